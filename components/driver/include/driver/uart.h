@@ -588,6 +588,18 @@ esp_err_t uart_flush_input(uart_port_t uart_num);
  */
 esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t* size);
 
+/**
+ * @brief   UART get free space in TX ring buffer, or in TX FIFO if the driver was installed without TX buffer
+ *
+ * @param   uart_num UART port number, the max port number is (UART_NUM_MAX -1).
+ * @param   size Pointer of size_t to accept the free space, in bytes
+ *
+ * @return
+ *     - ESP_OK Success
+ *     - ESP_FAIL Parameter error
+ */
+esp_err_t uart_get_tx_buffer_free_size(uart_port_t uart_num, size_t* size);
+
 /**
  * @brief   UART disable pattern detect function.
  *          Designed for applications like 'AT commands'.
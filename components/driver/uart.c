@@ -704,6 +704,11 @@ static void UART_ISR_ATTR uart_rx_intr_handler_default(void *param)
             uart_hal_disable_intr_mask(&(uart_context[uart_num].hal), UART_INTR_TXFIFO_EMPTY);
             UART_EXIT_CRITICAL_ISR(&(uart_context[uart_num].spinlock));
             uart_hal_clr_intsts_mask(&(uart_context[uart_num].hal), UART_INTR_TXFIFO_EMPTY);
+            UART_ENTER_CRITICAL_ISR(&uart_selectlock);
+            if (p_uart->uart_select_notif_callback) {
+                p_uart->uart_select_notif_callback(uart_num, UART_SELECT_WRITE_NOTIF, &HPTaskAwoken);
+            }
+            UART_EXIT_CRITICAL_ISR(&uart_selectlock);
             if(p_uart->tx_waiting_brk) {
                 continue;
             }
@@ -1215,6 +1220,18 @@ esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t* size)
     return ESP_OK;
 }
 
+esp_err_t uart_get_tx_buffer_free_size(uart_port_t uart_num, size_t* size)
+{
+    UART_CHECK((uart_num < UART_NUM_MAX), "uart_num error", ESP_FAIL);
+    UART_CHECK((p_uart_obj[uart_num]), "uart driver error", ESP_FAIL);
+    if (p_uart_obj[uart_num]->tx_buf_size > 0) {
+        *size = xRingbufferGetCurFreeSize(p_uart_obj[uart_num]->tx_ring_buf);
+    } else {
+        *size = uart_hal_get_txfifo_len(&(uart_context[uart_num].hal));
+    }
+    return ESP_OK;
+}
+
 esp_err_t uart_flush(uart_port_t uart_num) __attribute__((alias("uart_flush_input")));
 
 esp_err_t uart_flush_input(uart_port_t uart_num)
@@ -84,6 +84,16 @@ esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id,
             event_data, event_data_size, ticks_to_wait);
 }
 
+esp_err_t esp_event_post_ref(esp_event_base_t event_base, int32_t event_id,
+        void* event_data, esp_event_data_release_t release, void* release_arg, TickType_t ticks_to_wait)
+{
+    if (s_default_loop == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return esp_event_post_ref_to(s_default_loop, event_base, event_id,
+            event_data, release, release_arg, ticks_to_wait);
+}
 
 #if CONFIG_ESP_EVENT_POST_FROM_ISR
 esp_err_t esp_event_isr_post(esp_event_base_t event_base, int32_t event_id,
@@ -16,6 +16,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <sys/param.h>
 
 #include "esp_log.h"
 
@@ -319,7 +320,19 @@ static esp_err_t loop_node_add_handler(esp_event_loop_node_t* loop_node,
     }
 }
 
-static esp_err_t handler_instances_remove(esp_event_handler_nodes_t* handlers, esp_event_handler_instance_context_t* handler_ctx, bool legacy)
+static void handler_instance_delete(esp_event_loop_instance_t* loop, esp_event_handler_node_t* handler)
+{
+    if (loop->dispatch_depth > 0) {
+        // The handler may be in the dispatch entry being executed, free it once the dispatch is done
+        handler->removed = true;
+        SLIST_INSERT_HEAD(&(loop->removed_handlers), handler, next);
+    } else {
+        free(handler->handler_ctx);
+        free(handler);
+    }
+}
+
+static esp_err_t handler_instances_remove(esp_event_loop_instance_t* loop, esp_event_handler_nodes_t* handlers, esp_event_handler_instance_context_t* handler_ctx, bool legacy)
 {
     esp_event_handler_node_t *it, *temp;
 
@@ -327,15 +340,13 @@ static esp_err_t handler_instances_remove(esp_event_handler_nodes_t* handlers, e
         if (legacy) {
             if (it->handler_ctx->handler == handler_ctx->handler) {
                 SLIST_REMOVE(handlers, it, esp_event_handler_node, next);
-                free(it->handler_ctx);
-                free(it);
+                handler_instance_delete(loop, it);
                 return ESP_OK;
             }
         } else {
             if (it->handler_ctx == handler_ctx) {
                 SLIST_REMOVE(handlers, it, esp_event_handler_node, next);
-                free(it->handler_ctx);
-                free(it);
+                handler_instance_delete(loop, it);
                 return ESP_OK;
             }
         }
@@ -345,16 +356,16 @@ static esp_err_t handler_instances_remove(esp_event_handler_nodes_t* handlers, e
 }
 
 
-static esp_err_t base_node_remove_handler(esp_event_base_node_t* base_node, int32_t id, esp_event_handler_instance_context_t* handler_ctx, bool legacy)
+static esp_err_t base_node_remove_handler(esp_event_loop_instance_t* loop, esp_event_base_node_t* base_node, int32_t id, esp_event_handler_instance_context_t* handler_ctx, bool legacy)
 {
     if (id == ESP_EVENT_ANY_ID) {
-        return handler_instances_remove(&(base_node->handlers), handler_ctx, legacy);
+        return handler_instances_remove(loop, &(base_node->handlers), handler_ctx, legacy);
     }
     else {
         esp_event_id_node_t *it, *temp;
         SLIST_FOREACH_SAFE(it, &(base_node->id_nodes), next, temp) {
             if (it->id == id) {
-                esp_err_t res = handler_instances_remove(&(it->handlers), handler_ctx, legacy);
+                esp_err_t res = handler_instances_remove(loop, &(it->handlers), handler_ctx, legacy);
 
                 if (res == ESP_OK) {
                     if (SLIST_EMPTY(&(it->handlers))) {
@@ -370,16 +381,16 @@ static esp_err_t base_node_remove_handler(esp_event_base_node_t* base_node, int3
     return ESP_ERR_NOT_FOUND;
 }
 
-static esp_err_t loop_node_remove_handler(esp_event_loop_node_t* loop_node, esp_event_base_t base, int32_t id, esp_event_handler_instance_context_t* handler_ctx, bool legacy)
+static esp_err_t loop_node_remove_handler(esp_event_loop_instance_t* loop, esp_event_loop_node_t* loop_node, esp_event_base_t base, int32_t id, esp_event_handler_instance_context_t* handler_ctx, bool legacy)
 {
     if (base == esp_event_any_base && id == ESP_EVENT_ANY_ID) {
-        return handler_instances_remove(&(loop_node->handlers), handler_ctx, legacy);
+        return handler_instances_remove(loop, &(loop_node->handlers), handler_ctx, legacy);
     }
     else {
         esp_event_base_node_t *it, *temp;
         SLIST_FOREACH_SAFE(it, &(loop_node->base_nodes), next, temp) {
             if (it->base == base) {
-                esp_err_t res = base_node_remove_handler(it, id, handler_ctx, legacy);
+                esp_err_t res = base_node_remove_handler(loop, it, id, handler_ctx, legacy);
 
                 if (res == ESP_OK) {
                     if (SLIST_EMPTY(&(it->handlers)) && SLIST_EMPTY(&(it->id_nodes))) {
@@ -432,17 +443,222 @@ static void loop_node_remove_all_handler(esp_event_loop_node_t* loop_node)
 static void inline __attribute__((always_inline)) post_instance_delete(esp_event_post_instance_t* post)
 {
 #if CONFIG_ESP_EVENT_POST_FROM_ISR
-    if (post->data_allocated && post->data.ptr) {
+    if (post->release) {
+        post->release(post->data.ptr, post->release_arg);
+    } else if (post->data_allocated && post->data.ptr) {
         free(post->data.ptr);
     }
 #else
-    if (post->data) {
+    if (post->release) {
+        post->release(post->data, post->release_arg);
+    } else if (post->data) {
         free(post->data);
     }
 #endif
     memset(post, 0, sizeof(*post));
 }
 
+static void post_data_keep(void* data, void* arg)
+{
+    // data posted by reference without a release function, nothing to do
+}
+
+static esp_err_t data_pool_init(esp_event_data_pool_t* pool, size_t count, size_t item_size)
+{
+    // Free buffers hold the link of the free list. Keep all buffers aligned for any type of data.
+    item_size = (MAX(item_size, sizeof(void*)) + 7) & ~7;
+
+    pool->items = malloc(count * item_size);
+    if (pool->items == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    pool->item_size = item_size;
+    pool->free_items = NULL;
+    vPortCPUInitializeMutex(&pool->lock);
+
+    for (size_t i = count; i > 0; i--) {
+        void** item = (void**) ((char*) pool->items + (i - 1) * item_size);
+        *item = pool->free_items;
+        pool->free_items = item;
+    }
+
+    return ESP_OK;
+}
+
+static void* data_pool_alloc(esp_event_data_pool_t* pool, size_t size)
+{
+    if (pool->items == NULL || size > pool->item_size) {
+        return NULL;
+    }
+
+    portENTER_CRITICAL(&pool->lock);
+    void** item = (void**) pool->free_items;
+    if (item != NULL) {
+        pool->free_items = *item;
+    }
+    portEXIT_CRITICAL(&pool->lock);
+
+    return item;
+}
+
+static void data_pool_release(void* data, void* arg)
+{
+    esp_event_data_pool_t* pool = (esp_event_data_pool_t*) arg;
+
+    portENTER_CRITICAL(&pool->lock);
+    *((void**) data) = pool->free_items;
+    pool->free_items = data;
+    portEXIT_CRITICAL(&pool->lock);
+}
+
+// Walks the handlers to execute for an event, in the order they have to be executed. The handlers are
+// stored to handlers if not NULL, and executed if execute is set. Returns the number of handlers.
+static size_t event_handlers_walk(esp_event_loop_instance_t* loop, esp_event_post_instance_t* post,
+                                  esp_event_handler_node_t** handlers, bool execute)
+{
+    size_t count = 0;
+
+    esp_event_handler_node_t *handler, *temp_handler;
+    esp_event_loop_node_t *loop_node, *temp_node;
+    esp_event_base_node_t *base_node, *temp_base;
+    esp_event_id_node_t *id_node, *temp_id_node;
+
+#define HANDLER_VISIT(handler)  do { \
+                                    if (handlers) { \
+                                        handlers[count] = handler; \
+                                    } \
+                                    if (execute) { \
+                                        handler_execute(loop, handler, *post); \
+                                    } \
+                                    count++; \
+                                } while(0)
+
+    SLIST_FOREACH_SAFE(loop_node, &(loop->loop_nodes), next, temp_node) {
+        // Loop level handlers
+        SLIST_FOREACH_SAFE(handler, &(loop_node->handlers), next, temp_handler) {
+            HANDLER_VISIT(handler);
+        }
+
+        SLIST_FOREACH_SAFE(base_node, &(loop_node->base_nodes), next, temp_base) {
+            if (base_node->base == post->base) {
+                // Base level handlers
+                SLIST_FOREACH_SAFE(handler, &(base_node->handlers), next, temp_handler) {
+                    HANDLER_VISIT(handler);
+                }
+
+                SLIST_FOREACH_SAFE(id_node, &(base_node->id_nodes), next, temp_id_node) {
+                    if (id_node->id == post->id) {
+                        // Id level handlers
+                        SLIST_FOREACH_SAFE(handler, &(id_node->handlers), next, temp_handler) {
+                            HANDLER_VISIT(handler);
+                        }
+                        // Skip to next base node
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+#undef HANDLER_VISIT
+
+    return count;
+}
+
+static inline size_t dispatch_index_bucket(esp_event_base_t base, int32_t id)
+{
+    // Event bases are string pointers, mix in the id with a multiplicative hash
+    uint32_t hash = ((uint32_t) (uintptr_t) base >> 2) ^ ((uint32_t) id * 2654435761u);
+    return (hash ^ (hash >> 16)) % ESP_EVENT_DISPATCH_INDEX_SIZE;
+}
+
+// Returns the handlers to execute for an event, creating the index entry on the first post of the event.
+// Returns NULL if there is not enough memory for a new entry.
+static esp_event_dispatch_entry_t* dispatch_entry_get(esp_event_loop_instance_t* loop, esp_event_post_instance_t* post)
+{
+    esp_event_dispatch_entries_t* bucket = &(loop->dispatch_index[dispatch_index_bucket(post->base, post->id)]);
+    esp_event_dispatch_entry_t* entry;
+
+    SLIST_FOREACH(entry, bucket, next) {
+        if (entry->base == post->base && entry->id == post->id) {
+            return entry;
+        }
+    }
+
+    size_t count = event_handlers_walk(loop, post, NULL, false);
+    entry = calloc(1, sizeof(*entry) + count * sizeof(entry->handlers[0]));
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    entry->base = post->base;
+    entry->id = post->id;
+    entry->count = event_handlers_walk(loop, post, entry->handlers, false);
+    SLIST_INSERT_HEAD(bucket, entry, next);
+
+    return entry;
+}
+
+// Drops all the entries of the dispatch index, must be called whenever handlers are (un)registered
+static void dispatch_index_clear(esp_event_loop_instance_t* loop)
+{
+    for (int i = 0; i < ESP_EVENT_DISPATCH_INDEX_SIZE; i++) {
+        esp_event_dispatch_entry_t *it, *temp;
+        SLIST_FOREACH_SAFE(it, &(loop->dispatch_index[i]), next, temp) {
+            SLIST_REMOVE(&(loop->dispatch_index[i]), it, esp_event_dispatch_entry, next);
+            if (it->dispatching > 0) {
+                // freed by esp_event_loop_run when done executing its handlers
+                it->stale = true;
+            } else {
+                free(it);
+            }
+        }
+    }
+}
+
+static esp_err_t post_instance_send(esp_event_loop_instance_t* loop, esp_event_post_instance_t* post, TickType_t ticks_to_wait)
+{
+    BaseType_t result = pdFALSE;
+
+    // Find the task that currently executes the loop. It is safe to query loop->task since it is
+    // not mutated since loop creation. ENSURE THIS REMAINS TRUE.
+    if (loop->task == NULL) {
+        // The loop has no dedicated task. Find out what task is currently running it.
+        result = xSemaphoreTakeRecursive(loop->mutex, ticks_to_wait);
+
+        if (result == pdTRUE) {
+            if (loop->running_task != xTaskGetCurrentTaskHandle()) {
+                xSemaphoreGiveRecursive(loop->mutex);
+                result = xQueueSendToBack(loop->queue, post, ticks_to_wait);
+            } else {
+                xSemaphoreGiveRecursive(loop->mutex);
+                result = xQueueSendToBack(loop->queue, post, 0);
+            }
+        }
+    } else {
+        // The loop has a dedicated task.
+        if (loop->task != xTaskGetCurrentTaskHandle()) {
+            result = xQueueSendToBack(loop->queue, post, ticks_to_wait);
+        } else {
+            result = xQueueSendToBack(loop->queue, post, 0);
+        }
+    }
+
+    if (result != pdTRUE) {
+#ifdef CONFIG_ESP_EVENT_LOOP_PROFILING
+        atomic_fetch_add(&loop->events_dropped, 1);
+#endif
+        return ESP_ERR_TIMEOUT;
+    }
+
+#ifdef CONFIG_ESP_EVENT_LOOP_PROFILING
+    atomic_fetch_add(&loop->events_recieved, 1);
+#endif
+
+    return ESP_OK;
+}
+
 /* ---------------------------- Public API --------------------------------- */
 
 esp_err_t esp_event_loop_create(const esp_event_loop_args_t* event_loop_args, esp_event_loop_handle_t* event_loop)
@@ -479,6 +695,17 @@ esp_err_t esp_event_loop_create(const esp_event_loop_args_t* event_loop_args, es
 #endif
 
     SLIST_INIT(&(loop->loop_nodes));
+    SLIST_INIT(&(loop->removed_handlers));
+    for (int i = 0; i < ESP_EVENT_DISPATCH_INDEX_SIZE; i++) {
+        SLIST_INIT(&(loop->dispatch_index[i]));
+    }
+
+    if (event_loop_args->data_pool_size > 0) {
+        if (data_pool_init(&(loop->data_pool), event_loop_args->data_pool_size, event_loop_args->data_pool_item_size) != ESP_OK) {
+            ESP_LOGE(TAG, "alloc for event data pool failed");
+            goto on_err;
+        }
+    }
 
     // Create the loop task if requested
     if (event_loop_args->task_name != NULL) {
@@ -529,17 +756,16 @@ on_err:
     }
 #endif
 
+    free(loop->data_pool.items);
     free(loop);
 
     return err;
 }
 
-// On event lookup performance: The library implements the event list as a linked list, which results to O(n)
-// lookup time. The test comparing this implementation to the O(lg n) performance of rbtrees
-// (https://github.com/freebsd/freebsd/blob/master/sys/sys/tree.h)
-// indicate that the difference is not that substantial, especially considering the additional
-// pointers per node of rbtrees. Code for the rbtree implementation of the event loop library is archived
-// in feature/esp_event_loop_library_rbtrees if needed.
+// On event lookup performance: The library keeps the registered handlers in linked lists, which results in O(n)
+// lookup time. To avoid walking the lists for every post, the handlers to execute for an event are collected in
+// an array the first time the event is posted, and kept in a hash table indexed by event base and id. The table
+// is cleared whenever handlers are registered or unregistered.
 esp_err_t esp_event_loop_run(esp_event_loop_handle_t event_loop, TickType_t ticks_to_run)
 {
     assert(event_loop);
@@ -563,39 +789,36 @@ esp_err_t esp_event_loop_run(esp_event_loop_handle_t event_loop, TickType_t tick
 
         bool exec = false;
 
-        esp_event_handler_node_t *handler, *temp_handler;
-        esp_event_loop_node_t *loop_node, *temp_node;
-        esp_event_base_node_t *base_node, *temp_base;
-        esp_event_id_node_t *id_node, *temp_id_node;
+        esp_event_dispatch_entry_t* entry = dispatch_entry_get(loop, &post);
 
-        SLIST_FOREACH_SAFE(loop_node, &(loop->loop_nodes), next, temp_node) {
-            // Execute loop level handlers
-            SLIST_FOREACH_SAFE(handler, &(loop_node->handlers), next, temp_handler) {
-                handler_execute(loop, handler, post);
-                exec |= true;
+        if (entry != NULL) {
+            // Handlers (un)registered by the handlers below take effect from the next event on
+            loop->dispatch_depth++;
+            entry->dispatching++;
+
+            for (size_t i = 0; i < entry->count; i++) {
+                if (!entry->handlers[i]->removed) {
+                    handler_execute(loop, entry->handlers[i], post);
+                }
             }
+            exec = entry->count > 0;
 
-            SLIST_FOREACH_SAFE(base_node, &(loop_node->base_nodes), next, temp_base) {
-                if (base_node->base == post.base) {
-                    // Execute base level handlers
-                    SLIST_FOREACH_SAFE(handler, &(base_node->handlers), next, temp_handler) {
-                        handler_execute(loop, handler, post);
-                        exec |= true;
-                    }
+            entry->dispatching--;
+            if (entry->stale && entry->dispatching == 0) {
+                free(entry);
+            }
 
-                    SLIST_FOREACH_SAFE(id_node, &(base_node->id_nodes), next, temp_id_node) {
-                        if (id_node->id == post.id) {
-                            // Execute id level handlers
-                            SLIST_FOREACH_SAFE(handler, &(id_node->handlers), next, temp_handler) {
-                                handler_execute(loop, handler, post);
-                                exec |= true;
-                            }
-                            // Skip to next base node
-                            break;
-                        }
-                    }
+            if (--loop->dispatch_depth == 0) {
+                esp_event_handler_node_t *it, *temp;
+                SLIST_FOREACH_SAFE(it, &(loop->removed_handlers), next, temp) {
+                    free(it->handler_ctx);
+                    free(it);
                 }
+                SLIST_INIT(&(loop->removed_handlers));
             }
+        } else {
+            // Not enough memory to index the event, execute the handlers while walking the lists
+            exec = event_handlers_walk(loop, &post, NULL, true) > 0;
         }
 
         esp_event_base_t base = post.base;
@@ -660,6 +883,8 @@ esp_err_t esp_event_loop_delete(esp_event_loop_handle_t event_loop)
         free(it);
     }
 
+    dispatch_index_clear(loop);
+
     // Drop existing posts on the queue
     esp_event_post_instance_t post;
     while(xQueueReceive(loop->queue, &post, 0) == pdTRUE) {
@@ -668,6 +893,7 @@ esp_err_t esp_event_loop_delete(esp_event_loop_handle_t event_loop)
 
     // Cleanup loop
     vQueueDelete(loop->queue);
+    free(loop->data_pool.items);
     free(loop);
     // Free loop mutex before deleting
     xSemaphoreGiveRecursive(loop_mutex);
@@ -742,6 +968,10 @@ esp_err_t esp_event_handler_register_with_internal(esp_event_loop_handle_t event
         err = loop_node_add_handler(last_loop_node, event_base, event_id, event_handler, event_handler_arg, handler_ctx_arg, legacy);
     }
 
+    if (err == ESP_OK) {
+        dispatch_index_clear(loop);
+    }
+
 on_err:
     xSemaphoreGiveRecursive(loop->mutex);
     return err;
@@ -782,7 +1012,7 @@ esp_err_t esp_event_handler_unregister_with_internal(esp_event_loop_handle_t eve
     esp_event_loop_node_t *it, *temp;
 
     SLIST_FOREACH_SAFE(it, &(loop->loop_nodes), next, temp) {
-        esp_err_t res = loop_node_remove_handler(it, event_base, event_id, handler_ctx, legacy);
+        esp_err_t res = loop_node_remove_handler(loop, it, event_base, event_id, handler_ctx, legacy);
 
         if (res == ESP_OK && SLIST_EMPTY(&(it->base_nodes)) && SLIST_EMPTY(&(it->handlers))) {
             SLIST_REMOVE(&(loop->loop_nodes), it, esp_event_loop_node, next);
@@ -791,6 +1021,8 @@ esp_err_t esp_event_handler_unregister_with_internal(esp_event_loop_handle_t eve
         }
     }
 
+    dispatch_index_clear(loop);
+
     xSemaphoreGiveRecursive(loop->mutex);
 
     return ESP_OK;
@@ -829,11 +1061,18 @@ esp_err_t esp_event_post_to(esp_event_loop_handle_t event_loop, esp_event_base_t
     memset((void*)(&post), 0, sizeof(post));
 
     if (event_data != NULL && event_data_size != 0) {
-        // Make persistent copy of event data on heap.
-        void* event_data_copy = calloc(1, event_data_size);
+        // Make persistent copy of event data, in a buffer of the pool if there is one free
+        void* event_data_copy = data_pool_alloc(&(loop->data_pool), event_data_size);
+
+        if (event_data_copy != NULL) {
+            post.release = data_pool_release;
+            post.release_arg = &(loop->data_pool);
+        } else {
+            event_data_copy = calloc(1, event_data_size);
 
-        if (event_data_copy == NULL) {
-            return ESP_ERR_NO_MEM;
+            if (event_data_copy == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
         }
 
         memcpy(event_data_copy, event_data, event_data_size);
@@ -848,46 +1087,43 @@ esp_err_t esp_event_post_to(esp_event_loop_handle_t event_loop, esp_event_base_t
     post.base = event_base;
     post.id = event_id;
 
-    BaseType_t result = pdFALSE;
+    esp_err_t err = post_instance_send(loop, &post, ticks_to_wait);
 
-    // Find the task that currently executes the loop. It is safe to query loop->task since it is
-    // not mutated since loop creation. ENSURE THIS REMAINS TRUE.
-    if (loop->task == NULL) {
-        // The loop has no dedicated task. Find out what task is currently running it.
-        result = xSemaphoreTakeRecursive(loop->mutex, ticks_to_wait);
-
-        if (result == pdTRUE) {
-            if (loop->running_task != xTaskGetCurrentTaskHandle()) {
-                xSemaphoreGiveRecursive(loop->mutex);
-                result = xQueueSendToBack(loop->queue, &post, ticks_to_wait);
-            } else {
-                xSemaphoreGiveRecursive(loop->mutex);
-                result = xQueueSendToBack(loop->queue, &post, 0);
-            }
-        }
-    } else {
-        // The loop has a dedicated task.
-        if (loop->task != xTaskGetCurrentTaskHandle()) {
-            result = xQueueSendToBack(loop->queue, &post, ticks_to_wait);
-        } else {
-            result = xQueueSendToBack(loop->queue, &post, 0);
-        }
+    if (err != ESP_OK) {
+        post_instance_delete(&post);
     }
 
-    if (result != pdTRUE) {
-        post_instance_delete(&post);
+    return err;
+}
 
-#ifdef CONFIG_ESP_EVENT_LOOP_PROFILING
-        atomic_fetch_add(&loop->events_dropped, 1);
-#endif
-        return ESP_ERR_TIMEOUT;
+esp_err_t esp_event_post_ref_to(esp_event_loop_handle_t event_loop, esp_event_base_t event_base, int32_t event_id,
+                                void* event_data, esp_event_data_release_t release, void* release_arg, TickType_t ticks_to_wait)
+{
+    assert(event_loop);
+
+    if (event_base == ESP_EVENT_ANY_BASE || event_id == ESP_EVENT_ANY_ID) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-#ifdef CONFIG_ESP_EVENT_LOOP_PROFILING
-    atomic_fetch_add(&loop->events_recieved, 1);
+    esp_event_loop_instance_t* loop = (esp_event_loop_instance_t*) event_loop;
+
+    esp_event_post_instance_t post;
+    memset((void*)(&post), 0, sizeof(post));
+
+#if CONFIG_ESP_EVENT_POST_FROM_ISR
+    post.data.ptr = event_data;
+    post.data_allocated = true;
+    post.data_set = (event_data != NULL);
+#else
+    post.data = event_data;
 #endif
+    post.release = (release != NULL) ? release : post_data_keep;
+    post.release_arg = release_arg;
+    post.base = event_base;
+    post.id = event_id;
 
-    return ESP_OK;
+    // On failure the data still belongs to the caller, don't release it
+    return post_instance_send(loop, &post, ticks_to_wait);
 }
 
 #if CONFIG_ESP_EVENT_POST_FROM_ISR
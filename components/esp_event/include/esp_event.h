@@ -38,8 +38,20 @@ typedef struct {
     uint32_t task_stack_size;                   /**< stack size of the event loop task, ignored if task name is NULL */
     BaseType_t task_core_id;                    /**< core to which the event loop task is pinned to,
                                                         ignored if task name is NULL */
+    uint32_t data_pool_size;                    /**< number of event data buffers preallocated for the loop;
+                                                        if 0, event data is always allocated from heap */
+    uint32_t data_pool_item_size;               /**< size of each preallocated event data buffer; data of
+                                                        events posted with larger size is allocated from heap */
 } esp_event_loop_args_t;
 
+/**
+ * @brief Function called to release the data of an event posted by reference, once all handlers have run
+ *
+ * @param[in] event_data the data which was passed to esp_event_post_ref_to
+ * @param[in] release_arg the argument which was passed to esp_event_post_ref_to
+ */
+typedef void (*esp_event_data_release_t)(void *event_data, void *release_arg);
+
 /**
  * @brief Create a new event loop.
  *
@@ -388,6 +400,9 @@ esp_err_t esp_event_post(esp_event_base_t event_base,
  * This function behaves in the same manner as esp_event_post_to, except the additional specification of the event loop
  * to post the event to.
  *
+ * If the loop was created with a data pool and event_data_size is not larger than its item size, the copy
+ * is stored in a preallocated buffer of the pool instead of being allocated from heap.
+ *
  * @param[in] event_loop the event loop to post to
  * @param[in] event_base the event base that identifies the event
  * @param[in] event_id the event id that identifies the event
@@ -409,6 +424,66 @@ esp_err_t esp_event_post_to(esp_event_loop_handle_t event_loop,
                             size_t event_data_size,
                             TickType_t ticks_to_wait);
 
+/**
+ * @brief Posts an event and its data by reference to the default event loop.
+ *
+ * This function behaves in the same manner as esp_event_post_ref_to, except that the event is posted
+ * to the default event loop.
+ *
+ * @param[in] event_base the event base that identifies the event
+ * @param[in] event_id the event id that identifies the event
+ * @param[in] event_data the data, specific to the event occurence, that gets passed to the handler
+ * @param[in] release function called once the data is no longer used by the loop, can be NULL
+ * @param[in] release_arg argument passed to the release function
+ * @param[in] ticks_to_wait number of ticks to block on a full event queue
+ *
+ * @return
+ *  - ESP_OK: Success
+ *  - ESP_ERR_TIMEOUT: Time to wait for event queue to unblock expired
+ *  - ESP_ERR_INVALID_ARG: Invalid combination of event base and event id
+ *  - ESP_ERR_INVALID_STATE: Default event loop has not been created
+ *  - Others: Fail
+ */
+esp_err_t esp_event_post_ref(esp_event_base_t event_base,
+                             int32_t event_id,
+                             void *event_data,
+                             esp_event_data_release_t release,
+                             void *release_arg,
+                             TickType_t ticks_to_wait);
+
+/**
+ * @brief Posts an event and its data by reference to the specified event loop.
+ *
+ * Unlike esp_event_post_to, the event data is not copied: the handlers receive the event_data pointer
+ * itself. The data must remain valid, and must not be modified, until the loop calls the release
+ * function, after all the handlers of the event have run. The release function is called from the task
+ * running the loop, or from esp_event_loop_delete if the event is still queued when the loop is deleted.
+ *
+ * If the event can't be posted, the release function is not called and the caller keeps ownership
+ * of the data.
+ *
+ * @param[in] event_loop the event loop to post to
+ * @param[in] event_base the event base that identifies the event
+ * @param[in] event_id the event id that identifies the event
+ * @param[in] event_data the data, specific to the event occurence, that gets passed to the handler
+ * @param[in] release function called once the data is no longer used by the loop, can be NULL
+ * @param[in] release_arg argument passed to the release function
+ * @param[in] ticks_to_wait number of ticks to block on a full event queue
+ *
+ * @return
+ *  - ESP_OK: Success
+ *  - ESP_ERR_TIMEOUT: Time to wait for event queue to unblock expired
+ *  - ESP_ERR_INVALID_ARG: Invalid combination of event base and event id
+ *  - Others: Fail
+ */
+esp_err_t esp_event_post_ref_to(esp_event_loop_handle_t event_loop,
+                                esp_event_base_t event_base,
+                                int32_t event_id,
+                                void *event_data,
+                                esp_event_data_release_t release,
+                                void *release_arg,
+                                TickType_t ticks_to_wait);
+
 #if CONFIG_ESP_EVENT_POST_FROM_ISR
 /**
  * @brief Special variant of esp_event_post for posting events from interrupt handlers.
@@ -36,6 +36,8 @@ typedef struct esp_event_handler_node {
     uint32_t invoked;                                               /**< number of times this handler has been invoked */
     int64_t time;                                                   /**< total runtime of this handler across all calls */
 #endif
+    bool removed;                                                   /**< unregistered while an event is dispatched,
+                                                                            freed once the dispatch is done */
     SLIST_ENTRY(esp_event_handler_node) next;                   /**< next event handler in the list */
 } esp_event_handler_node_t;
 
@@ -71,6 +73,30 @@ typedef struct esp_event_loop_node {
 
 typedef SLIST_HEAD(esp_event_loop_nodes, esp_event_loop_node) esp_event_loop_nodes_t;
 
+/// Handlers to execute for an event, in the order given by the loop nodes
+typedef struct esp_event_dispatch_entry {
+    esp_event_base_t base;                                          /**< base identifier of the event */
+    int32_t id;                                                     /**< id number of the event */
+    uint32_t dispatching;                                           /**< number of dispatches executing the entry */
+    bool stale;                                                     /**< handlers were (un)registered while the
+                                                                            entry was being executed, free it after */
+    SLIST_ENTRY(esp_event_dispatch_entry) next;                     /**< next entry in the same index bucket */
+    size_t count;                                                   /**< number of handlers */
+    esp_event_handler_node_t* handlers[];                           /**< handlers to execute */
+} esp_event_dispatch_entry_t;
+
+typedef SLIST_HEAD(esp_event_dispatch_entries, esp_event_dispatch_entry) esp_event_dispatch_entries_t;
+
+#define ESP_EVENT_DISPATCH_INDEX_SIZE   32                          /**< number of buckets of the dispatch index */
+
+/// Preallocated buffers for the data of posted events
+typedef struct esp_event_data_pool {
+    void* items;                                                    /**< memory of all the buffers */
+    void* free_items;                                               /**< list of free buffers, linked through
+                                                                            their first word */
+    size_t item_size;                                               /**< size of a buffer */
+    portMUX_TYPE lock;                                              /**< lock protecting the free list */
+} esp_event_data_pool_t;
 /// Event loop
 typedef struct esp_event_loop_instance {
     const char* name;                                               /**< name of this event loop */
@@ -81,6 +107,11 @@ typedef struct esp_event_loop_instance {
     SemaphoreHandle_t mutex;                                        /**< mutex for updating the events linked list */
     esp_event_loop_nodes_t loop_nodes;                              /**< set of linked lists containing the
                                                                             registered handlers for the loop */
+    esp_event_dispatch_entries_t dispatch_index[ESP_EVENT_DISPATCH_INDEX_SIZE]; /**< hash table of the handlers
+                                                                            to execute for each event posted so far */
+    uint32_t dispatch_depth;                                        /**< number of events being dispatched */
+    esp_event_handler_nodes_t removed_handlers;                     /**< handlers unregistered while dispatching */
+    esp_event_data_pool_t data_pool;                                /**< buffers for the data of posted events */
 #ifdef CONFIG_ESP_EVENT_LOOP_PROFILING
     atomic_uint_least32_t events_recieved;                          /**< number of events successfully posted to the loop */
     atomic_uint_least32_t events_dropped;                           /**< number of events dropped due to queue being full */
@@ -107,6 +138,8 @@ typedef struct esp_event_post_instance {
     esp_event_base_t base;                                           /**< the event base */
     int32_t id;                                                      /**< the event id */
     esp_event_post_data_t data;                                      /**< data associated with the event */
+    esp_event_data_release_t release;                                /**< if set, releases the data instead of free() */
+    void* release_arg;                                               /**< argument of the release function */
 } esp_event_post_instance_t;
 
 #ifdef __cplusplus
@@ -1540,6 +1540,175 @@ TEST_CASE("performance test - no dedicated task", "[event]")
     performance_test(false);
 }
 
+static void test_event_release_counter(void* event_data, void* release_arg)
+{
+    (*((int*) release_arg))++;
+}
+
+TEST_CASE("can post events by reference and from data pool", "[event]")
+{
+    TEST_SETUP();
+
+    esp_event_loop_handle_t loop;
+    esp_event_loop_args_t loop_args = test_event_get_default_loop_args();
+
+    loop_args.task_name = NULL;
+    loop_args.queue_size = 4;
+    loop_args.data_pool_size = 2;
+    loop_args.data_pool_item_size = sizeof(int);
+    TEST_ESP_OK(esp_event_loop_create(&loop_args, &loop));
+
+    int count = 0;
+    simple_arg_t arg = {
+        .data = &count,
+        .mutex = xSemaphoreCreateMutex()
+    };
+
+    TEST_ESP_OK(esp_event_handler_register_with(loop, s_test_base1, TEST_EVENT_BASE1_EV1, test_event_simple_handler, &arg));
+
+    // two events use the pool, the third one falls back to heap
+    int data = 1;
+    TEST_ESP_OK(esp_event_post_to(loop, s_test_base1, TEST_EVENT_BASE1_EV1, &data, sizeof(data), portMAX_DELAY));
+    data = 10;
+    TEST_ESP_OK(esp_event_post_to(loop, s_test_base1, TEST_EVENT_BASE1_EV1, &data, sizeof(data), portMAX_DELAY));
+    data = 100;
+    TEST_ESP_OK(esp_event_post_to(loop, s_test_base1, TEST_EVENT_BASE1_EV1, &data, sizeof(data), portMAX_DELAY));
+    TEST_ESP_OK(esp_event_loop_run(loop, pdMS_TO_TICKS(10)));
+    TEST_ASSERT_EQUAL(111, count);
+
+    // data posted by reference is released after the handlers have run
+    int released = 0;
+    int ref_data = 1000;
+    TEST_ESP_OK(esp_event_post_ref_to(loop, s_test_base1, TEST_EVENT_BASE1_EV1, &ref_data, test_event_release_counter, &released, portMAX_DELAY));
+    TEST_ASSERT_EQUAL(0, released);
+    ref_data = 2000;
+    TEST_ESP_OK(esp_event_loop_run(loop, pdMS_TO_TICKS(10)));
+    TEST_ASSERT_EQUAL(2111, count);
+    TEST_ASSERT_EQUAL(1, released);
+
+    // data which could not be posted is not released, queued data is released when the loop is deleted
+    for (int i = 0; i < loop_args.queue_size; i++) {
+        TEST_ESP_OK(esp_event_post_ref_to(loop, s_test_base1, TEST_EVENT_BASE1_EV1, &ref_data, test_event_release_counter, &released, 0));
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, esp_event_post_ref_to(loop, s_test_base1, TEST_EVENT_BASE1_EV1, &ref_data, test_event_release_counter, &released, 0));
+    TEST_ESP_OK(esp_event_loop_delete(loop));
+    TEST_ASSERT_EQUAL(1 + loop_args.queue_size, released);
+
+    vSemaphoreDelete(arg.mutex);
+
+    TEST_TEARDOWN();
+}
+
+#define TEST_CONFIG_BENCH_HANDLERS          200
+#define TEST_CONFIG_BENCH_EVENTS            1000
+#define TEST_CONFIG_BENCH_QUEUE_SIZE        32
+
+typedef enum {
+    TEST_BENCH_POST_COPY,
+    TEST_BENCH_POST_POOL,
+    TEST_BENCH_POST_REF,
+} test_bench_post_mode_t;
+
+typedef struct {
+    int64_t posted_at;
+    uint32_t samples[6];
+} test_bench_event_data_t;
+
+typedef struct {
+    int count;
+    int64_t total_latency;
+    int released;
+    SemaphoreHandle_t done;
+} test_bench_data_t;
+
+static void test_event_bench_noop_handler(void* handler_arg, esp_event_base_t base, int32_t id, void* event_data)
+{
+}
+
+static void test_event_bench_handler(void* handler_arg, esp_event_base_t base, int32_t id, void* event_data)
+{
+    test_bench_data_t* data = (test_bench_data_t*) handler_arg;
+    test_bench_event_data_t* event = (test_bench_event_data_t*) event_data;
+
+    data->total_latency += esp_timer_get_time() - event->posted_at;
+    if (++data->count == TEST_CONFIG_BENCH_EVENTS) {
+        xSemaphoreGive(data->done);
+    }
+}
+
+static void test_event_bench_release(void* event_data, void* release_arg)
+{
+    ((test_bench_data_t*) release_arg)->released++;
+}
+
+static void post_benchmark(test_bench_post_mode_t mode, const char* name)
+{
+    esp_event_loop_args_t loop_args = test_event_get_default_loop_args();
+    loop_args.queue_size = TEST_CONFIG_BENCH_QUEUE_SIZE;
+    if (mode == TEST_BENCH_POST_POOL) {
+        loop_args.data_pool_size = TEST_CONFIG_BENCH_QUEUE_SIZE;
+        loop_args.data_pool_item_size = sizeof(test_bench_event_data_t);
+    }
+
+    esp_event_loop_handle_t loop;
+    TEST_ESP_OK(esp_event_loop_create(&loop_args, &loop));
+
+    test_bench_data_t data = {
+        .done = xSemaphoreCreateBinary()
+    };
+
+    // The measured event is registered last, after handlers for many other events of the same base
+    for (int id = 0; id < TEST_CONFIG_BENCH_HANDLERS; id++) {
+        TEST_ESP_OK(esp_event_handler_register_with(loop, s_test_base1, id, test_event_bench_noop_handler, NULL));
+    }
+    TEST_ESP_OK(esp_event_handler_register_with(loop, s_test_base1, TEST_CONFIG_BENCH_HANDLERS, test_event_bench_handler, &data));
+
+    // Events posted by reference need to stay valid until they are released
+    test_bench_event_data_t* events = calloc(mode == TEST_BENCH_POST_REF ? TEST_CONFIG_BENCH_EVENTS : 1, sizeof(test_bench_event_data_t));
+    TEST_ASSERT_NOT_NULL(events);
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < TEST_CONFIG_BENCH_EVENTS; i++) {
+        if (mode == TEST_BENCH_POST_REF) {
+            events[i].posted_at = esp_timer_get_time();
+            TEST_ESP_OK(esp_event_post_ref_to(loop, s_test_base1, TEST_CONFIG_BENCH_HANDLERS, &events[i],
+                                              test_event_bench_release, &data, portMAX_DELAY));
+        } else {
+            events[0].posted_at = esp_timer_get_time();
+            TEST_ESP_OK(esp_event_post_to(loop, s_test_base1, TEST_CONFIG_BENCH_HANDLERS, &events[0],
+                                          sizeof(events[0]), portMAX_DELAY));
+        }
+    }
+    TEST_ASSERT(xSemaphoreTake(data.done, pdMS_TO_TICKS(10000)));
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    TEST_ASSERT_EQUAL(TEST_CONFIG_BENCH_EVENTS, data.count);
+
+    TEST_ESP_OK(esp_event_loop_delete(loop));
+    if (mode == TEST_BENCH_POST_REF) {
+        TEST_ASSERT_EQUAL(TEST_CONFIG_BENCH_EVENTS, data.released);
+    }
+    free(events);
+    vSemaphoreDelete(data.done);
+
+    char item[48];
+    snprintf(item, sizeof(item), "event_post_%s_per_sec", name);
+    IDF_LOG_PERFORMANCE(item, "%d", (int) (TEST_CONFIG_BENCH_EVENTS * 1000000LL / elapsed));
+    snprintf(item, sizeof(item), "event_post_%s_latency_us", name);
+    IDF_LOG_PERFORMANCE(item, "%d", (int) (data.total_latency / TEST_CONFIG_BENCH_EVENTS));
+}
+
+TEST_CASE("performance test - post modes with many registered handlers", "[event]")
+{
+    TEST_SETUP();
+
+    post_benchmark(TEST_BENCH_POST_COPY, "copy");
+    post_benchmark(TEST_BENCH_POST_POOL, "pool");
+    post_benchmark(TEST_BENCH_POST_REF, "ref");
+
+    TEST_TEARDOWN();
+}
+
 TEST_CASE("can post to loop from handler - dedicated task", "[event]")
 {
     TEST_SETUP();
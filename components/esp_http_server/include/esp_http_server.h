@@ -44,6 +44,8 @@ initializer that should be kept in sync
         .lru_purge_enable   = false,                    \
         .recv_wait_timeout  = 5,                        \
         .send_wait_timeout  = 5,                        \
+        .sess_idle_timeout  = 0,                        \
+        .max_workers        = 0,                        \
         .global_user_ctx = NULL,                        \
         .global_user_ctx_free_fn = NULL,                \
         .global_transport_ctx = NULL,                   \
@@ -163,6 +165,31 @@ typedef struct httpd_config {
     uint16_t    recv_wait_timeout;  /*!< Timeout for recv function (in seconds)*/
     uint16_t    send_wait_timeout;  /*!< Timeout for send function (in seconds)*/
 
+    /**
+     * Close sessions which have been idle for this long (in seconds),
+     * 0 to keep them open until the client closes them.
+     *
+     * Connections are kept alive between requests, unless the client asks
+     * otherwise. Closing idle ones frees up sessions for new clients, as an
+     * alternative to lru_purge_enable. A session is active while a request
+     * is being processed, including asynchronous requests, or when
+     * httpd_sess_update_lru_counter() is called for it, e.g. after sending
+     * WebSocket frames.
+     */
+    uint16_t    sess_idle_timeout;
+
+    /**
+     * Number of worker tasks which process requests.
+     *
+     * With 0, requests are processed by the server task, one at a time, so a
+     * slow URI handler delays requests on all other sessions. Otherwise the
+     * server task dispatches sessions with a new request to a pool of worker
+     * tasks. Requests on the same session are still processed one at a time
+     * and in order. Each worker is created with the same stack size, priority
+     * and core affinity as the server task.
+     */
+    uint16_t    max_workers;
+
     /**
      * Global user context.
      *
@@ -234,9 +261,14 @@ typedef struct httpd_config {
      * Available options are:
      *     1) NULL : Internally do basic matching using `strncmp()`
      *     2) `httpd_uri_match_wildcard()` : URI wildcard matcher
+     *     3) `httpd_uri_match_params()` : URI wildcard matcher with path parameters
+     *
+     * With these options, registered URIs are indexed so that the cost of
+     * finding a handler doesn't grow with the number of handlers.
      *
      * Users can implement their own matching functions (See description
-     * of the `httpd_uri_match_func_t` function prototype)
+     * of the `httpd_uri_match_func_t` function prototype). All handlers are
+     * then tried in the order of registration.
      */
     httpd_uri_match_func_t uri_match_fn;
 } httpd_config_t;
@@ -778,6 +810,50 @@ esp_err_t httpd_sess_set_pending_override(httpd_handle_t hd, int sockfd, httpd_p
  */
 int httpd_req_to_sockfd(httpd_req_t *r);
 
+/**
+ * @brief   Start handling a request asynchronously
+ *
+ * Creates a copy of the request which remains valid after the URI handler
+ * returns, so that the response can be sent from another task. Until
+ * httpd_req_async_handler_complete() is called for the copy, the server
+ * neither receives further requests on the session nor closes it, and
+ * request data which has not been read is kept for the asynchronous handler.
+ *
+ * @note
+ *  - This API is supposed to be called only from the context of
+ *    a URI handler where httpd_req_t* request pointer is valid.
+ *  - The URI handler must return ESP_OK after this succeeds.
+ *  - All asynchronous requests must be completed before calling httpd_stop().
+ *
+ * @param[in]  r    The request to be handled asynchronously
+ * @param[out] out  Copy of the request, to be used in place of r
+ *
+ * @return
+ *  - ESP_OK : Copy of the request created
+ *  - ESP_ERR_INVALID_ARG : Null arguments
+ *  - ESP_ERR_HTTPD_INVALID_REQ : Invalid request pointer
+ *  - ESP_ERR_INVALID_STATE : Another request is handled asynchronously on the session
+ *  - ESP_ERR_HTTPD_ALLOC_MEM : Failed to allocate memory for the copy
+ */
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out);
+
+/**
+ * @brief   Complete an asynchronous request
+ *
+ * Purges any request data which has not been read, frees the copy of
+ * the request created by httpd_req_async_handler_begin(), and hands the
+ * session back to the server. The session is closed if the request data
+ * couldn't be purged.
+ *
+ * @param[in] r The copy of the request returned by httpd_req_async_handler_begin()
+ *
+ * @return
+ *  - ESP_OK : Request completed
+ *  - ESP_ERR_INVALID_ARG : Null argument
+ *  - ESP_FAIL : Failure in ctrl socket
+ */
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r);
+
 /**
  * @brief   API to read content data from the HTTP request
  *
@@ -857,6 +933,27 @@ size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field);
  */
 esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size);
 
+/**
+ * @brief   Check whether the client accepts a content coding, according
+ *          to the Accept-Encoding header of the request
+ *
+ * A coding is accepted if it is listed in the header, or if "*" is listed,
+ * unless it has a quality value of 0 (e.g. "gzip;q=0").
+ *
+ * @note
+ *  - This API is supposed to be called only from the context of
+ *    a URI handler where httpd_req_t* request pointer is valid.
+ *  - Once httpd_resp_send() API is called all request headers
+ *    are purged, so request headers need be copied into separate
+ *    buffers if they are required later.
+ *
+ * @param[in]  r        The request being responded to
+ * @param[in]  coding   Name of the content coding, e.g. "gzip"
+ *
+ * @return True if the coding is accepted
+ */
+bool httpd_req_accepts_encoding(httpd_req_t *r, const char *coding);
+
 /**
  * @brief   Get Query string length from the request URL
  *
@@ -902,6 +999,34 @@ size_t httpd_req_get_url_query_len(httpd_req_t *r);
  */
 esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len);
 
+/**
+ * @brief   Get the value of a URI path parameter
+ *
+ * Path parameters are "{name}" segments of the URI template of the handler,
+ * when the server is configured with `httpd_uri_match_params()` as the URI
+ * matcher function.
+ *
+ * @note
+ *  - This API is supposed to be called only from the context of
+ *    a URI handler where httpd_req_t* request pointer is valid
+ *  - If output size is greater than input, then the value is truncated,
+ *    accompanied by truncation error as return value
+ *  - The value is not URL decoded
+ *
+ * @param[in]  r         The request being responded to
+ * @param[in]  name      Name of the parameter, without the braces
+ * @param[out] val       Pointer to the buffer into which the value will be copied if found
+ * @param[in]  val_size  Size of the user buffer "val"
+ *
+ * @return
+ *  - ESP_OK : Parameter is found and copied to buffer
+ *  - ESP_ERR_NOT_FOUND          : Parameter not found in the URI template
+ *  - ESP_ERR_INVALID_ARG        : Null arguments
+ *  - ESP_ERR_HTTPD_INVALID_REQ  : Invalid HTTP request pointer
+ *  - ESP_ERR_HTTPD_RESULT_TRUNC : Value string truncated
+ */
+esp_err_t httpd_req_get_uri_param(httpd_req_t *r, const char *name, char *val, size_t val_size);
+
 /**
  * @brief   Helper function to get a URL query tag from a query
  *          string of the type param1=val1&param2=val2
@@ -951,6 +1076,27 @@ esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, siz
  */
 bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match, size_t match_upto);
 
+/**
+ * @brief Test if a URI matches the given template with path parameters.
+ *
+ * Same as httpd_uri_match_wildcard(), but template path segments of the form
+ * "{name}" match any non-empty path segment. The values of the parameters can
+ * be retrieved in the URI handler with httpd_req_get_uri_param().
+ *
+ * Example:
+ *   - /users/{id} matches /users/42, but not /users/ or /users/42/posts
+ *   - /users/{id}/\* (sans the backslash) matches /users/42/ and /users/42/posts
+ *   - /files/{name}.txt matches /files/{name}.txt only, as the parameter must be a whole path segment
+ *
+ * @param[in] uri_template   URI template (pattern)
+ * @param[in] uri_to_match   URI to be matched
+ * @param[in] match_upto     how many characters of the URI buffer to test
+ *                          (there may be trailing query string etc.)
+ *
+ * @return true if a match was found
+ */
+bool httpd_uri_match_params(const char *uri_template, const char *uri_to_match, size_t match_upto);
+
 /**
  * @brief   API to send a complete HTTP response.
  *
@@ -990,6 +1136,152 @@ bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match
  */
 esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
 
+/**
+ * @brief   Buffer of response content, for httpd_resp_sendv()
+ */
+typedef struct httpd_iovec {
+    const char *buf;    /*!< Pointer to the content */
+    size_t      len;    /*!< Length of the content */
+} httpd_iovec_t;
+
+/**
+ * @brief   API to send a complete HTTP response, with the content
+ *          gathered from several buffers.
+ *
+ * Same as httpd_resp_send(), but the content is the concatenation of the
+ * given buffers, e.g. a template with some variable parts, which then need
+ * not be copied into a single buffer. The headers and the content are passed
+ * to the socket together, in a single call where possible.
+ *
+ * @note
+ *  - This API is supposed to be called only from the context of
+ *    a URI handler where httpd_req_t* request pointer is valid.
+ *  - Once this API is called, the request has been responded to.
+ *  - No additional data can then be sent for the request.
+ *  - Once this API is called, all request headers are purged, so
+ *    request headers need be copied into separate buffers if
+ *    they are required later.
+ *
+ * @param[in] r         The request being responded to
+ * @param[in] iov       Array of buffers from where the content is to be fetched
+ * @param[in] iov_count Number of buffers
+ *
+ * @return
+ *  - ESP_OK : On successfully sending the response packet
+ *  - ESP_ERR_INVALID_ARG : Null request pointer or buffer
+ *  - ESP_ERR_HTTPD_RESP_HDR    : Essential headers are too large for internal buffer
+ *  - ESP_ERR_HTTPD_RESP_SEND   : Error in raw send
+ *  - ESP_ERR_HTTPD_INVALID_REQ : Invalid request
+ */
+esp_err_t httpd_resp_sendv(httpd_req_t *r, const httpd_iovec_t *iov, size_t iov_count);
+
+/**
+ * @brief   API to send the content of a file as a complete HTTP response.
+ *
+ * The file is sent from its current position to the end. For regular files,
+ * the response has a Content-Length header, and the headers are sent together
+ * with the first part of the content. Anything else is read until end of file
+ * and sent with chunked encoding.
+ *
+ * The file is read into a buffer of CONFIG_HTTPD_FILE_BUF_LEN bytes, which is
+ * allocated on first use and kept for the following requests. Status code,
+ * content type and additional headers are set like for httpd_resp_send().
+ *
+ * @note
+ *  - This API is supposed to be called only from the context of
+ *    a URI handler where httpd_req_t* request pointer is valid.
+ *  - Once this API is called, the request has been responded to.
+ *  - The file descriptor is not closed by this API.
+ *  - If reading the file fails after the headers have been sent, the
+ *    response is incomplete. The URI handler should then return an
+ *    error, so that the connection is closed.
+ *
+ * @param[in] r         The request being responded to
+ * @param[in] fd        Descriptor of the file, open for reading
+ *
+ * @return
+ *  - ESP_OK : On successfully sending the response packet
+ *  - ESP_FAIL : Error reading the file
+ *  - ESP_ERR_INVALID_ARG : Null request pointer or invalid descriptor
+ *  - ESP_ERR_HTTPD_ALLOC_MEM   : Failed to allocate the buffer
+ *  - ESP_ERR_HTTPD_RESP_HDR    : Essential headers are too large for internal buffer
+ *  - ESP_ERR_HTTPD_RESP_SEND   : Error in raw send
+ *  - ESP_ERR_HTTPD_INVALID_REQ : Invalid request
+ */
+esp_err_t httpd_resp_send_file(httpd_req_t *r, int fd);
+
+/**
+ * @brief   API to send a file as a complete HTTP response, or a gzip
+ *          compressed variant of it, if available.
+ *
+ * If a file with the same path and the ".gz" extension exists, the response
+ * has a "Vary: Accept-Encoding" header. If in addition the client accepts
+ * gzip, that file is sent with a "Content-Encoding: gzip" header. Otherwise
+ * the file at path is sent. Compressing static assets in advance, e.g. with
+ * "gzip -k -9", reduces the size of text files like HTML, JavaScript and CSS
+ * to a fraction, without any effort on the device.
+ *
+ * The file is sent with httpd_resp_send_file(). The content type should be
+ * set for the file at path, with httpd_resp_set_type(), before calling this.
+ *
+ * @note
+ *  - This API is supposed to be called only from the context of
+ *    a URI handler where httpd_req_t* request pointer is valid.
+ *  - Once this API is called, the request has been responded to,
+ *    unless ESP_ERR_NOT_FOUND is returned.
+ *  - The headers take up to two of the max_resp_headers slots.
+ *
+ * @param[in] r         The request being responded to
+ * @param[in] path      Path of the file, e.g. "/spiffs/index.html"
+ *
+ * @return
+ *  - ESP_OK : On successfully sending the response packet
+ *  - ESP_ERR_NOT_FOUND : Neither the file nor its compressed variant exist
+ *  - ESP_ERR_INVALID_ARG : Null arguments
+ *  - ESP_ERR_HTTPD_ALLOC_MEM : Failed to allocate memory
+ *  - other errors of httpd_resp_send_file()
+ */
+esp_err_t httpd_resp_send_static_file(httpd_req_t *r, const char *path);
+
+/**
+ * @brief   API to compress the content of the response with gzip, if the
+ *          client accepts it
+ *
+ * The content passed to any of the response APIs, e.g. httpd_resp_send(),
+ * httpd_resp_send_chunk() or httpd_resp_send_file(), is compressed on the
+ * fly, and sent with chunked encoding as the encoder outputs it. Compressed
+ * data may therefore be held back until the end of the response. The
+ * response gets a "Content-Encoding: gzip" header. The encoder uses a fixed
+ * amount of memory, which depends on CONFIG_HTTPD_GZIP_WINDOW_BITS, until
+ * the response is complete.
+ *
+ * Compression is most effective for text content, like HTML, JSON, JavaScript
+ * and CSS, and trades CPU time for less data to be transmitted. Static files
+ * are better compressed in advance, see httpd_resp_send_static_file().
+ *
+ * @note
+ *  - This API is supposed to be called only from the context of
+ *    a URI handler where httpd_req_t* request pointer is valid.
+ *  - This API must be called before any content is sent.
+ *  - The headers take up to two of the max_resp_headers slots.
+ *  - Requires CONFIG_HTTPD_GZIP_ENCODER.
+ *
+ * @param[in] r         The request being responded to
+ *
+ * @return
+ *  - ESP_OK : The response content is going to be compressed
+ *  - ESP_ERR_NOT_SUPPORTED : The client does not accept gzip, or
+ *                            CONFIG_HTTPD_GZIP_ENCODER is disabled.
+ *                            The content is sent uncompressed.
+ *  - ESP_ERR_INVALID_STATE : Content was sent already, or compression is
+ *                            enabled already
+ *  - ESP_ERR_INVALID_ARG : Null request pointer
+ *  - ESP_ERR_HTTPD_ALLOC_MEM : Failed to allocate the encoder
+ *  - ESP_ERR_HTTPD_RESP_HDR : Too many additional response headers
+ *  - ESP_ERR_HTTPD_INVALID_REQ : Invalid request pointer
+ */
+esp_err_t httpd_resp_enable_gzip(httpd_req_t *r);
+
 /**
  * @brief   API to send one HTTP chunk
  *
@@ -1405,8 +1697,11 @@ esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd);
  * wants one of the sessions to be kept open, irrespective of when it last
  * exchanged a packet.
  *
+ * This also restarts the idle time of the session (see sess_idle_timeout
+ * in httpd_config_t).
+ *
  * @note    Calling this API is only necessary if the LRU Purge Enable option
- *          is enabled.
+ *          is enabled, or if sess_idle_timeout is set.
  *
  * @param[in] handle    Handle to server returned by httpd_start
  * @param[in] sockfd    The socket descriptor of the session for which LRU counter
@@ -69,8 +69,15 @@ struct sock_db {
     httpd_recv_func_t recv_fn;              /*!< Receive function for this socket */
     httpd_pending_func_t pending_fn;        /*!< Pending function for this socket */
     uint64_t lru_counter;                   /*!< LRU Counter indicating when the socket was last used */
+    uint64_t lru_listed;                    /*!< Value of lru_counter when the socket was moved to the end of the LRU list */
+    struct sock_db *lru_prev;               /*!< Previous, less recently used, socket in the LRU list */
+    struct sock_db *lru_next;               /*!< Next, more recently used, socket in the LRU list */
+    int64_t last_active;                    /*!< Time of the last activity on the socket (us), for closing idle sessions */
     char pending_data[PARSER_BLOCK_SIZE];   /*!< Buffer for pending data to be received */
     size_t pending_len;                     /*!< Length of pending data to be received */
+    bool dispatched;                        /*!< True while a worker task is processing a request on this socket */
+    bool for_async_req;                     /*!< True while an asynchronous request handler is using this socket */
+    bool close_pending;                     /*!< Close the socket once it is no longer in use by a worker or asynchronous handler */
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     bool ws_handshake_done;                 /*!< True if it has done WebSocket handshake (if this socket is a valid WS) */
     bool ws_close;                          /*!< Set to true to close the socket later (when WS Close frame received) */
@@ -96,6 +103,13 @@ struct httpd_req_aux {
         const char *value;
     } *resp_hdrs;                                   /*!< Additional headers in response packet */
     struct http_parser_url url_parse_res;           /*!< URL parsing result, used for retrieving URL elements */
+    const char     *uri_template;                   /*!< Template of the matching URI handler, if it may contain parameters */
+    char           *file_buf;                       /*!< Buffer for sending files, allocated on first use */
+    bool            keep_alive;                     /*!< Keep the connection open after the response */
+    bool            async_begun;                    /*!< Request was handed to an asynchronous handler, which purges its data */
+#ifdef CONFIG_HTTPD_GZIP_ENCODER
+    struct httpd_gzip *gzip;                        /*!< Encoder compressing the response content, NULL if not compressed */
+#endif
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     bool ws_handshake_detect;                       /*!< WebSocket handshake detection flag */
     httpd_ws_type_t ws_type;                        /*!< WebSocket frame type */
@@ -103,6 +117,16 @@ struct httpd_req_aux {
 #endif
 };
 
+/**
+ * @brief   Worker task, with the request it is processing
+ */
+struct httpd_worker {
+    struct thread_data td;                  /*!< Information for the worker thread */
+    struct httpd_data *hd;                  /*!< Server the worker belongs to */
+    struct httpd_req req;                   /*!< The request being processed by the worker */
+    struct httpd_req_aux req_aux;           /*!< Additional data about the request */
+};
+
 /**
  * @brief   Server data for each instance. This is exposed publicly as
  *          httpd_handle_t but internal structure/members are kept private.
@@ -114,9 +138,15 @@ struct httpd_data {
     int msg_fd;                             /*!< Ctrl message sender FD */
     struct thread_data hd_td;               /*!< Information for the HTTPD thread */
     struct sock_db *hd_sd;                  /*!< The socket database */
+    struct sock_db *hd_lru_head;            /*!< Least recently used open socket */
+    struct sock_db *hd_lru_tail;            /*!< Most recently used open socket */
     httpd_uri_t **hd_calls;                 /*!< Registered URI handlers */
+    struct httpd_uri_trie *hd_uri_trie;     /*!< Registered URI handlers indexed by URI, NULL if empty */
+    unsigned hd_uri_seq;                    /*!< Registration counter, for ordering handlers in the trie */
     struct httpd_req hd_req;                /*!< The current HTTPD request */
     struct httpd_req_aux hd_req_aux;        /*!< Additional data about the HTTPD request kept unexposed */
+    struct httpd_worker *hd_workers;        /*!< Worker tasks, NULL if requests are processed by the HTTPD thread */
+    oqueue_t hd_work_queue;                 /*!< Sessions with a request ready to be processed by a worker */
 
     /* Array of registered error handler functions */
     httpd_err_handler_func_t *err_handler_fns;
@@ -169,13 +199,46 @@ esp_err_t httpd_sess_new(struct httpd_data *hd, int newfd);
  * @brief   Processes incoming HTTP requests
  *
  * @param[in] hd    Server instance data
- * @param[in] clifd Descriptor of the client from which data is to be received
+ * @param[in] sd    Session from which data is to be received
+ * @param[in] r     Request structure to use for processing
+ * @param[in] ra    Auxiliary data structure to use for processing
  *
  * @return
  *  - ESP_OK    : on successfully receiving, parsing and responding to a request
  *  - ESP_FAIL  : in case of failure in any of the stages of processing
  */
-esp_err_t httpd_sess_process(struct httpd_data *hd, int clifd);
+esp_err_t httpd_sess_process(struct httpd_data *hd, struct sock_db *sd,
+                             struct httpd_req *r, struct httpd_req_aux *ra);
+
+/**
+ * @brief   Checks if a session is in use by a worker task or an
+ *          asynchronous request handler, in which case the server
+ *          task must not receive from it or delete it
+ *
+ * @param[in] sd    Session to check
+ *
+ * @return True if the session is in use
+ */
+static inline bool httpd_sess_is_busy(const struct sock_db *sd)
+{
+    return sd->dispatched || sd->for_async_req;
+}
+
+/**
+ * @brief   Notifies the server task that a worker task or an asynchronous
+ *          request handler is done with a session. The server task then
+ *          either waits for new requests on the session again, or closes it.
+ *
+ * @param[in] hd    Server instance data
+ * @param[in] sd    Session which is no longer used
+ * @param[in] async True if called on completion of an asynchronous request
+ * @param[in] ret   Result of processing, the session is closed if not ESP_OK
+ *
+ * @return
+ *  - ESP_OK   : on successfully sending the notification
+ *  - ESP_FAIL : in case of control socket error while sending
+ */
+esp_err_t httpd_sess_done(struct httpd_data *hd, struct sock_db *sd, bool async, esp_err_t ret);
 
 /**
  * @brief   Remove client descriptor from the session / socket database
@@ -212,8 +275,11 @@ void httpd_sess_free_ctx(void *ctx, httpd_free_ctx_fn_t free_fn);
  * @param[in]  hd    Server instance data
  * @param[out] fdset File descriptor set to be updated.
  * @param[out] maxfd Maximum value among all file descriptors.
+ *
+ * @return True if any session already has pending data to be processed
+ *         (see httpd_sess_pending()), in which case select() must not block
  */
-void httpd_sess_set_descriptors(struct httpd_data *hd, fd_set *fdset, int *maxfd);
+bool httpd_sess_set_descriptors(struct httpd_data *hd, fd_set *fdset, int *maxfd);
 
 /**
  * @brief   Iterates through the list of client fds in the session /socket database.
@@ -240,6 +306,16 @@ int httpd_sess_iterate(struct httpd_data *hd, int fd);
  */
 bool httpd_is_sess_available(struct httpd_data *hd);
 
+/**
+ * @brief   Checks if the least recently used session can be closed to make
+ *          space for a new one, i.e. if any session is not in use
+ *
+ * @param[in] hd  Server instance data
+ *
+ * @return True if a session can be closed by httpd_sess_close_lru()
+ */
+bool httpd_is_sess_purgeable(struct httpd_data *hd);
+
 /**
  * @brief   Checks if session has any pending data/packets
  *          for processing
@@ -257,25 +333,48 @@ bool httpd_is_sess_available(struct httpd_data *hd);
  * @param[in] hd  Server instance data
  * @param[in] fd  Client descriptor
  *
- * @return True if there is any pending data
+ * @return True if there is any pending data, false also if the
+ *         session is busy (see httpd_sess_is_busy())
  */
 bool httpd_sess_pending(struct httpd_data *hd, int fd);
 
 /**
- * @brief   Removes the least recently used client from the session
+ * @brief   Closes the least recently used session
  *
  * This may be useful if new clients are requesting for connection but
  * max number of connections is reached, in which case the client which
  * is inactive for the longest will be removed from the session.
+ * Must be called from the server task.
  *
  * @param[in] hd  Server instance data
  *
  * @return
- *  - ESP_OK    : if session closure initiated successfully
- *  - ESP_FAIL  : if failed
+ *  - ESP_OK    : if a session was closed
+ *  - ESP_FAIL  : if all sessions are in use
  */
 esp_err_t httpd_sess_close_lru(struct httpd_data *hd);
 
+/**
+ * @brief   Moves a session to the end of the LRU list, after a request
+ *          was processed on it. Must be called from the server task.
+ *
+ * @param[in] hd  Server instance data
+ * @param[in] sd  Session which was used
+ */
+void httpd_sess_touch(struct httpd_data *hd, struct sock_db *sd);
+
+/**
+ * @brief   Closes the sessions which have been idle for longer than
+ *          the configured sess_idle_timeout. Must be called from the
+ *          server task.
+ *
+ * @param[in] hd  Server instance data
+ *
+ * @return Time in milliseconds until the next session becomes idle,
+ *         or -1 if no session is going to be closed
+ */
+int httpd_sess_close_idle(struct httpd_data *hd);
+
 /** End of Group : Session Management
  * @}
  */
@@ -291,12 +390,13 @@ esp_err_t httpd_sess_close_lru(struct httpd_data *hd);
  *          and invokes the appropriate one if found
  *
  * @param[in] hd  Server instance data for which handler needs to be invoked
+ * @param[in] req Parsed request
  *
  * @return
  *  - ESP_OK    : if handler found and executed successfully
  *  - ESP_FAIL  : otherwise
  */
-esp_err_t httpd_uri(struct httpd_data *hd);
+esp_err_t httpd_uri(struct httpd_data *hd, httpd_req_t *req);
 
 /**
  * @brief   Unregister all URI handlers
@@ -305,6 +405,86 @@ esp_err_t httpd_uri(struct httpd_data *hd);
  */
 void httpd_unregister_all_uri_handlers(struct httpd_data *hd);
 
+/**
+ * @brief   Splits a URI template into the part which must be matched and the
+ *          special characters understood by httpd_uri_match_wildcard()
+ *
+ * @param[in]  tpl       URI template
+ * @param[out] exact_len Length of the part which must be matched
+ * @param[out] optional  Optional character following that part, 0 if none
+ * @param[out] asterisk  Whether any characters may follow
+ *
+ * @return
+ *  - true  : on success
+ *  - false : if the template is invalid and never matches
+ */
+bool httpd_uri_template_parse(const char *tpl, size_t *exact_len, char *optional, bool *asterisk);
+
+/**
+ * @brief   Checks for a parameter at the given position of a URI template,
+ *          which is a path segment of the form "{name}"
+ *
+ * @param[in] tpl  URI template
+ * @param[in] pos  Position in the template
+ * @param[in] n    Length of the template part to be considered
+ *
+ * @return Length of the parameter, including the braces, or 0 if none
+ */
+size_t httpd_uri_param_len(const char *tpl, size_t pos, size_t n);
+
+/**
+ * @brief   Checks whether the URI matcher of the server can be replaced by
+ *          a lookup in the URI trie
+ *
+ * @param[in] hd  Server instance data
+ *
+ * @return true if handlers are looked up in the URI trie
+ */
+bool httpd_uri_trie_supported(struct httpd_data *hd);
+
+/**
+ * @brief   Adds a registered URI handler to the URI trie
+ *
+ * Handlers with invalid templates are not added, as they never match.
+ *
+ * @param[in] hd      Server instance data
+ * @param[in] handler Registered handler, in the hd_calls array
+ *
+ * @return
+ *  - ESP_OK : on success
+ *  - ESP_ERR_HTTPD_ALLOC_MEM : if memory allocation failed
+ */
+esp_err_t httpd_uri_trie_add(struct httpd_data *hd, httpd_uri_t *handler);
+
+/**
+ * @brief   Removes a URI handler from the URI trie
+ *
+ * @param[in] hd      Server instance data
+ * @param[in] handler Handler to be removed
+ */
+void httpd_uri_trie_remove(struct httpd_data *hd, const httpd_uri_t *handler);
+
+/**
+ * @brief   Removes all URI handlers from the URI trie
+ *
+ * @param[in] hd  Server instance data
+ */
+void httpd_uri_trie_free(struct httpd_data *hd);
+
+/**
+ * @brief   Looks up the first registered handler matching a URI and method
+ *
+ * @param[in]  hd      Server instance data
+ * @param[in]  uri     URI to be matched
+ * @param[in]  uri_len Length of the URI
+ * @param[in]  method  HTTP method
+ * @param[out] err     404 or 405 error code if no handler is found (may be NULL)
+ *
+ * @return Matching handler, or NULL if not found
+ */
+httpd_uri_t *httpd_uri_trie_find(struct httpd_data *hd, const char *uri, size_t uri_len,
+                                 httpd_method_t method, httpd_err_code_t *err);
+
 /**
  * @brief   Validates the request to prevent users from calling APIs, that are to
  *          be called only inside a URI handler, outside the handler context
@@ -345,25 +525,29 @@ bool httpd_validate_req_ptr(httpd_req_t *r);
  * http_recv() after this reads the body of the request.
  *
  * @param[in] hd  Server instance data
+ * @param[in] r   Request structure to be filled
+ * @param[in] ra  Auxiliary data structure to be used with the request
  * @param[in] sd  Pointer to socket which is needed for receiving TCP packets.
  *
  * @return
  *  - ESP_OK    : if request packet is valid
  *  - ESP_FAIL  : otherwise
  */
-esp_err_t httpd_req_new(struct httpd_data *hd, struct sock_db *sd);
+esp_err_t httpd_req_new(struct httpd_data *hd, struct httpd_req *r,
+                        struct httpd_req_aux *ra, struct sock_db *sd);
 
 /**
  * @brief   For an HTTP request, resets the resources allocated for it and
  *          purges any data left to be received
  *
  * @param[in] hd  Server instance data
+ * @param[in] r   Request to be deleted
  *
  * @return
  *  - ESP_OK    : if request packet deleted and resources cleaned.
  *  - ESP_FAIL  : otherwise.
  */
-esp_err_t httpd_req_delete(struct httpd_data *hd);
+esp_err_t httpd_req_delete(struct httpd_data *hd, struct httpd_req *r);
 
 /**
  * @brief   For handling HTTP errors by invoking registered
@@ -481,6 +665,73 @@ int httpd_default_recv(httpd_handle_t hd, int sockfd, char *buf, size_t buf_len,
  * @}
  */
 
+/* ************** Group: Compression ************** */
+/** @name Compression
+ * Streaming gzip encoder for response content
+ * @{
+ */
+
+/**
+ * @brief   Function called by the gzip encoder with compressed data
+ *
+ * @param[in] arg   Argument passed to the encoder function
+ * @param[in] buf   Compressed data
+ * @param[in] len   Length of the data
+ *
+ * @return ESP_OK on success, any other value is returned by the encoder
+ */
+typedef esp_err_t (*httpd_gzip_out_fn_t)(void *arg, const char *buf, size_t len);
+
+/**
+ * @brief   Creates a gzip encoder, which uses a fixed amount of memory
+ *          determined by CONFIG_HTTPD_GZIP_WINDOW_BITS
+ *
+ * @return Encoder, or NULL if out of memory
+ */
+struct httpd_gzip *httpd_gzip_new(void);
+
+/**
+ * @brief   Compresses data. Compressed data is passed to the output function
+ *          whenever the output buffer of the encoder fills up.
+ *
+ * @param[in] gz    Encoder
+ * @param[in] buf   Data to be compressed
+ * @param[in] len   Length of the data
+ * @param[in] out   Output function
+ * @param[in] arg   Argument for the output function
+ *
+ * @return
+ *  - ESP_OK : on success
+ *  - error returned by the output function
+ */
+esp_err_t httpd_gzip_write(struct httpd_gzip *gz, const char *buf, size_t len,
+                           httpd_gzip_out_fn_t out, void *arg);
+
+/**
+ * @brief   Compresses any data left in the encoder, and passes the rest of
+ *          the gzip stream to the output function
+ *
+ * @param[in] gz    Encoder
+ * @param[in] out   Output function
+ * @param[in] arg   Argument for the output function
+ *
+ * @return
+ *  - ESP_OK : on success
+ *  - error returned by the output function
+ */
+esp_err_t httpd_gzip_finish(struct httpd_gzip *gz, httpd_gzip_out_fn_t out, void *arg);
+
+/**
+ * @brief   Frees a gzip encoder
+ *
+ * @param[in] gz    Encoder
+ */
+void httpd_gzip_free(struct httpd_gzip *gz);
+
+/** End of Compression related functions
+ * @}
+ */
+
 /* ************** Group: WebSocket ************** */
 /** @name WebSocket
  * Functions for WebSocket header parsing
@@ -0,0 +1,321 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Streaming gzip encoder for compressing responses on the fly.
+ *
+ * Memory use is fixed by CONFIG_HTTPD_GZIP_WINDOW_BITS, rather than the 32 kB
+ * window and large block buffers of a general purpose deflate implementation.
+ * Matches are searched for in a sliding window with hash chains, and the
+ * output is a single deflate block with the fixed Huffman codes (RFC 1951),
+ * so nothing needs to be buffered besides the window and the output buffer.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <esp_err.h>
+#include <sdkconfig.h>
+
+#if CONFIG_IDF_TARGET_ESP32
+#include "esp32/rom/crc.h"
+#elif CONFIG_IDF_TARGET_ESP32S2
+#include "esp32s2/rom/crc.h"
+#endif
+
+#include <esp_http_server.h>
+#include "esp_httpd_priv.h"
+
+#ifdef CONFIG_HTTPD_GZIP_ENCODER
+
+#define GZ_WSIZE        (1 << CONFIG_HTTPD_GZIP_WINDOW_BITS)
+#define GZ_WMASK        (GZ_WSIZE - 1)
+#define GZ_HASH_BITS    (CONFIG_HTTPD_GZIP_WINDOW_BITS - 1)
+#define GZ_HASH_SIZE    (1 << GZ_HASH_BITS)
+#define GZ_MIN_MATCH    3
+#define GZ_MAX_MATCH    258
+#define GZ_MAX_CHAIN    8       /* Candidates compared for each match */
+#define GZ_OUT_SIZE     1024
+
+/* Output is passed on before the buffer could overflow with the next symbol */
+#define GZ_OUT_HIGH     (GZ_OUT_SIZE - 8)
+
+struct httpd_gzip {
+    uint32_t crc;                       /*!< CRC-32 of the uncompressed data */
+    uint32_t size;                      /*!< Length of the uncompressed data, modulo 2^32 */
+    uint32_t bits;                      /*!< Output bits not yet in the output buffer */
+    unsigned nbits;                     /*!< Number of bits in bits */
+    size_t out_len;                     /*!< Length of the data in out */
+    size_t pos;                         /*!< Position in win of the next byte to be encoded */
+    size_t end;                         /*!< End of the data in win */
+    uint16_t head[GZ_HASH_SIZE];        /*!< Latest position + 1 in win for each hash, 0 if none */
+    uint16_t prev[GZ_WSIZE];            /*!< Previous position + 1 with the same hash, by position */
+    uint8_t out[GZ_OUT_SIZE];
+    uint8_t win[2 * GZ_WSIZE];          /*!< Encoded data, as far back as the window reaches, and lookahead */
+};
+
+/* Lengths and distances of matches are coded as a base value and extra bits */
+static const uint16_t s_len_base[] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t s_len_extra[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t s_dist_base[] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t s_dist_extra[] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static void gz_put_bits(struct httpd_gzip *gz, uint32_t value, unsigned n)
+{
+    gz->bits |= value << gz->nbits;
+    gz->nbits += n;
+    while (gz->nbits >= 8) {
+        gz->out[gz->out_len++] = gz->bits;
+        gz->bits >>= 8;
+        gz->nbits -= 8;
+    }
+}
+
+/* Huffman codes are stored starting from their most significant bit */
+static void gz_put_code(struct httpd_gzip *gz, uint32_t code, unsigned n)
+{
+    uint32_t reversed = 0;
+    for (unsigned i = 0; i < n; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    gz_put_bits(gz, reversed, n);
+}
+
+/* Literal/length symbol, with the fixed Huffman codes */
+static void gz_put_symbol(struct httpd_gzip *gz, unsigned sym)
+{
+    if (sym < 144) {
+        gz_put_code(gz, 0x30 + sym, 8);
+    } else if (sym < 256) {
+        gz_put_code(gz, 0x190 + sym - 144, 9);
+    } else if (sym < 280) {
+        gz_put_code(gz, sym - 256, 7);
+    } else {
+        gz_put_code(gz, 0xc0 + sym - 280, 8);
+    }
+}
+
+static void gz_put_match(struct httpd_gzip *gz, unsigned len, unsigned dist)
+{
+    unsigned i = sizeof(s_len_base) / sizeof(s_len_base[0]) - 1;
+    while (s_len_base[i] > len) {
+        i--;
+    }
+    gz_put_symbol(gz, 257 + i);
+    gz_put_bits(gz, len - s_len_base[i], s_len_extra[i]);
+
+    i = sizeof(s_dist_base) / sizeof(s_dist_base[0]) - 1;
+    while (s_dist_base[i] > dist) {
+        i--;
+    }
+    gz_put_code(gz, i, 5);
+    gz_put_bits(gz, dist - s_dist_base[i], s_dist_extra[i]);
+}
+
+static esp_err_t gz_flush_out(struct httpd_gzip *gz, httpd_gzip_out_fn_t out, void *arg)
+{
+    esp_err_t ret = ESP_OK;
+    if (gz->out_len) {
+        ret = out(arg, (const char *) gz->out, gz->out_len);
+        gz->out_len = 0;
+    }
+    return ret;
+}
+
+static inline unsigned gz_hash(const uint8_t *p)
+{
+    uint32_t v = (p[0] << 16) | (p[1] << 8) | p[2];
+    return (v * 2654435761u) >> (32 - GZ_HASH_BITS);
+}
+
+static void gz_insert(struct httpd_gzip *gz, size_t pos)
+{
+    unsigned h = gz_hash(&gz->win[pos]);
+    gz->prev[pos & GZ_WMASK] = gz->head[h];
+    gz->head[h] = pos + 1;
+}
+
+/* Length of the longest match for the data at pos, and its distance */
+static unsigned gz_longest_match(struct httpd_gzip *gz, size_t pos, size_t avail, unsigned *dist)
+{
+    const size_t max_len = avail < GZ_MAX_MATCH ? avail : GZ_MAX_MATCH;
+    const uint8_t *cur = &gz->win[pos];
+    unsigned best = 0;
+    unsigned chain = GZ_MAX_CHAIN;
+    unsigned cand = gz->head[gz_hash(cur)];
+
+    /* Candidates are in decreasing order, and go back at most a window */
+    while (cand && chain-- && pos - (cand - 1) <= GZ_WSIZE) {
+        const uint8_t *match = &gz->win[cand - 1];
+        if (match[best] == cur[best]) {
+            unsigned len = 0;
+            while (len < max_len && match[len] == cur[len]) {
+                len++;
+            }
+            if (len > best) {
+                best = len;
+                *dist = pos - (cand - 1);
+                if (len == max_len) {
+                    break;
+                }
+            }
+        }
+        unsigned next = gz->prev[(cand - 1) & GZ_WMASK];
+        if (next >= cand) {
+            break;
+        }
+        cand = next;
+    }
+    return best;
+}
+
+/* Encodes the data in the window, keeping back enough lookahead for
+ * the longest match unless all the data has been written */
+static esp_err_t gz_deflate(struct httpd_gzip *gz, bool finish, httpd_gzip_out_fn_t out, void *arg)
+{
+    const size_t keep = finish ? 0 : GZ_MAX_MATCH - 1;
+    while (gz->end - gz->pos > keep) {
+        const size_t avail = gz->end - gz->pos;
+        unsigned len = 0;
+        unsigned dist = 0;
+        if (avail >= GZ_MIN_MATCH) {
+            len = gz_longest_match(gz, gz->pos, avail, &dist);
+            gz_insert(gz, gz->pos);
+        }
+
+        if (len >= GZ_MIN_MATCH) {
+            gz_put_match(gz, len, dist);
+            /* Later data may match any of the positions in this match */
+            for (size_t i = gz->pos + 1; i < gz->pos + len && i + GZ_MIN_MATCH <= gz->end; i++) {
+                gz_insert(gz, i);
+            }
+            gz->pos += len;
+        } else {
+            gz_put_symbol(gz, gz->win[gz->pos]);
+            gz->pos++;
+        }
+
+        if (gz->out_len >= GZ_OUT_HIGH) {
+            esp_err_t ret = gz_flush_out(gz, out, arg);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+/* Moves the window forward by half its buffer */
+static void gz_slide(struct httpd_gzip *gz)
+{
+    memmove(gz->win, gz->win + GZ_WSIZE, GZ_WSIZE);
+    gz->pos -= GZ_WSIZE;
+    gz->end -= GZ_WSIZE;
+    for (size_t i = 0; i < GZ_HASH_SIZE; i++) {
+        gz->head[i] = gz->head[i] > GZ_WSIZE ? gz->head[i] - GZ_WSIZE : 0;
+    }
+    for (size_t i = 0; i < GZ_WSIZE; i++) {
+        gz->prev[i] = gz->prev[i] > GZ_WSIZE ? gz->prev[i] - GZ_WSIZE : 0;
+    }
+}
+
+struct httpd_gzip *httpd_gzip_new(void)
+{
+    struct httpd_gzip *gz = calloc(1, sizeof(struct httpd_gzip));
+    if (gz == NULL) {
+        return NULL;
+    }
+
+    /* gzip member header (RFC 1952) with no optional fields, unknown OS */
+    static const uint8_t header[] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+    memcpy(gz->out, header, sizeof(header));
+    gz->out_len = sizeof(header);
+
+    /* All data goes into a single, final block with fixed Huffman codes */
+    gz_put_bits(gz, 1, 1);
+    gz_put_bits(gz, 1, 2);
+    return gz;
+}
+
+esp_err_t httpd_gzip_write(struct httpd_gzip *gz, const char *buf, size_t len,
+                           httpd_gzip_out_fn_t out, void *arg)
+{
+    gz->crc = crc32_le(gz->crc, (const uint8_t *) buf, len);
+    gz->size += len;
+
+    while (len) {
+        if (gz->end == sizeof(gz->win)) {
+            gz_slide(gz);
+        }
+        size_t n = sizeof(gz->win) - gz->end;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(gz->win + gz->end, buf, n);
+        gz->end += n;
+        buf += n;
+        len -= n;
+
+        esp_err_t ret = gz_deflate(gz, false, out, arg);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_gzip_finish(struct httpd_gzip *gz, httpd_gzip_out_fn_t out, void *arg)
+{
+    esp_err_t ret = gz_deflate(gz, true, out, arg);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    /* End of block, padded to a byte boundary */
+    gz_put_symbol(gz, 256);
+    gz_put_bits(gz, 0, (8 - gz->nbits) % 8);
+
+    /* gzip member trailer */
+    if (gz->out_len > GZ_OUT_SIZE - 8) {
+        ret = gz_flush_out(gz, out, arg);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    for (int i = 0; i < 32; i += 8) {
+        gz->out[gz->out_len++] = gz->crc >> i;
+    }
+    for (int i = 0; i < 32; i += 8) {
+        gz->out[gz->out_len++] = gz->size >> i;
+    }
+    return gz_flush_out(gz, out, arg);
+}
+
+void httpd_gzip_free(struct httpd_gzip *gz)
+{
+    free(gz);
+}
+
+#endif /* CONFIG_HTTPD_GZIP_ENCODER */
@@ -31,15 +31,10 @@ static esp_err_t httpd_accept_conn(struct httpd_data *hd, int listen_fd)
     /* If no space is available for new session, close the least recently used one */
     if (hd->config.lru_purge_enable == true) {
         if (!httpd_is_sess_available(hd)) {
-            /* Queue asynchronous closure of the least recently used session */
-            return httpd_sess_close_lru(hd);
-            /* Returning from this allowes the main server thread to process
-             * the queued asynchronous control message for closing LRU session.
-             * Since connection request hasn't been addressed yet using accept()
-             * therefore httpd_accept_conn() will be called again, but this time
-             * with space available for one session
-             */
-       }
+            if (httpd_sess_close_lru(hd) != ESP_OK) {
+                return ESP_FAIL;
+            }
+        }
     }
 
     struct sockaddr_in addr_from;
@@ -75,9 +70,13 @@ struct httpd_ctrl_data {
     enum httpd_ctrl_msg {
         HTTPD_CTRL_SHUTDOWN,
         HTTPD_CTRL_WORK,
+        HTTPD_CTRL_SESS_DONE,
+        HTTPD_CTRL_ASYNC_DONE,
     } hc_msg;
     httpd_work_fn_t hc_work;
     void *hc_work_arg;
+    struct sock_db *hc_sd;
+    esp_err_t hc_ret;
 };
 
 esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg)
@@ -102,6 +101,23 @@ esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *ar
     return ESP_OK;
 }
 
+esp_err_t httpd_sess_done(struct httpd_data *hd, struct sock_db *sd, bool async, esp_err_t ret)
+{
+    struct httpd_ctrl_data msg = {
+        .hc_msg = async ? HTTPD_CTRL_ASYNC_DONE : HTTPD_CTRL_SESS_DONE,
+        .hc_sd = sd,
+        .hc_ret = ret,
+    };
+
+    int err = cs_send_to_ctrl_sock(hd->msg_fd, hd->config.ctrl_port, &msg, sizeof(msg));
+    if (err < 0) {
+        ESP_LOGW(TAG, LOG_FMT("failed to notify server task"));
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
 void *httpd_get_global_user_ctx(httpd_handle_t handle)
 {
     return ((struct httpd_data *)handle)->config.global_user_ctx;
@@ -122,6 +138,27 @@ static void httpd_close_all_sessions(struct httpd_data *hd)
     }
 }
 
+/* Called once a worker or an asynchronous request handler is done with
+ * a session, to close it or to include it in select() again */
+static void httpd_sess_resume(struct httpd_data *hd, struct sock_db *sd, esp_err_t ret)
+{
+    if (ret != ESP_OK) {
+        sd->close_pending = true;
+    }
+    if (httpd_sess_is_busy(sd)) {
+        return;
+    }
+    if (!sd->close_pending) {
+        httpd_sess_touch(hd, sd);
+        return;
+    }
+
+    int fd = sd->fd;
+    ESP_LOGD(TAG, LOG_FMT("closing socket %d"), fd);
+    close(fd);
+    httpd_sess_delete(hd, fd);
+}
+
 static void httpd_process_ctrl_msg(struct httpd_data *hd)
 {
     struct httpd_ctrl_data msg;
@@ -146,32 +183,90 @@ static void httpd_process_ctrl_msg(struct httpd_data *hd)
         ESP_LOGD(TAG, LOG_FMT("shutdown"));
         hd->hd_td.status = THREAD_STOPPING;
         break;
+    case HTTPD_CTRL_SESS_DONE:
+        ESP_LOGD(TAG, LOG_FMT("worker done with socket %d"), msg.hc_sd->fd);
+        msg.hc_sd->dispatched = false;
+        httpd_sess_resume(hd, msg.hc_sd, msg.hc_ret);
+        break;
+    case HTTPD_CTRL_ASYNC_DONE:
+        ESP_LOGD(TAG, LOG_FMT("async request done on socket %d"), msg.hc_sd->fd);
+        msg.hc_sd->for_async_req = false;
+        httpd_sess_resume(hd, msg.hc_sd, msg.hc_ret);
+        break;
     default:
         break;
     }
 }
 
+/* Process a request on a session in the HTTPD thread, or
+ * hand it over to a worker if there are any */
+static esp_err_t httpd_serve_sess(struct httpd_data *hd, int fd)
+{
+    struct sock_db *sd = httpd_sess_get(hd, fd);
+    if (! sd) {
+        return ESP_FAIL;
+    }
+
+    if (hd->hd_workers == NULL) {
+        esp_err_t ret = httpd_sess_process(hd, sd, &hd->hd_req, &hd->hd_req_aux);
+        if (ret != ESP_OK && sd->for_async_req) {
+            /* Closed once the asynchronous request is complete */
+            sd->close_pending = true;
+            return ESP_OK;
+        }
+        if (ret == ESP_OK) {
+            httpd_sess_touch(hd, sd);
+        }
+        return ret;
+    }
+
+    /* The session is left out of select() until the
+     * worker reports back with httpd_sess_done() */
+    sd->dispatched = true;
+    if (httpd_os_queue_send(hd->hd_work_queue, &sd) != OS_SUCCESS) {
+        ESP_LOGW(TAG, LOG_FMT("failed to dispatch socket %d"), fd);
+        sd->dispatched = false;
+    }
+    return ESP_OK;
+}
+
 /* Manage in-coming connection or data requests */
 static esp_err_t httpd_server(struct httpd_data *hd)
 {
+    /* Close idle sessions first, so that they are left out of select() */
+    int idle_wait_ms = httpd_sess_close_idle(hd);
+
     fd_set read_set;
     FD_ZERO(&read_set);
-    if (hd->config.lru_purge_enable || httpd_is_sess_available(hd)) {
+    if (httpd_is_sess_available(hd) ||
+        (hd->config.lru_purge_enable && httpd_is_sess_purgeable(hd))) {
         /* Only listen for new connections if server has capacity to
          * handle more (or when LRU purge is enabled, in which case
-         * older connections will be closed) */
+         * older connections, which are not in use, will be closed) */
         FD_SET(hd->listen_fd, &read_set);
     }
     FD_SET(hd->ctrl_fd, &read_set);
 
     int tmp_max_fd;
-    httpd_sess_set_descriptors(hd, &read_set, &tmp_max_fd);
+    bool pending = httpd_sess_set_descriptors(hd, &read_set, &tmp_max_fd);
     int maxfd = MAX(hd->listen_fd, tmp_max_fd);
     tmp_max_fd = maxfd;
     maxfd = MAX(hd->ctrl_fd, tmp_max_fd);
 
+    /* Don't block if a session has a request waiting in its pending
+     * data, and only until the next idle session is to be closed */
+    struct timeval tv = { 0 };
+    struct timeval *timeout = NULL;
+    if (pending) {
+        timeout = &tv;
+    } else if (idle_wait_ms >= 0) {
+        tv.tv_sec = idle_wait_ms / 1000;
+        tv.tv_usec = (idle_wait_ms % 1000) * 1000;
+        timeout = &tv;
+    }
+
     ESP_LOGD(TAG, LOG_FMT("doing select maxfd+1 = %d"), maxfd + 1);
-    int active_cnt = select(maxfd + 1, &read_set, NULL, NULL, NULL);
+    int active_cnt = select(maxfd + 1, &read_set, NULL, NULL, timeout);
     if (active_cnt < 0) {
         ESP_LOGE(TAG, LOG_FMT("error in select (%d)"), errno);
         httpd_sess_delete_invalid(hd);
@@ -194,7 +289,7 @@ static esp_err_t httpd_server(struct httpd_data *hd)
     while ((fd = httpd_sess_iterate(hd, fd)) != -1) {
         if (FD_ISSET(fd, &read_set) || (httpd_sess_pending(hd, fd))) {
             ESP_LOGD(TAG, LOG_FMT("processing socket %d"), fd);
-            if (httpd_sess_process(hd, fd) != ESP_OK) {
+            if (httpd_serve_sess(hd, fd) != ESP_OK) {
                 ESP_LOGD(TAG, LOG_FMT("closing socket %d"), fd);
                 close(fd);
                 /* Delete session and update fd to that
@@ -215,6 +310,62 @@ static esp_err_t httpd_server(struct httpd_data *hd)
     return ESP_OK;
 }
 
+/* Worker thread, processing requests on the sessions
+ * dispatched to it by the main HTTPD thread */
+static void httpd_worker_thread(void *arg)
+{
+    struct httpd_worker *w = (struct httpd_worker *) arg;
+    struct httpd_data *hd = w->hd;
+    struct sock_db *sd;
+    w->td.status = THREAD_RUNNING;
+
+    /* A NULL session is queued to stop the worker */
+    while (httpd_os_queue_receive(hd->hd_work_queue, &sd) == OS_SUCCESS && sd) {
+        ESP_LOGD(TAG, LOG_FMT("processing socket %d"), sd->fd);
+        esp_err_t ret = httpd_sess_process(hd, sd, &w->req, &w->req_aux);
+
+        /* The session can't be used again until the main
+         * thread is notified, so keep trying */
+        while (httpd_sess_done(hd, sd, false, ret) != ESP_OK) {
+            httpd_os_thread_sleep(10);
+        }
+    }
+
+    w->td.status = THREAD_STOPPED;
+    httpd_os_thread_delete();
+}
+
+static void httpd_workers_stop(struct httpd_data *hd, unsigned count)
+{
+    struct sock_db *stop = NULL;
+    for (unsigned i = 0; i < count; i++) {
+        httpd_os_queue_send(hd->hd_work_queue, &stop);
+    }
+    /* Workers finish the requests which are already queued first */
+    for (unsigned i = 0; i < count; i++) {
+        while (hd->hd_workers[i].td.status != THREAD_STOPPED) {
+            httpd_os_thread_sleep(10);
+        }
+    }
+}
+
+static esp_err_t httpd_workers_start(struct httpd_data *hd)
+{
+    for (unsigned i = 0; i < hd->config.max_workers; i++) {
+        struct httpd_worker *w = &hd->hd_workers[i];
+        if (httpd_os_thread_create(&w->td.handle, "httpd_worker",
+                                   hd->config.stack_size,
+                                   hd->config.task_priority,
+                                   httpd_worker_thread, w,
+                                   hd->config.core_id) != ESP_OK) {
+            ESP_LOGE(TAG, LOG_FMT("Failed to launch worker %d"), i);
+            httpd_workers_stop(hd, i);
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
 /* The main HTTPD thread */
 static void httpd_thread(void *arg)
 {
@@ -231,6 +382,10 @@ static void httpd_thread(void *arg)
     }
 
     ESP_LOGD(TAG, LOG_FMT("web server exiting"));
+    if (hd->hd_workers) {
+        /* Workers need the control socket until they stop */
+        httpd_workers_stop(hd, hd->config.max_workers);
+    }
     close(hd->msg_fd);
     cs_free_ctrl_sock(hd->ctrl_fd);
     httpd_close_all_sessions(hd);
@@ -298,6 +453,52 @@ static esp_err_t httpd_server_init(struct httpd_data *hd)
     return ESP_OK;
 }
 
+static void httpd_workers_free(struct httpd_data *hd)
+{
+    if (hd->hd_work_queue) {
+        httpd_os_queue_delete(hd->hd_work_queue);
+        hd->hd_work_queue = NULL;
+    }
+    if (hd->hd_workers) {
+        for (unsigned i = 0; i < hd->config.max_workers; i++) {
+            free(hd->hd_workers[i].req_aux.resp_hdrs);
+            free(hd->hd_workers[i].req_aux.file_buf);
+        }
+        free(hd->hd_workers);
+        hd->hd_workers = NULL;
+    }
+}
+
+static esp_err_t httpd_workers_alloc(struct httpd_data *hd)
+{
+    if (hd->config.max_workers == 0) {
+        return ESP_OK;
+    }
+
+    hd->hd_workers = calloc(hd->config.max_workers, sizeof(struct httpd_worker));
+    if (!hd->hd_workers) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (unsigned i = 0; i < hd->config.max_workers; i++) {
+        struct httpd_worker *w = &hd->hd_workers[i];
+        w->hd = hd;
+        w->req_aux.resp_hdrs = calloc(hd->config.max_resp_headers, sizeof(struct resp_hdr));
+        if (!w->req_aux.resp_hdrs) {
+            httpd_workers_free(hd);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    /* Each session is queued at most once, plus a stop request per worker */
+    hd->hd_work_queue = httpd_os_queue_create(hd->config.max_open_sockets + hd->config.max_workers,
+                                              sizeof(struct sock_db *));
+    if (!hd->hd_work_queue) {
+        httpd_workers_free(hd);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
 static struct httpd_data *httpd_create(const httpd_config_t *config)
 {
     /* Allocate memory for httpd instance data */
@@ -339,6 +540,16 @@ static struct httpd_data *httpd_create(const httpd_config_t *config)
     }
     /* Save the configuration for this instance */
     hd->config = *config;
+
+    if (httpd_workers_alloc(hd) != ESP_OK) {
+        ESP_LOGE(TAG, LOG_FMT("Failed to allocate memory for HTTP worker tasks"));
+        free(hd->err_handler_fns);
+        free(ra->resp_hdrs);
+        free(hd->hd_sd);
+        free(hd->hd_calls);
+        free(hd);
+        return NULL;
+    }
     return hd;
 }
 
@@ -346,8 +557,10 @@ static void httpd_delete(struct httpd_data *hd)
 {
     struct httpd_req_aux *ra = &hd->hd_req_aux;
     /* Free memory of httpd instance data */
+    httpd_workers_free(hd);
     free(hd->err_handler_fns);
     free(ra->resp_hdrs);
+    free(ra->file_buf);
     free(hd->hd_sd);
 
     /* Free registered URI handlers */
@@ -391,12 +604,21 @@ esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
     }
 
     httpd_sess_init(hd);
+    if (hd->hd_workers && httpd_workers_start(hd) != ESP_OK) {
+        /* Failed to launch worker tasks */
+        httpd_delete(hd);
+        return ESP_ERR_HTTPD_TASK;
+    }
+
     if (httpd_os_thread_create(&hd->hd_td.handle, "httpd",
                                hd->config.stack_size,
                                hd->config.task_priority,
                                httpd_thread, hd,
                                hd->config.core_id) != ESP_OK) {
         /* Failed to launch task */
+        if (hd->hd_workers) {
+            httpd_workers_stop(hd, hd->config.max_workers);
+        }
         httpd_delete(hd);
         return ESP_ERR_HTTPD_TASK;
     }
@@ -367,6 +367,9 @@ static esp_err_t cb_headers_complete(http_parser *parser)
         return ESP_FAIL;
     }
 
+    /* Depends on the HTTP version and the "Connection" header */
+    ra->keep_alive = http_should_keep_alive(parser);
+
     /* In absence of body/chunked encoding, http_parser sets content_len to -1 */
     r->content_len = ((int)parser->content_length != -1 ?
                       parser->content_length : 0);
@@ -622,9 +625,8 @@ static void parse_init(httpd_req_t *r, http_parser *parser, parser_data_t *data)
 
 /* Function that receives TCP data and runs parser on it
  */
-static esp_err_t httpd_parse_req(struct httpd_data *hd)
+static esp_err_t httpd_parse_req(struct httpd_data *hd, httpd_req_t *r)
 {
-    httpd_req_t *r = &hd->hd_req;
     int blk_len,  offset;
     http_parser   parser;
     parser_data_t parser_data;
@@ -664,7 +666,7 @@ static esp_err_t httpd_parse_req(struct httpd_data *hd)
     } while (parser_data.status != PARSING_COMPLETE);
 
     ESP_LOGD(TAG, LOG_FMT("parsing complete"));
-    return httpd_uri(hd);
+    return httpd_uri(hd, r);
 }
 
 static void init_req(httpd_req_t *r, httpd_config_t *config)
@@ -690,6 +692,12 @@ static void init_req_aux(struct httpd_req_aux *ra, httpd_config_t *config)
     ra->first_chunk_sent = 0;
     ra->req_hdrs_count = 0;
     ra->resp_hdrs_count = 0;
+    ra->uri_template = NULL;
+    ra->keep_alive = true;
+    ra->async_begun = false;
+#ifdef CONFIG_HTTPD_GZIP_ENCODER
+    ra->gzip = NULL;
+#endif
 #if CONFIG_HTTPD_WS_SUPPORT
     ra->ws_handshake_detect = false;
 #endif
@@ -713,6 +721,12 @@ static void httpd_req_cleanup(httpd_req_t *r)
     }
 #endif
 
+#ifdef CONFIG_HTTPD_GZIP_ENCODER
+    /* Encoder of a response which was not completed */
+    httpd_gzip_free(ra->gzip);
+    ra->gzip = NULL;
+#endif
+
     /* Retrieve session info from the request into the socket database. */
     ra->sd->ctx = r->sess_ctx;
     ra->sd->free_ctx = r->free_ctx;
@@ -727,16 +741,15 @@ static void httpd_req_cleanup(httpd_req_t *r)
 /* Function that processes incoming TCP data and
  * updates the http request data httpd_req_t
  */
-esp_err_t httpd_req_new(struct httpd_data *hd, struct sock_db *sd)
+esp_err_t httpd_req_new(struct httpd_data *hd, httpd_req_t *r,
+                        struct httpd_req_aux *ra, struct sock_db *sd)
 {
-    httpd_req_t *r = &hd->hd_req;
     init_req(r, &hd->config);
-    init_req_aux(&hd->hd_req_aux, &hd->config);
+    init_req_aux(ra, &hd->config);
     r->handle = hd;
-    r->aux = &hd->hd_req_aux;
+    r->aux = ra;
 
     /* Associate the request to the socket */
-    struct httpd_req_aux *ra = r->aux;
     ra->sd = sd;
 
     /* Set defaults */
@@ -785,18 +798,18 @@ esp_err_t httpd_req_new(struct httpd_data *hd, struct sock_db *sd)
 #endif
 
     /* Parse request */
-    ret = httpd_parse_req(hd);
+    ret = httpd_parse_req(hd, r);
     if (ret != ESP_OK) {
         httpd_req_cleanup(r);
     }
     return ret;
 }
 
-/* Function that resets the http request data
+/* Function that receives and discards the request data
+ * which has not been read by the handler
  */
-esp_err_t httpd_req_delete(struct httpd_data *hd)
+static esp_err_t httpd_req_purge(httpd_req_t *r)
 {
-    httpd_req_t *r = &hd->hd_req;
     struct httpd_req_aux *ra = r->aux;
 
     /* Finish off reading any pending/leftover data */
@@ -807,7 +820,6 @@ esp_err_t httpd_req_delete(struct httpd_data *hd)
         int recv_len = MIN(sizeof(dummy), ra->remaining_len);
         recv_len = httpd_req_recv(r, dummy, recv_len);
         if (recv_len < 0) {
-            httpd_req_cleanup(r);
             return ESP_FAIL;
         }
 
@@ -822,8 +834,99 @@ esp_err_t httpd_req_delete(struct httpd_data *hd)
         ESP_LOGD(TAG, "===============================================");
 #endif
     }
+    return ESP_OK;
+}
+
+/* Function that resets the http request data
+ */
+esp_err_t httpd_req_delete(struct httpd_data *hd, httpd_req_t *r)
+{
+    struct httpd_req_aux *ra = r->aux;
+
+    /* Leftover data of a request which is handled asynchronously
+     * is purged by httpd_req_async_handler_complete(). The flag of
+     * the session can't tell, as the server task clears it as soon
+     * as the asynchronous request is complete */
+    esp_err_t ret = ESP_OK;
+    if (!ra->async_begun) {
+        ret = httpd_req_purge(r);
+    }
 
     httpd_req_cleanup(r);
+    return ret;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out)
+{
+    if (r == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!httpd_valid_req(r)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+
+    struct httpd_data *hd = (struct httpd_data *) r->handle;
+    struct httpd_req_aux *ra = r->aux;
+    if (ra->async_begun) {
+        /* Only one asynchronous request at a time per session */
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    httpd_req_t *async = malloc(sizeof(httpd_req_t));
+    struct httpd_req_aux *async_aux = malloc(sizeof(struct httpd_req_aux));
+    struct resp_hdr *resp_hdrs = calloc(hd->config.max_resp_headers, sizeof(struct resp_hdr));
+    if (!async || !async_aux || !resp_hdrs) {
+        ESP_LOGE(TAG, LOG_FMT("failed to allocate memory for async request"));
+        free(resp_hdrs);
+        free(async_aux);
+        free(async);
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+
+    /* Set before the copy, so that neither request can be handed off again */
+    ra->async_begun = true;
+    memcpy(async, r, sizeof(httpd_req_t));
+    memcpy(async_aux, ra, sizeof(struct httpd_req_aux));
+    memcpy(resp_hdrs, ra->resp_hdrs, hd->config.max_resp_headers * sizeof(struct resp_hdr));
+    async_aux->resp_hdrs = resp_hdrs;
+    async_aux->file_buf = NULL;
+    async->aux = async_aux;
+#ifdef CONFIG_HTTPD_GZIP_ENCODER
+    /* The response is continued by the asynchronous request */
+    ra->gzip = NULL;
+#endif
+
+    /* Keep the server from receiving on the session, or closing it,
+     * until the asynchronous request is complete */
+    ra->sd->for_async_req = true;
+    *out = async;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r)
+{
+    if (r == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct httpd_data *hd = (struct httpd_data *) r->handle;
+    struct httpd_req_aux *ra = r->aux;
+    struct sock_db *sd = ra->sd;
+
+    esp_err_t ret = httpd_req_purge(r);
+
+    free(ra->resp_hdrs);
+    free(ra->file_buf);
+#ifdef CONFIG_HTTPD_GZIP_ENCODER
+    httpd_gzip_free(ra->gzip);
+#endif
+    free(ra);
+    free(r);
+
+    /* Hand the session back to the server task */
+    if (httpd_sess_done(hd, sd, true, ret) != ESP_OK) {
+        return ESP_FAIL;
+    }
     return ESP_OK;
 }
 
@@ -836,10 +939,16 @@ bool httpd_validate_req_ptr(httpd_req_t *r)
         struct httpd_data *hd = (struct httpd_data *) r->handle;
         if (hd) {
             /* Check if this function is running in the context of
-             * the correct httpd server thread */
-            if (httpd_os_thread_handle() == hd->hd_td.handle) {
+             * the correct httpd server thread, or one of its workers */
+            othread_t current = httpd_os_thread_handle();
+            if (current == hd->hd_td.handle) {
                 return true;
             }
+            for (unsigned i = 0; hd->hd_workers && i < hd->config.max_workers; i++) {
+                if (current == hd->hd_workers[i].td.handle) {
+                    return true;
+                }
+            }
         }
     }
     return false;
@@ -954,17 +1063,9 @@ esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
 }
 
 /* Get the length of the value string of a header request field */
-size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+/* Returns the value of a request header, or NULL if not found */
+static const char *httpd_req_find_hdr_value(struct httpd_req_aux *ra, const char *field)
 {
-    if (r == NULL || field == NULL) {
-        return 0;
-    }
-
-    if (!httpd_valid_req(r)) {
-        return 0;
-    }
-
-    struct httpd_req_aux *ra = r->aux;
     const char   *hdr_ptr = ra->scratch;         /*!< Request headers are kept in scratch buffer */
     unsigned      count   = ra->req_hdrs_count;  /*!< Count set during parsing  */
 
@@ -1003,12 +1104,25 @@ size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
         while ((*val_ptr != '\0') && (*val_ptr == ' ')) {
             val_ptr++;
         }
-        return strlen(val_ptr);
+        return val_ptr;
     }
-    return 0;
+    return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    if (r == NULL || field == NULL) {
+        return 0;
+    }
+
+    if (!httpd_valid_req(r)) {
+        return 0;
+    }
+
+    const char *val_ptr = httpd_req_find_hdr_value(r->aux, field);
+    return val_ptr ? strlen(val_ptr) : 0;
 }
 
-/* Get the value of a field from the request headers */
 esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
 {
     if (r == NULL || field == NULL) {
@@ -1019,58 +1133,90 @@ esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *v
         return ESP_ERR_HTTPD_INVALID_REQ;
     }
 
-    struct httpd_req_aux *ra = r->aux;
-    const char   *hdr_ptr = ra->scratch;         /*!< Request headers are kept in scratch buffer */
-    unsigned     count    = ra->req_hdrs_count;  /*!< Count set during parsing  */
-    const size_t buf_len  = val_size;
+    const size_t buf_len = val_size;
+    const char *val_ptr = httpd_req_find_hdr_value(r->aux, field);
+    if (val_ptr == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
 
-    while (count--) {
-        /* Search for the ':' character. Else, it would mean
-         * that the field is invalid
-         */
-        const char *val_ptr = strchr(hdr_ptr, ':');
-        if (!val_ptr) {
-            break;
-        }
+    /* Get the NULL terminated value and copy it to the caller's buffer. */
+    strlcpy(val, val_ptr, buf_len);
 
-        /* If the field, does not match, continue searching.
-         * Compare lengths first as field from header is not
-         * null terminated (has ':' in the end).
-         */
-        if ((val_ptr - hdr_ptr != strlen(field)) ||
-            (strncasecmp(hdr_ptr, field, strlen(field)))) {
-            if (count) {
-                /* Jump to end of header field-value string */
-                hdr_ptr = 1 + strchr(hdr_ptr, '\0');
+    /* Update value length, including one byte for null */
+    val_size = strlen(val_ptr) + 1;
 
-                /* Skip all null characters (with which the line
-                 * terminators had been overwritten) */
-                while (*hdr_ptr == '\0') {
-                    hdr_ptr++;
-                }
-            }
-            continue;
+    /* If buffer length is smaller than needed, return truncation error */
+    if (buf_len < val_size) {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    return ESP_OK;
+}
+
+/* Checks whether a quality value (RFC 7231, section 5.3.1) is 0 */
+static bool httpd_qvalue_is_zero(const char *q)
+{
+    if (*q++ != '0') {
+        return false;
+    }
+    if (*q == '.') {
+        q++;
+        while (*q == '0') {
+            q++;
         }
+    }
+    return !(*q >= '1' && *q <= '9');
+}
 
-        /* Skip ':' */
-        val_ptr++;
+bool httpd_req_accepts_encoding(httpd_req_t *r, const char *coding)
+{
+    if (r == NULL || coding == NULL) {
+        return false;
+    }
 
-        /* Skip preceding space */
-        while ((*val_ptr != '\0') && (*val_ptr == ' ')) {
-            val_ptr++;
-        }
+    if (!httpd_valid_req(r)) {
+        return false;
+    }
 
-        /* Get the NULL terminated value and copy it to the caller's buffer. */
-        strlcpy(val, val_ptr, buf_len);
+    const char *val = httpd_req_find_hdr_value(r->aux, "Accept-Encoding");
+    if (val == NULL) {
+        return false;
+    }
 
-        /* Update value length, including one byte for null */
-        val_size = strlen(val_ptr) + 1;
+    /* Comma separated list of codings, each optionally followed by parameters,
+     * e.g. "gzip;q=1.0, identity; q=0.5, *;q=0" */
+    const size_t coding_len = strlen(coding);
+    bool any = false;
+    while (*val) {
+        while (*val == ' ' || *val == ',') {
+            val++;
+        }
+        const char *name = val;
+        while (*val && *val != ',' && *val != ';' && *val != ' ') {
+            val++;
+        }
+        const size_t name_len = val - name;
+
+        /* A coding with quality value 0 is not acceptable */
+        bool rejected = false;
+        while (*val && *val != ',') {
+            if (*val == ';') {
+                do {
+                    val++;
+                } while (*val == ' ');
+                if ((*val == 'q' || *val == 'Q') && val[1] == '=') {
+                    rejected = httpd_qvalue_is_zero(val + 2);
+                }
+                continue;
+            }
+            val++;
+        }
 
-        /* If buffer length is smaller than needed, return truncation error */
-        if (buf_len < val_size) {
-            return ESP_ERR_HTTPD_RESULT_TRUNC;
+        if (name_len == coding_len && strncasecmp(name, coding, coding_len) == 0) {
+            return !rejected;
+        }
+        if (name_len == 1 && *name == '*') {
+            any = !rejected;
         }
-        return ESP_OK;
     }
-    return ESP_ERR_NOT_FOUND;
+    return any;
 }
@@ -56,6 +56,72 @@ struct sock_db *httpd_sess_get(struct httpd_data *hd, int sockfd)
     return NULL;
 }
 
+/* Return the request being processed on a session, if a request
+ * handler is running for it in the server task or in a worker */
+static httpd_req_t *httpd_sess_active_req(struct httpd_data *hd, struct sock_db *sd)
+{
+    if (hd->hd_req_aux.sd == sd) {
+        return &hd->hd_req;
+    }
+    for (unsigned i = 0; hd->hd_workers && i < hd->config.max_workers; i++) {
+        if (hd->hd_workers[i].req_aux.sd == sd) {
+            return &hd->hd_workers[i].req;
+        }
+    }
+    return NULL;
+}
+
+/* Open sessions are kept in a list ordered by their last activity, so that
+ * the least recently used one is found without searching the socket database.
+ * The list is only changed by the server task. A session used by another task,
+ * e.g. through httpd_sess_update_lru_counter(), only gets a new lru_counter,
+ * and is moved to the end of the list once it is found out of order. */
+static void httpd_sess_lru_unlink(struct httpd_data *hd, struct sock_db *sd)
+{
+    if (sd->lru_prev) {
+        sd->lru_prev->lru_next = sd->lru_next;
+    } else {
+        hd->hd_lru_head = sd->lru_next;
+    }
+    if (sd->lru_next) {
+        sd->lru_next->lru_prev = sd->lru_prev;
+    } else {
+        hd->hd_lru_tail = sd->lru_prev;
+    }
+    sd->lru_prev = NULL;
+    sd->lru_next = NULL;
+}
+
+static void httpd_sess_lru_append(struct httpd_data *hd, struct sock_db *sd, int64_t now)
+{
+    sd->lru_prev = hd->hd_lru_tail;
+    sd->lru_next = NULL;
+    if (hd->hd_lru_tail) {
+        hd->hd_lru_tail->lru_next = sd;
+    } else {
+        hd->hd_lru_head = sd;
+    }
+    hd->hd_lru_tail = sd;
+    sd->lru_listed = sd->lru_counter;
+    sd->last_active = now;
+}
+
+/* Returns the least recently used session which can be closed, i.e. which
+ * is not in use. Sessions which are in use, or which were used since they
+ * were listed, are moved to the end of the list on the way. */
+static struct sock_db *httpd_sess_lru_first(struct httpd_data *hd, int64_t now)
+{
+    for (int i = 0; i < hd->config.max_open_sockets && hd->hd_lru_head; i++) {
+        struct sock_db *sd = hd->hd_lru_head;
+        if (!httpd_sess_is_busy(sd) && !sd->close_pending && sd->lru_counter == sd->lru_listed) {
+            return sd;
+        }
+        httpd_sess_lru_unlink(hd, sd);
+        httpd_sess_lru_append(hd, sd, now);
+    }
+    return NULL;
+}
+
 esp_err_t httpd_sess_new(struct httpd_data *hd, int newfd)
 {
     ESP_LOGD(TAG, LOG_FMT("fd = %d"), newfd);
@@ -73,6 +139,7 @@ esp_err_t httpd_sess_new(struct httpd_data *hd, int newfd)
             hd->hd_sd[i].handle = (httpd_handle_t) hd;
             hd->hd_sd[i].send_fn = httpd_default_send;
             hd->hd_sd[i].recv_fn = httpd_default_recv;
+            httpd_sess_lru_append(hd, &hd->hd_sd[i], httpd_os_get_time_us());
 
             /* Call user-defined session opening function */
             if (hd->config.open_fn) {
@@ -111,9 +178,9 @@ void *httpd_sess_get_ctx(httpd_handle_t handle, int sockfd)
     /* Check if the function has been called from inside a
      * request handler, in which case fetch the context from
      * the httpd_req_t structure */
-    struct httpd_data *hd = (struct httpd_data *) handle;
-    if (hd->hd_req_aux.sd == sd) {
-        return hd->hd_req.sess_ctx;
+    httpd_req_t *req = httpd_sess_active_req(handle, sd);
+    if (req) {
+        return req->sess_ctx;
     }
 
     return sd->ctx;
@@ -129,18 +196,18 @@ void httpd_sess_set_ctx(httpd_handle_t handle, int sockfd, void *ctx, httpd_free
     /* Check if the function has been called from inside a
      * request handler, in which case set the context inside
      * the httpd_req_t structure */
-    struct httpd_data *hd = (struct httpd_data *) handle;
-    if (hd->hd_req_aux.sd == sd) {
-        if (hd->hd_req.sess_ctx != ctx) {
+    httpd_req_t *req = httpd_sess_active_req(handle, sd);
+    if (req) {
+        if (req->sess_ctx != ctx) {
             /* Don't free previous context if it is in sockdb
              * as it will be freed inside httpd_req_cleanup() */
-            if (sd->ctx != hd->hd_req.sess_ctx) {
+            if (sd->ctx != req->sess_ctx) {
                 /* Free previous context */
-                httpd_sess_free_ctx(hd->hd_req.sess_ctx, hd->hd_req.free_ctx);
+                httpd_sess_free_ctx(req->sess_ctx, req->free_ctx);
             }
-            hd->hd_req.sess_ctx = ctx;
+            req->sess_ctx = ctx;
         }
-        hd->hd_req.free_ctx = free_fn;
+        req->free_ctx = free_fn;
         return;
     }
 
@@ -178,19 +245,41 @@ void httpd_sess_set_transport_ctx(httpd_handle_t handle, int sockfd, void *ctx,
     sd->free_transport_ctx = free_fn;
 }
 
-void httpd_sess_set_descriptors(struct httpd_data *hd,
+static bool httpd_sess_has_pending(struct httpd_data *hd, struct sock_db *sd)
+{
+    if (sd->pending_fn) {
+        // test if there's any data to be read (besides read() function, which is handled by select() in the main httpd loop)
+        // this should check e.g. for the SSL data buffer
+        if (sd->pending_fn(hd, sd->fd) > 0) {
+            return true;
+        }
+    }
+
+    return (sd->pending_len != 0);
+}
+
+bool httpd_sess_set_descriptors(struct httpd_data *hd,
                                 fd_set *fdset, int *maxfd)
 {
     int i;
+    bool pending = false;
     *maxfd = -1;
     for (i = 0; i < hd->config.max_open_sockets; i++) {
-        if (hd->hd_sd[i].fd != -1) {
+        /* Sessions in use by a worker or an asynchronous
+         * request handler are not read by the server task */
+        if (hd->hd_sd[i].fd != -1 && !httpd_sess_is_busy(&hd->hd_sd[i])) {
             FD_SET(hd->hd_sd[i].fd, fdset);
             if (hd->hd_sd[i].fd > *maxfd) {
                 *maxfd = hd->hd_sd[i].fd;
             }
+            /* A pipelined request may already have been received
+             * completely, so select() would not report it */
+            if (!pending && httpd_sess_has_pending(hd, &hd->hd_sd[i])) {
+                pending = true;
+            }
         }
     }
+    return pending;
 }
 
 /** Check if a FD is valid */
@@ -208,7 +297,10 @@ static inline uint64_t httpd_sess_get_lru_counter(void)
 void httpd_sess_delete_invalid(struct httpd_data *hd)
 {
     for (int i = 0; i < hd->config.max_open_sockets; i++) {
-        if (hd->hd_sd[i].fd != -1 && !fd_is_valid(hd->hd_sd[i].fd)) {
+        /* Busy sessions are left to the worker or asynchronous
+         * request handler, which will fail on the invalid socket */
+        if (hd->hd_sd[i].fd != -1 && !httpd_sess_is_busy(&hd->hd_sd[i]) &&
+            !fd_is_valid(hd->hd_sd[i].fd)) {
             ESP_LOGW(TAG, LOG_FMT("Closing invalid socket %d"), hd->hd_sd[i].fd);
             httpd_sess_delete(hd, hd->hd_sd[i].fd);
         }
@@ -250,6 +342,7 @@ int httpd_sess_delete(struct httpd_data *hd, int fd)
             }
 
             /* mark session slot as available */
+            httpd_sess_lru_unlink(hd, &hd->hd_sd[i]);
             hd->hd_sd[i].fd = -1;
             break;
         } else if (hd->hd_sd[i].fd != -1) {
@@ -278,34 +371,35 @@ bool httpd_sess_pending(struct httpd_data *hd, int fd)
         return ESP_FAIL;
     }
 
-    if (sd->pending_fn) {
-        // test if there's any data to be read (besides read() function, which is handled by select() in the main httpd loop)
-        // this should check e.g. for the SSL data buffer
-        if (sd->pending_fn(hd, fd) > 0) {
-            return true;
-        }
+    /* Pending data of a busy session belongs to the
+     * worker or asynchronous request handler using it */
+    if (httpd_sess_is_busy(sd)) {
+        return false;
     }
 
-    return (sd->pending_len != 0);
+    return httpd_sess_has_pending(hd, sd);
 }
 
 /* This MUST return ESP_OK on successful execution. If any other
  * value is returned, everything related to this socket will be
  * cleaned up and the socket will be closed.
  */
-esp_err_t httpd_sess_process(struct httpd_data *hd, int newfd)
+esp_err_t httpd_sess_process(struct httpd_data *hd, struct sock_db *sd,
+                             httpd_req_t *r, struct httpd_req_aux *ra)
 {
-    struct sock_db *sd = httpd_sess_get(hd, newfd);
-    if (! sd) {
-        return ESP_FAIL;
-    }
-
     ESP_LOGD(TAG, LOG_FMT("httpd_req_new"));
-    if (httpd_req_new(hd, sd) != ESP_OK) {
+    if (httpd_req_new(hd, r, ra, sd) != ESP_OK) {
         return ESP_FAIL;
     }
+    /* Read before the request is reset */
+    bool keep_alive = ra->keep_alive;
     ESP_LOGD(TAG, LOG_FMT("httpd_req_delete"));
-    if (httpd_req_delete(hd) != ESP_OK) {
+    if (httpd_req_delete(hd, r) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (!keep_alive) {
+        /* Any further requests pipelined by the client are discarded */
+        ESP_LOGD(TAG, LOG_FMT("closing connection as requested by the client"));
         return ESP_FAIL;
     }
     ESP_LOGD(TAG, LOG_FMT("success"));
@@ -331,26 +425,61 @@ esp_err_t httpd_sess_update_lru_counter(httpd_handle_t handle, int sockfd)
     return ESP_ERR_NOT_FOUND;
 }
 
-esp_err_t httpd_sess_close_lru(struct httpd_data *hd)
+bool httpd_is_sess_purgeable(struct httpd_data *hd)
 {
-    uint64_t lru_counter = UINT64_MAX;
-    int lru_fd = -1;
     int i;
     for (i = 0; i < hd->config.max_open_sockets; i++) {
-        /* If a descriptor is -1, there is no need to close any session.
-         * So, we can return from here, without finding the Least Recently Used
-         * session
-         */
-        if (hd->hd_sd[i].fd == -1) {
-            return ESP_OK;
+        if (hd->hd_sd[i].fd == -1 ||
+            (!httpd_sess_is_busy(&hd->hd_sd[i]) && !hd->hd_sd[i].close_pending)) {
+            return true;
         }
-        if (hd->hd_sd[i].lru_counter < lru_counter) {
-            lru_counter = hd->hd_sd[i].lru_counter;
-            lru_fd = hd->hd_sd[i].fd;
+    }
+    return false;
+}
+
+esp_err_t httpd_sess_close_lru(struct httpd_data *hd)
+{
+    struct sock_db *sd = httpd_sess_lru_first(hd, httpd_os_get_time_us());
+    if (sd == NULL) {
+        ESP_LOGD(TAG, LOG_FMT("all sessions are in use"));
+        return ESP_FAIL;
+    }
+
+    int fd = sd->fd;
+    ESP_LOGD(TAG, LOG_FMT("fd = %d"), fd);
+    httpd_sess_delete(hd, fd);
+    close(fd);
+    return ESP_OK;
+}
+
+void httpd_sess_touch(struct httpd_data *hd, struct sock_db *sd)
+{
+    httpd_sess_lru_unlink(hd, sd);
+    httpd_sess_lru_append(hd, sd, httpd_os_get_time_us());
+}
+
+int httpd_sess_close_idle(struct httpd_data *hd)
+{
+    if (hd->config.sess_idle_timeout == 0) {
+        return -1;
+    }
+
+    const int64_t timeout = hd->config.sess_idle_timeout * 1000000LL;
+    const int64_t now = httpd_os_get_time_us();
+    struct sock_db *sd;
+    /* Sessions become idle in the order of the LRU list */
+    while ((sd = httpd_sess_lru_first(hd, now)) != NULL) {
+        int64_t idle = now - sd->last_active;
+        if (idle < timeout) {
+            /* Rounded up, not to wake up just before the session becomes idle */
+            return (timeout - idle + 999) / 1000;
         }
+        int fd = sd->fd;
+        ESP_LOGD(TAG, LOG_FMT("closing idle session %d"), fd);
+        httpd_sess_delete(hd, fd);
+        close(fd);
     }
-    ESP_LOGD(TAG, LOG_FMT("fd = %d"), lru_fd);
-    return httpd_sess_trigger_close(hd, lru_fd);
+    return -1;
 }
 
 int httpd_sess_iterate(struct httpd_data *hd, int start_fd)
@@ -384,6 +513,13 @@ static void httpd_sess_close(void *arg)
             ESP_LOGD(TAG, "Skipping session close for %d as it seems to be a race condition", sock_db->fd);
             return;
         }
+        if (httpd_sess_is_busy(sock_db)) {
+            /* Closed by the server task once the worker or the
+             * asynchronous request handler is done with it */
+            ESP_LOGD(TAG, "Deferring session close for %d as it is in use", sock_db->fd);
+            sock_db->close_pending = true;
+            return;
+        }
         int fd = sock_db->fd;
         struct httpd_data *hd = (struct httpd_data *) sock_db->handle;
         httpd_sess_delete(hd, fd);
@@ -14,6 +14,9 @@
 
 
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <esp_log.h>
 #include <esp_err.h>
 
@@ -22,6 +25,16 @@
 
 static const char *TAG = "httpd_txrx";
 
+/* Maximum number of buffers passed to the socket at once */
+#define HTTPD_IOV_MAX   16
+
+/* Buffers to be sent together */
+struct httpd_iov {
+    httpd_req_t *r;
+    int count;
+    struct iovec iov[HTTPD_IOV_MAX];
+};
+
 esp_err_t httpd_sess_set_send_override(httpd_handle_t hd, int sockfd, httpd_send_func_t send_func)
 {
     struct sock_db *sess = httpd_sess_get(hd, sockfd);
@@ -89,6 +102,76 @@ static esp_err_t httpd_send_all(httpd_req_t *r, const char *buf, size_t buf_len)
     return ESP_OK;
 }
 
+static int httpd_sock_err(const char *ctx, int sockfd);
+
+/* Sends all the buffers, with a single call to the socket if possible. Sessions with
+ * an overridden send function (e.g. for TLS) are sent one buffer at a time */
+static esp_err_t httpd_sendv_all(httpd_req_t *r, struct iovec *iov, int iov_count)
+{
+    struct httpd_req_aux *ra = r->aux;
+
+    if (ra->sd->send_fn != httpd_default_send) {
+        for (int i = 0; i < iov_count; i++) {
+            if (httpd_send_all(r, iov[i].iov_base, iov[i].iov_len) != ESP_OK) {
+                return ESP_FAIL;
+            }
+        }
+        return ESP_OK;
+    }
+
+    struct msghdr msg = {
+        .msg_iov    = iov,
+        .msg_iovlen = iov_count,
+    };
+    while (msg.msg_iovlen > 0) {
+        int ret = sendmsg(ra->sd->fd, &msg, 0);
+        if (ret < 0) {
+            httpd_sock_err("sendmsg", ra->sd->fd);
+            return ESP_FAIL;
+        }
+        ESP_LOGD(TAG, LOG_FMT("sent = %d"), ret);
+
+        /* Skip the buffers sent, and the sent part of the next one */
+        while (msg.msg_iovlen > 0 && ret >= msg.msg_iov->iov_len) {
+            ret -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (ret > 0) {
+            msg.msg_iov->iov_base = (char *) msg.msg_iov->iov_base + ret;
+            msg.msg_iov->iov_len -= ret;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t httpd_iov_flush(struct httpd_iov *v)
+{
+    int iov_count = v->count;
+    v->count = 0;
+    if (httpd_sendv_all(v->r, v->iov, iov_count) != ESP_OK) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t httpd_iov_add(struct httpd_iov *v, const char *buf, size_t buf_len)
+{
+    if (buf_len == 0) {
+        return ESP_OK;
+    }
+    if (v->count == HTTPD_IOV_MAX) {
+        esp_err_t ret = httpd_iov_flush(v);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    v->iov[v->count].iov_base = (void *) buf;
+    v->iov[v->count].iov_len = buf_len;
+    v->count++;
+    return ESP_OK;
+}
+
 static size_t httpd_recv_pending(httpd_req_t *r, char *buf, size_t buf_len)
 {
     struct httpd_req_aux *ra = r->aux;
@@ -232,6 +315,113 @@ esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
     return ESP_OK;
 }
 
+/* Content length of responses with chunked transfer encoding */
+#define HTTPD_CHUNKED_CONTENT_LEN   -1
+
+/* Appends the status line and headers of the response to the buffers to be sent.
+ * As many headers as fit are formatted into the scratch buffer, so that headers
+ * usually take up a single buffer */
+static esp_err_t httpd_iov_add_hdrs(struct httpd_iov *v, ssize_t content_len)
+{
+    struct httpd_req_aux *ra = v->r->aux;
+    const char *httpd_hdr_str = "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n";
+    const char *httpd_chunked_hdr_str = "HTTP/1.1 %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n";
+    const char *colon_separator = ": ";
+    const char *cr_lf_seperator = "\r\n";
+    const size_t size = sizeof(ra->scratch);
+    size_t len;
+
+    /* Request headers are no longer available */
+    ra->req_hdrs_count = 0;
+
+    /* Size of essential headers is limited by scratch buffer size */
+    if (content_len == HTTPD_CHUNKED_CONTENT_LEN) {
+        len = snprintf(ra->scratch, size, httpd_chunked_hdr_str, ra->status, ra->content_type);
+    } else {
+        len = snprintf(ra->scratch, size, httpd_hdr_str, ra->status, ra->content_type, content_len);
+    }
+    if (len >= size) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+
+    /* The connection is closed after the response, as asked by the client */
+    if (!ra->keep_alive) {
+        len += snprintf(ra->scratch + len, size - len, "Connection: close\r\n");
+        if (len >= size) {
+            return ESP_ERR_HTTPD_RESP_HDR;
+        }
+    }
+
+    /* Additional headers based on set_header, appended while they fit */
+    unsigned i;
+    for (i = 0; i < ra->resp_hdrs_count; i++) {
+        size_t hdr_len = snprintf(ra->scratch + len, size - len, "%s%s%s%s",
+                                  ra->resp_hdrs[i].field, colon_separator,
+                                  ra->resp_hdrs[i].value, cr_lf_seperator);
+        if (hdr_len >= size - len) {
+            break;
+        }
+        len += hdr_len;
+    }
+
+    /* End header section */
+    const bool hdr_end = (i == ra->resp_hdrs_count && len + strlen(cr_lf_seperator) < size);
+    if (hdr_end) {
+        strcpy(ra->scratch + len, cr_lf_seperator);
+        len += strlen(cr_lf_seperator);
+    }
+
+    esp_err_t ret = httpd_iov_add(v, ra->scratch, len);
+
+    /* Remaining headers, sent from where they are */
+    for (; i < ra->resp_hdrs_count && ret == ESP_OK; i++) {
+        ret = httpd_iov_add(v, ra->resp_hdrs[i].field, strlen(ra->resp_hdrs[i].field));
+        if (ret == ESP_OK) {
+            ret = httpd_iov_add(v, colon_separator, strlen(colon_separator));
+        }
+        if (ret == ESP_OK) {
+            ret = httpd_iov_add(v, ra->resp_hdrs[i].value, strlen(ra->resp_hdrs[i].value));
+        }
+        if (ret == ESP_OK) {
+            ret = httpd_iov_add(v, cr_lf_seperator, strlen(cr_lf_seperator));
+        }
+    }
+    if (!hdr_end && ret == ESP_OK) {
+        ret = httpd_iov_add(v, cr_lf_seperator, strlen(cr_lf_seperator));
+    }
+    return ret;
+}
+
+/* Sends a complete response, with the content in the given buffers */
+static esp_err_t httpd_resp_send_iov(httpd_req_t *r, const httpd_iovec_t *iov, size_t iov_count,
+                                     ssize_t content_len)
+{
+#ifdef CONFIG_HTTPD_GZIP_ENCODER
+    struct httpd_req_aux *ra = r->aux;
+    if (ra->gzip) {
+        /* The length of the compressed content is not known in advance */
+        esp_err_t ret = ESP_OK;
+        for (size_t i = 0; i < iov_count && ret == ESP_OK; i++) {
+            if (iov[i].len > 0) {
+                ret = httpd_resp_send_chunk(r, iov[i].buf, iov[i].len);
+            }
+        }
+        return ret == ESP_OK ? httpd_resp_send_chunk(r, NULL, 0) : ret;
+    }
+#endif
+
+    struct httpd_iov v = { .r = r };
+
+    esp_err_t ret = httpd_iov_add_hdrs(&v, content_len);
+    for (size_t i = 0; i < iov_count && ret == ESP_OK; i++) {
+        ret = httpd_iov_add(&v, iov[i].buf, iov[i].len);
+    }
+    if (ret == ESP_OK) {
+        ret = httpd_iov_flush(&v);
+    }
+    return ret;
+}
+
 esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
 {
     if (r == NULL) {
@@ -242,63 +432,77 @@ esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
         return ESP_ERR_HTTPD_INVALID_REQ;
     }
 
-    struct httpd_req_aux *ra = r->aux;
-    const char *httpd_hdr_str = "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n";
-    const char *colon_separator = ": ";
-    const char *cr_lf_seperator = "\r\n";
-
     if (buf_len == HTTPD_RESP_USE_STRLEN) {
         buf_len = strlen(buf);
     }
 
-    /* Request headers are no longer available */
-    ra->req_hdrs_count = 0;
+    const httpd_iovec_t content = {
+        .buf = buf,
+        .len = buf ? buf_len : 0,
+    };
+    return httpd_resp_send_iov(r, &content, 1, buf_len);
+}
 
-    /* Size of essential headers is limited by scratch buffer size */
-    if (snprintf(ra->scratch, sizeof(ra->scratch), httpd_hdr_str,
-                 ra->status, ra->content_type, buf_len) >= sizeof(ra->scratch)) {
-        return ESP_ERR_HTTPD_RESP_HDR;
+esp_err_t httpd_resp_sendv(httpd_req_t *r, const httpd_iovec_t *iov, size_t iov_count)
+{
+    if (r == NULL || (iov == NULL && iov_count > 0)) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    /* Sending essential headers */
-    if (httpd_send_all(r, ra->scratch, strlen(ra->scratch)) != ESP_OK) {
-        return ESP_ERR_HTTPD_RESP_SEND;
+    if (!httpd_valid_req(r)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
     }
 
-    /* Sending additional headers based on set_header */
-    for (unsigned i = 0; i < ra->resp_hdrs_count; i++) {
-        /* Send header field */
-        if (httpd_send_all(r, ra->resp_hdrs[i].field, strlen(ra->resp_hdrs[i].field)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
+    size_t content_len = 0;
+    for (size_t i = 0; i < iov_count; i++) {
+        if (iov[i].buf == NULL && iov[i].len > 0) {
+            return ESP_ERR_INVALID_ARG;
         }
-        /* Send ': ' */
-        if (httpd_send_all(r, colon_separator, strlen(colon_separator)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
-        }
-        /* Send header value */
-        if (httpd_send_all(r, ra->resp_hdrs[i].value, strlen(ra->resp_hdrs[i].value)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
-        }
-        /* Send CR + LF */
-        if (httpd_send_all(r, cr_lf_seperator, strlen(cr_lf_seperator)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
+        content_len += iov[i].len;
+    }
+    return httpd_resp_send_iov(r, iov, iov_count, content_len);
+}
+
+/* Sends a chunk of content as it is, preceded by the headers if it is the first one */
+static esp_err_t httpd_resp_send_chunk_raw(httpd_req_t *r, const char *buf, size_t buf_len)
+{
+    struct httpd_req_aux *ra = r->aux;
+    struct httpd_iov v = { .r = r };
+    esp_err_t ret = ESP_OK;
+
+    if (!ra->first_chunk_sent) {
+        ret = httpd_iov_add_hdrs(&v, HTTPD_CHUNKED_CONTENT_LEN);
+        if (ret != ESP_OK) {
+            return ret;
         }
+        ra->first_chunk_sent = true;
     }
 
-    /* End header section */
-    if (httpd_send_all(r, cr_lf_seperator, strlen(cr_lf_seperator)) != ESP_OK) {
-        return ESP_ERR_HTTPD_RESP_SEND;
+    /* Chunked content, sent together with the headers if this is the first chunk */
+    char len_str[10];
+    snprintf(len_str, sizeof(len_str), "%x\r\n", buf_len);
+    ret = httpd_iov_add(&v, len_str, strlen(len_str));
+    if (ret == ESP_OK && buf) {
+        ret = httpd_iov_add(&v, buf, buf_len);
     }
 
-    /* Sending content */
-    if (buf && buf_len) {
-        if (httpd_send_all(r, buf, buf_len) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
-        }
+    /* Indicate end of chunk */
+    if (ret == ESP_OK) {
+        ret = httpd_iov_add(&v, "\r\n", strlen("\r\n"));
     }
-    return ESP_OK;
+    if (ret == ESP_OK) {
+        ret = httpd_iov_flush(&v);
+    }
+    return ret;
 }
 
+#ifdef CONFIG_HTTPD_GZIP_ENCODER
+static esp_err_t httpd_gzip_out(void *arg, const char *buf, size_t len)
+{
+    return httpd_resp_send_chunk_raw((httpd_req_t *) arg, buf, len);
+}
+#endif
+
 esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
 {
     if (r == NULL) {
@@ -313,71 +517,198 @@ esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len
         buf_len = strlen(buf);
     }
 
+#ifdef CONFIG_HTTPD_GZIP_ENCODER
     struct httpd_req_aux *ra = r->aux;
-    const char *httpd_chunked_hdr_str = "HTTP/1.1 %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n";
-    const char *colon_separator = ": ";
-    const char *cr_lf_seperator = "\r\n";
+    if (ra->gzip) {
+        /* Compressed data is sent in chunks as the encoder outputs it */
+        if (buf && buf_len > 0) {
+            return httpd_gzip_write(ra->gzip, buf, buf_len, httpd_gzip_out, r);
+        }
+        esp_err_t ret = httpd_gzip_finish(ra->gzip, httpd_gzip_out, r);
+        httpd_gzip_free(ra->gzip);
+        ra->gzip = NULL;
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+#endif
 
-    /* Request headers are no longer available */
-    ra->req_hdrs_count = 0;
+    return httpd_resp_send_chunk_raw(r, buf, buf ? buf_len : 0);
+}
 
-    if (!ra->first_chunk_sent) {
-        /* Size of essential headers is limited by scratch buffer size */
-        if (snprintf(ra->scratch, sizeof(ra->scratch), httpd_chunked_hdr_str,
-                     ra->status, ra->content_type) >= sizeof(ra->scratch)) {
-            return ESP_ERR_HTTPD_RESP_HDR;
-        }
+esp_err_t httpd_resp_send_file(httpd_req_t *r, int fd)
+{
+    if (r == NULL || fd < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-        /* Sending essential headers */
-        if (httpd_send_all(r, ra->scratch, strlen(ra->scratch)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
+    if (!httpd_valid_req(r)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+
+    struct httpd_req_aux *ra = r->aux;
+    if (ra->file_buf == NULL) {
+        ra->file_buf = malloc(CONFIG_HTTPD_FILE_BUF_LEN);
+        if (ra->file_buf == NULL) {
+            return ESP_ERR_HTTPD_ALLOC_MEM;
         }
+    }
 
-        /* Sending additional headers based on set_header */
-        for (unsigned i = 0; i < ra->resp_hdrs_count; i++) {
-            /* Send header field */
-            if (httpd_send_all(r, ra->resp_hdrs[i].field, strlen(ra->resp_hdrs[i].field)) != ESP_OK) {
-                return ESP_ERR_HTTPD_RESP_SEND;
-            }
-            /* Send ': ' */
-            if (httpd_send_all(r, colon_separator, strlen(colon_separator)) != ESP_OK) {
-                return ESP_ERR_HTTPD_RESP_SEND;
-            }
-            /* Send header value */
-            if (httpd_send_all(r, ra->resp_hdrs[i].value, strlen(ra->resp_hdrs[i].value)) != ESP_OK) {
-                return ESP_ERR_HTTPD_RESP_SEND;
-            }
-            /* Send CR + LF */
-            if (httpd_send_all(r, cr_lf_seperator, strlen(cr_lf_seperator)) != ESP_OK) {
-                return ESP_ERR_HTTPD_RESP_SEND;
+    /* The length of the rest of the file is known for regular files,
+     * anything else is sent with chunked encoding */
+    struct stat st;
+    off_t pos = -1;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        pos = lseek(fd, 0, SEEK_CUR);
+    }
+#ifdef CONFIG_HTTPD_GZIP_ENCODER
+    if (ra->gzip) {
+        /* Unless the content is compressed */
+        pos = -1;
+    }
+#endif
+    if (pos < 0 || pos > st.st_size) {
+        ssize_t len;
+        while ((len = read(fd, ra->file_buf, CONFIG_HTTPD_FILE_BUF_LEN)) > 0) {
+            esp_err_t ret = httpd_resp_send_chunk(r, ra->file_buf, len);
+            if (ret != ESP_OK) {
+                return ret;
             }
         }
+        if (len < 0) {
+            ESP_LOGW(TAG, LOG_FMT("error reading file : %d"), errno);
+            return ESP_FAIL;
+        }
+        return httpd_resp_send_chunk(r, NULL, 0);
+    }
+
+    /* The first buffer is sent together with the headers */
+    size_t remaining = st.st_size - pos;
+    ssize_t len = read(fd, ra->file_buf, MIN(remaining, CONFIG_HTTPD_FILE_BUF_LEN));
+    if (len < 0) {
+        ESP_LOGW(TAG, LOG_FMT("error reading file : %d"), errno);
+        return ESP_FAIL;
+    }
+    const httpd_iovec_t content = {
+        .buf = ra->file_buf,
+        .len = len,
+    };
+    esp_err_t ret = httpd_resp_send_iov(r, &content, 1, remaining);
+
+    while (ret == ESP_OK && (remaining -= len) > 0) {
+        len = read(fd, ra->file_buf, MIN(remaining, CONFIG_HTTPD_FILE_BUF_LEN));
+        if (len <= 0) {
+            /* Response can't be completed, the file was truncated */
+            ESP_LOGW(TAG, LOG_FMT("error reading file : %d"), len < 0 ? errno : 0);
+            return ESP_FAIL;
+        }
+        if (httpd_send_all(r, ra->file_buf, len) != ESP_OK) {
+            ret = ESP_ERR_HTTPD_RESP_SEND;
+        }
+    }
+    return ret;
+}
 
-        /* End header section */
-        if (httpd_send_all(r, cr_lf_seperator, strlen(cr_lf_seperator)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
+/* Caches must not serve either variant of the content to all clients */
+static esp_err_t httpd_resp_set_vary_encoding(httpd_req_t *r)
+{
+    struct httpd_req_aux *ra = r->aux;
+    for (unsigned i = 0; i < ra->resp_hdrs_count; i++) {
+        if (strcasecmp(ra->resp_hdrs[i].field, "Vary") == 0 &&
+            strcasecmp(ra->resp_hdrs[i].value, "Accept-Encoding") == 0) {
+            return ESP_OK;
         }
-        ra->first_chunk_sent = true;
     }
+    return httpd_resp_set_hdr(r, "Vary", "Accept-Encoding");
+}
 
-    /* Sending chunked content */
-    char len_str[10];
-    snprintf(len_str, sizeof(len_str), "%x\r\n", buf_len);
-    if (httpd_send_all(r, len_str, strlen(len_str)) != ESP_OK) {
-        return ESP_ERR_HTTPD_RESP_SEND;
+esp_err_t httpd_resp_send_static_file(httpd_req_t *r, const char *path)
+{
+    if (r == NULL || path == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    if (buf) {
-        if (httpd_send_all(r, buf, (size_t) buf_len) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
+    if (!httpd_valid_req(r)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+
+    int fd = -1;
+    char *gz_path = malloc(strlen(path) + sizeof(".gz"));
+    if (gz_path == NULL) {
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    strcpy(gz_path, path);
+    strcat(gz_path, ".gz");
+
+    /* The compressed variant is not used if the response is compressed on the fly */
+    bool precompressed = true;
+#ifdef CONFIG_HTTPD_GZIP_ENCODER
+    struct httpd_req_aux *ra = r->aux;
+    precompressed = (ra->gzip == NULL);
+#endif
+    struct stat st;
+    if (precompressed && stat(gz_path, &st) == 0) {
+        esp_err_t ret = httpd_resp_set_vary_encoding(r);
+        if (ret == ESP_OK && httpd_req_accepts_encoding(r, "gzip")) {
+            fd = open(gz_path, O_RDONLY);
+            if (fd >= 0 && httpd_resp_set_hdr(r, "Content-Encoding", "gzip") != ESP_OK) {
+                close(fd);
+                fd = -1;
+            }
         }
     }
+    free(gz_path);
 
-    /* Indicate end of chunk */
-    if (httpd_send_all(r, "\r\n", strlen("\r\n")) != ESP_OK) {
-        return ESP_ERR_HTTPD_RESP_SEND;
+    if (fd < 0) {
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return ESP_ERR_NOT_FOUND;
+        }
+    }
+
+    esp_err_t ret = httpd_resp_send_file(r, fd);
+    close(fd);
+    return ret;
+}
+
+esp_err_t httpd_resp_enable_gzip(httpd_req_t *r)
+{
+    if (r == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!httpd_valid_req(r)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+
+#ifdef CONFIG_HTTPD_GZIP_ENCODER
+    struct httpd_req_aux *ra = r->aux;
+    if (ra->first_chunk_sent || ra->gzip) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret = httpd_resp_set_vary_encoding(r);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (!httpd_req_accepts_encoding(r, "gzip")) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    ret = httpd_resp_set_hdr(r, "Content-Encoding", "gzip");
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ra->gzip = httpd_gzip_new();
+    if (ra->gzip == NULL) {
+        /* Remove the Content-Encoding header again */
+        ra->resp_hdrs_count--;
+        return ESP_ERR_HTTPD_ALLOC_MEM;
     }
     return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
 }
 
 esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *usr_msg)
@@ -29,15 +29,15 @@ static bool httpd_uri_match_simple(const char *uri1, const char *uri2, size_t le
         (strncmp(uri1, uri2, len2) == 0);   // Then match actual URIs
 }
 
-bool httpd_uri_match_wildcard(const char *template, const char *uri, size_t len)
+bool httpd_uri_template_parse(const char *tpl, size_t *exact_len, char *optional, bool *asterisk)
 {
-    const size_t tpl_len = strlen(template);
+    const size_t tpl_len = strlen(tpl);
     size_t exact_match_chars = tpl_len;
 
     /* Check for trailing question mark and asterisk */
-    const char last = (const char) (tpl_len > 0 ? template[tpl_len - 1] : 0);
-    const char prevlast = (const char) (tpl_len > 1 ? template[tpl_len - 2] : 0);
-    const bool asterisk = last == '*' || (prevlast == '*' && last == '?');
+    const char last = (const char) (tpl_len > 0 ? tpl[tpl_len - 1] : 0);
+    const char prevlast = (const char) (tpl_len > 1 ? tpl[tpl_len - 2] : 0);
+    const bool ast = last == '*' || (prevlast == '*' && last == '?');
     const bool quest = last == '?' || (prevlast == '?' && last == '*');
 
     /* Minimum template string length must be:
@@ -51,41 +51,112 @@ bool httpd_uri_match_wildcard(const char *template, const char *uri, size_t len)
      */
 
     /* abort in cases such as "?" with no preceding character (invalid template) */
-    if (exact_match_chars < asterisk + quest*2) {
+    if (exact_match_chars < ast + quest*2) {
         return false;
     }
 
     /* account for special characters and the optional character if "?" is used */
-    exact_match_chars -= asterisk + quest*2;
+    exact_match_chars -= ast + quest*2;
 
-    if (len < exact_match_chars) {
-        return false;
+    *exact_len = exact_match_chars;
+    *optional = quest ? tpl[exact_match_chars] : 0;
+    *asterisk = ast;
+    return true;
+}
+
+size_t httpd_uri_param_len(const char *tpl, size_t pos, size_t n)
+{
+    /* A parameter must start a path segment */
+    if (tpl[pos] != '{' || (pos > 0 && tpl[pos - 1] != '/')) {
+        return 0;
+    }
+    size_t end = pos + 1;
+    while (end < n && tpl[end] != '/') {
+        end++;
     }
+    /* ... and span all of it, with a non-empty name */
+    if (end - pos < 3 || tpl[end - 1] != '}') {
+        return 0;
+    }
+    return end - pos;
+}
 
-    if (!quest) {
-        if (!asterisk && len != exact_match_chars) {
-            /* no special characters and different length - strncmp would return false */
-            return false;
+/* Matches the first n characters of the template against the beginning of the URI.
+ * If params is set, "{name}" path segments of the template match any non-empty
+ * path segment. The number of URI characters matched is returned in matched.
+ * If param is not NULL, the value of the parameter with that name is returned
+ * in val and val_len */
+static bool httpd_uri_match_prefix(const char *tpl, size_t n, const char *uri, size_t len,
+                                   size_t *matched, bool params, const char *param,
+                                   const char **val, size_t *val_len)
+{
+    size_t t = 0, u = 0;
+    while (t < n) {
+        size_t param_len = params ? httpd_uri_param_len(tpl, t, n) : 0;
+        if (param_len) {
+            size_t start = u;
+            while (u < len && uri[u] != '/') {
+                u++;
+            }
+            if (u == start) {
+                return false;
+            }
+            if (param && strlen(param) == param_len - 2 &&
+                strncmp(param, tpl + t + 1, param_len - 2) == 0) {
+                *val = uri + start;
+                *val_len = u - start;
+            }
+            t += param_len;
+        } else {
+            if (u >= len || tpl[t] != uri[u]) {
+                return false;
+            }
+            t++;
+            u++;
         }
-        /* asterisk allows arbitrary trailing characters, we ignore these using
-         * exact_match_chars as the length limit */
-        return (strncmp(template, uri, exact_match_chars) == 0);
-    } else {
-        /* question mark present */
-        if (len > exact_match_chars && template[exact_match_chars] != uri[exact_match_chars]) {
+    }
+    *matched = u;
+    return true;
+}
+
+static bool httpd_uri_match_template(const char *template, const char *uri, size_t len, bool params)
+{
+    size_t exact_match_chars;
+    char optional;
+    bool asterisk;
+
+    if (!httpd_uri_template_parse(template, &exact_match_chars, &optional, &asterisk)) {
+        return false;
+    }
+
+    /* the mandatory part */
+    size_t matched;
+    if (!httpd_uri_match_prefix(template, exact_match_chars, uri, len, &matched,
+                                params, NULL, NULL, NULL)) {
+        return false;
+    }
+
+    if (optional && matched < len) {
+        if (uri[matched] != optional) {
             /* the optional character is present, but different */
             return false;
         }
-        if (strncmp(template, uri, exact_match_chars) != 0) {
-            /* the mandatory part differs */
-            return false;
-        }
-        /* Now we know the URI is longer than the required part of template,
-         * the mandatory part matches, and if the optional character is present, it is correct.
-         * Match is OK if we have asterisk, i.e. any trailing characters are OK, or if
-         * there are no characters beyond the optional character. */
-        return asterisk || len <= exact_match_chars + 1;
+        matched++;
     }
+
+    /* Match is OK if we have asterisk, i.e. any trailing characters are OK, or if
+     * there are no characters beyond the optional character. */
+    return asterisk || matched == len;
+}
+
+bool httpd_uri_match_wildcard(const char *template, const char *uri, size_t len)
+{
+    return httpd_uri_match_template(template, uri, len, false);
+}
+
+bool httpd_uri_match_params(const char *template, const char *uri, size_t len)
+{
+    return httpd_uri_match_template(template, uri, len, true);
 }
 
 /* Find handler with matching URI and method, and set
@@ -95,6 +166,10 @@ static httpd_uri_t* httpd_find_uri_handler(struct httpd_data *hd,
                                            httpd_method_t method,
                                            httpd_err_code_t *err)
 {
+    if (httpd_uri_trie_supported(hd)) {
+        return httpd_uri_trie_find(hd, uri, uri_len, method, err);
+    }
+
     if (err) {
         *err = HTTPD_404_NOT_FOUND;
     }
@@ -175,6 +250,13 @@ esp_err_t httpd_register_uri_handler(httpd_handle_t handle,
 #ifdef CONFIG_HTTPD_WS_SUPPORT
             hd->hd_calls[i]->is_websocket = uri_handler->is_websocket;
 #endif
+            if (httpd_uri_trie_supported(hd) &&
+                httpd_uri_trie_add(hd, hd->hd_calls[i]) != ESP_OK) {
+                free((char*)hd->hd_calls[i]->uri);
+                free(hd->hd_calls[i]);
+                hd->hd_calls[i] = NULL;
+                return ESP_ERR_HTTPD_ALLOC_MEM;
+            }
             ESP_LOGD(TAG, LOG_FMT("[%d] installed %s"), i, uri_handler->uri);
             return ESP_OK;
         }
@@ -200,6 +282,7 @@ esp_err_t httpd_unregister_uri_handler(httpd_handle_t handle,
             (strcmp(hd->hd_calls[i]->uri, uri) == 0)) {  // Then match URI string
             ESP_LOGD(TAG, LOG_FMT("[%d] removing %s"), i, hd->hd_calls[i]->uri);
 
+            httpd_uri_trie_remove(hd, hd->hd_calls[i]);
             free((char*)hd->hd_calls[i]->uri);
             free(hd->hd_calls[i]);
             hd->hd_calls[i] = NULL;
@@ -238,6 +321,7 @@ esp_err_t httpd_unregister_uri(httpd_handle_t handle, const char *uri)
         if (strcmp(hd->hd_calls[i]->uri, uri) == 0) {   // Match URI strings
             ESP_LOGD(TAG, LOG_FMT("[%d] removing %s"), i, uri);
 
+            httpd_uri_trie_remove(hd, hd->hd_calls[i]);
             free((char*)hd->hd_calls[i]->uri);
             free(hd->hd_calls[i]);
             hd->hd_calls[i] = NULL;
@@ -263,6 +347,7 @@ esp_err_t httpd_unregister_uri(httpd_handle_t handle, const char *uri)
 
 void httpd_unregister_all_uri_handlers(struct httpd_data *hd)
 {
+    httpd_uri_trie_free(hd);
     for (unsigned i = 0; i < hd->config.max_uri_handlers; i++) {
         if (!hd->hd_calls[i]) {
             break;
@@ -275,11 +360,11 @@ void httpd_unregister_all_uri_handlers(struct httpd_data *hd)
     }
 }
 
-esp_err_t httpd_uri(struct httpd_data *hd)
+esp_err_t httpd_uri(struct httpd_data *hd, httpd_req_t *req)
 {
     httpd_uri_t            *uri = NULL;
-    httpd_req_t            *req = &hd->hd_req;
-    struct http_parser_url *res = &hd->hd_req_aux.url_parse_res;
+    struct httpd_req_aux   *ra  = req->aux;
+    struct http_parser_url *res = &ra->url_parse_res;
 
     /* For conveying URI not found/method not allowed */
     httpd_err_code_t err = 0;
@@ -310,12 +395,17 @@ esp_err_t httpd_uri(struct httpd_data *hd)
     /* Attach user context data (passed during URI registration) into request */
     req->user_ctx = uri->user_ctx;
 
+    /* Keep the template for retrieving URI parameters */
+    if (hd->config.uri_match_fn == httpd_uri_match_params) {
+        ra->uri_template = uri->uri;
+    }
+
     /* Final step for a WebSocket handshake verification */
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     struct httpd_req_aux   *aux = req->aux;
     if (uri->is_websocket && aux->ws_handshake_detect && uri->method == HTTP_GET) {
         ESP_LOGD(TAG, LOG_FMT("Responding WS handshake to sock %d"), aux->sd->fd);
-        esp_err_t ret = httpd_ws_respond_server_handshake(&hd->hd_req);
+        esp_err_t ret = httpd_ws_respond_server_handshake(req);
         if (ret != ESP_OK) {
             return ret;
         }
@@ -336,3 +426,41 @@ esp_err_t httpd_uri(struct httpd_data *hd)
     }
     return ESP_OK;
 }
+
+esp_err_t httpd_req_get_uri_param(httpd_req_t *r, const char *name, char *val, size_t val_size)
+{
+    if (r == NULL || name == NULL || val == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!httpd_valid_req(r)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+
+    struct httpd_req_aux   *ra  = r->aux;
+    struct http_parser_url *res = &ra->url_parse_res;
+    size_t exact_match_chars;
+    char optional;
+    bool asterisk;
+
+    if (ra->uri_template == NULL || !(res->field_set & (1 << UF_PATH)) ||
+        !httpd_uri_template_parse(ra->uri_template, &exact_match_chars, &optional, &asterisk)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const char *value = NULL;
+    size_t value_len = 0, matched;
+    httpd_uri_match_prefix(ra->uri_template, exact_match_chars,
+                           r->uri + res->field_data[UF_PATH].off, res->field_data[UF_PATH].len,
+                           &matched, true, name, &value, &value_len);
+    if (value == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* Copy the value, truncated to fit the buffer */
+    strlcpy(val, value, MIN(value_len + 1, val_size));
+    if (val_size < value_len + 1) {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,334 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Index of the registered URI handlers, so that the handler for a request
+ * is found in time proportional to the length of the URI, rather than the
+ * number of handlers.
+ *
+ * Templates are stored in a radix tree. Each node matches a part of the URI:
+ * either its label, or for parameter nodes ("{name}" template segments of
+ * httpd_uri_match_params()) one non-empty path segment. A handler is attached
+ * as a route to the node where its template ends. Prefix routes (templates
+ * ending in "*") also match URIs continuing beyond the node. Templates ending
+ * in "?" are attached to two nodes, with and without the optional character.
+ *
+ * All routes matching a URI are visited, and the one registered first for
+ * the request method wins, like in the linear search of the handler array.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <esp_err.h>
+
+#include <esp_http_server.h>
+#include "esp_httpd_priv.h"
+
+struct httpd_uri_route {
+    httpd_uri_t *handler;                   /*!< Registered handler */
+    unsigned seq;                           /*!< Order of registration */
+    bool prefix;                            /*!< Also matches longer URIs */
+    struct httpd_uri_route *next;
+};
+
+struct httpd_uri_trie {
+    struct httpd_uri_trie *children;        /*!< First child */
+    struct httpd_uri_trie *next;            /*!< Next sibling */
+    struct httpd_uri_route *routes;         /*!< Handlers whose template ends here */
+    bool param;                             /*!< Matches one path segment instead of the label */
+    size_t len;                             /*!< Length of the label */
+    char label[];
+};
+
+struct httpd_uri_trie_match {
+    const struct httpd_uri_route *best;     /*!< Earliest registered match for the method */
+    bool uri_found;                         /*!< Any handler matches the URI */
+};
+
+static struct httpd_uri_trie *trie_node_new(const char *label, size_t len, bool param)
+{
+    struct httpd_uri_trie *node = calloc(1, sizeof(struct httpd_uri_trie) + len);
+    if (node) {
+        if (len) {
+            memcpy(node->label, label, len);
+        }
+        node->len = len;
+        node->param = param;
+    }
+    return node;
+}
+
+static void trie_node_free(struct httpd_uri_trie *node)
+{
+    while (node->routes) {
+        struct httpd_uri_route *route = node->routes;
+        node->routes = route->next;
+        free(route);
+    }
+    while (node->children) {
+        struct httpd_uri_trie *child = node->children;
+        node->children = child->next;
+        trie_node_free(child);
+    }
+    free(node);
+}
+
+/* Returns the descendant of node which matches str, creating nodes as needed */
+static struct httpd_uri_trie *trie_insert_literal(struct httpd_uri_trie *node, const char *str, size_t len)
+{
+    while (len > 0) {
+        /* Siblings have different first characters */
+        struct httpd_uri_trie **link = &node->children;
+        while (*link && ((*link)->param || (*link)->label[0] != str[0])) {
+            link = &(*link)->next;
+        }
+
+        struct httpd_uri_trie *child = *link;
+        if (child == NULL) {
+            child = trie_node_new(str, len, false);
+            if (child) {
+                child->next = node->children;
+                node->children = child;
+            }
+            return child;
+        }
+
+        size_t common = 1;
+        while (common < child->len && common < len && child->label[common] == str[common]) {
+            common++;
+        }
+
+        if (common < child->len) {
+            /* Split the child, the new node takes over the common part of the label */
+            struct httpd_uri_trie *split = trie_node_new(child->label, common, false);
+            if (split == NULL) {
+                return NULL;
+            }
+            split->next = child->next;
+            split->children = child;
+            *link = split;
+            child->next = NULL;
+            child->len -= common;
+            memmove(child->label, child->label + common, child->len);
+            child = split;
+        }
+
+        node = child;
+        str += common;
+        len -= common;
+    }
+    return node;
+}
+
+static struct httpd_uri_trie *trie_insert_param(struct httpd_uri_trie *node)
+{
+    struct httpd_uri_trie *child = node->children;
+    while (child && !child->param) {
+        child = child->next;
+    }
+    if (child == NULL) {
+        child = trie_node_new(NULL, 0, true);
+        if (child) {
+            child->next = node->children;
+            node->children = child;
+        }
+    }
+    return child;
+}
+
+/* Returns the node for the first len characters of the template */
+static struct httpd_uri_trie *trie_insert_template(struct httpd_uri_trie *node, const char *tpl,
+                                                   size_t len, bool params)
+{
+    size_t literal = 0;
+    for (size_t pos = 0; node && pos < len; ) {
+        size_t param_len = params ? httpd_uri_param_len(tpl, pos, len) : 0;
+        if (param_len) {
+            node = trie_insert_literal(node, tpl + literal, pos - literal);
+            if (node) {
+                node = trie_insert_param(node);
+            }
+            pos += param_len;
+            literal = pos;
+        } else {
+            pos++;
+        }
+    }
+    return node ? trie_insert_literal(node, tpl + literal, len - literal) : NULL;
+}
+
+static esp_err_t trie_add_route(struct httpd_uri_trie *node, httpd_uri_t *handler,
+                                unsigned seq, bool prefix)
+{
+    struct httpd_uri_route *route = malloc(sizeof(struct httpd_uri_route));
+    if (route == NULL) {
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    route->handler = handler;
+    route->seq = seq;
+    route->prefix = prefix;
+    route->next = node->routes;
+    node->routes = route;
+    return ESP_OK;
+}
+
+/* Removes the routes of the handler from the descendants of node,
+ * and frees the descendants left without routes */
+static void trie_remove_routes(struct httpd_uri_trie *node, const httpd_uri_t *handler)
+{
+    struct httpd_uri_route **route = &node->routes;
+    while (*route) {
+        if ((*route)->handler == handler) {
+            struct httpd_uri_route *removed = *route;
+            *route = removed->next;
+            free(removed);
+        } else {
+            route = &(*route)->next;
+        }
+    }
+
+    struct httpd_uri_trie **link = &node->children;
+    while (*link) {
+        struct httpd_uri_trie *child = *link;
+        trie_remove_routes(child, handler);
+        if (child->routes == NULL && child->children == NULL) {
+            *link = child->next;
+            free(child);
+        } else {
+            link = &child->next;
+        }
+    }
+}
+
+static void trie_lookup(const struct httpd_uri_trie *node, const char *uri, size_t len,
+                        httpd_method_t method, struct httpd_uri_trie_match *match)
+{
+    while (node) {
+        for (const struct httpd_uri_route *route = node->routes; route; route = route->next) {
+            if (len == 0 || route->prefix) {
+                match->uri_found = true;
+                if (route->handler->method == method &&
+                    (match->best == NULL || route->seq < match->best->seq)) {
+                    match->best = route;
+                }
+            }
+        }
+
+        /* At most one literal child matches, and is followed without recursion.
+         * Parameter nodes, which are rare, are searched recursively */
+        const struct httpd_uri_trie *next = NULL;
+        for (const struct httpd_uri_trie *child = node->children; child; child = child->next) {
+            if (child->param) {
+                size_t segment = 0;
+                while (segment < len && uri[segment] != '/') {
+                    segment++;
+                }
+                if (segment > 0) {
+                    trie_lookup(child, uri + segment, len - segment, method, match);
+                }
+            } else if (next == NULL && child->len <= len &&
+                       memcmp(child->label, uri, child->len) == 0) {
+                next = child;
+            }
+        }
+        if (next) {
+            uri += next->len;
+            len -= next->len;
+        }
+        node = next;
+    }
+}
+
+bool httpd_uri_trie_supported(struct httpd_data *hd)
+{
+    /* Custom matchers are opaque, and need the linear search */
+    return hd->config.uri_match_fn == NULL ||
+           hd->config.uri_match_fn == httpd_uri_match_wildcard ||
+           hd->config.uri_match_fn == httpd_uri_match_params;
+}
+
+esp_err_t httpd_uri_trie_add(struct httpd_data *hd, httpd_uri_t *handler)
+{
+    size_t exact_len = strlen(handler->uri);
+    char optional = 0;
+    bool asterisk = false;
+
+    if (hd->config.uri_match_fn != NULL &&
+        !httpd_uri_template_parse(handler->uri, &exact_len, &optional, &asterisk)) {
+        /* Never matches */
+        return ESP_OK;
+    }
+
+    if (hd->hd_uri_trie == NULL) {
+        hd->hd_uri_trie = trie_node_new(NULL, 0, false);
+        if (hd->hd_uri_trie == NULL) {
+            return ESP_ERR_HTTPD_ALLOC_MEM;
+        }
+    }
+
+    const unsigned seq = hd->hd_uri_seq++;
+    struct httpd_uri_trie *node = trie_insert_template(hd->hd_uri_trie, handler->uri, exact_len,
+                                                       hd->config.uri_match_fn == httpd_uri_match_params);
+    if (node && optional) {
+        /* Without the optional character, nothing may follow */
+        if (trie_add_route(node, handler, seq, false) == ESP_OK) {
+            node = trie_insert_literal(node, &optional, 1);
+        } else {
+            node = NULL;
+        }
+    }
+    if (node == NULL || trie_add_route(node, handler, seq, asterisk) != ESP_OK) {
+        httpd_uri_trie_remove(hd, handler);
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    return ESP_OK;
+}
+
+void httpd_uri_trie_remove(struct httpd_data *hd, const httpd_uri_t *handler)
+{
+    if (hd->hd_uri_trie == NULL) {
+        return;
+    }
+    trie_remove_routes(hd->hd_uri_trie, handler);
+    if (hd->hd_uri_trie->routes == NULL && hd->hd_uri_trie->children == NULL) {
+        httpd_uri_trie_free(hd);
+    }
+}
+
+void httpd_uri_trie_free(struct httpd_data *hd)
+{
+    if (hd->hd_uri_trie) {
+        trie_node_free(hd->hd_uri_trie);
+        hd->hd_uri_trie = NULL;
+    }
+}
+
+httpd_uri_t *httpd_uri_trie_find(struct httpd_data *hd, const char *uri, size_t uri_len,
+                                 httpd_method_t method, httpd_err_code_t *err)
+{
+    struct httpd_uri_trie_match match = { NULL, false };
+
+    if (hd->hd_uri_trie) {
+        trie_lookup(hd->hd_uri_trie, uri, uri_len, method, &match);
+    }
+
+    if (err) {
+        if (match.best) {
+            *err = 0;
+        } else {
+            *err = match.uri_found ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND;
+        }
+    }
+    return match.best ? match.best->handler : NULL;
+}
@@ -17,6 +17,7 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
 #include <unistd.h>
 #include <stdint.h>
 #include <esp_timer.h>
@@ -29,6 +30,7 @@ extern "C" {
 #define OS_FAIL    ESP_FAIL
 
 typedef TaskHandle_t othread_t;
+typedef QueueHandle_t oqueue_t;
 
 static inline int httpd_os_thread_create(othread_t *thread,
                                  const char *name, uint16_t stacksize, int prio,
@@ -58,6 +60,40 @@ static inline othread_t httpd_os_thread_handle(void)
     return xTaskGetCurrentTaskHandle();
 }
 
+/* Monotonic time in microseconds */
+static inline int64_t httpd_os_get_time_us(void)
+{
+    return esp_timer_get_time();
+}
+
+static inline oqueue_t httpd_os_queue_create(unsigned length, unsigned item_size)
+{
+    return xQueueCreate(length, item_size);
+}
+
+static inline void httpd_os_queue_delete(oqueue_t queue)
+{
+    vQueueDelete(queue);
+}
+
+/* Doesn't block if the queue is full */
+static inline int httpd_os_queue_send(oqueue_t queue, const void *item)
+{
+    if (xQueueSend(queue, item, 0) == pdTRUE) {
+        return OS_SUCCESS;
+    }
+    return OS_FAIL;
+}
+
+/* Blocks until an item is available */
+static inline int httpd_os_queue_receive(oqueue_t queue, void *item)
+{
+    if (xQueueReceive(queue, item, portMAX_DELAY) == pdTRUE) {
+        return OS_SUCCESS;
+    }
+    return OS_FAIL;
+}
+
 #ifdef __cplusplus
 }
 #endif
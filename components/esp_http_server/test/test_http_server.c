@@ -14,11 +14,29 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/stat.h>
 #include <esp_system.h>
+#include <esp_vfs.h>
 #include <esp_http_server.h>
+#include <http_parser.h>
 
 #include "unity.h"
 #include "test_utils.h"
+#include "soc/cpu.h"
+#include "esp_httpd_priv.h"
+
+#if CONFIG_IDF_TARGET_ESP32
+#include "esp32/rom/crc.h"
+#include "esp32/rom/miniz.h"
+#elif CONFIG_IDF_TARGET_ESP32S2
+#include "esp32s2/rom/crc.h"
+#include "esp32s2/rom/miniz.h"
+#endif
 
 int pre_start_mem, post_stop_mem, post_stop_min_mem;
 bool basic_sanity = true;
@@ -251,3 +269,507 @@ TEST_CASE("Max Allowed Sockets Test", "[HTTP SERVER]")
     config.max_open_sockets += 1;
     TEST_ASSERT(httpd_start(&hd, &config) != ESP_OK);
 }
+
+#define HTTPD_TEST_WORKERS 3
+
+TEST_CASE("Worker Tasks Start/Stop Test", "[HTTP SERVER]")
+{
+    test_case_uses_tcpip();
+
+    httpd_handle_t hd;
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_workers = HTTPD_TEST_WORKERS;
+
+    unsigned task_count = uxTaskGetNumberOfTasks();
+    TEST_ASSERT(httpd_start(&hd, &config) == ESP_OK);
+    vTaskDelay(10);
+    /* Server task and its workers */
+    TEST_ASSERT_EQUAL(task_count + 1 + HTTPD_TEST_WORKERS, uxTaskGetNumberOfTasks());
+
+    test_handler_limit(hd);
+
+    TEST_ASSERT(httpd_stop(hd) == ESP_OK);
+    vTaskDelay(10);
+    TEST_ASSERT_EQUAL(task_count, uxTaskGetNumberOfTasks());
+}
+
+TEST_CASE("URI Params Matcher Tests", "[HTTP SERVER]")
+{
+    struct uritest {
+        const char *template;
+        const char *uri;
+        bool matches;
+    };
+
+    struct uritest uris[] = {
+        {"/users/{id}", "/users/42", true},
+        {"/users/{id}", "/users/", false},
+        {"/users/{id}", "/users", false},
+        {"/users/{id}", "/users/42/", false},
+        {"/users/{id}/posts/{post}", "/users/42/posts/7", true},
+        {"/users/{id}/posts/{post}", "/users/42/posts/", false},
+        {"/{a}/{b}", "/x/y", true},
+        {"/{a}/{b}", "/x//y", false},
+
+        {"/users/{id}/?", "/users/42", true},
+        {"/users/{id}/?", "/users/42/", true},
+        {"/users/{id}/?", "/users/42/x", false},
+        {"/users/{id}/*", "/users/42/", true},
+        {"/users/{id}/*", "/users/42/posts/7", true},
+        {"/users/{id}/*", "/users/42", false},
+        {"/users/{id}*", "/users/42/posts", true},
+
+        /* Not a whole path segment, taken literally */
+        {"/files/{name}.txt", "/files/a.txt", false},
+        {"/files/{name}.txt", "/files/{name}.txt", true},
+        {"/files/x{name}", "/files/x{name}", true},
+        {"/files/{}", "/files/{}", true},
+        {"/files/{}", "/files/a", false},
+        {}
+    };
+
+    struct uritest *ut = &uris[0];
+
+    while(ut->template != 0) {
+        bool match = httpd_uri_match_params(ut->template, ut->uri, strlen(ut->uri));
+        TEST_ASSERT(match == ut->matches);
+        ut++;
+    }
+}
+
+static esp_err_t test_get_uri_param(const char *template, const char *uri,
+                                    const char *name, char *val, size_t val_size)
+{
+    struct httpd_data hd = {
+        .hd_td.handle = httpd_os_thread_handle(),
+    };
+    struct httpd_req_aux *ra = calloc(1, sizeof(struct httpd_req_aux));
+    httpd_req_t *req = calloc(1, sizeof(httpd_req_t));
+    TEST_ASSERT(ra && req);
+
+    req->handle = &hd;
+    req->aux = ra;
+    ra->uri_template = template;
+    strlcpy((char *) req->uri, uri, sizeof(req->uri));
+    TEST_ASSERT(http_parser_parse_url(req->uri, strlen(req->uri), 0, &ra->url_parse_res) == 0);
+
+    esp_err_t ret = httpd_req_get_uri_param(req, name, val, val_size);
+    free(req);
+    free(ra);
+    return ret;
+}
+
+TEST_CASE("URI Params Retrieval Test", "[HTTP SERVER]")
+{
+    char val[8];
+
+    TEST_ASSERT_EQUAL(ESP_OK, test_get_uri_param("/users/{id}/posts/{post}", "/users/42/posts/7?x=1",
+                                                 "id", val, sizeof(val)));
+    TEST_ASSERT_EQUAL_STRING("42", val);
+    TEST_ASSERT_EQUAL(ESP_OK, test_get_uri_param("/users/{id}/posts/{post}", "/users/42/posts/7?x=1",
+                                                 "post", val, sizeof(val)));
+    TEST_ASSERT_EQUAL_STRING("7", val);
+    TEST_ASSERT_EQUAL(ESP_OK, test_get_uri_param("/users/{id}/*", "/users/42/a/b",
+                                                 "id", val, sizeof(val)));
+    TEST_ASSERT_EQUAL_STRING("42", val);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, test_get_uri_param("/users/{id}", "/users/42",
+                                                            "i", val, sizeof(val)));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, test_get_uri_param("/files/{name}.txt", "/files/{name}.txt",
+                                                            "name", val, sizeof(val)));
+    TEST_ASSERT_EQUAL(ESP_ERR_HTTPD_RESULT_TRUNC, test_get_uri_param("/users/{id}", "/users/0123456789",
+                                                                     "id", val, sizeof(val)));
+    TEST_ASSERT_EQUAL_STRING("0123456", val);
+}
+
+#define HTTPD_TEST_LOOKUP_COUNT 100
+
+static httpd_uri_t *test_find_uri_linear(struct httpd_data *hd, const char *uri)
+{
+    for (int i = 0; i < hd->config.max_uri_handlers && hd->hd_calls[i]; i++) {
+        if (httpd_uri_match_wildcard(hd->hd_calls[i]->uri, uri, strlen(uri)) &&
+            hd->hd_calls[i]->method == HTTP_GET) {
+            return hd->hd_calls[i];
+        }
+    }
+    return NULL;
+}
+
+static void test_uri_lookup_performance(unsigned uri_count)
+{
+    struct httpd_data hd = {
+        .config = HTTPD_DEFAULT_CONFIG(),
+    };
+    hd.config.max_uri_handlers = uri_count;
+    hd.config.uri_match_fn = httpd_uri_match_wildcard;
+    hd.hd_calls = calloc(uri_count, sizeof(httpd_uri_t *));
+    TEST_ASSERT_NOT_NULL(hd.hd_calls);
+
+    char path[32];
+    for (unsigned i = 0; i < uri_count; i++) {
+        snprintf(path, sizeof(path), "/api/resource%u/*", i);
+        httpd_uri_t uri = handler_limit_uri(path);
+        TEST_ASSERT_EQUAL(ESP_OK, httpd_register_uri_handler(&hd, &uri));
+    }
+
+    /* Worst case for the linear search */
+    snprintf(path, sizeof(path), "/api/resource%u/item", uri_count - 1);
+    httpd_uri_t *expected = hd.hd_calls[uri_count - 1];
+    httpd_err_code_t err;
+
+    uint32_t start = esp_cpu_get_ccount();
+    for (int i = 0; i < HTTPD_TEST_LOOKUP_COUNT; i++) {
+        TEST_ASSERT(test_find_uri_linear(&hd, path) == expected);
+    }
+    uint32_t linear_cycles = (esp_cpu_get_ccount() - start) / HTTPD_TEST_LOOKUP_COUNT;
+
+    start = esp_cpu_get_ccount();
+    for (int i = 0; i < HTTPD_TEST_LOOKUP_COUNT; i++) {
+        TEST_ASSERT(httpd_uri_trie_find(&hd, path, strlen(path), HTTP_GET, &err) == expected);
+    }
+    uint32_t trie_cycles = (esp_cpu_get_ccount() - start) / HTTPD_TEST_LOOKUP_COUNT;
+
+    char item[40];
+    snprintf(item, sizeof(item), "httpd_uri_linear_%u_cycles", uri_count);
+    IDF_LOG_PERFORMANCE(item, "%d", linear_cycles);
+    snprintf(item, sizeof(item), "httpd_uri_trie_%u_cycles", uri_count);
+    IDF_LOG_PERFORMANCE(item, "%d", trie_cycles);
+    if (uri_count >= 100) {
+        TEST_ASSERT_LESS_THAN(linear_cycles, trie_cycles);
+    }
+
+    httpd_unregister_all_uri_handlers(&hd);
+    TEST_ASSERT_NULL(hd.hd_uri_trie);
+    free(hd.hd_calls);
+}
+
+TEST_CASE("URI Handler Lookup Performance", "[HTTP SERVER]")
+{
+    test_uri_lookup_performance(10);
+    test_uri_lookup_performance(100);
+    test_uri_lookup_performance(1000);
+}
+
+#ifdef CONFIG_HTTPD_GZIP_ENCODER
+
+#define HTTPD_TEST_GZIP_LEN     16384
+
+struct gzip_test_out {
+    char *buf;
+    size_t len;
+    size_t size;
+};
+
+static esp_err_t gzip_test_out(void *arg, const char *buf, size_t len)
+{
+    struct gzip_test_out *out = arg;
+    TEST_ASSERT_LESS_OR_EQUAL(out->size - out->len, len);
+    memcpy(out->buf + out->len, buf, len);
+    out->len += len;
+    return ESP_OK;
+}
+
+TEST_CASE("gzip Response Encoder Test", "[HTTP SERVER]")
+{
+    /* Markup like content, as served by web applications */
+    char *text = malloc(HTTPD_TEST_GZIP_LEN);
+    TEST_ASSERT_NOT_NULL(text);
+    size_t len = 0;
+    for (unsigned i = 0; len < HTTPD_TEST_GZIP_LEN; i++) {
+        size_t n = snprintf(text + len, HTTPD_TEST_GZIP_LEN - len,
+                            "<tr><td class=\"name\">sensor%u</td><td class=\"value\">%u</td></tr>\n",
+                            i, (i * 7919) % 1000);
+        len += n < HTTPD_TEST_GZIP_LEN - len ? n : HTTPD_TEST_GZIP_LEN - len;
+    }
+
+    struct gzip_test_out out = {
+        .buf = malloc(HTTPD_TEST_GZIP_LEN + 1024),
+        .size = HTTPD_TEST_GZIP_LEN + 1024,
+    };
+    TEST_ASSERT_NOT_NULL(out.buf);
+
+    uint32_t start = esp_cpu_get_ccount();
+    struct httpd_gzip *gz = httpd_gzip_new();
+    TEST_ASSERT_NOT_NULL(gz);
+    /* Written in pieces, like by httpd_resp_send_chunk() */
+    for (size_t pos = 0; pos < len; pos += 1000) {
+        size_t n = len - pos < 1000 ? len - pos : 1000;
+        TEST_ASSERT_EQUAL(ESP_OK, httpd_gzip_write(gz, text + pos, n, gzip_test_out, &out));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, httpd_gzip_finish(gz, gzip_test_out, &out));
+    uint32_t cycles = esp_cpu_get_ccount() - start;
+    httpd_gzip_free(gz);
+
+    IDF_LOG_PERFORMANCE("httpd_gzip_16k_cycles", "%d", cycles);
+    IDF_LOG_PERFORMANCE("httpd_gzip_16k_bytes", "%d", (int) out.len);
+    TEST_ASSERT_LESS_THAN(len / 2, out.len);
+
+    /* gzip header and trailer around the deflate stream */
+    TEST_ASSERT_EQUAL_HEX8(0x1f, out.buf[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x8b, out.buf[1]);
+    uint32_t crc, size;
+    memcpy(&crc, out.buf + out.len - 8, sizeof(crc));
+    memcpy(&size, out.buf + out.len - 4, sizeof(size));
+    TEST_ASSERT_EQUAL_HEX32(crc32_le(0, (const uint8_t *) text, len), crc);
+    TEST_ASSERT_EQUAL(len, size);
+
+    char *inflated = malloc(HTTPD_TEST_GZIP_LEN);
+    TEST_ASSERT_NOT_NULL(inflated);
+    TEST_ASSERT_EQUAL(len, tinfl_decompress_mem_to_mem(inflated, HTTPD_TEST_GZIP_LEN,
+                                                       out.buf + 10, out.len - 18, 0));
+    TEST_ASSERT_EQUAL_MEMORY(text, inflated, len);
+
+    free(inflated);
+    free(out.buf);
+    free(text);
+}
+
+#endif /* CONFIG_HTTPD_GZIP_ENCODER */
+
+/* Response sent by the server, as captured from the socket */
+struct test_resp {
+    char *buf;
+    size_t len;
+    size_t size;
+    unsigned send_calls;
+};
+
+static struct test_resp s_test_resp;
+
+static int test_resp_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    struct test_resp *resp = &s_test_resp;
+    resp->send_calls++;
+    if (resp->len + buf_len > resp->size) {
+        resp->size = (resp->len + buf_len) * 2;
+        resp->buf = realloc(resp->buf, resp->size + 1);
+        TEST_ASSERT_NOT_NULL(resp->buf);
+    }
+    memcpy(resp->buf + resp->len, buf, buf_len);
+    resp->len += buf_len;
+    resp->buf[resp->len] = '\0';
+    return buf_len;
+}
+
+/* Request like those handed to URI handlers, with its response captured in s_test_resp */
+static httpd_req_t *test_resp_req_new(void)
+{
+    struct httpd_data *hd = calloc(1, sizeof(struct httpd_data));
+    struct sock_db *sd = calloc(1, sizeof(struct sock_db));
+    struct httpd_req_aux *ra = calloc(1, sizeof(struct httpd_req_aux));
+    httpd_req_t *req = calloc(1, sizeof(httpd_req_t));
+    TEST_ASSERT(hd && sd && ra && req);
+    hd->config = (httpd_config_t) HTTPD_DEFAULT_CONFIG();
+    hd->hd_td.handle = httpd_os_thread_handle();
+    ra->resp_hdrs = calloc(hd->config.max_resp_headers, sizeof(struct resp_hdr));
+    TEST_ASSERT_NOT_NULL(ra->resp_hdrs);
+
+    sd->fd = -1;
+    sd->handle = hd;
+    sd->send_fn = test_resp_send;
+    req->handle = hd;
+    req->aux = ra;
+    ra->sd = sd;
+    ra->status = HTTPD_200;
+    ra->content_type = HTTPD_TYPE_TEXT;
+    ra->keep_alive = true;
+    memset(&s_test_resp, 0, sizeof(s_test_resp));
+    return req;
+}
+
+static void test_resp_req_free(httpd_req_t *req)
+{
+    struct httpd_req_aux *ra = req->aux;
+    free(ra->resp_hdrs);
+    free(ra->file_buf);
+    free(ra->sd);
+    free(ra);
+    free(req->handle);
+    free(req);
+    free(s_test_resp.buf);
+    s_test_resp.buf = NULL;
+}
+
+/* Returns the content of the captured response, after checking its headers */
+static const char *test_resp_content(const char *expected_hdrs)
+{
+    const char *content = strstr(s_test_resp.buf, "\r\n\r\n");
+    TEST_ASSERT_NOT_NULL(content);
+    content += strlen("\r\n\r\n");
+    TEST_ASSERT_EQUAL(strlen(expected_hdrs), content - s_test_resp.buf);
+    TEST_ASSERT_EQUAL_MEMORY(expected_hdrs, s_test_resp.buf, strlen(expected_hdrs));
+    return content;
+}
+
+TEST_CASE("Response with Content in Several Buffers Test", "[HTTP SERVER]")
+{
+    httpd_req_t *req = test_resp_req_new();
+    TEST_ASSERT_EQUAL(ESP_OK, httpd_resp_set_hdr(req, "Custom", "Value1"));
+    TEST_ASSERT_EQUAL(ESP_OK, httpd_resp_set_hdr(req, "Custom2", "Value2"));
+
+    const httpd_iovec_t iov[] = {
+        { .buf = "Hello ", .len = 6 },
+        { .buf = NULL, .len = 0 },
+        { .buf = "World!", .len = 6 },
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, httpd_resp_sendv(req, iov, sizeof(iov) / sizeof(iov[0])));
+
+    const char *content = test_resp_content("HTTP/1.1 200 OK\r\n"
+                                            "Content-Type: text/html\r\n"
+                                            "Content-Length: 12\r\n"
+                                            "Custom: Value1\r\n"
+                                            "Custom2: Value2\r\n"
+                                            "\r\n");
+    TEST_ASSERT_EQUAL_STRING("Hello World!", content);
+    /* A session with its own send function gets the headers in one buffer,
+     * and each non-empty buffer of content */
+    TEST_ASSERT_EQUAL(3, s_test_resp.send_calls);
+
+    const httpd_iovec_t bad_iov = { .buf = NULL, .len = 1 };
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, httpd_resp_sendv(req, &bad_iov, 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, httpd_resp_sendv(req, NULL, 1));
+    test_resp_req_free(req);
+}
+
+#define HTTPD_TEST_FILE_VFS     "/httpd_test"
+#define HTTPD_TEST_FILE_LEN     (3 * CONFIG_HTTPD_FILE_BUF_LEN + 100)
+#define HTTPD_TEST_FILE_START   100
+
+/* Files with content of the given length, read from a regular file or a pipe */
+static struct {
+    mode_t mode;
+    off_t pos;
+} s_test_file;
+
+static inline char test_file_byte(off_t pos)
+{
+    return 'a' + pos % 26;
+}
+
+static int test_file_open(const char *path, int flags, int mode)
+{
+    if (strcmp(path, "/file") == 0) {
+        s_test_file.mode = S_IFREG;
+    } else if (strcmp(path, "/pipe") == 0) {
+        s_test_file.mode = S_IFIFO;
+    } else {
+        errno = ENOENT;
+        return -1;
+    }
+    s_test_file.pos = 0;
+    return 0;
+}
+
+static ssize_t test_file_read(int fd, void *dst, size_t size)
+{
+    size = MIN(size, HTTPD_TEST_FILE_LEN - s_test_file.pos);
+    if (s_test_file.mode != S_IFREG) {
+        /* Short reads, like from a pipe */
+        size = MIN(size, 1000);
+    }
+    for (size_t i = 0; i < size; i++) {
+        ((char *) dst)[i] = test_file_byte(s_test_file.pos++);
+    }
+    return size;
+}
+
+static off_t test_file_lseek(int fd, off_t offset, int mode)
+{
+    if (s_test_file.mode != S_IFREG) {
+        errno = ESPIPE;
+        return -1;
+    }
+    if (mode == SEEK_CUR) {
+        offset += s_test_file.pos;
+    } else if (mode == SEEK_END) {
+        offset += HTTPD_TEST_FILE_LEN;
+    }
+    s_test_file.pos = offset;
+    return offset;
+}
+
+static int test_file_fstat(int fd, struct stat *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->st_mode = s_test_file.mode;
+    st->st_size = s_test_file.mode == S_IFREG ? HTTPD_TEST_FILE_LEN : 0;
+    return 0;
+}
+
+static int test_file_close(int fd)
+{
+    return 0;
+}
+
+static void test_send_file(const char *path, const char *expected_hdrs)
+{
+    const esp_vfs_t vfs = {
+        .flags = ESP_VFS_FLAG_DEFAULT,
+        .open = test_file_open,
+        .read = test_file_read,
+        .lseek = test_file_lseek,
+        .fstat = test_file_fstat,
+        .close = test_file_close,
+    };
+    TEST_ESP_OK(esp_vfs_register(HTTPD_TEST_FILE_VFS, &vfs, NULL));
+
+    int fd = open(path, O_RDONLY);
+    TEST_ASSERT_NOT_EQUAL(-1, fd);
+    /* The file is sent from the current position */
+    char buf[HTTPD_TEST_FILE_START];
+    TEST_ASSERT_EQUAL(HTTPD_TEST_FILE_START, read(fd, buf, sizeof(buf)));
+
+    httpd_req_t *req = test_resp_req_new();
+    TEST_ASSERT_EQUAL(ESP_OK, httpd_resp_send_file(req, fd));
+    close(fd);
+    TEST_ESP_OK(esp_vfs_unregister(HTTPD_TEST_FILE_VFS));
+
+    const char *content = test_resp_content(expected_hdrs);
+    size_t content_len = s_test_resp.len - (content - s_test_resp.buf);
+    char *decoded = NULL;
+    if (strstr(expected_hdrs, "Transfer-Encoding: chunked")) {
+        decoded = malloc(content_len);
+        TEST_ASSERT_NOT_NULL(decoded);
+        size_t len = 0, chunk_len;
+        do {
+            char *end;
+            chunk_len = strtoul(content, &end, 16);
+            TEST_ASSERT_EQUAL_MEMORY("\r\n", end, 2);
+            TEST_ASSERT_LESS_OR_EQUAL(CONFIG_HTTPD_FILE_BUF_LEN, chunk_len);
+            memcpy(decoded + len, end + 2, chunk_len);
+            len += chunk_len;
+            content = end + 2 + chunk_len;
+            TEST_ASSERT_EQUAL_MEMORY("\r\n", content, 2);
+            content += 2;
+        } while (chunk_len > 0);
+        TEST_ASSERT(content == s_test_resp.buf + s_test_resp.len);
+        content = decoded;
+        content_len = len;
+    }
+
+    TEST_ASSERT_EQUAL(HTTPD_TEST_FILE_LEN - HTTPD_TEST_FILE_START, content_len);
+    for (size_t i = 0; i < content_len; i++) {
+        TEST_ASSERT_EQUAL(test_file_byte(HTTPD_TEST_FILE_START + i), content[i]);
+    }
+    free(decoded);
+    test_resp_req_free(req);
+}
+
+TEST_CASE("Response with Content of a File Test", "[HTTP SERVER]")
+{
+    /* Length of the rest of a regular file is known */
+    char hdrs[100];
+    snprintf(hdrs, sizeof(hdrs), "HTTP/1.1 200 OK\r\n"
+             "Content-Type: text/html\r\n"
+             "Content-Length: %d\r\n"
+             "\r\n", HTTPD_TEST_FILE_LEN - HTTPD_TEST_FILE_START);
+    test_send_file(HTTPD_TEST_FILE_VFS "/file", hdrs);
+    /* Headers, then one buffer of content per read of the file */
+    TEST_ASSERT_EQUAL(1 + 3, s_test_resp.send_calls);
+
+    /* Anything else is sent in chunks as read */
+    test_send_file(HTTPD_TEST_FILE_VFS "/pipe",
+                   "HTTP/1.1 200 OK\r\n"
+                   "Content-Type: text/html\r\n"
+                   "Transfer-Encoding: chunked\r\n"
+                   "\r\n");
+}
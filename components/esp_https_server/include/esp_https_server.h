@@ -100,6 +100,8 @@ typedef struct httpd_ssl_config httpd_ssl_config_t;
         .lru_purge_enable   = true,               \
         .recv_wait_timeout  = 5,                  \
         .send_wait_timeout  = 5,                  \
+        .sess_idle_timeout  = 0,                  \
+        .max_workers        = 0,                  \
         .global_user_ctx = NULL,                  \
         .global_user_ctx_free_fn = NULL,          \
         .global_transport_ctx = NULL,             \
@@ -53,6 +53,16 @@ typedef enum {
      * time.
      */
     RINGBUF_TYPE_BYTEBUF,
+    /**
+     * Single-producer/single-consumer byte buffers store data as a sequence of
+     * bytes like byte buffers, but the data is sent and received without
+     * critical sections. Exactly one task (or ISR) may write to the buffer and
+     * exactly one task (or ISR) may read from it. A blocked sender/receiver is
+     * woken up by the other side only when it is actually waiting. Data can
+     * also be written and read in place using xRingbufferWriteAcquire() and
+     * xRingbufferReadAcquire(). These buffers cannot be added to queue sets.
+     */
+    RINGBUF_TYPE_BYTEBUF_SPSC,
     RINGBUF_TYPE_MAX,
 } RingbufferType_t;
 
@@ -74,6 +84,8 @@ typedef struct xSTATIC_RINGBUFFER {
     UBaseType_t uxDummy2;
     BaseType_t xDummy3;
     void *pvDummy4[11];
+    size_t xDummy6[3];
+    BaseType_t xDummy7[2];
     StaticSemaphore_t xDummy5[2];
     portMUX_TYPE muxDummy;
     /** @endcond */
@@ -389,6 +401,99 @@ void vRingbufferReturnItem(RingbufHandle_t xRingbuffer, void *pvItem);
  */
 void vRingbufferReturnItemFromISR(RingbufHandle_t xRingbuffer, void *pvItem, BaseType_t *pxHigherPriorityTaskWoken);
 
+/**
+ * @brief   Acquire free space of a single-producer/single-consumer byte buffer to be written in place
+ *
+ * Retrieve the largest contiguous block of free space at the write position
+ * of the buffer. This function will block until at least one byte of space is
+ * available or until it times out. The data written to the block is made
+ * available to the receiver by calling vRingbufferWriteCommit().
+ *
+ * @param[in]   xRingbuffer     Ring buffer to write to
+ * @param[out]  ppvData         Double pointer to the free space (set to NULL if no space was acquired)
+ * @param[out]  pxSize          Pointer to a variable to which the size of the free space will be written
+ * @param[in]   xTicksToWait    Ticks to wait for free space in the ring buffer.
+ *
+ * @note    This function should only be called on RINGBUF_TYPE_BYTEBUF_SPSC buffers
+ *          and only by the producer. It can be called from an ISR if xTicksToWait is 0.
+ * @note    The free space may end before the end of the free space in the buffer
+ *          if the free space wraps around. Call this function again after
+ *          committing to get the rest.
+ *
+ * @return
+ *      - pdTRUE if space was acquired
+ *      - pdFALSE on time-out
+ */
+BaseType_t xRingbufferWriteAcquire(RingbufHandle_t xRingbuffer, void **ppvData, size_t *pxSize, TickType_t xTicksToWait);
+
+/**
+ * @brief   Make data written in place available to the receiver
+ *
+ * @param[in]   xRingbuffer     Ring buffer to write to
+ * @param[in]   xSize           Number of bytes written at the start of the space
+ *                              returned by xRingbufferWriteAcquire(). Must not exceed its size.
+ *
+ * @note    This function should only be called on RINGBUF_TYPE_BYTEBUF_SPSC buffers
+ */
+void vRingbufferWriteCommit(RingbufHandle_t xRingbuffer, size_t xSize);
+
+/**
+ * @brief   Make data written in place available to the receiver, from an ISR
+ *
+ * @param[in]   xRingbuffer     Ring buffer to write to
+ * @param[in]   xSize           Number of bytes written at the start of the space
+ *                              returned by xRingbufferWriteAcquire(). Must not exceed its size.
+ * @param[out]  pxHigherPriorityTaskWoken   Value pointed to will be set to pdTRUE if the function woke up a higher priority task.
+ *
+ * @note    This function should only be called on RINGBUF_TYPE_BYTEBUF_SPSC buffers
+ */
+void vRingbufferWriteCommitFromISR(RingbufHandle_t xRingbuffer, size_t xSize, BaseType_t *pxHigherPriorityTaskWoken);
+
+/**
+ * @brief   Acquire data of a single-producer/single-consumer byte buffer to be read in place
+ *
+ * Retrieve the largest contiguous block of data at the read position of the
+ * buffer. This function will block until at least one byte is available or
+ * until it times out. The space is given back to the sender by calling
+ * vRingbufferReadRelease().
+ *
+ * @param[in]   xRingbuffer     Ring buffer to read from
+ * @param[out]  ppvData         Double pointer to the data (set to NULL if no data was acquired)
+ * @param[out]  pxSize          Pointer to a variable to which the size of the data will be written
+ * @param[in]   xTicksToWait    Ticks to wait for data in the ring buffer.
+ *
+ * @note    This function should only be called on RINGBUF_TYPE_BYTEBUF_SPSC buffers
+ *          and only by the consumer. It can be called from an ISR if xTicksToWait is 0.
+ *
+ * @return
+ *      - pdTRUE if data was acquired
+ *      - pdFALSE on time-out
+ */
+BaseType_t xRingbufferReadAcquire(RingbufHandle_t xRingbuffer, void **ppvData, size_t *pxSize, TickType_t xTicksToWait);
+
+/**
+ * @brief   Give back space of data read in place to the sender
+ *
+ * @param[in]   xRingbuffer     Ring buffer that was read
+ * @param[in]   xSize           Number of bytes consumed from the start of the data
+ *                              returned by xRingbufferReadAcquire(). Must not exceed its size.
+ *
+ * @note    This function should only be called on RINGBUF_TYPE_BYTEBUF_SPSC buffers
+ */
+void vRingbufferReadRelease(RingbufHandle_t xRingbuffer, size_t xSize);
+
+/**
+ * @brief   Give back space of data read in place to the sender, from an ISR
+ *
+ * @param[in]   xRingbuffer     Ring buffer that was read
+ * @param[in]   xSize           Number of bytes consumed from the start of the data
+ *                              returned by xRingbufferReadAcquire(). Must not exceed its size.
+ * @param[out]  pxHigherPriorityTaskWoken   Value pointed to will be set to pdTRUE if the function woke up a higher priority task.
+ *
+ * @note    This function should only be called on RINGBUF_TYPE_BYTEBUF_SPSC buffers
+ */
+void vRingbufferReadReleaseFromISR(RingbufHandle_t xRingbuffer, size_t xSize, BaseType_t *pxHigherPriorityTaskWoken);
+
 /**
  * @brief   Delete a ring buffer
  *
@@ -446,6 +551,8 @@ size_t xRingbufferGetCurFreeSize(RingbufHandle_t xRingbuffer);
  * to the ring buffer. This function adds the ring buffer's read semaphore to
  * a queue set.
  *
+ * @note    RINGBUF_TYPE_BYTEBUF_SPSC buffers cannot be added to a queue set.
+ *
  * @param[in]   xRingbuffer     Ring buffer to add to the queue set
  * @param[in]   xQueueSet       Queue set to add the ring buffer's read semaphore to
  *
@@ -28,6 +28,7 @@
 #define rbBYTE_BUFFER_FLAG          ( ( UBaseType_t ) 2 )   //The ring buffer is a byte buffer
 #define rbBUFFER_FULL_FLAG          ( ( UBaseType_t ) 4 )   //The ring buffer is currently full (write pointer == free pointer)
 #define rbBUFFER_STATIC_FLAG        ( ( UBaseType_t ) 8 )   //The ring buffer is statically allocated
+#define rbSPSC_FLAG                 ( ( UBaseType_t ) 16 )  //The ring buffer is a lock-free single-producer/single-consumer byte buffer
 
 //Item flags
 #define rbITEM_FREE_FLAG            ( ( UBaseType_t ) 1 )   //Item has been retrieved and returned by application, free to overwrite
@@ -78,6 +79,19 @@ typedef struct RingbufferDefinition {
     uint8_t *pucTail;                           //Pointer to the end of the ring buffer storage area
 
     BaseType_t xItemsWaiting;                   //Number of items/bytes(for byte buffers) currently in ring buffer that have not yet been read
+    /*
+     * SPSC byte buffers don't use the pointers above. The producer only modifies
+     * the write index and the consumer only modifies the read index, so neither
+     * side needs a critical section. Indexes run from 0 to (2 * xSize) - 1 so that
+     * a full buffer (difference of xSize) can be told apart from an empty one.
+     * The waiting flags are set by a side before it blocks on its semaphore, and
+     * the semaphore is only given by the other side when the flag is set.
+     */
+    size_t xSpscWrite;                          //Write index, modified by the producer only
+    size_t xSpscRead;                           //Read index, modified by the consumer only
+    size_t xSpscReadLen;                        //Length of data retrieved by the last receive, freed by vRingbufferReturnItem()
+    BaseType_t xSpscTxWaiting;                  //Producer is blocked waiting for free space
+    BaseType_t xSpscRxWaiting;                  //Consumer is blocked waiting for data
     /*
      * TransSem: Binary semaphore used to indicate to a blocked transmitting tasks
      *           that more free space has become available or that the block has
@@ -178,6 +192,21 @@ static size_t prvGetCurMaxSizeAllowSplit(Ringbuffer_t *pxRingbuffer);
 //Get the maximum size an item that can currently have if sent to a byte buffer
 static size_t prvGetCurMaxSizeByteBuf(Ringbuffer_t *pxRingbuffer);
 
+//Get the number of bytes in a SPSC byte buffer which can currently be written (xIsWriter) or read
+static size_t prvSpscGetAvail(Ringbuffer_t *pxRingbuffer, BaseType_t xIsWriter);
+
+//Get the contiguous free space (xIsWriter) or data at the write or read index of a SPSC byte buffer
+static uint8_t *prvSpscGetContiguous(Ringbuffer_t *pxRingbuffer, BaseType_t xIsWriter, size_t *pxSize);
+
+//Advance the write or read index of a SPSC byte buffer. Returns pdTRUE if the other side is waiting to be woken up
+static BaseType_t prvSpscAdvance(Ringbuffer_t *pxRingbuffer, BaseType_t xIsWriter, size_t xSize);
+
+//Block until xRequired bytes can be written (xIsWriter) or read from a SPSC byte buffer, or until timeout
+static BaseType_t prvSpscWait(Ringbuffer_t *pxRingbuffer, BaseType_t xIsWriter, size_t xRequired, TickType_t xTicksToWait);
+
+//Copy an item to a SPSC byte buffer. Only call this function after prvSpscWait() for the item's size succeeded
+static BaseType_t prvSpscCopyItem(Ringbuffer_t *pxRingbuffer, const uint8_t *pucItem, size_t xItemSize);
+
 /**
  * Generic function used to retrieve an item/data from ring buffers. If called on
  * an allow-split buffer, and pvItem2 and xItemSize2 are not NULL, both parts of
@@ -241,6 +270,9 @@ static void prvInitializeNewRingbuffer(size_t xBufferSize,
         pxNewRingbuffer->xGetCurMaxSize = prvGetCurMaxSizeAllowSplit;
     } else { //Byte Buffer
         pxNewRingbuffer->uxRingbufferFlags |= rbBYTE_BUFFER_FLAG;
+        if (xBufferType == RINGBUF_TYPE_BYTEBUF_SPSC) {
+            pxNewRingbuffer->uxRingbufferFlags |= rbSPSC_FLAG;
+        }
         pxNewRingbuffer->xCheckItemFits = prvCheckItemFitsByteBuffer;
         pxNewRingbuffer->vCopyItem = prvCopyItemByteBuf;
         pxNewRingbuffer->pvGetItem = prvGetItemByteBuf;
@@ -249,6 +281,11 @@ static void prvInitializeNewRingbuffer(size_t xBufferSize,
         pxNewRingbuffer->xMaxItemSize = pxNewRingbuffer->xSize;
         pxNewRingbuffer->xGetCurMaxSize = prvGetCurMaxSizeByteBuf;
     }
+    pxNewRingbuffer->xSpscWrite = 0;
+    pxNewRingbuffer->xSpscRead = 0;
+    pxNewRingbuffer->xSpscReadLen = 0;
+    pxNewRingbuffer->xSpscTxWaiting = pdFALSE;
+    pxNewRingbuffer->xSpscRxWaiting = pdFALSE;
     xSemaphoreGive(rbGET_TX_SEM_HANDLE(pxNewRingbuffer));
     vPortCPUInitializeMutex(&pxNewRingbuffer->mux);
 }
@@ -731,6 +768,113 @@ static size_t prvGetCurMaxSizeByteBuf(Ringbuffer_t *pxRingbuffer)
     return xFreeSize;
 }
 
+static size_t prvSpscGetAvail(Ringbuffer_t *pxRingbuffer, BaseType_t xIsWriter)
+{
+    //The index of the other side is loaded with acquire ordering, so that its data/free space is visible
+    size_t xWrite, xRead;
+    if (xIsWriter) {
+        xWrite = pxRingbuffer->xSpscWrite;
+        xRead = __atomic_load_n(&pxRingbuffer->xSpscRead, __ATOMIC_ACQUIRE);
+    } else {
+        xWrite = __atomic_load_n(&pxRingbuffer->xSpscWrite, __ATOMIC_ACQUIRE);
+        xRead = pxRingbuffer->xSpscRead;
+    }
+    size_t xUsed = (xWrite >= xRead) ? xWrite - xRead : xWrite + 2 * pxRingbuffer->xSize - xRead;
+    configASSERT(xUsed <= pxRingbuffer->xSize);
+    return xIsWriter ? pxRingbuffer->xSize - xUsed : xUsed;
+}
+
+static uint8_t *prvSpscGetContiguous(Ringbuffer_t *pxRingbuffer, BaseType_t xIsWriter, size_t *pxSize)
+{
+    size_t xAvail = prvSpscGetAvail(pxRingbuffer, xIsWriter);
+    size_t xIndex = xIsWriter ? pxRingbuffer->xSpscWrite : pxRingbuffer->xSpscRead;
+    if (xIndex >= pxRingbuffer->xSize) {
+        xIndex -= pxRingbuffer->xSize;
+    }
+    //Space/data wraps around at the end of the storage area
+    size_t xRemLen = pxRingbuffer->xSize - xIndex;
+    *pxSize = (xAvail < xRemLen) ? xAvail : xRemLen;
+    return pxRingbuffer->pucHead + xIndex;
+}
+
+static BaseType_t prvSpscAdvance(Ringbuffer_t *pxRingbuffer, BaseType_t xIsWriter, size_t xSize)
+{
+    configASSERT(xSize <= prvSpscGetAvail(pxRingbuffer, xIsWriter));
+    size_t *pxIndex = xIsWriter ? &pxRingbuffer->xSpscWrite : &pxRingbuffer->xSpscRead;
+    size_t xIndex = *pxIndex + xSize;
+    if (xIndex >= 2 * pxRingbuffer->xSize) {
+        xIndex -= 2 * pxRingbuffer->xSize;
+    }
+    //Release ordering publishes the written data (or the consumed space) before the new index
+    __atomic_store_n(pxIndex, xIndex, __ATOMIC_RELEASE);
+    /*
+     * Full barrier between storing the index and loading the waiting flag of the
+     * other side. Pairs with the barrier in prvSpscWait(): either the other side
+     * sees the new index, or this side sees its waiting flag.
+     */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    BaseType_t *pxWaiting = xIsWriter ? &pxRingbuffer->xSpscRxWaiting : &pxRingbuffer->xSpscTxWaiting;
+    return __atomic_load_n(pxWaiting, __ATOMIC_RELAXED);
+}
+
+static BaseType_t prvSpscWait(Ringbuffer_t *pxRingbuffer, BaseType_t xIsWriter, size_t xRequired, TickType_t xTicksToWait)
+{
+    //Fast path, also used from ISRs where xTicksToWait is 0
+    if (prvSpscGetAvail(pxRingbuffer, xIsWriter) >= xRequired) {
+        return pdTRUE;
+    }
+    if (xTicksToWait == 0) {
+        return pdFALSE;
+    }
+
+    SemaphoreHandle_t xSemaphore = xIsWriter ? rbGET_TX_SEM_HANDLE(pxRingbuffer) : rbGET_RX_SEM_HANDLE(pxRingbuffer);
+    BaseType_t *pxWaiting = xIsWriter ? &pxRingbuffer->xSpscTxWaiting : &pxRingbuffer->xSpscRxWaiting;
+    BaseType_t xReturn = pdFALSE;
+    TickType_t xTicksEnd = xTaskGetTickCount() + xTicksToWait;
+    TickType_t xTicksRemaining = xTicksToWait;
+    while (xTicksRemaining <= xTicksToWait) {   //xTicksToWait will underflow once xTaskGetTickCount() > ticks_end
+        //Announce that this side is waiting, then check again in case the other side advanced in between
+        __atomic_store_n(pxWaiting, pdTRUE, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (prvSpscGetAvail(pxRingbuffer, xIsWriter) >= xRequired) {
+            xReturn = pdTRUE;
+            break;
+        }
+        /*
+         * The semaphore may have been given while this side was not actually
+         * blocked. The only cost of this is one extra iteration of the loop.
+         */
+        BaseType_t xTaken = xSemaphoreTake(xSemaphore, xTicksRemaining);
+        __atomic_store_n(pxWaiting, pdFALSE, __ATOMIC_RELAXED);
+        if (prvSpscGetAvail(pxRingbuffer, xIsWriter) >= xRequired) {
+            xReturn = pdTRUE;
+            break;
+        }
+        if (xTaken != pdTRUE) {
+            break;      //Timed out
+        }
+        if (xTicksToWait != portMAX_DELAY) {
+            xTicksRemaining = xTicksEnd - xTaskGetTickCount();
+        }
+    }
+    __atomic_store_n(pxWaiting, pdFALSE, __ATOMIC_RELAXED);
+    return xReturn;
+}
+
+static BaseType_t prvSpscCopyItem(Ringbuffer_t *pxRingbuffer, const uint8_t *pucItem, size_t xItemSize)
+{
+    size_t xContiguous;
+    uint8_t *pucWrite = prvSpscGetContiguous(pxRingbuffer, pdTRUE, &xContiguous);
+    if (xContiguous >= xItemSize) {
+        memcpy(pucWrite, pucItem, xItemSize);
+    } else {
+        //Item wraps around, copy the rest to the start of the storage area
+        memcpy(pucWrite, pucItem, xContiguous);
+        memcpy(pxRingbuffer->pucHead, pucItem + xContiguous, xItemSize - xContiguous);
+    }
+    return prvSpscAdvance(pxRingbuffer, pdTRUE, xItemSize);
+}
+
 static BaseType_t prvReceiveGeneric(Ringbuffer_t *pxRingbuffer,
                                     void **pvItem1,
                                     void **pvItem2,
@@ -739,6 +883,19 @@ static BaseType_t prvReceiveGeneric(Ringbuffer_t *pxRingbuffer,
                                     size_t xMaxSize,
                                     TickType_t xTicksToWait)
 {
+    if (pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG) {
+        //SPSC byte buffers return the contiguous data without taking the spinlock
+        if (prvSpscWait(pxRingbuffer, pdFALSE, 1, xTicksToWait) != pdTRUE) {
+            return pdFALSE;
+        }
+        *pvItem1 = prvSpscGetContiguous(pxRingbuffer, pdFALSE, xItemSize1);
+        if (xMaxSize != 0 && *xItemSize1 > xMaxSize) {
+            *xItemSize1 = xMaxSize;
+        }
+        pxRingbuffer->xSpscReadLen = *xItemSize1;
+        return pdTRUE;
+    }
+
     BaseType_t xReturn = pdFALSE;
     BaseType_t xReturnSemaphore = pdFALSE;
     TickType_t xTicksEnd = xTaskGetTickCount() + xTicksToWait;
@@ -803,6 +960,11 @@ static BaseType_t prvReceiveGenericFromISR(Ringbuffer_t *pxRingbuffer,
                                            size_t *xItemSize2,
                                            size_t xMaxSize)
 {
+    if (pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG) {
+        //Ticks to wait is 0, so this does not block
+        return prvReceiveGeneric(pxRingbuffer, pvItem1, pvItem2, xItemSize1, xItemSize2, xMaxSize, 0);
+    }
+
     BaseType_t xReturn = pdFALSE;
     BaseType_t xReturnSemaphore = pdFALSE;
 
@@ -847,7 +1009,7 @@ RingbufHandle_t xRingbufferCreate(size_t xBufferSize, RingbufferType_t xBufferTy
     configASSERT(xBufferType < RINGBUF_TYPE_MAX);
 
     //Allocate memory
-    if (xBufferType != RINGBUF_TYPE_BYTEBUF) {
+    if (xBufferType != RINGBUF_TYPE_BYTEBUF && xBufferType != RINGBUF_TYPE_BYTEBUF_SPSC) {
         xBufferSize = rbALIGN_SIZE(xBufferSize);    //xBufferSize is rounded up for no-split/allow-split buffers
     }
     Ringbuffer_t *pxNewRingbuffer = calloc(1, sizeof(Ringbuffer_t));
@@ -900,7 +1062,7 @@ RingbufHandle_t xRingbufferCreateStatic(size_t xBufferSize,
     configASSERT(xBufferSize > 0);
     configASSERT(xBufferType < RINGBUF_TYPE_MAX);
     configASSERT(pucRingbufferStorage != NULL && pxStaticRingbuffer != NULL);
-    if (xBufferType != RINGBUF_TYPE_BYTEBUF) {
+    if (xBufferType != RINGBUF_TYPE_BYTEBUF && xBufferType != RINGBUF_TYPE_BYTEBUF_SPSC) {
         //No-split/allow-split buffer sizes must be 32-bit aligned
         configASSERT(rbCHECK_ALIGNED(xBufferSize));
     }
@@ -1004,6 +1166,15 @@ BaseType_t xRingbufferSend(RingbufHandle_t xRingbuffer,
     if ((pxRingbuffer->uxRingbufferFlags & rbBYTE_BUFFER_FLAG) && xItemSize == 0) {
         return pdTRUE;      //Sending 0 bytes to byte buffer has no effect
     }
+    if (pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG) {
+        if (prvSpscWait(pxRingbuffer, pdTRUE, xItemSize, xTicksToWait) != pdTRUE) {
+            return pdFALSE;
+        }
+        if (prvSpscCopyItem(pxRingbuffer, pvItem, xItemSize) == pdTRUE) {
+            xSemaphoreGive(rbGET_RX_SEM_HANDLE(pxRingbuffer));  //Wake up the blocked receiver
+        }
+        return pdTRUE;
+    }
 
     //Attempt to send an item
     BaseType_t xReturn = pdFALSE;
@@ -1065,6 +1236,15 @@ BaseType_t xRingbufferSendFromISR(RingbufHandle_t xRingbuffer,
     if ((pxRingbuffer->uxRingbufferFlags & rbBYTE_BUFFER_FLAG) && xItemSize == 0) {
         return pdTRUE;      //Sending 0 bytes to byte buffer has no effect
     }
+    if (pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG) {
+        if (prvSpscWait(pxRingbuffer, pdTRUE, xItemSize, 0) != pdTRUE) {
+            return pdFALSE;
+        }
+        if (prvSpscCopyItem(pxRingbuffer, pvItem, xItemSize) == pdTRUE) {
+            xSemaphoreGiveFromISR(rbGET_RX_SEM_HANDLE(pxRingbuffer), pxHigherPriorityTaskWoken);
+        }
+        return pdTRUE;
+    }
 
     //Attempt to send an item
     BaseType_t xReturn;
@@ -1263,6 +1443,11 @@ void vRingbufferReturnItem(RingbufHandle_t xRingbuffer, void *pvItem)
     configASSERT(pxRingbuffer);
     configASSERT(pvItem != NULL);
 
+    if (pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG) {
+        vRingbufferReadRelease(xRingbuffer, pxRingbuffer->xSpscReadLen);
+        return;
+    }
+
     portENTER_CRITICAL(&pxRingbuffer->mux);
     pxRingbuffer->vReturnItem(pxRingbuffer, (uint8_t *)pvItem);
     portEXIT_CRITICAL(&pxRingbuffer->mux);
@@ -1275,12 +1460,93 @@ void vRingbufferReturnItemFromISR(RingbufHandle_t xRingbuffer, void *pvItem, Bas
     configASSERT(pxRingbuffer);
     configASSERT(pvItem != NULL);
 
+    if (pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG) {
+        vRingbufferReadReleaseFromISR(xRingbuffer, pxRingbuffer->xSpscReadLen, pxHigherPriorityTaskWoken);
+        return;
+    }
+
     portENTER_CRITICAL_ISR(&pxRingbuffer->mux);
     pxRingbuffer->vReturnItem(pxRingbuffer, (uint8_t *)pvItem);
     portEXIT_CRITICAL_ISR(&pxRingbuffer->mux);
     xSemaphoreGiveFromISR(rbGET_TX_SEM_HANDLE(pxRingbuffer), pxHigherPriorityTaskWoken);
 }
 
+BaseType_t xRingbufferWriteAcquire(RingbufHandle_t xRingbuffer, void **ppvData, size_t *pxSize, TickType_t xTicksToWait)
+{
+    //Check arguments
+    Ringbuffer_t *pxRingbuffer = (Ringbuffer_t *)xRingbuffer;
+    configASSERT(pxRingbuffer);
+    configASSERT(pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG);    //This function should only be called for SPSC byte buffers
+    configASSERT(ppvData != NULL && pxSize != NULL);
+
+    if (prvSpscWait(pxRingbuffer, pdTRUE, 1, xTicksToWait) != pdTRUE) {
+        *ppvData = NULL;
+        return pdFALSE;
+    }
+    *ppvData = prvSpscGetContiguous(pxRingbuffer, pdTRUE, pxSize);
+    return pdTRUE;
+}
+
+void vRingbufferWriteCommit(RingbufHandle_t xRingbuffer, size_t xSize)
+{
+    Ringbuffer_t *pxRingbuffer = (Ringbuffer_t *)xRingbuffer;
+    configASSERT(pxRingbuffer);
+    configASSERT(pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG);
+
+    if (prvSpscAdvance(pxRingbuffer, pdTRUE, xSize) == pdTRUE) {
+        xSemaphoreGive(rbGET_RX_SEM_HANDLE(pxRingbuffer));  //Wake up the blocked receiver
+    }
+}
+
+void vRingbufferWriteCommitFromISR(RingbufHandle_t xRingbuffer, size_t xSize, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    Ringbuffer_t *pxRingbuffer = (Ringbuffer_t *)xRingbuffer;
+    configASSERT(pxRingbuffer);
+    configASSERT(pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG);
+
+    if (prvSpscAdvance(pxRingbuffer, pdTRUE, xSize) == pdTRUE) {
+        xSemaphoreGiveFromISR(rbGET_RX_SEM_HANDLE(pxRingbuffer), pxHigherPriorityTaskWoken);
+    }
+}
+
+BaseType_t xRingbufferReadAcquire(RingbufHandle_t xRingbuffer, void **ppvData, size_t *pxSize, TickType_t xTicksToWait)
+{
+    //Check arguments
+    Ringbuffer_t *pxRingbuffer = (Ringbuffer_t *)xRingbuffer;
+    configASSERT(pxRingbuffer);
+    configASSERT(pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG);    //This function should only be called for SPSC byte buffers
+    configASSERT(ppvData != NULL && pxSize != NULL);
+
+    if (prvSpscWait(pxRingbuffer, pdFALSE, 1, xTicksToWait) != pdTRUE) {
+        *ppvData = NULL;
+        return pdFALSE;
+    }
+    *ppvData = prvSpscGetContiguous(pxRingbuffer, pdFALSE, pxSize);
+    return pdTRUE;
+}
+
+void vRingbufferReadRelease(RingbufHandle_t xRingbuffer, size_t xSize)
+{
+    Ringbuffer_t *pxRingbuffer = (Ringbuffer_t *)xRingbuffer;
+    configASSERT(pxRingbuffer);
+    configASSERT(pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG);
+
+    if (prvSpscAdvance(pxRingbuffer, pdFALSE, xSize) == pdTRUE) {
+        xSemaphoreGive(rbGET_TX_SEM_HANDLE(pxRingbuffer));  //Wake up the blocked sender
+    }
+}
+
+void vRingbufferReadReleaseFromISR(RingbufHandle_t xRingbuffer, size_t xSize, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    Ringbuffer_t *pxRingbuffer = (Ringbuffer_t *)xRingbuffer;
+    configASSERT(pxRingbuffer);
+    configASSERT(pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG);
+
+    if (prvSpscAdvance(pxRingbuffer, pdFALSE, xSize) == pdTRUE) {
+        xSemaphoreGiveFromISR(rbGET_TX_SEM_HANDLE(pxRingbuffer), pxHigherPriorityTaskWoken);
+    }
+}
+
 void vRingbufferDelete(RingbufHandle_t xRingbuffer)
 {
     Ringbuffer_t *pxRingbuffer = (Ringbuffer_t *)xRingbuffer;
@@ -1311,6 +1577,10 @@ size_t xRingbufferGetCurFreeSize(RingbufHandle_t xRingbuffer)
     Ringbuffer_t *pxRingbuffer = (Ringbuffer_t *)xRingbuffer;
     configASSERT(pxRingbuffer);
 
+    if (pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG) {
+        return prvSpscGetAvail(pxRingbuffer, pdTRUE);
+    }
+
     size_t xFreeSize;
     portENTER_CRITICAL(&pxRingbuffer->mux);
     xFreeSize = pxRingbuffer->xGetCurMaxSize(pxRingbuffer);
@@ -1322,6 +1592,8 @@ BaseType_t xRingbufferAddToQueueSetRead(RingbufHandle_t xRingbuffer, QueueSetHan
 {
     Ringbuffer_t *pxRingbuffer = (Ringbuffer_t *)xRingbuffer;
     configASSERT(pxRingbuffer);
+    //The read semaphore of SPSC byte buffers is only given when the receiver is blocked
+    configASSERT((pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG) == 0);
 
     BaseType_t xReturn;
     portENTER_CRITICAL(&pxRingbuffer->mux);
@@ -1372,6 +1644,31 @@ void vRingbufferGetInfo(RingbufHandle_t xRingbuffer,
     Ringbuffer_t *pxRingbuffer = (Ringbuffer_t *)xRingbuffer;
     configASSERT(pxRingbuffer);
 
+    if (pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG) {
+        //Read and free positions are the same, as are write and acquire positions
+        size_t xRead = __atomic_load_n(&pxRingbuffer->xSpscRead, __ATOMIC_ACQUIRE);
+        size_t xWrite = __atomic_load_n(&pxRingbuffer->xSpscWrite, __ATOMIC_ACQUIRE);
+        size_t xUsed = (xWrite >= xRead) ? xWrite - xRead : xWrite + 2 * pxRingbuffer->xSize - xRead;
+        xRead = (xRead >= pxRingbuffer->xSize) ? xRead - pxRingbuffer->xSize : xRead;
+        xWrite = (xWrite >= pxRingbuffer->xSize) ? xWrite - pxRingbuffer->xSize : xWrite;
+        if (uxFree != NULL) {
+            *uxFree = (UBaseType_t)xRead;
+        }
+        if (uxRead != NULL) {
+            *uxRead = (UBaseType_t)xRead;
+        }
+        if (uxWrite != NULL) {
+            *uxWrite = (UBaseType_t)xWrite;
+        }
+        if (uxAcquire != NULL) {
+            *uxAcquire = (UBaseType_t)xWrite;
+        }
+        if (uxItemsWaiting != NULL) {
+            *uxItemsWaiting = (UBaseType_t)xUsed;
+        }
+        return;
+    }
+
     portENTER_CRITICAL(&pxRingbuffer->mux);
     if (uxFree != NULL) {
         *uxFree = (UBaseType_t)(pxRingbuffer->pucFree - pxRingbuffer->pucHead);
@@ -1395,6 +1692,13 @@ void xRingbufferPrintInfo(RingbufHandle_t xRingbuffer)
 {
     Ringbuffer_t *pxRingbuffer = (Ringbuffer_t *)xRingbuffer;
     configASSERT(pxRingbuffer);
+    if (pxRingbuffer->uxRingbufferFlags & rbSPSC_FLAG) {
+        UBaseType_t uxRead, uxWrite, uxItemsWaiting;
+        vRingbufferGetInfo(xRingbuffer, NULL, &uxRead, &uxWrite, NULL, &uxItemsWaiting);
+        printf("Rb size:%d\tfree: %d\trptr: %d\twptr: %d (SPSC)\n",
+               pxRingbuffer->xSize, pxRingbuffer->xSize - uxItemsWaiting, uxRead, uxWrite);
+        return;
+    }
     printf("Rb size:%d\tfree: %d\trptr: %d\tfreeptr: %d\twptr: %d, aptr: %d\n",
            pxRingbuffer->xSize, prvGetFreeSize(pxRingbuffer),
            pxRingbuffer->pucRead - pxRingbuffer->pucHead,
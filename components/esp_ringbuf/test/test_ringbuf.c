@@ -516,7 +516,7 @@ static void read_from_buffer(RingbufHandle_t buffer, RingbufferType_t buf_type,
 
             //Check received item and return it
             TEST_ASSERT_MESSAGE(item_data != NULL, "Failed to receive an item");
-            if (buf_type == RINGBUF_TYPE_BYTEBUF) {
+            if (buf_type == RINGBUF_TYPE_BYTEBUF || buf_type == RINGBUF_TYPE_BYTEBUF_SPSC) {
                 TEST_ASSERT_MESSAGE(item_size <= max_rec_size, "Received data exceeds max size");
             }
             for (int i = 0; i < item_size; i++) {
@@ -590,7 +590,7 @@ static void cleanup(void)
 TEST_CASE("Test ring buffer SMP", "[esp_ringbuf]")
 {
     setup();
-    //Iterate through buffer types (No split, split, then byte buff)
+    //Iterate through buffer types (No split, split, byte buff, then SPSC byte buff)
     for (RingbufferType_t buf_type = 0; buf_type < RINGBUF_TYPE_MAX; buf_type++) {
         //Create buffer
         task_args_t task_args;
@@ -622,7 +622,7 @@ TEST_CASE("Test ring buffer SMP", "[esp_ringbuf]")
 TEST_CASE("Test static ring buffer SMP", "[esp_ringbuf]")
 {
     setup();
-    //Iterate through buffer types (No split, split, then byte buff)
+    //Iterate through buffer types (No split, split, byte buff, then SPSC byte buff)
     for (RingbufferType_t buf_type = 0; buf_type < RINGBUF_TYPE_MAX; buf_type++) {
         StaticRingbuffer_t *buffer_struct;
         uint8_t *buffer_storage;
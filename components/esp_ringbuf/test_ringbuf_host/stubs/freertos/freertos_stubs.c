@@ -0,0 +1,108 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+void vPortCPUInitializeMutex(portMUX_TYPE *mux)
+{
+    pthread_mutex_init(mux, NULL);
+}
+
+static uint64_t get_time_ms(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t) (get_time_ms(CLOCK_MONOTONIC) / portTICK_PERIOD_MS);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *pxSemaphoreBuffer)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&pxSemaphoreBuffer->mutex, NULL);
+    pthread_cond_init(&pxSemaphoreBuffer->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pxSemaphoreBuffer->count = 0;
+    return pxSemaphoreBuffer;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore)
+{
+    pthread_cond_destroy(&xSemaphore->cond);
+    pthread_mutex_destroy(&xSemaphore->mutex);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xTicksToWait)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    uint64_t ns = (uint64_t) deadline.tv_nsec + (uint64_t) xTicksToWait * portTICK_PERIOD_MS * 1000000;
+    deadline.tv_sec += ns / 1000000000;
+    deadline.tv_nsec = ns % 1000000000;
+
+    pthread_mutex_lock(&xSemaphore->mutex);
+    int err = 0;
+    while (xSemaphore->count == 0 && err != ETIMEDOUT) {
+        if (xTicksToWait == portMAX_DELAY) {
+            pthread_cond_wait(&xSemaphore->cond, &xSemaphore->mutex);
+        } else {
+            err = pthread_cond_timedwait(&xSemaphore->cond, &xSemaphore->mutex, &deadline);
+        }
+    }
+    BaseType_t ret = pdFALSE;
+    if (xSemaphore->count != 0) {
+        xSemaphore->count = 0;
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&xSemaphore->mutex);
+    return ret;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore)
+{
+    pthread_mutex_lock(&xSemaphore->mutex);
+    BaseType_t ret = (xSemaphore->count == 0) ? pdTRUE : pdFALSE;
+    xSemaphore->count = 1;
+    pthread_cond_signal(&xSemaphore->cond);
+    pthread_mutex_unlock(&xSemaphore->mutex);
+    return ret;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t xSemaphore, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken != NULL) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return xSemaphoreGive(xSemaphore);
+}
+
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t xQueueOrSemaphore, QueueSetHandle_t xQueueSet)
+{
+    return pdFAIL;
+}
+
+BaseType_t xQueueRemoveFromSet(QueueSetMemberHandle_t xQueueOrSemaphore, QueueSetHandle_t xQueueSet)
+{
+    return pdFAIL;
+}
@@ -0,0 +1,65 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/* Minimal FreeRTOS port on top of pthreads, enough to run esp_ringbuf on the host */
+#pragma once
+
+#define INC_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <assert.h>
+#include <pthread.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE                             ( ( BaseType_t ) 0 )
+#define pdTRUE                              ( ( BaseType_t ) 1 )
+#define pdPASS                              ( pdTRUE )
+#define pdFAIL                              ( pdFALSE )
+
+#define configSUPPORT_STATIC_ALLOCATION     1
+#define configTICK_RATE_HZ                  1000
+#define configASSERT(x)                     assert(x)
+
+#define portMAX_DELAY                       ( ( TickType_t ) 0xffffffffUL )
+#define portBYTE_ALIGNMENT_MASK             ( 0x0003 )
+#define portTICK_PERIOD_MS                  ( ( TickType_t ) 1000 / configTICK_RATE_HZ )
+
+/* Critical sections are emulated with a mutex per spinlock */
+typedef pthread_mutex_t portMUX_TYPE;
+
+void vPortCPUInitializeMutex(portMUX_TYPE *mux);
+
+#define portENTER_CRITICAL(mux)             pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)              pthread_mutex_unlock(mux)
+#define portENTER_CRITICAL_ISR(mux)         pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL_ISR(mux)          pthread_mutex_unlock(mux)
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int count;
+} StaticSemaphore_t;
+
+#if defined(__cplusplus)
+}
+#endif
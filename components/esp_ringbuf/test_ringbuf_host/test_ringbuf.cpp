@@ -0,0 +1,239 @@
+#include "catch.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+static const size_t BUFFER_SIZE = 256;
+
+/* Fill buf with the byte sequence starting at offset */
+static void fill_sequence(uint8_t *buf, size_t len, size_t offset)
+{
+    for (size_t i = 0; i < len; ++i) {
+        buf[i] = (uint8_t)((offset + i) * 7);
+    }
+}
+
+static bool check_sequence(const uint8_t *buf, size_t len, size_t offset)
+{
+    for (size_t i = 0; i < len; ++i) {
+        if (buf[i] != (uint8_t)((offset + i) * 7)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE("SPSC byte buffer send and receive", "[ringbuf][spsc]")
+{
+    RingbufHandle_t rb = xRingbufferCreate(BUFFER_SIZE, RINGBUF_TYPE_BYTEBUF_SPSC);
+    REQUIRE(rb != NULL);
+    CHECK(xRingbufferGetMaxItemSize(rb) == BUFFER_SIZE);
+    CHECK(xRingbufferGetCurFreeSize(rb) == BUFFER_SIZE);
+
+    uint8_t data[BUFFER_SIZE + 1];
+    fill_sequence(data, sizeof(data), 0);
+    CHECK(xRingbufferSend(rb, data, sizeof(data), 0) == pdFALSE);
+    CHECK(xRingbufferSend(rb, data, 0, 0) == pdTRUE);
+
+    size_t size;
+    CHECK(xRingbufferReceive(rb, &size, 0) == NULL);
+
+    // fill the buffer completely, then read it in two parts
+    REQUIRE(xRingbufferSend(rb, data, BUFFER_SIZE, 0) == pdTRUE);
+    CHECK(xRingbufferGetCurFreeSize(rb) == 0);
+    CHECK(xRingbufferSend(rb, data, 1, 0) == pdFALSE);
+
+    uint8_t *item = (uint8_t *)xRingbufferReceiveUpTo(rb, &size, 0, 100);
+    REQUIRE(item != NULL);
+    CHECK(size == 100);
+    CHECK(check_sequence(item, size, 0));
+    vRingbufferReturnItem(rb, item);
+    CHECK(xRingbufferGetCurFreeSize(rb) == 100);
+
+    item = (uint8_t *)xRingbufferReceive(rb, &size, 0);
+    REQUIRE(item != NULL);
+    CHECK(size == BUFFER_SIZE - 100);
+    CHECK(check_sequence(item, size, 100));
+    vRingbufferReturnItem(rb, item);
+    CHECK(xRingbufferGetCurFreeSize(rb) == BUFFER_SIZE);
+
+    // an item sent across the end of the storage area is received in two parts
+    REQUIRE(xRingbufferSend(rb, data, 200, 0) == pdTRUE);
+    item = (uint8_t *)xRingbufferReceive(rb, &size, 0);
+    REQUIRE(size == 200);
+    vRingbufferReturnItem(rb, item);
+
+    REQUIRE(xRingbufferSend(rb, data, 100, 0) == pdTRUE);
+    UBaseType_t read_pos, write_pos, waiting;
+    vRingbufferGetInfo(rb, NULL, &read_pos, &write_pos, NULL, &waiting);
+    CHECK(read_pos == 200);
+    CHECK(write_pos == 300 - BUFFER_SIZE);
+    CHECK(waiting == 100);
+
+    item = (uint8_t *)xRingbufferReceiveFromISR(rb, &size);
+    REQUIRE(item != NULL);
+    CHECK(size == BUFFER_SIZE - 200);
+    CHECK(check_sequence(item, size, 0));
+    BaseType_t woken = pdFALSE;
+    vRingbufferReturnItemFromISR(rb, item, &woken);
+
+    item = (uint8_t *)xRingbufferReceive(rb, &size, 0);
+    REQUIRE(item != NULL);
+    CHECK(size == 100 - (BUFFER_SIZE - 200));
+    CHECK(check_sequence(item, size, BUFFER_SIZE - 200));
+    vRingbufferReturnItem(rb, item);
+    CHECK(xRingbufferReceive(rb, &size, 0) == NULL);
+
+    vRingbufferDelete(rb);
+}
+
+TEST_CASE("SPSC byte buffer zero-copy acquire and commit", "[ringbuf][spsc]")
+{
+    uint8_t *storage = new uint8_t[BUFFER_SIZE];
+    StaticRingbuffer_t rb_struct;
+    RingbufHandle_t rb = xRingbufferCreateStatic(BUFFER_SIZE, RINGBUF_TYPE_BYTEBUF_SPSC, storage, &rb_struct);
+    REQUIRE(rb != NULL);
+
+    void *ptr;
+    size_t size;
+    CHECK(xRingbufferReadAcquire(rb, &ptr, &size, 0) == pdFALSE);
+    CHECK(ptr == NULL);
+
+    // the whole buffer can be written in place
+    REQUIRE(xRingbufferWriteAcquire(rb, &ptr, &size, 0) == pdTRUE);
+    CHECK(ptr == storage);
+    CHECK(size == BUFFER_SIZE);
+    fill_sequence((uint8_t *)ptr, 150, 0);
+    vRingbufferWriteCommit(rb, 150);
+
+    // only the contiguous space up to the end of the storage area is returned
+    REQUIRE(xRingbufferWriteAcquire(rb, &ptr, &size, 0) == pdTRUE);
+    CHECK(ptr == storage + 150);
+    CHECK(size == BUFFER_SIZE - 150);
+
+    REQUIRE(xRingbufferReadAcquire(rb, &ptr, &size, 0) == pdTRUE);
+    CHECK(ptr == storage);
+    CHECK(size == 150);
+    CHECK(check_sequence((uint8_t *)ptr, 150, 0));
+    vRingbufferReadRelease(rb, 50);
+
+    REQUIRE(xRingbufferReadAcquire(rb, &ptr, &size, 0) == pdTRUE);
+    CHECK(ptr == storage + 50);
+    CHECK(size == 100);
+    vRingbufferReadRelease(rb, 100);
+
+    REQUIRE(xRingbufferWriteAcquire(rb, &ptr, &size, 0) == pdTRUE);
+    CHECK(ptr == storage + 150);
+    CHECK(size == BUFFER_SIZE - 150);
+    BaseType_t woken = pdFALSE;
+    vRingbufferWriteCommitFromISR(rb, size, &woken);
+
+    // free space wraps around to the start of the storage area
+    REQUIRE(xRingbufferWriteAcquire(rb, &ptr, &size, 0) == pdTRUE);
+    CHECK(ptr == storage);
+    CHECK(size == 150);
+    vRingbufferWriteCommit(rb, size);
+    CHECK(xRingbufferWriteAcquire(rb, &ptr, &size, 0) == pdFALSE);
+
+    REQUIRE(xRingbufferReadAcquire(rb, &ptr, &size, 0) == pdTRUE);
+    CHECK(ptr == storage + 150);
+    CHECK(size == BUFFER_SIZE - 150);
+    vRingbufferReadReleaseFromISR(rb, size, &woken);
+    REQUIRE(xRingbufferReadAcquire(rb, &ptr, &size, 0) == pdTRUE);
+    CHECK(ptr == storage);
+    CHECK(size == 150);
+    vRingbufferReadRelease(rb, size);
+
+    vRingbufferDelete(rb);
+    delete[] storage;
+}
+
+TEST_CASE("SPSC byte buffer acquire times out", "[ringbuf][spsc]")
+{
+    RingbufHandle_t rb = xRingbufferCreate(BUFFER_SIZE, RINGBUF_TYPE_BYTEBUF_SPSC);
+    REQUIRE(rb != NULL);
+
+    void *ptr;
+    size_t size;
+    TickType_t start = xTaskGetTickCount();
+    CHECK(xRingbufferReadAcquire(rb, &ptr, &size, 20) == pdFALSE);
+    CHECK(xTaskGetTickCount() - start >= 20);
+
+    REQUIRE(xRingbufferWriteAcquire(rb, &ptr, &size, 0) == pdTRUE);
+    vRingbufferWriteCommit(rb, size);
+    start = xTaskGetTickCount();
+    CHECK(xRingbufferWriteAcquire(rb, &ptr, &size, 20) == pdFALSE);
+    CHECK(xRingbufferSend(rb, &size, sizeof(size), 20) == pdFALSE);
+    CHECK(xTaskGetTickCount() - start >= 40);
+
+    vRingbufferDelete(rb);
+}
+
+/* Stream a byte sequence from one thread to another, in chunks of varying size */
+static void stream_sequence(RingbufferType_t type, bool zero_copy, size_t total)
+{
+    RingbufHandle_t rb = xRingbufferCreate(BUFFER_SIZE, type);
+    REQUIRE(rb != NULL);
+
+    std::thread producer([=]() {
+        std::vector<uint8_t> chunk(BUFFER_SIZE);
+        size_t offset = 0;
+        size_t i = 0;
+        while (offset < total) {
+            size_t len = std::min<size_t>(1 + (i++ * 37) % 100, total - offset);
+            if (zero_copy) {
+                void *ptr;
+                size_t size;
+                assert(xRingbufferWriteAcquire(rb, &ptr, &size, portMAX_DELAY) == pdTRUE);
+                len = std::min(len, size);
+                fill_sequence((uint8_t *)ptr, len, offset);
+                vRingbufferWriteCommit(rb, len);
+            } else {
+                fill_sequence(chunk.data(), len, offset);
+                assert(xRingbufferSend(rb, chunk.data(), len, portMAX_DELAY) == pdTRUE);
+            }
+            offset += len;
+        }
+    });
+
+    size_t offset = 0;
+    size_t i = 0;
+    bool ok = true;
+    while (offset < total) {
+        size_t size;
+        if (zero_copy) {
+            void *ptr;
+            REQUIRE(xRingbufferReadAcquire(rb, &ptr, &size, portMAX_DELAY) == pdTRUE);
+            size = std::min<size_t>(size, 1 + (i++ * 53) % 120);
+            ok = ok && check_sequence((uint8_t *)ptr, size, offset);
+            vRingbufferReadRelease(rb, size);
+        } else {
+            uint8_t *item = (uint8_t *)xRingbufferReceiveUpTo(rb, &size, portMAX_DELAY, 1 + (i++ * 53) % 120);
+            REQUIRE(item != NULL);
+            ok = ok && check_sequence(item, size, offset);
+            vRingbufferReturnItem(rb, item);
+        }
+        offset += size;
+    }
+    producer.join();
+    CHECK(ok);
+    CHECK(offset == total);
+    CHECK(xRingbufferGetCurFreeSize(rb) == BUFFER_SIZE);
+    vRingbufferDelete(rb);
+}
+
+TEST_CASE("byte buffer streams data between threads", "[ringbuf]")
+{
+    stream_sequence(RINGBUF_TYPE_BYTEBUF, false, 1000000);
+}
+
+TEST_CASE("SPSC byte buffer streams data between threads", "[ringbuf][spsc]")
+{
+    stream_sequence(RINGBUF_TYPE_BYTEBUF_SPSC, false, 1000000);
+    stream_sequence(RINGBUF_TYPE_BYTEBUF_SPSC, true, 1000000);
+}
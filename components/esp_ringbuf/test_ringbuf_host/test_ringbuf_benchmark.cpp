@@ -0,0 +1,107 @@
+#include "catch.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/ringbuf.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+/* Throughput and latency of the byte buffer types
+
+   These tests are hidden from the default test run, use "make benchmark".
+*/
+
+using std::chrono::steady_clock;
+
+static const size_t BUFFER_SIZE = 4096;
+static const size_t ITEM_SIZE = 64;
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static const char *type_name(RingbufferType_t type)
+{
+    return (type == RINGBUF_TYPE_BYTEBUF_SPSC) ? "RINGBUF_TYPE_BYTEBUF_SPSC" : "RINGBUF_TYPE_BYTEBUF     ";
+}
+
+/* Producer streams ITEM_SIZE byte items as fast as possible, consumer receives one item at a time */
+static void benchmark_throughput(RingbufferType_t type, size_t total)
+{
+    RingbufHandle_t rb = xRingbufferCreate(BUFFER_SIZE, type);
+    REQUIRE(rb != NULL);
+
+    auto start = steady_clock::now();
+    std::thread producer([=]() {
+        uint8_t item[ITEM_SIZE];
+        memset(item, 0xa5, sizeof(item));
+        for (size_t sent = 0; sent < total; sent += ITEM_SIZE) {
+            xRingbufferSend(rb, item, ITEM_SIZE, portMAX_DELAY);
+        }
+    });
+    size_t received = 0;
+    while (received < total) {
+        size_t size;
+        void *item = xRingbufferReceiveUpTo(rb, &size, portMAX_DELAY, ITEM_SIZE);
+        received += size;
+        vRingbufferReturnItem(rb, item);
+    }
+    producer.join();
+    double seconds = std::chrono::duration<double>(steady_clock::now() - start).count();
+    printf("%s: %zu byte items, %8.1f MB/s\n", type_name(type), ITEM_SIZE, total / seconds / 1e6);
+    vRingbufferDelete(rb);
+}
+
+/* Producer sends one item at a time and waits for it to be received, so every item wakes up the blocked consumer */
+static void benchmark_latency(RingbufferType_t type, size_t count)
+{
+    RingbufHandle_t rb = xRingbufferCreate(BUFFER_SIZE, type);
+    REQUIRE(rb != NULL);
+
+    std::atomic<size_t> received(0);
+    std::vector<int64_t> latencies;
+    latencies.reserve(count);
+    std::thread consumer([&]() {
+        for (size_t i = 0; i < count; ++i) {
+            size_t size;
+            int64_t *item = (int64_t *)xRingbufferReceiveUpTo(rb, &size, portMAX_DELAY, ITEM_SIZE);
+            latencies.push_back(now_ns() - *item);
+            vRingbufferReturnItem(rb, item);
+            received.store(i + 1);
+        }
+    });
+    uint8_t item[ITEM_SIZE] = { 0 };
+    for (size_t i = 0; i < count; ++i) {
+        // give the consumer time to block
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+        int64_t timestamp = now_ns();
+        memcpy(item, &timestamp, sizeof(timestamp));
+        xRingbufferSend(rb, item, ITEM_SIZE, portMAX_DELAY);
+        while (received.load() <= i) {
+        }
+    }
+    consumer.join();
+    std::sort(latencies.begin(), latencies.end());
+    printf("%s: send to receive latency p50 %6lld ns, p99 %6lld ns\n", type_name(type),
+           (long long)latencies[count / 2], (long long)latencies[count * 99 / 100]);
+    vRingbufferDelete(rb);
+}
+
+TEST_CASE("byte buffer throughput", "[ringbuf][benchmark][.]")
+{
+    for (RingbufferType_t type : { RINGBUF_TYPE_BYTEBUF, RINGBUF_TYPE_BYTEBUF_SPSC }) {
+        benchmark_throughput(type, 256 * 1024 * 1024);
+    }
+}
+
+TEST_CASE("byte buffer latency", "[ringbuf][benchmark][.]")
+{
+    for (RingbufferType_t type : { RINGBUF_TYPE_BYTEBUF, RINGBUF_TYPE_BYTEBUF_SPSC }) {
+        benchmark_latency(type, 20000);
+    }
+}
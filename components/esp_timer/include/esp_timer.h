@@ -29,11 +29,13 @@
  * use RTOS notification mechanisms (queues, semaphores, event groups, etc.) to
  * pass information to other tasks.
  *
- * To be implemented: it should be possible to request the callback to be called
- * directly from the ISR. This reduces the latency, but has potential impact on
- * all other callbacks which need to be dispatched. This option should only be
- * used for simple callback functions, which do not take longer than a few
- * microseconds to run.
+ * If CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD is enabled, a timer can be
+ * created with ESP_TIMER_ISR dispatch method, in which case the callback is
+ * called directly from the timer ISR. This reduces the latency, but has
+ * potential impact on all other callbacks which need to be dispatched, and on
+ * other interrupts. This option should only be used for simple callback
+ * functions placed in IRAM, which do not take longer than a few microseconds
+ * to run.
  *
  * Implementation note: on the ESP32, esp_timer APIs use the "legacy" FRC2
  * timer. Timer callbacks are called from a task running on the PRO CPU.
@@ -42,6 +44,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include "esp_err.h"
+#include "sdkconfig.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -64,13 +67,8 @@ typedef void (*esp_timer_cb_t)(void* arg);
  */
 typedef enum {
     ESP_TIMER_TASK,     //!< Callback is called from timer task
-
-    /* Not supported for now, provision to allow callbacks to run directly
-     * from an ISR:
-
-        ESP_TIMER_ISR,      //!< Callback is called from timer ISR
-
-     */
+    ESP_TIMER_ISR,      //!< Callback is called from timer ISR, requires CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+    ESP_TIMER_MAX,      //!< Count of the methods for dispatching timer callback
 } esp_timer_dispatch_t;
 
 /**
@@ -120,7 +118,10 @@ esp_err_t esp_timer_deinit(void);
  *
  * @return
  *      - ESP_OK on success
- *      - ESP_ERR_INVALID_ARG if some of the create_args are not valid
+ *      - ESP_ERR_INVALID_ARG if some of the create_args are not valid, or if
+ *        ESP_TIMER_ISR dispatch method is requested and the callback is not in IRAM
+ *      - ESP_ERR_NOT_SUPPORTED if ESP_TIMER_ISR dispatch method is requested and
+ *        CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD is disabled
  *      - ESP_ERR_INVALID_STATE if esp_timer library is not initialized yet
  *      - ESP_ERR_NO_MEM if memory allocation fails
  */
@@ -204,7 +205,7 @@ int64_t esp_timer_get_next_alarm(void);
  *
  * The format is:
  *
- *   name  period  alarm  times_armed  times_triggered  total_callback_run_time
+ *   name  period  alarm  times_armed  times_triggered  total_callback_run_time  max_callback_run_time
  *
  * where:
  *
@@ -218,6 +219,8 @@ int64_t esp_timer_get_next_alarm(void);
  * times_armed — number of times the timer was armed via esp_timer_start_X
  * times_triggered - number of times the callback was called
  * total_callback_run_time - total time taken by callback to execute, across all calls
+ * max_callback_run_time - longest time taken by a single call of the callback. For
+ *         ESP_TIMER_ISR timers this is the time the timer ISR was extended by.
  *
  * @param stream stream (such as stdout) to dump the information to
  * @return
@@ -226,6 +229,16 @@ int64_t esp_timer_get_next_alarm(void);
  */
 esp_err_t esp_timer_dump(FILE* stream);
 
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+/**
+ * @brief Requests a context switch from a timer callback function.
+ *
+ * This only works for a timer that has an ISR dispatch method.
+ * The context switch will be called after all ISR dispatch timers have been processed.
+ */
+void esp_timer_isr_dispatch_need_yield(void);
+#endif // CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+
 #ifdef __cplusplus
 }
 #endif
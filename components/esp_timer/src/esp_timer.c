@@ -13,13 +13,16 @@
 // limitations under the License.
 
 #include <sys/param.h>
+#include <stdlib.h>
 #include <string.h>
 #include "soc/soc.h"
+#include "soc/soc_memory_layout.h"
 #include "esp_types.h"
 #include "esp_attr.h"
 #include "esp_err.h"
 #include "esp_task.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
@@ -43,6 +46,16 @@
 
 #define TIMER_EVENT_QUEUE_SIZE      16
 
+// initial capacity of a heap of armed timers, it is doubled as necessary
+#define TIMER_HEAP_MIN_CAPACITY     16
+
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+// timer_process_alarm is also called from the timer ISR
+#define TIMER_PROCESS_ATTR      IRAM_ATTR
+#else
+#define TIMER_PROCESS_ATTR
+#endif
+
 struct esp_timer {
     uint64_t alarm;
     uint64_t period;
@@ -51,21 +64,42 @@ struct esp_timer {
         uint32_t event_id;
     };
     void* arg;
+    // position in the heap of armed timers
+    size_t heap_index;
+    // insertion order, keeps timers with the same alarm in FIFO order
+    uint32_t seq;
+    esp_timer_dispatch_t dispatch_method;
 #if WITH_PROFILING
     const char* name;
     size_t times_triggered;
     size_t times_armed;
     uint64_t total_callback_run_time;
-#endif // WITH_PROFILING
+    uint64_t max_callback_run_time;
     LIST_ENTRY(esp_timer) list_entry;
+#endif // WITH_PROFILING
 };
 
+// binary min-heap of armed timers, ordered by (alarm, seq)
+typedef struct {
+    esp_timer_handle_t* items;
+    size_t size;
+    size_t capacity;
+    // number of timers which can be in the heap at the same time
+    size_t reserved;
+} timer_heap_t;
+
 static bool is_initialized(void);
 static esp_err_t timer_insert(esp_timer_handle_t timer);
 static esp_err_t timer_remove(esp_timer_handle_t timer);
 static bool timer_armed(esp_timer_handle_t timer);
 static void timer_list_lock(void);
 static void timer_list_unlock(void);
+static esp_err_t timer_heap_reserve(timer_heap_t* heap);
+static void timer_heap_release(timer_heap_t* heap);
+static void timer_heap_push(timer_heap_t* heap, esp_timer_handle_t timer);
+static void timer_heap_remove(timer_heap_t* heap, esp_timer_handle_t timer);
+static void timer_heap_sift_down(timer_heap_t* heap, size_t index);
+static void timer_set_next_alarm(void);
 
 #if WITH_PROFILING
 static void timer_insert_inactive(esp_timer_handle_t timer);
@@ -74,14 +108,30 @@ static void timer_remove_inactive(esp_timer_handle_t timer);
 
 static const char* TAG = "esp_timer";
 
-// list of currently armed timers
-static LIST_HEAD(esp_timer_list, esp_timer) s_timers =
-        LIST_HEAD_INITIALIZER(s_timers);
+/* Currently armed timers, one heap per dispatch method. Arming and disarming
+ * a timer is O(log n), the next timer to expire is always items[0] of a heap.
+ * The capacity of a heap is kept at least equal to the number of timers which
+ * can be in it (reserved), so inserting never needs to allocate memory inside
+ * the critical section. Timers pending deletion are freed by the timer task,
+ * so they are always inserted into the ESP_TIMER_TASK heap, which therefore
+ * reserves a slot for every existing timer.
+ */
+static timer_heap_t s_timer_heaps[ESP_TIMER_MAX];
+static uint32_t s_timer_seq;
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+/* Set by the ISR when it notifies the timer task, cleared when the task starts
+ * processing. Meanwhile the alarm is only set for ESP_TIMER_ISR timers, the task
+ * sets it for its own timers when done.
+ */
+static bool s_task_dispatch_pending;
+// set by ESP_TIMER_ISR callbacks via esp_timer_isr_dispatch_need_yield
+static volatile bool s_isr_dispatch_need_yield;
+#endif
 #if WITH_PROFILING
 // list of unarmed timers, used only to be able to dump statistics about
 // all the timers
 static LIST_HEAD(esp_inactive_timer_list, esp_timer) s_inactive_timers =
-        LIST_HEAD_INITIALIZER(s_timers);
+        LIST_HEAD_INITIALIZER(s_inactive_timers);
 #endif
 // task used to dispatch timer callbacks
 static TaskHandle_t s_timer_task;
@@ -93,7 +143,7 @@ static SemaphoreHandle_t s_timer_semaphore;
 static StaticQueue_t s_timer_semaphore_memory;
 #endif
 
-// lock protecting s_timers, s_inactive_timers
+// lock protecting s_timer_heaps, s_inactive_timers and the variables above
 static portMUX_TYPE s_timer_lock = portMUX_INITIALIZER_UNLOCKED;
 
 
@@ -104,15 +154,38 @@ esp_err_t esp_timer_create(const esp_timer_create_args_t* args,
     if (!is_initialized()) {
         return ESP_ERR_INVALID_STATE;
     }
-    if (args == NULL || args->callback == NULL || out_handle == NULL) {
+    if (args == NULL || args->callback == NULL || out_handle == NULL ||
+            (unsigned) args->dispatch_method >= ESP_TIMER_MAX) {
         return ESP_ERR_INVALID_ARG;
     }
+    if (args->dispatch_method == ESP_TIMER_ISR) {
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+        // the timer ISR may run while the flash cache is disabled
+        if (!esp_ptr_in_iram(args->callback)) {
+            ESP_LOGE(TAG, "callback %p of ISR dispatch timer is not in IRAM", args->callback);
+            return ESP_ERR_INVALID_ARG;
+        }
+#else
+        return ESP_ERR_NOT_SUPPORTED;
+#endif
+    }
     esp_timer_handle_t result = (esp_timer_handle_t) calloc(1, sizeof(*result));
     if (result == NULL) {
         return ESP_ERR_NO_MEM;
     }
+    if (timer_heap_reserve(&s_timer_heaps[ESP_TIMER_TASK]) != ESP_OK) {
+        free(result);
+        return ESP_ERR_NO_MEM;
+    }
+    if (args->dispatch_method != ESP_TIMER_TASK &&
+            timer_heap_reserve(&s_timer_heaps[args->dispatch_method]) != ESP_OK) {
+        timer_heap_release(&s_timer_heaps[ESP_TIMER_TASK]);
+        free(result);
+        return ESP_ERR_NO_MEM;
+    }
     result->callback = args->callback;
     result->arg = args->arg;
+    result->dispatch_method = args->dispatch_method;
 #if WITH_PROFILING
     result->name = args->name;
     timer_insert_inactive(result);
@@ -188,29 +261,23 @@ esp_err_t esp_timer_delete(esp_timer_handle_t timer)
     return ESP_OK;
 }
 
+static inline IRAM_ATTR timer_heap_t* timer_heap_of(esp_timer_handle_t timer)
+{
+    if (timer->event_id == EVENT_ID_DELETE_TIMER) {
+        return &s_timer_heaps[ESP_TIMER_TASK];
+    }
+    return &s_timer_heaps[timer->dispatch_method];
+}
+
 static IRAM_ATTR esp_err_t timer_insert(esp_timer_handle_t timer)
 {
 #if WITH_PROFILING
     timer_remove_inactive(timer);
 #endif
-    esp_timer_handle_t it, last = NULL;
-    if (LIST_FIRST(&s_timers) == NULL) {
-        LIST_INSERT_HEAD(&s_timers, timer, list_entry);
-    } else {
-        LIST_FOREACH(it, &s_timers, list_entry) {
-            if (timer->alarm < it->alarm) {
-                LIST_INSERT_BEFORE(it, timer, list_entry);
-                break;
-            }
-            last = it;
-        }
-        if (it == NULL) {
-            assert(last);
-            LIST_INSERT_AFTER(last, timer, list_entry);
-        }
-    }
-    if (timer == LIST_FIRST(&s_timers)) {
-        esp_timer_impl_set_alarm(timer->alarm);
+    timer_heap_t* heap = timer_heap_of(timer);
+    timer_heap_push(heap, timer);
+    if (timer == heap->items[0]) {
+        timer_set_next_alarm();
     }
     return ESP_OK;
 }
@@ -218,7 +285,7 @@ static IRAM_ATTR esp_err_t timer_insert(esp_timer_handle_t timer)
 static IRAM_ATTR esp_err_t timer_remove(esp_timer_handle_t timer)
 {
     timer_list_lock();
-    LIST_REMOVE(timer, list_entry);
+    timer_heap_remove(timer_heap_of(timer), timer);
     timer->alarm = 0;
     timer->period = 0;
 #if WITH_PROFILING
@@ -257,11 +324,159 @@ static IRAM_ATTR void timer_remove_inactive(esp_timer_handle_t timer)
 
 #endif // WITH_PROFILING
 
+static esp_err_t timer_heap_reserve(timer_heap_t* heap)
+{
+    while (true) {
+        timer_list_lock();
+        if (heap->reserved < heap->capacity) {
+            ++heap->reserved;
+            timer_list_unlock();
+            return ESP_OK;
+        }
+        size_t new_capacity = MAX(heap->capacity * 2, TIMER_HEAP_MIN_CAPACITY);
+        timer_list_unlock();
+
+        /* The heap is accessed from IRAM functions, which may be called
+         * while the flash cache is disabled.
+         */
+        esp_timer_handle_t* new_items = heap_caps_malloc(new_capacity * sizeof(esp_timer_handle_t),
+                MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (new_items == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        esp_timer_handle_t* unused = new_items;
+        timer_list_lock();
+        // another task may have grown the heap meanwhile
+        if (new_capacity > heap->capacity) {
+            if (heap->items != NULL) {
+                memcpy(new_items, heap->items, heap->size * sizeof(esp_timer_handle_t));
+            }
+            unused = heap->items;
+            heap->items = new_items;
+            heap->capacity = new_capacity;
+        }
+        timer_list_unlock();
+        free(unused);
+    }
+}
+
+static void timer_heap_release(timer_heap_t* heap)
+{
+    timer_list_lock();
+    --heap->reserved;
+    timer_list_unlock();
+}
+
+static inline IRAM_ATTR bool timer_heap_less(esp_timer_handle_t a, esp_timer_handle_t b)
+{
+    if (a->alarm != b->alarm) {
+        return a->alarm < b->alarm;
+    }
+    return (int32_t) (a->seq - b->seq) < 0;
+}
+
+static inline IRAM_ATTR void timer_heap_set(timer_heap_t* heap, size_t index, esp_timer_handle_t timer)
+{
+    heap->items[index] = timer;
+    timer->heap_index = index;
+}
+
+static inline IRAM_ATTR esp_timer_handle_t timer_heap_top(timer_heap_t* heap)
+{
+    return (heap->size > 0) ? heap->items[0] : NULL;
+}
+
+static IRAM_ATTR void timer_heap_sift_up(timer_heap_t* heap, size_t index)
+{
+    esp_timer_handle_t timer = heap->items[index];
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (!timer_heap_less(timer, heap->items[parent])) {
+            break;
+        }
+        timer_heap_set(heap, index, heap->items[parent]);
+        index = parent;
+    }
+    timer_heap_set(heap, index, timer);
+}
+
+static IRAM_ATTR void timer_heap_sift_down(timer_heap_t* heap, size_t index)
+{
+    esp_timer_handle_t timer = heap->items[index];
+    while (true) {
+        size_t child = index * 2 + 1;
+        if (child >= heap->size) {
+            break;
+        }
+        if (child + 1 < heap->size && timer_heap_less(heap->items[child + 1], heap->items[child])) {
+            ++child;
+        }
+        if (!timer_heap_less(heap->items[child], timer)) {
+            break;
+        }
+        timer_heap_set(heap, index, heap->items[child]);
+        index = child;
+    }
+    timer_heap_set(heap, index, timer);
+}
+
+static IRAM_ATTR void timer_heap_push(timer_heap_t* heap, esp_timer_handle_t timer)
+{
+    assert(heap->size < heap->capacity);
+    timer->seq = s_timer_seq++;
+    timer_heap_set(heap, heap->size++, timer);
+    timer_heap_sift_up(heap, timer->heap_index);
+}
+
+static IRAM_ATTR void timer_heap_remove(timer_heap_t* heap, esp_timer_handle_t timer)
+{
+    size_t index = timer->heap_index;
+    assert(index < heap->size && heap->items[index] == timer);
+    esp_timer_handle_t last = heap->items[--heap->size];
+    if (last == timer) {
+        return;
+    }
+    // move the last timer into the hole, then restore the ordering in whichever direction it's broken
+    timer_heap_set(heap, index, last);
+    if (index > 0 && timer_heap_less(last, heap->items[(index - 1) / 2])) {
+        timer_heap_sift_up(heap, index);
+    } else {
+        timer_heap_sift_down(heap, index);
+    }
+}
+
+/* Set the alarm for the earliest timer, must be called with the lock held */
+static IRAM_ATTR void timer_set_next_alarm(void)
+{
+    esp_timer_handle_t next = NULL;
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+    if (!s_task_dispatch_pending) {
+        next = timer_heap_top(&s_timer_heaps[ESP_TIMER_TASK]);
+    }
+    esp_timer_handle_t next_isr = timer_heap_top(&s_timer_heaps[ESP_TIMER_ISR]);
+    if (next_isr != NULL && (next == NULL || next_isr->alarm < next->alarm)) {
+        next = next_isr;
+    }
+#else
+    next = timer_heap_top(&s_timer_heaps[ESP_TIMER_TASK]);
+#endif
+    if (next != NULL) {
+        esp_timer_impl_set_alarm(next->alarm);
+    }
+}
+
 static IRAM_ATTR bool timer_armed(esp_timer_handle_t timer)
 {
     return timer->alarm > 0;
 }
 
+// Same condition for running a callback and for notifying the task to run it,
+// so the task is never woken up for a timer it doesn't consider due yet
+static inline IRAM_ATTR bool timer_expired(esp_timer_handle_t timer, int64_t now)
+{
+    return timer->alarm < now;
+}
+
 static IRAM_ATTR void timer_list_lock(void)
 {
     portENTER_CRITICAL_SAFE(&s_timer_lock);
@@ -272,26 +487,37 @@ static IRAM_ATTR void timer_list_unlock(void)
     portEXIT_CRITICAL_SAFE(&s_timer_lock);
 }
 
-static void timer_process_alarm(esp_timer_dispatch_t dispatch_method)
+static TIMER_PROCESS_ATTR void timer_process_alarm(esp_timer_dispatch_t dispatch_method)
 {
-    /* unused, provision to allow running callbacks from ISR */
-    (void) dispatch_method;
-
+    timer_heap_t* heap = &s_timer_heaps[dispatch_method];
     timer_list_lock();
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+    if (dispatch_method == ESP_TIMER_TASK) {
+        s_task_dispatch_pending = false;
+    }
+#endif
     int64_t now = esp_timer_impl_get_time();
-    esp_timer_handle_t it = LIST_FIRST(&s_timers);
+    esp_timer_handle_t it = timer_heap_top(heap);
     while (it != NULL &&
-            it->alarm < now) {
-        LIST_REMOVE(it, list_entry);
+            timer_expired(it, now)) {
         if (it->event_id == EVENT_ID_DELETE_TIMER) {
+            // only ever in the ESP_TIMER_TASK heap
+            timer_heap_remove(heap, it);
+            --heap->reserved;
+            if (it->dispatch_method != ESP_TIMER_TASK) {
+                --s_timer_heaps[it->dispatch_method].reserved;
+            }
             free(it);
-            it = LIST_FIRST(&s_timers);
+            it = timer_heap_top(heap);
             continue;
         }
         if (it->period > 0) {
+            // re-arm in place: the timer stays at the top, only its key grows
             it->alarm += it->period;
-            timer_insert(it);
+            it->seq = s_timer_seq++;
+            timer_heap_sift_down(heap, 0);
         } else {
+            timer_heap_remove(heap, it);
             it->alarm = 0;
 #if WITH_PROFILING
             timer_insert_inactive(it);
@@ -307,15 +533,14 @@ static void timer_process_alarm(esp_timer_dispatch_t dispatch_method)
         timer_list_lock();
         now = esp_timer_impl_get_time();
 #if WITH_PROFILING
+        uint64_t callback_run_time = now - callback_start;
         it->times_triggered++;
-        it->total_callback_run_time += now - callback_start;
+        it->total_callback_run_time += callback_run_time;
+        it->max_callback_run_time = MAX(it->max_callback_run_time, callback_run_time);
 #endif
-        it = LIST_FIRST(&s_timers);
-    }
-    esp_timer_handle_t first = LIST_FIRST(&s_timers);
-    if (first) {
-        esp_timer_impl_set_alarm(first->alarm);
+        it = timer_heap_top(heap);
     }
+    timer_set_next_alarm();
     timer_list_unlock();
 }
 
@@ -328,12 +553,42 @@ static void timer_task(void* arg)
     }
 }
 
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+/* Check from the ISR whether the timer task has callbacks to dispatch */
+static IRAM_ATTR bool timer_task_dispatch_due(void)
+{
+    timer_list_lock();
+    esp_timer_handle_t next = timer_heap_top(&s_timer_heaps[ESP_TIMER_TASK]);
+    bool due = !s_task_dispatch_pending && next != NULL &&
+            timer_expired(next, esp_timer_impl_get_time());
+    if (due) {
+        s_task_dispatch_pending = true;
+    }
+    timer_list_unlock();
+    return due;
+}
+
+void IRAM_ATTR esp_timer_isr_dispatch_need_yield(void)
+{
+    assert(xPortInIsrContext());
+    s_isr_dispatch_need_yield = true;
+}
+#endif // CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+
 static void IRAM_ATTR timer_alarm_handler(void* arg)
 {
-    int need_yield;
-    if (xSemaphoreGiveFromISR(s_timer_semaphore, &need_yield) != pdPASS) {
+    int need_yield = pdFALSE;
+    bool notify_task = true;
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+    notify_task = timer_task_dispatch_due();
+    s_isr_dispatch_need_yield = false;
+    timer_process_alarm(ESP_TIMER_ISR);
+    if (s_isr_dispatch_need_yield) {
+        need_yield = pdTRUE;
+    }
+#endif
+    if (notify_task && xSemaphoreGiveFromISR(s_timer_semaphore, &need_yield) != pdPASS) {
         ESP_EARLY_LOGD(TAG, "timer queue overflow");
-        return;
     }
     if (need_yield == pdTRUE) {
         portYIELD_FROM_ISR();
@@ -397,8 +652,10 @@ esp_err_t esp_timer_deinit(void)
     }
 
     /* Check if there are any active timers */
-    if (!LIST_EMPTY(&s_timers)) {
-        return ESP_ERR_INVALID_STATE;
+    for (int i = 0; i < ESP_TIMER_MAX; ++i) {
+        if (s_timer_heaps[i].size > 0) {
+            return ESP_ERR_INVALID_STATE;
+        }
     }
 
     /* We can only check if there are any timers which are not deleted if
@@ -412,6 +669,16 @@ esp_err_t esp_timer_deinit(void)
 
     esp_timer_impl_deinit();
 
+    /* Timers which were not deleted keep their slots if the library is initialized again */
+    for (int i = 0; i < ESP_TIMER_MAX; ++i) {
+        timer_heap_t* heap = &s_timer_heaps[i];
+        if (heap->reserved == 0) {
+            free(heap->items);
+            heap->items = NULL;
+            heap->capacity = 0;
+        }
+    }
+
     vTaskDelete(s_timer_task);
     s_timer_task = NULL;
     vSemaphoreDelete(s_timer_semaphore);
@@ -423,19 +690,39 @@ static void print_timer_info(esp_timer_handle_t t, char** dst, size_t* dst_size)
 {
     size_t cb = snprintf(*dst, *dst_size,
 #if WITH_PROFILING
-            "%-12s  %12lld  %12lld  %9d  %9d  %12lld\n",
+            "%-12s  %12lld  %12lld  %9d  %9d  %12lld  %12lld\n",
             t->name, t->period, t->alarm,
-            t->times_armed, t->times_triggered, t->total_callback_run_time);
+            t->times_armed, t->times_triggered, t->total_callback_run_time,
+            t->max_callback_run_time);
     /* keep this in sync with the format string, used in esp_timer_dump */
-#define TIMER_INFO_LINE_LEN 78
+#define TIMER_INFO_LINE_LEN 92
 #else
             "timer@%p  %12lld  %12lld\n", t, t->period, t->alarm);
 #define TIMER_INFO_LINE_LEN 46
 #endif
+    /* output is truncated if the buffer is too small */
+    cb = MIN(cb, (*dst_size > 0) ? *dst_size - 1 : 0);
     *dst += cb;
     *dst_size -= cb;
 }
 
+/* Line of an armed timer in the esp_timer_dump buffer */
+typedef struct {
+    uint64_t alarm;
+    uint32_t seq;
+    size_t offset;
+    size_t len;
+} timer_dump_line_t;
+
+static int timer_dump_line_cmp(const void* a, const void* b)
+{
+    const timer_dump_line_t* la = (const timer_dump_line_t*) a;
+    const timer_dump_line_t* lb = (const timer_dump_line_t*) b;
+    if (la->alarm != lb->alarm) {
+        return (la->alarm < lb->alarm) ? -1 : 1;
+    }
+    return (int32_t) (la->seq - lb->seq);
+}
 
 esp_err_t esp_timer_dump(FILE* stream)
 {
@@ -445,15 +732,17 @@ esp_err_t esp_timer_dump(FILE* stream)
      * print to it, then dump this memory to stdout.
      */
 
-    esp_timer_handle_t it;
-
     /* First count the number of timers */
-    size_t timer_count = 0;
+    size_t armed_count;
+    size_t timer_count;
     timer_list_lock();
-    LIST_FOREACH(it, &s_timers, list_entry) {
-        ++timer_count;
+    armed_count = 0;
+    for (int i = 0; i < ESP_TIMER_MAX; ++i) {
+        armed_count += s_timer_heaps[i].size;
     }
+    timer_count = armed_count;
 #if WITH_PROFILING
+    esp_timer_handle_t it;
     LIST_FOREACH(it, &s_inactive_timers, list_entry) {
         ++timer_count;
     }
@@ -466,17 +755,36 @@ esp_err_t esp_timer_dump(FILE* stream)
      * slightly more and the output will be truncated if that is not enough.
      */
     size_t buf_size = TIMER_INFO_LINE_LEN * (timer_count + 3);
+    size_t max_lines = armed_count + 3;
     char* print_buf = calloc(1, buf_size + 1);
-    if (print_buf == NULL) {
+    timer_dump_line_t* lines = calloc(max_lines, sizeof(timer_dump_line_t));
+    if (print_buf == NULL || lines == NULL) {
+        free(print_buf);
+        free(lines);
         return ESP_ERR_NO_MEM;
     }
 
-    /* Print to the buffer */
+    /* Print to the buffer. Armed timers are printed in heap order, and
+     * sorted by alarm time below, outside of the critical section.
+     */
     timer_list_lock();
     char* pos = print_buf;
-    LIST_FOREACH(it, &s_timers, list_entry) {
-        print_timer_info(it, &pos, &buf_size);
+    size_t line_count = 0;
+    for (int i = 0; i < ESP_TIMER_MAX; ++i) {
+        timer_heap_t* heap = &s_timer_heaps[i];
+        for (size_t j = 0; j < heap->size && line_count < max_lines; ++j) {
+            esp_timer_handle_t t = heap->items[j];
+            char* line = pos;
+            print_timer_info(t, &pos, &buf_size);
+            lines[line_count++] = (timer_dump_line_t) {
+                .alarm = t->alarm,
+                .seq = t->seq,
+                .offset = line - print_buf,
+                .len = pos - line
+            };
+        }
     }
+    char* inactive_start = pos;
 #if WITH_PROFILING
     LIST_FOREACH(it, &s_inactive_timers, list_entry) {
         print_timer_info(it, &pos, &buf_size);
@@ -485,8 +793,13 @@ esp_err_t esp_timer_dump(FILE* stream)
     timer_list_unlock();
 
     /* Print the buffer */
-    fputs(print_buf, stream);
+    qsort(lines, line_count, sizeof(timer_dump_line_t), &timer_dump_line_cmp);
+    for (size_t i = 0; i < line_count; ++i) {
+        fwrite(print_buf + lines[i].offset, 1, lines[i].len, stream);
+    }
+    fputs(inactive_start, stream);
 
+    free(lines);
     free(print_buf);
     return ESP_OK;
 }
@@ -495,9 +808,11 @@ int64_t IRAM_ATTR esp_timer_get_next_alarm(void)
 {
     int64_t next_alarm = INT64_MAX;
     timer_list_lock();
-    esp_timer_handle_t it = LIST_FIRST(&s_timers);
-    if (it) {
-        next_alarm = it->alarm;
+    for (int i = 0; i < ESP_TIMER_MAX; ++i) {
+        esp_timer_handle_t next = timer_heap_top(&s_timer_heaps[i]);
+        if (next != NULL && (int64_t) next->alarm < next_alarm) {
+            next_alarm = next->alarm;
+        }
     }
     timer_list_unlock();
     return next_alarm;
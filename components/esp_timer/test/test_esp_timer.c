@@ -8,6 +8,7 @@
 #include "unity.h"
 #include "soc/frc_timer_reg.h"
 #include "soc/timer_group_reg.h"
+#include "soc/cpu.h"
 #include "esp_heap_caps.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -424,6 +425,117 @@ TEST_CASE("esp_timer_get_time call takes less than 1us", "[esp_timer]")
     TEST_PERFORMANCE_LESS_THAN(ESP_TIMER_GET_TIME_PER_CALL, "%dns", ns_per_call);
 }
 
+typedef struct {
+    int64_t start;
+    int64_t period;
+    int count;
+    int max_count;
+    int64_t total_jitter;
+    int64_t max_jitter;
+    SemaphoreHandle_t done;
+} jitter_probe_t;
+
+static void empty_timer_cb(void* arg)
+{
+}
+
+static void jitter_probe_cb(void* arg)
+{
+    jitter_probe_t* p = (jitter_probe_t*) arg;
+    int64_t now = esp_timer_get_time();
+    int64_t jitter = now - (p->start + p->period * (p->count + 1));
+    p->total_jitter += jitter;
+    p->max_jitter = MAX(p->max_jitter, jitter);
+    if (++p->count == p->max_count) {
+        xSemaphoreGive(p->done);
+    }
+}
+
+/* Measures arming and disarming a timer, and the callback dispatch latency of
+ * a periodic timer, while a number of other timers are armed. The other timers
+ * expire 10 to 20 seconds later, so they don't run during the measurement.
+ */
+TEST_CASE("esp_timer start/stop and dispatch performance with many timers", "[esp_timer][timeout=60]")
+{
+    const int timer_counts[] = { 10, 100, 1000 };
+    const int max_timers = 1000;
+    const int iter_count = 1000;
+    const int64_t base_timeout = 10 * 1000000;
+
+    esp_timer_handle_t* timers = calloc(max_timers, sizeof(esp_timer_handle_t));
+    TEST_ASSERT_NOT_NULL(timers);
+    esp_timer_create_args_t args = {
+        .callback = &empty_timer_cb,
+        .name = "background"
+    };
+    for (int i = 0; i < max_timers; ++i) {
+        TEST_ESP_OK(esp_timer_create(&args, &timers[i]));
+    }
+    esp_timer_handle_t probe;
+    args.name = "probe";
+    TEST_ESP_OK(esp_timer_create(&args, &probe));
+
+    jitter_probe_t jitter = { .period = 2000, .max_count = 200 };
+    jitter.done = xSemaphoreCreateBinary();
+    esp_timer_handle_t jitter_timer;
+    args.callback = &jitter_probe_cb;
+    args.arg = &jitter;
+    args.name = "jitter";
+    TEST_ESP_OK(esp_timer_create(&args, &jitter_timer));
+
+    for (int c = 0; c < sizeof(timer_counts) / sizeof(timer_counts[0]); ++c) {
+        const int n = timer_counts[c];
+        for (int i = 0; i < n; ++i) {
+            TEST_ESP_OK(esp_timer_start_once(timers[i], base_timeout + base_timeout * i / n));
+        }
+
+        uint32_t start_cycles = 0;
+        uint32_t stop_cycles = 0;
+        for (int i = 0; i < iter_count; ++i) {
+            uint64_t timeout = base_timeout + (uint64_t) base_timeout * ((i * 7919) % iter_count) / iter_count;
+            uint32_t t0 = esp_cpu_get_ccount();
+            esp_timer_start_once(probe, timeout);
+            uint32_t t1 = esp_cpu_get_ccount();
+            esp_timer_stop(probe);
+            uint32_t t2 = esp_cpu_get_ccount();
+            start_cycles += t1 - t0;
+            stop_cycles += t2 - t1;
+        }
+
+        jitter.count = 0;
+        jitter.total_jitter = 0;
+        jitter.max_jitter = 0;
+        jitter.start = esp_timer_get_time();
+        TEST_ESP_OK(esp_timer_start_periodic(jitter_timer, jitter.period));
+        TEST_ASSERT(xSemaphoreTake(jitter.done, pdMS_TO_TICKS(2000)));
+        TEST_ESP_OK(esp_timer_stop(jitter_timer));
+
+        for (int i = 0; i < n; ++i) {
+            TEST_ESP_OK(esp_timer_stop(timers[i]));
+        }
+
+        char item[48];
+        snprintf(item, sizeof(item), "esp_timer_start_cycles_%d_timers", n);
+        IDF_LOG_PERFORMANCE(item, "%d", start_cycles / iter_count);
+        snprintf(item, sizeof(item), "esp_timer_stop_cycles_%d_timers", n);
+        IDF_LOG_PERFORMANCE(item, "%d", stop_cycles / iter_count);
+        snprintf(item, sizeof(item), "esp_timer_avg_jitter_us_%d_timers", n);
+        IDF_LOG_PERFORMANCE(item, "%d", (int) (jitter.total_jitter / jitter.count));
+        snprintf(item, sizeof(item), "esp_timer_max_jitter_us_%d_timers", n);
+        IDF_LOG_PERFORMANCE(item, "%d", (int) jitter.max_jitter);
+    }
+
+    for (int i = 0; i < max_timers; ++i) {
+        TEST_ESP_OK(esp_timer_delete(timers[i]));
+    }
+    TEST_ESP_OK(esp_timer_delete(probe));
+    TEST_ESP_OK(esp_timer_delete(jitter_timer));
+    vSemaphoreDelete(jitter.done);
+    free(timers);
+    // let the timer task free the deleted timers
+    vTaskDelay(2);
+}
+
 static int64_t IRAM_ATTR __attribute__((noinline)) get_clock_diff(void)
 {
     uint64_t hs_time = esp_timer_get_time();
@@ -864,3 +976,124 @@ TEST_CASE("Test esp_timer_impl_set_alarm when the counter is near an overflow va
         esp_timer_impl_set_alarm(1); // timestamp is expired
     }
 }
+
+#ifdef CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+
+TEST_CASE("ESP_TIMER_ISR timer callback must be in IRAM", "[esp_timer]")
+{
+    esp_timer_handle_t timer;
+    esp_timer_create_args_t args = {
+        .callback = &empty_timer_cb,
+        .dispatch_method = ESP_TIMER_ISR,
+        .name = "isr_flash"
+    };
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_timer_create(&args, &timer));
+}
+
+#define LATENCY_SAMPLE_COUNT    500
+
+typedef struct {
+    int64_t expected;
+    int64_t period;
+    int count;
+    uint32_t latency[LATENCY_SAMPLE_COUNT];
+    SemaphoreHandle_t done;
+} latency_probe_t;
+
+static void IRAM_ATTR latency_probe_cb(void* arg)
+{
+    latency_probe_t* p = (latency_probe_t*) arg;
+    int64_t now = esp_timer_get_time();
+    p->expected += p->period;
+    if (p->count == LATENCY_SAMPLE_COUNT) {
+        return;
+    }
+    p->latency[p->count] = now - p->expected;
+    if (++p->count == LATENCY_SAMPLE_COUNT) {
+        if (xPortInIsrContext()) {
+            BaseType_t need_yield = pdFALSE;
+            xSemaphoreGiveFromISR(p->done, &need_yield);
+            if (need_yield == pdTRUE) {
+                esp_timer_isr_dispatch_need_yield();
+            }
+        } else {
+            xSemaphoreGive(p->done);
+        }
+    }
+}
+
+static int cmp_latency(const void* a, const void* b)
+{
+    uint32_t la = *(const uint32_t*) a;
+    uint32_t lb = *(const uint32_t*) b;
+    return (la > lb) - (la < lb);
+}
+
+/* Runs a periodic timer with the given dispatch method, prints the histogram
+ * of the callback latency and returns the median, in microseconds.
+ */
+static uint32_t measure_dispatch_latency(esp_timer_dispatch_t dispatch_method, const char* name)
+{
+    const uint32_t bucket_limits[] = { 5, 10, 20, 50, 100, UINT32_MAX };
+    const int bucket_count = sizeof(bucket_limits) / sizeof(bucket_limits[0]);
+    int buckets[sizeof(bucket_limits) / sizeof(bucket_limits[0])] = { 0 };
+
+    // accessed from the timer ISR
+    latency_probe_t* p = heap_caps_calloc(1, sizeof(*p), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    TEST_ASSERT_NOT_NULL(p);
+    p->period = 1000;
+    p->done = xSemaphoreCreateBinary();
+    esp_timer_create_args_t args = {
+        .callback = &latency_probe_cb,
+        .arg = p,
+        .dispatch_method = dispatch_method,
+        .name = name
+    };
+    esp_timer_handle_t timer;
+    TEST_ESP_OK(esp_timer_create(&args, &timer));
+    p->expected = esp_timer_get_time();
+    TEST_ESP_OK(esp_timer_start_periodic(timer, p->period));
+    TEST_ASSERT(xSemaphoreTake(p->done, pdMS_TO_TICKS(LATENCY_SAMPLE_COUNT * 2)));
+    TEST_ESP_OK(esp_timer_stop(timer));
+    TEST_ESP_OK(esp_timer_delete(timer));
+
+    qsort(p->latency, LATENCY_SAMPLE_COUNT, sizeof(uint32_t), &cmp_latency);
+    for (int i = 0; i < LATENCY_SAMPLE_COUNT; ++i) {
+        int b = 0;
+        while (p->latency[i] >= bucket_limits[b]) {
+            ++b;
+        }
+        ++buckets[b];
+    }
+    printf("%s dispatch latency:\n", name);
+    for (int b = 0; b < bucket_count; ++b) {
+        if (bucket_limits[b] == UINT32_MAX) {
+            printf("  >=%3d us: %d\n", bucket_limits[b - 1], buckets[b]);
+        } else {
+            printf("  <%4d us: %d\n", bucket_limits[b], buckets[b]);
+        }
+    }
+    uint32_t p50 = p->latency[LATENCY_SAMPLE_COUNT / 2];
+    char item[48];
+    snprintf(item, sizeof(item), "esp_timer_%s_latency_p50_us", name);
+    IDF_LOG_PERFORMANCE(item, "%d", p50);
+    snprintf(item, sizeof(item), "esp_timer_%s_latency_p99_us", name);
+    IDF_LOG_PERFORMANCE(item, "%d", p->latency[LATENCY_SAMPLE_COUNT * 99 / 100]);
+    snprintf(item, sizeof(item), "esp_timer_%s_latency_max_us", name);
+    IDF_LOG_PERFORMANCE(item, "%d", p->latency[LATENCY_SAMPLE_COUNT - 1]);
+
+    vSemaphoreDelete(p->done);
+    free(p);
+    return p50;
+}
+
+TEST_CASE("esp_timer callback latency with task and ISR dispatch", "[esp_timer]")
+{
+    uint32_t task_p50 = measure_dispatch_latency(ESP_TIMER_TASK, "task");
+    uint32_t isr_p50 = measure_dispatch_latency(ESP_TIMER_ISR, "isr");
+    TEST_ASSERT_LESS_THAN(task_p50, isr_p50);
+    // let the timer task free the deleted timers
+    vTaskDelay(2);
+}
+
+#endif // CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
@@ -75,8 +75,14 @@ DRESULT ff_wl_ioctl (BYTE pdrv, BYTE cmd, void *buff)
     ESP_LOGV(TAG, "ff_wl_ioctl: cmd=%i\n", cmd);
     assert(wl_handle + 1);
     switch (cmd) {
-    case CTRL_SYNC:
+    case CTRL_SYNC: {
+        esp_err_t err = wl_flush(wl_handle);
+        if (unlikely(err != ESP_OK)) {
+            ESP_LOGE(TAG, "wl_flush failed (%d)", err);
+            return RES_ERROR;
+        }
         return RES_OK;
+    }
     case GET_SECTOR_COUNT:
         *((DWORD *) buff) = wl_size(wl_handle) / wl_sector_size(wl_handle);
         return RES_OK;
@@ -1636,6 +1636,46 @@ static DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Count clusters contiguous with the current cluster     */
+/*-----------------------------------------------------------------------*/
+
+static DWORD contiguous_clusters (	/* Number of clusters directly following the current cluster on the volume (0 to ncl) */
+	FIL* fp,		/* Pointer to the file object */
+	DWORD ncl		/* Maximum number of clusters to count */
+)
+{
+	DWORD n, clst, nxt;
+#if FF_USE_FASTSEEK
+	DWORD cl, *tbl;
+	FATFS *fs = fp->obj.fs;
+
+
+	if (fp->cltbl) {	/* Fragment lengths are in the CLMT */
+		tbl = fp->cltbl + 1;
+		cl = (DWORD)(fp->fptr / SS(fs) / fs->csize);	/* Cluster order of the current cluster */
+		for (;;) {
+			n = *tbl++;
+			if (n == 0) return 0;	/* End of table? (error, left to the caller) */
+			if (cl < n) break;		/* In this fragment? */
+			cl -= n; tbl++;
+		}
+		n -= cl + 1;				/* Clusters left in the fragment */
+		return (n < ncl) ? n : ncl;
+	}
+#endif
+	clst = fp->clust;
+	for (n = 0; n < ncl; n++) {
+		nxt = get_fat(&fp->obj, clst);	/* The FAT sector is usually in the window already */
+		if (nxt != clst + 1) break;		/* End of fragment, end of chain or error */
+		clst = nxt;
+	}
+	return n;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Fill a cluster with zeros                        */
 /*-----------------------------------------------------------------------*/
@@ -3730,6 +3770,39 @@ FRESULT f_open (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Read data sectors of a file                                           */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT read_data_sectors (	/* FR_OK(0):succeeded, FR_DISK_ERR:disk error, FR_TIMEOUT/FR_INVALID_OBJECT:volume is not locked any more */
+	FIL* fp,		/* File object, its volume is locked by the caller */
+	BYTE* buff,		/* Data buffer to store read data */
+	DWORD sect,		/* Start sector */
+	UINT count		/* Number of sectors to read */
+)
+{
+	FATFS *fs = fp->obj.fs;
+	DRESULT dr;
+
+#if FF_FS_REENTRANT && FF_FS_UNLOCKED_READ
+	/* The sectors belong to the file, so the volume can be accessed by other tasks meanwhile */
+	unlock_fs(fs, FR_OK);
+	dr = disk_read(fs->pdrv, buff, sect, count);
+	if (!lock_fs(fs)) return FR_TIMEOUT;
+	/* Check the file object again, as in validate(). The file may have been closed,
+	   or the volume unmounted or remounted while it was not locked. */
+	if (fp->obj.fs != fs || !fs->fs_type || fp->obj.id != fs->id || (disk_status(fs->pdrv) & STA_NOINIT)) {
+		unlock_fs(fs, FR_OK);
+		return FR_INVALID_OBJECT;
+	}
+#else
+	dr = disk_read(fs->pdrv, buff, sect, count);
+#endif
+	return (dr == RES_OK) ? FR_OK : FR_DISK_ERR;
+}
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Read File                                                             */
 /*-----------------------------------------------------------------------*/
@@ -3743,7 +3816,7 @@ FRESULT f_read (
 {
 	FRESULT res;
 	FATFS *fs;
-	DWORD clst, sect;
+	DWORD clst, sect, ncl;
 	FSIZE_t remain;
 	UINT rcnt, cc, csect;
 	BYTE *rbuff = (BYTE*)buff;
@@ -3782,10 +3855,14 @@ FRESULT f_read (
 			sect += csect;
 			cc = btr / SS(fs);					/* When remaining bytes >= sector size, */
 			if (cc > 0) {						/* Read maximum contiguous sectors directly */
-				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
-					cc = fs->csize - csect;
+				if (csect + cc > fs->csize) {	/* Clip at the end of contiguous clusters */
+					ncl = contiguous_clusters(fp, (csect + cc - 1) / fs->csize);
+					if (csect + cc > (ncl + 1) * fs->csize) cc = (ncl + 1) * fs->csize - csect;
 				}
-				if (disk_read(fs->pdrv, rbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
+				res = read_data_sectors(fp, rbuff, sect, cc);
+				if (res == FR_TIMEOUT || res == FR_INVALID_OBJECT) return res;
+				if (res != FR_OK) ABORT(fs, res);
+				fp->clust += (csect + cc - 1) / fs->csize;	/* Move to the last cluster read */
 #if !FF_FS_READONLY && FF_FS_MINIMIZE <= 2		/* Replace one of the read sectors with cached data if it contains a dirty sector */
 #if FF_FS_TINY
 				if (fs->wflag && fs->winsect - sect < cc) {
@@ -3808,7 +3885,9 @@ FRESULT f_read (
 					fp->flag &= (BYTE)~FA_DIRTY;
 				}
 #endif
-				if (disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK)	ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+				res = read_data_sectors(fp, fp->buf, sect, 1);	/* Fill sector cache */
+				if (res == FR_TIMEOUT || res == FR_INVALID_OBJECT) return res;
+				if (res != FR_OK) ABORT(fs, res);
 			}
 #endif
 			fp->sect = sect;
@@ -4407,6 +4486,91 @@ FRESULT f_lseek (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Read/Write File at an Offset without Moving the File Pointer          */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT restore_fptr (
+	FIL* fp,		/* Pointer to the file object */
+	FSIZE_t fptr,	/* File pointer to be restored */
+	DWORD clust,	/* Current cluster of the file pointer */
+	DWORD sect		/* Sector in the sector cache at the file pointer */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
+	if (res != FR_OK) LEAVE_FF(fs, res);
+#if !FF_FS_TINY
+	if (fp->sect != sect) {
+#if !FF_FS_READONLY
+		if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
+			if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+			fp->flag &= (BYTE)~FA_DIRTY;
+		}
+#endif
+		if (fptr % SS(fs)) {
+			if (disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+		} else {
+			sect = 0;					/* On a sector boundary the next access loads the sector, so leave the cache invalid */
+		}
+	}
+#endif
+	fp->fptr = fptr;					/* Seeking back to a known position does not need to follow the cluster chain */
+	fp->clust = clust;
+	fp->sect = sect;
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+FRESULT f_pread (
+	FIL* fp, 		/* Pointer to the file object */
+	void* buff,		/* Pointer to data buffer */
+	UINT btr,		/* Number of bytes to read */
+	FSIZE_t ofs,	/* File offset to read from */
+	UINT* br		/* Pointer to number of bytes read */
+)
+{
+	FRESULT res, res2;
+	const FSIZE_t fptr = fp->fptr;
+	const DWORD clust = fp->clust, sect = fp->sect;
+
+
+	*br = 0;
+	res = f_lseek(fp, ofs);
+	if (res == FR_OK) res = f_read(fp, buff, btr, br);
+	res2 = restore_fptr(fp, fptr, clust, sect);
+	return (res != FR_OK) ? res : res2;
+}
+
+
+#if !FF_FS_READONLY
+FRESULT f_pwrite (
+	FIL* fp,			/* Pointer to the file object */
+	const void* buff,	/* Pointer to the data to be written */
+	UINT btw,			/* Number of bytes to write */
+	FSIZE_t ofs,		/* File offset to write to */
+	UINT* bw			/* Pointer to number of bytes written */
+)
+{
+	FRESULT res, res2;
+	const FSIZE_t fptr = fp->fptr;
+	const DWORD clust = fp->clust, sect = fp->sect;
+
+
+	*bw = 0;
+	res = f_lseek(fp, ofs);
+	if (res == FR_OK) res = f_write(fp, buff, btw, bw);
+	res2 = restore_fptr(fp, fptr, clust, sect);
+	return (res != FR_OK) ? res : res2;
+}
+#endif
+
+
+
 #if FF_FS_MINIMIZE <= 1
 /*-----------------------------------------------------------------------*/
 /* Create a Directory Object                                             */
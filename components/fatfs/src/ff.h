@@ -285,6 +285,8 @@ FRESULT f_close (FIL* fp);											/* Close an open file object */
 FRESULT f_read (FIL* fp, void* buff, UINT btr, UINT* br);			/* Read data from the file */
 FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data to the file */
 FRESULT f_lseek (FIL* fp, FSIZE_t ofs);								/* Move file pointer of the file object */
+FRESULT f_pread (FIL* fp, void* buff, UINT btr, FSIZE_t ofs, UINT* br);	/* Read data from the file at an offset, without moving the file pointer */
+FRESULT f_pwrite (FIL* fp, const void* buff, UINT btw, FSIZE_t ofs, UINT* bw);	/* Write data to the file at an offset, without moving the file pointer */
 FRESULT f_truncate (FIL* fp);										/* Truncate the file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of the writing file */
 FRESULT f_opendir (FF_DIR* dp, const TCHAR* path);						/* Open a directory */
@@ -44,7 +44,11 @@
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 
 
+#ifdef CONFIG_FATFS_USE_FASTSEEK
+#define FF_USE_FASTSEEK	1
+#else
 #define FF_USE_FASTSEEK	0
+#endif
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
@@ -304,6 +308,14 @@
 /  SemaphoreHandle_t and etc. A header file for O/S definitions needs to be
 /  included somewhere in the scope of ff.h. */
 
+
+#define FF_FS_UNLOCKED_READ	1
+/* The option FF_FS_UNLOCKED_READ is specific to ESP-IDF. When it is 1 and
+/  FF_FS_REENTRANT is enabled, f_read() releases the volume while it reads the data
+/  sectors of the file from the disk, so that other files of the same volume can be
+/  accessed in the meantime. A file object must not be used by more tasks at the
+/  same time then. */
+
 #include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
@@ -1,6 +1,8 @@
 # pragma once
 #define CONFIG_IDF_TARGET_ESP32 1
 #define CONFIG_WL_SECTOR_SIZE   4096
+#define CONFIG_FATFS_USE_FASTSEEK 1
+#define CONFIG_FATFS_FAST_SEEK_BUFFER_SIZE 64
 #define CONFIG_LOG_DEFAULT_LEVEL 3
 #define CONFIG_PARTITION_TABLE_OFFSET 0x8000
 #define CONFIG_ESPTOOLPY_FLASHSIZE "8MB"
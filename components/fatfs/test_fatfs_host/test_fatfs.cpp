@@ -1,16 +1,175 @@
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 #include "ff.h"
 #include "esp_partition.h"
 #include "wear_levelling.h"
 #include "diskio_impl.h"
 #include "diskio_wl.h"
+#include "esp_vfs.h"
 
 #include "catch.hpp"
 
 extern "C" void _spi_flash_init(const char* chip_size, size_t block_size, size_t sector_size, size_t page_size, const char* partition_bin);
 
+extern "C" DSTATUS ff_wl_initialize(BYTE pdrv);
+extern "C" DSTATUS ff_wl_status(BYTE pdrv);
+extern "C" DRESULT ff_wl_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count);
+extern "C" DRESULT ff_wl_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count);
+extern "C" DRESULT ff_wl_ioctl(BYTE pdrv, BYTE cmd, void *buff);
+
+extern "C" esp_err_t esp_vfs_fat_register(const char* base_path, const char* fat_drive, size_t max_files, FATFS** out_fs);
+extern "C" esp_err_t esp_vfs_fat_unregister_path(const char* base_path);
+
+// The FAT VFS driver registered last, its functions are called directly by the tests
+static esp_vfs_t s_vfs;
+static void *s_vfs_ctx;
+
+extern "C" esp_err_t esp_vfs_register(const char* base_path, const esp_vfs_t* vfs, void* ctx)
+{
+    s_vfs = *vfs;
+    s_vfs_ctx = ctx;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t esp_vfs_unregister(const char* base_path)
+{
+    s_vfs_ctx = NULL;
+    return ESP_OK;
+}
+
+static size_t s_disk_reads;
+static size_t s_sectors_read;
+
+static DRESULT counting_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    s_disk_reads++;
+    s_sectors_read += count;
+    return ff_wl_read(pdrv, buff, sector, count);
+}
+
+// Wear levelling disk I/O driver which counts the read calls
+static const ff_diskio_impl_t s_counting_wl_impl = {
+    .init = &ff_wl_initialize,
+    .status = &ff_wl_status,
+    .read = &counting_read,
+    .write = &ff_wl_write,
+    .ioctl = &ff_wl_ioctl
+};
+
+// Disk I/O driver which takes as long as reading from flash would, and records how many reads are in progress at once
+static std::atomic<int> s_reads_in_progress;
+static std::atomic<int> s_max_reads_in_progress;
+
+static DRESULT slow_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    // Fixed cost of each read call, and reading at 40 MHz QIO, as in the read throughput benchmark
+    const double call_time_us = 30.0;
+    const double read_time_us_per_byte = 1.0 / 20;
+
+    int in_progress = ++s_reads_in_progress;
+    int max = s_max_reads_in_progress;
+    while (in_progress > max && !s_max_reads_in_progress.compare_exchange_weak(max, in_progress)) {
+    }
+    DRESULT res = ff_wl_read(pdrv, buff, sector, count);
+    std::this_thread::sleep_for(std::chrono::microseconds((long) (call_time_us + count * FF_MAX_SS * read_time_us_per_byte)));
+    --s_reads_in_progress;
+    return res;
+}
+
+static const ff_diskio_impl_t s_slow_wl_impl = {
+    .init = &ff_wl_initialize,
+    .status = &ff_wl_status,
+    .read = &slow_read,
+    .write = &ff_wl_write,
+    .ioctl = &ff_wl_ioctl
+};
+
+static void mount_counting_volume(BYTE *pdrv, wl_handle_t *wl_handle, FATFS *fs, char *drv,
+                                  const ff_diskio_impl_t *impl = &s_counting_wl_impl)
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_FAT, "storage");
+    REQUIRE(wl_mount(partition, wl_handle) == ESP_OK);
+    REQUIRE(ff_diskio_get_drive(pdrv) == ESP_OK);
+    REQUIRE(ff_diskio_register_wl_partition(*pdrv, *wl_handle) == ESP_OK);
+    ff_diskio_register(*pdrv, impl);
+
+    drv[0] = '0' + *pdrv;
+    drv[1] = ':';
+    drv[2] = 0;
+
+    DWORD part_list[] = {100, 0, 0, 0};
+    BYTE work_area[FF_MAX_SS];
+    REQUIRE(f_fdisk(*pdrv, part_list, work_area) == FR_OK);
+    REQUIRE(f_mkfs(drv, FM_ANY, 0, work_area, sizeof(work_area)) == FR_OK);
+    REQUIRE(f_mount(fs, drv, 1) == FR_OK);
+}
+
+static void unmount_counting_volume(BYTE pdrv, wl_handle_t wl_handle, const char *drv)
+{
+    REQUIRE(f_mount(0, drv, 0) == FR_OK);
+    ff_diskio_unregister(pdrv);
+    REQUIRE(wl_unmount(wl_handle) == ESP_OK);
+}
+
+static void fill_file_data(char *data, uint32_t size, uint32_t seed)
+{
+    for (uint32_t i = 0; i < size; i += sizeof(i)) {
+        *((uint32_t*)(data + i)) = i ^ seed;
+    }
+}
+
+/* Writes a contiguous file, and two files with clusters interleaved, so that each has one cluster per fragment */
+static void create_test_files(const char *drv, uint32_t size, UINT cluster_size, char *data, char *data_frag)
+{
+    char path[16];
+    FIL file, file_frag[2];
+    UINT bw;
+
+    fill_file_data(data, size, 0);
+    snprintf(path, sizeof(path), "%s/cont.bin", drv);
+    REQUIRE(f_open(&file, path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+    REQUIRE(f_write(&file, data, size, &bw) == FR_OK);
+    REQUIRE(bw == size);
+    REQUIRE(f_close(&file) == FR_OK);
+
+    fill_file_data(data_frag, size, 0x5a5a5a5a);
+    for (int i = 0; i < 2; ++i) {
+        snprintf(path, sizeof(path), "%s/frag%d.bin", drv, i);
+        REQUIRE(f_open(&file_frag[i], path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+    }
+    for (uint32_t ofs = 0; ofs < size; ofs += cluster_size) {
+        for (int i = 0; i < 2; ++i) {
+            REQUIRE(f_write(&file_frag[i], data_frag + ofs, cluster_size, &bw) == FR_OK);
+            REQUIRE(bw == cluster_size);
+            REQUIRE(f_sync(&file_frag[i]) == FR_OK);
+        }
+    }
+    for (int i = 0; i < 2; ++i) {
+        REQUIRE(f_close(&file_frag[i]) == FR_OK);
+    }
+}
+
+static void open_test_file(FIL *file, const char *drv, const char *name, DWORD *clmt, DWORD clmt_size)
+{
+    char path[16];
+    snprintf(path, sizeof(path), "%s/%s", drv, name);
+    REQUIRE(f_open(file, path, FA_READ) == FR_OK);
+    if (clmt) {
+        clmt[0] = clmt_size;
+        file->cltbl = clmt;
+        REQUIRE(f_lseek(file, CREATE_LINKMAP) == FR_OK);
+    }
+}
+
 TEST_CASE("create volume, open file, write and read back data", "[fatfs]")
 {
     _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
@@ -91,3 +250,433 @@ TEST_CASE("create volume, open file, write and read back data", "[fatfs]")
     free(read);
     free(data);
 }
+
+TEST_CASE("pread and pwrite do not move the file pointer", "[fatfs]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+
+    FRESULT fr_result;
+    BYTE pdrv;
+    FATFS fs;
+    FIL file;
+    UINT bw;
+
+    esp_err_t esp_result;
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_FAT, "storage");
+
+    wl_handle_t wl_handle;
+    esp_result = wl_mount(partition, &wl_handle);
+    REQUIRE(esp_result == ESP_OK);
+
+    esp_result = ff_diskio_get_drive(&pdrv);
+    REQUIRE(esp_result == ESP_OK);
+
+    esp_result = ff_diskio_register_wl_partition(pdrv, wl_handle);
+    REQUIRE(esp_result == ESP_OK);
+
+    // The logical drive number matches the physical drive number
+    char drv[3] = {(char) ('0' + pdrv), ':', 0};
+    char path[16];
+    snprintf(path, sizeof(path), "%s/test.bin", drv);
+
+    DWORD part_list[] = {100, 0, 0, 0};
+    BYTE work_area[FF_MAX_SS];
+
+    fr_result = f_fdisk(pdrv, part_list, work_area);
+    REQUIRE(fr_result == FR_OK);
+    fr_result = f_mkfs(drv, FM_ANY, 0, work_area, sizeof(work_area));
+    REQUIRE(fr_result == FR_OK);
+
+    fr_result = f_mount(&fs, drv, 0);
+    REQUIRE(fr_result == FR_OK);
+
+    fr_result = f_open(&file, path, FA_CREATE_ALWAYS | FA_READ | FA_WRITE);
+    REQUIRE(fr_result == FR_OK);
+
+    // Several clusters, so that the offsets below land in different ones
+    uint32_t data_size = 64 * 1024;
+
+    char *data = (char*) malloc(data_size);
+    char *read = (char*) malloc(data_size);
+
+    for(uint32_t i = 0; i < data_size; i += sizeof(i))
+    {
+        *((uint32_t*)(data + i)) = i;
+    }
+
+    fr_result = f_write(&file, data, data_size, &bw);
+    REQUIRE(fr_result == FR_OK);
+    REQUIRE(bw == data_size);
+
+    // Leave the file pointer in the middle of a sector
+    const FSIZE_t pos = 1000;
+    fr_result = f_lseek(&file, pos);
+    REQUIRE(fr_result == FR_OK);
+
+    // Read from a later cluster, from before the file pointer and across the end of file
+    fr_result = f_pread(&file, read, 5000, 40000, &bw);
+    REQUIRE(fr_result == FR_OK);
+    REQUIRE(bw == 5000);
+    REQUIRE(memcmp(data + 40000, read, 5000) == 0);
+    REQUIRE(f_tell(&file) == pos);
+
+    fr_result = f_pread(&file, read, 300, 10, &bw);
+    REQUIRE(fr_result == FR_OK);
+    REQUIRE(bw == 300);
+    REQUIRE(memcmp(data + 10, read, 300) == 0);
+    REQUIRE(f_tell(&file) == pos);
+
+    fr_result = f_pread(&file, read, 1000, data_size - 100, &bw);
+    REQUIRE(fr_result == FR_OK);
+    REQUIRE(bw == 100);
+    REQUIRE(f_tell(&file) == pos);
+
+    // Overwrite a range away from the file pointer
+    memset(data + 30000, 0xa5, 2000);
+    fr_result = f_pwrite(&file, data + 30000, 2000, 30000, &bw);
+    REQUIRE(fr_result == FR_OK);
+    REQUIRE(bw == 2000);
+    REQUIRE(f_tell(&file) == pos);
+
+    // Sequential read continues from the original position
+    fr_result = f_read(&file, read, 600, &bw);
+    REQUIRE(fr_result == FR_OK);
+    REQUIRE(bw == 600);
+    REQUIRE(memcmp(data + pos, read, 600) == 0);
+
+    // Same with the file pointer on a sector boundary, then seek back into the previous sector
+    fr_result = f_lseek(&file, FF_MAX_SS);
+    REQUIRE(fr_result == FR_OK);
+    fr_result = f_pread(&file, read, 100, 50000, &bw);
+    REQUIRE(fr_result == FR_OK);
+    REQUIRE(bw == 100);
+    REQUIRE(memcmp(data + 50000, read, 100) == 0);
+    REQUIRE(f_tell(&file) == FF_MAX_SS);
+    fr_result = f_lseek(&file, FF_MAX_SS - 100);
+    REQUIRE(fr_result == FR_OK);
+    fr_result = f_read(&file, read, 200, &bw);
+    REQUIRE(fr_result == FR_OK);
+    REQUIRE(bw == 200);
+    REQUIRE(memcmp(data + FF_MAX_SS - 100, read, 200) == 0);
+
+    // Data written with f_pwrite is there after reopening the file
+    fr_result = f_close(&file);
+    REQUIRE(fr_result == FR_OK);
+    fr_result = f_open(&file, path, FA_READ);
+    REQUIRE(fr_result == FR_OK);
+    fr_result = f_read(&file, read, data_size, &bw);
+    REQUIRE(fr_result == FR_OK);
+    REQUIRE(bw == data_size);
+    REQUIRE(memcmp(data, read, data_size) == 0);
+
+    fr_result = f_close(&file);
+    REQUIRE(fr_result == FR_OK);
+
+    fr_result = f_mount(0, drv, 0);
+    REQUIRE(fr_result == FR_OK);
+
+    ff_diskio_unregister(pdrv);
+    esp_result = wl_unmount(wl_handle);
+    REQUIRE(esp_result == ESP_OK);
+
+    free(read);
+    free(data);
+}
+
+TEST_CASE("large reads of contiguous and fragmented files, with and without CLMT", "[fatfs]")
+{
+    BYTE pdrv;
+    wl_handle_t wl_handle;
+    FATFS fs;
+    FIL file;
+    UINT br;
+    char drv[3];
+
+    mount_counting_volume(&pdrv, &wl_handle, &fs, drv);
+
+    const UINT cluster_size = fs.csize * fs.ssize;
+    const uint32_t size = 32 * cluster_size;
+    const uint32_t clusters = size / cluster_size;
+    char *data = (char*) malloc(size);
+    char *data_frag = (char*) malloc(size);
+    char *read = (char*) malloc(size);
+    // Each fragmented file has one fragment per cluster
+    const DWORD clmt_size = 2 * clusters + 2;
+    DWORD *clmt = (DWORD*) malloc(clmt_size * sizeof(DWORD));
+
+    create_test_files(drv, size, cluster_size, data, data_frag);
+
+    for (int use_clmt = 0; use_clmt <= 1; ++use_clmt) {
+        // Contiguous file is read with a single data read, plus a FAT read at most
+        open_test_file(&file, drv, "cont.bin", use_clmt ? clmt : NULL, clmt_size);
+        if (use_clmt) {
+            REQUIRE(clmt[0] == 4);
+        }
+        memset(read, 0, size);
+        s_disk_reads = 0;
+        REQUIRE(f_read(&file, read, size, &br) == FR_OK);
+        REQUIRE(br == size);
+        CHECK(s_disk_reads <= 2);
+        REQUIRE(memcmp(data, read, size) == 0);
+
+        // Unaligned start and length, then continue reading from a cluster in the middle of the file
+        REQUIRE(f_lseek(&file, 100) == FR_OK);
+        REQUIRE(f_read(&file, read, 5 * cluster_size + 300, &br) == FR_OK);
+        REQUIRE(br == 5 * cluster_size + 300);
+        REQUIRE(memcmp(data + 100, read, br) == 0);
+        REQUIRE(f_read(&file, read, 3 * cluster_size, &br) == FR_OK);
+        REQUIRE(br == 3 * cluster_size);
+        REQUIRE(memcmp(data + 5 * cluster_size + 400, read, br) == 0);
+        REQUIRE(f_close(&file) == FR_OK);
+
+        // Fragmented file must not be read across fragments
+        open_test_file(&file, drv, "frag0.bin", use_clmt ? clmt : NULL, clmt_size);
+        if (use_clmt) {
+            REQUIRE(clmt[0] == clmt_size);
+        }
+        memset(read, 0, size);
+        REQUIRE(f_read(&file, read, size, &br) == FR_OK);
+        REQUIRE(br == size);
+        REQUIRE(memcmp(data_frag, read, size) == 0);
+
+        // Seek backwards to random positions
+        srand(12345);
+        for (int i = 0; i < 64; ++i) {
+            const uint32_t ofs = rand() % size;
+            const uint32_t max_len = rand() % (3 * cluster_size);
+            const uint32_t len = MIN(size - ofs, max_len);
+            REQUIRE(f_lseek(&file, ofs) == FR_OK);
+            REQUIRE(f_read(&file, read, len, &br) == FR_OK);
+            REQUIRE(br == len);
+            REQUIRE(memcmp(data_frag + ofs, read, len) == 0);
+        }
+        REQUIRE(f_close(&file) == FR_OK);
+    }
+
+    unmount_counting_volume(pdrv, wl_handle, drv);
+
+    free(clmt);
+    free(read);
+    free(data_frag);
+    free(data);
+}
+
+/* Hidden benchmark of sequential and random reads of a contiguous and a fragmented file.
+ * Reading the fragmented file cluster by cluster is what FatFs did for any file before
+ * contiguous clusters were read at once. The estimated flash time assumes a fixed cost of
+ * each read call (SPI transaction setup and wear levelling address translation) and reading
+ * at 40 MHz QIO. */
+TEST_CASE("read throughput benchmark", "[fatfs][benchmark][.]")
+{
+    const double call_time_us = 30.0;
+    const double read_time_us_per_byte = 1.0 / 20;
+    const UINT seq_chunk = 32 * 1024;
+    const UINT random_chunk = 4 * 1024;
+    const int random_reads = 256;
+
+    BYTE pdrv;
+    wl_handle_t wl_handle;
+    FATFS fs;
+    FIL file;
+    UINT br;
+    char drv[3];
+
+    mount_counting_volume(&pdrv, &wl_handle, &fs, drv);
+
+    const UINT cluster_size = fs.csize * fs.ssize;
+    const uint32_t size = 48 * cluster_size;
+    char *data = (char*) malloc(size);
+    char *data_frag = (char*) malloc(size);
+    char *read = (char*) malloc(seq_chunk);
+    const DWORD clmt_size = 2 * (size / cluster_size) + 2;
+    DWORD *clmt = (DWORD*) malloc(clmt_size * sizeof(DWORD));
+
+    create_test_files(drv, size, cluster_size, data, data_frag);
+
+    for (const char *name : { "cont.bin", "frag0.bin" }) {
+        const char *expected = (strcmp(name, "cont.bin") == 0) ? data : data_frag;
+        for (int use_clmt = 0; use_clmt <= 1; ++use_clmt) {
+            for (int random = 0; random <= 1; ++random) {
+                open_test_file(&file, drv, name, use_clmt ? clmt : NULL, clmt_size);
+                s_disk_reads = 0;
+                s_sectors_read = 0;
+                size_t total = 0;
+                clock_t start = clock();
+                if (!random) {
+                    for (uint32_t ofs = 0; ofs < size; ofs += seq_chunk) {
+                        REQUIRE(f_read(&file, read, seq_chunk, &br) == FR_OK);
+                        REQUIRE(memcmp(expected + ofs, read, br) == 0);
+                        total += br;
+                    }
+                } else {
+                    srand(1);
+                    for (int i = 0; i < random_reads; ++i) {
+                        const uint32_t ofs = rand() % (size - random_chunk);
+                        REQUIRE(f_lseek(&file, ofs) == FR_OK);
+                        REQUIRE(f_read(&file, read, random_chunk, &br) == FR_OK);
+                        REQUIRE(memcmp(expected + ofs, read, br) == 0);
+                        total += br;
+                    }
+                }
+                double cpu_time_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+                REQUIRE(f_close(&file) == FR_OK);
+
+                double mb = (double) total / (1024 * 1024);
+                double flash_time_s = (s_disk_reads * call_time_us + s_sectors_read * fs.ssize * read_time_us_per_byte) / 1000000;
+                printf("%-9s %-4s %-10s: %6.0f disk reads/MB, %6.0f KB read from disk/MB, estimated flash %6.2f MB/s, host %7.1f MB/s\n",
+                       name, use_clmt ? "CLMT" : "FAT", random ? "random" : "sequential",
+                       s_disk_reads / mb, s_sectors_read * fs.ssize / 1024 / mb,
+                       mb / flash_time_s, cpu_time_s > 0 ? mb / cpu_time_s : 0.0);
+            }
+        }
+    }
+
+    unmount_counting_volume(pdrv, wl_handle, drv);
+
+    free(clmt);
+    free(read);
+    free(data_frag);
+    free(data);
+}
+
+/* Readers of different files only hold the volume lock while they look up the clusters, the data
+ * sectors are read while other readers use the volume. Reports the throughput of one reader and of
+ * several, with the flash read time emulated by the disk I/O driver. */
+TEST_CASE("concurrent readers of different files overlap their data reads", "[fatfs]")
+{
+    const int max_readers = 4;
+    const UINT chunk = 4 * FF_MAX_SS;
+
+    BYTE pdrv;
+    wl_handle_t wl_handle;
+    FATFS fs;
+    char drv[3];
+    char path[16];
+
+    mount_counting_volume(&pdrv, &wl_handle, &fs, drv, &s_slow_wl_impl);
+
+    const UINT cluster_size = fs.csize * fs.ssize;
+    const uint32_t size = 16 * cluster_size;
+    std::vector<std::vector<char>> data(max_readers, std::vector<char>(size));
+    for (int i = 0; i < max_readers; ++i) {
+        FIL file;
+        UINT bw;
+        fill_file_data(data[i].data(), size, i * 0x01010101);
+        snprintf(path, sizeof(path), "%s/r%d.bin", drv, i);
+        REQUIRE(f_open(&file, path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+        REQUIRE(f_write(&file, data[i].data(), size, &bw) == FR_OK);
+        REQUIRE(bw == size);
+        REQUIRE(f_close(&file) == FR_OK);
+    }
+
+    for (int readers = 1; readers <= max_readers; readers *= 2) {
+        // Catch assertions can't be used from other threads, so the readers count their failures
+        std::atomic<int> errors(0);
+        std::vector<std::thread> threads;
+        s_max_reads_in_progress = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < readers; ++i) {
+            threads.emplace_back([&, i]() {
+                char path[16];
+                std::vector<char> read(chunk);
+                FIL file;
+                UINT br;
+                snprintf(path, sizeof(path), "%s/r%d.bin", drv, i);
+                if (f_open(&file, path, FA_READ) != FR_OK) {
+                    ++errors;
+                    return;
+                }
+                for (uint32_t ofs = 0; ofs < size; ofs += chunk) {
+                    if (f_read(&file, read.data(), chunk, &br) != FR_OK || br != chunk ||
+                            memcmp(&data[i][ofs], read.data(), chunk) != 0) {
+                        ++errors;
+                        break;
+                    }
+                }
+                if (f_close(&file) != FR_OK) {
+                    ++errors;
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        REQUIRE(errors == 0);
+
+        printf("%d reader(s): %6.2f MB/s in total, at most %d disk reads at once\n",
+               readers, readers * size / (1024.0 * 1024) / seconds, (int) s_max_reads_in_progress);
+        if (readers > 1) {
+            CHECK(s_max_reads_in_progress > 1);
+        }
+    }
+
+    unmount_counting_volume(pdrv, wl_handle, drv);
+}
+
+/* Closing a file must not free its slot in the VFS driver before it has cleaned it up, otherwise
+ * a concurrent open() can get the slot and have its file object cleared. open() takes the first
+ * free slot, so a thread reopening its file picks the other thread's slot while it is closed. */
+TEST_CASE("files can be opened and closed from several threads through the VFS", "[fatfs]")
+{
+    const int threads_count = 2;
+    const int iterations = 100000;
+    const uint32_t size = 2 * FF_MAX_SS;
+
+    BYTE pdrv;
+    wl_handle_t wl_handle;
+    FATFS fs;
+    FATFS *vfs_fs;
+    char drv[3];
+    char path[16];
+
+    mount_counting_volume(&pdrv, &wl_handle, &fs, drv);
+
+    std::vector<std::vector<char>> data(threads_count, std::vector<char>(size));
+    for (int i = 0; i < threads_count; ++i) {
+        FIL file;
+        UINT bw;
+        fill_file_data(data[i].data(), size, i * 0x01010101);
+        snprintf(path, sizeof(path), "%s/o%d.bin", drv, i);
+        REQUIRE(f_open(&file, path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+        REQUIRE(f_write(&file, data[i].data(), size, &bw) == FR_OK);
+        REQUIRE(bw == size);
+        REQUIRE(f_close(&file) == FR_OK);
+    }
+
+    REQUIRE(esp_vfs_fat_register("/fat", drv, threads_count, &vfs_fs) == ESP_OK);
+    REQUIRE(f_mount(vfs_fs, drv, 1) == FR_OK);
+
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threads_count; ++i) {
+        threads.emplace_back([&, i]() {
+            char name[16];
+            std::vector<char> read(size);
+            snprintf(name, sizeof(name), "/o%d.bin", i);
+            for (int n = 0; n < iterations; ) {
+                int fd = s_vfs.open_p(s_vfs_ctx, name, O_RDONLY, 0);
+                if (fd < 0) {
+                    ++errors;
+                    return;
+                }
+                if (s_vfs.read_p(s_vfs_ctx, fd, read.data(), size) != (ssize_t) size ||
+                        memcmp(data[i].data(), read.data(), size) != 0) {
+                    ++errors;
+                }
+                if (s_vfs.close_p(s_vfs_ctx, fd) != 0) {
+                    ++errors;
+                }
+                ++n;
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    REQUIRE(errors == 0);
+
+    REQUIRE(esp_vfs_fat_unregister_path("/fat") == ESP_OK);
+    unmount_counting_volume(pdrv, wl_handle, drv);
+}
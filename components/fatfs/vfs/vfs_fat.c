@@ -24,18 +24,24 @@
 #include "ff.h"
 #include "diskio_impl.h"
 
+typedef struct {
+    _lock_t lock;   /* guard for access to the file; if ctx->lock is also needed, it is acquired after this one */
+    bool o_append;  /* O_APPEND is stored here (because O_APPEND is not compatible with FA_OPEN_APPEND) */
+} vfs_fat_file_t;
+
 typedef struct {
     char fat_drive[8];  /* FAT drive name */
     char base_path[ESP_VFS_PATH_MAX];   /* base path in VFS where partition is registered */
     size_t max_files;   /* max number of simultaneously open files; size of files[] array */
-    _lock_t lock;       /* guard for access to this structure */
+    _lock_t lock;       /* guard for access to this structure and for operations on paths; not held while accessing open files */
     FATFS fs;           /* fatfs library FS structure */
     char tmp_path_buf[FILENAME_MAX+3];  /* temporary buffer used to prepend drive name to the path */
     char tmp_path_buf2[FILENAME_MAX+3]; /* as above; used in functions which take two path arguments */
-    bool *o_append;  /* O_APPEND is stored here for each max_files entries (because O_APPEND is not compatible with FA_OPEN_APPEND) */
+    vfs_fat_file_t *file_info;  /* state of each of max_files entries, not covered by FIL */
     FIL files[0];   /* array with max_files entries; must be the final member of the structure */
 } vfs_fat_ctx_t;
 
+#ifdef CONFIG_VFS_SUPPORT_DIR
 typedef struct {
     DIR dir;
     long offset;
@@ -43,6 +49,7 @@ typedef struct {
     FILINFO filinfo;
     struct dirent cur_dirent;
 } vfs_fat_dir_t;
+#endif // CONFIG_VFS_SUPPORT_DIR
 
 /* Date and time storage formats in FAT */
 typedef union {
@@ -163,24 +170,27 @@ esp_err_t esp_vfs_fat_register(const char* base_path, const char* fat_drive, siz
         return ESP_ERR_NO_MEM;
     }
     memset(fat_ctx, 0, ctx_size);
-    fat_ctx->o_append = ff_memalloc(max_files * sizeof(bool));
-    if (fat_ctx->o_append == NULL) {
+    fat_ctx->file_info = ff_memalloc(max_files * sizeof(vfs_fat_file_t));
+    if (fat_ctx->file_info == NULL) {
         free(fat_ctx);
         return ESP_ERR_NO_MEM;
     }
-    memset(fat_ctx->o_append, 0, max_files * sizeof(bool));
+    memset(fat_ctx->file_info, 0, max_files * sizeof(vfs_fat_file_t));
     fat_ctx->max_files = max_files;
     strlcpy(fat_ctx->fat_drive, fat_drive, sizeof(fat_ctx->fat_drive) - 1);
     strlcpy(fat_ctx->base_path, base_path, sizeof(fat_ctx->base_path) - 1);
 
     esp_err_t err = esp_vfs_register(base_path, &vfs, fat_ctx);
     if (err != ESP_OK) {
-        free(fat_ctx->o_append);
+        free(fat_ctx->file_info);
         free(fat_ctx);
         return err;
     }
 
     _lock_init(&fat_ctx->lock);
+    for (size_t i = 0; i < max_files; ++i) {
+        _lock_init(&fat_ctx->file_info[i].lock);
+    }
     s_fat_ctxs[ctx] = fat_ctx;
 
     //compatibility
@@ -203,7 +213,10 @@ esp_err_t esp_vfs_fat_unregister_path(const char* base_path)
         return err;
     }
     _lock_close(&fat_ctx->lock);
-    free(fat_ctx->o_append);
+    for (size_t i = 0; i < fat_ctx->max_files; ++i) {
+        _lock_close(&fat_ctx->file_info[i].lock);
+    }
+    free(fat_ctx->file_info);
     free(fat_ctx);
     s_fat_ctxs[ctx] = NULL;
     return ESP_OK;
@@ -272,9 +285,39 @@ static int fresult_to_errno(FRESULT fr)
 
 static void file_cleanup(vfs_fat_ctx_t* ctx, int fd)
 {
+#if FF_USE_FASTSEEK
+    free(ctx->files[fd].cltbl);
+#endif
     memset(&ctx->files[fd], 0, sizeof(FIL));
 }
 
+#if FF_USE_FASTSEEK
+/**
+ * @brief Attach a cluster link map table to a file opened for reading
+ * With the table, FatFs finds the cluster for any offset without following
+ * the cluster chain in the FAT, and f_read can tell how far the file is
+ * contiguous. If the table can't be allocated or the file has too many
+ * fragments, the file is used without it.
+ * @param file file object, just opened
+ */
+static void file_fast_seek_init(FIL* file)
+{
+    DWORD* clmt = ff_memalloc(CONFIG_FATFS_FAST_SEEK_BUFFER_SIZE * sizeof(DWORD));
+    if (clmt == NULL) {
+        ESP_LOGD(TAG, "%s: no memory for CLMT", __func__);
+        return;
+    }
+    clmt[0] = CONFIG_FATFS_FAST_SEEK_BUFFER_SIZE;
+    file->cltbl = clmt;
+    FRESULT res = f_lseek(file, CREATE_LINKMAP);
+    if (res != FR_OK) {
+        ESP_LOGD(TAG, "%s: fresult=%d, using file without CLMT", __func__, res);
+        file->cltbl = NULL;
+        free(clmt);
+    }
+}
+#endif // FF_USE_FASTSEEK
+
 /**
  * @brief Prepend drive letters to path names
  * This function returns new path path pointers, pointing to a temporary buffer
@@ -321,7 +364,13 @@ static int vfs_fat_open(void* ctx, const char * path, int flags, int mode)
     // Other VFS drivers handles O_APPEND well (to the best of my knowledge),
     // therefore this flag is stored here (at this VFS level) in order to save
     // memory.
-    fat_ctx->o_append[fd] = (flags & O_APPEND) == O_APPEND;
+    fat_ctx->file_info[fd].o_append = (flags & O_APPEND) == O_APPEND;
+#if FF_USE_FASTSEEK
+    // FatFs can't extend a file in fast seek mode, so only read-only files use it
+    if ((flags & O_ACCMODE) == O_RDONLY) {
+        file_fast_seek_init(&fat_ctx->files[fd]);
+    }
+#endif
     _lock_release(&fat_ctx->lock);
     return fd;
 }
@@ -329,10 +378,13 @@ static int vfs_fat_open(void* ctx, const char * path, int flags, int mode)
 static ssize_t vfs_fat_write(void* ctx, int fd, const void * data, size_t size)
 {
     vfs_fat_ctx_t* fat_ctx = (vfs_fat_ctx_t*) ctx;
+    vfs_fat_file_t* info = &fat_ctx->file_info[fd];
     FIL* file = &fat_ctx->files[fd];
     FRESULT res;
-    if (fat_ctx->o_append[fd]) {
+    _lock_acquire(&info->lock);
+    if (info->o_append) {
         if ((res = f_lseek(file, f_size(file))) != FR_OK) {
+            _lock_release(&info->lock);
             ESP_LOGD(TAG, "%s: fresult=%d", __func__, res);
             errno = fresult_to_errno(res);
             return -1;
@@ -340,6 +392,7 @@ static ssize_t vfs_fat_write(void* ctx, int fd, const void * data, size_t size)
     }
     unsigned written = 0;
     res = f_write(file, data, size, &written);
+    _lock_release(&info->lock);
     if (res != FR_OK) {
         ESP_LOGD(TAG, "%s: fresult=%d", __func__, res);
         errno = fresult_to_errno(res);
@@ -353,9 +406,12 @@ static ssize_t vfs_fat_write(void* ctx, int fd, const void * data, size_t size)
 static ssize_t vfs_fat_read(void* ctx, int fd, void * dst, size_t size)
 {
     vfs_fat_ctx_t* fat_ctx = (vfs_fat_ctx_t*) ctx;
+    vfs_fat_file_t* info = &fat_ctx->file_info[fd];
     FIL* file = &fat_ctx->files[fd];
     unsigned read = 0;
+    _lock_acquire(&info->lock);
     FRESULT res = f_read(file, dst, size, &read);
+    _lock_release(&info->lock);
     if (res != FR_OK) {
         ESP_LOGD(TAG, "%s: fresult=%d", __func__, res);
         errno = fresult_to_errno(res);
@@ -368,89 +424,46 @@ static ssize_t vfs_fat_read(void* ctx, int fd, void * dst, size_t size)
 
 static ssize_t vfs_fat_pread(void *ctx, int fd, void *dst, size_t size, off_t offset)
 {
-    ssize_t ret = -1;
     vfs_fat_ctx_t *fat_ctx = (vfs_fat_ctx_t *) ctx;
-    _lock_acquire(&fat_ctx->lock);
+    vfs_fat_file_t *info = &fat_ctx->file_info[fd];
     FIL *file = &fat_ctx->files[fd];
-    const off_t prev_pos = f_tell(file);
-
-    FRESULT f_res = f_lseek(file, offset);
-    if (f_res != FR_OK) {
-        ESP_LOGD(TAG, "%s: fresult=%d", __func__, f_res);
-        errno = fresult_to_errno(f_res);
-        goto pread_release;
-    }
-
     unsigned read = 0;
-    f_res = f_read(file, dst, size, &read);
-    if (f_res == FR_OK) {
-        ret = read;
-    } else {
-        ESP_LOGD(TAG, "%s: fresult=%d", __func__, f_res);
-        errno = fresult_to_errno(f_res);
-        // No return yet - need to restore previous position
-    }
-
-    f_res = f_lseek(file, prev_pos);
+    _lock_acquire(&info->lock);
+    FRESULT f_res = f_pread(file, dst, size, offset, &read);
+    _lock_release(&info->lock);
     if (f_res != FR_OK) {
         ESP_LOGD(TAG, "%s: fresult=%d", __func__, f_res);
-        if (ret >= 0) {
-            errno = fresult_to_errno(f_res);
-        } // else f_read failed so errno shouldn't be overwritten
-        ret = -1; // in case the read was successful but the seek wasn't
+        errno = fresult_to_errno(f_res);
+        return -1;
     }
-
-pread_release:
-    _lock_release(&fat_ctx->lock);
-    return ret;
+    return read;
 }
 
 static ssize_t vfs_fat_pwrite(void *ctx, int fd, const void *src, size_t size, off_t offset)
 {
-    ssize_t ret = -1;
     vfs_fat_ctx_t *fat_ctx = (vfs_fat_ctx_t *) ctx;
-    _lock_acquire(&fat_ctx->lock);
+    vfs_fat_file_t *info = &fat_ctx->file_info[fd];
     FIL *file = &fat_ctx->files[fd];
-    const off_t prev_pos = f_tell(file);
-
-    FRESULT f_res = f_lseek(file, offset);
-    if (f_res != FR_OK) {
-        ESP_LOGD(TAG, "%s: fresult=%d", __func__, f_res);
-        errno = fresult_to_errno(f_res);
-        goto pwrite_release;
-    }
-
     unsigned wr = 0;
-    f_res = f_write(file, src, size, &wr);
-    if (f_res == FR_OK) {
-        ret = wr;
-    } else {
-        ESP_LOGD(TAG, "%s: fresult=%d", __func__, f_res);
-        errno = fresult_to_errno(f_res);
-        // No return yet - need to restore previous position
-    }
-
-    f_res = f_lseek(file, prev_pos);
+    _lock_acquire(&info->lock);
+    FRESULT f_res = f_pwrite(file, src, size, offset, &wr);
+    _lock_release(&info->lock);
     if (f_res != FR_OK) {
         ESP_LOGD(TAG, "%s: fresult=%d", __func__, f_res);
-        if (ret >= 0) {
-            errno = fresult_to_errno(f_res);
-        } // else f_write failed so errno shouldn't be overwritten
-        ret = -1; // in case the write was successful but the seek wasn't
+        errno = fresult_to_errno(f_res);
+        return -1;
     }
-
-pwrite_release:
-    _lock_release(&fat_ctx->lock);
-    return ret;
+    return wr;
 }
 
 static int vfs_fat_fsync(void* ctx, int fd)
 {
     vfs_fat_ctx_t* fat_ctx = (vfs_fat_ctx_t*) ctx;
-    _lock_acquire(&fat_ctx->lock);
+    vfs_fat_file_t* info = &fat_ctx->file_info[fd];
+    _lock_acquire(&info->lock);
     FIL* file = &fat_ctx->files[fd];
     FRESULT res = f_sync(file);
-    _lock_release(&fat_ctx->lock);
+    _lock_release(&info->lock);
     int rc = 0;
     if (res != FR_OK) {
         ESP_LOGD(TAG, "%s: fresult=%d", __func__, res);
@@ -463,11 +476,16 @@ static int vfs_fat_fsync(void* ctx, int fd)
 static int vfs_fat_close(void* ctx, int fd)
 {
     vfs_fat_ctx_t* fat_ctx = (vfs_fat_ctx_t*) ctx;
+    vfs_fat_file_t* info = &fat_ctx->file_info[fd];
+    _lock_acquire(&info->lock);
+    // f_close marks the slot as free, so vfs_fat_open must not see it until
+    // file_cleanup has run
     _lock_acquire(&fat_ctx->lock);
     FIL* file = &fat_ctx->files[fd];
     FRESULT res = f_close(file);
     file_cleanup(fat_ctx, fd);
     _lock_release(&fat_ctx->lock);
+    _lock_release(&info->lock);
     int rc = 0;
     if (res != FR_OK) {
         ESP_LOGD(TAG, "%s: fresult=%d", __func__, res);
@@ -480,8 +498,10 @@ static int vfs_fat_close(void* ctx, int fd)
 static off_t vfs_fat_lseek(void* ctx, int fd, off_t offset, int mode)
 {
     vfs_fat_ctx_t* fat_ctx = (vfs_fat_ctx_t*) ctx;
+    vfs_fat_file_t* info = &fat_ctx->file_info[fd];
     FIL* file = &fat_ctx->files[fd];
     off_t new_pos;
+    _lock_acquire(&info->lock);
     if (mode == SEEK_SET) {
         new_pos = offset;
     } else if (mode == SEEK_CUR) {
@@ -491,10 +511,12 @@ static off_t vfs_fat_lseek(void* ctx, int fd, off_t offset, int mode)
         off_t size = f_size(file);
         new_pos = size + offset;
     } else {
+        _lock_release(&info->lock);
         errno = EINVAL;
         return -1;
     }
     FRESULT res = f_lseek(file, new_pos);
+    _lock_release(&info->lock);
     if (res != FR_OK) {
         ESP_LOGD(TAG, "%s: fresult=%d", __func__, res);
         errno = fresult_to_errno(res);
@@ -506,8 +528,11 @@ static off_t vfs_fat_lseek(void* ctx, int fd, off_t offset, int mode)
 static int vfs_fat_fstat(void* ctx, int fd, struct stat * st)
 {
     vfs_fat_ctx_t* fat_ctx = (vfs_fat_ctx_t*) ctx;
+    vfs_fat_file_t* info = &fat_ctx->file_info[fd];
     FIL* file = &fat_ctx->files[fd];
+    _lock_acquire(&info->lock);
     st->st_size = f_size(file);
+    _lock_release(&info->lock);
     st->st_mode = S_IRWXU | S_IRWXG | S_IRWXO | S_IFREG;
     st->st_mtime = 0;
     st->st_atime = 0;
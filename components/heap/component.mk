@@ -2,7 +2,17 @@
 # Component Makefile
 #
 
-COMPONENT_OBJS := heap_caps_init.o heap_caps.o multi_heap.o
+COMPONENT_OBJS := heap_caps_init.o heap_caps.o heap_pool.o multi_heap_pool.o
+
+ifdef CONFIG_HEAP_ALLOCATOR_TLSF
+COMPONENT_OBJS += multi_heap_tlsf.o
+else
+COMPONENT_OBJS += multi_heap.o
+endif
+
+ifdef CONFIG_HEAP_CACHE
+COMPONENT_OBJS += multi_heap_cache.o
+endif
 
 ifndef CONFIG_HEAP_POISONING_DISABLED
 COMPONENT_OBJS += multi_heap_poisoning.o
@@ -84,6 +84,44 @@ bool heap_caps_match(const heap_t *heap, uint32_t caps)
     return heap->heap != NULL && ((get_all_caps(heap) & caps) == caps);
 }
 
+#ifdef CONFIG_HEAP_CACHE
+/* Return the blocks held in all small object caches to their heaps.
+
+   Returns true if there was anything to return.
+*/
+IRAM_ATTR static bool flush_heap_caches(void)
+{
+    bool flushed = false;
+    heap_t *heap;
+    SLIST_FOREACH(heap, &registered_heaps, next) {
+        if (heap->cache != NULL && multi_heap_cache_get_info(heap->cache, NULL) > 0) {
+            multi_heap_cache_flush(heap->cache);
+            flushed = true;
+        }
+    }
+    return flushed;
+}
+#endif
+
+/* Return the blocks held in the small object cache of a heap to the heap. Freeing a
+   block may merge it with its neighbours, so the free size of a heap is only exact
+   when its cache is empty. */
+static inline void flush_heap_cache(heap_t *heap)
+{
+#ifdef CONFIG_HEAP_CACHE
+    if (heap->cache != NULL) {
+        multi_heap_cache_flush(heap->cache);
+    }
+#endif
+}
+
+/* Get info for a single heap, with the blocks held in its small object cache freed */
+static void get_heap_info(heap_t *heap, multi_heap_info_t *info)
+{
+    flush_heap_cache(heap);
+    multi_heap_get_info(heap->heap, info);
+}
+
 /*
 Routine to allocate a bit of memory with certain capabilities. caps is a bitfield of MALLOC_CAP_* bits.
 */
@@ -119,6 +157,12 @@ IRAM_ATTR void *heap_caps_malloc( size_t size, uint32_t caps )
         size = (size + 3) & (~3); // int overflow checked above
     }
 
+#ifdef CONFIG_HEAP_CACHE
+    //Small requests which can be satisfied by any internal 8/32-bit RAM are served from the per-core caches
+    bool use_cache = (size <= MULTI_HEAP_CACHE_MAX_SIZE) && ((caps & ~HEAP_CACHE_CAPS) == 0);
+    bool caches_flushed = false;
+ retry:
+#endif
     for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
         //Iterate over heaps and check capabilities at this priority
         heap_t *heap;
@@ -142,7 +186,15 @@ IRAM_ATTR void *heap_caps_malloc( size_t size, uint32_t caps )
                         }
                     } else {
                         //Just try to alloc, nothing special.
+#ifdef CONFIG_HEAP_CACHE
+                        if (use_cache && heap->cache != NULL) {
+                            ret = multi_heap_cache_malloc(heap->cache, size);
+                        } else {
+                            ret = multi_heap_malloc(heap->heap, size);
+                        }
+#else
                         ret = multi_heap_malloc(heap->heap, size);
+#endif
                         if (ret != NULL) {
                             return ret;
                         }
@@ -152,6 +204,16 @@ IRAM_ATTR void *heap_caps_malloc( size_t size, uint32_t caps )
         }
     }
 
+#ifdef CONFIG_HEAP_CACHE
+    //The free memory needed may be held in the small object caches, return it to the heaps and try again
+    if (!caches_flushed) {
+        caches_flushed = true;
+        if (flush_heap_caches()) {
+            goto retry;
+        }
+    }
+#endif
+
     heap_caps_alloc_failed(size, caps, __func__);
 
     //Nothing usable found.
@@ -302,6 +364,11 @@ IRAM_ATTR void heap_caps_free( void *ptr)
 
     heap_t *heap = find_containing_heap(ptr);
     assert(heap != NULL && "free() target pointer is outside heap areas");
+#ifdef CONFIG_HEAP_CACHE
+    if (heap->cache != NULL && multi_heap_cache_free(heap->cache, ptr)) {
+        return;
+    }
+#endif
     multi_heap_free(heap->heap, ptr);
 }
 
@@ -417,6 +484,7 @@ size_t heap_caps_get_free_size( uint32_t caps )
     heap_t *heap;
     SLIST_FOREACH(heap, &registered_heaps, next) {
         if (heap_caps_match(heap, caps)) {
+            flush_heap_cache(heap);
             ret += multi_heap_free_size(heap->heap);
         }
     }
@@ -450,7 +518,7 @@ void heap_caps_get_info( multi_heap_info_t *info, uint32_t caps )
     SLIST_FOREACH(heap, &registered_heaps, next) {
         if (heap_caps_match(heap, caps)) {
             multi_heap_info_t hinfo;
-            multi_heap_get_info(heap->heap, &hinfo);
+            get_heap_info(heap, &hinfo);
 
             info->total_free_bytes += hinfo.total_free_bytes;
             info->total_allocated_bytes += hinfo.total_allocated_bytes;
@@ -471,7 +539,7 @@ void heap_caps_print_heap_info( uint32_t caps )
     heap_t *heap;
     SLIST_FOREACH(heap, &registered_heaps, next) {
         if (heap_caps_match(heap, caps)) {
-            multi_heap_get_info(heap->heap, &info);
+            get_heap_info(heap, &info);
 
             printf("  At 0x%08x len %d free %d allocated %d min_free %d\n",
                    heap->start, heap->end - heap->start, info.total_free_bytes, info.total_allocated_bytes, info.minimum_free_bytes);
@@ -484,6 +552,7 @@ void heap_caps_print_heap_info( uint32_t caps )
     heap_caps_get_info(&info, caps);
 
     printf("    free %d allocated %d min_free %d largest_free_block %d\n", info.total_free_bytes, info.total_allocated_bytes, info.minimum_free_bytes, info.largest_free_block);
+    heap_pool_print_info(caps);
 }
 
 bool heap_caps_check_integrity(uint32_t caps, bool print_errors)
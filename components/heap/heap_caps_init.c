@@ -37,6 +37,16 @@ static void register_heap(heap_t *region)
     }
 }
 
+/* Called once the heap's lock is set */
+static void create_heap_cache(heap_t *heap)
+{
+#ifdef CONFIG_HEAP_CACHE
+    if (heap_caps_match(heap, HEAP_CACHE_CAPS)) {
+        heap->cache = multi_heap_cache_create(heap->heap);
+    }
+#endif
+}
+
 void heap_caps_enable_nonos_stack_heaps(void)
 {
     heap_t *heap;
@@ -47,6 +57,7 @@ void heap_caps_enable_nonos_stack_heaps(void)
             register_heap(heap);
             if (heap->heap != NULL) {
                 multi_heap_set_lock(heap->heap, &heap->heap_mux);
+                create_heap_cache(heap);
             }
         }
     }
@@ -106,6 +117,9 @@ void heap_caps_init(void)
         heap->start = region->start;
         heap->end = region->start + region->size;
         MULTI_HEAP_LOCK_INIT(&heap->heap_mux);
+#ifdef CONFIG_HEAP_CACHE
+        heap->cache = NULL;
+#endif
         if (type->startup_stack) {
             /* Will be registered when OS scheduler starts */
             heap->heap = NULL;
@@ -143,6 +157,7 @@ void heap_caps_init(void)
     for (int i = 0; i < num_heaps; i++) {
         if (heaps_array[i].heap != NULL) {
             multi_heap_set_lock(heaps_array[i].heap, &heaps_array[i].heap_mux);
+            create_heap_cache(&heaps_array[i]);
         }
         if (i == 0) {
             SLIST_INSERT_HEAD(&registered_heaps, &heaps_array[0], next);
@@ -215,6 +230,9 @@ esp_err_t heap_caps_add_region_with_caps(const uint32_t caps[], intptr_t start,
     p_new->start = start;
     p_new->end = end;
     MULTI_HEAP_LOCK_INIT(&p_new->heap_mux);
+#ifdef CONFIG_HEAP_CACHE
+    p_new->cache = NULL;
+#endif
     p_new->heap = multi_heap_register((void *)start, end - start);
     SLIST_NEXT(p_new, next) = NULL;
     if (p_new->heap == NULL) {
@@ -222,6 +240,7 @@ esp_err_t heap_caps_add_region_with_caps(const uint32_t caps[], intptr_t start,
         goto done;
     }
     multi_heap_set_lock(p_new->heap, &p_new->heap_mux);
+    create_heap_cache(p_new);
 
     /* (This insertion is atomic to registered_heaps, so
        we don't need to worry about thread safety for readers,
@@ -0,0 +1,142 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <stdio.h>
+#include <sys/lock.h>
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_heap_pool.h"
+#include "heap_private.h"
+#include "multi_heap_pool.h"
+
+/*
+Object pools, allocated with heap_caps_malloc() and managed by multi_heap_pool.
+
+The pool bookkeeping (struct heap_pool) and the multi_heap_pool storage are allocated together.
+All pools are kept in a list, so heap_caps_print_heap_info() can report them.
+*/
+
+struct heap_pool {
+    multi_heap_pool_handle_t pool;
+    uint32_t flags;
+    multi_heap_lock_t lock;
+    SLIST_ENTRY(heap_pool) next;
+};
+
+static SLIST_HEAD(heap_pool_ll, heap_pool) registered_pools = SLIST_HEAD_INITIALIZER(registered_pools);
+
+/* Pools are only created, destroyed and listed from task context */
+static _lock_t registered_pools_lock;
+
+#ifdef MULTI_HEAP_FREERTOS
+#define ASSERT_CONTEXT_ALLOWED(POOL) assert(((POOL)->flags & HEAP_POOL_FLAG_ISR_SAFE) || !xPortInIsrContext())
+#else
+#define ASSERT_CONTEXT_ALLOWED(POOL)
+#endif
+
+heap_pool_handle_t heap_pool_create(size_t object_size, size_t num_objects, uint32_t caps, uint32_t flags)
+{
+    size_t storage_size = multi_heap_pool_storage_size(object_size, num_objects);
+    if (storage_size == 0 || num_objects == 0 || storage_size > HEAP_SIZE_MAX - sizeof(struct heap_pool)) {
+        return NULL;
+    }
+
+    if (flags & HEAP_POOL_FLAG_ISR_SAFE) {
+        //ISRs may run while the flash cache is disabled, so the objects can't be in external RAM
+        caps |= MALLOC_CAP_INTERNAL;
+    }
+
+    heap_pool_handle_t result = heap_caps_malloc(sizeof(struct heap_pool) + storage_size, caps);
+    if (result == NULL) {
+        return NULL;
+    }
+
+    result->pool = multi_heap_pool_init(result + 1, object_size, num_objects);
+    assert(result->pool != NULL);
+    result->flags = flags;
+    MULTI_HEAP_LOCK_INIT(&result->lock);
+    multi_heap_pool_set_lock(result->pool, &result->lock);
+
+    _lock_acquire(&registered_pools_lock);
+    SLIST_INSERT_HEAD(&registered_pools, result, next);
+    _lock_release(&registered_pools_lock);
+
+    return result;
+}
+
+void heap_pool_destroy(heap_pool_handle_t pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+
+    _lock_acquire(&registered_pools_lock);
+    SLIST_REMOVE(&registered_pools, pool, heap_pool, next);
+    _lock_release(&registered_pools_lock);
+
+    heap_caps_free(pool);
+}
+
+IRAM_ATTR void *heap_pool_alloc(heap_pool_handle_t pool)
+{
+    assert(pool != NULL);
+    ASSERT_CONTEXT_ALLOWED(pool);
+    return multi_heap_pool_alloc(pool->pool);
+}
+
+IRAM_ATTR void heap_pool_free(heap_pool_handle_t pool, void *ptr)
+{
+    assert(pool != NULL);
+    ASSERT_CONTEXT_ALLOWED(pool);
+    multi_heap_pool_free(pool->pool, ptr);
+}
+
+void heap_pool_get_info(heap_pool_handle_t pool, heap_pool_info_t *info)
+{
+    assert(pool != NULL && info != NULL);
+    multi_heap_pool_get_info(pool->pool, info);
+}
+
+void heap_pool_print_info(uint32_t caps)
+{
+    bool first = true;
+    heap_pool_info_t info;
+
+    _lock_acquire(&registered_pools_lock);
+    heap_pool_handle_t pool;
+    SLIST_FOREACH(pool, &registered_pools, next) {
+        /* Only report pools whose storage is in a heap with the requested capabilities */
+        heap_t *heap;
+        SLIST_FOREACH(heap, &registered_heaps, next) {
+            if ((intptr_t)pool >= heap->start && (intptr_t)pool < heap->end) {
+                break;
+            }
+        }
+        if (heap == NULL || !heap_caps_match(heap, caps)) {
+            continue;
+        }
+
+        if (first) {
+            printf("  Object pools:\n");
+            first = false;
+        }
+        multi_heap_pool_get_info(pool->pool, &info);
+        printf("    At %p object_size %d total %d free %d min_free %d failed_allocs %d\n",
+               pool, info.object_size, info.total_objects, info.free_objects,
+               info.minimum_free_objects, info.failed_allocs);
+    }
+    _lock_release(&registered_pools_lock);
+}
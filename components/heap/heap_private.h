@@ -19,6 +19,9 @@
 #include "multi_heap.h"
 #include "multi_heap_platform.h"
 #include "sys/queue.h"
+#ifdef CONFIG_HEAP_CACHE
+#include "multi_heap_cache.h"
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,9 +40,16 @@ typedef struct heap_t_ {
     intptr_t end;
     multi_heap_lock_t heap_mux;
     multi_heap_handle_t heap;
+#ifdef CONFIG_HEAP_CACHE
+    multi_heap_cache_t *cache; ///< Small object cache, only set for heaps matching HEAP_CACHE_CAPS
+#endif
     SLIST_ENTRY(heap_t_) next;
 } heap_t;
 
+/* Heaps matching these caps get a small object cache (CONFIG_HEAP_CACHE), and allocation
+   requests which only ask for a subset of these caps are served from the cache. */
+#define HEAP_CACHE_CAPS (MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT | MALLOC_CAP_32BIT)
+
 /* All registered heaps.
 
    Forms a single linked list, even though most entries are contiguous.
@@ -71,6 +81,9 @@ inline static IRAM_ATTR uint32_t get_all_caps(const heap_t *heap)
 void *heap_caps_realloc_default(void *p, size_t size);
 void *heap_caps_malloc_default(size_t size);
 
+/* Print statistics of the object pools allocated in heaps matching 'caps' (heap_pool.c) */
+void heap_pool_print_info(uint32_t caps);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,99 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Flags for heap_pool_create()
+ */
+#define HEAP_POOL_FLAG_ISR_SAFE     (1<<0)  ///< Pool can be used from ISRs. Its storage is always allocated in internal RAM.
+
+/**
+ * @brief Opaque handle to an object pool
+ */
+typedef struct heap_pool *heap_pool_handle_t;
+
+/**
+ * @brief Structure to access object pool statistics via heap_pool_get_info()
+ */
+typedef struct {
+    size_t object_size;           ///< Size of each object in the pool, after rounding up for alignment
+    size_t total_objects;         ///< Number of objects in the pool
+    size_t free_objects;          ///< Number of objects currently free
+    size_t minimum_free_objects;  ///< Lifetime minimum number of free objects
+    size_t failed_allocs;         ///< Number of heap_pool_alloc() calls which failed because the pool was empty
+} heap_pool_info_t;
+
+/**
+ * @brief Create a pool of fixed size objects
+ *
+ * All storage for the pool is allocated at once with heap_caps_malloc(). Allocating
+ * and freeing objects from the pool then takes constant time and has no per-object
+ * memory overhead.
+ *
+ * Object pools are thread safe. If HEAP_POOL_FLAG_ISR_SAFE is not set, they must not
+ * be used from interrupt handlers.
+ *
+ * @param object_size Size of each object, in bytes
+ * @param num_objects Number of objects in the pool
+ * @param caps Bitwise OR of MALLOC_CAP_* flags indicating the type of memory to allocate the pool storage from
+ * @param flags Bitwise OR of HEAP_POOL_FLAG_* flags
+ *
+ * @return Handle to the new pool, or NULL if the arguments are invalid or the storage could not be allocated
+ */
+heap_pool_handle_t heap_pool_create(size_t object_size, size_t num_objects, uint32_t caps, uint32_t flags);
+
+/**
+ * @brief Delete an object pool and free its storage
+ *
+ * All objects allocated from the pool become invalid.
+ *
+ * @param pool Pool handle, or NULL (in which case this function does nothing)
+ */
+void heap_pool_destroy(heap_pool_handle_t pool);
+
+/**
+ * @brief Allocate an object from a pool
+ *
+ * @param pool Pool handle
+ *
+ * @return Pointer to an object of the pool's object size, or NULL if all objects are in use
+ */
+void *heap_pool_alloc(heap_pool_handle_t pool);
+
+/**
+ * @brief Return an object to its pool
+ *
+ * @param pool Pool handle
+ * @param ptr Object allocated from this pool with heap_pool_alloc(), or NULL (in which case this function does nothing)
+ */
+void heap_pool_free(heap_pool_handle_t pool, void *ptr);
+
+/**
+ * @brief Get statistics for an object pool
+ *
+ * @param pool Pool handle
+ * @param info Pointer to a structure which will be filled with pool statistics
+ */
+void heap_pool_get_info(heap_pool_handle_t pool, heap_pool_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,196 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <multi_heap.h>
+#include "multi_heap_internal.h"
+#include "multi_heap_cache.h"
+
+/* Note: Keep platform-specific parts in this header, this source
+   file should depend on libc only */
+#include "multi_heap_platform.h"
+
+/* Defines compile-time configuration macros */
+#include "multi_heap_config.h"
+
+/* Size classes, all multiples of 16 so blocks are the same size for every
+   allocator implementation and poisoning level */
+static const uint16_t class_sizes[] = { 16, 32, 48, 64, 96, 128, 192, MULTI_HEAP_CACHE_MAX_SIZE };
+
+#define NUM_CLASSES (sizeof(class_sizes) / sizeof(class_sizes[0]))
+
+/* Number of blocks moved between a cache stack and the heap at once */
+#define BATCH_COUNT ((MULTI_HEAP_CACHE_DEPTH + 1) / 2)
+
+typedef struct {
+    multi_heap_lock_t lock;
+    uint8_t count[NUM_CLASSES];
+    void *blocks[NUM_CLASSES][MULTI_HEAP_CACHE_DEPTH];
+} cache_slot_t;
+
+struct multi_heap_cache {
+    multi_heap_handle_t heap;
+    cache_slot_t slots[MULTI_HEAP_NUM_CORES];
+};
+
+/* Return the index of the smallest size class which fits 'size', or -1 */
+static inline int size_class(size_t size)
+{
+    for (int i = 0; i < NUM_CLASSES; i++) {
+        if (size <= class_sizes[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+multi_heap_cache_t *multi_heap_cache_create(multi_heap_handle_t heap)
+{
+    multi_heap_cache_t *cache = multi_heap_malloc(heap, sizeof(multi_heap_cache_t));
+    if (cache == NULL) {
+        return NULL;
+    }
+    memset(cache, 0, sizeof(multi_heap_cache_t));
+    cache->heap = heap;
+    for (int i = 0; i < MULTI_HEAP_NUM_CORES; i++) {
+        MULTI_HEAP_LOCK_INIT(&cache->slots[i].lock);
+    }
+    return cache;
+}
+
+/* Allocate a batch of blocks for an empty stack, holding the heap lock once for the whole batch.
+
+   Returns the first block allocated, for the caller. Blocks which the heap didn't split to exactly
+   the class size (can happen when it's nearly full) are never cached, the free byte accounting
+   relies on every cached block being exactly its class size.
+
+   Called with the slot lock held.
+*/
+static void *refill(multi_heap_handle_t heap, cache_slot_t *slot, int cls)
+{
+    const size_t size = class_sizes[cls];
+    void *result;
+
+    multi_heap_internal_lock(heap);
+    result = multi_heap_malloc(heap, size);
+    for (int i = 0; result != NULL && i < BATCH_COUNT; i++) {
+        void *p = multi_heap_malloc(heap, size);
+        if (p == NULL) {
+            break;
+        }
+        if (multi_heap_get_allocated_size(heap, p) != size) {
+            multi_heap_free(heap, p);
+            break;
+        }
+        slot->blocks[cls][slot->count[cls]++] = p;
+    }
+    multi_heap_internal_unlock(heap);
+
+    return result;
+}
+
+/* Free the 'num' oldest blocks of a stack back to the heap. Called with the slot lock held. */
+static void flush_class(multi_heap_handle_t heap, cache_slot_t *slot, int cls, int num)
+{
+    void **blocks = slot->blocks[cls];
+
+    multi_heap_internal_lock(heap);
+    for (int i = 0; i < num; i++) {
+        multi_heap_free(heap, blocks[i]);
+    }
+    multi_heap_internal_unlock(heap);
+
+    slot->count[cls] -= num;
+    memmove(blocks, blocks + num, slot->count[cls] * sizeof(void *));
+}
+
+void *multi_heap_cache_malloc(multi_heap_cache_t *cache, size_t size)
+{
+    int cls = size_class(size);
+    if (size == 0 || cls < 0) {
+        return NULL;
+    }
+
+    cache_slot_t *slot = &cache->slots[MULTI_HEAP_CURRENT_CORE()];
+    void *result;
+
+    MULTI_HEAP_LOCK(&slot->lock);
+    if (slot->count[cls] > 0) {
+        result = slot->blocks[cls][--slot->count[cls]];
+    } else {
+        result = refill(cache->heap, slot, cls);
+    }
+    MULTI_HEAP_UNLOCK(&slot->lock);
+
+    return result;
+}
+
+bool multi_heap_cache_free(multi_heap_cache_t *cache, void *p)
+{
+    size_t size = multi_heap_get_allocated_size(cache->heap, p);
+    int cls = size_class(size);
+    if (cls < 0 || class_sizes[cls] != size) {
+        return false;
+    }
+
+    cache_slot_t *slot = &cache->slots[MULTI_HEAP_CURRENT_CORE()];
+
+    MULTI_HEAP_LOCK(&slot->lock);
+    if (slot->count[cls] == MULTI_HEAP_CACHE_DEPTH) {
+        flush_class(cache->heap, slot, cls, BATCH_COUNT);
+    }
+    slot->blocks[cls][slot->count[cls]++] = p;
+    MULTI_HEAP_UNLOCK(&slot->lock);
+
+    return true;
+}
+
+void multi_heap_cache_flush(multi_heap_cache_t *cache)
+{
+    for (int i = 0; i < MULTI_HEAP_NUM_CORES; i++) {
+        cache_slot_t *slot = &cache->slots[i];
+        MULTI_HEAP_LOCK(&slot->lock);
+        for (int cls = 0; cls < NUM_CLASSES; cls++) {
+            if (slot->count[cls] > 0) {
+                flush_class(cache->heap, slot, cls, slot->count[cls]);
+            }
+        }
+        MULTI_HEAP_UNLOCK(&slot->lock);
+    }
+}
+
+size_t multi_heap_cache_get_info(multi_heap_cache_t *cache, size_t *cached_blocks)
+{
+    size_t bytes = 0;
+    size_t blocks = 0;
+
+    for (int i = 0; i < MULTI_HEAP_NUM_CORES; i++) {
+        cache_slot_t *slot = &cache->slots[i];
+        MULTI_HEAP_LOCK(&slot->lock);
+        for (int cls = 0; cls < NUM_CLASSES; cls++) {
+            bytes += slot->count[cls] * class_sizes[cls];
+            blocks += slot->count[cls];
+        }
+        MULTI_HEAP_UNLOCK(&slot->lock);
+    }
+
+    if (cached_blocks != NULL) {
+        *cached_blocks = blocks;
+    }
+    return bytes;
+}
@@ -0,0 +1,78 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "multi_heap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Per-core small object cache ("magazines") in front of a multi_heap.
+
+   Each core has its own set of LIFO stacks of free blocks, one stack per size class
+   (16 to MULTI_HEAP_CACHE_MAX_SIZE bytes.) Allocations and frees of small blocks
+   only take the lock of the current core's stacks, the heap lock is only taken
+   to refill an empty stack or to flush a full one, in batches.
+
+   Blocks held in a cache are allocated blocks as far as the underlying heap is concerned.
+   Their headers and merging with neighbouring free blocks make the difference to the
+   heap's free size larger than the cached bytes, flush the cache to get exact numbers.
+*/
+
+/* Largest allocation size served by the cache */
+#define MULTI_HEAP_CACHE_MAX_SIZE 256
+
+typedef struct multi_heap_cache multi_heap_cache_t;
+
+/** @brief Create a cache for the given heap.
+ *
+ * The cache structure is allocated from the heap itself.
+ *
+ * @return Cache handle, or NULL if there was no memory for it.
+ */
+multi_heap_cache_t *multi_heap_cache_create(multi_heap_handle_t heap);
+
+/** @brief Allocate a small block via the cache.
+ *
+ * Size is rounded up to the next size class.
+ *
+ * @return Pointer to the allocated block, or NULL if size is larger than
+ * MULTI_HEAP_CACHE_MAX_SIZE or the underlying heap has no memory.
+ */
+void *multi_heap_cache_malloc(multi_heap_cache_t *cache, size_t size);
+
+/** @brief Return a block to the cache.
+ *
+ * @param p Block allocated from the cache's heap (via the cache or not.)
+ *
+ * @return true if the block was cached, false if its size doesn't match a
+ * size class and the caller should free it to the heap.
+ */
+bool multi_heap_cache_free(multi_heap_cache_t *cache, void *p);
+
+/** @brief Return all blocks held by the cache (on all cores) to the heap. */
+void multi_heap_cache_flush(multi_heap_cache_t *cache);
+
+/** @brief Return the number of bytes held in cached blocks.
+ *
+ * @param[out] cached_blocks If not NULL, set to the number of cached blocks.
+ */
+size_t multi_heap_cache_get_info(multi_heap_cache_t *cache, size_t *cached_blocks);
+
+#ifdef __cplusplus
+}
+#endif
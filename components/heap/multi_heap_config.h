@@ -27,3 +27,9 @@
 #define MULTI_HEAP_POISONING
 #define MULTI_HEAP_POISONING_SLOW
 #endif
+
+#ifdef CONFIG_HEAP_CACHE_DEPTH
+#define MULTI_HEAP_CACHE_DEPTH CONFIG_HEAP_CACHE_DEPTH
+#else
+#define MULTI_HEAP_CACHE_DEPTH 8
+#endif
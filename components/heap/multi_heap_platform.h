@@ -53,6 +53,9 @@ typedef portMUX_TYPE multi_heap_lock_t;
 #define MULTI_HEAP_PRINTF ets_printf
 #define MULTI_HEAP_STDERR_PRINTF(MSG, ...) ets_printf(MSG, __VA_ARGS__)
 
+#define MULTI_HEAP_NUM_CORES portNUM_PROCESSORS
+#define MULTI_HEAP_CURRENT_CORE() xPortGetCoreID()
+
 inline static void multi_heap_assert(bool condition, const char *format, int line, intptr_t address)
 {
     /* Can't use libc assert() here as it calls printf() which can cause another malloc() for a newlib lock.
@@ -89,15 +92,60 @@ inline static void multi_heap_assert(bool condition, const char *format, int lin
 #else // MULTI_HEAP_FREERTOS
 
 #include <assert.h>
+#include <pthread.h>
+
+/* Host builds use recursive pthread mutexes, so that the heap can be exercised from
+   several threads in host tests (a heap without a lock set is not locked at all.) */
+typedef pthread_mutex_t multi_heap_lock_t;
+
+static inline void multi_heap_host_lock_init(pthread_mutex_t *lock)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
 
-typedef int multi_heap_lock_t;
+#ifndef MULTI_HEAP_NUM_CORES
+#define MULTI_HEAP_NUM_CORES 4
+#endif
+
+/* Each host thread is assigned one of MULTI_HEAP_NUM_CORES "cores" the first time it asks */
+static inline int multi_heap_host_core_id(void)
+{
+    static int next_id;
+    static __thread int id = -1;
+    if (id < 0) {
+        id = __atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED) % MULTI_HEAP_NUM_CORES;
+    }
+    return id;
+}
 
 #define MULTI_HEAP_PRINTF printf
 #define MULTI_HEAP_STDERR_PRINTF(MSG, ...) fprintf(stderr, MSG, __VA_ARGS__)
-#define MULTI_HEAP_LOCK(PLOCK)  (void) (PLOCK)
-#define MULTI_HEAP_UNLOCK(PLOCK)  (void) (PLOCK)
-#define MULTI_HEAP_LOCK_INIT(PLOCK)  (void) (PLOCK)
-#define MULTI_HEAP_LOCK_STATIC_INITIALIZER  0
+#define MULTI_HEAP_LOCK(PLOCK) do {                         \
+        if ((PLOCK) != NULL) {                              \
+            pthread_mutex_lock((PLOCK));                    \
+        }                                                   \
+    } while(0)
+#define MULTI_HEAP_UNLOCK(PLOCK) do {                       \
+        if ((PLOCK) != NULL) {                              \
+            pthread_mutex_unlock((PLOCK));                  \
+        }                                                   \
+    } while(0)
+#define MULTI_HEAP_LOCK_INIT(PLOCK)  multi_heap_host_lock_init((PLOCK))
+/* Heap locks may be taken recursively (the cache refills and flushes under the heap lock),
+   so statically initialized locks need to be recursive too */
+#if defined(PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP)
+#define MULTI_HEAP_LOCK_STATIC_INITIALIZER  PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+#elif defined(PTHREAD_RECURSIVE_MUTEX_INITIALIZER)
+#define MULTI_HEAP_LOCK_STATIC_INITIALIZER  PTHREAD_RECURSIVE_MUTEX_INITIALIZER
+#else
+#error "No static initializer for recursive pthread mutexes, build with _GNU_SOURCE defined"
+#endif
+
+#define MULTI_HEAP_CURRENT_CORE() multi_heap_host_core_id()
 
 #define MULTI_HEAP_ASSERT(CONDITION, ADDRESS) assert((CONDITION) && "Heap corrupt")
 
@@ -0,0 +1,147 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "multi_heap_pool.h"
+
+/* Note: Keep platform-specific parts in this header, this source
+   file should depend on libc only */
+#include "multi_heap_platform.h"
+
+#define ALIGN_UP(num) (((num) + (sizeof(void *) - 1)) & ~(sizeof(void *) - 1))
+
+typedef struct pool_free_object {
+    struct pool_free_object *next;
+} pool_free_object_t;
+
+struct multi_heap_pool {
+    void *lock;
+    pool_free_object_t *free_list; ///< Objects which were freed
+    uint8_t *unused;               ///< First object which was never allocated, objects from here to 'end' are free too
+    uint8_t *objects;
+    uint8_t *end;
+    size_t object_size;
+    size_t free_objects;
+    size_t minimum_free_objects;
+    size_t failed_allocs;
+};
+
+#define POOL_HEADER_SIZE ALIGN_UP(sizeof(struct multi_heap_pool))
+
+size_t multi_heap_pool_object_size(size_t object_size)
+{
+    if (object_size < sizeof(pool_free_object_t)) {
+        object_size = sizeof(pool_free_object_t);
+    }
+    return ALIGN_UP(object_size);
+}
+
+size_t multi_heap_pool_storage_size(size_t object_size, size_t num_objects)
+{
+    size_t objects_size;
+    if (object_size == 0 || object_size > SIZE_MAX / 2
+        || __builtin_mul_overflow(multi_heap_pool_object_size(object_size), num_objects, &objects_size)
+        || objects_size > SIZE_MAX - POOL_HEADER_SIZE) {
+        return 0;
+    }
+    return POOL_HEADER_SIZE + objects_size;
+}
+
+multi_heap_pool_handle_t multi_heap_pool_init(void *storage, size_t object_size, size_t num_objects)
+{
+    if (storage == NULL || multi_heap_pool_storage_size(object_size, num_objects) == 0) {
+        return NULL;
+    }
+
+    multi_heap_pool_handle_t pool = (multi_heap_pool_handle_t)storage;
+    memset(pool, 0, sizeof(struct multi_heap_pool));
+    pool->object_size = multi_heap_pool_object_size(object_size);
+    pool->objects = (uint8_t *)storage + POOL_HEADER_SIZE;
+    pool->unused = pool->objects;
+    pool->end = pool->objects + pool->object_size * num_objects;
+    pool->free_objects = num_objects;
+    pool->minimum_free_objects = num_objects;
+    return pool;
+}
+
+void multi_heap_pool_set_lock(multi_heap_pool_handle_t pool, void *lock)
+{
+    pool->lock = lock;
+}
+
+bool multi_heap_pool_contains(multi_heap_pool_handle_t pool, const void *p)
+{
+    return (const uint8_t *)p >= pool->objects && (const uint8_t *)p < pool->end;
+}
+
+void *multi_heap_pool_alloc(multi_heap_pool_handle_t pool)
+{
+    void *result = NULL;
+
+    MULTI_HEAP_LOCK(pool->lock);
+    if (pool->free_list != NULL) {
+        result = pool->free_list;
+        pool->free_list = pool->free_list->next;
+    } else if (pool->unused < pool->end) {
+        result = pool->unused;
+        pool->unused += pool->object_size;
+    }
+
+    if (result != NULL) {
+        pool->free_objects--;
+        if (pool->free_objects < pool->minimum_free_objects) {
+            pool->minimum_free_objects = pool->free_objects;
+        }
+    } else {
+        pool->failed_allocs++;
+    }
+    MULTI_HEAP_UNLOCK(pool->lock);
+
+    return result;
+}
+
+void multi_heap_pool_free(multi_heap_pool_handle_t pool, void *p)
+{
+    if (p == NULL) {
+        return;
+    }
+
+    /* Pointer must be the start of an object which was handed out */
+    MULTI_HEAP_ASSERT(multi_heap_pool_contains(pool, p)
+                      && ((uint8_t *)p - pool->objects) % pool->object_size == 0
+                      && (uint8_t *)p < pool->unused, p);
+
+    pool_free_object_t *object = (pool_free_object_t *)p;
+
+    MULTI_HEAP_LOCK(pool->lock);
+    object->next = pool->free_list;
+    pool->free_list = object;
+    pool->free_objects++;
+    MULTI_HEAP_UNLOCK(pool->lock);
+}
+
+void multi_heap_pool_get_info(multi_heap_pool_handle_t pool, heap_pool_info_t *info)
+{
+    MULTI_HEAP_LOCK(pool->lock);
+    info->object_size = pool->object_size;
+    info->total_objects = (pool->end - pool->objects) / pool->object_size;
+    info->free_objects = pool->free_objects;
+    info->minimum_free_objects = pool->minimum_free_objects;
+    info->failed_allocs = pool->failed_allocs;
+    MULTI_HEAP_UNLOCK(pool->lock);
+}
@@ -0,0 +1,59 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_heap_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Fixed size object pool, laid out in a single caller-provided buffer.
+
+   This is the platform-independent part of the heap_pool_xxx API (heap_pool.c),
+   in the same way that multi_heap is the platform-independent part of heap_caps.
+
+   Free objects are kept in a singly linked list threaded through the objects
+   themselves, objects which were never allocated are handed out from the end
+   of the used region, so initialising a pool doesn't touch the objects.
+*/
+
+typedef struct multi_heap_pool *multi_heap_pool_handle_t;
+
+/* Return the object size a pool actually uses for 'object_size' (rounded up for alignment and to fit a pointer) */
+size_t multi_heap_pool_object_size(size_t object_size);
+
+/* Return the buffer size needed for a pool of 'num_objects' objects of 'object_size', or 0 on overflow */
+size_t multi_heap_pool_storage_size(size_t object_size, size_t num_objects);
+
+/* Initialise a pool in 'storage', which must be at least multi_heap_pool_storage_size() bytes and pointer aligned */
+multi_heap_pool_handle_t multi_heap_pool_init(void *storage, size_t object_size, size_t num_objects);
+
+/* Associate a lock with the pool, same semantics as multi_heap_set_lock() */
+void multi_heap_pool_set_lock(multi_heap_pool_handle_t pool, void *lock);
+
+void *multi_heap_pool_alloc(multi_heap_pool_handle_t pool);
+
+void multi_heap_pool_free(multi_heap_pool_handle_t pool, void *p);
+
+/* Return true if 'p' points into the pool's object storage */
+bool multi_heap_pool_contains(multi_heap_pool_handle_t pool, const void *p);
+
+void multi_heap_pool_get_info(multi_heap_pool_handle_t pool, heap_pool_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,926 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <multi_heap.h>
+#include "multi_heap_internal.h"
+
+/* Note: Keep platform-specific parts in this header, this source
+   file should depend on libc only */
+#include "multi_heap_platform.h"
+
+/* Defines compile-time configuration macros */
+#include "multi_heap_config.h"
+
+/* Two-Level Segregated Fit (TLSF) implementation of the multi_heap internal API.
+
+   This is a drop-in alternative to the best-fit free list walker in multi_heap.c, selected with
+   CONFIG_HEAP_ALLOCATOR_TLSF. Free blocks are kept in a matrix of segregated lists indexed by
+   (first level = power of two size class, second level = linear subdivision of that class). Two levels
+   of bitmaps record which lists are non-empty, so finding a suitable free block is a couple of
+   find-first-set operations instead of a walk over the whole free list.
+
+   malloc, free and realloc are therefore bounded in time regardless of heap fragmentation. The one
+   exception is a request that can only be served by a block in the exact size class of the request
+   (ie the heap is nearly exhausted), in which case that single list is searched so that
+   multi_heap_get_info()'s largest_free_block remains an allocatable size.
+*/
+
+#ifndef MULTI_HEAP_POISONING
+/* if no heap poisoning, public API aliases directly to these implementations */
+void *multi_heap_malloc(multi_heap_handle_t heap, size_t size)
+    __attribute__((alias("multi_heap_malloc_impl")));
+
+void *multi_heap_aligned_alloc(multi_heap_handle_t heap, size_t size, size_t alignment)
+    __attribute__((alias("multi_heap_aligned_alloc_impl")));
+
+void multi_heap_free(multi_heap_handle_t heap, void *p)
+    __attribute__((alias("multi_heap_free_impl")));
+
+void multi_heap_aligned_free(multi_heap_handle_t heap, void *p)
+    __attribute__((alias("multi_heap_aligned_free_impl")));
+
+void *multi_heap_realloc(multi_heap_handle_t heap, void *p, size_t size)
+    __attribute__((alias("multi_heap_realloc_impl")));
+
+size_t multi_heap_get_allocated_size(multi_heap_handle_t heap, void *p)
+    __attribute__((alias("multi_heap_get_allocated_size_impl")));
+
+multi_heap_handle_t multi_heap_register(void *start, size_t size)
+    __attribute__((alias("multi_heap_register_impl")));
+
+void multi_heap_get_info(multi_heap_handle_t heap, multi_heap_info_t *info)
+    __attribute__((alias("multi_heap_get_info_impl")));
+
+size_t multi_heap_free_size(multi_heap_handle_t heap)
+    __attribute__((alias("multi_heap_free_size_impl")));
+
+size_t multi_heap_minimum_free_size(multi_heap_handle_t heap)
+    __attribute__((alias("multi_heap_minimum_free_size_impl")));
+
+void *multi_heap_get_block_address(multi_heap_block_handle_t block)
+    __attribute__((alias("multi_heap_get_block_address_impl")));
+
+void *multi_heap_get_block_owner(multi_heap_block_handle_t block)
+{
+    return NULL;
+}
+
+#endif
+
+#define ALIGN(X) ((X) & ~(sizeof(void *)-1))
+#define ALIGN_UP(X) ALIGN((X)+sizeof(void *)-1)
+#define ALIGN_UP_BY(num, align) (((num) + ((align) - 1)) & ~((align) - 1))
+
+/* log2 of the number of second level lists per first level size class.
+
+   Each power of two size class is split into 2^SL_INDEX_COUNT_LOG2 linear sub-ranges. Higher values
+   give a closer fit (less fragmentation) at the cost of a larger control structure per heap.
+*/
+#define SL_INDEX_COUNT_LOG2 4
+#define SL_INDEX_COUNT (1 << SL_INDEX_COUNT_LOG2)
+
+#define ALIGN_SIZE_LOG2 (sizeof(void *) == 8 ? 3 : 2)
+
+/* Blocks smaller than SMALL_BLOCK_SIZE all live in first level list 0, subdivided linearly
+   (each second level list then holds a single aligned size.) */
+#define FL_INDEX_SHIFT (SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2)
+#define SMALL_BLOCK_SIZE ((size_t)1 << FL_INDEX_SHIFT)
+
+/* First level bitmap is a single 32-bit word */
+#define FL_INDEX_COUNT_MAX 32
+
+struct heap_block;
+
+/* Block in the heap
+
+   Blocks are laid out back to back in the heap. Only the 'size' field is overhead for a used block:
+
+   - 'prev_phys_block' is stored in the last word of the previous block, and is only valid if the previous block
+     is free (BLOCK_PREV_FREE_FLAG is set in 'size').
+   - 'next_free' and 'prev_free' overlap the data of the block, and are only valid if the block is free.
+
+   The two low bits of 'size' are used as flags, as sizes are always multiples of the pointer size.
+*/
+typedef struct heap_block {
+    struct heap_block *prev_phys_block; /* Previous block in the heap, valid if it's free */
+    size_t size;                        /* Data size of this block, ORed with BLOCK_FREE_FLAG & BLOCK_PREV_FREE_FLAG */
+    struct heap_block *next_free;       /* Next block in the same segregated free list, valid if block is free */
+    struct heap_block *prev_free;       /* Previous block in the same segregated free list, valid if block is free */
+} heap_block_t;
+
+/* These masks apply to the 'size' field of heap_block_t */
+#define BLOCK_FREE_FLAG 0x1      /* If set, this block is free & next_free/prev_free pointers are valid */
+#define BLOCK_PREV_FREE_FLAG 0x2 /* If set, previous block is free & prev_phys_block pointer is valid */
+#define BLOCK_SIZE_MASK (~(size_t)3)
+
+/* Offset from the start of the block structure to the start of the data */
+#define BLOCK_START_OFFSET (offsetof(heap_block_t, size) + sizeof(size_t))
+
+/* Bytes of heap used by a block in addition to its data */
+#define BLOCK_OVERHEAD sizeof(size_t)
+
+/* A free block needs to hold the free list pointers, plus the next block's prev_phys_block */
+#define BLOCK_SIZE_MIN (sizeof(heap_block_t) - sizeof(heap_block_t *))
+
+/* Metadata header for the heap, stored at the beginning of heap space.
+
+   'sl_bitmap' and 'free_lists' point to variable length arrays immediately following this structure, sized
+   according to the number of first level size classes needed to cover the heap.
+
+   'first_block' is the first allocatable block in the heap.
+
+   'last_block' is a sentinel block of length 0 at the end of the heap, which is always marked as used so it is never
+   merged into an adjacent free block.
+ */
+typedef struct multi_heap_info {
+    void *lock;
+    size_t free_bytes;
+    size_t minimum_free_bytes;
+    heap_block_t *first_block;
+    heap_block_t *last_block;
+    size_t fl_count;          /* Number of first level size classes in this heap */
+    uint32_t fl_bitmap;       /* Bit set for each first level class with a non-empty second level list */
+    uint32_t *sl_bitmap;      /* Per first level class, bit set for each non-empty second level list */
+    heap_block_t **free_lists; /* Heads of the segregated free lists, [fl_count][SL_INDEX_COUNT] */
+} heap_t;
+
+/* Index of the most significant bit set in 'size', 'size' must be non-zero */
+static inline int fls_size(size_t size)
+{
+    return (int)(sizeof(unsigned long) * 8) - 1 - __builtin_clzl((unsigned long)size);
+}
+
+/* Index of the least significant bit set in 'word', 'word' must be non-zero */
+static inline int ffs_word(uint32_t word)
+{
+    return __builtin_ctz(word);
+}
+
+static inline size_t block_size(const heap_block_t *block)
+{
+    return block->size & BLOCK_SIZE_MASK;
+}
+
+static inline void block_set_size(heap_block_t *block, size_t size)
+{
+    block->size = size | (block->size & ~BLOCK_SIZE_MASK);
+}
+
+/* Return true if this block is free. */
+static inline bool is_free(const heap_block_t *block)
+{
+    return block->size & BLOCK_FREE_FLAG;
+}
+
+static inline bool is_prev_free(const heap_block_t *block)
+{
+    return block->size & BLOCK_PREV_FREE_FLAG;
+}
+
+/* Return true if this block is the last_block in the heap */
+static inline bool is_last_block(const heap_t *heap, const heap_block_t *block)
+{
+    return block == heap->last_block;
+}
+
+/* Given a pointer to the data of a block (ie the previous malloc/realloc result), return a pointer to the
+   containing block.
+*/
+static inline heap_block_t *get_block(const void *data_ptr)
+{
+    return (heap_block_t *)((char *)data_ptr - BLOCK_START_OFFSET);
+}
+
+static inline void *block_data(const heap_block_t *block)
+{
+    return (char *)block + BLOCK_START_OFFSET;
+}
+
+/* Return the next sequential block in the heap. */
+static inline heap_block_t *get_next_block(const heap_block_t *block)
+{
+    heap_block_t *next = (heap_block_t *)((char *)block_data(block) + block_size(block) - BLOCK_OVERHEAD);
+    assert(next > block);
+    return next;
+}
+
+/* Link a block to the following one, so 'next' can find its way back to it if 'block' is free.
+   Returns the next block. */
+static inline heap_block_t *link_next_block(heap_block_t *block)
+{
+    heap_block_t *next = get_next_block(block);
+    next->prev_phys_block = block;
+    return next;
+}
+
+static inline void mark_as_free(heap_block_t *block)
+{
+    heap_block_t *next = link_next_block(block);
+    next->size |= BLOCK_PREV_FREE_FLAG;
+    block->size |= BLOCK_FREE_FLAG;
+}
+
+static inline void mark_as_used(heap_block_t *block)
+{
+    heap_block_t *next = get_next_block(block);
+    next->size &= ~BLOCK_PREV_FREE_FLAG;
+    block->size &= ~BLOCK_FREE_FLAG;
+#ifdef MULTI_HEAP_POISONING_SLOW
+    /* next block's prev_phys_block pointer is now part of this block's data, replace it with a fill pattern */
+    multi_heap_internal_poison_fill_region(&next->prev_phys_block, sizeof(heap_block_t *), true /* free */);
+#endif
+}
+
+/* Map a block size to the free list which should contain it */
+static inline void mapping_insert(size_t size, int *fl, int *sl)
+{
+    if (size < SMALL_BLOCK_SIZE) {
+        *fl = 0;
+        *sl = (int)(size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT));
+    } else {
+        int f = fls_size(size);
+        *sl = (int)((size >> (f - SL_INDEX_COUNT_LOG2)) ^ (1 << SL_INDEX_COUNT_LOG2));
+        *fl = f - (FL_INDEX_SHIFT - 1);
+    }
+}
+
+/* Map a requested size to the first free list whose blocks are all at least this size */
+static inline void mapping_search(size_t size, int *fl, int *sl)
+{
+    if (size >= SMALL_BLOCK_SIZE) {
+        size_t round = ((size_t)1 << (fls_size(size) - SL_INDEX_COUNT_LOG2)) - 1;
+        size += round;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+/* Check a block is valid for this heap. Used to verify parameters. */
+static void assert_valid_block(const heap_t *heap, const heap_block_t *block)
+{
+    MULTI_HEAP_ASSERT(block >= heap->first_block && block <= heap->last_block,
+                      block); // block not in heap
+    if (!is_last_block(heap, block)) {
+        const heap_block_t *next = get_next_block(block);
+        MULTI_HEAP_ASSERT(next > heap->first_block && next <= heap->last_block, block); // Next block not in heap
+    }
+}
+
+/* Insert a free block at the head of the free list for its size */
+static void insert_free_block(heap_t *heap, heap_block_t *block)
+{
+    int fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+    MULTI_HEAP_ASSERT(fl < heap->fl_count, block); // block larger than heap?
+
+    heap_block_t **head = &heap->free_lists[fl * SL_INDEX_COUNT + sl];
+    block->next_free = *head;
+    block->prev_free = NULL;
+    if (*head != NULL) {
+        (*head)->prev_free = block;
+    }
+    *head = block;
+
+    heap->fl_bitmap |= (1U << fl);
+    heap->sl_bitmap[fl] |= (1U << sl);
+    heap->free_bytes += block_size(block);
+}
+
+/* Remove a free block from the free list for its size */
+static void remove_free_block(heap_t *heap, heap_block_t *block)
+{
+    int fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+    MULTI_HEAP_ASSERT(is_free(block), block); // block should be free
+
+    heap_block_t *prev = block->prev_free;
+    heap_block_t *next = block->next_free;
+    if (next != NULL) {
+        next->prev_free = prev;
+    }
+    if (prev != NULL) {
+        prev->next_free = next;
+    } else {
+        heap_block_t **head = &heap->free_lists[fl * SL_INDEX_COUNT + sl];
+        MULTI_HEAP_ASSERT(*head == block, head); // free list head should be this block
+        *head = next;
+        if (next == NULL) {
+            heap->sl_bitmap[fl] &= ~(1U << sl);
+            if (heap->sl_bitmap[fl] == 0) {
+                heap->fl_bitmap &= ~(1U << fl);
+            }
+        }
+    }
+
+    heap->free_bytes -= block_size(block);
+}
+
+/* Find a free block of at least 'size' bytes, in constant time. Returns NULL if none is found.
+
+   The block is not removed from its free list.
+*/
+static heap_block_t *find_suitable_block(heap_t *heap, size_t size)
+{
+    int fl, sl;
+    mapping_search(size, &fl, &sl);
+
+    if (fl < heap->fl_count) {
+        uint32_t sl_map = heap->sl_bitmap[fl] & (~0U << sl);
+        if (sl_map == 0) {
+            /* no suitable list in this first level class, find the next larger class which isn't empty */
+            uint32_t fl_map = (fl + 1 < FL_INDEX_COUNT_MAX) ? (heap->fl_bitmap & (~0U << (fl + 1))) : 0;
+            if (fl_map != 0) {
+                fl = ffs_word(fl_map);
+                sl_map = heap->sl_bitmap[fl];
+            }
+        }
+        if (sl_map != 0) {
+            sl = ffs_word(sl_map);
+            return heap->free_lists[fl * SL_INDEX_COUNT + sl];
+        }
+    }
+
+    /* mapping_search() rounds up so any block in the chosen list is big enough, which means a block in the
+       same list as 'size' is never considered. Before failing, look in that list for a block which fits.
+    */
+    mapping_insert(size, &fl, &sl);
+    if (fl < heap->fl_count) {
+        for (heap_block_t *b = heap->free_lists[fl * SL_INDEX_COUNT + sl]; b != NULL; b = b->next_free) {
+            if (block_size(b) >= size) {
+                return b;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Merge the (free) block 'b' into the previous block 'a', which is also free and has already been
+   removed from its free list. Returns 'a'.
+*/
+static heap_block_t *absorb_block(heap_block_t *a, heap_block_t *b)
+{
+    MULTI_HEAP_ASSERT(get_next_block(a) == b, a); // Blocks should be in order
+    block_set_size(a, block_size(a) + block_size(b) + BLOCK_OVERHEAD);
+    link_next_block(a);
+
+#ifdef MULTI_HEAP_POISONING_SLOW
+    /* b's former block header needs to be replaced with a fill pattern */
+    multi_heap_internal_poison_fill_region(b, sizeof(heap_block_t), true /* free */);
+#endif
+    return a;
+}
+
+/* Merge a free block (not on any free list) with the previous block, if that is free. */
+static heap_block_t *merge_prev(heap_t *heap, heap_block_t *block)
+{
+    if (is_prev_free(block)) {
+        heap_block_t *prev = block->prev_phys_block;
+        MULTI_HEAP_ASSERT(prev >= heap->first_block && prev < block, &block->prev_phys_block); // prev block should be in heap
+        MULTI_HEAP_ASSERT(is_free(prev), prev); // prev block should be free
+        remove_free_block(heap, prev);
+        block = absorb_block(prev, block);
+    }
+    return block;
+}
+
+/* Merge a block (not on any free list) with the next block, if that is free. */
+static heap_block_t *merge_next(heap_t *heap, heap_block_t *block)
+{
+    heap_block_t *next = get_next_block(block);
+    if (is_free(next)) {
+        MULTI_HEAP_ASSERT(!is_last_block(heap, next), next); // last block should never be free
+        remove_free_block(heap, next);
+        block = absorb_block(block, next);
+    }
+    return block;
+}
+
+/* Split a block so it holds exactly 'size' bytes of data (if there is enough spare space to make a new block),
+   and return the remainder as a new free block. Returns NULL if the block can't be split.
+
+   Both 'block' and the returned block are left off the free lists.
+*/
+static heap_block_t *split_block(heap_block_t *block, size_t size)
+{
+    if (block_size(block) < size + sizeof(heap_block_t)) {
+        /* Can't split 'block' if we're not going to get a usable free block afterwards */
+        return NULL;
+    }
+    heap_block_t *remaining = (heap_block_t *)((char *)block_data(block) + size - BLOCK_OVERHEAD);
+    remaining->size = block_size(block) - size - BLOCK_OVERHEAD;
+    block_set_size(block, size);
+    mark_as_free(remaining);
+    return remaining;
+}
+
+/* Trim a used block to 'size' bytes, giving any spare space back to the heap */
+static void trim_used_block(heap_t *heap, heap_block_t *block, size_t size)
+{
+    MULTI_HEAP_ASSERT(!is_free(block), block); // trimmed block shouldn't be free
+    heap_block_t *remaining = split_block(block, size);
+    if (remaining != NULL) {
+        remaining = merge_next(heap, remaining);
+        insert_free_block(heap, remaining);
+    }
+}
+
+/* Round up a requested allocation size to a valid block size. Returns 0 if the size is not valid. */
+static inline size_t adjust_request_size(size_t size)
+{
+    if (size == 0 || size > SIZE_MAX - sizeof(heap_block_t)) {
+        return 0;
+    }
+    size = ALIGN_UP(size);
+    return (size < BLOCK_SIZE_MIN) ? BLOCK_SIZE_MIN : size;
+}
+
+void *multi_heap_get_block_address_impl(multi_heap_block_handle_t block)
+{
+    return block_data(block);
+}
+
+size_t multi_heap_get_allocated_size_impl(multi_heap_handle_t heap, void *p)
+{
+    heap_block_t *pb = get_block(p);
+
+    assert_valid_block(heap, pb);
+    MULTI_HEAP_ASSERT(!is_free(pb), pb); // block shouldn't be free
+    return block_size(pb);
+}
+
+multi_heap_handle_t multi_heap_register_impl(void *start_ptr, size_t size)
+{
+    uintptr_t start = ALIGN_UP((uintptr_t)start_ptr);
+    uintptr_t end = ALIGN((uintptr_t)start_ptr + size);
+    heap_t *heap = (heap_t *)start;
+
+    if (end < start + sizeof(heap_t) + 2 * sizeof(heap_block_t)) {
+        return NULL; /* 'size' is too small to fit a heap here */
+    }
+    size = end - start;
+
+    /* Number of first level classes needed to index a block the size of the whole heap */
+    size_t fl_count = 1;
+    if (size >= SMALL_BLOCK_SIZE) {
+        fl_count = fls_size(size) - FL_INDEX_SHIFT + 2;
+    }
+    assert(fl_count <= FL_INDEX_COUNT_MAX);
+
+    const size_t control_size = sizeof(heap_t)
+        + fl_count * sizeof(uint32_t)
+        + fl_count * SL_INDEX_COUNT * sizeof(heap_block_t *);
+    uintptr_t first_block_addr = ALIGN_UP(start + control_size);
+
+    if (first_block_addr + 2 * sizeof(heap_block_t) > end) {
+        return NULL; /* not enough space left for any blocks after the control structure */
+    }
+
+    heap->lock = NULL;
+    heap->fl_count = fl_count;
+    heap->fl_bitmap = 0;
+    heap->sl_bitmap = (uint32_t *)(start + sizeof(heap_t));
+    heap->free_lists = (heap_block_t **)(heap->sl_bitmap + fl_count);
+    memset(heap->sl_bitmap, 0, fl_count * sizeof(uint32_t));
+    memset(heap->free_lists, 0, fl_count * SL_INDEX_COUNT * sizeof(heap_block_t *));
+
+    /* last block is a used block of length 0, its 'size' field is the last word of the heap */
+    heap->first_block = (heap_block_t *)first_block_addr;
+    heap->last_block = (heap_block_t *)(end - BLOCK_START_OFFSET);
+
+    heap->first_block->size = (uintptr_t)heap->last_block - first_block_addr - BLOCK_OVERHEAD;
+    heap->last_block->size = 0;
+
+    heap->free_bytes = 0;
+    mark_as_free(heap->first_block);
+    insert_free_block(heap, heap->first_block);
+    heap->minimum_free_bytes = heap->free_bytes;
+
+    return heap;
+}
+
+void multi_heap_set_lock(multi_heap_handle_t heap, void *lock)
+{
+    heap->lock = lock;
+}
+
+void inline multi_heap_internal_lock(multi_heap_handle_t heap)
+{
+    MULTI_HEAP_LOCK(heap->lock);
+}
+
+void inline multi_heap_internal_unlock(multi_heap_handle_t heap)
+{
+    MULTI_HEAP_UNLOCK(heap->lock);
+}
+
+multi_heap_block_handle_t multi_heap_get_first_block(multi_heap_handle_t heap)
+{
+    return heap->first_block;
+}
+
+multi_heap_block_handle_t multi_heap_get_next_block(multi_heap_handle_t heap, multi_heap_block_handle_t block)
+{
+    heap_block_t *next = get_next_block(block);
+    if (is_last_block(heap, next)) {
+        return NULL;
+    }
+    assert_valid_block(heap, next);
+    return next;
+}
+
+bool multi_heap_is_free(multi_heap_block_handle_t block)
+{
+    return is_free(block);
+}
+
+void *multi_heap_malloc_impl(multi_heap_handle_t heap, size_t size)
+{
+    if (heap == NULL) {
+        return NULL;
+    }
+
+    size = adjust_request_size(size);
+    if (size == 0) {
+        return NULL;
+    }
+
+    multi_heap_internal_lock(heap);
+
+    if (heap->free_bytes < size) {
+        multi_heap_internal_unlock(heap);
+        return NULL;
+    }
+
+    heap_block_t *block = find_suitable_block(heap, size);
+    if (block == NULL) {
+        multi_heap_internal_unlock(heap);
+        return NULL; /* No room in heap */
+    }
+
+    remove_free_block(heap, block);
+    heap_block_t *remaining = split_block(block, size);
+    if (remaining != NULL) {
+        insert_free_block(heap, remaining);
+    }
+    mark_as_used(block);
+
+    if (heap->free_bytes < heap->minimum_free_bytes) {
+        heap->minimum_free_bytes = heap->free_bytes;
+    }
+
+    multi_heap_internal_unlock(heap);
+
+    return block_data(block);
+}
+
+void *multi_heap_aligned_alloc_impl(multi_heap_handle_t heap, size_t size, size_t alignment)
+{
+    if (heap == NULL) {
+        return NULL;
+    }
+
+    if (!size) {
+        return NULL;
+    }
+
+    if (!alignment) {
+        return NULL;
+    }
+
+    //Alignment must be a power of two...
+    if ((alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+
+    uint32_t overhead = (sizeof(uint32_t) + (alignment - 1));
+
+    multi_heap_internal_lock(heap);
+    void *head = multi_heap_malloc_impl(heap, size + overhead);
+    if (head == NULL) {
+        multi_heap_internal_unlock(heap);
+        return NULL;
+    }
+
+    //Lets align our new obtained block address:
+    //and save information to recover original block pointer
+    //to allow us to deallocate the memory when needed
+    void *ptr = (void *)ALIGN_UP_BY((uintptr_t)head + sizeof(uint32_t), alignment);
+    *((uint32_t *)ptr - 1) = (uint32_t)((uintptr_t)ptr - (uintptr_t)head);
+
+    multi_heap_internal_unlock(heap);
+    return ptr;
+}
+
+void multi_heap_aligned_free_impl(multi_heap_handle_t heap, void *p)
+{
+    if (p == NULL) {
+        return;
+    }
+
+    multi_heap_internal_lock(heap);
+    uint32_t offset = *((uint32_t *)p - 1);
+    void *block_head = (void *)((uint8_t *)p - offset);
+
+#ifdef MULTI_HEAP_POISONING_SLOW
+        multi_heap_internal_poison_fill_region(block_head, multi_heap_get_allocated_size_impl(heap, block_head), true /* free */);
+#endif
+
+    multi_heap_free_impl(heap, block_head);
+    multi_heap_internal_unlock(heap);
+}
+
+void multi_heap_free_impl(multi_heap_handle_t heap, void *p)
+{
+    heap_block_t *pb = get_block(p);
+
+    if (heap == NULL || p == NULL) {
+        return;
+    }
+
+    multi_heap_internal_lock(heap);
+
+    assert_valid_block(heap, pb);
+    MULTI_HEAP_ASSERT(!is_free(pb), pb); // block should not be free
+    MULTI_HEAP_ASSERT(!is_last_block(heap, pb), pb); // block should not be last block
+
+    mark_as_free(pb);
+    pb = merge_prev(heap, pb);
+    pb = merge_next(heap, pb);
+    insert_free_block(heap, pb);
+
+    multi_heap_internal_unlock(heap);
+}
+
+void *multi_heap_realloc_impl(multi_heap_handle_t heap, void *p, size_t size)
+{
+    heap_block_t *pb = get_block(p);
+    void *result;
+
+    assert(heap != NULL);
+
+    if (p == NULL) {
+        return multi_heap_malloc_impl(heap, size);
+    }
+
+    assert_valid_block(heap, pb);
+    // non-null realloc arg should be allocated
+    MULTI_HEAP_ASSERT(!is_free(pb), pb);
+
+    if (size == 0) {
+        /* note: calling multi_free_impl() here as we've already been
+           through any poison-unwrapping */
+        multi_heap_free_impl(heap, p);
+        return NULL;
+    }
+
+    size_t adjusted_size = adjust_request_size(size);
+    if (adjusted_size == 0) {
+        return NULL;
+    }
+
+    multi_heap_internal_lock(heap);
+    result = NULL;
+
+    const size_t cur_size = block_size(pb);
+    heap_block_t *next = get_next_block(pb);
+
+    if (adjusted_size <= cur_size) {
+        // Shrinking...
+        trim_used_block(heap, pb, adjusted_size);
+        result = p;
+    } else if (is_free(next) && adjusted_size <= cur_size + block_size(next) + BLOCK_OVERHEAD) {
+        // Growing in place, into the following free block
+        remove_free_block(heap, next);
+        absorb_block(pb, next);
+        mark_as_used(pb);
+        trim_used_block(heap, pb, adjusted_size);
+        result = p;
+    } else {
+        // Need to allocate elsewhere and copy data over
+        //
+        // (Calling _impl versions here as we've already been through any
+        // unwrapping for heap poisoning features.)
+        result = multi_heap_malloc_impl(heap, size);
+        if (result != NULL) {
+            memcpy(result, p, cur_size);
+            multi_heap_free_impl(heap, p);
+        }
+    }
+
+    if (heap->free_bytes < heap->minimum_free_bytes) {
+        heap->minimum_free_bytes = heap->free_bytes;
+    }
+
+    multi_heap_internal_unlock(heap);
+    return result;
+}
+
+#define FAIL_PRINT(MSG, ...) do {                                       \
+        if (print_errors) {                                             \
+            MULTI_HEAP_STDERR_PRINTF(MSG, __VA_ARGS__);                 \
+        }                                                               \
+        valid = false;                                                  \
+    }                                                                   \
+    while(0)
+
+bool multi_heap_check(multi_heap_handle_t heap, bool print_errors)
+{
+    bool valid = true;
+    size_t total_free_bytes = 0;
+    size_t total_free_blocks = 0;
+    assert(heap != NULL);
+
+    multi_heap_internal_lock(heap);
+
+    heap_block_t *prev = NULL;
+
+    /* Walk all blocks in address order.
+       note: not using get_next_block() in loop, so that assertions aren't checked here */
+    for (heap_block_t *b = heap->first_block; b != heap->last_block;
+         b = (heap_block_t *)((char *)b + BLOCK_START_OFFSET + block_size(b) - BLOCK_OVERHEAD)) {
+        if (b <= prev) {
+            FAIL_PRINT("CORRUPT HEAP: Block %p is not after prev block %p\n", b, prev);
+            goto done;
+        }
+        if (b > heap->last_block || b < heap->first_block) {
+            FAIL_PRINT("CORRUPT HEAP: Block %p is outside heap (last valid block %p)\n", b, prev);
+            goto done;
+        }
+        if (block_size(b) < BLOCK_SIZE_MIN) {
+            FAIL_PRINT("CORRUPT HEAP: Block %p has invalid size 0x%08x\n", b, (unsigned)block_size(b));
+            goto done;
+        }
+        bool prev_free = (prev != NULL && is_free(prev));
+        if (is_prev_free(b) != prev_free) {
+            FAIL_PRINT("CORRUPT HEAP: Block %p prev free flag doesn't match prev block %p\n", b, prev);
+        }
+        if (is_free(b)) {
+            if (prev_free) {
+                FAIL_PRINT("CORRUPT HEAP: Two adjacent free blocks found, %p and %p\n", prev, b);
+            }
+            if (prev_free && b->prev_phys_block != prev) {
+                FAIL_PRINT("CORRUPT HEAP: Block %p prev_phys_block %p should be %p\n", b, b->prev_phys_block, prev);
+            }
+            total_free_bytes += block_size(b);
+            total_free_blocks++;
+        }
+        prev = b;
+
+#ifdef MULTI_HEAP_POISONING
+        /* For slow heap poisoning, any block should contain correct poisoning patterns and/or fills */
+        bool poison_ok;
+        if (is_free(b)) {
+            /* skip the free list pointers at the start and the next block's prev_phys_block at the end */
+            size_t free_start = offsetof(heap_block_t, prev_free) + sizeof(heap_block_t *);
+            size_t block_len = block_size(b) + BLOCK_START_OFFSET - free_start - BLOCK_OVERHEAD;
+            poison_ok = multi_heap_internal_check_block_poisoning((char *)b + free_start, block_len, true, print_errors);
+        }
+        else {
+            poison_ok = multi_heap_internal_check_block_poisoning(block_data(b), block_size(b), false, print_errors);
+        }
+        valid = poison_ok && valid;
+#endif
+
+    } /* for(heap_block_t b = ... */
+
+    if (is_free(heap->last_block) || block_size(heap->last_block) != 0) {
+        FAIL_PRINT("CORRUPT HEAP: Last block %p should be used and empty\n", heap->last_block);
+    }
+    if (is_prev_free(heap->last_block) != (prev != NULL && is_free(prev))) {
+        FAIL_PRINT("CORRUPT HEAP: Last block %p prev free flag doesn't match prev block %p\n", heap->last_block, prev);
+    }
+
+    /* Walk the segregated free lists, check each block is free and is filed under the correct size class */
+    size_t listed_free_blocks = 0;
+    for (int fl = 0; fl < heap->fl_count; fl++) {
+        for (int sl = 0; sl < SL_INDEX_COUNT; sl++) {
+            heap_block_t *head = heap->free_lists[fl * SL_INDEX_COUNT + sl];
+            bool bit_set = (heap->sl_bitmap[fl] & (1U << sl)) != 0;
+            if (bit_set != (head != NULL)) {
+                FAIL_PRINT("CORRUPT HEAP: Free list %d/%d bitmap doesn't match list head %p\n", fl, sl, head);
+            }
+            heap_block_t *prev_free = NULL;
+            for (heap_block_t *b = head; b != NULL; b = b->next_free) {
+                int b_fl, b_sl;
+                if (b < heap->first_block || b >= heap->last_block) {
+                    FAIL_PRINT("CORRUPT HEAP: Free block %p is outside heap\n", b);
+                    goto done;
+                }
+                if (!is_free(b)) {
+                    FAIL_PRINT("CORRUPT HEAP: Block %p on free list %d/%d is not free\n", b, fl, sl);
+                    goto done;
+                }
+                if (b->prev_free != prev_free) {
+                    FAIL_PRINT("CORRUPT HEAP: Free block %p prev_free %p should be %p\n", b, b->prev_free, prev_free);
+                }
+                mapping_insert(block_size(b), &b_fl, &b_sl);
+                if (b_fl != fl || b_sl != sl) {
+                    FAIL_PRINT("CORRUPT HEAP: Free block %p is on list %d/%d not %d/%d\n", b, fl, sl, b_fl, b_sl);
+                }
+                if (++listed_free_blocks > total_free_blocks) {
+                    FAIL_PRINT("CORRUPT HEAP: More blocks on free lists than free blocks (%u)\n", (unsigned)total_free_blocks);
+                    goto done;
+                }
+                prev_free = b;
+            }
+        }
+        if (((heap->fl_bitmap & (1U << fl)) != 0) != (heap->sl_bitmap[fl] != 0)) {
+            FAIL_PRINT("CORRUPT HEAP: First level bitmap 0x%08x doesn't match class %d\n", heap->fl_bitmap, fl);
+        }
+    }
+
+    if (listed_free_blocks != total_free_blocks) {
+        FAIL_PRINT("CORRUPT HEAP: Expected %u free blocks on free lists, found %u\n",
+                   (unsigned)total_free_blocks, (unsigned)listed_free_blocks);
+    }
+
+    if (heap->free_bytes != total_free_bytes) {
+        FAIL_PRINT("CORRUPT HEAP: Expected %u free bytes counted %u\n", (unsigned)heap->free_bytes, (unsigned)total_free_bytes);
+    }
+
+ done:
+    multi_heap_internal_unlock(heap);
+
+    return valid;
+}
+
+void multi_heap_dump(multi_heap_handle_t heap)
+{
+    assert(heap != NULL);
+
+    multi_heap_internal_lock(heap);
+    MULTI_HEAP_STDERR_PRINTF("Heap start %p end %p\nFirst level bitmap 0x%08x\n", heap->first_block, heap->last_block, heap->fl_bitmap);
+    for(heap_block_t *b = heap->first_block; !is_last_block(heap, b); b = get_next_block(b)) {
+        MULTI_HEAP_STDERR_PRINTF("Block %p data size 0x%08x bytes next block %p", b, block_size(b), get_next_block(b));
+        if (is_free(b)) {
+            MULTI_HEAP_STDERR_PRINTF(" FREE. Next free %p\n", b->next_free);
+        } else {
+            MULTI_HEAP_STDERR_PRINTF("%s", "\n"); /* C macros & optional __VA_ARGS__ */
+        }
+    }
+    multi_heap_internal_unlock(heap);
+}
+
+size_t multi_heap_free_size_impl(multi_heap_handle_t heap)
+{
+    if (heap == NULL) {
+        return 0;
+    }
+    return heap->free_bytes;
+}
+
+size_t multi_heap_minimum_free_size_impl(multi_heap_handle_t heap)
+{
+    if (heap == NULL) {
+        return 0;
+    }
+    return heap->minimum_free_bytes;
+}
+
+void multi_heap_get_info_impl(multi_heap_handle_t heap, multi_heap_info_t *info)
+{
+    memset(info, 0, sizeof(multi_heap_info_t));
+
+    if (heap == NULL) {
+        return;
+    }
+
+    multi_heap_internal_lock(heap);
+    for(heap_block_t *b = heap->first_block; !is_last_block(heap, b); b = get_next_block(b)) {
+        info->total_blocks++;
+        if (is_free(b)) {
+            size_t s = block_size(b);
+            info->total_free_bytes += s;
+            if (s > info->largest_free_block) {
+                info->largest_free_block = s;
+            }
+            info->free_blocks++;
+        } else {
+            info->total_allocated_bytes += block_size(b);
+            info->allocated_blocks++;
+        }
+    }
+
+    info->minimum_free_bytes = heap->minimum_free_bytes;
+    // heap has wrong total size (address printed here is not indicative of the real error)
+    MULTI_HEAP_ASSERT(info->total_free_bytes == heap->free_bytes, heap);
+
+    multi_heap_internal_unlock(heap);
+
+}
@@ -0,0 +1,69 @@
+/*
+ Tests for the fixed size object pool API.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_heap_pool.h"
+#include "soc/soc_memory_layout.h"
+
+TEST_CASE("Object pool alloc and free", "[heap]")
+{
+    const size_t NUM = 16;
+    void *p[NUM];
+    heap_pool_info_t info;
+
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    heap_pool_handle_t pool = heap_pool_create(42, NUM, MALLOC_CAP_8BIT, 0);
+    TEST_ASSERT_NOT_NULL(pool);
+    TEST_ASSERT(heap_caps_get_free_size(MALLOC_CAP_8BIT) < free_before);
+
+    heap_pool_get_info(pool, &info);
+    TEST_ASSERT(info.object_size >= 42);
+    TEST_ASSERT_EQUAL(NUM, info.total_objects);
+    TEST_ASSERT_EQUAL(NUM, info.free_objects);
+
+    for (int i = 0; i < NUM; i++) {
+        p[i] = heap_pool_alloc(pool);
+        TEST_ASSERT_NOT_NULL(p[i]);
+        memset(p[i], 0xA5, 42);
+    }
+    TEST_ASSERT_NULL(heap_pool_alloc(pool));
+
+    heap_caps_print_heap_info(MALLOC_CAP_8BIT);
+
+    for (int i = 0; i < NUM; i++) {
+        heap_pool_free(pool, p[i]);
+    }
+    heap_pool_get_info(pool, &info);
+    TEST_ASSERT_EQUAL(NUM, info.free_objects);
+    TEST_ASSERT_EQUAL(0, info.minimum_free_objects);
+    TEST_ASSERT_EQUAL(1, info.failed_allocs);
+
+    heap_pool_destroy(pool);
+    TEST_ASSERT_EQUAL(free_before, heap_caps_get_free_size(MALLOC_CAP_8BIT));
+}
+
+TEST_CASE("Object pool invalid arguments", "[heap]")
+{
+    TEST_ASSERT_NULL(heap_pool_create(0, 10, MALLOC_CAP_8BIT, 0));
+    TEST_ASSERT_NULL(heap_pool_create(16, 0, MALLOC_CAP_8BIT, 0));
+    TEST_ASSERT_NULL(heap_pool_create(1024 * 1024, 1024, MALLOC_CAP_8BIT, 0));
+    heap_pool_destroy(NULL);
+}
+
+TEST_CASE("ISR safe object pool is in internal memory", "[heap]")
+{
+    heap_pool_handle_t pool = heap_pool_create(32, 4, MALLOC_CAP_8BIT, HEAP_POOL_FLAG_ISR_SAFE);
+    TEST_ASSERT_NOT_NULL(pool);
+
+    void *p = heap_pool_alloc(pool);
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT(esp_ptr_internal(p));
+    heap_pool_free(pool, p);
+
+    heap_pool_destroy(pool);
+}
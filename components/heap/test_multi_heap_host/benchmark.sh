@@ -0,0 +1,18 @@
+#!/usr/bin/env bash
+#
+# Run the allocation latency benchmarks for each heap allocator implementation
+#
+
+FAIL=0
+
+for FLAGS in "CONFIG_HEAP_ALLOCATOR_BEST_FIT" "CONFIG_HEAP_ALLOCATOR_TLSF"; do
+    echo "==== Benchmarking allocator: ${FLAGS} ===="
+    CPPFLAGS="-D${FLAGS} -DNDEBUG" make clean benchmark || FAIL=1
+done
+
+make clean
+
+if [ $FAIL != 0 ]; then
+    echo "Some benchmarks failed, see log."
+    exit 1
+fi
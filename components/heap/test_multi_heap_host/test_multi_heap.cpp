@@ -16,6 +16,11 @@
 #undef realloc
 #define realloc #error
 
+/* These tests use heaps of a few hundred bytes, which is too small to hold the TLSF allocator's control
+   structure, and check block placement details specific to the best-fit allocator.
+   See test_multi_heap_tlsf.cpp for the TLSF equivalents.
+*/
+#ifndef CONFIG_HEAP_ALLOCATOR_TLSF
 TEST_CASE("multi_heap simple allocations", "[multi_heap]")
 {
     uint8_t small_heap[128];
@@ -200,6 +205,7 @@ TEST_CASE("multi_heap defrag realloc", "[multi_heap]")
     REQUIRE( info.total_free_bytes == info2.total_free_bytes );
 }
 #endif
+#endif // CONFIG_HEAP_ALLOCATOR_TLSF
 
 
 TEST_CASE("multi_heap many random allocations", "[multi_heap]")
@@ -294,6 +300,7 @@ TEST_CASE("multi_heap many random allocations", "[multi_heap]")
     REQUIRE( initial_free == multi_heap_free_size(heap) );
 }
 
+#ifndef CONFIG_HEAP_ALLOCATOR_TLSF
 TEST_CASE("multi_heap_get_info() function", "[multi_heap]")
 {
     uint8_t heapdata[256];
@@ -346,6 +353,7 @@ TEST_CASE("multi_heap_get_info() function", "[multi_heap]")
     REQUIRE( before.total_free_bytes == freed.total_free_bytes );
     REQUIRE( after.minimum_free_bytes == freed.minimum_free_bytes );
 }
+#endif // CONFIG_HEAP_ALLOCATOR_TLSF
 
 TEST_CASE("multi_heap minimum-size allocations", "[multi_heap]")
 {
@@ -388,6 +396,7 @@ TEST_CASE("multi_heap minimum-size allocations", "[multi_heap]")
     REQUIRE( before_free == multi_heap_free_size(heap) );
 }
 
+#ifndef CONFIG_HEAP_ALLOCATOR_TLSF
 TEST_CASE("multi_heap_realloc()", "[multi_heap]")
 {
     const uint32_t PATTERN = 0xABABDADA;
@@ -494,6 +503,7 @@ TEST_CASE("unaligned heaps", "[multi_heap]")
         }
     }
 }
+#endif // CONFIG_HEAP_ALLOCATOR_TLSF
 
 TEST_CASE("multi_heap aligned allocations", "[multi_heap]")
 {
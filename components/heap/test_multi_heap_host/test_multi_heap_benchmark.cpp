@@ -0,0 +1,186 @@
+#include "catch.hpp"
+#include "multi_heap.h"
+
+#include "../multi_heap_config.h"
+#include "../multi_heap_platform.h"
+#include "../multi_heap_cache.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/* Allocation latency benchmarks
+
+   These tests are hidden from the default test run, use "make benchmark" or ./benchmark.sh
+   (to compare the heap allocator implementations.)
+*/
+
+#ifdef CONFIG_HEAP_ALLOCATOR_TLSF
+#define ALLOCATOR_NAME "TLSF"
+#else
+#define ALLOCATOR_NAME "best-fit"
+#endif
+
+class LatencyStats {
+public:
+    LatencyStats(const char *name) : name(name) { }
+
+    template<typename F>
+    auto measure(F f) -> decltype(f())
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto result = f();
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        return result;
+    }
+
+    void report()
+    {
+        if (samples.empty()) {
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        double total = 0;
+        for (auto s : samples) {
+            total += s;
+        }
+        printf("[%s] %-8s calls %7zu avg %8.1f ns p99 %8lld ns max %8lld ns\n",
+               ALLOCATOR_NAME, name, samples.size(), total / samples.size(),
+               (long long)samples[samples.size() * 99 / 100], (long long)samples.back());
+    }
+
+private:
+    const char *name;
+    std::vector<long long> samples;
+};
+
+static uint8_t bench_heap[256 * 1024];
+
+TEST_CASE("multi_heap allocation latency with fragmented heap", "[multi_heap][benchmark][.]")
+{
+    const int NUM_POINTERS = 4096;
+    const int ITERATIONS = 200000;
+    const size_t MAX_ALLOC = 512;
+
+    multi_heap_handle_t heap = multi_heap_register(bench_heap, sizeof(bench_heap));
+    REQUIRE( heap != NULL );
+
+    std::vector<void *> p(NUM_POINTERS, nullptr);
+    LatencyStats malloc_stats("malloc"), free_stats("free"), realloc_stats("realloc");
+
+    srand(0x1234);
+
+    /* fragment the heap: fill it up, then free every other block */
+    for (int i = 0; i < NUM_POINTERS; i++) {
+        p[i] = multi_heap_malloc(heap, 1 + rand() % MAX_ALLOC);
+    }
+    for (int i = 0; i < NUM_POINTERS; i += 2) {
+        multi_heap_free(heap, p[i]);
+        p[i] = nullptr;
+    }
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        int n = rand() % NUM_POINTERS;
+        size_t size = 1 + rand() % MAX_ALLOC;
+        if (p[n] == nullptr) {
+            p[n] = malloc_stats.measure([&] { return multi_heap_malloc(heap, size); });
+        } else if (rand() % 8 == 0) {
+            void *r = realloc_stats.measure([&] { return multi_heap_realloc(heap, p[n], size); });
+            if (r != nullptr) {
+                p[n] = r;
+            }
+        } else {
+            free_stats.measure([&] { multi_heap_free(heap, p[n]); return 0; });
+            p[n] = nullptr;
+        }
+    }
+
+    multi_heap_info_t info;
+    multi_heap_get_info(heap, &info);
+    printf("[%s] heap %zu bytes: %zu free in %zu free blocks, largest free block %zu\n", ALLOCATOR_NAME,
+           sizeof(bench_heap), info.total_free_bytes, info.free_blocks, info.largest_free_block);
+    malloc_stats.report();
+    free_stats.report();
+    realloc_stats.report();
+
+    REQUIRE( multi_heap_check(heap, true) );
+    for (int i = 0; i < NUM_POINTERS; i++) {
+        multi_heap_free(heap, p[i]);
+    }
+    REQUIRE( multi_heap_check(heap, true) );
+}
+
+/* Run 'num_threads' threads doing random small allocations and frees with 'alloc' & 'dealloc',
+   return the total throughput in operations per second */
+static double small_alloc_throughput(int num_threads, std::function<void *(size_t)> alloc, std::function<void(void *)> dealloc)
+{
+    const int ITERATIONS = 200000;
+    const int NUM_POINTERS = 64;
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t] {
+            unsigned seed = t;
+            void *p[NUM_POINTERS] = { 0 };
+            for (int i = 0; i < ITERATIONS; i++) {
+                int n = rand_r(&seed) % NUM_POINTERS;
+                if (p[n] == nullptr) {
+                    p[n] = alloc(16 + rand_r(&seed) % (MULTI_HEAP_CACHE_MAX_SIZE - 16));
+                } else {
+                    dealloc(p[n]);
+                    p[n] = nullptr;
+                }
+            }
+            for (int n = 0; n < NUM_POINTERS; n++) {
+                if (p[n] != nullptr) {
+                    dealloc(p[n]);
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return (double)num_threads * ITERATIONS / std::chrono::duration<double>(end - start).count();
+}
+
+TEST_CASE("multi_heap small object cache throughput with concurrent threads", "[multi_heap][cache][benchmark][.]")
+{
+    multi_heap_lock_t lock;
+    MULTI_HEAP_LOCK_INIT(&lock);
+    multi_heap_handle_t heap = multi_heap_register(bench_heap, sizeof(bench_heap));
+    REQUIRE( heap != NULL );
+    multi_heap_set_lock(heap, &lock);
+    multi_heap_cache_t *cache = multi_heap_cache_create(heap);
+    REQUIRE( cache != NULL );
+
+    for (int num_threads = 1; num_threads <= 8; num_threads *= 2) {
+        double direct = small_alloc_throughput(num_threads,
+                                               [&](size_t size) { return multi_heap_malloc(heap, size); },
+                                               [&](void *p) { multi_heap_free(heap, p); });
+
+        double cached = small_alloc_throughput(num_threads,
+                                               [&](size_t size) { return multi_heap_cache_malloc(cache, size); },
+                                               [&](void *p) {
+                                                   if (!multi_heap_cache_free(cache, p)) {
+                                                       multi_heap_free(heap, p);
+                                                   }
+                                               });
+        multi_heap_cache_flush(cache);
+
+        printf("[%s] %d threads: heap %10.0f ops/s, cache %10.0f ops/s (%.1fx)\n", ALLOCATOR_NAME,
+               num_threads, direct, cached, cached / direct);
+    }
+
+    REQUIRE( multi_heap_check(heap, true) );
+    pthread_mutex_destroy(&lock);
+}
@@ -0,0 +1,180 @@
+#include "catch.hpp"
+#include "multi_heap.h"
+
+#include "../multi_heap_config.h"
+#include "../multi_heap_platform.h"
+#include "../multi_heap_cache.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+/* Insurance against accidentally using libc heap functions in tests */
+#undef free
+#define free #error
+#undef malloc
+#define malloc #error
+#undef calloc
+#define calloc #error
+#undef realloc
+#define realloc #error
+
+static uint8_t cache_test_heap[64 * 1024];
+
+TEST_CASE("multi_heap cache allocations", "[multi_heap][cache]")
+{
+    multi_heap_handle_t heap = multi_heap_register(cache_test_heap, sizeof(cache_test_heap));
+    REQUIRE( heap != NULL );
+    multi_heap_cache_t *cache = multi_heap_cache_create(heap);
+    REQUIRE( cache != NULL );
+
+    size_t free_before = multi_heap_free_size(heap);
+    size_t cached_blocks;
+
+    REQUIRE( multi_heap_cache_malloc(cache, 0) == NULL );
+    REQUIRE( multi_heap_cache_malloc(cache, MULTI_HEAP_CACHE_MAX_SIZE + 1) == NULL );
+
+    /* sizes are rounded up to the size class */
+    void *a = multi_heap_cache_malloc(cache, 20);
+    REQUIRE( a != NULL );
+    REQUIRE( multi_heap_get_allocated_size(heap, a) == 32 );
+    memset(a, 0xEE, 32);
+
+    /* refill took a batch of blocks from the heap, all but one of them are held in the cache */
+    size_t cached = multi_heap_cache_get_info(cache, &cached_blocks);
+    REQUIRE( cached_blocks > 0 );
+    REQUIRE( cached == cached_blocks * 32 );
+
+    void *b = multi_heap_cache_malloc(cache, 32);
+    REQUIRE( b != NULL );
+    REQUIRE( b != a );
+    REQUIRE( multi_heap_cache_get_info(cache, NULL) == cached - 32 );
+
+    REQUIRE( multi_heap_cache_free(cache, a) );
+    REQUIRE( multi_heap_cache_free(cache, b) );
+    REQUIRE( multi_heap_cache_get_info(cache, NULL) == cached + 32 );
+    REQUIRE( multi_heap_check(heap, true) );
+
+    /* blocks which aren't exactly a size class aren't cached */
+    void *c = multi_heap_malloc(heap, 100);
+    REQUIRE( c != NULL );
+    REQUIRE( !multi_heap_cache_free(cache, c) );
+    multi_heap_free(heap, c);
+
+    multi_heap_cache_flush(cache);
+    REQUIRE( multi_heap_cache_get_info(cache, &cached_blocks) == 0 );
+    REQUIRE( cached_blocks == 0 );
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( multi_heap_free_size(heap) == free_before );
+}
+
+TEST_CASE("multi_heap cache depth is limited", "[multi_heap][cache]")
+{
+    multi_heap_handle_t heap = multi_heap_register(cache_test_heap, sizeof(cache_test_heap));
+    REQUIRE( heap != NULL );
+    multi_heap_cache_t *cache = multi_heap_cache_create(heap);
+    REQUIRE( cache != NULL );
+
+    const int NUM = MULTI_HEAP_CACHE_DEPTH * 4;
+    void *p[NUM];
+    size_t cached_blocks;
+
+    for (int i = 0; i < NUM; i++) {
+        p[i] = multi_heap_cache_malloc(cache, 64);
+        REQUIRE( p[i] != NULL );
+    }
+    for (int i = 0; i < NUM; i++) {
+        REQUIRE( multi_heap_cache_free(cache, p[i]) );
+        multi_heap_cache_get_info(cache, &cached_blocks);
+        REQUIRE( cached_blocks <= MULTI_HEAP_CACHE_DEPTH );
+    }
+    REQUIRE( multi_heap_check(heap, true) );
+}
+
+TEST_CASE("multi_heap cache when heap is full", "[multi_heap][cache]")
+{
+    multi_heap_handle_t heap = multi_heap_register(cache_test_heap, sizeof(cache_test_heap));
+    REQUIRE( heap != NULL );
+    multi_heap_cache_t *cache = multi_heap_cache_create(heap);
+    REQUIRE( cache != NULL );
+
+    size_t free_before = multi_heap_free_size(heap);
+    std::vector<void *> p;
+
+    /* fill the heap via the cache */
+    void *x;
+    while ((x = multi_heap_cache_malloc(cache, 256)) != NULL) {
+        memset(x, 0xAA, 256);
+        p.push_back(x);
+    }
+    REQUIRE( p.size() > sizeof(cache_test_heap) / 2 / 256 );
+    REQUIRE( multi_heap_check(heap, true) );
+
+    for (auto q : p) {
+        if (!multi_heap_cache_free(cache, q)) {
+            multi_heap_free(heap, q);
+        }
+    }
+    multi_heap_cache_flush(cache);
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( multi_heap_free_size(heap) == free_before );
+}
+
+TEST_CASE("multi_heap cache concurrent threads", "[multi_heap][cache]")
+{
+    const int NUM_THREADS = 4;
+    const int ITERATIONS = 20000;
+
+    multi_heap_lock_t lock;
+    MULTI_HEAP_LOCK_INIT(&lock);
+    multi_heap_handle_t heap = multi_heap_register(cache_test_heap, sizeof(cache_test_heap));
+    REQUIRE( heap != NULL );
+    multi_heap_set_lock(heap, &lock);
+    multi_heap_cache_t *cache = multi_heap_cache_create(heap);
+    REQUIRE( cache != NULL );
+
+    size_t free_before = multi_heap_free_size(heap);
+    bool ok[NUM_THREADS];
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; t++) {
+        threads.emplace_back([&, t] {
+            unsigned seed = t;
+            uint8_t *p[32] = { 0 };
+            ok[t] = true;
+            for (int i = 0; i < ITERATIONS; i++) {
+                int n = rand_r(&seed) % 32;
+                if (p[n] == NULL) {
+                    size_t size = 1 + rand_r(&seed) % MULTI_HEAP_CACHE_MAX_SIZE;
+                    p[n] = (uint8_t *)multi_heap_cache_malloc(cache, size);
+                    if (p[n] != NULL) {
+                        memset(p[n], t, size);
+                    }
+                } else {
+                    ok[t] = ok[t] && (p[n][0] == t);
+                    if (!multi_heap_cache_free(cache, p[n])) {
+                        multi_heap_free(heap, p[n]);
+                    }
+                    p[n] = NULL;
+                }
+            }
+            for (int n = 0; n < 32; n++) {
+                if (p[n] != NULL && !multi_heap_cache_free(cache, p[n])) {
+                    multi_heap_free(heap, p[n]);
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (int t = 0; t < NUM_THREADS; t++) {
+        REQUIRE( ok[t] );
+    }
+    multi_heap_cache_flush(cache);
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( multi_heap_free_size(heap) == free_before );
+    pthread_mutex_destroy(&lock);
+}
@@ -0,0 +1,200 @@
+#include "catch.hpp"
+#include "multi_heap.h"
+
+#include "../multi_heap_config.h"
+#include "../multi_heap_platform.h"
+#include "../multi_heap_pool.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/* Insurance against accidentally using libc heap functions in tests */
+#undef free
+#define free #error
+#undef malloc
+#define malloc #error
+#undef calloc
+#define calloc #error
+#undef realloc
+#define realloc #error
+
+TEST_CASE("multi_heap pool allocations", "[multi_heap][pool]")
+{
+    const size_t NUM = 10;
+    alignas(void *) uint8_t storage[1024];
+    REQUIRE( multi_heap_pool_storage_size(20, NUM) <= sizeof(storage) );
+
+    multi_heap_pool_handle_t pool = multi_heap_pool_init(storage, 20, NUM);
+    REQUIRE( pool != NULL );
+
+    heap_pool_info_t info;
+    multi_heap_pool_get_info(pool, &info);
+    REQUIRE( info.object_size == multi_heap_pool_object_size(20) );
+    REQUIRE( info.object_size >= 20 );
+    REQUIRE( info.total_objects == NUM );
+    REQUIRE( info.free_objects == NUM );
+
+    void *p[NUM];
+    for (size_t i = 0; i < NUM; i++) {
+        p[i] = multi_heap_pool_alloc(pool);
+        REQUIRE( p[i] != NULL );
+        REQUIRE( multi_heap_pool_contains(pool, p[i]) );
+        REQUIRE( (intptr_t)p[i] % sizeof(void *) == 0 );
+        memset(p[i], i, 20);
+    }
+    for (size_t i = 0; i < NUM; i++) {
+        for (int j = 0; j < 20; j++) {
+            REQUIRE( ((uint8_t *)p[i])[j] == i );
+        }
+    }
+
+    REQUIRE( multi_heap_pool_alloc(pool) == NULL );
+    multi_heap_pool_get_info(pool, &info);
+    REQUIRE( info.free_objects == 0 );
+    REQUIRE( info.minimum_free_objects == 0 );
+    REQUIRE( info.failed_allocs == 1 );
+
+    /* freed objects are reused, most recently freed first */
+    multi_heap_pool_free(pool, p[3]);
+    multi_heap_pool_free(pool, p[7]);
+    multi_heap_pool_free(pool, NULL);
+    REQUIRE( multi_heap_pool_alloc(pool) == p[7] );
+    REQUIRE( multi_heap_pool_alloc(pool) == p[3] );
+
+    for (size_t i = 0; i < NUM; i++) {
+        multi_heap_pool_free(pool, p[i]);
+    }
+    multi_heap_pool_get_info(pool, &info);
+    REQUIRE( info.free_objects == NUM );
+    REQUIRE( info.minimum_free_objects == 0 );
+}
+
+TEST_CASE("multi_heap pool invalid arguments", "[multi_heap][pool]")
+{
+    alignas(void *) uint8_t storage[64];
+
+    REQUIRE( multi_heap_pool_storage_size(0, 10) == 0 );
+    REQUIRE( multi_heap_pool_storage_size(SIZE_MAX / 4, 8) == 0 );
+    REQUIRE( multi_heap_pool_init(NULL, 16, 2) == NULL );
+    REQUIRE( multi_heap_pool_init(storage, 0, 2) == NULL );
+
+    /* objects are always big enough to hold the free list pointer */
+    REQUIRE( multi_heap_pool_object_size(1) == sizeof(void *) );
+
+    multi_heap_pool_handle_t pool = multi_heap_pool_init(storage, 1, 0);
+    REQUIRE( pool != NULL );
+    REQUIRE( multi_heap_pool_alloc(pool) == NULL );
+}
+
+TEST_CASE("multi_heap pool concurrent threads", "[multi_heap][pool]")
+{
+    const int NUM_THREADS = 4;
+    const int NUM_OBJECTS = 64;
+    const int ITERATIONS = 50000;
+
+    static uint8_t storage[8192];
+    REQUIRE( multi_heap_pool_storage_size(32, NUM_OBJECTS) <= sizeof(storage) );
+    multi_heap_pool_handle_t pool = multi_heap_pool_init(storage, 32, NUM_OBJECTS);
+    REQUIRE( pool != NULL );
+    multi_heap_lock_t lock;
+    MULTI_HEAP_LOCK_INIT(&lock);
+    multi_heap_pool_set_lock(pool, &lock);
+
+    bool ok[NUM_THREADS];
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; t++) {
+        threads.emplace_back([&, t] {
+            uint8_t *p[8] = { 0 };
+            ok[t] = true;
+            for (int i = 0; i < ITERATIONS; i++) {
+                int n = i % 8;
+                if (p[n] == NULL) {
+                    p[n] = (uint8_t *)multi_heap_pool_alloc(pool);
+                    if (p[n] != NULL) {
+                        memset(p[n], t, 32);
+                    }
+                } else {
+                    ok[t] = ok[t] && p[n][0] == t && p[n][31] == t;
+                    multi_heap_pool_free(pool, p[n]);
+                    p[n] = NULL;
+                }
+            }
+            for (int n = 0; n < 8; n++) {
+                multi_heap_pool_free(pool, p[n]);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    heap_pool_info_t info;
+    multi_heap_pool_get_info(pool, &info);
+    for (int t = 0; t < NUM_THREADS; t++) {
+        REQUIRE( ok[t] );
+    }
+    REQUIRE( info.free_objects == NUM_OBJECTS );
+    REQUIRE( info.failed_allocs == 0 );
+    pthread_mutex_destroy(&lock);
+}
+
+/* Hidden micro-benchmark, compares pool allocation with allocating the same objects
+   from a multi_heap (which is what heap_caps_malloc() does on the target.) */
+TEST_CASE("multi_heap pool vs heap allocation speed", "[multi_heap][pool][benchmark][.]")
+{
+    const int NUM_OBJECTS = 256;
+    const int ROUNDS = 2000;
+    static uint8_t heap_storage[128 * 1024];
+    static uint8_t pool_storage[64 * 1024];
+    const size_t sizes[] = { 32, 64, 128 };
+
+    for (size_t size : sizes) {
+        multi_heap_handle_t heap = multi_heap_register(heap_storage, sizeof(heap_storage));
+        REQUIRE( heap != NULL );
+        multi_heap_pool_handle_t pool = multi_heap_pool_init(pool_storage, size, NUM_OBJECTS);
+        REQUIRE( pool != NULL );
+        multi_heap_lock_t heap_lock, pool_lock;
+        MULTI_HEAP_LOCK_INIT(&heap_lock);
+        MULTI_HEAP_LOCK_INIT(&pool_lock);
+        multi_heap_set_lock(heap, &heap_lock);
+        multi_heap_pool_set_lock(pool, &pool_lock);
+
+        void *p[NUM_OBJECTS];
+
+        /* alloc all objects, then free every other object and allocate those again, to mimic
+           a heap where other allocations are interleaved */
+        auto run = [&](std::function<void *()> alloc, std::function<void(void *)> dealloc) {
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < ROUNDS; r++) {
+                for (int i = 0; i < NUM_OBJECTS; i++) {
+                    p[i] = alloc();
+                }
+                for (int i = 0; i < NUM_OBJECTS; i += 2) {
+                    dealloc(p[i]);
+                }
+                for (int i = 0; i < NUM_OBJECTS; i += 2) {
+                    p[i] = alloc();
+                }
+                for (int i = 0; i < NUM_OBJECTS; i++) {
+                    dealloc(p[i]);
+                }
+            }
+            auto end = std::chrono::steady_clock::now();
+            return std::chrono::duration<double, std::nano>(end - start).count() / (ROUNDS * NUM_OBJECTS * 3 / 2);
+        };
+
+        double heap_ns = run([&] { return multi_heap_malloc(heap, size); }, [&](void *x) { multi_heap_free(heap, x); });
+        double pool_ns = run([&] { return multi_heap_pool_alloc(pool); }, [&](void *x) { multi_heap_pool_free(pool, x); });
+
+        printf("%3zu byte objects: heap %6.1f ns per alloc+free, pool %6.1f ns (%.1fx)\n",
+               size, heap_ns, pool_ns, heap_ns / pool_ns);
+
+        REQUIRE( multi_heap_check(heap, true) );
+        pthread_mutex_destroy(&heap_lock);
+        pthread_mutex_destroy(&pool_lock);
+    }
+}
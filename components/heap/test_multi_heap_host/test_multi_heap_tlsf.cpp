@@ -0,0 +1,224 @@
+#include "catch.hpp"
+#include "multi_heap.h"
+
+#include "../multi_heap_config.h"
+
+#include <string.h>
+#include <assert.h>
+
+/* Tests specific to the TLSF allocator (CONFIG_HEAP_ALLOCATOR_TLSF).
+
+   Equivalent to the small heap tests in test_multi_heap.cpp, using heaps big enough to hold the TLSF
+   control structure and without assumptions about best-fit block placement.
+*/
+#ifdef CONFIG_HEAP_ALLOCATOR_TLSF
+
+/* Insurance against accidentally using libc heap functions in tests */
+#undef free
+#define free #error
+#undef malloc
+#define malloc #error
+#undef calloc
+#define calloc #error
+#undef realloc
+#define realloc #error
+
+TEST_CASE("multi_heap TLSF simple allocations", "[multi_heap][tlsf]")
+{
+    uint8_t small_heap[4096];
+
+    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+    REQUIRE( heap != NULL );
+
+    size_t test_alloc_size = (multi_heap_free_size(heap) + 4) / 2;
+
+    uint8_t *buf = (uint8_t *)multi_heap_malloc(heap, test_alloc_size);
+    REQUIRE( buf != NULL );
+    REQUIRE( (intptr_t)buf >= (intptr_t)small_heap );
+    REQUIRE( (intptr_t)buf < (intptr_t)(small_heap + sizeof(small_heap)) );
+
+    REQUIRE( multi_heap_get_allocated_size(heap, buf) >= test_alloc_size );
+    REQUIRE( multi_heap_get_allocated_size(heap, buf) < test_alloc_size + 16 );
+
+    memset(buf, 0xEE, test_alloc_size);
+
+    REQUIRE( multi_heap_malloc(heap, test_alloc_size) == NULL );
+
+    multi_heap_free(heap, buf);
+    REQUIRE( multi_heap_check(heap, true) );
+
+    /* Now there should be space for another allocation */
+    buf = (uint8_t *)multi_heap_malloc(heap, test_alloc_size);
+    REQUIRE( buf != NULL );
+    multi_heap_free(heap, buf);
+
+    REQUIRE( multi_heap_free_size(heap) > multi_heap_minimum_free_size(heap) );
+}
+
+/* Test that malloc/free coalesces free blocks on both sides */
+TEST_CASE("multi_heap TLSF defrag", "[multi_heap][tlsf]")
+{
+    void *p[4];
+    uint8_t small_heap[4096];
+    multi_heap_info_t info, info2;
+    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+    REQUIRE( heap != NULL );
+
+    multi_heap_get_info(heap, &info);
+    REQUIRE( 0 == info.allocated_blocks );
+    REQUIRE( 1 == info.free_blocks );
+
+    for (int i = 0; i < 4; i++) {
+        p[i] = multi_heap_malloc(heap, 100 + i * 40);
+        REQUIRE( p[i] != NULL );
+        REQUIRE( multi_heap_check(heap, true) );
+    }
+
+    /* free out of order, so blocks are merged with both the previous and following block */
+    multi_heap_free(heap, p[0]);
+    multi_heap_free(heap, p[2]);
+    REQUIRE( multi_heap_check(heap, true) );
+    multi_heap_free(heap, p[1]);
+    REQUIRE( multi_heap_check(heap, true) );
+
+    multi_heap_get_info(heap, &info2);
+    REQUIRE( 1 == info2.allocated_blocks );
+    REQUIRE( 2 == info2.free_blocks );
+
+    multi_heap_free(heap, p[3]);
+    multi_heap_get_info(heap, &info2);
+    REQUIRE( 0 == info2.allocated_blocks );
+    REQUIRE( 1 == info2.free_blocks );
+    REQUIRE( info.total_free_bytes == info2.total_free_bytes );
+}
+
+TEST_CASE("multi_heap TLSF get_info", "[multi_heap][tlsf]")
+{
+    uint8_t heapdata[4096];
+    multi_heap_handle_t heap = multi_heap_register(heapdata, sizeof(heapdata));
+    multi_heap_info_t before, after, freed;
+    REQUIRE( heap != NULL );
+
+    multi_heap_get_info(heap, &before);
+    REQUIRE( 0 == before.allocated_blocks );
+    REQUIRE( 0 == before.total_allocated_bytes );
+    REQUIRE( before.total_free_bytes == before.minimum_free_bytes );
+
+    void *x = multi_heap_malloc(heap, 32);
+    multi_heap_get_info(heap, &after);
+    REQUIRE( 1 == after.allocated_blocks );
+    REQUIRE( 32 == after.total_allocated_bytes );
+    REQUIRE( after.minimum_free_bytes < before.minimum_free_bytes );
+    REQUIRE( after.minimum_free_bytes > 0 );
+
+    multi_heap_free(heap, x);
+    multi_heap_get_info(heap, &freed);
+    REQUIRE( 0 == freed.allocated_blocks );
+    REQUIRE( 0 == freed.total_allocated_bytes );
+    REQUIRE( before.total_free_bytes == freed.total_free_bytes );
+    REQUIRE( after.minimum_free_bytes == freed.minimum_free_bytes );
+}
+
+TEST_CASE("multi_heap TLSF realloc", "[multi_heap][tlsf]")
+{
+    const uint32_t PATTERN = 0xABABDADA;
+    uint8_t small_heap[4096];
+    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+    REQUIRE( heap != NULL );
+
+    uint32_t *a = (uint32_t *)multi_heap_malloc(heap, 64);
+    uint32_t *b = (uint32_t *)multi_heap_malloc(heap, 32);
+    REQUIRE( a != NULL );
+    REQUIRE( b != NULL );
+
+    *a = PATTERN;
+
+    uint32_t *c = (uint32_t *)multi_heap_realloc(heap, a, 72);
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( c != NULL );
+    REQUIRE( c != a ); /* 'a' is followed by 'b', so it has to move */
+    REQUIRE( *c == PATTERN );
+
+#ifndef MULTI_HEAP_POISONING_SLOW
+    // "Slow" poisoning implementation doesn't reallocate in place
+    uint32_t *d = (uint32_t *)multi_heap_realloc(heap, c, 36);
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( c == d ); /* 'c' block should be shrunk in-place */
+    REQUIRE( *d == PATTERN );
+
+    uint32_t *e = (uint32_t *)multi_heap_malloc(heap, 200);
+    REQUIRE( e != NULL );
+    uint32_t *f = (uint32_t *)multi_heap_malloc(heap, 200);
+    REQUIRE( f != NULL );
+    *e = PATTERN;
+    multi_heap_free(heap, f);
+
+    /* grows in place if the following block is free */
+    uint32_t *g = (uint32_t *)multi_heap_realloc(heap, e, 300);
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( e == g );
+    REQUIRE( *g == PATTERN );
+#endif
+}
+
+TEST_CASE("multi_heap TLSF corrupt heap block", "[multi_heap][tlsf]")
+{
+    uint8_t small_heap[4096];
+    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+    REQUIRE( heap != NULL );
+
+    void *a = multi_heap_malloc(heap, 32);
+    REQUIRE( multi_heap_check(heap, true) );
+    memset(a, 0xEE, 64);
+    REQUIRE( !multi_heap_check(heap, true) );
+}
+
+TEST_CASE("multi_heap TLSF unaligned heaps", "[multi_heap][tlsf]")
+{
+    const size_t CHUNK_LEN = 4096;
+    const size_t CANARY_LEN = 16;
+    const uint8_t CANARY_BYTE = 0x3E;
+    uint8_t heap_chunk[CHUNK_LEN + CANARY_LEN * 2];
+
+    /* Put some canary bytes before and after the bytes we intend to use for
+       the heap, make sure they aren't ever overwritten */
+    memset(heap_chunk, CANARY_BYTE, CANARY_LEN);
+    memset(heap_chunk + CANARY_LEN + CHUNK_LEN, CANARY_BYTE, CANARY_LEN);
+
+    for (int i = 0; i < 8; i++) {
+        multi_heap_handle_t heap = multi_heap_register(heap_chunk + CANARY_LEN + i, CHUNK_LEN - i);
+        multi_heap_info_t info;
+        REQUIRE( heap != NULL );
+
+        REQUIRE( multi_heap_check(heap, true) );
+
+        multi_heap_get_info(heap, &info);
+
+        REQUIRE( info.total_free_bytes > CHUNK_LEN / 2 );
+        REQUIRE( info.largest_free_block == info.total_free_bytes );
+
+        /* largest free block must be allocatable, even though it isn't in a size class above the request */
+        void *a = multi_heap_malloc(heap, info.largest_free_block);
+        REQUIRE( a != NULL );
+        memset(a, 0xAA, info.largest_free_block);
+
+        REQUIRE( multi_heap_check(heap, true) );
+
+        multi_heap_free(heap, a);
+
+        REQUIRE( multi_heap_check(heap, true) );
+
+        for (unsigned j = 0; j < CANARY_LEN; j++) { // check canaries
+            REQUIRE( heap_chunk[j] == CANARY_BYTE );
+            REQUIRE( heap_chunk[CHUNK_LEN + CANARY_LEN + j] == CANARY_BYTE );
+        }
+    }
+}
+
+TEST_CASE("multi_heap TLSF too small heap", "[multi_heap][tlsf]")
+{
+    uint8_t small_heap[64];
+    REQUIRE( multi_heap_register(small_heap, sizeof(small_heap)) == NULL );
+}
+
+#endif // CONFIG_HEAP_ALLOCATOR_TLSF
@@ -7,8 +7,11 @@
 # We assume that FreeRTOS is always included into the build with GNU Make.
 ifndef IS_BOOTLOADER_BUILD
 COMPONENT_OBJEXCLUDE := log_noos.o
+ifndef CONFIG_LOG_DEFERRED
+COMPONENT_OBJEXCLUDE += log_deferred.o
+endif
 else
-COMPONENT_OBJEXCLUDE := log_freertos.o
+COMPONENT_OBJEXCLUDE := log_freertos.o log_deferred.o
 endif
 
 COMPONENT_ADD_LDFRAGMENTS += linker.lf
@@ -1,6 +1,14 @@
 #pragma once
 #include <stdbool.h>
+#include <stdarg.h>
+#include "esp_log.h"
 
 void esp_log_impl_lock(void);
 bool esp_log_impl_lock_timeout(void);
 void esp_log_impl_unlock(void);
+
+// Output through the function set by esp_log_set_vprintf
+int esp_log_impl_printf(const char *format, ...);
+
+// Store the message for deferred output. Returns false if it has to be written synchronously.
+bool esp_log_deferred_writev(esp_log_level_t level, const char *format, va_list args);
@@ -17,6 +17,7 @@
 
 #include <stdint.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include "sdkconfig.h"
 #if CONFIG_IDF_TARGET_ESP32
 #include "esp32/rom/ets_sys.h"
@@ -134,6 +135,64 @@ void esp_log_write(esp_log_level_t level, const char* tag, const char* format, .
  */
 void esp_log_writev(esp_log_level_t level, const char* tag, const char* format, va_list args);
 
+/** Level of a tag descriptor which has not been used yet */
+#define ESP_LOG_TAG_LEVEL_UNSET 0xff
+
+/**
+ * @brief Log tag descriptor
+ *
+ * Declared with ESP_LOG_TAG_DEFINE and used with the ESP_TAG_LOGx macros.
+ * The descriptor holds the current level of the tag, so the level check
+ * of a log statement is a single load and compare, without any lookup
+ * or locking. The members should not be accessed directly.
+ */
+typedef struct esp_log_tag_ {
+    const char *name;               /*!< Tag name */
+    volatile uint8_t level;         /*!< Level of the tag, ESP_LOG_TAG_LEVEL_UNSET until the first log statement */
+    struct esp_log_tag_ *next;      /*!< Next descriptor in the list updated by esp_log_level_set */
+} esp_log_tag_t;
+
+/**
+ * @brief Write message into the log, using a tag descriptor
+ *
+ * This function is not intended to be used directly. Instead, use one of
+ * ESP_TAG_LOGE, ESP_TAG_LOGW, ESP_TAG_LOGI, ESP_TAG_LOGD, ESP_TAG_LOGV macros.
+ *
+ * This function or these macros should not be used from an interrupt.
+ */
+void esp_log_tag_write(esp_log_tag_t *tag, esp_log_level_t level, const char* format, ...) __attribute__ ((format (printf, 3, 4)));
+
+/**
+ * @brief Write message into the log using a tag descriptor, va_list variant
+ * @see esp_log_tag_write()
+ */
+void esp_log_tag_writev(esp_log_tag_t *tag, esp_log_level_t level, const char* format, va_list args);
+
+#if CONFIG_LOG_DEFERRED
+/**
+ * @brief Output all pending deferred log messages
+ *
+ * With CONFIG_LOG_DEFERRED, log messages are stored in a per-core buffer
+ * and formatted later by a low priority task. This function outputs the
+ * pending messages in the context of the caller, for example before
+ * entering deep sleep or restarting.
+ *
+ * This function should not be called from an interrupt.
+ */
+void esp_log_deferred_flush(void);
+
+/**
+ * @brief Enable or disable deferred logging at runtime
+ *
+ * Deferred logging is enabled by default if CONFIG_LOG_DEFERRED is set.
+ * While it is disabled, messages are formatted and output by the caller.
+ * Disabling it outputs all pending messages first.
+ *
+ * @param enable true to store messages for deferred output, false to output them immediately
+ */
+void esp_log_deferred_enable(bool enable);
+#endif // CONFIG_LOG_DEFERRED
+
 /** @cond */
 
 #include "esp_log_internal.h"
@@ -382,6 +441,79 @@ void esp_log_writev(esp_log_level_t level, const char* tag, const char* format,
         }} while(0)
 /** @endcond */
 
+/**
+ * @brief Define a log tag descriptor
+ *
+ * Defines a static descriptor variable for the ESP_TAG_LOGx macros, e.g.:
+ *
+ *      ESP_LOG_TAG_DEFINE(TAG, my_module);
+ *      ...
+ *      ESP_TAG_LOGI(TAG, "value %d", value);
+ *
+ * The level of the tag can be changed at runtime with
+ * ``esp_log_level_set("my_module", level)`` like the level of any other tag.
+ * If CONFIG_LOG_TAG_LEVEL_TABLE has an entry for the tag, log statements above
+ * the level given there are removed at compile time.
+ *
+ * @param var      name of the descriptor variable
+ * @param tag_name tag name, must be a valid C identifier
+ */
+#define ESP_LOG_TAG_DEFINE(var, tag_name) \
+    enum { _ESP_LOG_TAG_MAX_LEVEL_##var = ESP_LOG_TAG_LIMIT(tag_name) }; \
+    static esp_log_tag_t var __attribute__((unused)) = { .name = #tag_name, .level = ESP_LOG_TAG_LEVEL_UNSET, .next = NULL }
+
+/** @cond */
+/* CONFIG_LOG_TAG_LEVEL_TABLE entries are passed to the compiler as
+ * -DESP_LOG_TAG_LIMIT_<tag_name>=ESP_LOG_TAG_LIMITED(<letter>). The ", level"
+ * this expands to shifts the level into the second argument of
+ * _ESP_LOG_SECOND, otherwise it picks ESP_LOG_VERBOSE.
+ */
+#define ESP_LOG_TAG_LIMITED(letter) ~, _ESP_LOG_TAG_LEVEL_##letter
+#define ESP_LOG_TAG_LIMIT(tag_name) _ESP_LOG_TAG_SELECT(ESP_LOG_TAG_LIMIT_##tag_name, ESP_LOG_VERBOSE)
+#define _ESP_LOG_TAG_SELECT(limit, default_level) _ESP_LOG_SECOND(limit, default_level, ~)
+#define _ESP_LOG_SECOND(first, second, ...) second
+
+#define _ESP_LOG_TAG_LEVEL_N ESP_LOG_NONE
+#define _ESP_LOG_TAG_LEVEL_E ESP_LOG_ERROR
+#define _ESP_LOG_TAG_LEVEL_W ESP_LOG_WARN
+#define _ESP_LOG_TAG_LEVEL_I ESP_LOG_INFO
+#define _ESP_LOG_TAG_LEVEL_D ESP_LOG_DEBUG
+#define _ESP_LOG_TAG_LEVEL_V ESP_LOG_VERBOSE
+
+#define _ESP_LOG_TAG_ENABLED(tag, log_level) \
+    (LOG_LOCAL_LEVEL >= (log_level) && (int) _ESP_LOG_TAG_MAX_LEVEL_##tag >= (int) (log_level))
+/** @endcond */
+
+/// macro to output logs at ``ESP_LOG_ERROR`` level, using a tag descriptor defined with ``ESP_LOG_TAG_DEFINE``. @see ``ESP_LOGE``
+#define ESP_TAG_LOGE( tag, format, ... ) ESP_TAG_LOG_IMPL(tag, format, ESP_LOG_ERROR,   E, ##__VA_ARGS__)
+/// macro to output logs at ``ESP_LOG_WARN`` level, using a tag descriptor.  @see ``ESP_TAG_LOGE``
+#define ESP_TAG_LOGW( tag, format, ... ) ESP_TAG_LOG_IMPL(tag, format, ESP_LOG_WARN,    W, ##__VA_ARGS__)
+/// macro to output logs at ``ESP_LOG_INFO`` level, using a tag descriptor.  @see ``ESP_TAG_LOGE``
+#define ESP_TAG_LOGI( tag, format, ... ) ESP_TAG_LOG_IMPL(tag, format, ESP_LOG_INFO,    I, ##__VA_ARGS__)
+/// macro to output logs at ``ESP_LOG_DEBUG`` level, using a tag descriptor.  @see ``ESP_TAG_LOGE``
+#define ESP_TAG_LOGD( tag, format, ... ) ESP_TAG_LOG_IMPL(tag, format, ESP_LOG_DEBUG,   D, ##__VA_ARGS__)
+/// macro to output logs at ``ESP_LOG_VERBOSE`` level, using a tag descriptor.  @see ``ESP_TAG_LOGE``
+#define ESP_TAG_LOGV( tag, format, ... ) ESP_TAG_LOG_IMPL(tag, format, ESP_LOG_VERBOSE, V, ##__VA_ARGS__)
+
+/** @cond */
+#if defined(BOOTLOADER_BUILD)
+#define ESP_TAG_LOG_IMPL(tag, format, log_level, log_tag_letter, ...) do {                          \
+        if (_ESP_LOG_TAG_ENABLED(tag, log_level)) {                                                  \
+            ESP_LOG_EARLY_IMPL((tag).name, format, log_level, log_tag_letter, ##__VA_ARGS__);       \
+        }} while(0)
+#elif CONFIG_LOG_TIMESTAMP_SOURCE_RTOS
+#define ESP_TAG_LOG_IMPL(tag, format, log_level, log_tag_letter, ...) do {                          \
+        if (_ESP_LOG_TAG_ENABLED(tag, log_level) && (log_level) <= (tag).level) {                   \
+            esp_log_tag_write(&(tag), log_level, LOG_FORMAT(log_tag_letter, format), esp_log_timestamp(), (tag).name, ##__VA_ARGS__); \
+        }} while(0)
+#elif CONFIG_LOG_TIMESTAMP_SOURCE_SYSTEM
+#define ESP_TAG_LOG_IMPL(tag, format, log_level, log_tag_letter, ...) do {                          \
+        if (_ESP_LOG_TAG_ENABLED(tag, log_level) && (log_level) <= (tag).level) {                   \
+            esp_log_tag_write(&(tag), log_level, LOG_SYSTEM_TIME_FORMAT(log_tag_letter, format), esp_log_system_timestamp(), (tag).name, ##__VA_ARGS__); \
+        }} while(0)
+#endif
+/** @endcond */
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,6 +34,12 @@
  * than 4 billion log entries, at which point wrap-around will not be
  * the biggest problem.
  *
+ * Tags declared with ESP_LOG_TAG_DEFINE bypass the cache: the descriptor
+ * holds the level of the tag, which the ESP_TAG_LOGx macros check before
+ * calling into this library. On first use, the level is looked up in the
+ * linked list and the descriptor is added to s_log_tag_descs, which
+ * esp_log_level_set walks to update the levels of matching descriptors.
+ *
  */
 
 #include <stdbool.h>
@@ -75,6 +81,7 @@ static cached_tag_entry_t s_log_cache[TAG_CACHE_SIZE];
 static uint32_t s_log_cache_max_generation = 0;
 static uint32_t s_log_cache_entry_count = 0;
 static vprintf_like_t s_log_print_func = &vprintf;
+static esp_log_tag_t *s_log_tag_descs = NULL;
 
 #ifdef LOG_BUILTIN_CHECKS
 static uint32_t s_log_cache_misses = 0;
@@ -88,6 +95,8 @@ static void heap_bubble_down(int index);
 static inline void heap_swap(int i, int j);
 static inline bool should_output(esp_log_level_t level_for_message, esp_log_level_t level_for_tag);
 static inline void clear_log_level_list(void);
+static inline void update_tag_descs(const char *tag, esp_log_level_t level);
+static void log_output(esp_log_level_t level, const char *format, va_list args);
 
 vprintf_like_t esp_log_set_vprintf(vprintf_like_t func)
 {
@@ -106,6 +115,7 @@ void esp_log_level_set(const char *tag, esp_log_level_t level)
     if (strcmp(tag, "*") == 0) {
         s_log_default_level = level;
         clear_log_level_list();
+        update_tag_descs(NULL, level);
         esp_log_impl_unlock();
         return;
     }
@@ -145,9 +155,20 @@ void esp_log_level_set(const char *tag, esp_log_level_t level)
             break;
         }
     }
+    update_tag_descs(tag, level);
     esp_log_impl_unlock();
 }
 
+static inline void update_tag_descs(const char *tag, esp_log_level_t level)
+{
+    // NULL tag updates all descriptors
+    for (esp_log_tag_t *it = s_log_tag_descs; it != NULL; it = it->next) {
+        if (tag == NULL || strcmp(it->name, tag) == 0) {
+            it->level = level;
+        }
+    }
+}
+
 void clear_log_level_list(void)
 {
     uncached_tag_entry_t *it;
@@ -185,9 +206,53 @@ void esp_log_writev(esp_log_level_t level,
     if (!should_output(level, level_for_tag)) {
         return;
     }
+    log_output(level, format, args);
+}
 
+void esp_log_tag_writev(esp_log_tag_t *tag,
+                        esp_log_level_t level,
+                        const char *format,
+                        va_list args)
+{
+    if (tag->level == ESP_LOG_TAG_LEVEL_UNSET) {
+        if (!esp_log_impl_lock_timeout()) {
+            return;
+        }
+        // check again, another task could have registered it meanwhile
+        if (tag->level == ESP_LOG_TAG_LEVEL_UNSET) {
+            esp_log_level_t level_for_tag;
+            if (!get_uncached_log_level(tag->name, &level_for_tag)) {
+                level_for_tag = s_log_default_level;
+            }
+            tag->next = s_log_tag_descs;
+            s_log_tag_descs = tag;
+            tag->level = level_for_tag;
+        }
+        esp_log_impl_unlock();
+    }
+    if (!should_output(level, tag->level)) {
+        return;
+    }
+    log_output(level, format, args);
+}
+
+static void log_output(esp_log_level_t level, const char *format, va_list args)
+{
+#if CONFIG_LOG_DEFERRED && !BOOTLOADER_BUILD
+    if (esp_log_deferred_writev(level, format, args)) {
+        return;
+    }
+#endif
     (*s_log_print_func)(format, args);
+}
 
+int esp_log_impl_printf(const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    int ret = (*s_log_print_func)(format, list);
+    va_end(list);
+    return ret;
 }
 
 void esp_log_write(esp_log_level_t level,
@@ -200,6 +265,16 @@ void esp_log_write(esp_log_level_t level,
     va_end(list);
 }
 
+void esp_log_tag_write(esp_log_tag_t *tag,
+                       esp_log_level_t level,
+                       const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    esp_log_tag_writev(tag, level, format, list);
+    va_end(list);
+}
+
 static inline bool get_cached_log_level(const char *tag, esp_log_level_t *level)
 {
     // Look for `tag` in cache
@@ -0,0 +1,578 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Deferred logging implementation notes.
+ *
+ * Instead of formatting the message in the context of the caller,
+ * esp_log_writev() stores the format string pointer and the raw arguments
+ * as a record in a buffer of the current core. A low priority task formats
+ * the records later, or outputs them as base64 encoded binary lines, which
+ * tools/esp_log_decode.py turns back into text using the format strings
+ * from the ELF file.
+ *
+ * Each core only writes to its own buffer, so the cores don't contend with
+ * each other. Tasks and ISRs on the same core reserve space by advancing
+ * the write offset with an atomic compare-and-set, copy the record and
+ * store its header word last. The reader stops at the first header which
+ * is still zero, and zeroes the records it has consumed before releasing
+ * their space, so a reserved but unfinished record is never read.
+ *
+ * Write and read offsets are free running byte counters, the buffer size
+ * is a power of two. A record never wraps around the end of the buffer,
+ * the space up to the end is filled with a padding record instead.
+ *
+ * Record layout, in 32-bit words:
+ *
+ * - header: length in words (bits 0-15), log level (bits 16-18),
+ *   record type (bits 24-31)
+ * - format string pointer
+ * - arguments: one word for each argument of up to 4 bytes (including '*'
+ *   width and precision), two words for 64-bit integers and doubles.
+ *   Strings in flash are stored as a pointer, other strings are copied:
+ *   a word (STR_INLINE | length) followed by the characters, padded to a
+ *   multiple of 4 bytes.
+ */
+
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/lock.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "soc/soc_memory_layout.h"
+#include "esp_log.h"
+#include "esp_log_private.h"
+#include "sdkconfig.h"
+
+#define BUFFER_SIZE             CONFIG_LOG_DEFERRED_BUFFER_SIZE
+#define BUFFER_WORDS            (BUFFER_SIZE / sizeof(uint32_t))
+#define MAX_STRING_LEN          CONFIG_LOG_DEFERRED_MAX_STRING_LEN
+
+_Static_assert((BUFFER_SIZE & (BUFFER_SIZE - 1)) == 0, "CONFIG_LOG_DEFERRED_BUFFER_SIZE must be a power of two");
+
+// Maximum size of one record, messages with larger records are written synchronously
+#define MAX_RECORD_WORDS        64
+
+#define HEADER_LEN_MASK         0xffff
+#define HEADER_LEVEL_SHIFT      16
+#define HEADER_LEVEL_MASK       0x7
+#define HEADER_TYPE_SHIFT       24
+#define RECORD_TYPE_LOG         0xb1
+#define RECORD_TYPE_PADDING     0xb0
+
+#define STR_INLINE              0xffff0000
+#define STR_INLINE_MASK         0xffff0000
+#define STR_INLINE_LEN_MASK     0x0000ffff
+
+// Prefix of binary output lines, must match tools/esp_log_decode.py
+#define BINARY_LINE_PREFIX      "#B:"
+
+typedef enum {
+    ARG_NONE,       // "%%", no argument
+    ARG_INT,
+    ARG_LONG,
+    ARG_LLONG,
+    ARG_INTMAX,
+    ARG_SIZE,
+    ARG_PTRDIFF,
+    ARG_PTR,
+    ARG_DOUBLE,
+    ARG_LDOUBLE,
+    ARG_STR,
+    ARG_COUNT,      // "%n", argument is consumed but not stored
+    ARG_INVALID,    // unknown conversion, rest of the format string is output as is
+} arg_type_t;
+
+typedef struct {
+    const char *start;          // '%' of the conversion specification
+    const char *end;            // character after the conversion specifier
+    arg_type_t type;
+    bool star_width;
+    bool star_precision;
+    int precision;              // -1 if not given or given as '*'
+} conv_spec_t;
+
+typedef struct {
+    volatile uint32_t write;    // bytes reserved so far, advanced by writers on the buffer's core
+    volatile uint32_t read;     // bytes consumed so far, advanced by the reader
+    volatile uint32_t dropped;  // records dropped because the buffer was full
+    uint32_t data[BUFFER_WORDS];
+} log_buffer_t;
+
+static log_buffer_t s_buffers[portNUM_PROCESSORS];
+static bool s_enabled = true;
+static TaskHandle_t s_task = NULL;
+static volatile uint32_t s_task_starting = 0;
+static _lock_t s_flush_lock;
+
+// Line buffer of the reader, protected by s_flush_lock
+static char s_line[256];
+static size_t s_line_len;
+
+static bool next_conversion(const char *format, conv_spec_t *spec);
+static void start_task(void);
+
+static inline uint32_t atomic_add(volatile uint32_t *addr, uint32_t value)
+{
+    uint32_t old, set;
+    do {
+        old = *addr;
+        set = old + value;
+        uxPortCompareSet(addr, old, &set);
+    } while (set != old);
+    return old;
+}
+
+static inline bool put_bytes(uint32_t *record, size_t *len, const void *data, size_t size)
+{
+    if (size == 0) {
+        return true;
+    }
+    size_t words = (size + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+    if (*len + words > MAX_RECORD_WORDS) {
+        return false;
+    }
+    record[*len + words - 1] = 0;   // zero the padding of the last word
+    memcpy(&record[*len], data, size);
+    *len += words;
+    return true;
+}
+
+static inline bool put_word(uint32_t *record, size_t *len, uint32_t word)
+{
+    return put_bytes(record, len, &word, sizeof(word));
+}
+
+static bool put_string(uint32_t *record, size_t *len, const char *str, int precision)
+{
+    // Strings in flash stay valid, and the host tool can read them from the ELF file
+    if (str == NULL || esp_ptr_in_drom(str)) {
+        return put_word(record, len, (uint32_t) str);
+    }
+    size_t max_len = (precision >= 0 && precision < MAX_STRING_LEN) ? precision : MAX_STRING_LEN;
+    size_t str_len = strnlen(str, max_len);
+    return put_word(record, len, STR_INLINE | str_len) && put_bytes(record, len, str, str_len);
+}
+
+#define PUT_ARG(type) do { \
+        type value = va_arg(args, type); \
+        ok = put_bytes(record, &len, &value, sizeof(value)); \
+    } while(0)
+
+static bool serialize(uint32_t *record, size_t *out_len, esp_log_level_t level, const char *format, va_list args)
+{
+    size_t len = 2;
+    record[1] = (uint32_t) format;
+    bool ok = true;
+    conv_spec_t spec;
+    const char *p = format;
+    while (ok && next_conversion(p, &spec)) {
+        p = spec.end;
+        if (spec.type == ARG_INVALID) {
+            break;
+        }
+        if (spec.star_width) {
+            PUT_ARG(int);
+        }
+        if (ok && spec.star_precision) {
+            PUT_ARG(int);
+        }
+        if (!ok) {
+            break;
+        }
+        switch (spec.type) {
+        case ARG_INT:       PUT_ARG(int); break;
+        case ARG_LONG:      PUT_ARG(long); break;
+        case ARG_LLONG:     PUT_ARG(long long); break;
+        case ARG_INTMAX:    PUT_ARG(intmax_t); break;
+        case ARG_SIZE:      PUT_ARG(size_t); break;
+        case ARG_PTRDIFF:   PUT_ARG(ptrdiff_t); break;
+        case ARG_PTR:       PUT_ARG(void *); break;
+        case ARG_DOUBLE:    PUT_ARG(double); break;
+        case ARG_LDOUBLE:   PUT_ARG(long double); break;
+        case ARG_STR:
+            ok = put_string(record, &len, va_arg(args, const char *), spec.precision);
+            break;
+        case ARG_COUNT:
+            (void) va_arg(args, int *);
+            break;
+        default:
+            break;
+        }
+    }
+    record[0] = (RECORD_TYPE_LOG << HEADER_TYPE_SHIFT) | ((level & HEADER_LEVEL_MASK) << HEADER_LEVEL_SHIFT) | len;
+    *out_len = len;
+    return ok;
+}
+
+bool esp_log_deferred_writev(esp_log_level_t level, const char *format, va_list args)
+{
+    if (!s_enabled || xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) {
+        return false;
+    }
+    if (s_task == NULL) {
+        start_task();
+    }
+
+    uint32_t record[MAX_RECORD_WORDS];
+    size_t len;
+    va_list args_copy;
+    va_copy(args_copy, args);   // args are still needed if the message is written synchronously
+    bool ok = serialize(record, &len, level, format, args_copy);
+    va_end(args_copy);
+    if (!ok) {
+        return false;
+    }
+
+    // Reserve space in the buffer of this core. Only tasks and ISRs running on
+    // this core race for the write offset, so compare-and-set never spins for long.
+    log_buffer_t *buf = &s_buffers[xPortGetCoreID()];
+    uint32_t size = len * sizeof(uint32_t);
+    uint32_t write, padding, set;
+    do {
+        write = buf->write;
+        uint32_t offset = write & (BUFFER_SIZE - 1);
+        padding = (offset + size > BUFFER_SIZE) ? BUFFER_SIZE - offset : 0;
+        if (write + padding + size - buf->read > BUFFER_SIZE) {
+            atomic_add(&buf->dropped, 1);
+            return true;
+        }
+        set = write + padding + size;
+        uxPortCompareSet(&buf->write, write, &set);
+    } while (set != write);
+
+    uint32_t offset = write & (BUFFER_SIZE - 1);
+    if (padding != 0) {
+        volatile uint32_t *header = &buf->data[offset / sizeof(uint32_t)];
+        *header = (RECORD_TYPE_PADDING << HEADER_TYPE_SHIFT) | (padding / sizeof(uint32_t));
+        offset = 0;
+    }
+    uint32_t *dest = &buf->data[offset / sizeof(uint32_t)];
+    memcpy(dest + 1, record + 1, size - sizeof(uint32_t));
+    // Volatile store is ordered after the copy (memw), the record is visible to the reader once its header is set
+    *(volatile uint32_t *) dest = record[0];
+
+    // Wake up the task early if this record made the buffer more than half full
+    uint32_t used_before = write - buf->read;
+    uint32_t used_after = used_before + padding + size;
+    if (used_before <= BUFFER_SIZE / 2 && used_after > BUFFER_SIZE / 2 && s_task != NULL && !xPortInIsrContext()) {
+        xTaskNotifyGive(s_task);
+    }
+    return true;
+}
+
+static void output_line(void)
+{
+    if (s_line_len > 0) {
+        s_line[s_line_len] = 0;
+        esp_log_impl_printf("%s", s_line);
+        s_line_len = 0;
+    }
+}
+
+static void append(const char *str, size_t len)
+{
+    while (len > 0) {
+        size_t space = sizeof(s_line) - 1 - s_line_len;
+        if (space == 0) {
+            output_line();
+            continue;
+        }
+        size_t n = (len < space) ? len : space;
+        memcpy(s_line + s_line_len, str, n);
+        s_line_len += n;
+        str += n;
+        len -= n;
+    }
+}
+
+#define APPEND_FORMATTED(type) do { \
+        type value; \
+        memcpy(&value, &record[i], sizeof(value)); \
+        i += (sizeof(value) + sizeof(uint32_t) - 1) / sizeof(uint32_t); \
+        int n = snprintf(piece, sizeof(piece), spec_buf, value); \
+        append(piece, ((size_t) n < sizeof(piece)) ? n : sizeof(piece) - 1); \
+    } while(0)
+
+#if CONFIG_LOG_DEFERRED_OUTPUT_TEXT
+static void output_record(const uint32_t *record, size_t len)
+{
+    const char *format = (const char *) record[1];
+    size_t i = 2;
+    conv_spec_t spec;
+    const char *p = format;
+    char spec_buf[32];
+    char piece[MAX_STRING_LEN + 64];
+    while (next_conversion(p, &spec)) {
+        append(p, spec.start - p);
+        p = spec.end;
+        if (spec.type == ARG_NONE) {
+            append("%", 1);
+            continue;
+        }
+        if (spec.type == ARG_INVALID || (size_t) (spec.end - spec.start) >= sizeof(spec_buf) - 24) {
+            p = spec.start;
+            break;
+        }
+        // Copy the conversion specification, replacing '*' with the stored values
+        size_t spec_len = 0;
+        for (const char *c = spec.start; c < spec.end; ++c) {
+            if (*c != '*') {
+                spec_buf[spec_len++] = *c;
+                continue;
+            }
+            int value = (i < len) ? (int) record[i++] : 0;
+            if (c[-1] == '.' && value < 0) {
+                --spec_len;     // negative precision is taken as if it was omitted
+            } else {
+                spec_len += sprintf(spec_buf + spec_len, "%d", value);
+            }
+        }
+        spec_buf[spec_len] = 0;
+        if (i >= len && spec.type != ARG_COUNT) {
+            break;
+        }
+        switch (spec.type) {
+        case ARG_INT:       APPEND_FORMATTED(int); break;
+        case ARG_LONG:      APPEND_FORMATTED(long); break;
+        case ARG_LLONG:     APPEND_FORMATTED(long long); break;
+        case ARG_INTMAX:    APPEND_FORMATTED(intmax_t); break;
+        case ARG_SIZE:      APPEND_FORMATTED(size_t); break;
+        case ARG_PTRDIFF:   APPEND_FORMATTED(ptrdiff_t); break;
+        case ARG_PTR:       APPEND_FORMATTED(void *); break;
+        case ARG_DOUBLE:    APPEND_FORMATTED(double); break;
+        case ARG_LDOUBLE:   APPEND_FORMATTED(long double); break;
+        case ARG_STR: {
+            uint32_t word = record[i++];
+            const char *str = (const char *) word;
+            char copy[MAX_STRING_LEN + 1];
+            if ((word & STR_INLINE_MASK) == STR_INLINE) {
+                size_t str_len = word & STR_INLINE_LEN_MASK;
+                memcpy(copy, &record[i], str_len);
+                copy[str_len] = 0;
+                i += (str_len + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+                str = copy;
+            }
+            int n = snprintf(piece, sizeof(piece), spec_buf, str);
+            append(piece, ((size_t) n < sizeof(piece)) ? n : sizeof(piece) - 1);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    append(p, strlen(p));
+    output_line();
+}
+#else // CONFIG_LOG_DEFERRED_OUTPUT_BINARY
+static void output_record(const uint32_t *record, size_t len)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const uint8_t *data = (const uint8_t *) record;
+    size_t size = len * sizeof(uint32_t);
+    append(BINARY_LINE_PREFIX, strlen(BINARY_LINE_PREFIX));
+    // Records are a multiple of 4 bytes, so the last group may have 1 or 2 bytes
+    for (size_t i = 0; i < size; i += 3) {
+        uint32_t group = data[i] << 16;
+        size_t n = size - i;
+        if (n > 1) {
+            group |= data[i + 1] << 8;
+        }
+        if (n > 2) {
+            group |= data[i + 2];
+        }
+        char out[4] = {
+            alphabet[(group >> 18) & 0x3f],
+            alphabet[(group >> 12) & 0x3f],
+            (n > 1) ? alphabet[(group >> 6) & 0x3f] : '=',
+            (n > 2) ? alphabet[group & 0x3f] : '=',
+        };
+        append(out, sizeof(out));
+    }
+    append("\n", 1);
+    output_line();
+}
+#endif // CONFIG_LOG_DEFERRED_OUTPUT_TEXT
+
+static void flush_buffer(log_buffer_t *buf)
+{
+    while (buf->read != buf->write) {
+        uint32_t offset = buf->read & (BUFFER_SIZE - 1);
+        uint32_t *record = &buf->data[offset / sizeof(uint32_t)];
+        uint32_t header = *(volatile uint32_t *) record;
+        if (header == 0) {
+            break;      // the record is still being written
+        }
+        size_t len = header & HEADER_LEN_MASK;
+        if ((header >> HEADER_TYPE_SHIFT) == RECORD_TYPE_LOG) {
+            output_record(record, len);
+        }
+        memset(record, 0, len * sizeof(uint32_t));
+        buf->read += len * sizeof(uint32_t);
+    }
+    // Messages are dropped while the buffer is full, i.e. after the ones output above
+    uint32_t dropped = buf->dropped;
+    if (dropped != 0) {
+        atomic_add(&buf->dropped, -dropped);
+        esp_log_impl_printf("%u deferred log messages dropped\n", dropped);
+    }
+}
+
+void esp_log_deferred_flush(void)
+{
+    _lock_acquire(&s_flush_lock);
+    for (int i = 0; i < portNUM_PROCESSORS; ++i) {
+        flush_buffer(&s_buffers[i]);
+    }
+    _lock_release(&s_flush_lock);
+}
+
+void esp_log_deferred_enable(bool enable)
+{
+    s_enabled = enable;
+    if (!enable) {
+        // output the pending records before any synchronous message
+        esp_log_deferred_flush();
+    }
+}
+
+static void log_deferred_task(void *arg)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_LOG_DEFERRED_FLUSH_PERIOD_MS));
+        esp_log_deferred_flush();
+    }
+}
+
+static void start_task(void)
+{
+    uint32_t set = 1;
+    uxPortCompareSet(&s_task_starting, 0, &set);
+    if (set != 0 || xPortInIsrContext() || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
+        if (set == 0) {
+            s_task_starting = 0;    // try again from the next task context
+        }
+        return;
+    }
+    xTaskCreatePinnedToCore(&log_deferred_task, "log_deferred", CONFIG_LOG_DEFERRED_TASK_STACK_SIZE,
+                            NULL, CONFIG_LOG_DEFERRED_TASK_PRIORITY, &s_task, tskNO_AFFINITY);
+    if (s_task == NULL) {
+        s_task_starting = 0;
+    }
+}
+
+static bool next_conversion(const char *format, conv_spec_t *spec)
+{
+    const char *p = strchr(format, '%');
+    if (p == NULL) {
+        return false;
+    }
+    spec->start = p++;
+    spec->star_width = false;
+    spec->star_precision = false;
+    spec->precision = -1;
+    if (*p == '%') {
+        spec->type = ARG_NONE;
+        spec->end = p + 1;
+        return true;
+    }
+    while (*p != 0 && strchr("-+ #0", *p) != NULL) {
+        ++p;
+    }
+    if (*p == '*') {
+        spec->star_width = true;
+        ++p;
+    } else {
+        while (isdigit((unsigned char) *p)) {
+            ++p;
+        }
+    }
+    if (*p == '.') {
+        ++p;
+        if (*p == '*') {
+            spec->star_precision = true;
+            ++p;
+        } else {
+            spec->precision = 0;
+            while (isdigit((unsigned char) *p)) {
+                spec->precision = spec->precision * 10 + (*p++ - '0');
+            }
+        }
+    }
+    arg_type_t int_type = ARG_INT;
+    bool long_double = false;
+    switch (*p) {
+    case 'h':
+        p += (p[1] == 'h') ? 2 : 1;
+        break;
+    case 'l':
+        if (p[1] == 'l') {
+            int_type = ARG_LLONG;
+            p += 2;
+        } else {
+            int_type = ARG_LONG;
+            ++p;
+        }
+        break;
+    case 'j':
+        int_type = ARG_INTMAX;
+        ++p;
+        break;
+    case 'z':
+        int_type = ARG_SIZE;
+        ++p;
+        break;
+    case 't':
+        int_type = ARG_PTRDIFF;
+        ++p;
+        break;
+    case 'L':
+        long_double = true;
+        ++p;
+        break;
+    default:
+        break;
+    }
+    switch (*p) {
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+        spec->type = int_type;
+        break;
+    case 'c':
+        spec->type = ARG_INT;
+        break;
+    case 'p':
+        spec->type = ARG_PTR;
+        break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        spec->type = long_double ? ARG_LDOUBLE : ARG_DOUBLE;
+        break;
+    case 's':
+        spec->type = ARG_STR;
+        break;
+    case 'n':
+        spec->type = ARG_COUNT;
+        break;
+    default:
+        spec->type = ARG_INVALID;
+        spec->end = p;
+        return true;
+    }
+    spec->end = p + 1;
+    return true;
+}
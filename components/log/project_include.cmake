@@ -0,0 +1,13 @@
+# Pass CONFIG_LOG_TAG_LEVEL_TABLE entries to all components, as used by
+# ESP_LOG_TAG_LIMIT() in esp_log.h
+if(CONFIG_LOG_TAG_LEVEL_TABLE)
+    string(REPLACE " " ";" log_tag_levels "${CONFIG_LOG_TAG_LEVEL_TABLE}")
+    foreach(entry ${log_tag_levels})
+        if(NOT entry MATCHES "^([A-Za-z_][A-Za-z0-9_]*):([NEWIDV])$")
+            message(FATAL_ERROR "Invalid CONFIG_LOG_TAG_LEVEL_TABLE entry '${entry}', "
+                "expected 'tag:level' with level one of N, E, W, I, D, V")
+        endif()
+        idf_build_set_property(COMPILE_DEFINITIONS
+            "-DESP_LOG_TAG_LIMIT_${CMAKE_MATCH_1}=ESP_LOG_TAG_LIMITED(${CMAKE_MATCH_2})" APPEND)
+    endforeach()
+endif()
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "soc/cpu.h"
+#include "esp_log.h"
+#include "unity.h"
+#include "test_utils.h"
+#include "sdkconfig.h"
+
+#if CONFIG_LOG_DEFERRED
+
+static const char *TAG = "test_log";
+
+static char s_capture[1024];
+static size_t s_capture_len;
+
+static int capture_vprintf(const char *format, va_list args)
+{
+    int n = vsnprintf(s_capture + s_capture_len, sizeof(s_capture) - s_capture_len, format, args);
+    if (n > 0) {
+        s_capture_len += n;
+        if (s_capture_len >= sizeof(s_capture)) {
+            s_capture_len = sizeof(s_capture) - 1;
+        }
+    }
+    return n;
+}
+
+static void log_test_messages(void)
+{
+    char stack_str[] = "string on the stack";
+    char empty_str[] = "";
+    esp_log_write(ESP_LOG_INFO, TAG, "int %d, unsigned %u, hex %08x, char %c\n", -42, 42U, 0xbeef, 'z');
+    esp_log_write(ESP_LOG_WARN, TAG, "long long %lld, size %zu, %%, pointer %p\n", -1099511627776LL, sizeof(s_capture), (void *) 0x3ffb0000);
+    esp_log_write(ESP_LOG_ERROR, TAG, "double %.3f %e, width %*d, precision %.*s\n", 3.14159, 1e-5, 6, 7, 3, "abcdef");
+    esp_log_write(ESP_LOG_INFO, TAG, "flash '%s', stack '%s', null '%s'\n", TAG, stack_str, NULL);
+    // strings in RAM which are stored with no characters, followed by another argument
+    esp_log_write(ESP_LOG_INFO, TAG, "empty '%s', precision 0 '%.0s', after %d\n", empty_str, stack_str, 42);
+}
+
+#if CONFIG_LOG_DEFERRED_OUTPUT_TEXT
+TEST_CASE("deferred log output matches synchronous output", "[log]")
+{
+    static char expected[sizeof(s_capture)];
+    vprintf_like_t orig = esp_log_set_vprintf(capture_vprintf);
+
+    esp_log_deferred_enable(false);
+    s_capture_len = 0;
+    log_test_messages();
+    memcpy(expected, s_capture, s_capture_len + 1);
+
+    esp_log_deferred_enable(true);
+    s_capture_len = 0;
+    log_test_messages();
+    TEST_ASSERT_EQUAL(0, s_capture_len);    // nothing is output by the caller
+    esp_log_deferred_flush();
+
+    esp_log_set_vprintf(orig);
+    TEST_ASSERT_EQUAL_STRING(expected, s_capture);
+}
+#endif // CONFIG_LOG_DEFERRED_OUTPUT_TEXT
+
+static int discard_vprintf(const char *format, va_list args)
+{
+    char buf[128];
+    return vsnprintf(buf, sizeof(buf), format, args);
+}
+
+static uint32_t measure_log_cycles(void)
+{
+    const int batches = 16;
+    const int batch_size = 16;
+    char stack_str[] = "string";
+    uint32_t total = 0;
+    for (int i = 0; i < batches; ++i) {
+        uint32_t start = esp_cpu_get_ccount();
+        for (int j = 0; j < batch_size; ++j) {
+            esp_log_write(ESP_LOG_INFO, TAG, "I (%d) %s: message %d of %d, %s\n", 1234, TAG, j, i, stack_str);
+        }
+        total += esp_cpu_get_ccount() - start;
+        // output outside of the measured time, the buffer doesn't get full
+        esp_log_deferred_flush();
+    }
+    return total / (batches * batch_size);
+}
+
+TEST_CASE("deferred log performance", "[log]")
+{
+    vprintf_like_t orig = esp_log_set_vprintf(discard_vprintf);
+
+    esp_log_deferred_enable(false);
+    uint32_t sync_cycles = measure_log_cycles();
+    esp_log_deferred_enable(true);
+    uint32_t deferred_cycles = measure_log_cycles();
+
+    esp_log_set_vprintf(orig);
+    IDF_LOG_PERFORMANCE("log_write_sync_cycles", "%d", sync_cycles);
+    IDF_LOG_PERFORMANCE("log_write_deferred_cycles", "%d", deferred_cycles);
+    TEST_ASSERT_LESS_THAN(sync_cycles, deferred_cycles);
+}
+
+#endif // CONFIG_LOG_DEFERRED
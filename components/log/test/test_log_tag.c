@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "soc/cpu.h"
+// Debug statements must be compiled in, so that they are suppressed at runtime
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+// Same as a "test_log_limited:I" entry in CONFIG_LOG_TAG_LEVEL_TABLE
+#define ESP_LOG_TAG_LIMIT_test_log_limited ESP_LOG_TAG_LIMITED(I)
+#include "esp_log.h"
+#include "unity.h"
+#include "test_utils.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "test_log_str";
+ESP_LOG_TAG_DEFINE(TAG_DESC, test_log_desc);
+ESP_LOG_TAG_DEFINE(TAG_LIMITED, test_log_limited);
+
+static char s_capture[256];
+static size_t s_capture_len;
+
+static int capture_vprintf(const char *format, va_list args)
+{
+    int n = vsnprintf(s_capture + s_capture_len, sizeof(s_capture) - s_capture_len, format, args);
+    if (n > 0) {
+        s_capture_len += n;
+        if (s_capture_len >= sizeof(s_capture)) {
+            s_capture_len = sizeof(s_capture) - 1;
+        }
+    }
+    return n;
+}
+
+static bool output_contains(const char *str)
+{
+#if CONFIG_LOG_DEFERRED
+    esp_log_deferred_flush();
+#endif
+    bool found = strstr(s_capture, str) != NULL;
+    s_capture_len = 0;
+    s_capture[0] = 0;
+    return found;
+}
+
+TEST_CASE("log tag descriptor follows esp_log_level_set", "[log]")
+{
+    vprintf_like_t orig = esp_log_set_vprintf(capture_vprintf);
+    s_capture_len = 0;
+
+    esp_log_level_set("test_log_desc", ESP_LOG_INFO);
+    ESP_TAG_LOGI(TAG_DESC, "info 1");
+    TEST_ASSERT_TRUE(output_contains("test_log_desc: info 1"));
+    ESP_TAG_LOGD(TAG_DESC, "debug 2");
+    TEST_ASSERT_FALSE(output_contains("debug 2"));
+
+    esp_log_level_set("test_log_desc", ESP_LOG_DEBUG);
+    ESP_TAG_LOGD(TAG_DESC, "debug 3");
+    TEST_ASSERT_TRUE(output_contains("debug 3"));
+
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    ESP_TAG_LOGW(TAG_DESC, "warn 4");
+    TEST_ASSERT_FALSE(output_contains("warn 4"));
+    esp_log_level_set("*", ESP_LOG_VERBOSE);
+    ESP_TAG_LOGW(TAG_DESC, "warn 5");
+    TEST_ASSERT_TRUE(output_contains("warn 5"));
+
+    // compile-time limit, runtime level doesn't matter
+    ESP_TAG_LOGI(TAG_LIMITED, "info 6");
+    TEST_ASSERT_TRUE(output_contains("info 6"));
+    ESP_TAG_LOGD(TAG_LIMITED, "debug 7");
+    TEST_ASSERT_FALSE(output_contains("debug 7"));
+
+    esp_log_set_vprintf(orig);
+    esp_log_level_set("*", ESP_LOG_VERBOSE);
+}
+
+#define SUPPRESSED_LOG_COUNT 1000
+
+#define MEASURE_CYCLES(result, statement) do { \
+        uint32_t start = esp_cpu_get_ccount(); \
+        for (int i = 0; i < SUPPRESSED_LOG_COUNT; ++i) { \
+            statement; \
+        } \
+        result = (esp_cpu_get_ccount() - start) / SUPPRESSED_LOG_COUNT; \
+    } while(0)
+
+TEST_CASE("suppressed log statement performance", "[log]")
+{
+    uint32_t str_cycles, desc_cycles, limited_cycles;
+    esp_log_level_set(TAG, ESP_LOG_INFO);
+    esp_log_level_set("test_log_desc", ESP_LOG_INFO);
+    // first use registers the descriptor
+    ESP_TAG_LOGD(TAG_DESC, "first");
+
+    MEASURE_CYCLES(str_cycles, ESP_LOGD(TAG, "suppressed %d", i));
+    MEASURE_CYCLES(desc_cycles, ESP_TAG_LOGD(TAG_DESC, "suppressed %d", i));
+    MEASURE_CYCLES(limited_cycles, ESP_TAG_LOGD(TAG_LIMITED, "suppressed %d", i));
+
+    IDF_LOG_PERFORMANCE("log_suppressed_string_tag_cycles", "%d", str_cycles);
+    IDF_LOG_PERFORMANCE("log_suppressed_tag_desc_cycles", "%d", desc_cycles);
+    IDF_LOG_PERFORMANCE("log_suppressed_compiled_out_cycles", "%d", limited_cycles);
+    TEST_ASSERT_LESS_THAN(str_cycles, desc_cycles);
+    TEST_ASSERT_LESS_OR_EQUAL(desc_cycles, limited_cycles);
+
+    esp_log_level_set("*", ESP_LOG_VERBOSE);
+}
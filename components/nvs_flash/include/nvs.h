@@ -391,16 +391,149 @@ esp_err_t nvs_erase_all(nvs_handle_t handle);
  * to non-volatile storage. Individual implementations may write to storage at other times,
  * but this is not guaranteed.
  *
+ * If a transaction was started with nvs_transaction_begin(), its changes are written and
+ * become visible atomically: if power is lost, either all or none of them are present after
+ * the next initialization. The transaction ends if nvs_commit() succeeds. Otherwise it stays
+ * active, so that nvs_commit() can be called again, or the transaction can be aborted.
+ *
  * @param[in]  handle  Storage handle obtained with nvs_open.
  *                     Handles that were opened read only cannot be used.
  *
  * @return
  *             - ESP_OK if the changes have been written successfully
  *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if there is not enough space for the
+ *               changes of the transaction
  *             - other error codes from the underlying storage driver
  */
 esp_err_t nvs_commit(nvs_handle_t handle);
 
+/**
+ * @brief      Start a transaction
+ *
+ * Until nvs_commit() or nvs_transaction_abort() is called, values set or erased through
+ * this handle are kept in RAM. They are returned when reading through this handle, but are
+ * not visible through other handles. nvs_commit() writes all of them together, with as
+ * few flash writes as possible.
+ *
+ * Committing a transaction which changes more than one key requires free space for a copy
+ * of the changed values, in addition to the values themselves. The copy is kept in the
+ * reserved namespace "nvs.txn", which the first such commit creates.
+ *
+ * @param[in]  handle  Storage handle obtained with nvs_open.
+ *                     Handles that were opened read only cannot be used.
+ *
+ * @return
+ *             - ESP_OK if the transaction was started
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_READ_ONLY if handle was opened as read only
+ *             - ESP_ERR_INVALID_STATE if a transaction is already active on this handle
+ *             - ESP_ERR_NO_MEM if memory couldn't be allocated
+ */
+esp_err_t nvs_transaction_begin(nvs_handle_t handle);
+
+/**
+ * @brief      Discard the changes of the active transaction and end it
+ *
+ * @param[in]  handle  Storage handle obtained with nvs_open.
+ *
+ * @return
+ *             - ESP_OK if the transaction was aborted
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_INVALID_STATE if no transaction is active on this handle
+ */
+esp_err_t nvs_transaction_abort(nvs_handle_t handle);
+
+/**
+ * @brief      Open a blob for reading or writing in pieces
+ *
+ * This allows to read and write blobs which are too large to be kept in RAM as a whole.
+ * The pieces map directly onto the chunks in which blobs are stored, so the RAM used
+ * doesn't depend on the size of the blob. One blob can be open per handle at a time.
+ *
+ * With NVS_READONLY, the blob must exist, and is read with nvs_blob_read(). With
+ * NVS_READWRITE, a new value is written with nvs_blob_write(). It replaces the previous
+ * value, if any, when nvs_blob_close() succeeds. Until then, the previous value can still
+ * be read, and if power is lost, it is kept. The key must not be set through other handles
+ * while the blob is open.
+ *
+ * @param[in]  handle  Storage handle obtained with nvs_open.
+ * @param[in]  key     Key name. Maximal length is (NVS_KEY_NAME_MAX_SIZE-1) characters. Shouldn't be empty.
+ * @param[in]  mode    NVS_READONLY to read the blob, NVS_READWRITE to write it.
+ *
+ * @return
+ *             - ESP_OK if the blob was opened
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_NOT_FOUND if the blob is opened for reading and doesn't exist
+ *             - ESP_ERR_NVS_READ_ONLY if the blob is opened for writing and the handle
+ *               was opened as read only
+ *             - ESP_ERR_NVS_KEY_TOO_LONG if key name is too long
+ *             - ESP_ERR_INVALID_STATE if a blob is already open, or a transaction is active
+ *             - ESP_ERR_NO_MEM if memory couldn't be allocated
+ */
+esp_err_t nvs_blob_open(nvs_handle_t handle, const char* key, nvs_open_mode_t mode);
+
+/**
+ * @brief      Read a part of the blob opened with nvs_blob_open() for reading
+ *
+ * Reads may be done at any offset. Reading the blob from start to end is the fastest,
+ * because each read continues at the chunk where the previous one ended.
+ *
+ * @param[in]  handle    Storage handle obtained with nvs_open.
+ * @param[in]  offset    Offset of the data in the blob.
+ * @param[out] out_data  Buffer for the data.
+ * @param[in]  length    Number of bytes to read.
+ *
+ * @return
+ *             - ESP_OK if the data was read
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_INVALID_LENGTH if the blob ends before offset + length
+ *             - ESP_ERR_NVS_NOT_FOUND if the blob was erased or replaced since it was opened
+ *             - ESP_ERR_INVALID_STATE if no blob is open for reading
+ */
+esp_err_t nvs_blob_read(nvs_handle_t handle, size_t offset, void* out_data, size_t length);
+
+/**
+ * @brief      Append data to the blob opened with nvs_blob_open() for writing
+ *
+ * Data is written in order, so offset must be the number of bytes written so far. Pieces
+ * of at least 4000 bytes are written to flash without being copied. If writing fails, the
+ * blob is closed and the previous value is kept.
+ *
+ * @param[in]  handle    Storage handle obtained with nvs_open.
+ * @param[in]  offset    Offset of the data in the blob, i.e. the number of bytes written so far.
+ * @param[in]  data      The data to write.
+ * @param[in]  length    Number of bytes to write.
+ *
+ * @return
+ *             - ESP_OK if the data was written
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_INVALID_ARG if offset isn't the end of the data written so far
+ *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if there is not enough space in the
+ *               underlying storage to save the value
+ *             - ESP_ERR_NVS_VALUE_TOO_LONG if the value is too long
+ *             - ESP_ERR_INVALID_STATE if no blob is open for writing
+ */
+esp_err_t nvs_blob_write(nvs_handle_t handle, size_t offset, const void* data, size_t length);
+
+/**
+ * @brief      Close the blob opened with nvs_blob_open()
+ *
+ * If the blob was opened for writing, the rest of its data and its index are written, and
+ * the previous value is erased. The blob is closed even if this fails, and the previous value
+ * is kept in that case. If the handle is closed while a blob is open for writing, the data
+ * written is discarded.
+ *
+ * @param[in]  handle  Storage handle obtained with nvs_open.
+ *
+ * @return
+ *             - ESP_OK if the blob was closed
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_INVALID_STATE if no blob is open
+ *             - the errors of nvs_blob_write() and nvs_set_blob() if the value couldn't be written
+ */
+esp_err_t nvs_blob_close(nvs_handle_t handle);
+
 /**
  * @brief      Close the storage handle and free any allocated resources
  *
@@ -518,7 +651,9 @@ esp_err_t nvs_get_used_entry_count(nvs_handle_t handle, size_t* used_entries);
  * @param[in]   part_name       Partition name
  *
  * @param[in]   namespace_name  Set this value if looking for entries with
- *                              a specific namespace. Pass NULL otherwise.
+ *                              a specific namespace. Pass NULL otherwise,
+ *                              which lists all namespaces but the reserved
+ *                              "nvs.txn".
  *
  * @param[in]   type            One of nvs_type_t values.
  *
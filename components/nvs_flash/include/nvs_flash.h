@@ -84,6 +84,32 @@ esp_err_t nvs_flash_deinit(void);
  */
 esp_err_t nvs_flash_deinit_partition(const char* partition_label);
 
+/**
+ * @brief Reclaim space of erased items ahead of demand, in bounded steps
+ *
+ * When a write needs a new page and only one page is free, NVS copies the items of the page
+ * with the most erased entries to a new page and erases it during the write. This function
+ * does the same work before it is needed, a few items at a time, so it can be called from a
+ * low priority task or whenever the application is idle. It does nothing while at least
+ * CONFIG_NVS_GC_FREE_PAGES pages are free.
+ *
+ * Each call either moves up to max_items items from the page being reclaimed to the current
+ * page, or erases the page being reclaimed once it is empty.
+ *
+ * @param[in]  part_name  Label of the partition, or NULL for the default NVS partition
+ * @param[in]  max_items  Maximum number of items to move in this call, must be non-zero
+ * @param[out] out_done   If not NULL, set to true if there is nothing more to do for now,
+ *                        i.e. enough pages are free, no page has erased entries, or the items
+ *                        left to move don't fit into the current page
+ *
+ * @return
+ *      - ESP_OK if the step was completed
+ *      - ESP_ERR_INVALID_ARG if max_items is zero
+ *      - ESP_ERR_NVS_NOT_INITIALIZED if the partition is not initialized
+ *      - one of the error codes from the underlying flash storage driver
+ */
+esp_err_t nvs_flash_gc_step(const char* part_name, size_t max_items, bool* out_done);
+
 /**
  * @brief Erase the default NVS partition
  *
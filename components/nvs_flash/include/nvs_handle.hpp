@@ -173,9 +173,111 @@ public:
 
     /**
      * Commits all changes done through this handle so far.
+     *
+     * If a transaction is active, its changes are written to flash and become visible atomically: after a
+     * power loss, either all or none of them are present. The transaction ends if the commit succeeds,
+     * otherwise it stays active and may be committed again or aborted.
      */
     virtual esp_err_t commit() = 0;
 
+    /**
+     * @brief Starts a transaction.
+     *
+     * Until commit() or abort_transaction() is called, changes made through this handle are kept in RAM
+     * and are only visible through this handle. commit() writes them with as few flash writes as possible.
+     *
+     * @return
+     *             - ESP_OK if the transaction was started
+     *             - ESP_ERR_NVS_READ_ONLY if the handle was opened as read only
+     *             - ESP_ERR_INVALID_STATE if a transaction is already active
+     *             - ESP_ERR_NO_MEM if memory couldn't be allocated
+     */
+    virtual esp_err_t begin_transaction() = 0;
+
+    /**
+     * @brief Discards the changes of the active transaction and ends it.
+     *
+     * @return
+     *             - ESP_OK if the transaction was aborted
+     *             - ESP_ERR_INVALID_STATE if no transaction is active
+     */
+    virtual esp_err_t abort_transaction() = 0;
+
+    /**
+     * @brief Opens a blob for reading or writing in pieces.
+     *
+     * This allows to read and write blobs which are too large to be kept in RAM as a whole. The pieces map
+     * directly onto the chunks in which blobs are stored, so the RAM used doesn't depend on the size of the blob.
+     * One blob can be open per handle at a time.
+     *
+     * With NVS_READONLY, the blob must exist, and is read with read_blob(). With NVS_READWRITE, a new value
+     * is written with write_blob(). It replaces the previous value, if any, when close_blob() succeeds. Until
+     * then, the previous value can still be read, and if power is lost, it is kept. The key must not be set
+     * through other handles while the blob is open.
+     *
+     * @param[in]  key     Key name. Maximal length is 15 characters. Shouldn't be empty.
+     * @param[in]  mode    NVS_READONLY to read the blob, NVS_READWRITE to write it.
+     * @return
+     *             - ESP_OK if the blob was opened
+     *             - ESP_ERR_NVS_NOT_FOUND if the blob is opened for reading and doesn't exist
+     *             - ESP_ERR_NVS_READ_ONLY if the blob is opened for writing and the handle was opened as read only
+     *             - ESP_ERR_NVS_KEY_TOO_LONG if key name is too long
+     *             - ESP_ERR_INVALID_STATE if a blob is already open, or a transaction is active
+     *             - ESP_ERR_NO_MEM if memory couldn't be allocated
+     */
+    virtual esp_err_t open_blob(const char *key, nvs_open_mode_t mode) = 0;
+
+    /**
+     * @brief Reads a part of the blob opened with open_blob() for reading.
+     *
+     * Reads may be done at any offset. Reading the blob from start to end is the fastest, because each
+     * read continues at the chunk where the previous one ended.
+     *
+     * @param[in]  offset    Offset of the data in the blob.
+     * @param[out] out_data  Buffer for the data.
+     * @param[in]  len       Number of bytes to read.
+     * @return
+     *             - ESP_OK if the data was read
+     *             - ESP_ERR_NVS_INVALID_LENGTH if the blob ends before offset + len
+     *             - ESP_ERR_NVS_NOT_FOUND if the blob was erased or replaced since it was opened
+     *             - ESP_ERR_INVALID_STATE if no blob is open for reading
+     */
+    virtual esp_err_t read_blob(size_t offset, void* out_data, size_t len) = 0;
+
+    /**
+     * @brief Appends data to the blob opened with open_blob() for writing.
+     *
+     * Data is written in order, so offset must be the number of bytes written so far. Pieces of at least
+     * 4000 bytes are written to flash without being copied. If writing fails, the blob is closed and the
+     * previous value is kept.
+     *
+     * @param[in]  offset    Offset of the data in the blob, i.e. the number of bytes written so far.
+     * @param[in]  data      The data to write.
+     * @param[in]  len       Number of bytes to write.
+     * @return
+     *             - ESP_OK if the data was written
+     *             - ESP_ERR_INVALID_ARG if offset isn't the end of the data written so far
+     *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if there is not enough space in the
+     *               underlying storage to save the value
+     *             - ESP_ERR_NVS_VALUE_TOO_LONG if the value is too long
+     *             - ESP_ERR_INVALID_STATE if no blob is open for writing
+     */
+    virtual esp_err_t write_blob(size_t offset, const void* data, size_t len) = 0;
+
+    /**
+     * @brief Closes the blob opened with open_blob().
+     *
+     * If the blob was opened for writing, the rest of its data and its index are written, and the previous
+     * value is erased. The blob is closed even if this fails, and the previous value is kept in that case.
+     * If the handle is destroyed while a blob is open for writing, the data written is discarded.
+     *
+     * @return
+     *             - ESP_OK if the blob was closed
+     *             - ESP_ERR_INVALID_STATE if no blob is open
+     *             - the errors of write_blob() and set_blob() if the value couldn't be written
+     */
+    virtual esp_err_t close_blob() = 0;
+
     /**
      * @brief      Calculate all entries in the scope of the handle.
      *
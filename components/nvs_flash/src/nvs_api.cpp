@@ -26,6 +26,9 @@
 
 #ifdef ESP_PLATFORM
 #include <esp32/rom/crc.h>
+#ifdef CONFIG_NVS_GC_TASK
+#include "freertos/task.h"
+#endif
 
 // Uncomment this line to force output from this module
 // #define LOG_LOCAL_LEVEL ESP_LOG_DEBUG
@@ -127,13 +130,51 @@ static esp_err_t close_handles_and_deinit(const char* part_name)
     return NVSPartitionManager::get_instance()->deinit_partition(part_name);
 }
 
+#if defined(ESP_PLATFORM) && defined(CONFIG_NVS_GC_TASK)
+static void nvs_gc_task(void* arg)
+{
+    while (true) {
+        bool done;
+        {
+            Lock lock;
+            esp_err_t err = NVSPartitionManager::get_instance()->gc_step(CONFIG_NVS_GC_TASK_STEP_ITEMS, done);
+            if (err != ESP_OK) {
+                ESP_LOGD(TAG, "gc step failed: %s", esp_err_to_name(err));
+                done = true;
+            }
+        }
+        // give other tasks a chance to take the lock between steps
+        vTaskDelay(done ? pdMS_TO_TICKS(CONFIG_NVS_GC_TASK_INTERVAL_MS) : 1);
+    }
+}
+
+static esp_err_t nvs_gc_task_start()
+{
+    static TaskHandle_t s_gc_task = NULL;
+    if (s_gc_task) {
+        return ESP_OK;
+    }
+    if (xTaskCreate(nvs_gc_task, "nvs_gc", CONFIG_NVS_GC_TASK_STACK_SIZE, NULL,
+                    CONFIG_NVS_GC_TASK_PRIORITY, &s_gc_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+#endif
+
 #ifdef ESP_PLATFORM
 extern "C" esp_err_t nvs_flash_init_partition(const char *part_name)
 {
     Lock::init();
     Lock lock;
 
-    return NVSPartitionManager::get_instance()->init_partition(part_name);
+    esp_err_t err = NVSPartitionManager::get_instance()->init_partition(part_name);
+#ifdef CONFIG_NVS_GC_TASK
+    if (err == ESP_OK) {
+        err = nvs_gc_task_start();
+    }
+#endif
+    return err;
 }
 
 extern "C" esp_err_t nvs_flash_init(void)
@@ -159,8 +200,14 @@ extern "C" esp_err_t nvs_flash_secure_init_partition(const char *part_name, nvs_
         return ESP_ERR_NOT_FOUND;
     }
 
-    return nvs_flash_secure_init_custom(part_name, partition->address / SPI_FLASH_SEC_SIZE,
+    esp_err_t err = nvs_flash_secure_init_custom(part_name, partition->address / SPI_FLASH_SEC_SIZE,
             partition->size / SPI_FLASH_SEC_SIZE, cfg);
+#ifdef CONFIG_NVS_GC_TASK
+    if (err == ESP_OK) {
+        err = nvs_gc_task_start();
+    }
+#endif
+    return err;
 }
 
 extern "C" esp_err_t nvs_flash_secure_init(nvs_sec_cfg_t* cfg)
@@ -212,6 +259,28 @@ extern "C" esp_err_t nvs_flash_deinit(void)
     return nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME);
 }
 
+extern "C" esp_err_t nvs_flash_gc_step(const char* part_name, size_t max_items, bool* out_done)
+{
+    Lock lock;
+    nvs::Storage* pStorage;
+
+    if (max_items == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pStorage = lookup_storage_from_name((part_name == NULL) ? NVS_DEFAULT_PART_NAME : part_name);
+    if (pStorage == NULL) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    bool done;
+    esp_err_t err = pStorage->gcStep(max_items, done);
+    if (out_done) {
+        *out_done = done;
+    }
+    return err;
+}
+
 static esp_err_t nvs_find_ns_handle(nvs_handle_t c_handle, NVSHandleSimple** handle)
 {
     auto it = find_if(begin(s_nvs_handles), end(s_nvs_handles), [=](NVSHandleEntry& e) -> bool {
@@ -347,7 +416,6 @@ extern "C" esp_err_t nvs_set_u64 (nvs_handle_t handle, const char* key, uint64_t
 extern "C" esp_err_t nvs_commit(nvs_handle_t c_handle)
 {
     Lock lock;
-    // no-op for now, to be used when intermediate cache is added
     NVSHandleSimple *handle;
     auto err = nvs_find_ns_handle(c_handle, &handle);
     if (err != ESP_OK) {
@@ -356,6 +424,76 @@ extern "C" esp_err_t nvs_commit(nvs_handle_t c_handle)
     return handle->commit();
 }
 
+extern "C" esp_err_t nvs_transaction_begin(nvs_handle_t c_handle)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s", __func__);
+    NVSHandleSimple *handle;
+    auto err = nvs_find_ns_handle(c_handle, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return handle->begin_transaction();
+}
+
+extern "C" esp_err_t nvs_transaction_abort(nvs_handle_t c_handle)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s", __func__);
+    NVSHandleSimple *handle;
+    auto err = nvs_find_ns_handle(c_handle, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return handle->abort_transaction();
+}
+
+extern "C" esp_err_t nvs_blob_open(nvs_handle_t c_handle, const char* key, nvs_open_mode_t mode)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %s %d", __func__, key, mode);
+    NVSHandleSimple *handle;
+    auto err = nvs_find_ns_handle(c_handle, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return handle->open_blob(key, mode);
+}
+
+extern "C" esp_err_t nvs_blob_read(nvs_handle_t c_handle, size_t offset, void* out_data, size_t length)
+{
+    Lock lock;
+    NVSHandleSimple *handle;
+    auto err = nvs_find_ns_handle(c_handle, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return handle->read_blob(offset, out_data, length);
+}
+
+extern "C" esp_err_t nvs_blob_write(nvs_handle_t c_handle, size_t offset, const void* data, size_t length)
+{
+    Lock lock;
+    NVSHandleSimple *handle;
+    auto err = nvs_find_ns_handle(c_handle, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return handle->write_blob(offset, data, length);
+}
+
+extern "C" esp_err_t nvs_blob_close(nvs_handle_t c_handle)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s", __func__);
+    NVSHandleSimple *handle;
+    auto err = nvs_find_ns_handle(c_handle, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return handle->close_blob();
+}
+
 extern "C" esp_err_t nvs_set_str(nvs_handle_t c_handle, const char* key, const char* value)
 {
     Lock lock;
@@ -0,0 +1,82 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_blob_stream_hpp
+#define nvs_blob_stream_hpp
+
+#include "nvs_types.hpp"
+
+namespace nvs
+{
+
+/**
+ * State of a blob which is read or written in pieces, see Storage::openBlobStream.
+ *
+ * A stream maps directly onto the BLOB_IDX/BLOB_DATA layout of multi-page blobs. A reader remembers
+ * the chunk it read last, so that sequential reads don't search for the chunks before it. A writer
+ * writes chunks as data arrives, and the blob index when it is closed. Data which is too small for
+ * a chunk of its own is collected in a buffer of at most one chunk, so the RAM used doesn't depend
+ * on the size of the blob.
+ */
+class BlobStream
+{
+public:
+    BlobStream(uint8_t nsIndex, const char* key, bool write) :
+        mNsIndex(nsIndex),
+        mWrite(write)
+    {
+        strncpy(mKey, key, sizeof(mKey) - 1);
+        mKey[sizeof(mKey) - 1] = 0;
+    }
+
+    ~BlobStream()
+    {
+        delete[] mBuffer;
+    }
+
+    bool isWrite() const
+    {
+        return mWrite;
+    }
+
+    /* Size of the blob for readers, number of bytes written so far for writers */
+    size_t size() const
+    {
+        return mDataSize;
+    }
+
+    uint8_t mNsIndex;
+    bool mWrite;
+    char mKey[Item::MAX_KEY_LENGTH + 1];
+    ItemType mDatatype = ItemType::BLOB_DATA;   // ItemType::BLOB for blobs written in the format without index
+    VerOffset mChunkStart = VerOffset::VER_0_OFFSET;
+    uint8_t mChunkCount = 0;
+    size_t mDataSize = 0;
+
+    // reader: the chunk read last
+    bool mChunkValid = false;
+    bool mChunkVerified = false;
+    uint8_t mChunkNum = 0;
+    size_t mChunkOffset = 0;
+    size_t mChunkSize = 0;
+
+    // writer: the version which is replaced when the stream is closed, and data not written yet
+    bool mHasPrevious = false;
+    VerOffset mPrevStart = VerOffset::VER_0_OFFSET;
+    uint8_t* mBuffer = nullptr;
+    size_t mBufferSize = 0;
+};
+
+} // namespace nvs
+
+#endif /* nvs_blob_stream_hpp */
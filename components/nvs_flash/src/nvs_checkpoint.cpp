@@ -0,0 +1,471 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <memory>
+#include "nvs_checkpoint.hpp"
+#include "nvs_pagemanager.hpp"
+#include "nvs_key_index.hpp"
+#if defined(ESP_PLATFORM)
+#include <esp32/rom/crc.h>
+#else
+#include "crc.h"
+#endif
+
+namespace nvs
+{
+
+/* Each checkpoint page starts with a PageHeader, followed by up to DATA_SIZE bytes of checkpoint data.
+ * The data of all pages of a checkpoint, in the order of their part numbers, consists of a DataHeader,
+ * a NamespaceRecord for each namespace, and for each page a PageRecord followed by the hash list
+ * nodes and the key index hashes of the page. */
+
+static const uint32_t CHECKPOINT_MAGIC = 0x5043564e; // "NVCP"
+
+static const uint32_t FLAG_KEY_INDEX = 0x1;
+
+struct PageHeader {
+    uint32_t mState;        // all ones, like the state of an empty page
+    uint32_t mMagic;
+    uint32_t mId;
+    uint16_t mPart;
+    uint16_t mPartCount;
+    uint32_t mDataSize;     // bytes of checkpoint data in this page
+    uint32_t mDataCrc32;
+    uint32_t mReserved;
+    uint32_t mCrc32;        // crc of the fields from mMagic to mReserved
+
+    uint32_t calculateCrc32() const
+    {
+        return crc32_le(0xffffffff,
+                        reinterpret_cast<const uint8_t*>(this) + offsetof(PageHeader, mMagic),
+                        offsetof(PageHeader, mCrc32) - offsetof(PageHeader, mMagic));
+    }
+};
+
+struct DataHeader {
+    uint32_t mPageCount;
+    uint32_t mNamespaceCount;
+    uint32_t mFlags;
+    uint32_t mReserved;
+};
+
+struct PageRecord {
+    uint32_t mPageIndex;
+    uint32_t mState;
+    uint32_t mSeqNumber;
+    uint32_t mEntryTableCrc;
+    uint16_t mHashNodeCount;
+    uint16_t mKeyHashCount;
+};
+
+static const size_t DATA_SIZE = SPI_FLASH_SEC_SIZE - sizeof(PageHeader);
+
+static_assert(sizeof(PageHeader) == 32, "checkpoint page header size must be 32 bytes");
+static_assert(sizeof(Checkpoint::NamespaceRecord) % 4 == 0, "checkpoint records must be word aligned");
+static_assert(sizeof(PageRecord) % 4 == 0, "checkpoint records must be word aligned");
+
+static bool readPageHeader(uint32_t sector, PageHeader& header)
+{
+    if (spi_flash_read(sector * SPI_FLASH_SEC_SIZE, &header, sizeof(header)) != ESP_OK) {
+        return false;
+    }
+    return header.mState == 0xffffffff
+           && header.mMagic == CHECKPOINT_MAGIC
+           && header.mCrc32 == header.calculateCrc32()
+           && header.mPart < header.mPartCount
+           && header.mDataSize <= DATA_SIZE
+           && header.mDataSize % 4 == 0;
+}
+
+void Checkpoint::clear()
+{
+    delete[] mData;
+    mData = nullptr;
+    mDataSize = 0;
+    delete[] mPages;
+    mPages = nullptr;
+    mPageCount = 0;
+    mUsedPageCount = 0;
+    mKeyHashCount = 0;
+    mFlags = 0;
+    mNamespaces = nullptr;
+    mNamespaceCount = 0;
+}
+
+esp_err_t Checkpoint::read(uint32_t baseSector, uint32_t sectorCount)
+{
+    clear();
+    mId = 0;
+
+    std::unique_ptr<PageHeader[]> headers(new (std::nothrow) PageHeader[sectorCount]);
+    if (!headers) {
+        return ESP_ERR_NO_MEM;
+    }
+    bool found = false;
+    for (uint32_t i = 0; i < sectorCount; ++i) {
+        if (readPageHeader(baseSector + i, headers[i])) {
+            found = true;
+            mId = std::max(mId, headers[i].mId);
+        } else {
+            headers[i].mMagic = 0;
+        }
+    }
+    if (!found) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    auto findPart = [&](const PageHeader& first, uint16_t part) -> uint32_t {
+        for (uint32_t i = 0; i < sectorCount; ++i) {
+            const PageHeader& h = headers[i];
+            if (h.mMagic == CHECKPOINT_MAGIC && h.mId == first.mId && h.mPart == part && h.mPartCount == first.mPartCount) {
+                return i;
+            }
+        }
+        return UINT32_MAX;
+    };
+
+    // use the newest checkpoint of which all pages are present
+    uint32_t newest = UINT32_MAX;
+    for (uint32_t i = 0; i < sectorCount; ++i) {
+        const PageHeader& h = headers[i];
+        if (h.mMagic != CHECKPOINT_MAGIC || h.mPart != 0
+                || (newest != UINT32_MAX && h.mId <= headers[newest].mId)) {
+            continue;
+        }
+        bool complete = true;
+        for (uint16_t part = 1; part < h.mPartCount && complete; ++part) {
+            complete = findPart(h, part) != UINT32_MAX;
+        }
+        if (complete) {
+            newest = i;
+        }
+    }
+    if (newest == UINT32_MAX) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    const PageHeader& first = headers[newest];
+    size_t dataSize = 0;
+    for (uint16_t part = 0; part < first.mPartCount; ++part) {
+        dataSize += headers[findPart(first, part)].mDataSize;
+    }
+    mData = new (std::nothrow) uint8_t[dataSize];
+    if (!mData) {
+        return ESP_ERR_NO_MEM;
+    }
+    mDataSize = dataSize;
+
+    size_t offset = 0;
+    for (uint16_t part = 0; part < first.mPartCount; ++part) {
+        uint32_t index = findPart(first, part);
+        const PageHeader& h = headers[index];
+        auto err = spi_flash_read((baseSector + index) * SPI_FLASH_SEC_SIZE + sizeof(PageHeader), mData + offset, h.mDataSize);
+        if (err != ESP_OK) {
+            clear();
+            return err;
+        }
+        if (crc32_le(0xffffffff, mData + offset, h.mDataSize) != h.mDataCrc32) {
+            clear();
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        offset += h.mDataSize;
+    }
+
+    auto err = parse(sectorCount);
+    if (err != ESP_OK) {
+        clear();
+    }
+    return err;
+}
+
+esp_err_t Checkpoint::parse(uint32_t sectorCount)
+{
+    size_t offset = 0;
+    auto take = [&](size_t size) -> const uint8_t* {
+        if (mDataSize - offset < size) {
+            return nullptr;
+        }
+        const uint8_t* p = mData + offset;
+        offset += size;
+        return p;
+    };
+
+    auto header = reinterpret_cast<const DataHeader*>(take(sizeof(DataHeader)));
+    if (!header || header->mPageCount > sectorCount || header->mNamespaceCount > 256) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    mFlags = header->mFlags;
+    mNamespaceCount = header->mNamespaceCount;
+    mNamespaces = reinterpret_cast<const NamespaceRecord*>(take(mNamespaceCount * sizeof(NamespaceRecord)));
+    if (!mNamespaces) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    mPages = new (std::nothrow) PageInfo[sectorCount];
+    if (!mPages) {
+        return ESP_ERR_NO_MEM;
+    }
+    mPageCount = sectorCount;
+    for (size_t i = 0; i < mPageCount; ++i) {
+        mPages[i].mValid = false;
+    }
+
+    for (uint32_t i = 0; i < header->mPageCount; ++i) {
+        auto record = reinterpret_cast<const PageRecord*>(take(sizeof(PageRecord)));
+        if (!record || record->mPageIndex >= sectorCount || mPages[record->mPageIndex].mValid) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        const auto state = static_cast<Page::PageState>(record->mState);
+        if (state != Page::PageState::ACTIVE && state != Page::PageState::FULL
+                && state != Page::PageState::UNINITIALIZED) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        auto hashNodes = reinterpret_cast<const uint32_t*>(take(record->mHashNodeCount * sizeof(uint32_t)));
+        auto keyHashes = reinterpret_cast<const uint32_t*>(take(record->mKeyHashCount * sizeof(uint32_t)));
+        if (!hashNodes || !keyHashes) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+
+        PageInfo& info = mPages[record->mPageIndex];
+        info.mValid = true;
+        info.mSummary.state = state;
+        info.mSummary.seqNumber = record->mSeqNumber;
+        info.mSummary.entryTableCrc = record->mEntryTableCrc;
+        info.mSummary.hashNodes = hashNodes;
+        info.mSummary.hashNodeCount = record->mHashNodeCount;
+        info.mKeyHashes = keyHashes;
+        info.mKeyHashCount = record->mKeyHashCount;
+        if (state != Page::PageState::UNINITIALIZED) {
+            ++mUsedPageCount;
+        }
+        mKeyHashCount += info.mKeyHashCount;
+    }
+    return ESP_OK;
+}
+
+const Page::Summary* Checkpoint::findPage(uint32_t pageIndex) const
+{
+    if (pageIndex >= mPageCount || !mPages[pageIndex].mValid) {
+        return nullptr;
+    }
+    return &mPages[pageIndex].mSummary;
+}
+
+bool Checkpoint::matches(PageManager& pageManager) const
+{
+    size_t usedPageCount = 0;
+    for (auto it = pageManager.begin(); it != pageManager.end(); ++it) {
+        const Page::Summary* summary = findPage(it->getSectorNumber() - pageManager.getBaseSector());
+        uint32_t seqNumber;
+        if (!summary || summary->state != it->state()
+                || it->getSeqNumber(seqNumber) != ESP_OK || seqNumber != summary->seqNumber
+                || it->getEntryTableCrc() != summary->entryTableCrc) {
+            return false;
+        }
+        ++usedPageCount;
+    }
+    return usedPageCount == mUsedPageCount;
+}
+
+bool Checkpoint::hasKeyIndex() const
+{
+    return (mFlags & FLAG_KEY_INDEX) != 0;
+}
+
+size_t Checkpoint::getKeyHashCount() const
+{
+    return mKeyHashCount;
+}
+
+const uint32_t* Checkpoint::getKeyHashes(uint32_t pageIndex, size_t& count) const
+{
+    if (pageIndex >= mPageCount || !mPages[pageIndex].mValid) {
+        count = 0;
+        return nullptr;
+    }
+    count = mPages[pageIndex].mKeyHashCount;
+    return mPages[pageIndex].mKeyHashes;
+}
+
+uint32_t Checkpoint::fingerprint(PageManager& pageManager)
+{
+    uint32_t result = 0xffffffff;
+    for (auto it = pageManager.begin(); it != pageManager.end(); ++it) {
+        uint32_t seqNumber = UINT32_MAX;
+        it->getSeqNumber(seqNumber);
+        const uint32_t values[] = {
+            it->getSectorNumber(), static_cast<uint32_t>(it->state()), seqNumber, it->getEntryTableCrc()
+        };
+        result = crc32_le(result, reinterpret_cast<const uint8_t*>(values), sizeof(values));
+    }
+    return result;
+}
+
+esp_err_t Checkpoint::write(PageManager& pageManager, uint32_t id, const NamespaceRecord* namespaces, size_t namespaceCount,
+                            const KeyIndex* keyIndex)
+{
+    const uint32_t baseSector = pageManager.getBaseSector();
+    const uint32_t pageCount = pageManager.getPageCount();
+
+    size_t usedPageCount = 0;
+    size_t hashNodeCount = 0;
+    for (auto it = pageManager.begin(); it != pageManager.end(); ++it) {
+        // a page which is being freed or couldn't be written to would need a full load
+        if (it->state() != Page::PageState::ACTIVE && it->state() != Page::PageState::FULL) {
+            return ESP_ERR_NVS_INVALID_STATE;
+        }
+        ++usedPageCount;
+        hashNodeCount += it->getHashNodes(nullptr, 0);
+    }
+
+    // key index entries, sorted by page
+    std::unique_ptr<size_t[]> keyHashStart(new (std::nothrow) size_t[pageCount + 1]());
+    if (!keyHashStart) {
+        return ESP_ERR_NO_MEM;
+    }
+    const size_t keyHashCount = keyIndex ? keyIndex->getCount() : 0;
+    std::unique_ptr<uint32_t[]> keyHashes(new (std::nothrow) uint32_t[keyHashCount]);
+    if (!keyHashes) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (keyIndex) {
+        keyIndex->forEach([&](uint32_t, Page* page) {
+            ++keyHashStart[page->getSectorNumber() - baseSector + 1];
+        });
+        for (uint32_t i = 0; i < pageCount; ++i) {
+            keyHashStart[i + 1] += keyHashStart[i];
+        }
+        std::unique_ptr<size_t[]> next(new (std::nothrow) size_t[pageCount]);
+        if (!next) {
+            return ESP_ERR_NO_MEM;
+        }
+        std::copy_n(keyHashStart.get(), pageCount, next.get());
+        keyIndex->forEach([&](uint32_t hash, Page* page) {
+            keyHashes[next[page->getSectorNumber() - baseSector]++] = hash;
+        });
+    }
+
+    // prefer pages of older checkpoints, which would otherwise stay unused until they are erased
+    const size_t freePageCount = pageManager.mFreePageList.size();
+    const size_t maxDataSize = sizeof(DataHeader) + namespaceCount * sizeof(NamespaceRecord)
+                               + (usedPageCount + freePageCount) * sizeof(PageRecord)
+                               + (hashNodeCount + keyHashCount) * sizeof(uint32_t);
+    const size_t maxPartCount = (maxDataSize + DATA_SIZE - 1) / DATA_SIZE;
+    std::unique_ptr<Page*[]> parts(new (std::nothrow) Page*[maxPartCount]);
+    if (!parts) {
+        return ESP_ERR_NO_MEM;
+    }
+    size_t partCount = 0;
+    for (auto it = pageManager.mFreePageList.begin(); it != pageManager.mFreePageList.end() && partCount < maxPartCount; ++it) {
+        PageHeader header;
+        if (it->state() == Page::PageState::CORRUPT && readPageHeader(it->getSectorNumber(), header)) {
+            parts[partCount++] = it;
+        }
+    }
+    for (auto it = pageManager.mFreePageList.begin(); it != pageManager.mFreePageList.end() && partCount < maxPartCount; ++it) {
+        if (it->state() == Page::PageState::UNINITIALIZED) {
+            parts[partCount++] = it;
+        }
+    }
+    if (partCount < maxPartCount) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+
+    std::unique_ptr<uint8_t[]> data(new (std::nothrow) uint8_t[maxDataSize]);
+    if (!data) {
+        return ESP_ERR_NO_MEM;
+    }
+    size_t dataSize = sizeof(DataHeader);
+    auto addRecord = [&](Page& page, size_t keyHashIndex) {
+        PageRecord record;
+        record.mPageIndex = page.getSectorNumber() - baseSector;
+        record.mState = static_cast<uint32_t>(page.state());
+        record.mSeqNumber = UINT32_MAX;
+        page.getSeqNumber(record.mSeqNumber);
+        record.mEntryTableCrc = page.getEntryTableCrc();
+        // the hash list is only restored for full pages, see Page::load()
+        uint32_t* nodes = reinterpret_cast<uint32_t*>(data.get() + dataSize + sizeof(record));
+        record.mHashNodeCount = 0;
+        if (page.state() == Page::PageState::FULL) {
+            record.mHashNodeCount = page.getHashNodes(nodes, hashNodeCount);
+        }
+        record.mKeyHashCount = 0;
+        if (keyIndex) {
+            record.mKeyHashCount = keyHashStart[keyHashIndex + 1] - keyHashStart[keyHashIndex];
+            std::copy_n(keyHashes.get() + keyHashStart[keyHashIndex], record.mKeyHashCount, nodes + record.mHashNodeCount);
+        }
+        memcpy(data.get() + dataSize, &record, sizeof(record));
+        dataSize += sizeof(record) + (record.mHashNodeCount + record.mKeyHashCount) * sizeof(uint32_t);
+    };
+
+    DataHeader header;
+    header.mPageCount = 0;
+    header.mNamespaceCount = namespaceCount;
+    header.mFlags = keyIndex ? FLAG_KEY_INDEX : 0;
+    header.mReserved = UINT32_MAX;
+    memcpy(data.get() + dataSize, namespaces, namespaceCount * sizeof(NamespaceRecord));
+    dataSize += namespaceCount * sizeof(NamespaceRecord);
+    for (auto it = pageManager.begin(); it != pageManager.end(); ++it) {
+        addRecord(*it, it->getSectorNumber() - baseSector);
+        ++header.mPageCount;
+    }
+    for (auto it = pageManager.mFreePageList.begin(); it != pageManager.mFreePageList.end(); ++it) {
+        if (it->state() == Page::PageState::UNINITIALIZED
+                && std::find(parts.get(), parts.get() + partCount, static_cast<Page*>(it)) == parts.get() + partCount) {
+            addRecord(*it, it->getSectorNumber() - baseSector);
+            ++header.mPageCount;
+        }
+    }
+    memcpy(data.get(), &header, sizeof(header));
+    partCount = (dataSize + DATA_SIZE - 1) / DATA_SIZE;
+
+    for (size_t part = 0; part < partCount; ++part) {
+        Page* page = parts[part];
+        if (page->state() != Page::PageState::UNINITIALIZED) {
+            auto err = page->erase();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        const uint32_t address = page->getSectorNumber() * SPI_FLASH_SEC_SIZE;
+        const uint8_t* partData = data.get() + part * DATA_SIZE;
+        PageHeader pageHeader;
+        pageHeader.mState = 0xffffffff;
+        pageHeader.mMagic = CHECKPOINT_MAGIC;
+        pageHeader.mId = id;
+        pageHeader.mPart = part;
+        pageHeader.mPartCount = partCount;
+        pageHeader.mDataSize = std::min(DATA_SIZE, dataSize - part * DATA_SIZE);
+        pageHeader.mDataCrc32 = crc32_le(0xffffffff, partData, pageHeader.mDataSize);
+        pageHeader.mReserved = UINT32_MAX;
+        pageHeader.mCrc32 = pageHeader.calculateCrc32();
+
+        // the header is written last, a page without it is ignored
+        auto err = spi_flash_write(address + sizeof(PageHeader), partData, pageHeader.mDataSize);
+        if (err != ESP_OK) {
+            return err;
+        }
+        err = spi_flash_write(address, &pageHeader, sizeof(pageHeader));
+        if (err != ESP_OK) {
+            return err;
+        }
+        // the page isn't empty any more, and will be erased before it is used
+        err = page->load(page->getSectorNumber());
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+} // namespace nvs
@@ -0,0 +1,126 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_checkpoint_hpp
+#define nvs_checkpoint_hpp
+
+#include "sdkconfig.h"
+#include "nvs_types.hpp"
+#include "nvs_page.hpp"
+
+#ifdef CONFIG_NVS_MOUNT_CHECKPOINT
+#define NVS_MOUNT_CHECKPOINT true
+#else
+#define NVS_MOUNT_CHECKPOINT false
+#endif
+
+namespace nvs
+{
+
+class PageManager;
+class KeyIndex;
+
+/**
+ * Summary of a partition, written to free pages when the partition is deinitialized, so that the
+ * next init doesn't need to read every item.
+ *
+ * For each page in use, the checkpoint holds the sequence number, a CRC of the entry state table,
+ * the item hash list and the key index entries of the page. It also lists the free pages which are
+ * empty, and the namespaces. PageManager::load() restores the hash list of a full page from it if
+ * the entry state table of the page hasn't changed. If no page has changed, Storage::init() also
+ * restores the namespaces and the key index, and skips the search for orphan blob chunks.
+ *
+ * Like empty pages, checkpoint pages start with an all-ones word, but the rest of the page isn't
+ * empty. They are loaded as corrupt pages, and erased before they are used for items, also by
+ * versions which don't know about checkpoints.
+ */
+class Checkpoint
+{
+public:
+    struct NamespaceRecord {
+        char mName[Item::MAX_KEY_LENGTH + 1];
+        uint8_t mIndex;
+        uint8_t mReserved[3];
+    };
+
+    Checkpoint()
+    {
+    }
+
+    ~Checkpoint()
+    {
+        clear();
+    }
+
+    /* Read the newest complete checkpoint of the partition. Returns ESP_ERR_NVS_NOT_FOUND if there is none. */
+    esp_err_t read(uint32_t baseSector, uint32_t sectorCount);
+
+    /* Summary of the page with the given index in the partition, nullptr if the page wasn't empty or in use */
+    const Page::Summary* findPage(uint32_t pageIndex) const;
+
+    /* True if the pages in use, and their entry state tables, are the ones of the checkpoint */
+    bool matches(PageManager& pageManager) const;
+
+    const NamespaceRecord* getNamespaces(size_t& count) const
+    {
+        count = mNamespaceCount;
+        return mNamespaces;
+    }
+
+    bool hasKeyIndex() const;
+
+    size_t getKeyHashCount() const;
+
+    /* Key index entries of the page with the given index */
+    const uint32_t* getKeyHashes(uint32_t pageIndex, size_t& count) const;
+
+    /* Id of the checkpoint which was read, or the highest id found if none was complete */
+    uint32_t getId() const
+    {
+        return mId;
+    }
+
+    void clear();
+
+    /* Write a checkpoint of the pages in use to free pages. Key index entries are only saved if keyIndex isn't nullptr. */
+    static esp_err_t write(PageManager& pageManager, uint32_t id, const NamespaceRecord* namespaces, size_t namespaceCount,
+                           const KeyIndex* keyIndex);
+
+    /* Value which changes when any page in use changes */
+    static uint32_t fingerprint(PageManager& pageManager);
+
+protected:
+    struct PageInfo {
+        bool mValid;
+        Page::Summary mSummary;
+        const uint32_t* mKeyHashes;
+        size_t mKeyHashCount;
+    };
+
+    esp_err_t parse(uint32_t sectorCount);
+
+    uint8_t* mData = nullptr;
+    size_t mDataSize = 0;
+    uint32_t mId = 0;
+    uint32_t mFlags = 0;
+    PageInfo* mPages = nullptr;
+    size_t mPageCount = 0;
+    size_t mUsedPageCount = 0;
+    size_t mKeyHashCount = 0;
+    const NamespaceRecord* mNamespaces = nullptr;
+    size_t mNamespaceCount = 0;
+}; // class Checkpoint
+
+} // namespace nvs
+
+#endif /* nvs_checkpoint_hpp */
@@ -64,6 +64,36 @@ esp_err_t NVSHandleLocked::commit() {
     return handle->commit();
 }
 
+esp_err_t NVSHandleLocked::begin_transaction() {
+    Lock lock;
+    return handle->begin_transaction();
+}
+
+esp_err_t NVSHandleLocked::abort_transaction() {
+    Lock lock;
+    return handle->abort_transaction();
+}
+
+esp_err_t NVSHandleLocked::open_blob(const char *key, nvs_open_mode_t mode) {
+    Lock lock;
+    return handle->open_blob(key, mode);
+}
+
+esp_err_t NVSHandleLocked::read_blob(size_t offset, void* out_data, size_t len) {
+    Lock lock;
+    return handle->read_blob(offset, out_data, len);
+}
+
+esp_err_t NVSHandleLocked::write_blob(size_t offset, const void* data, size_t len) {
+    Lock lock;
+    return handle->write_blob(offset, data, len);
+}
+
+esp_err_t NVSHandleLocked::close_blob() {
+    Lock lock;
+    return handle->close_blob();
+}
+
 esp_err_t NVSHandleLocked::get_used_entry_count(size_t& usedEntries) {
     Lock lock;
     return handle->get_used_entry_count(usedEntries);
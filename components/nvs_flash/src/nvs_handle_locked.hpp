@@ -50,6 +50,18 @@ public:
 
     esp_err_t commit() override;
 
+    esp_err_t begin_transaction() override;
+
+    esp_err_t abort_transaction() override;
+
+    esp_err_t open_blob(const char *key, nvs_open_mode_t mode) override;
+
+    esp_err_t read_blob(size_t offset, void* out_data, size_t len) override;
+
+    esp_err_t write_blob(size_t offset, const void* data, size_t len) override;
+
+    esp_err_t close_blob() override;
+
     esp_err_t get_used_entry_count(size_t& usedEntries) override;
 
 protected:
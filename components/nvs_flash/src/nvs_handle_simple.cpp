@@ -18,7 +18,12 @@
 namespace nvs {
 
 NVSHandleSimple::~NVSHandleSimple() {
+    if (mBlobStream && valid) {
+        mStoragePtr->abortBlobStream(*mBlobStream);
+    }
     NVSPartitionManager::get_instance()->close_handle(this);
+    delete mTransaction;
+    delete mBlobStream;
 }
 
 esp_err_t NVSHandleSimple::set_typed_item(ItemType datatype, const char *key, const void* data, size_t dataSize)
@@ -26,6 +31,8 @@ esp_err_t NVSHandleSimple::set_typed_item(ItemType datatype, const char *key, co
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
     if (mReadOnly) return ESP_ERR_NVS_READ_ONLY;
 
+    if (mTransaction) return mTransaction->set(datatype, key, data, dataSize);
+
     return mStoragePtr->writeItem(mNsIndex, datatype, key, data, dataSize);
 }
 
@@ -33,6 +40,10 @@ esp_err_t NVSHandleSimple::get_typed_item(ItemType datatype, const char *key, vo
 {
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
 
+    if (mTransaction && mTransaction->contains(datatype, key)) {
+        return mTransaction->readItem(datatype, key, data, dataSize);
+    }
+
     return mStoragePtr->readItem(mNsIndex, datatype, key, data, dataSize);
 }
 
@@ -41,6 +52,8 @@ esp_err_t NVSHandleSimple::set_string(const char *key, const char* str)
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
     if (mReadOnly) return ESP_ERR_NVS_READ_ONLY;
 
+    if (mTransaction) return mTransaction->set(nvs::ItemType::SZ, key, str, strlen(str) + 1);
+
     return mStoragePtr->writeItem(mNsIndex, nvs::ItemType::SZ, key, str, strlen(str) + 1);
 }
 
@@ -49,6 +62,8 @@ esp_err_t NVSHandleSimple::set_blob(const char *key, const void* blob, size_t le
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
     if (mReadOnly) return ESP_ERR_NVS_READ_ONLY;
 
+    if (mTransaction) return mTransaction->set(nvs::ItemType::BLOB, key, blob, len);
+
     return mStoragePtr->writeItem(mNsIndex, nvs::ItemType::BLOB, key, blob, len);
 }
 
@@ -56,6 +71,10 @@ esp_err_t NVSHandleSimple::get_string(const char *key, char* out_str, size_t len
 {
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
 
+    if (mTransaction && mTransaction->contains(nvs::ItemType::SZ, key)) {
+        return mTransaction->readItem(nvs::ItemType::SZ, key, out_str, len);
+    }
+
     return mStoragePtr->readItem(mNsIndex, nvs::ItemType::SZ, key, out_str, len);
 }
 
@@ -63,6 +82,10 @@ esp_err_t NVSHandleSimple::get_blob(const char *key, void* out_blob, size_t len)
 {
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
 
+    if (mTransaction && mTransaction->contains(nvs::ItemType::BLOB, key)) {
+        return mTransaction->readItem(nvs::ItemType::BLOB, key, out_blob, len);
+    }
+
     return mStoragePtr->readItem(mNsIndex, nvs::ItemType::BLOB, key, out_blob, len);
 }
 
@@ -70,6 +93,10 @@ esp_err_t NVSHandleSimple::get_item_size(ItemType datatype, const char *key, siz
 {
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
 
+    if (mTransaction && mTransaction->contains(datatype, key)) {
+        return mTransaction->getItemDataSize(datatype, key, size);
+    }
+
     return mStoragePtr->getItemDataSize(mNsIndex, datatype, key, size);
 }
 
@@ -78,6 +105,8 @@ esp_err_t NVSHandleSimple::erase_item(const char* key)
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
     if (mReadOnly) return ESP_ERR_NVS_READ_ONLY;
 
+    if (mTransaction) return mTransaction->erase(key);
+
     return mStoragePtr->eraseItem(mNsIndex, key);
 }
 
@@ -86,6 +115,8 @@ esp_err_t NVSHandleSimple::erase_all()
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
     if (mReadOnly) return ESP_ERR_NVS_READ_ONLY;
 
+    if (mTransaction) return mTransaction->eraseAll();
+
     return mStoragePtr->eraseNamespace(mNsIndex);
 }
 
@@ -93,9 +124,92 @@ esp_err_t NVSHandleSimple::commit()
 {
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
 
+    if (!mTransaction) return ESP_OK;
+
+    // on failure, the transaction stays active so that it can be committed again or aborted
+    esp_err_t err = mStoragePtr->commitTransaction(mNsIndex, *mTransaction);
+    if (err == ESP_OK) {
+        delete mTransaction;
+        mTransaction = nullptr;
+    }
+    return err;
+}
+
+esp_err_t NVSHandleSimple::begin_transaction()
+{
+    if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (mReadOnly) return ESP_ERR_NVS_READ_ONLY;
+    if (mTransaction) return ESP_ERR_INVALID_STATE;
+
+    mTransaction = new (std::nothrow) Transaction;
+    if (!mTransaction) return ESP_ERR_NO_MEM;
+
     return ESP_OK;
 }
 
+esp_err_t NVSHandleSimple::abort_transaction()
+{
+    if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (!mTransaction) return ESP_ERR_INVALID_STATE;
+
+    delete mTransaction;
+    mTransaction = nullptr;
+    return ESP_OK;
+}
+
+esp_err_t NVSHandleSimple::open_blob(const char *key, nvs_open_mode_t mode)
+{
+    if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (mode == NVS_READWRITE && mReadOnly) return ESP_ERR_NVS_READ_ONLY;
+    if (mBlobStream || mTransaction) return ESP_ERR_INVALID_STATE;
+    if (strlen(key) > Item::MAX_KEY_LENGTH) return ESP_ERR_NVS_KEY_TOO_LONG;
+
+    mBlobStream = new (std::nothrow) BlobStream(mNsIndex, key, mode == NVS_READWRITE);
+    if (!mBlobStream) return ESP_ERR_NO_MEM;
+
+    esp_err_t err = mStoragePtr->openBlobStream(*mBlobStream);
+    if (err != ESP_OK) {
+        delete mBlobStream;
+        mBlobStream = nullptr;
+    }
+    return err;
+}
+
+esp_err_t NVSHandleSimple::read_blob(size_t offset, void* out_data, size_t len)
+{
+    if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (!mBlobStream || mBlobStream->isWrite()) return ESP_ERR_INVALID_STATE;
+
+    return mStoragePtr->readBlobStream(*mBlobStream, offset, out_data, len);
+}
+
+esp_err_t NVSHandleSimple::write_blob(size_t offset, const void* data, size_t len)
+{
+    if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (!mBlobStream || !mBlobStream->isWrite()) return ESP_ERR_INVALID_STATE;
+    if (offset != mBlobStream->size()) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = mStoragePtr->writeBlobStream(*mBlobStream, data, len);
+    if (err != ESP_OK) {
+        mStoragePtr->abortBlobStream(*mBlobStream);
+        delete mBlobStream;
+        mBlobStream = nullptr;
+    }
+    return err;
+}
+
+esp_err_t NVSHandleSimple::close_blob()
+{
+    if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (!mBlobStream) return ESP_ERR_INVALID_STATE;
+
+    // closeBlobStream() discards the data written if it fails
+    esp_err_t err = mStoragePtr->closeBlobStream(*mBlobStream);
+    delete mBlobStream;
+    mBlobStream = nullptr;
+    return err;
+}
+
 esp_err_t NVSHandleSimple::get_used_entry_count(size_t& used_entries)
 {
     used_entries = 0;
@@ -62,6 +62,18 @@ public:
 
     esp_err_t commit() override;
 
+    esp_err_t begin_transaction() override;
+
+    esp_err_t abort_transaction() override;
+
+    esp_err_t open_blob(const char *key, nvs_open_mode_t mode) override;
+
+    esp_err_t read_blob(size_t offset, void *out_data, size_t len) override;
+
+    esp_err_t write_blob(size_t offset, const void *data, size_t len) override;
+
+    esp_err_t close_blob() override;
+
     esp_err_t get_used_entry_count(size_t &usedEntries) override;
 
     esp_err_t getItemDataSize(ItemType datatype, const char *key, size_t &dataSize);
@@ -82,6 +94,16 @@ private:
      */
     Storage *mStoragePtr;
 
+    /**
+     * Changes staged by begin_transaction(), nullptr if no transaction is active.
+     */
+    Transaction *mTransaction = nullptr;
+
+    /**
+     * Blob opened by open_blob(), nullptr if no blob is open.
+     */
+    BlobStream *mBlobStream = nullptr;
+
     /**
      * Numeric representation of the namespace as it is saved in flash (see README.rst for further details).
      */
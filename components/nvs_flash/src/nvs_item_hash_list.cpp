@@ -45,11 +45,16 @@ HashList::HashListBlock::HashListBlock()
 esp_err_t HashList::insert(const Item& item, size_t index)
 {
     const uint32_t hash_24 = item.calculateCrc32WithoutValue() & 0xffffff;
+    return insertNode(HashListNode(hash_24, index));
+}
+
+esp_err_t HashList::insertNode(const HashListNode& node)
+{
     // add entry to the end of last block if possible
     if (mBlockList.size()) {
         auto& block = mBlockList.back();
         if (block.mCount < HashListBlock::ENTRY_COUNT) {
-            block.mNodes[block.mCount++] = HashListNode(hash_24, index);
+            block.mNodes[block.mCount++] = node;
             return ESP_OK;
         }
     }
@@ -59,12 +64,41 @@ esp_err_t HashList::insert(const Item& item, size_t index)
     if (!newBlock) return ESP_ERR_NO_MEM;
 
     mBlockList.push_back(newBlock);
-    newBlock->mNodes[0] = HashListNode(hash_24, index);
+    newBlock->mNodes[0] = node;
     newBlock->mCount++;
 
     return ESP_OK;
 }
 
+size_t HashList::getNodes(uint32_t* nodes, size_t maxCount)
+{
+    size_t count = 0;
+    for (auto it = mBlockList.begin(); it != mBlockList.end(); ++it) {
+        for (size_t i = 0; i < it->mCount; ++i) {
+            const HashListNode& e = it->mNodes[i];
+            if (e.mIndex == 0xff) {
+                continue;
+            }
+            if (count < maxCount) {
+                nodes[count] = (e.mHash << 8) | e.mIndex;
+            }
+            ++count;
+        }
+    }
+    return count;
+}
+
+esp_err_t HashList::insertNodes(const uint32_t* nodes, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        auto err = insertNode(HashListNode(nodes[i] >> 8, nodes[i] & 0xff));
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
 void HashList::erase(size_t index, bool itemShouldExist)
 {
     for (auto it = mBlockList.begin(); it != mBlockList.end();) {
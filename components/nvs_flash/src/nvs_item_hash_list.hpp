@@ -33,6 +33,13 @@ public:
     size_t find(size_t start, const Item& item);
     void clear();
 
+    /* Copy the entries of the list to 'nodes', as (hash << 8) | index, and return the number of entries.
+       At most 'maxCount' entries are copied. */
+    size_t getNodes(uint32_t* nodes, size_t maxCount);
+
+    /* Add entries copied by getNodes() */
+    esp_err_t insertNodes(const uint32_t* nodes, size_t count);
+
 private:
     HashList(const HashList& other);
     const HashList& operator= (const HashList& rhs);
@@ -64,6 +71,8 @@ protected:
         HashListNode mNodes[ENTRY_COUNT];
     };
 
+    esp_err_t insertNode(const HashListNode& node);
+
     typedef intrusive_list<HashListBlock> TBlockList;
     TBlockList mBlockList;
 }; // class HashList
@@ -0,0 +1,213 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "nvs_key_index.hpp"
+
+namespace nvs
+{
+
+/* Open addressing hash table with linear probing. Entries are removed by shifting
+ * the following entries of the probe sequence back, so no tombstones are needed. */
+
+static const size_t MIN_CAPACITY = 16;
+
+static bool isOverloaded(size_t count, size_t capacity)
+{
+    return count * 4 > capacity * 3;
+}
+
+KeyIndex::~KeyIndex()
+{
+    disable();
+}
+
+void KeyIndex::disable()
+{
+    delete[] mEntries;
+    mEntries = nullptr;
+    mCapacity = 0;
+    mCount = 0;
+}
+
+bool KeyIndex::reset(size_t itemCount)
+{
+    disable();
+
+    size_t capacity = MIN_CAPACITY;
+    while (isOverloaded(itemCount, capacity)) {
+        capacity *= 2;
+    }
+    if (capacity * sizeof(Entry) > mMaxSize) {
+        return false;
+    }
+    // leave room to add items without rehashing, if the budget allows it
+    if (capacity * 2 * sizeof(Entry) <= mMaxSize) {
+        capacity *= 2;
+    }
+
+    mEntries = new (std::nothrow) Entry[capacity];
+    if (!mEntries) {
+        return false;
+    }
+    for (size_t i = 0; i < capacity; ++i) {
+        mEntries[i].mPage = nullptr;
+    }
+    mCapacity = capacity;
+    return true;
+}
+
+uint32_t KeyIndex::hash(uint8_t nsIndex, const char* key, uint8_t chunkIdx)
+{
+    Item item(nsIndex, ItemType::ANY, 0, key, chunkIdx);
+    return (static_cast<uint32_t>(nsIndex) << 24) | (item.calculateCrc32WithoutValue() & 0xffffff);
+}
+
+bool KeyIndex::grow()
+{
+    size_t capacity = mCapacity * 2;
+    if (capacity * sizeof(Entry) > mMaxSize) {
+        return false;
+    }
+    Entry* entries = new (std::nothrow) Entry[capacity];
+    if (!entries) {
+        return false;
+    }
+    for (size_t i = 0; i < capacity; ++i) {
+        entries[i].mPage = nullptr;
+    }
+
+    Entry* oldEntries = mEntries;
+    size_t oldCapacity = mCapacity;
+    mEntries = entries;
+    mCapacity = capacity;
+    mCount = 0;
+    for (size_t i = 0; i < oldCapacity; ++i) {
+        if (oldEntries[i].mPage) {
+            insertEntry(oldEntries[i].mHash, oldEntries[i].mPage);
+        }
+    }
+    delete[] oldEntries;
+    return true;
+}
+
+void KeyIndex::insertEntry(uint32_t hash, Page* page)
+{
+    size_t i = home(hash);
+    while (mEntries[i].mPage) {
+        i = (i + 1) & (mCapacity - 1);
+    }
+    mEntries[i].mHash = hash;
+    mEntries[i].mPage = page;
+    ++mCount;
+}
+
+void KeyIndex::insert(Page* page, uint8_t nsIndex, const char* key, uint8_t chunkIdx)
+{
+    insertHash(page, hash(nsIndex, key, chunkIdx));
+}
+
+void KeyIndex::insertHash(Page* page, uint32_t hash)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    if (isOverloaded(mCount + 1, mCapacity) && !grow()) {
+        // every item must be in the index, so it can't be used any more
+        disable();
+        return;
+    }
+    insertEntry(hash, page);
+}
+
+void KeyIndex::eraseAt(size_t index)
+{
+    const size_t mask = mCapacity - 1;
+    size_t hole = index;
+    for (size_t i = (hole + 1) & mask; mEntries[i].mPage; i = (i + 1) & mask) {
+        size_t h = home(mEntries[i].mHash);
+        // entry i can move into the hole unless its home slot lies cyclically in (hole, i]
+        bool stays = (hole <= i) ? (hole < h && h <= i) : (hole < h || h <= i);
+        if (!stays) {
+            mEntries[hole] = mEntries[i];
+            hole = i;
+        }
+    }
+    mEntries[hole].mPage = nullptr;
+    --mCount;
+}
+
+void KeyIndex::erase(Page* page, uint8_t nsIndex, const char* key, uint8_t chunkIdx)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    const uint32_t h = hash(nsIndex, key, chunkIdx);
+    for (size_t i = home(h); mEntries[i].mPage; i = (i + 1) & (mCapacity - 1)) {
+        if (mEntries[i].mHash == h && mEntries[i].mPage == page) {
+            eraseAt(i);
+            return;
+        }
+    }
+}
+
+template<typename TPred>
+void KeyIndex::eraseIf(TPred pred)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    /* eraseAt() only moves entries into the hole at 'i' or to slots which haven't been visited yet,
+     * so 'i' is checked again after each removal. */
+    for (size_t i = 0; i < mCapacity;) {
+        if (mEntries[i].mPage && pred(mEntries[i])) {
+            eraseAt(i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+void KeyIndex::erasePage(Page* page)
+{
+    eraseIf([=](const Entry& e) -> bool {
+        return e.mPage == page;
+    });
+}
+
+void KeyIndex::eraseNamespace(uint8_t nsIndex)
+{
+    eraseIf([=](const Entry& e) -> bool {
+        return (e.mHash >> 24) == nsIndex;
+    });
+}
+
+Page* KeyIndex::find(uint32_t hash, size_t& pos) const
+{
+    if (!isEnabled()) {
+        return nullptr;
+    }
+    for (; pos < mCapacity; ++pos) {
+        const Entry& e = mEntries[(home(hash) + pos) & (mCapacity - 1)];
+        if (!e.mPage) {
+            break;
+        }
+        if (e.mHash == hash) {
+            ++pos;
+            return e.mPage;
+        }
+    }
+    pos = mCapacity;
+    return nullptr;
+}
+
+} // namespace nvs
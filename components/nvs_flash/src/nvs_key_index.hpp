@@ -0,0 +1,136 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_key_index_hpp
+#define nvs_key_index_hpp
+
+#include "sdkconfig.h"
+#include "nvs_types.hpp"
+
+#ifdef CONFIG_NVS_KEY_INDEX
+#define NVS_KEY_INDEX_MAX_SIZE CONFIG_NVS_KEY_INDEX_MAX_SIZE
+#else
+#define NVS_KEY_INDEX_MAX_SIZE 0
+#endif
+
+namespace nvs
+{
+
+class Page;
+
+/**
+ * Storage-wide index, mapping the <namespace, key, chunk index> hash of each item to the page
+ * which holds it. This lets Storage::findItem search only the pages which may contain an item,
+ * instead of every page.
+ *
+ * Every item in storage has an entry in the index. The index may also have entries for items which
+ * no longer exist (e.g. ones erased because of a CRC error), these are skipped when the page is
+ * searched. If the index doesn't fit into its RAM budget it disables itself, and Storage falls
+ * back to searching every page.
+ */
+class KeyIndex
+{
+public:
+    KeyIndex(size_t maxSize = NVS_KEY_INDEX_MAX_SIZE) : mMaxSize(maxSize)
+    {
+    }
+
+    ~KeyIndex();
+
+    bool isEnabled() const
+    {
+        return mEntries != nullptr;
+    }
+
+    /* Limit the RAM used by the index. Takes effect on the next reset(). */
+    void setMaxSize(size_t maxSize)
+    {
+        mMaxSize = maxSize;
+    }
+
+    /* Clear the index and size it for 'itemCount' items. Returns false, and disables the index, if it doesn't fit. */
+    bool reset(size_t itemCount);
+
+    void disable();
+
+    void insert(Page* page, uint8_t nsIndex, const char* key, uint8_t chunkIdx);
+
+    /* Insert an entry with a hash returned by hash() or passed to forEach() */
+    void insertHash(Page* page, uint32_t hash);
+
+    void erase(Page* page, uint8_t nsIndex, const char* key, uint8_t chunkIdx);
+
+    void erasePage(Page* page);
+
+    void eraseNamespace(uint8_t nsIndex);
+
+    static uint32_t hash(uint8_t nsIndex, const char* key, uint8_t chunkIdx);
+
+    /* Return the next page which may hold an item with the given hash, or nullptr.
+       'pos' should be 0 for the first call, and is updated for the next call. */
+    Page* find(uint32_t hash, size_t& pos) const;
+
+    size_t getMemorySize() const
+    {
+        return mCapacity * sizeof(Entry);
+    }
+
+    /* Call func(hash, page) for each entry */
+    template<typename TFunc>
+    void forEach(TFunc func) const
+    {
+        for (size_t i = 0; i < mCapacity; ++i) {
+            if (mEntries[i].mPage) {
+                func(mEntries[i].mHash, mEntries[i].mPage);
+            }
+        }
+    }
+
+    size_t getCount() const
+    {
+        return mCount;
+    }
+
+private:
+    KeyIndex(const KeyIndex& other);
+    const KeyIndex& operator= (const KeyIndex& rhs);
+
+protected:
+    struct Entry {
+        uint32_t mHash;     // namespace index in bits 31..24, hash of key and chunk index in bits 23..0
+        Page* mPage;        // nullptr if the entry is empty
+    };
+
+    size_t home(uint32_t hash) const
+    {
+        return hash & (mCapacity - 1);
+    }
+
+    bool grow();
+
+    void insertEntry(uint32_t hash, Page* page);
+
+    void eraseAt(size_t index);
+
+    template<typename TPred>
+    void eraseIf(TPred pred);
+
+    Entry* mEntries = nullptr;
+    size_t mCapacity = 0;   // always a power of two
+    size_t mCount = 0;
+    size_t mMaxSize;
+}; // class KeyIndex
+
+} // namespace nvs
+
+#endif /* nvs_key_index_hpp */
@@ -32,7 +32,7 @@ uint32_t Page::Header::calculateCrc32()
                     offsetof(Header, mCrc32) - offsetof(Header, mSeqNumber));
 }
 
-esp_err_t Page::load(uint32_t sectorNumber)
+esp_err_t Page::load(uint32_t sectorNumber, const Summary* summary)
 {
     mBaseAddress = sectorNumber * SEC_SIZE;
     mUsedEntryCount = 0;
@@ -46,27 +46,15 @@ esp_err_t Page::load(uint32_t sectorNumber)
     }
     if (header.mState == PageState::UNINITIALIZED) {
         mState = header.mState;
-        // check if the whole page is really empty
-        // reading the whole page takes ~40 times less than erasing it
-        const int BLOCK_SIZE = 128;
-        uint32_t* block = new (std::nothrow) uint32_t[BLOCK_SIZE];
-
-        if (!block) return ESP_ERR_NO_MEM;
-
-        for (uint32_t i = 0; i < SPI_FLASH_SEC_SIZE; i += 4 * BLOCK_SIZE) {
-            rc = spi_flash_read(mBaseAddress + i, block, 4 * BLOCK_SIZE);
+        // the checkpoint has seen the page empty, PageManager checks it if the checkpoint is outdated
+        const uint8_t* headerBytes = reinterpret_cast<const uint8_t*>(&header);
+        if (!summary || summary->state != PageState::UNINITIALIZED
+                || std::any_of(headerBytes, headerBytes + sizeof(header), [](uint8_t b) { return b != 0xff; })) {
+            rc = checkErased();
             if (rc != ESP_OK) {
-                mState = PageState::INVALID;
-                delete[] block;
                 return rc;
             }
-            if (std::any_of(block, block + BLOCK_SIZE, [](uint32_t val) -> bool { return val != 0xffffffff; })) {
-                // page isn't as empty after all, mark it as corrupted
-                mState = PageState::CORRUPT;
-                break;
-            }
         }
-        delete[] block;
     } else if (header.mCrc32 != header.calculateCrc32()) {
         header.mState = PageState::CORRUPT;
     } else {
@@ -84,9 +72,20 @@ esp_err_t Page::load(uint32_t sectorNumber)
         break;
 
     case PageState::FULL:
+        if (summary && summary->state == mState && summary->seqNumber == mSeqNumber) {
+            rc = mLoadSummary(*summary);
+            if (rc != ESP_ERR_NVS_NOT_FOUND) {
+                return rc;
+            }
+        }
+        // fall through
     case PageState::ACTIVE:
     case PageState::FREEING:
-        mLoadEntryTable();
+        // a page whose entry table couldn't be updated must not end up in the list of free pages
+        rc = mLoadEntryTable();
+        if (rc != ESP_OK) {
+            return rc;
+        }
         break;
 
     default:
@@ -97,6 +96,38 @@ esp_err_t Page::load(uint32_t sectorNumber)
     return ESP_OK;
 }
 
+esp_err_t Page::checkErased()
+{
+    assert(mState == PageState::UNINITIALIZED);
+    // check if the whole page is really empty
+    // reading the whole page takes ~40 times less than erasing it
+    const int BLOCK_SIZE = 128;
+    uint32_t* block = new (std::nothrow) uint32_t[BLOCK_SIZE];
+
+    if (!block) return ESP_ERR_NO_MEM;
+
+    for (uint32_t i = 0; i < SPI_FLASH_SEC_SIZE; i += 4 * BLOCK_SIZE) {
+        auto rc = spi_flash_read(mBaseAddress + i, block, 4 * BLOCK_SIZE);
+        if (rc != ESP_OK) {
+            mState = PageState::INVALID;
+            delete[] block;
+            return rc;
+        }
+        if (std::any_of(block, block + BLOCK_SIZE, [](uint32_t val) -> bool { return val != 0xffffffff; })) {
+            // page isn't as empty after all, mark it as corrupted
+            mState = PageState::CORRUPT;
+            break;
+        }
+    }
+    delete[] block;
+    return ESP_OK;
+}
+
+uint32_t Page::getEntryTableCrc() const
+{
+    return crc32_le(0xffffffff, reinterpret_cast<const uint8_t*>(mEntryTable.data()), mEntryTable.byteSize());
+}
+
 esp_err_t Page::writeEntry(const Item& item)
 {
     esp_err_t err;
@@ -264,6 +295,112 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
     return ESP_OK;
 }
 
+esp_err_t Page::writeItems(uint8_t nsIndex, const ItemData* items, size_t count, size_t& written)
+{
+    esp_err_t err;
+    written = 0;
+
+    if (mState == PageState::INVALID) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+
+    if (mState == PageState::UNINITIALIZED) {
+        err = initialize();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (mState == PageState::FULL || mNextFreeEntry == INVALID_ENTRY) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    // find out how many items fit into the free entries
+    size_t itemCount = 0;
+    size_t entriesCount = 0;
+    for (; itemCount < count; ++itemCount) {
+        const ItemData& data = items[itemCount];
+        assert(data.datatype != ItemType::BLOB && data.datatype != ItemType::BLOB_DATA && data.datatype != ItemType::BLOB_IDX);
+        if (strlen(data.key) > Item::MAX_KEY_LENGTH) {
+            return ESP_ERR_NVS_KEY_TOO_LONG;
+        }
+        if (data.dataSize > Page::CHUNK_MAX_SIZE) {
+            return ESP_ERR_NVS_VALUE_TOO_LONG;
+        }
+        size_t span = 1;
+        if (isVariableLengthType(data.datatype)) {
+            span += (data.dataSize + ENTRY_SIZE - 1) / ENTRY_SIZE;
+        }
+        if (mNextFreeEntry + entriesCount + span > ENTRY_COUNT) {
+            break;
+        }
+        entriesCount += span;
+    }
+
+    if (itemCount == 0) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    Item* buf = new (std::nothrow) Item[entriesCount];
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t index = 0;
+    for (size_t i = 0; i < itemCount; ++i) {
+        const ItemData& data = items[i];
+        size_t span = 1;
+        if (isVariableLengthType(data.datatype)) {
+            span += (data.dataSize + ENTRY_SIZE - 1) / ENTRY_SIZE;
+        }
+        Item& item = buf[index];
+        item = Item(nsIndex, data.datatype, span, data.key);
+        if (!isVariableLengthType(data.datatype)) {
+            memcpy(item.data, data.data, data.dataSize);
+        } else {
+            item.varLength.dataCrc32 = Item::calculateCrc32(static_cast<const uint8_t*>(data.data), data.dataSize);
+            item.varLength.dataSize = data.dataSize;
+            item.varLength.reserved = 0xffff;
+            uint8_t* dst = buf[index + 1].rawData;
+            memcpy(dst, data.data, data.dataSize);
+            std::fill(dst + data.dataSize, dst + (span - 1) * ENTRY_SIZE, 0xff);
+        }
+        item.crc32 = item.calculateCrc32();
+
+        err = mHashList.insert(item, mNextFreeEntry + index);
+        if (err != ESP_OK) {
+            for (size_t j = 0; j < index; j += buf[j].span) {
+                mHashList.erase(mNextFreeEntry + j);
+            }
+            delete[] buf;
+            return err;
+        }
+        index += span;
+    }
+
+    // power loss before all entry states are updated leaves entries with data but without WRITTEN state,
+    // these are erased when the page is loaded again
+    err = nvs_flash_write(getEntryAddress(mNextFreeEntry), buf, entriesCount * ENTRY_SIZE);
+    delete[] buf;
+    if (err != ESP_OK) {
+        mState = PageState::INVALID;
+        return err;
+    }
+
+    err = alterEntryRangeState(mNextFreeEntry, mNextFreeEntry + entriesCount, EntryState::WRITTEN);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (mFirstUsedEntry == INVALID_ENTRY) {
+        mFirstUsedEntry = mNextFreeEntry;
+    }
+    mUsedEntryCount += entriesCount;
+    mNextFreeEntry += entriesCount;
+    written = itemCount;
+    return ESP_OK;
+}
+
 esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize, uint8_t chunkIdx, VerOffset chunkStart)
 {
     size_t index = 0;
@@ -315,6 +452,89 @@ esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, vo
     return ESP_OK;
 }
 
+esp_err_t Page::readItemData(uint8_t nsIndex, ItemType datatype, const char* key, size_t offset, void* data, size_t size, uint8_t chunkIdx)
+{
+    size_t index = 0;
+    Item item;
+
+    if (mState == PageState::INVALID) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+
+    esp_err_t rc = findItem(nsIndex, datatype, key, index, item, chunkIdx);
+    if (rc != ESP_OK) {
+        return rc;
+    }
+
+    if (!isVariableLengthType(datatype)) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+
+    if (offset > item.varLength.dataSize || size > item.varLength.dataSize - offset) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    uint8_t* dst = reinterpret_cast<uint8_t*>(data);
+    size_t i = index + 1 + offset / ENTRY_SIZE;
+    size_t entryOffset = offset % ENTRY_SIZE;
+    while (size > 0) {
+        Item ditem;
+        rc = readEntry(i, ditem);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        size_t willCopy = ENTRY_SIZE - entryOffset;
+        willCopy = (size < willCopy)?size:willCopy;
+        memcpy(dst, ditem.rawData + entryOffset, willCopy);
+        size -= willCopy;
+        dst += willCopy;
+        entryOffset = 0;
+        ++i;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Page::checkItemData(uint8_t nsIndex, ItemType datatype, const char* key, uint8_t chunkIdx)
+{
+    size_t index = 0;
+    Item item;
+
+    if (mState == PageState::INVALID) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+
+    esp_err_t rc = findItem(nsIndex, datatype, key, index, item, chunkIdx);
+    if (rc != ESP_OK) {
+        return rc;
+    }
+
+    if (!isVariableLengthType(datatype)) {
+        return ESP_OK;
+    }
+
+    uint32_t crc = 0xffffffff;
+    size_t left = item.varLength.dataSize;
+    for (size_t i = index + 1; i < index + item.span; ++i) {
+        Item ditem;
+        rc = readEntry(i, ditem);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        size_t willCheck = ENTRY_SIZE;
+        willCheck = (left < willCheck)?left:willCheck;
+        crc = crc32_le(crc, ditem.rawData, willCheck);
+        left -= willCheck;
+    }
+    if (crc != item.varLength.dataCrc32) {
+        rc = eraseEntryAndSpan(index);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
 esp_err_t Page::cmpItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t chunkIdx, VerOffset chunkStart)
 {
     size_t index = 0;
@@ -512,6 +732,62 @@ esp_err_t Page::copyItems(Page& other)
     return ESP_OK;
 }
 
+esp_err_t Page::moveItem(size_t index, Page& other)
+{
+    if (index >= ENTRY_COUNT || mEntryTable.get(index) != EntryState::WRITTEN) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    if (other.mState == PageState::UNINITIALIZED) {
+        auto err = other.initialize();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (other.mState != PageState::ACTIVE) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    Item entry;
+    auto err = readEntry(index, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    size_t span = entry.span;
+    if (span == 0 || index + span > ENTRY_COUNT) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    if (other.mNextFreeEntry == INVALID_ENTRY || other.mNextFreeEntry + span > ENTRY_COUNT) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    err = other.mHashList.insert(entry, other.mNextFreeEntry);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // same order as writeItem: if power is lost before the copy is erased, the copy is the last
+    // item of the newest page, and PageManager::load() erases the duplicate on this page
+    err = other.writeEntry(entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (size_t i = index + 1; i < index + span; ++i) {
+        err = readEntry(i, entry);
+        if (err != ESP_OK) {
+            return err;
+        }
+        err = other.writeEntry(entry);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    return eraseEntryAndSpan(index);
+}
+
 esp_err_t Page::mLoadEntryTable()
 {
     // for states where we actually care about data in the page, read entry state table
@@ -526,19 +802,7 @@ esp_err_t Page::mLoadEntryTable()
         }
     }
 
-    mErasedEntryCount = 0;
-    mUsedEntryCount = 0;
-    for (size_t i = 0; i < ENTRY_COUNT; ++i) {
-        auto s = mEntryTable.get(i);
-        if (s == EntryState::WRITTEN) {
-            if (mFirstUsedEntry == INVALID_ENTRY) {
-                mFirstUsedEntry = i;
-            }
-            ++mUsedEntryCount;
-        } else if (s == EntryState::ERASED) {
-            ++mErasedEntryCount;
-        }
-    }
+    mCountEntries();
 
     // for PageState::ACTIVE, we may have more data written to this page
     // as such, we need to figure out where the first unused entry is
@@ -712,6 +976,47 @@ esp_err_t Page::mLoadEntryTable()
 }
 
 
+esp_err_t Page::mLoadSummary(const Summary& summary)
+{
+    auto rc = spi_flash_read(mBaseAddress + ENTRY_TABLE_OFFSET, mEntryTable.data(),
+                             mEntryTable.byteSize());
+    if (rc != ESP_OK) {
+        mState = PageState::INVALID;
+        return rc;
+    }
+
+    // items were erased since the checkpoint was written, the hash list is outdated
+    if (getEntryTableCrc() != summary.entryTableCrc) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    mCountEntries();
+
+    rc = mHashList.insertNodes(summary.hashNodes, summary.hashNodeCount);
+    if (rc != ESP_OK) {
+        mState = PageState::INVALID;
+        return rc;
+    }
+    return ESP_OK;
+}
+
+void Page::mCountEntries()
+{
+    mErasedEntryCount = 0;
+    mUsedEntryCount = 0;
+    for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+        auto s = mEntryTable.get(i);
+        if (s == EntryState::WRITTEN) {
+            if (mFirstUsedEntry == INVALID_ENTRY) {
+                mFirstUsedEntry = i;
+            }
+            ++mUsedEntryCount;
+        } else if (s == EntryState::ERASED) {
+            ++mErasedEntryCount;
+        }
+    }
+}
+
 esp_err_t Page::initialize()
 {
     assert(mState == PageState::UNINITIALIZED);
@@ -766,6 +1071,7 @@ esp_err_t Page::alterEntryRangeState(size_t begin, size_t end, EntryState state)
             auto rc = spi_flash_write(mBaseAddress + ENTRY_TABLE_OFFSET + static_cast<uint32_t>(wordIndex) * 4,
                     &word, 4);
             if (rc != ESP_OK) {
+                mState = PageState::INVALID;
                 return rc;
             }
         }
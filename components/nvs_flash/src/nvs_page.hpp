@@ -77,12 +77,50 @@ public:
         INVALID       = 0
     };
 
+    /**
+     * A primitive or string item, as written by writeItems().
+     */
+    struct ItemData {
+        ItemType datatype;
+        const char* key;
+        const void* data;
+        size_t dataSize;
+    };
+
+    /**
+     * State of a page saved in a mount checkpoint. load() uses it instead of reading the items of
+     * a full page if the entry state table of the page hasn't changed, and to skip checking that
+     * a free page is empty.
+     */
+    struct Summary {
+        PageState state;
+        uint32_t seqNumber;
+        uint32_t entryTableCrc;
+        const uint32_t* hashNodes;  // item hash list, see HashList::getNodes()
+        size_t hashNodeCount;
+    };
+
     PageState state() const
     {
         return mState;
     }
 
-    esp_err_t load(uint32_t sectorNumber);
+    esp_err_t load(uint32_t sectorNumber, const Summary* summary = nullptr);
+
+    /* Check that a page loaded as uninitialized is empty, and mark it as corrupt if it isn't */
+    esp_err_t checkErased();
+
+    uint32_t getSectorNumber() const
+    {
+        return mBaseAddress / SEC_SIZE;
+    }
+
+    uint32_t getEntryTableCrc() const;
+
+    size_t getHashNodes(uint32_t* nodes, size_t maxCount)
+    {
+        return mHashList.getNodes(nodes, maxCount);
+    }
 
     esp_err_t getSeqNumber(uint32_t& seqNumber) const;
 
@@ -92,8 +130,19 @@ public:
 
     esp_err_t writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t chunkIdx = CHUNK_ANY);
 
+    /* Write as many of 'items' as fit into the page, using one flash write for all of their entries.
+       'written' is set to the number of items written, ESP_ERR_NVS_PAGE_FULL is returned if none fits. */
+    esp_err_t writeItems(uint8_t nsIndex, const ItemData* items, size_t count, size_t& written);
+
     esp_err_t readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize, uint8_t chunkIdx = CHUNK_ANY, VerOffset chunkStart = VerOffset::VER_ANY);
 
+    /* Read 'size' bytes at 'offset' of the data of a variable length item. The CRC of the data isn't checked, see checkItemData(). */
+    esp_err_t readItemData(uint8_t nsIndex, ItemType datatype, const char* key, size_t offset, void* data, size_t size, uint8_t chunkIdx = CHUNK_ANY);
+
+    /* Check the CRC of the data of a variable length item without reading it into RAM. Like readItem(), erases the
+       item and returns ESP_ERR_NVS_NOT_FOUND if the data is corrupted. */
+    esp_err_t checkItemData(uint8_t nsIndex, ItemType datatype, const char* key, uint8_t chunkIdx = CHUNK_ANY);
+
     esp_err_t cmpItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t chunkIdx = CHUNK_ANY, VerOffset chunkStart = VerOffset::VER_ANY);
 
     esp_err_t eraseItem(uint8_t nsIndex, ItemType datatype, const char* key, uint8_t chunkIdx = CHUNK_ANY, VerOffset chunkStart = VerOffset::VER_ANY);
@@ -143,6 +192,9 @@ public:
 
     esp_err_t copyItems(Page& other);
 
+    /* Copy the item starting at the given entry to the end of the other page, then erase it from this page */
+    esp_err_t moveItem(size_t index, Page& other);
+
     esp_err_t erase();
 
     void debugDump() const;
@@ -177,6 +229,10 @@ protected:
 
     esp_err_t mLoadEntryTable();
 
+    esp_err_t mLoadSummary(const Summary& summary);
+
+    void mCountEntries();
+
     esp_err_t initialize();
 
     esp_err_t alterEntryState(size_t index, EntryState state);
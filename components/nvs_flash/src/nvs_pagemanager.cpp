@@ -12,10 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include "nvs_pagemanager.hpp"
+#include "nvs_checkpoint.hpp"
 
 namespace nvs
 {
-esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
+esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount, const Checkpoint* checkpoint)
 {
     mBaseSector = baseSector;
     mPageCount = sectorCount;
@@ -26,7 +27,7 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
     if (!mPages) return ESP_ERR_NO_MEM;
 
     for (uint32_t i = 0; i < sectorCount; ++i) {
-        auto err = mPages[i].load(baseSector + i);
+        auto err = mPages[i].load(baseSector + i, checkpoint ? checkpoint->findPage(i) : nullptr);
         if (err != ESP_OK) {
             return err;
         }
@@ -46,6 +47,19 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
         }
     }
 
+    // free pages weren't checked if the checkpoint has seen them empty. This is only known to be
+    // true if no page was used since, i.e. if the pages in use are the ones of the checkpoint.
+    if (checkpoint && !checkpoint->matches(*this)) {
+        for (auto it = mFreePageList.begin(); it != mFreePageList.end(); ++it) {
+            if (it->state() == Page::PageState::UNINITIALIZED) {
+                auto err = it->checkErased();
+                if (err != ESP_OK) {
+                    return err;
+                }
+            }
+        }
+    }
+
     if (mPageList.empty()) {
         mSeqNumber = 0;
         return activatePage();
@@ -133,8 +147,12 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
     return ESP_OK;
 }
 
-esp_err_t PageManager::requestNewPage()
+esp_err_t PageManager::requestNewPage(Page** reclaimedPage)
 {
+    if (reclaimedPage) {
+        *reclaimedPage = nullptr;
+    }
+
     if (mFreePageList.empty()) {
         return ESP_ERR_NVS_INVALID_STATE;
     }
@@ -193,6 +211,40 @@ esp_err_t PageManager::requestNewPage()
     mPageList.erase(maxUnusedItemsPageIt);
     mFreePageList.push_back(erasedPage);
 
+    if (reclaimedPage) {
+        *reclaimedPage = erasedPage;
+    }
+    return ESP_OK;
+}
+
+Page* PageManager::findPageToReclaim()
+{
+    Page* result = nullptr;
+    size_t maxUnusedItems = 0;
+    for (auto it = begin(); it != end(); ++it) {
+        if (it->state() != Page::PageState::FULL || static_cast<Page*>(it) == &back()) {
+            continue;
+        }
+        auto unused = Page::ENTRY_COUNT - it->getUsedEntryCount();
+        if (unused > maxUnusedItems) {
+            result = it;
+            maxUnusedItems = unused;
+        }
+    }
+    return result;
+}
+
+esp_err_t PageManager::releasePage(Page* page)
+{
+    assert(page->state() == Page::PageState::FULL && page->getUsedEntryCount() == 0);
+    assert(page != &back());
+
+    auto err = page->erase();
+    if (err != ESP_OK) {
+        return err;
+    }
+    mPageList.erase(page);
+    mFreePageList.push_back(page);
     return ESP_OK;
 }
 
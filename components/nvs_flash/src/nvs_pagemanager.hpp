@@ -23,6 +23,8 @@
 
 namespace nvs
 {
+class Checkpoint;
+
 class PageManager
 {
     using TPageList = intrusive_list<Page>;
@@ -31,7 +33,7 @@ public:
 
     PageManager() {}
 
-    esp_err_t load(uint32_t baseSector, uint32_t sectorCount);
+    esp_err_t load(uint32_t baseSector, uint32_t sectorCount, const Checkpoint* checkpoint = nullptr);
 
     TPageListIterator begin()
     {
@@ -52,7 +54,18 @@ public:
         return mPageCount;
     }
 
-    esp_err_t requestNewPage();
+    esp_err_t requestNewPage(Page** reclaimedPage = nullptr);
+
+    size_t getFreePageCount()
+    {
+        return mFreePageList.size();
+    }
+
+    /* Full page with the most erased entries, other than the current page. nullptr if no such page has any. */
+    Page* findPageToReclaim();
+
+    /* Erase a full page whose items were all erased or moved, and add it to the free pages */
+    esp_err_t releasePage(Page* page);
 
     esp_err_t fillStats(nvs_stats_t& nvsStats);
 
@@ -63,6 +76,7 @@ public:
 
 protected:
     friend class Iterator;
+    friend class Checkpoint;
 
     esp_err_t activatePage();
 
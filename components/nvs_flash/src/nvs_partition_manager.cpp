@@ -118,6 +118,9 @@ esp_err_t NVSPartitionManager::deinit_partition(const char *partition_label)
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
 
+    /* A checkpoint only makes the next init faster, so deinit succeeds even if it can't be written */
+    storage->writeCheckpoint();
+
 #ifdef CONFIG_NVS_ENCRYPTION
     if(EncrMgr::isEncrActive()) {
         auto encrMgr = EncrMgr::getInstance();
@@ -199,5 +202,19 @@ Storage* NVSPartitionManager::lookup_storage_from_name(const char* name)
     return it;
 }
 
+esp_err_t NVSPartitionManager::gc_step(size_t max_items, bool& done)
+{
+    done = true;
+    for (auto it = begin(nvs_storage_list); it != end(nvs_storage_list); ++it) {
+        bool storageDone;
+        esp_err_t err = it->gcStep(max_items, storageDone);
+        if (err != ESP_OK) {
+            return err;
+        }
+        done = done && storageDone;
+    }
+    return ESP_OK;
+}
+
 } // nvs
 
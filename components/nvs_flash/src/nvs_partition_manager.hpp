@@ -43,6 +43,9 @@ public:
 
     Storage* lookup_storage_from_name(const char* name);
 
+    /* Run a garbage collection step on each partition. done is set if none of them has more to do. */
+    esp_err_t gc_step(size_t max_items, bool& done);
+
     esp_err_t open_handle(const char *part_name, const char *ns_name, nvs_open_mode_t open_mode, NVSHandleSimple** handle);
 
     esp_err_t close_handle(NVSHandleSimple* handle);
@@ -12,6 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include "nvs_storage.hpp"
+#ifdef CONFIG_NVS_ENCRYPTION
+#include "nvs_encr.hpp"
+#endif
 
 #ifndef ESP_PLATFORM
 #include <map>
@@ -21,6 +24,21 @@
 namespace nvs
 {
 
+/* Namespace and key of the log written by commitTransaction(). The namespace is reserved,
+ * it takes one of the namespace indices once a transaction was committed */
+static const char* TXN_LOG_NAMESPACE = "nvs.txn";
+static const char* TXN_LOG_KEY = "log";
+
+/* The mount checkpoint isn't encrypted, so it is only used while no partition is encrypted */
+static bool checkpointAllowed()
+{
+#ifdef CONFIG_NVS_ENCRYPTION
+    return !EncrMgr::isEncrActive();
+#else
+    return true;
+#endif
+}
+
 Storage::~Storage()
 {
     clearNamespaces();
@@ -60,8 +78,24 @@ esp_err_t Storage::populateBlobIndices(TBlobIndexList& blobIdxList)
     return ESP_OK;
 }
 
-void Storage::eraseOrphanDataBlobs(TBlobIndexList& blobIdxList)
+esp_err_t Storage::eraseOrphanDataBlobs(TBlobIndexList& blobIdxList)
 {
+    /* Hash table of the blob indices, so that each data chunk is only compared
+     * with the indices which have the same namespace and key */
+    size_t bucketCount = 1;
+    while (bucketCount < blobIdxList.size()) {
+        bucketCount *= 2;
+    }
+    BlobIndexNode** buckets = new (std::nothrow) BlobIndexNode*[bucketCount]();
+    if (!buckets) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (auto it = blobIdxList.begin(); it != blobIdxList.end(); ++it) {
+        size_t bucket = KeyIndex::hash(it->nsIndex, it->key, Page::CHUNK_ANY) & (bucketCount - 1);
+        it->nextInBucket = buckets[bucket];
+        buckets[bucket] = it;
+    }
+
     for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
         Page& p = *it;
         size_t itemIndex = 0;
@@ -72,69 +106,115 @@ void Storage::eraseOrphanDataBlobs(TBlobIndexList& blobIdxList)
          * 2) VER_1_OFFSET <= chunkIndex < VER_ANY => Version1 chunks
          */
         while (p.findItem(Page::NS_ANY, ItemType::BLOB_DATA, nullptr, itemIndex, item) == ESP_OK) {
-
-            auto iter = std::find_if(blobIdxList.begin(),
-                    blobIdxList.end(),
-                    [=] (const BlobIndexNode& e) -> bool
-                    {return (strncmp(item.key, e.key, sizeof(e.key) - 1) == 0)
-                            && (item.nsIndex == e.nsIndex)
-                            && (item.chunkIndex >=  static_cast<uint8_t> (e.chunkStart))
-                            && (item.chunkIndex < static_cast<uint8_t> (e.chunkStart) + e.chunkCount);});
-            if (iter == std::end(blobIdxList)) {
+            BlobIndexNode* e = buckets[KeyIndex::hash(item.nsIndex, item.key, Page::CHUNK_ANY) & (bucketCount - 1)];
+            while (e && !((strncmp(item.key, e->key, sizeof(e->key) - 1) == 0)
+                          && (item.nsIndex == e->nsIndex)
+                          && (item.chunkIndex >=  static_cast<uint8_t> (e->chunkStart))
+                          && (item.chunkIndex < static_cast<uint8_t> (e->chunkStart) + e->chunkCount))) {
+                e = e->nextInBucket;
+            }
+            if (!e) {
                 p.eraseItem(item.nsIndex, item.datatype, item.key, item.chunkIndex);
             }
             itemIndex += item.span;
         }
     }
+
+    delete[] buckets;
+    return ESP_OK;
 }
 
 esp_err_t Storage::init(uint32_t baseSector, uint32_t sectorCount)
 {
-    auto err = mPageManager.load(baseSector, sectorCount);
+    mKeyIndex.disable();
+    mGcPage = nullptr;
+
+    Checkpoint checkpoint;
+    bool haveCheckpoint = mCheckpointEnabled && checkpointAllowed()
+                          && checkpoint.read(baseSector, sectorCount) == ESP_OK;
+    mCheckpointId = checkpoint.getId();
+    mCheckpointMatched = false;
+
+    auto err = mPageManager.load(baseSector, sectorCount, haveCheckpoint ? &checkpoint : nullptr);
     if (err != ESP_OK) {
         mState = StorageState::INVALID;
         return err;
     }
 
-    // load namespaces list
     clearNamespaces();
     std::fill_n(mNamespaceUsage.data(), mNamespaceUsage.byteSize() / 4, 0);
-    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
-        Page& p = *it;
-        size_t itemIndex = 0;
-        Item item;
-        while (p.findItem(Page::NS_INDEX, ItemType::U8, nullptr, itemIndex, item) == ESP_OK) {
-            NamespaceEntry* entry = new (std::nothrow) NamespaceEntry;
 
-            if (!entry) {
-                mState = StorageState::INVALID;
-                return ESP_ERR_NO_MEM;
+    if (haveCheckpoint && checkpoint.matches(mPageManager)) {
+        // No page changed since the checkpoint was written, so there are no orphan blob chunks either
+        err = restoreCheckpoint(checkpoint);
+        if (err != ESP_OK) {
+            mState = StorageState::INVALID;
+            return err;
+        }
+        mCheckpointMatched = true;
+        mState = StorageState::ACTIVE;
+    } else {
+        // load namespaces list
+        for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+            Page& p = *it;
+            size_t itemIndex = 0;
+            Item item;
+            while (p.findItem(Page::NS_INDEX, ItemType::U8, nullptr, itemIndex, item) == ESP_OK) {
+                NamespaceEntry* entry = new (std::nothrow) NamespaceEntry;
+
+                if (!entry) {
+                    mState = StorageState::INVALID;
+                    return ESP_ERR_NO_MEM;
+                }
+
+                item.getKey(entry->mName, sizeof(entry->mName));
+                item.getValue(entry->mIndex);
+                mNamespaces.push_back(entry);
+                mNamespaceUsage.set(entry->mIndex, true);
+                itemIndex += item.span;
             }
+        }
+        mNamespaceUsage.set(0, true);
+        mNamespaceUsage.set(255, true);
+        mState = StorageState::ACTIVE;
 
-            item.getKey(entry->mName, sizeof(entry->mName));
-            item.getValue(entry->mIndex);
-            mNamespaces.push_back(entry);
-            mNamespaceUsage.set(entry->mIndex, true);
-            itemIndex += item.span;
+        // Populate list of multi-page index entries.
+        TBlobIndexList blobIdxList;
+        err = populateBlobIndices(blobIdxList);
+        if (err == ESP_OK) {
+            // Remove the entries for which there is no parent multi-page index.
+            err = eraseOrphanDataBlobs(blobIdxList);
+        }
+
+        // Purge the blob index list
+        blobIdxList.clearAndFreeNodes();
+
+        if (err != ESP_OK) {
+            mState = StorageState::INVALID;
+            return ESP_ERR_NO_MEM;
         }
+
+        buildKeyIndex();
     }
-    mNamespaceUsage.set(0, true);
-    mNamespaceUsage.set(255, true);
-    mState = StorageState::ACTIVE;
+    checkpoint.clear();
 
-    // Populate list of multi-page index entries.
-    TBlobIndexList blobIdxList;
-    err = populateBlobIndices(blobIdxList);
-    if (err != ESP_OK) {
-        mState = StorageState::INVALID;
-        return ESP_ERR_NO_MEM;
+    // Erasing duplicates and orphan chunks above ignores errors, check that flash writes didn't fail
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        if (it->state() == Page::PageState::INVALID) {
+            mState = StorageState::INVALID;
+            return ESP_ERR_FLASH_OP_FAIL;
+        }
     }
 
-    // Remove the entries for which there is no parent multi-page index.
-    eraseOrphanDataBlobs(blobIdxList);
+    mCheckpointFingerprint = Checkpoint::fingerprint(mPageManager);
 
-    // Purge the blob index list
-    blobIdxList.clearAndFreeNodes();
+    // Complete a transaction whose commit was interrupted. If this fails, e.g. because
+    // there isn't enough space, the log is kept and the next commit tries again.
+    err = recoverTransaction();
+    if (err == ESP_ERR_FLASH_OP_FAIL) {
+        mState = StorageState::INVALID;
+        return err;
+    }
 
 #ifndef ESP_PLATFORM
     debugCheck();
@@ -142,13 +222,224 @@ esp_err_t Storage::init(uint32_t baseSector, uint32_t sectorCount)
     return ESP_OK;
 }
 
+esp_err_t Storage::restoreCheckpoint(const Checkpoint& checkpoint)
+{
+    size_t namespaceCount;
+    const Checkpoint::NamespaceRecord* namespaces = checkpoint.getNamespaces(namespaceCount);
+    for (size_t i = 0; i < namespaceCount; ++i) {
+        NamespaceEntry* entry = new (std::nothrow) NamespaceEntry;
+        if (!entry) {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(entry->mName, namespaces[i].mName, sizeof(entry->mName));
+        entry->mName[sizeof(entry->mName) - 1] = 0;
+        entry->mIndex = namespaces[i].mIndex;
+        mNamespaces.push_back(entry);
+        mNamespaceUsage.set(entry->mIndex, true);
+    }
+    mNamespaceUsage.set(0, true);
+    mNamespaceUsage.set(255, true);
+
+    if (!checkpoint.hasKeyIndex()) {
+        buildKeyIndex();
+        return ESP_OK;
+    }
+    if (!mKeyIndex.reset(checkpoint.getKeyHashCount())) {
+        return ESP_OK;
+    }
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        size_t count;
+        const uint32_t* hashes = checkpoint.getKeyHashes(it->getSectorNumber() - mPageManager.getBaseSector(), count);
+        for (size_t i = 0; i < count; ++i) {
+            mKeyIndex.insertHash(it, hashes[i]);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeCheckpoint()
+{
+    if (!mCheckpointEnabled || !checkpointAllowed()) {
+        return ESP_OK;
+    }
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    uint32_t fingerprint = Checkpoint::fingerprint(mPageManager);
+    if (mCheckpointMatched && fingerprint == mCheckpointFingerprint) {
+        // the checkpoint read by init() is still valid
+        return ESP_OK;
+    }
+
+    size_t namespaceCount = mNamespaces.size();
+    Checkpoint::NamespaceRecord* namespaces = new (std::nothrow) Checkpoint::NamespaceRecord[namespaceCount + 1];
+    if (!namespaces) {
+        return ESP_ERR_NO_MEM;
+    }
+    size_t i = 0;
+    for (auto it = mNamespaces.begin(); it != mNamespaces.end(); ++it, ++i) {
+        memset(&namespaces[i], 0xff, sizeof(namespaces[i]));
+        memcpy(namespaces[i].mName, it->mName, sizeof(namespaces[i].mName));
+        namespaces[i].mIndex = it->mIndex;
+    }
+
+    auto err = Checkpoint::write(mPageManager, mCheckpointId + 1, namespaces, namespaceCount,
+                                 mKeyIndex.isEnabled() ? &mKeyIndex : nullptr);
+    delete[] namespaces;
+    if (err != ESP_OK) {
+        return err;
+    }
+    mCheckpointId++;
+    mCheckpointMatched = true;
+    mCheckpointFingerprint = fingerprint;
+    return ESP_OK;
+}
+
 bool Storage::isValid() const
 {
     return mState == StorageState::ACTIVE;
 }
 
+void Storage::buildKeyIndex()
+{
+    // items may span several entries, so this is an upper bound for the number of items
+    size_t usedEntries = 0;
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        usedEntries += it->getUsedEntryCount();
+    }
+    if (!mKeyIndex.reset(usedEntries)) {
+        return;
+    }
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        addPageToKeyIndex(*it);
+    }
+}
+
+void Storage::addPageToKeyIndex(Page& page)
+{
+    size_t itemIndex = 0;
+    Item item;
+    while (mKeyIndex.isEnabled() && page.findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
+        mKeyIndex.insert(&page, item.nsIndex, item.key, item.chunkIndex);
+        itemIndex += item.span;
+    }
+}
+
+esp_err_t Storage::requestNewPage()
+{
+    Page* reclaimedPage;
+    auto err = mPageManager.requestNewPage(&reclaimedPage);
+    if (err != ESP_OK) {
+        if (err != ESP_ERR_NVS_NOT_ENOUGH_SPACE && err != ESP_ERR_NVS_INVALID_STATE) {
+            // items may have been copied to the new page only partially
+            mKeyIndex.disable();
+        }
+        return err;
+    }
+    if (reclaimedPage) {
+        // items of the reclaimed page were moved to the new current page
+        mKeyIndex.erasePage(reclaimedPage);
+        addPageToKeyIndex(getCurrentPage());
+        if (reclaimedPage == mGcPage) {
+            mGcPage = nullptr;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::gcStep(size_t maxItems, bool& done)
+{
+    done = false;
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    if (!mGcPage) {
+        if (mPageManager.getFreePageCount() >= mGcFreePages) {
+            done = true;
+            return ESP_OK;
+        }
+        mGcPage = mPageManager.findPageToReclaim();
+        if (!mGcPage) {
+            done = true;
+            return ESP_OK;
+        }
+    }
+
+    if (mGcPage->getUsedEntryCount() == 0) {
+        // erasing the page is a step of its own, it takes longer than moving a few items
+        Page* page = mGcPage;
+        mGcPage = nullptr;
+        auto err = mPageManager.releasePage(page);
+        if (err != ESP_OK) {
+            return err;
+        }
+        done = mPageManager.getFreePageCount() >= mGcFreePages;
+        return ESP_OK;
+    }
+
+    Page& page = getCurrentPage();
+    for (size_t i = 0; i < maxItems; ++i) {
+        size_t itemIndex = 0;
+        Item item;
+        auto err = mGcPage->findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            break;
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        err = mGcPage->moveItem(itemIndex, page);
+        if (err == ESP_ERR_NVS_PAGE_FULL) {
+            // the next page is activated by a write, which doesn't need to reclaim a page as long as
+            // there are free pages. Moving the rest of the items continues on that page.
+            done = true;
+            break;
+        }
+        if (err != ESP_OK) {
+            // the item may be on both pages now
+            mKeyIndex.disable();
+            return err;
+        }
+        mKeyIndex.erase(mGcPage, item.nsIndex, item.key, item.chunkIndex);
+        mKeyIndex.insert(&page, item.nsIndex, item.key, item.chunkIndex);
+    }
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
 esp_err_t Storage::findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item, uint8_t chunkIdx, VerOffset chunkStart)
 {
+    if (mKeyIndex.isEnabled() && nsIndex != Page::NS_ANY && datatype != ItemType::ANY && key != nullptr) {
+        /* Only search the pages the index has entries for. While an item is being replaced, two
+         * pages may hold it, so pick the first one in page order like the search below does. */
+        const uint32_t hash = KeyIndex::hash(nsIndex, key, chunkIdx);
+        Page* foundPage = nullptr;
+        uint32_t foundSeqNumber = 0;
+        size_t pos = 0;
+        Item pageItem;
+        for (Page* p = mKeyIndex.find(hash, pos); p != nullptr; p = mKeyIndex.find(hash, pos)) {
+            uint32_t seqNumber;
+            if (p == foundPage || p->getSeqNumber(seqNumber) != ESP_OK
+                    || (foundPage != nullptr && seqNumber >= foundSeqNumber)) {
+                continue;
+            }
+            size_t itemIndex = 0;
+            if (p->findItem(nsIndex, datatype, key, itemIndex, pageItem, chunkIdx, chunkStart) == ESP_OK) {
+                foundPage = p;
+                foundSeqNumber = seqNumber;
+                item = pageItem;
+            }
+        }
+        if (foundPage == nullptr) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        page = foundPage;
+        return ESP_OK;
+    }
+
     for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
         size_t itemIndex = 0;
         auto err = it->findItem(nsIndex, datatype, key, itemIndex, item, chunkIdx, chunkStart);
@@ -191,7 +482,7 @@ esp_err_t Storage::writeMultiPageBlob(uint8_t nsIndex, const char* key, const vo
                     return err;
                 }
             }
-            err = mPageManager.requestNewPage();
+            err = requestNewPage();
             if (err != ESP_OK) {
                 return err;
             } else if(getCurrentPage().getVarDataTailroom() == tailroom) {
@@ -212,6 +503,7 @@ esp_err_t Storage::writeMultiPageBlob(uint8_t nsIndex, const char* key, const vo
 
         err = page.writeItem(nsIndex, ItemType::BLOB_DATA, key,
                 static_cast<const uint8_t*> (data) + offset, chunkSize, static_cast<uint8_t> (chunkStart) + chunkCount);
+        mKeyIndex.insert(&page, nsIndex, key, static_cast<uint8_t> (chunkStart) + chunkCount);
         chunkCount++;
         assert(err != ESP_ERR_NVS_PAGE_FULL);
         if (err != ESP_OK) {
@@ -231,7 +523,7 @@ esp_err_t Storage::writeMultiPageBlob(uint8_t nsIndex, const char* key, const vo
                         break;
                     }
                 }
-                err = mPageManager.requestNewPage();
+                err = requestNewPage();
                 if (err != ESP_OK) {
                     break;
                 }
@@ -248,6 +540,7 @@ esp_err_t Storage::writeMultiPageBlob(uint8_t nsIndex, const char* key, const vo
 
             err = getCurrentPage().writeItem(nsIndex, ItemType::BLOB_IDX, key, item.data, sizeof(item.data));
             assert(err != ESP_ERR_NVS_PAGE_FULL);
+            mKeyIndex.insert(&getCurrentPage(), nsIndex, key, Page::CHUNK_ANY);
             break;
         }
     } while (1);
@@ -256,7 +549,10 @@ esp_err_t Storage::writeMultiPageBlob(uint8_t nsIndex, const char* key, const vo
         /* Anything failed, then we should erase all the written chunks*/
         int ii=0;
         for (auto it = std::begin(usedPages); it != std::end(usedPages); it++) {
-            it->mPage->eraseItem(nsIndex, ItemType::BLOB_DATA, key, ii++);
+            if (it->mPage->eraseItem(nsIndex, ItemType::BLOB_DATA, key, ii) == ESP_OK) {
+                mKeyIndex.erase(it->mPage, nsIndex, key, ii);
+            }
+            ii++;
         }
     }
     usedPages.clearAndFreeNodes();
@@ -346,6 +642,9 @@ esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key
 
         Page& page = getCurrentPage();
         err = page.writeItem(nsIndex, datatype, key, data, dataSize);
+        if (err != ESP_ERR_NVS_PAGE_FULL) {
+            mKeyIndex.insert(&page, nsIndex, key, Page::CHUNK_ANY);
+        }
         if (err == ESP_ERR_NVS_PAGE_FULL) {
             if (page.state() != Page::PageState::FULL) {
                 err = page.markFull();
@@ -353,7 +652,7 @@ esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key
                     return err;
                 }
             }
-            err = mPageManager.requestNewPage();
+            err = requestNewPage();
             if (err != ESP_OK) {
                 return err;
             }
@@ -362,6 +661,7 @@ esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key
             if (err == ESP_ERR_NVS_PAGE_FULL) {
                 return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
             }
+            mKeyIndex.insert(&getCurrentPage(), nsIndex, key, Page::CHUNK_ANY);
             if (err != ESP_OK) {
                 return err;
             }
@@ -382,6 +682,7 @@ esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key
         if (err != ESP_OK) {
             return err;
         }
+        mKeyIndex.erase(findPage, nsIndex, key, item.chunkIndex);
     }
 #ifndef ESP_PLATFORM
     debugCheck();
@@ -561,6 +862,7 @@ esp_err_t Storage::eraseMultiPageBlob(uint8_t nsIndex, const char* key, VerOffse
     if (err != ESP_OK) {
         return err;
     }
+    mKeyIndex.erase(findPage, nsIndex, key, Page::CHUNK_ANY);
 
     uint8_t chunkCount = item.blobIndex.chunkCount;
 
@@ -583,6 +885,7 @@ esp_err_t Storage::eraseMultiPageBlob(uint8_t nsIndex, const char* key, VerOffse
         if (err != ESP_OK) {
             return err;
         }
+        mKeyIndex.erase(findPage, nsIndex, key, static_cast<uint8_t> (chunkStart) + chunkNum);
 
     }
 
@@ -610,7 +913,12 @@ esp_err_t Storage::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key
         return eraseMultiPageBlob(nsIndex, key);
     }
 
-    return findPage->eraseItem(nsIndex, datatype, key);
+    err = findPage->eraseItem(nsIndex, datatype, key);
+    if (err != ESP_OK) {
+        return err;
+    }
+    mKeyIndex.erase(findPage, nsIndex, key, item.chunkIndex);
+    return ESP_OK;
 }
 
 esp_err_t Storage::eraseNamespace(uint8_t nsIndex)
@@ -630,10 +938,213 @@ esp_err_t Storage::eraseNamespace(uint8_t nsIndex)
             }
         }
     }
+    mKeyIndex.eraseNamespace(nsIndex);
     return ESP_OK;
 
 }
 
+esp_err_t Storage::eraseKey(uint8_t nsIndex, ItemType datatype, const char* key)
+{
+    esp_err_t err;
+    do {
+        err = eraseItem(nsIndex, datatype, key);
+    } while (err == ESP_OK);
+    return (err == ESP_ERR_NVS_NOT_FOUND) ? ESP_OK : err;
+}
+
+esp_err_t Storage::writeItemBatch(uint8_t nsIndex, const Page::ItemData* items, size_t count)
+{
+    bool newPage = false;
+    while (count > 0) {
+        Page& page = getCurrentPage();
+        size_t written;
+        auto err = page.writeItems(nsIndex, items, count, written);
+        if (err == ESP_ERR_NVS_PAGE_FULL) {
+            if (newPage) {
+                return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+            }
+            if (page.state() != Page::PageState::FULL) {
+                err = page.markFull();
+                if (err != ESP_OK) {
+                    return err;
+                }
+            }
+            err = requestNewPage();
+            if (err != ESP_OK) {
+                return err;
+            }
+            newPage = true;
+            continue;
+        }
+        if (err != ESP_OK) {
+            // some of the items may have been written
+            written = count;
+        }
+        for (size_t i = 0; i < written; ++i) {
+            mKeyIndex.insert(&page, nsIndex, items[i].key, Page::CHUNK_ANY);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        items += written;
+        count -= written;
+        newPage = false;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::applyTransaction(uint8_t nsIndex, Transaction& txn, bool recovering)
+{
+    /* Primitive and string values are collected and written together, with as few flash writes as
+     * possible. Old values are erased before the new ones are written, this is safe because the
+     * transaction log is only erased once all of them are written. */
+    Page::ItemData* batch = new (std::nothrow) Page::ItemData[txn.size()];
+    if (!batch) {
+        return ESP_ERR_NO_MEM;
+    }
+    size_t batchCount = 0;
+
+    esp_err_t err = ESP_OK;
+    for (auto it = txn.begin(); it != txn.end() && err == ESP_OK; ++it) {
+        if (it->isEraseAll()) {
+            err = eraseNamespace(nsIndex);
+        } else if (it->isErase()) {
+            err = eraseKey(nsIndex, ItemType::ANY, it->mKey);
+        } else if (it->mDatatype == ItemType::BLOB) {
+            err = writeItemBatch(nsIndex, batch, batchCount);
+            batchCount = 0;
+            if (err == ESP_OK && recovering) {
+                // the interrupted commit may have left both versions of the blob
+                err = eraseKey(nsIndex, ItemType::BLOB, it->mKey);
+            }
+            if (err == ESP_OK) {
+                err = writeItem(nsIndex, ItemType::BLOB, it->mKey, it->mData, it->mDataSize);
+            }
+        } else {
+            Item item;
+            Page* findPage = nullptr;
+            if (!recovering
+                    && findItem(nsIndex, it->mDatatype, it->mKey, findPage, item) == ESP_OK
+                    && findPage->cmpItem(nsIndex, it->mDatatype, it->mKey, it->mData, it->mDataSize) == ESP_OK) {
+                continue;
+            }
+            // when recovering, the new value may have been written already
+            err = eraseKey(nsIndex, it->mDatatype, it->mKey);
+            batch[batchCount++] = { it->mDatatype, it->mKey, it->mData, it->mDataSize };
+        }
+    }
+    if (err == ESP_OK) {
+        err = writeItemBatch(nsIndex, batch, batchCount);
+    }
+    delete[] batch;
+    if (err != ESP_OK) {
+        return err;
+    }
+
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
+esp_err_t Storage::commitTransaction(uint8_t nsIndex, Transaction& txn)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    // complete a transaction which failed after its log was written
+    auto err = recoverTransaction();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (txn.empty()) {
+        return ESP_OK;
+    }
+
+    auto first = txn.begin();
+    if (txn.size() == 1 && !first->isErase()) {
+        // writing a single item is atomic already
+        return writeItem(nsIndex, first->mDatatype, first->mKey, first->mData, first->mDataSize);
+    }
+
+    uint8_t logNsIndex;
+    err = createOrOpenNamespace(TXN_LOG_NAMESPACE, true, logNsIndex);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    size_t logSize = txn.getLogSize();
+    uint8_t* log = new (std::nothrow) uint8_t[logSize];
+    if (!log) {
+        return ESP_ERR_NO_MEM;
+    }
+    txn.writeLog(nsIndex, log);
+
+    /* Writing the blob index of the log is the commit point. Before that, the chunks of the log
+     * are erased at init as orphans, after it init applies the log if applying it was interrupted. */
+    err = writeMultiPageBlob(logNsIndex, TXN_LOG_KEY, log, logSize, VerOffset::VER_0_OFFSET);
+    delete[] log;
+    if (err == ESP_ERR_NVS_PAGE_FULL) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = applyTransaction(nsIndex, txn, false);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return eraseMultiPageBlob(logNsIndex, TXN_LOG_KEY);
+}
+
+esp_err_t Storage::recoverTransaction()
+{
+    uint8_t logNsIndex;
+    if (createOrOpenNamespace(TXN_LOG_NAMESPACE, false, logNsIndex) != ESP_OK) {
+        return ESP_OK;
+    }
+
+    Item item;
+    Page* findPage = nullptr;
+    auto err = findItem(logNsIndex, ItemType::BLOB_IDX, TXN_LOG_KEY, findPage, item);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    size_t logSize = item.blobIndex.dataSize;
+    uint8_t* log = new (std::nothrow) uint8_t[logSize];
+    if (!log) {
+        return ESP_ERR_NO_MEM;
+    }
+    err = readMultiPageBlob(logNsIndex, TXN_LOG_KEY, log, logSize);
+    if (err == ESP_OK) {
+        Transaction txn;
+        uint8_t nsIndex;
+        err = txn.readLog(log, logSize, nsIndex);
+        if (err == ESP_OK) {
+            err = applyTransaction(nsIndex, txn, true);
+        } else if (err == ESP_ERR_NVS_INVALID_LENGTH) {
+            // not a log which can be applied, drop it
+            err = ESP_OK;
+        }
+    } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+        // a chunk is missing, readMultiPageBlob() has erased the log
+        delete[] log;
+        return ESP_OK;
+    }
+    delete[] log;
+    if (err != ESP_OK) {
+        return err;
+    }
+    return eraseMultiPageBlob(logNsIndex, TXN_LOG_KEY);
+}
+
 esp_err_t Storage::getItemDataSize(uint8_t nsIndex, ItemType datatype, const char* key, size_t& dataSize)
 {
     if (mState != StorageState::ACTIVE) {
@@ -659,6 +1170,333 @@ esp_err_t Storage::getItemDataSize(uint8_t nsIndex, ItemType datatype, const cha
     return ESP_OK;
 }
 
+esp_err_t Storage::openBlobStream(BlobStream& stream)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    Item item;
+    Page* findPage = nullptr;
+    auto err = findItem(stream.mNsIndex, ItemType::BLOB_IDX, stream.mKey, findPage, item);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
+    }
+
+    if (stream.isWrite()) {
+        if (err == ESP_OK) {
+            /* The new version is written with the other chunk offset, like in writeItem() */
+            stream.mHasPrevious = true;
+            stream.mPrevStart = item.blobIndex.chunkStart;
+            stream.mChunkStart = (stream.mPrevStart == VerOffset::VER_1_OFFSET) ? VerOffset::VER_0_OFFSET : VerOffset::VER_1_OFFSET;
+        }
+        return ESP_OK;
+    }
+
+    if (err == ESP_OK) {
+        stream.mDatatype = ItemType::BLOB_DATA;
+        stream.mChunkStart = item.blobIndex.chunkStart;
+        stream.mChunkCount = item.blobIndex.chunkCount;
+        stream.mDataSize = item.blobIndex.dataSize;
+        return ESP_OK;
+    }
+
+    /* Blob written in the format without index, it is read as a single chunk */
+    err = findItem(stream.mNsIndex, ItemType::BLOB, stream.mKey, findPage, item);
+    if (err != ESP_OK) {
+        return err;
+    }
+    stream.mDatatype = ItemType::BLOB;
+    stream.mChunkCount = 1;
+    stream.mDataSize = item.varLength.dataSize;
+    return ESP_OK;
+}
+
+esp_err_t Storage::readBlobStream(BlobStream& stream, size_t offset, void* data, size_t dataSize)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (offset > stream.mDataSize || dataSize > stream.mDataSize - offset) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    Item item;
+    Page* findPage = nullptr;
+    esp_err_t err;
+    if (stream.mDatatype == ItemType::BLOB_DATA) {
+        /* Check that the blob wasn't replaced since the stream was opened */
+        err = findItem(stream.mNsIndex, ItemType::BLOB_IDX, stream.mKey, findPage, item, Page::CHUNK_ANY, stream.mChunkStart);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (item.blobIndex.dataSize != stream.mDataSize || item.blobIndex.chunkCount != stream.mChunkCount) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+    }
+
+    /* Sequential reads continue from the chunk read last, others start from the first chunk */
+    if (!stream.mChunkValid || offset < stream.mChunkOffset) {
+        stream.mChunkValid = false;
+        stream.mChunkNum = 0;
+        stream.mChunkOffset = 0;
+    }
+
+    uint8_t* dst = static_cast<uint8_t*>(data);
+    while (dataSize > 0) {
+        if (stream.mChunkNum >= stream.mChunkCount) {
+            // the chunks hold less data than the index says
+            stream.mChunkValid = false;
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        uint8_t chunkIdx = (stream.mDatatype == ItemType::BLOB) ? Page::CHUNK_ANY
+                           : static_cast<uint8_t> (stream.mChunkStart) + stream.mChunkNum;
+        err = findItem(stream.mNsIndex, stream.mDatatype, stream.mKey, findPage, item, chunkIdx);
+        if (err != ESP_OK) {
+            stream.mChunkValid = false;
+            return err;
+        }
+        if (!stream.mChunkValid) {
+            stream.mChunkSize = item.varLength.dataSize;
+            stream.mChunkVerified = false;
+            stream.mChunkValid = true;
+        }
+        size_t chunkPos = offset - stream.mChunkOffset;
+        if (chunkPos >= stream.mChunkSize) {
+            stream.mChunkOffset += stream.mChunkSize;
+            stream.mChunkNum++;
+            stream.mChunkValid = false;
+            continue;
+        }
+
+        size_t readSize = std::min(dataSize, stream.mChunkSize - chunkPos);
+        if (stream.mChunkVerified) {
+            err = findPage->readItemData(stream.mNsIndex, stream.mDatatype, stream.mKey, chunkPos, dst, readSize, chunkIdx);
+        } else if (readSize == stream.mChunkSize) {
+            // readItem() checks the CRC of the data it reads
+            err = findPage->readItem(stream.mNsIndex, stream.mDatatype, stream.mKey, dst, readSize, chunkIdx);
+        } else {
+            err = findPage->checkItemData(stream.mNsIndex, stream.mDatatype, stream.mKey, chunkIdx);
+            if (err == ESP_OK) {
+                err = findPage->readItemData(stream.mNsIndex, stream.mDatatype, stream.mKey, chunkPos, dst, readSize, chunkIdx);
+            }
+        }
+        if (err != ESP_OK) {
+            stream.mChunkValid = false;
+            return err;
+        }
+        stream.mChunkVerified = true;
+        offset += readSize;
+        dst += readSize;
+        dataSize -= readSize;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeBlobStreamChunk(BlobStream& stream, const uint8_t* data, size_t dataSize, size_t& written)
+{
+    written = 0;
+
+    /* Same limit as in writeMultiPageBlob() */
+    size_t maxChunks = mPageManager.getPageCount() - 1;
+    if (maxChunks > (Page::CHUNK_ANY - 1) / 2) {
+        maxChunks = (Page::CHUNK_ANY - 1) / 2;
+    }
+    if (stream.mChunkCount >= maxChunks) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+
+    Page* page = &getCurrentPage();
+    size_t tailroom = page->getVarDataTailroom();
+    if (tailroom == 0 || (tailroom < dataSize && tailroom < Page::CHUNK_MAX_SIZE / 10)) {
+        /* Too little room for a useful chunk, continue on a new page */
+        esp_err_t err;
+        if (page->state() != Page::PageState::FULL) {
+            err = page->markFull();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        err = requestNewPage();
+        if (err != ESP_OK) {
+            return err;
+        }
+        page = &getCurrentPage();
+        tailroom = page->getVarDataTailroom();
+        if (tailroom == 0) {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+    }
+
+    size_t chunkSize = std::min(dataSize, tailroom);
+    uint8_t chunkIdx = static_cast<uint8_t> (stream.mChunkStart) + stream.mChunkCount;
+    auto err = page->writeItem(stream.mNsIndex, ItemType::BLOB_DATA, stream.mKey, data, chunkSize, chunkIdx);
+    assert(err != ESP_ERR_NVS_PAGE_FULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+    mKeyIndex.insert(page, stream.mNsIndex, stream.mKey, chunkIdx);
+    stream.mChunkCount++;
+    written = chunkSize;
+    return ESP_OK;
+}
+
+esp_err_t Storage::flushBlobStream(BlobStream& stream)
+{
+    size_t written;
+    auto err = writeBlobStreamChunk(stream, stream.mBuffer, stream.mBufferSize, written);
+    if (err != ESP_OK) {
+        return err;
+    }
+    memmove(stream.mBuffer, stream.mBuffer + written, stream.mBufferSize - written);
+    stream.mBufferSize -= written;
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeBlobStream(BlobStream& stream, const void* data, size_t dataSize)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    while (dataSize > 0) {
+        esp_err_t err;
+        if (stream.mBufferSize == 0 && dataSize >= Page::CHUNK_MAX_SIZE) {
+            /* Enough data for a chunk of any size, write it from the caller's buffer */
+            size_t written;
+            err = writeBlobStreamChunk(stream, src, dataSize, written);
+            if (err != ESP_OK) {
+                return err;
+            }
+            src += written;
+            dataSize -= written;
+            stream.mDataSize += written;
+            continue;
+        }
+
+        if (!stream.mBuffer) {
+            stream.mBuffer = new (std::nothrow) uint8_t[Page::CHUNK_MAX_SIZE];
+            if (!stream.mBuffer) {
+                return ESP_ERR_NO_MEM;
+            }
+        }
+        size_t copySize = std::min(dataSize, Page::CHUNK_MAX_SIZE - stream.mBufferSize);
+        memcpy(stream.mBuffer + stream.mBufferSize, src, copySize);
+        stream.mBufferSize += copySize;
+        src += copySize;
+        dataSize -= copySize;
+        stream.mDataSize += copySize;
+        if (stream.mBufferSize == Page::CHUNK_MAX_SIZE) {
+            err = flushBlobStream(stream);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::closeBlobStream(BlobStream& stream)
+{
+    if (!stream.isWrite()) {
+        return ESP_OK;
+    }
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    esp_err_t err = ESP_OK;
+    while (stream.mBufferSize > 0 && err == ESP_OK) {
+        err = flushBlobStream(stream);
+    }
+    if (err == ESP_OK && stream.mChunkCount == 0) {
+        // like writeMultiPageBlob(), store an empty blob as one empty chunk
+        size_t written;
+        err = writeBlobStreamChunk(stream, nullptr, 0, written);
+    }
+
+    if (err == ESP_OK) {
+        Item item;
+        std::fill_n(item.data, sizeof(item.data), 0xff);
+        item.blobIndex.dataSize = stream.mDataSize;
+        item.blobIndex.chunkCount = stream.mChunkCount;
+        item.blobIndex.chunkStart = stream.mChunkStart;
+
+        err = getCurrentPage().writeItem(stream.mNsIndex, ItemType::BLOB_IDX, stream.mKey, item.data, sizeof(item.data));
+        if (err == ESP_ERR_NVS_PAGE_FULL) {
+            if (getCurrentPage().state() != Page::PageState::FULL) {
+                err = getCurrentPage().markFull();
+            } else {
+                err = ESP_OK;
+            }
+            if (err == ESP_OK) {
+                err = requestNewPage();
+            }
+            if (err == ESP_OK) {
+                err = getCurrentPage().writeItem(stream.mNsIndex, ItemType::BLOB_IDX, stream.mKey, item.data, sizeof(item.data));
+                if (err == ESP_ERR_NVS_PAGE_FULL) {
+                    err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+                }
+            }
+        }
+        if (err == ESP_OK) {
+            mKeyIndex.insert(&getCurrentPage(), stream.mNsIndex, stream.mKey, Page::CHUNK_ANY);
+        }
+    }
+
+    if (err != ESP_OK) {
+        abortBlobStream(stream);
+        return err;
+    }
+
+    /* The new version is complete, erase the one it replaces */
+    if (stream.mHasPrevious) {
+        err = eraseMultiPageBlob(stream.mNsIndex, stream.mKey, stream.mPrevStart);
+    } else {
+        /* Support for earlier versions where BLOBS were stored without index */
+        Item item;
+        Page* findPage = nullptr;
+        err = findItem(stream.mNsIndex, ItemType::BLOB, stream.mKey, findPage, item);
+        if (err == ESP_OK) {
+            err = findPage->eraseItem(stream.mNsIndex, ItemType::BLOB, stream.mKey);
+            if (err == ESP_OK) {
+                mKeyIndex.erase(findPage, stream.mNsIndex, stream.mKey, item.chunkIndex);
+            }
+        } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = ESP_OK;
+        }
+    }
+    if (err == ESP_ERR_FLASH_OP_FAIL) {
+        return ESP_ERR_NVS_REMOVE_FAILED;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
+void Storage::abortBlobStream(BlobStream& stream)
+{
+    if (!stream.isWrite() || mState != StorageState::ACTIVE) {
+        return;
+    }
+    for (uint8_t chunkNum = 0; chunkNum < stream.mChunkCount; chunkNum++) {
+        uint8_t chunkIdx = static_cast<uint8_t> (stream.mChunkStart) + chunkNum;
+        Item item;
+        Page* findPage = nullptr;
+        if (findItem(stream.mNsIndex, ItemType::BLOB_DATA, stream.mKey, findPage, item, chunkIdx) == ESP_OK
+                && findPage->eraseItem(stream.mNsIndex, ItemType::BLOB_DATA, stream.mKey, chunkIdx) == ESP_OK) {
+            mKeyIndex.erase(findPage, stream.mNsIndex, stream.mKey, chunkIdx);
+        }
+    }
+    stream.mChunkCount = 0;
+    stream.mBufferSize = 0;
+}
+
 void Storage::debugDump()
 {
     for (auto p = mPageManager.begin(); p != mPageManager.end(); ++p) {
@@ -685,6 +1523,18 @@ void Storage::debugCheck()
                 assert(0);
             }
             keys.insert(std::make_pair(keystr, static_cast<Page*>(p)));
+            if (mKeyIndex.isEnabled()) {
+                // every item must be in the key index
+                const uint32_t hash = KeyIndex::hash(item.nsIndex, item.key, item.chunkIndex);
+                size_t pos = 0;
+                Page* indexPage;
+                while ((indexPage = mKeyIndex.find(hash, pos)) != nullptr && indexPage != static_cast<Page*>(p)) {
+                }
+                if (indexPage == nullptr) {
+                    printf("Key not in index: %s\n", keystr.c_str());
+                    assert(0);
+                }
+            }
             itemIndex += item.span;
             usedCount += item.span;
         }
@@ -773,11 +1623,17 @@ bool Storage::nextEntry(nvs_opaque_iterator_t* it)
     Item item;
     esp_err_t err;
 
+    /* The transaction log is internal, so it isn't listed with the entries of all namespaces */
+    uint8_t logNsIndex = Page::NS_ANY;
+    if (it->nsIndex == Page::NS_ANY) {
+        createOrOpenNamespace(TXN_LOG_NAMESPACE, false, logNsIndex);
+    }
+
     for (auto page = it->page; page != mPageManager.end(); ++page) {
         do {
             err = page->findItem(it->nsIndex, (ItemType)it->type, nullptr, it->entryIndex, item);
             it->entryIndex += item.span;
-            if(err == ESP_OK && isIterableItem(item) && !isMultipageBlob(item)) {
+            if(err == ESP_OK && isIterableItem(item) && !isMultipageBlob(item) && item.nsIndex != logNsIndex) {
                 fillEntryInfo(item, it->entry_info);
                 it->page = page;
                 return true;
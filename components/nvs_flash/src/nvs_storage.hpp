@@ -20,6 +20,16 @@
 #include "nvs_types.hpp"
 #include "nvs_page.hpp"
 #include "nvs_pagemanager.hpp"
+#include "nvs_key_index.hpp"
+#include "nvs_transaction.hpp"
+#include "nvs_checkpoint.hpp"
+#include "nvs_blob_stream.hpp"
+
+#ifdef CONFIG_NVS_GC_FREE_PAGES
+#define NVS_GC_FREE_PAGES CONFIG_NVS_GC_FREE_PAGES
+#else
+#define NVS_GC_FREE_PAGES 3
+#endif
 
 //extern void dumpBytes(const uint8_t* data, size_t count);
 
@@ -53,6 +63,7 @@ class Storage : public intrusive_list_node<Storage>
             uint8_t nsIndex;
             uint8_t chunkCount;
             VerOffset chunkStart;
+            BlobIndexNode* nextInBucket;
     };
 
     typedef intrusive_list<BlobIndexNode> TBlobIndexList;
@@ -98,6 +109,11 @@ public:
 
     esp_err_t eraseNamespace(uint8_t nsIndex);
 
+    esp_err_t commitTransaction(uint8_t nsIndex, Transaction& txn);
+
+    /* Write a mount checkpoint if the pages in use changed since init. Called before the partition is deinitialized. */
+    esp_err_t writeCheckpoint();
+
     const char *getPartName() const
     {
         return mPartitionName;
@@ -115,6 +131,28 @@ public:
 
     esp_err_t eraseMultiPageBlob(uint8_t nsIndex, const char* key, VerOffset chunkStart = VerOffset::VER_ANY);
 
+    /* Find the blob of a reading stream, or the version which a writing stream replaces */
+    esp_err_t openBlobStream(BlobStream& stream);
+
+    esp_err_t readBlobStream(BlobStream& stream, size_t offset, void* data, size_t dataSize);
+
+    /* Append data to a writing stream. If this fails, abortBlobStream() must be called. */
+    esp_err_t writeBlobStream(BlobStream& stream, const void* data, size_t dataSize);
+
+    /* Write the rest of the data and the index of a writing stream, and erase the previous version of the blob */
+    esp_err_t closeBlobStream(BlobStream& stream);
+
+    /* Erase the chunks written by a writing stream, the previous version of the blob is kept */
+    void abortBlobStream(BlobStream& stream);
+
+    /**
+     * Reclaim the space of erased items before new pages are needed, so that writes don't have to.
+     * Does nothing while at least NVS_GC_FREE_PAGES pages are free. Otherwise each call either moves
+     * up to maxItems items from the full page with the most erased entries to the current page, or
+     * erases that page once it is empty. done is set when there is nothing more to do for now.
+     */
+    esp_err_t gcStep(size_t maxItems, bool& done);
+
     void debugDump();
 
     void debugCheck();
@@ -138,19 +176,46 @@ protected:
 
     esp_err_t populateBlobIndices(TBlobIndexList&);
 
-    void eraseOrphanDataBlobs(TBlobIndexList&);
+    esp_err_t eraseOrphanDataBlobs(TBlobIndexList&);
 
     void fillEntryInfo(Item &item, nvs_entry_info_t &info);
 
     esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item, uint8_t chunkIdx = Page::CHUNK_ANY, VerOffset chunkStart = VerOffset::VER_ANY);
 
+    esp_err_t requestNewPage();
+
+    void buildKeyIndex();
+
+    void addPageToKeyIndex(Page& page);
+
+    esp_err_t restoreCheckpoint(const Checkpoint& checkpoint);
+
+    esp_err_t writeBlobStreamChunk(BlobStream& stream, const uint8_t* data, size_t dataSize, size_t& written);
+
+    esp_err_t flushBlobStream(BlobStream& stream);
+
+    esp_err_t eraseKey(uint8_t nsIndex, ItemType datatype, const char* key);
+
+    esp_err_t writeItemBatch(uint8_t nsIndex, const Page::ItemData* items, size_t count);
+
+    esp_err_t applyTransaction(uint8_t nsIndex, Transaction& txn, bool recovering);
+
+    esp_err_t recoverTransaction();
+
 protected:
     char mPartitionName [NVS_PART_NAME_MAX_SIZE + 1];
     size_t mPageCount;
     PageManager mPageManager;
+    KeyIndex mKeyIndex;
     TNamespaces mNamespaces;
     CompressedEnumTable<bool, 1, 256> mNamespaceUsage;
     StorageState mState = StorageState::INVALID;
+    bool mCheckpointEnabled = NVS_MOUNT_CHECKPOINT;
+    bool mCheckpointMatched = false;
+    uint32_t mCheckpointId = 0;
+    uint32_t mCheckpointFingerprint = 0;
+    Page* mGcPage = nullptr;
+    size_t mGcFreePages = NVS_GC_FREE_PAGES;
 };
 
 } // namespace nvs
@@ -0,0 +1,240 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "nvs_transaction.hpp"
+#include "nvs_page.hpp"
+
+namespace nvs
+{
+
+/* Log layout: LogHeader, followed by a LogRecord and the data, padded to 4 bytes, for each operation */
+
+static const uint8_t LOG_VERSION = 1;
+
+struct LogHeader {
+    uint8_t version;
+    uint8_t nsIndex;
+    uint16_t reserved;
+    uint32_t opCount;
+};
+
+struct LogRecord {
+    ItemType datatype;
+    uint8_t reserved[3];
+    uint32_t dataSize;
+    char key[Item::MAX_KEY_LENGTH + 1];
+};
+
+static_assert(sizeof(LogHeader) == 8, "log header size must be 8 bytes");
+static_assert(sizeof(LogRecord) == 24, "log record size must be 24 bytes");
+
+static size_t alignLogData(size_t size)
+{
+    return (size + 3) & ~3;
+}
+
+TransactionOp* Transaction::findOp(ItemType datatype, const char* key)
+{
+    for (auto it = mOps.begin(); it != mOps.end(); ++it) {
+        if (it->mDatatype == datatype && strncmp(it->mKey, key, Item::MAX_KEY_LENGTH) == 0) {
+            return it;
+        }
+    }
+    return nullptr;
+}
+
+void Transaction::eraseOps(const char* key)
+{
+    for (auto it = mOps.begin(); it != mOps.end();) {
+        auto next = it;
+        ++next;
+        if (strncmp(it->mKey, key, Item::MAX_KEY_LENGTH) == 0) {
+            TransactionOp* op = it;
+            mOps.erase(it);
+            delete op;
+        }
+        it = next;
+    }
+}
+
+esp_err_t Transaction::addOp(ItemType datatype, const char* key, const void* data, size_t dataSize)
+{
+    TransactionOp* op = new (std::nothrow) TransactionOp;
+    if (!op) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (dataSize > 0) {
+        op->mData = new (std::nothrow) uint8_t[dataSize];
+        if (!op->mData) {
+            delete op;
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(op->mData, data, dataSize);
+    }
+    op->mDatatype = datatype;
+    strncpy(op->mKey, key, sizeof(op->mKey) - 1);
+    op->mKey[sizeof(op->mKey) - 1] = 0;
+    op->mDataSize = dataSize;
+    mOps.push_back(op);
+    return ESP_OK;
+}
+
+esp_err_t Transaction::set(ItemType datatype, const char* key, const void* data, size_t dataSize)
+{
+    if (strlen(key) > Item::MAX_KEY_LENGTH) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    if (datatype == ItemType::SZ && dataSize > Page::CHUNK_MAX_SIZE) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+
+    TransactionOp* op = findOp(datatype, key);
+    if (op) {
+        mOps.erase(op);
+        delete op;
+    }
+    return addOp(datatype, key, data, dataSize);
+}
+
+esp_err_t Transaction::erase(const char* key)
+{
+    if (strlen(key) > Item::MAX_KEY_LENGTH) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    eraseOps(key);
+    return addOp(ItemType::ANY, key, nullptr, 0);
+}
+
+esp_err_t Transaction::eraseAll()
+{
+    clear();
+    return addOp(ItemType::ANY, "", nullptr, 0);
+}
+
+bool Transaction::contains(ItemType datatype, const char* key)
+{
+    for (auto it = mOps.begin(); it != mOps.end(); ++it) {
+        if (it->isEraseAll()) {
+            return true;
+        }
+        if ((it->isErase() || it->mDatatype == datatype) && strncmp(it->mKey, key, Item::MAX_KEY_LENGTH) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t Transaction::readItem(ItemType datatype, const char* key, void* data, size_t dataSize)
+{
+    TransactionOp* op = findOp(datatype, key);
+    if (!op) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (!isVariableLengthType(datatype)) {
+        if (dataSize != op->mDataSize) {
+            return ESP_ERR_NVS_TYPE_MISMATCH;
+        }
+    } else if (dataSize < op->mDataSize) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(data, op->mData, op->mDataSize);
+    return ESP_OK;
+}
+
+esp_err_t Transaction::getItemDataSize(ItemType datatype, const char* key, size_t& dataSize)
+{
+    TransactionOp* op = findOp(datatype, key);
+    if (!op) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    dataSize = op->mDataSize;
+    return ESP_OK;
+}
+
+size_t Transaction::getLogSize()
+{
+    size_t size = sizeof(LogHeader);
+    for (auto it = mOps.begin(); it != mOps.end(); ++it) {
+        size += sizeof(LogRecord) + alignLogData(it->mDataSize);
+    }
+    return size;
+}
+
+void Transaction::writeLog(uint8_t nsIndex, uint8_t* log)
+{
+    LogHeader header;
+    header.version = LOG_VERSION;
+    header.nsIndex = nsIndex;
+    header.reserved = 0xffff;
+    header.opCount = mOps.size();
+    memcpy(log, &header, sizeof(header));
+    log += sizeof(header);
+
+    for (auto it = mOps.begin(); it != mOps.end(); ++it) {
+        LogRecord record;
+        record.datatype = it->mDatatype;
+        std::fill_n(record.reserved, sizeof(record.reserved), 0xff);
+        record.dataSize = it->mDataSize;
+        memcpy(record.key, it->mKey, sizeof(record.key));
+        memcpy(log, &record, sizeof(record));
+        log += sizeof(record);
+
+        size_t alignedSize = alignLogData(it->mDataSize);
+        if (it->mDataSize > 0) {
+            memcpy(log, it->mData, it->mDataSize);
+        }
+        std::fill(log + it->mDataSize, log + alignedSize, 0xff);
+        log += alignedSize;
+    }
+}
+
+esp_err_t Transaction::readLog(const uint8_t* log, size_t logSize, uint8_t& nsIndex)
+{
+    clear();
+
+    LogHeader header;
+    if (logSize < sizeof(header)) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(&header, log, sizeof(header));
+    if (header.version != LOG_VERSION) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    nsIndex = header.nsIndex;
+
+    size_t offset = sizeof(header);
+    for (uint32_t i = 0; i < header.opCount; ++i) {
+        LogRecord record;
+        if (logSize - offset < sizeof(record)) {
+            clear();
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        memcpy(&record, log + offset, sizeof(record));
+        offset += sizeof(record);
+        // checked before aligning, as aligning a corrupt size may wrap around
+        if (record.dataSize > logSize - offset || logSize - offset < alignLogData(record.dataSize)) {
+            clear();
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        record.key[sizeof(record.key) - 1] = 0;
+        auto err = addOp(record.datatype, record.key, log + offset, record.dataSize);
+        if (err != ESP_OK) {
+            clear();
+            return err;
+        }
+        offset += alignLogData(record.dataSize);
+    }
+    return ESP_OK;
+}
+
+} // namespace nvs
@@ -0,0 +1,127 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_transaction_hpp
+#define nvs_transaction_hpp
+
+#include "intrusive_list.h"
+#include "nvs_types.hpp"
+
+namespace nvs
+{
+
+/**
+ * One change staged in a Transaction: a new value for a key, the removal of a key, or
+ * the removal of all keys of the namespace.
+ */
+class TransactionOp : public intrusive_list_node<TransactionOp>
+{
+public:
+    ~TransactionOp()
+    {
+        delete[] mData;
+    }
+
+    bool isErase() const
+    {
+        return mDatatype == ItemType::ANY;
+    }
+
+    bool isEraseAll() const
+    {
+        return isErase() && mKey[0] == 0;
+    }
+
+    ItemType mDatatype;                   // ItemType::ANY for erase operations
+    char mKey[Item::MAX_KEY_LENGTH + 1];  // empty for erase all
+    uint8_t* mData = nullptr;
+    size_t mDataSize = 0;
+};
+
+/**
+ * Changes to one namespace, kept in RAM until they are written to flash by Storage::commitTransaction.
+ *
+ * Only the latest change of each key is kept. Changes can also be serialized into a log, which Storage
+ * writes to flash before applying them, so that an interrupted commit can be completed at the next init.
+ */
+class Transaction
+{
+    typedef intrusive_list<TransactionOp> TOpList;
+
+public:
+    typedef TOpList::iterator iterator;
+
+    ~Transaction()
+    {
+        clear();
+    }
+
+    esp_err_t set(ItemType datatype, const char* key, const void* data, size_t dataSize);
+
+    esp_err_t erase(const char* key);
+
+    esp_err_t eraseAll();
+
+    /* Returns true if the value of the key is decided by this transaction, i.e. it was set or erased */
+    bool contains(ItemType datatype, const char* key);
+
+    /* Same semantics as Storage::readItem, for keys for which contains() returns true */
+    esp_err_t readItem(ItemType datatype, const char* key, void* data, size_t dataSize);
+
+    esp_err_t getItemDataSize(ItemType datatype, const char* key, size_t& dataSize);
+
+    void clear()
+    {
+        mOps.clearAndFreeNodes();
+    }
+
+    bool empty() const
+    {
+        return mOps.empty();
+    }
+
+    size_t size() const
+    {
+        return mOps.size();
+    }
+
+    iterator begin()
+    {
+        return mOps.begin();
+    }
+
+    iterator end()
+    {
+        return mOps.end();
+    }
+
+    size_t getLogSize();
+
+    void writeLog(uint8_t nsIndex, uint8_t* log);
+
+    /* Replace the contents of this transaction with the ones of a log written by writeLog() */
+    esp_err_t readLog(const uint8_t* log, size_t logSize, uint8_t& nsIndex);
+
+protected:
+    esp_err_t addOp(ItemType datatype, const char* key, const void* data, size_t dataSize);
+
+    TransactionOp* findOp(ItemType datatype, const char* key);
+
+    void eraseOps(const char* key);
+
+    TOpList mOps;
+};
+
+} // namespace nvs
+
+#endif /* nvs_transaction_hpp */
@@ -85,7 +85,7 @@ public:
         }
         
         for (size_t i = 0; i < size / 4; ++i) {
-            if (mFailCountdown != SIZE_MAX && mFailCountdown-- == 0) {
+            if (failNow()) {
                 return false;
             }
 
@@ -118,7 +118,7 @@ public:
             return false;
         }
         
-        if (mFailCountdown != SIZE_MAX && mFailCountdown-- == 0) {
+        if (failNow()) {
             return false;
         }
 
@@ -215,8 +215,11 @@ public:
         mUpperSectorBound = upperSector;
     }
     
-    void failAfter(uint32_t count) {
+    /* Make the operation after the next "count" word writes or erases fail. If failPermanently is set, all
+     * operations after it fail as well, like they would after a power loss. */
+    void failAfter(uint32_t count, bool failPermanently = false) {
         mFailCountdown = count;
+        mFailPermanently = failPermanently;
     }
 
     size_t getSectorEraseCount(uint32_t sector) const {
@@ -224,6 +227,16 @@ public:
     }
 
 protected:
+    bool failNow() {
+        if (mFailCountdown == SIZE_MAX || mFailCountdown-- != 0) {
+            return false;
+        }
+        if (mFailPermanently) {
+            mFailCountdown = 0;
+        }
+        return true;
+    }
+
     static size_t getReadOpTime(uint32_t bytes);
     static size_t getWriteOpTime(uint32_t bytes);
     static size_t getEraseOpTime();
@@ -242,6 +255,7 @@ protected:
     size_t mUpperSectorBound = 0;
     
     size_t mFailCountdown = SIZE_MAX;
+    bool mFailPermanently = false;
 
 };
 
@@ -0,0 +1,404 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+#include "nvs.hpp"
+#include "nvs_handle.hpp"
+#include "nvs_test_api.h"
+#include "spi_flash_emulation.h"
+
+#define TEST_ESP_ERR(rc, res) CHECK((rc) == (res))
+#define TEST_ESP_OK(rc) CHECK((rc) == ESP_OK)
+
+using namespace std;
+using namespace nvs;
+
+/* Heap usage of all code in the test program which allocates with operator new, as NVS does. Sizes
+ * are taken from the allocator, so blocks which are allocated with malloc() and freed with delete
+ * don't break the accounting. */
+static size_t s_heapUsed = 0;
+static size_t s_heapPeak = 0;
+
+static void* countedAlloc(size_t size)
+{
+    void* p = malloc(size);
+    if (!p) {
+        return nullptr;
+    }
+    s_heapUsed += malloc_usable_size(p);
+    if (s_heapUsed > s_heapPeak) {
+        s_heapPeak = s_heapUsed;
+    }
+    return p;
+}
+
+static void countedFree(void* ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    s_heapUsed -= std::min(s_heapUsed, malloc_usable_size(ptr));
+    free(ptr);
+}
+
+void* operator new(size_t size)
+{
+    void* p = countedAlloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return countedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    countedFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    countedFree(ptr);
+}
+
+/* Start measuring peak heap usage, returns the current usage */
+static size_t resetHeapPeak()
+{
+    s_heapPeak = s_heapUsed;
+    return s_heapUsed;
+}
+
+static size_t getHeapPeak(size_t base)
+{
+    return s_heapPeak - base;
+}
+
+static void fillTestData(uint8_t* data, size_t size, uint32_t seed)
+{
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<uint8_t>((i * 2654435761u + seed) >> 13);
+    }
+}
+
+/* Write a blob through the stream API, in pieces of the given size */
+static esp_err_t writeStreamed(NVSHandle& handle, const char* key, const uint8_t* data, size_t size, size_t pieceSize)
+{
+    esp_err_t err = handle.open_blob(key, NVS_READWRITE);
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (size_t offset = 0; offset < size; offset += pieceSize) {
+        err = handle.write_blob(offset, data + offset, std::min(pieceSize, size - offset));
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return handle.close_blob();
+}
+
+/* Read a blob through the stream API, in pieces of the given size */
+static esp_err_t readStreamed(NVSHandle& handle, const char* key, uint8_t* data, size_t size, size_t pieceSize)
+{
+    esp_err_t err = handle.open_blob(key, NVS_READONLY);
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (size_t offset = 0; offset < size && err == ESP_OK; offset += pieceSize) {
+        err = handle.read_blob(offset, data + offset, std::min(pieceSize, size - offset));
+    }
+    esp_err_t closeErr = handle.close_blob();
+    return (err != ESP_OK) ? err : closeErr;
+}
+
+TEST_CASE("streamed blobs match blobs of the classic API", "[nvs][blob_stream]")
+{
+    const size_t SIZES[] = { 0, 1, 100, Page::CHUNK_MAX_SIZE, Page::CHUNK_MAX_SIZE + 1, 20000 };
+    const size_t PIECE_SIZES[] = { 1, 31, 500, Page::CHUNK_MAX_SIZE, 100000 };
+    const size_t MAX_SIZE = 20000;
+    SpiFlashEmulator emu(16);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 16));
+    esp_err_t err;
+    unique_ptr<NVSHandle> handle = open_nvs_handle("stream", NVS_READWRITE, &err);
+    REQUIRE(err == ESP_OK);
+
+    uint8_t* data = new uint8_t[MAX_SIZE];
+    uint8_t* readData = new uint8_t[MAX_SIZE];
+    uint32_t seed = 0;
+    for (size_t size : SIZES) {
+        for (size_t pieceSize : PIECE_SIZES) {
+            if (pieceSize > 1 || size <= Page::CHUNK_MAX_SIZE + 1) {
+                INFO("size " << size << ", pieces of " << pieceSize);
+                fillTestData(data, size, ++seed);
+
+                // streamed write, classic read
+                REQUIRE(writeStreamed(*handle, "blob", data, size, pieceSize) == ESP_OK);
+                size_t readSize;
+                TEST_ESP_OK(handle->get_item_size(ItemType::BLOB, "blob", readSize));
+                CHECK(readSize == size);
+                memset(readData, 0, MAX_SIZE);
+                TEST_ESP_OK(handle->get_blob("blob", readData, size));
+                CHECK(memcmp(data, readData, size) == 0);
+
+                // classic write, streamed read
+                fillTestData(data, size, ++seed);
+                TEST_ESP_OK(handle->set_blob("blob", data, size));
+                memset(readData, 0, MAX_SIZE);
+                TEST_ESP_OK(readStreamed(*handle, "blob", readData, size, pieceSize));
+                CHECK(memcmp(data, readData, size) == 0);
+            }
+        }
+    }
+
+    // reads at any offset, backwards
+    fillTestData(data, MAX_SIZE, ++seed);
+    REQUIRE(writeStreamed(*handle, "blob", data, MAX_SIZE, 777) == ESP_OK);
+    TEST_ESP_OK(handle->open_blob("blob", NVS_READONLY));
+    for (size_t offset = MAX_SIZE - 333; offset > 0; offset -= std::min(offset, static_cast<size_t>(4567))) {
+        TEST_ESP_OK(handle->read_blob(offset, readData, 333));
+        CHECK(memcmp(data + offset, readData, 333) == 0);
+    }
+    TEST_ESP_OK(handle->close_blob());
+
+    delete[] data;
+    delete[] readData;
+    handle.reset();
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+TEST_CASE("blob stream errors", "[nvs][blob_stream]")
+{
+    SpiFlashEmulator emu(5);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+    nvs_handle_t handle, readOnly;
+    TEST_ESP_OK(nvs_open("stream", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_open("stream", NVS_READONLY, &readOnly));
+    uint8_t data[100];
+    fillTestData(data, sizeof(data), 1);
+
+    TEST_ESP_ERR(nvs_blob_read(handle, 0, data, 1), ESP_ERR_INVALID_STATE);
+    TEST_ESP_ERR(nvs_blob_close(handle), ESP_ERR_INVALID_STATE);
+    TEST_ESP_ERR(nvs_blob_open(handle, "missing", NVS_READONLY), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_ERR(nvs_blob_open(handle, "key_which_is_too_long", NVS_READWRITE), ESP_ERR_NVS_KEY_TOO_LONG);
+    TEST_ESP_ERR(nvs_blob_open(readOnly, "blob", NVS_READWRITE), ESP_ERR_NVS_READ_ONLY);
+
+    TEST_ESP_OK(nvs_blob_open(handle, "blob", NVS_READWRITE));
+    TEST_ESP_ERR(nvs_blob_open(handle, "blob", NVS_READWRITE), ESP_ERR_INVALID_STATE);
+    TEST_ESP_ERR(nvs_blob_read(handle, 0, data, 1), ESP_ERR_INVALID_STATE);
+    TEST_ESP_OK(nvs_blob_write(handle, 0, data, 50));
+    TEST_ESP_ERR(nvs_blob_write(handle, 10, data, 50), ESP_ERR_INVALID_ARG);
+    TEST_ESP_OK(nvs_blob_write(handle, 50, data + 50, 50));
+    // not visible until closed
+    size_t size = sizeof(data);
+    TEST_ESP_ERR(nvs_get_blob(readOnly, "blob", data, &size), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(nvs_blob_close(handle));
+
+    TEST_ESP_OK(nvs_blob_open(readOnly, "blob", NVS_READONLY));
+    uint8_t readData[sizeof(data)];
+    TEST_ESP_ERR(nvs_blob_write(readOnly, 0, data, 1), ESP_ERR_INVALID_STATE);
+    TEST_ESP_ERR(nvs_blob_read(readOnly, 50, readData, 51), ESP_ERR_NVS_INVALID_LENGTH);
+    TEST_ESP_OK(nvs_blob_read(readOnly, 0, readData, sizeof(readData)));
+    CHECK(memcmp(data, readData, sizeof(data)) == 0);
+    TEST_ESP_OK(nvs_blob_read(readOnly, 100, readData, 0));
+
+    // the blob is replaced while it is open for reading
+    uint8_t other[10] = {};
+    TEST_ESP_OK(nvs_set_blob(handle, "blob", other, sizeof(other)));
+    TEST_ESP_ERR(nvs_blob_read(readOnly, 0, readData, 1), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(nvs_blob_close(readOnly));
+
+    // blobs can't be streamed while a transaction is active
+    TEST_ESP_OK(nvs_transaction_begin(handle));
+    TEST_ESP_ERR(nvs_blob_open(handle, "blob", NVS_READWRITE), ESP_ERR_INVALID_STATE);
+    TEST_ESP_OK(nvs_transaction_abort(handle));
+
+    nvs_close(readOnly);
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+TEST_CASE("blob stream which isn't closed keeps the previous value", "[nvs][blob_stream]")
+{
+    const size_t SIZE = 3 * Page::CHUNK_MAX_SIZE;
+    SpiFlashEmulator emu(8);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 8));
+    uint8_t* data = new uint8_t[SIZE];
+    uint8_t* readData = new uint8_t[SIZE];
+    fillTestData(data, SIZE, 1);
+    nvs_handle_t handle;
+    TEST_ESP_OK(nvs_open("stream", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_set_blob(handle, "blob", data, SIZE));
+    size_t usedEntries;
+    TEST_ESP_OK(nvs_get_used_entry_count(handle, &usedEntries));
+
+    TEST_ESP_OK(nvs_blob_open(handle, "blob", NVS_READWRITE));
+    TEST_ESP_OK(nvs_blob_write(handle, 0, data + 1, SIZE - 1));
+    nvs_close(handle);
+
+    TEST_ESP_OK(nvs_open("stream", NVS_READWRITE, &handle));
+    size_t size = SIZE;
+    TEST_ESP_OK(nvs_get_blob(handle, "blob", readData, &size));
+    CHECK(size == SIZE);
+    CHECK(memcmp(data, readData, SIZE) == 0);
+    // the chunks written by the stream were erased
+    size_t newUsedEntries;
+    TEST_ESP_OK(nvs_get_used_entry_count(handle, &newUsedEntries));
+    CHECK(newUsedEntries == usedEntries);
+    nvs_close(handle);
+
+    delete[] data;
+    delete[] readData;
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+TEST_CASE("streamed blob replaces the previous value completely or not at all if power is lost", "[nvs][blob_stream]")
+{
+    const uint32_t SECTORS = 8;
+    const size_t SIZE = 2 * Page::CHUNK_MAX_SIZE + 500;
+    uint8_t* oldData = new uint8_t[SIZE];
+    uint8_t* newData = new uint8_t[SIZE];
+    uint8_t* readData = new uint8_t[SIZE];
+    fillTestData(oldData, SIZE, 1);
+    fillTestData(newData, SIZE, 2);
+    size_t oldCount = 0;
+    size_t newCount = 0;
+
+    for (uint32_t errDelay = 0; ; ++errDelay) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(SECTORS);
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, SECTORS));
+        esp_err_t err;
+        {
+            unique_ptr<NVSHandle> handle = open_nvs_handle("stream", NVS_READWRITE, &err);
+            REQUIRE(err == ESP_OK);
+            TEST_ESP_OK(handle->set_blob("blob", oldData, SIZE));
+
+            emu.failAfter(errDelay, true);
+            err = writeStreamed(*handle, "blob", newData, SIZE, 1000);
+        }
+        emu.failAfter(UINT32_MAX);
+
+        // power is lost, initialize again
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, SECTORS));
+        nvs_handle_t handle;
+        TEST_ESP_OK(nvs_open("stream", NVS_READONLY, &handle));
+        size_t size = SIZE;
+        TEST_ESP_OK(nvs_get_blob(handle, "blob", readData, &size));
+        REQUIRE(size == SIZE);
+        if (memcmp(readData, newData, SIZE) == 0) {
+            ++newCount;
+        } else {
+            CHECK(memcmp(readData, oldData, SIZE) == 0);
+            CHECK(err != ESP_OK);
+            ++oldCount;
+        }
+        nvs_close(handle);
+        TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+        if (err == ESP_OK) {
+            CHECK(memcmp(readData, newData, SIZE) == 0);
+            break;
+        }
+    }
+    CHECK(oldCount > 0);
+    CHECK(newCount > 0);
+    delete[] oldData;
+    delete[] newData;
+    delete[] readData;
+}
+
+TEST_CASE("blob stream peak heap usage", "[nvs][blob_stream]")
+{
+    const size_t SIZE = 100000;
+    const size_t PIECE_SIZE = 512;
+    SpiFlashEmulator emu(64);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 64));
+    nvs_handle_t handle;
+    TEST_ESP_OK(nvs_open("stream", NVS_READWRITE, &handle));
+    uint8_t piece[PIECE_SIZE];
+
+    // classic API: the caller needs a buffer for the whole blob
+    size_t base = resetHeapPeak();
+    uint8_t* data = new uint8_t[SIZE];
+    fillTestData(data, SIZE, 1);
+    TEST_ESP_OK(nvs_set_blob(handle, "classic", data, SIZE));
+    delete[] data;
+    size_t classicWritePeak = getHeapPeak(base);
+
+    base = resetHeapPeak();
+    data = new uint8_t[SIZE];
+    size_t size = SIZE;
+    TEST_ESP_OK(nvs_get_blob(handle, "classic", data, &size));
+    delete[] data;
+    size_t classicReadPeak = getHeapPeak(base);
+
+    // stream API: pieces of the blob are generated and consumed one at a time
+    base = resetHeapPeak();
+    // assertions allocate memory, so errors are only checked when done
+    esp_err_t err = nvs_blob_open(handle, "streamed", NVS_READWRITE);
+    for (size_t offset = 0; offset < SIZE && err == ESP_OK; offset += PIECE_SIZE) {
+        size_t len = std::min(PIECE_SIZE, SIZE - offset);
+        fillTestData(piece, len, offset + 1);
+        err = nvs_blob_write(handle, offset, piece, len);
+    }
+    if (err == ESP_OK) {
+        err = nvs_blob_close(handle);
+    }
+    size_t streamWritePeak = getHeapPeak(base);
+    TEST_ESP_OK(err);
+
+    base = resetHeapPeak();
+    uint32_t sum = 0;
+    err = nvs_blob_open(handle, "streamed", NVS_READONLY);
+    for (size_t offset = 0; offset < SIZE && err == ESP_OK; offset += PIECE_SIZE) {
+        size_t len = std::min(PIECE_SIZE, SIZE - offset);
+        err = nvs_blob_read(handle, offset, piece, len);
+        for (size_t i = 0; i < len; ++i) {
+            sum += piece[i];
+        }
+    }
+    if (err == ESP_OK) {
+        err = nvs_blob_close(handle);
+    }
+    size_t streamReadPeak = getHeapPeak(base);
+    TEST_ESP_OK(err);
+    CHECK(sum != 0);
+
+    printf("%zu byte blob, peak heap usage: classic write %zu, classic read %zu, "
+           "streamed write %zu, streamed read %zu bytes\n",
+           SIZE, classicWritePeak, classicReadPeak, streamWritePeak, streamReadPeak);
+    CHECK(classicWritePeak >= SIZE);
+    CHECK(classicReadPeak >= SIZE);
+    // the rest of the peak is the index of the items written, which grows in the same way for both APIs
+    CHECK(streamWritePeak < classicWritePeak / 4);
+    CHECK(streamReadPeak <= 1024);
+
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
@@ -0,0 +1,274 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include <cstdio>
+#include <chrono>
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "nvs_test_api.h"
+#include "nvs_checkpoint.hpp"
+#include "nvs_storage.hpp"
+#include "spi_flash_emulation.h"
+
+using namespace std;
+using namespace nvs;
+
+#define TEST_ESP_OK(rc) CHECK((rc) == ESP_OK)
+
+/* Storage which reports whether init() used the mount checkpoint */
+class CheckpointTestStorage : public Storage
+{
+public:
+    CheckpointTestStorage(bool useCheckpoint = true)
+    {
+        mCheckpointEnabled = useCheckpoint;
+    }
+
+    bool isMountedFromCheckpoint() const
+    {
+        return mCheckpointMatched;
+    }
+
+    bool isKeyIndexEnabled() const
+    {
+        return mKeyIndex.isEnabled();
+    }
+};
+
+static const size_t BLOB_SIZE = Page::CHUNK_MAX_SIZE + 100;
+
+static void fillStorage(Storage& storage, int itemCount, int generation = 0)
+{
+    uint8_t nsIndex;
+    REQUIRE(storage.createOrOpenNamespace("first", true, nsIndex) == ESP_OK);
+    REQUIRE(nsIndex == 1);
+    REQUIRE(storage.createOrOpenNamespace("second", true, nsIndex) == ESP_OK);
+    REQUIRE(nsIndex == 2);
+    char key[16];
+    for (int i = 0; i < itemCount; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        REQUIRE(storage.writeItem(1 + i % 2, key, i + generation) == ESP_OK);
+    }
+    // a blob which spans two pages
+    uint8_t blob[BLOB_SIZE];
+    std::fill_n(blob, sizeof(blob), generation);
+    REQUIRE(storage.writeItem(1, ItemType::BLOB, "blob", blob, sizeof(blob)) == ESP_OK);
+}
+
+static void checkStorage(Storage& storage, int itemCount, int generation = 0)
+{
+    uint8_t nsIndex;
+    CHECK(storage.createOrOpenNamespace("first", false, nsIndex) == ESP_OK);
+    CHECK(nsIndex == 1);
+    CHECK(storage.createOrOpenNamespace("second", false, nsIndex) == ESP_OK);
+    CHECK(nsIndex == 2);
+    char key[16];
+    for (int i = 0; i < itemCount; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        int val;
+        REQUIRE(storage.readItem(1 + i % 2, key, val) == ESP_OK);
+        CHECK(val == i + generation);
+    }
+    uint8_t blob[BLOB_SIZE];
+    uint8_t readBlob[BLOB_SIZE];
+    std::fill_n(blob, sizeof(blob), generation);
+    REQUIRE(storage.readItem(1, ItemType::BLOB, "blob", readBlob, sizeof(readBlob)) == ESP_OK);
+    CHECK(memcmp(blob, readBlob, sizeof(blob)) == 0);
+}
+
+TEST_CASE("mount checkpoint is used by the next init", "[nvs][checkpoint]")
+{
+    SpiFlashEmulator emu(10);
+    {
+        CheckpointTestStorage storage;
+        CHECK(storage.init(0, 10) == ESP_OK);
+        CHECK_FALSE(storage.isMountedFromCheckpoint());
+        fillStorage(storage, 400);
+        CHECK(storage.writeCheckpoint() == ESP_OK);
+    }
+
+    emu.clearStats();
+    CheckpointTestStorage storage;
+    CHECK(storage.init(0, 10) == ESP_OK);
+    CHECK(storage.isMountedFromCheckpoint());
+    CHECK(storage.isKeyIndexEnabled());
+    size_t checkpointReadBytes = emu.getReadBytes();
+    checkStorage(storage, 400);
+
+    // nothing changed, so the checkpoint isn't written again
+    emu.clearStats();
+    CHECK(storage.writeCheckpoint() == ESP_OK);
+    CHECK(emu.getWriteOps() == 0);
+
+    emu.clearStats();
+    CheckpointTestStorage fullStorage(false);
+    CHECK(fullStorage.init(0, 10) == ESP_OK);
+    CHECK_FALSE(fullStorage.isMountedFromCheckpoint());
+    CHECK(checkpointReadBytes < emu.getReadBytes() / 2);
+    checkStorage(fullStorage, 400);
+}
+
+TEST_CASE("mount checkpoint is ignored if pages changed after it was written", "[nvs][checkpoint]")
+{
+    SpiFlashEmulator emu(10);
+    {
+        CheckpointTestStorage storage;
+        CHECK(storage.init(0, 10) == ESP_OK);
+        fillStorage(storage, 400);
+        CHECK(storage.writeCheckpoint() == ESP_OK);
+        // the device is reset after these writes, without writing a new checkpoint
+        fillStorage(storage, 100, 1000);
+        CHECK(storage.eraseItem(2, "key399") == ESP_OK);
+    }
+
+    CheckpointTestStorage storage;
+    CHECK(storage.init(0, 10) == ESP_OK);
+    CHECK_FALSE(storage.isMountedFromCheckpoint());
+    checkStorage(storage, 100, 1000);
+    char key[16];
+    for (int i = 100; i < 399; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        int val;
+        REQUIRE(storage.readItem(1 + i % 2, key, val) == ESP_OK);
+        CHECK(val == i);
+    }
+    int val;
+    CHECK(storage.readItem(2, "key399", val) == ESP_ERR_NVS_NOT_FOUND);
+
+    // the next checkpoint replaces the stale one
+    CHECK(storage.writeCheckpoint() == ESP_OK);
+    CheckpointTestStorage storage2;
+    CHECK(storage2.init(0, 10) == ESP_OK);
+    CHECK(storage2.isMountedFromCheckpoint());
+    checkStorage(storage2, 100, 1000);
+}
+
+TEST_CASE("interrupted mount checkpoint write is ignored by init", "[nvs][checkpoint]")
+{
+    for (uint32_t failAfter = 0; ; ++failAfter) {
+        SpiFlashEmulator emu(10);
+        {
+            CheckpointTestStorage storage;
+            CHECK(storage.init(0, 10) == ESP_OK);
+            fillStorage(storage, 100);
+            CHECK(storage.writeCheckpoint() == ESP_OK);
+            fillStorage(storage, 100, 1);
+        }
+
+        CheckpointTestStorage storage;
+        CHECK(storage.init(0, 10) == ESP_OK);
+        emu.failAfter(failAfter);
+        bool written = storage.writeCheckpoint() == ESP_OK;
+        emu.failAfter(UINT32_MAX);
+
+        CheckpointTestStorage storage2;
+        CHECK(storage2.init(0, 10) == ESP_OK);
+        CHECK(storage2.isMountedFromCheckpoint() == written);
+        checkStorage(storage2, 100, 1);
+        if (written) {
+            break;
+        }
+    }
+}
+
+TEST_CASE("mount checkpoint pages are reused for items", "[nvs][checkpoint]")
+{
+    SpiFlashEmulator emu(5);
+    {
+        CheckpointTestStorage storage;
+        CHECK(storage.init(0, 5) == ESP_OK);
+        fillStorage(storage, 50);
+        CHECK(storage.writeCheckpoint() == ESP_OK);
+    }
+
+    CheckpointTestStorage storage;
+    CHECK(storage.init(0, 5) == ESP_OK);
+    CHECK(storage.isMountedFromCheckpoint());
+    // overwriting the items reclaims every page several times
+    for (int generation = 1; generation < 10; ++generation) {
+        fillStorage(storage, 50, generation);
+    }
+    checkStorage(storage, 50, 9);
+    CHECK(storage.writeCheckpoint() == ESP_OK);
+
+    CheckpointTestStorage storage2;
+    CHECK(storage2.init(0, 5) == ESP_OK);
+    CHECK(storage2.isMountedFromCheckpoint());
+    checkStorage(storage2, 50, 9);
+}
+
+TEST_CASE("nvs_flash_deinit writes a mount checkpoint", "[nvs][checkpoint]")
+{
+    SpiFlashEmulator emu(10);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 10));
+    nvs_handle_t handle;
+    TEST_ESP_OK(nvs_open("first", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_set_i32(handle, "key", 42));
+    TEST_ESP_OK(nvs_commit(handle));
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+
+    CheckpointTestStorage storage;
+    CHECK(storage.init(0, 10) == ESP_OK);
+    CHECK(storage.isMountedFromCheckpoint());
+    uint8_t nsIndex;
+    CHECK(storage.createOrOpenNamespace("first", false, nsIndex) == ESP_OK);
+    int32_t val;
+    CHECK(storage.readItem(nsIndex, "key", val) == ESP_OK);
+    CHECK(val == 42);
+}
+
+/* Hidden benchmark, compares init with and without a mount checkpoint */
+TEST_CASE("mount checkpoint init speed", "[nvs][checkpoint][benchmark][.]")
+{
+    const size_t pageCounts[] = { 4, 16, 64, 256 };
+    char key[16];
+
+    for (size_t pageCount : pageCounts) {
+        // leave enough pages free for the checkpoint
+        const size_t freePages = pageCount / 4 + 1;
+        SpiFlashEmulator emu(pageCount);
+        // writing pages directly is much faster than Storage::writeItem(), which checks the whole storage after each write on the host
+        const size_t itemsPerPage = Page::ENTRY_COUNT - 16;
+        const int itemCount = (pageCount - freePages) * itemsPerPage;
+        for (size_t sector = 0; sector < pageCount - freePages; ++sector) {
+            Page page;
+            REQUIRE(page.load(sector) == ESP_OK);
+            REQUIRE(page.setSeqNumber(sector) == ESP_OK);
+            for (size_t i = sector * itemsPerPage; i < (sector + 1) * itemsPerPage; ++i) {
+                snprintf(key, sizeof(key), "key%d", (int) i);
+                REQUIRE(page.writeItem(1 + i % 4, key, static_cast<int>(i)) == ESP_OK);
+            }
+            REQUIRE(page.markFull() == ESP_OK);
+        }
+
+        for (bool useCheckpoint : { false, true }) {
+            if (useCheckpoint) {
+                CheckpointTestStorage storage;
+                REQUIRE(storage.init(0, pageCount) == ESP_OK);
+                REQUIRE(storage.writeCheckpoint() == ESP_OK);
+            }
+            CheckpointTestStorage storage(useCheckpoint);
+            emu.clearStats();
+            auto start = chrono::steady_clock::now();
+            REQUIRE(storage.init(0, pageCount) == ESP_OK);
+            double initMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            REQUIRE(storage.isMountedFromCheckpoint() == useCheckpoint);
+
+            printf("%3zu pages, %5d items, %-11s init %8.2f ms (%7zu us flash time, %8zu bytes read)\n",
+                   pageCount, itemCount, useCheckpoint ? "checkpoint:" : "full load:",
+                   initMs, emu.getTotalTime(), emu.getReadBytes());
+        }
+    }
+}
@@ -0,0 +1,246 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "nvs_test_api.h"
+#include "nvs_storage.hpp"
+#include "spi_flash_emulation.h"
+
+using namespace std;
+using namespace nvs;
+
+#define TEST_ESP_ERR(rc, res) CHECK((rc) == (res))
+#define TEST_ESP_OK(rc) CHECK((rc) == ESP_OK)
+
+/* Storage which reports its number of free pages */
+class GcTestStorage : public Storage
+{
+public:
+    size_t getFreePageCount()
+    {
+        return mPageManager.getFreePageCount();
+    }
+};
+
+static const int KEY_COUNT = 100;
+
+/* Write every key with values of the given generation, as 32 byte strings so that each item spans two entries */
+static void writeGeneration(Storage& storage, int generation)
+{
+    char key[16];
+    char value[32];
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        snprintf(value, sizeof(value), "value %d of generation %d", i, generation);
+        REQUIRE(storage.writeItem(1, ItemType::SZ, key, value, strlen(value) + 1) == ESP_OK);
+    }
+}
+
+static void checkGeneration(Storage& storage, int generation)
+{
+    char key[16];
+    char value[32];
+    char readValue[32];
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        snprintf(value, sizeof(value), "value %d of generation %d", i, generation);
+        REQUIRE(storage.readItem(1, ItemType::SZ, key, readValue, sizeof(readValue)) == ESP_OK);
+        CHECK(strcmp(value, readValue) == 0);
+    }
+}
+
+/* Write generations until only one page is free */
+static int fillWithGarbage(GcTestStorage& storage)
+{
+    int generation = 0;
+    while (storage.getFreePageCount() > 1) {
+        writeGeneration(storage, ++generation);
+    }
+    return generation;
+}
+
+static void runGc(Storage& storage, size_t maxItems = 4)
+{
+    bool done = false;
+    for (int steps = 0; !done; ++steps) {
+        REQUIRE(steps < 10000);
+        REQUIRE(storage.gcStep(maxItems, done) == ESP_OK);
+    }
+}
+
+TEST_CASE("gc step reclaims pages with erased items", "[nvs][gc]")
+{
+    SpiFlashEmulator emu(8);
+    GcTestStorage storage;
+    REQUIRE(storage.init(0, 8) == ESP_OK);
+    uint8_t nsIndex;
+    REQUIRE(storage.createOrOpenNamespace("gc", true, nsIndex) == ESP_OK);
+
+    // nothing to do while enough pages are free
+    bool done;
+    emu.clearStats();
+    TEST_ESP_OK(storage.gcStep(4, done));
+    CHECK(done);
+    CHECK(emu.getWriteOps() == 0);
+
+    int generation = fillWithGarbage(storage);
+    REQUIRE(storage.getFreePageCount() == 1);
+
+    // each step moves at most the given number of items, or erases one page
+    size_t steps = 0;
+    done = false;
+    while (!done) {
+        emu.clearStats();
+        TEST_ESP_OK(storage.gcStep(4, done));
+        CHECK(emu.getEraseOps() <= 1);
+        if (emu.getEraseOps() == 0) {
+            // two entries per item, and one write to mark each entry as written and as erased
+            CHECK(emu.getWriteOps() <= 4 * (2 + 2 + 1));
+        }
+        ++steps;
+        REQUIRE(steps < 1000);
+    }
+    CHECK(steps > 1);
+    CHECK(storage.getFreePageCount() >= NVS_GC_FREE_PAGES);
+    checkGeneration(storage, generation);
+
+    // once done, there is nothing to do until pages are used again
+    emu.clearStats();
+    TEST_ESP_OK(storage.gcStep(4, done));
+    CHECK(done);
+    CHECK(emu.getWriteOps() == 0);
+
+    GcTestStorage storage2;
+    REQUIRE(storage2.init(0, 8) == ESP_OK);
+    checkGeneration(storage2, generation);
+}
+
+TEST_CASE("writes don't reclaim pages while gc keeps up", "[nvs][gc]")
+{
+    SpiFlashEmulator emu(8);
+    GcTestStorage storage;
+    REQUIRE(storage.init(0, 8) == ESP_OK);
+    uint8_t nsIndex;
+    REQUIRE(storage.createOrOpenNamespace("gc", true, nsIndex) == ESP_OK);
+
+    size_t writeErases = 0;
+    for (int generation = 1; generation < 30; ++generation) {
+        emu.clearStats();
+        writeGeneration(storage, generation);
+        writeErases += emu.getEraseOps();
+        runGc(storage);
+        checkGeneration(storage, generation);
+    }
+    CHECK(writeErases == 0);
+}
+
+TEST_CASE("items are kept if power is lost during a gc step", "[nvs][gc]")
+{
+    for (uint32_t errDelay = 0; ; ++errDelay) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(6);
+        int generation;
+        bool done = false;
+        {
+            GcTestStorage storage;
+            REQUIRE(storage.init(0, 6) == ESP_OK);
+            uint8_t nsIndex;
+            REQUIRE(storage.createOrOpenNamespace("gc", true, nsIndex) == ESP_OK);
+            generation = fillWithGarbage(storage);
+
+            emu.failAfter(errDelay, true);
+            esp_err_t err = ESP_OK;
+            while (!done && err == ESP_OK) {
+                err = storage.gcStep(4, done);
+            }
+            emu.failAfter(UINT32_MAX);
+        }
+
+        GcTestStorage storage;
+        REQUIRE(storage.init(0, 6) == ESP_OK);
+        checkGeneration(storage, generation);
+        // the partition can still be written and reclaimed
+        writeGeneration(storage, generation + 1);
+        runGc(storage);
+        checkGeneration(storage, generation + 1);
+        if (done) {
+            break;
+        }
+    }
+}
+
+TEST_CASE("nvs_flash_gc_step checks its arguments", "[nvs][gc]")
+{
+    SpiFlashEmulator emu(5);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+    bool done = false;
+    TEST_ESP_ERR(nvs_flash_gc_step(NULL, 0, &done), ESP_ERR_INVALID_ARG);
+    TEST_ESP_ERR(nvs_flash_gc_step("missing", 4, &done), ESP_ERR_NVS_NOT_INITIALIZED);
+    TEST_ESP_OK(nvs_flash_gc_step(NULL, 4, &done));
+    CHECK(done);
+    TEST_ESP_OK(nvs_flash_gc_step(NVS_DEFAULT_PART_NAME, 4, NULL));
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+/* Hidden benchmark, flash time of nvs_set_blob calls under sustained rewrites, with and without
+ * page reclamation between the calls, as done by the gc task while writers are idle */
+TEST_CASE("nvs_set_blob latency with and without incremental gc", "[nvs][gc][benchmark][.]")
+{
+    const size_t SECTORS = 16;
+    const int KEYS = 10;
+    const size_t BLOB_SIZE = 1000;
+    const int WRITES = 4000;
+
+    for (bool useGc : { false, true }) {
+        SpiFlashEmulator emu(SECTORS);
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, SECTORS));
+        nvs_handle_t handle;
+        TEST_ESP_OK(nvs_open("bench", NVS_READWRITE, &handle));
+        vector<size_t> writeTimes;
+        size_t maxStepTime = 0;
+        uint8_t blob[BLOB_SIZE];
+        char key[16];
+
+        for (int i = 0; i < WRITES; ++i) {
+            snprintf(key, sizeof(key), "blob%d", i % KEYS);
+            std::fill_n(blob, sizeof(blob), static_cast<uint8_t>(i));
+            emu.clearStats();
+            REQUIRE(nvs_set_blob(handle, key, blob, sizeof(blob)) == ESP_OK);
+            writeTimes.push_back(emu.getTotalTime());
+
+            bool done = !useGc;
+            while (!done) {
+                emu.clearStats();
+                REQUIRE(nvs_flash_gc_step(NULL, 8, &done) == ESP_OK);
+                maxStepTime = std::max(maxStepTime, emu.getTotalTime());
+            }
+        }
+
+        sort(writeTimes.begin(), writeTimes.end());
+        printf("nvs_set_blob %zu bytes, %s: p50 %6zu us, p99 %6zu us, max %6zu us flash time",
+               BLOB_SIZE, useGc ? "with gc   " : "without gc",
+               writeTimes[writeTimes.size() / 2], writeTimes[writeTimes.size() * 99 / 100], writeTimes.back());
+        if (useGc) {
+            printf(", max gc step %zu us", maxStepTime);
+        }
+        printf("\n");
+
+        nvs_close(handle);
+        TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+    }
+}
@@ -0,0 +1,251 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include "nvs_key_index.hpp"
+#include "nvs_storage.hpp"
+#include "spi_flash_emulation.h"
+
+using namespace std;
+using namespace nvs;
+
+/* Storage with access to its key index, and the option to search all pages instead */
+class KeyIndexTestStorage : public Storage
+{
+public:
+    KeyIndexTestStorage(bool useKeyIndex)
+    {
+        if (!useKeyIndex) {
+            mKeyIndex.setMaxSize(0);
+        }
+    }
+
+    void setKeyIndexMaxSize(size_t maxSize)
+    {
+        mKeyIndex.setMaxSize(maxSize);
+    }
+
+    bool isKeyIndexEnabled() const
+    {
+        return mKeyIndex.isEnabled();
+    }
+};
+
+static size_t countPages(const KeyIndex& index, uint32_t hash, Page* page)
+{
+    size_t count = 0;
+    size_t pos = 0;
+    Page* p;
+    while ((p = index.find(hash, pos)) != nullptr) {
+        if (p == page) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+TEST_CASE("key index insert, find and erase", "[nvs][key_index]")
+{
+    KeyIndex index(64 * 1024);
+    REQUIRE(index.reset(0));
+
+    Page pages[4];
+    char key[16];
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        index.insert(&pages[i % 4], i % 3 + 1, key, Page::CHUNK_ANY);
+    }
+    REQUIRE(index.isEnabled());
+
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        uint32_t hash = KeyIndex::hash(i % 3 + 1, key, Page::CHUNK_ANY);
+        CHECK(countPages(index, hash, &pages[i % 4]) == 1);
+        // chunk index and namespace are part of the key
+        CHECK(countPages(index, KeyIndex::hash(i % 3 + 1, key, 0), &pages[i % 4]) == 0);
+        CHECK(countPages(index, KeyIndex::hash(i % 3 + 2, key, Page::CHUNK_ANY), &pages[i % 4]) == 0);
+    }
+
+    // the same key may be on several pages, or twice on one page, while it is being replaced
+    index.insert(&pages[1], 1, "key0", Page::CHUNK_ANY);
+    index.insert(&pages[0], 1, "key0", Page::CHUNK_ANY);
+    CHECK(countPages(index, KeyIndex::hash(1, "key0", Page::CHUNK_ANY), &pages[0]) == 2);
+    CHECK(countPages(index, KeyIndex::hash(1, "key0", Page::CHUNK_ANY), &pages[1]) == 1);
+    index.erase(&pages[0], 1, "key0", Page::CHUNK_ANY);
+    index.erase(&pages[1], 1, "key0", Page::CHUNK_ANY);
+    CHECK(countPages(index, KeyIndex::hash(1, "key0", Page::CHUNK_ANY), &pages[0]) == 1);
+    CHECK(countPages(index, KeyIndex::hash(1, "key0", Page::CHUNK_ANY), &pages[1]) == 0);
+
+    for (int i = 0; i < 1000; i += 2) {
+        snprintf(key, sizeof(key), "key%d", i);
+        index.erase(&pages[i % 4], i % 3 + 1, key, Page::CHUNK_ANY);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        CHECK(countPages(index, KeyIndex::hash(i % 3 + 1, key, Page::CHUNK_ANY), &pages[i % 4]) == (i % 2 ? 1 : 0));
+    }
+}
+
+TEST_CASE("key index erases pages and namespaces", "[nvs][key_index]")
+{
+    KeyIndex index(64 * 1024);
+    REQUIRE(index.reset(100));
+
+    Page pages[4];
+    char key[16];
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        index.insert(&pages[i % 4], i % 3 + 1, key, Page::CHUNK_ANY);
+    }
+
+    index.erasePage(&pages[2]);
+    index.eraseNamespace(3);
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        bool present = (i % 4 != 2) && (i % 3 + 1 != 3);
+        CHECK(countPages(index, KeyIndex::hash(i % 3 + 1, key, Page::CHUNK_ANY), &pages[i % 4]) == (present ? 1 : 0));
+    }
+}
+
+TEST_CASE("key index is disabled if it doesn't fit", "[nvs][key_index]")
+{
+    KeyIndex index(1024);
+    CHECK_FALSE(index.reset(1000));
+    CHECK_FALSE(index.isEnabled());
+
+    REQUIRE(index.reset(10));
+    CHECK(index.getMemorySize() <= 1024);
+    Page page;
+    char key[16];
+    for (int i = 0; i < 1000 && index.isEnabled(); ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        index.insert(&page, 1, key, Page::CHUNK_ANY);
+    }
+    CHECK_FALSE(index.isEnabled());
+    size_t pos = 0;
+    CHECK(index.find(KeyIndex::hash(1, "key0", Page::CHUNK_ANY), pos) == nullptr);
+}
+
+TEST_CASE("storage falls back to searching all pages if the key index doesn't fit", "[nvs][key_index]")
+{
+    SpiFlashEmulator emu(8);
+    char key[16];
+    {
+        KeyIndexTestStorage storage(true);
+        CHECK(storage.init(0, 8) == ESP_OK);
+        CHECK(storage.isKeyIndexEnabled());
+        for (int i = 0; i < 300; ++i) {
+            snprintf(key, sizeof(key), "key%d", i);
+            REQUIRE(storage.writeItem(1, key, i) == ESP_OK);
+        }
+        CHECK(storage.writeItem(1, ItemType::BLOB, "blob", key, sizeof(key)) == ESP_OK);
+    }
+
+    KeyIndexTestStorage storage(true);
+    storage.setKeyIndexMaxSize(256);
+    CHECK(storage.init(0, 8) == ESP_OK);
+    CHECK_FALSE(storage.isKeyIndexEnabled());
+    for (int i = 0; i < 300; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        int val;
+        REQUIRE(storage.readItem(1, key, val) == ESP_OK);
+        CHECK(val == i);
+    }
+    char blob[sizeof(key)];
+    CHECK(storage.readItem(1, ItemType::BLOB, "blob", blob, sizeof(blob)) == ESP_OK);
+    CHECK(memcmp(blob, key, sizeof(key)) == 0);
+}
+
+TEST_CASE("key index follows items when pages are reclaimed", "[nvs][key_index]")
+{
+    SpiFlashEmulator emu(4);
+    KeyIndexTestStorage storage(true);
+    CHECK(storage.init(0, 4) == ESP_OK);
+    char key[16];
+    uint8_t blob[Page::CHUNK_MAX_SIZE / 2];
+    // write enough to reclaim every page several times, debugCheck() verifies the index after each write
+    for (int i = 0; i < 2000; ++i) {
+        snprintf(key, sizeof(key), "key%d", i % 50);
+        REQUIRE(storage.writeItem(1 + i % 2, key, i) == ESP_OK);
+        if (i % 100 == 0) {
+            std::fill_n(blob, sizeof(blob), i);
+            REQUIRE(storage.writeItem(1, ItemType::BLOB, "blob", blob, sizeof(blob)) == ESP_OK);
+        }
+    }
+    CHECK(storage.isKeyIndexEnabled());
+    CHECK(storage.eraseNamespace(2) == ESP_OK);
+    for (int i = 0; i < 50; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        int val;
+        // even keys were written to namespace 1, odd ones to namespace 2
+        CHECK(storage.readItem(1, key, val) == (i % 2 ? ESP_ERR_NVS_NOT_FOUND : ESP_OK));
+        CHECK(storage.readItem(2, key, val) == ESP_ERR_NVS_NOT_FOUND);
+    }
+    uint8_t readBlob[sizeof(blob)];
+    CHECK(storage.readItem(1, ItemType::BLOB, "blob", readBlob, sizeof(readBlob)) == ESP_OK);
+    CHECK(memcmp(blob, readBlob, sizeof(blob)) == 0);
+}
+
+/* Hidden benchmark, compares key lookups with and without the key index */
+TEST_CASE("key index lookup and init speed", "[nvs][key_index][benchmark][.]")
+{
+    const size_t pageCounts[] = { 4, 16, 64, 256 };
+    const int LOOKUPS = 20000;
+    char key[16];
+
+    for (size_t pageCount : pageCounts) {
+        SpiFlashEmulator emu(pageCount);
+        // fill all pages but the one which must be kept free, writing pages directly is much
+        // faster than Storage::writeItem(), which checks the whole storage after each write on the host
+        const size_t itemsPerPage = Page::ENTRY_COUNT - 16;
+        const int itemCount = (pageCount - 1) * itemsPerPage;
+        for (size_t sector = 0; sector < pageCount - 1; ++sector) {
+            Page page;
+            REQUIRE(page.load(sector) == ESP_OK);
+            REQUIRE(page.setSeqNumber(sector) == ESP_OK);
+            for (size_t i = sector * itemsPerPage; i < (sector + 1) * itemsPerPage; ++i) {
+                snprintf(key, sizeof(key), "key%d", (int) i);
+                REQUIRE(page.writeItem(1 + i % 4, key, static_cast<int>(i)) == ESP_OK);
+            }
+            REQUIRE(page.markFull() == ESP_OK);
+        }
+
+        for (bool useKeyIndex : { false, true }) {
+            KeyIndexTestStorage storage(useKeyIndex);
+            emu.clearStats();
+            auto start = chrono::steady_clock::now();
+            REQUIRE(storage.init(0, pageCount) == ESP_OK);
+            double initMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            size_t initFlashUs = emu.getTotalTime();
+            REQUIRE(storage.isKeyIndexEnabled() == useKeyIndex);
+
+            mt19937 gen(42);
+            uniform_int_distribution<int> dist(0, itemCount - 1);
+            start = chrono::steady_clock::now();
+            for (int i = 0; i < LOOKUPS; ++i) {
+                int n = dist(gen);
+                snprintf(key, sizeof(key), "key%d", n);
+                int val;
+                REQUIRE(storage.readItem(1 + n % 4, key, val) == ESP_OK);
+            }
+            double lookupS = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            printf("%3zu pages, %5d items, %-11s init %8.2f ms (%7zu us flash time), %10.0f lookups/s\n",
+                   pageCount, itemCount, useKeyIndex ? "key index:" : "page scan:",
+                   initMs, initFlashUs, LOOKUPS / lookupS);
+        }
+    }
+}
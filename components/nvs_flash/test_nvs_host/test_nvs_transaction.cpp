@@ -0,0 +1,482 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include "nvs.hpp"
+#include "nvs_test_api.h"
+#include "nvs_handle_simple.hpp"
+#include "spi_flash_emulation.h"
+
+#define TEST_ESP_ERR(rc, res) CHECK((rc) == (res))
+#define TEST_ESP_OK(rc) CHECK((rc) == ESP_OK)
+
+using namespace std;
+using namespace nvs;
+
+TEST_CASE("nvs transaction changes are only visible through its handle until committed", "[nvs][transaction]")
+{
+    SpiFlashEmulator emu(5);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+    nvs_handle_t handle, other;
+    TEST_ESP_OK(nvs_open("ns", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_open("ns", NVS_READONLY, &other));
+
+    TEST_ESP_OK(nvs_set_u32(handle, "a", 1));
+    TEST_ESP_OK(nvs_set_u32(handle, "b", 2));
+    TEST_ESP_OK(nvs_set_str(handle, "s", "old"));
+
+    TEST_ESP_OK(nvs_transaction_begin(handle));
+    TEST_ESP_OK(nvs_set_u32(handle, "a", 10));
+    TEST_ESP_OK(nvs_set_u32(handle, "a", 11));
+    TEST_ESP_OK(nvs_erase_key(handle, "b"));
+    TEST_ESP_OK(nvs_set_str(handle, "s", "new value"));
+    const uint8_t blob[] = { 1, 2, 3, 4, 5 };
+    TEST_ESP_OK(nvs_set_blob(handle, "blob", blob, sizeof(blob)));
+
+    // read your own writes
+    uint32_t val;
+    TEST_ESP_OK(nvs_get_u32(handle, "a", &val));
+    CHECK(val == 11);
+    TEST_ESP_ERR(nvs_get_u32(handle, "b", &val), ESP_ERR_NVS_NOT_FOUND);
+    char str[16];
+    size_t len = sizeof(str);
+    TEST_ESP_OK(nvs_get_str(handle, "s", str, &len));
+    CHECK(strcmp(str, "new value") == 0);
+    CHECK(len == strlen("new value") + 1);
+    uint8_t readBlob[sizeof(blob)];
+    len = sizeof(readBlob);
+    TEST_ESP_OK(nvs_get_blob(handle, "blob", readBlob, &len));
+    CHECK(memcmp(blob, readBlob, sizeof(blob)) == 0);
+
+    // other handles see the old values
+    TEST_ESP_OK(nvs_get_u32(other, "a", &val));
+    CHECK(val == 1);
+    TEST_ESP_OK(nvs_get_u32(other, "b", &val));
+    CHECK(val == 2);
+    len = sizeof(readBlob);
+    TEST_ESP_ERR(nvs_get_blob(other, "blob", readBlob, &len), ESP_ERR_NVS_NOT_FOUND);
+
+    TEST_ESP_OK(nvs_commit(handle));
+
+    TEST_ESP_OK(nvs_get_u32(other, "a", &val));
+    CHECK(val == 11);
+    TEST_ESP_ERR(nvs_get_u32(other, "b", &val), ESP_ERR_NVS_NOT_FOUND);
+    len = sizeof(str);
+    TEST_ESP_OK(nvs_get_str(other, "s", str, &len));
+    CHECK(strcmp(str, "new value") == 0);
+    nvs_close(other);
+    nvs_close(handle);
+
+    // changes are persistent, and the transaction log is gone
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+    TEST_ESP_OK(nvs_open("ns", NVS_READONLY, &handle));
+    TEST_ESP_OK(nvs_get_u32(handle, "a", &val));
+    CHECK(val == 11);
+    len = sizeof(readBlob);
+    TEST_ESP_OK(nvs_get_blob(handle, "blob", readBlob, &len));
+    CHECK(memcmp(blob, readBlob, sizeof(blob)) == 0);
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_open("nvs.txn", NVS_READONLY, &handle));
+    TEST_ESP_ERR(nvs_get_blob(handle, "log", nullptr, &len), ESP_ERR_NVS_NOT_FOUND);
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+TEST_CASE("nvs transaction abort and erase all", "[nvs][transaction]")
+{
+    SpiFlashEmulator emu(5);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+    nvs_handle_t handle;
+    TEST_ESP_OK(nvs_open("ns", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_set_i32(handle, "a", -1));
+    TEST_ESP_OK(nvs_set_i32(handle, "b", -2));
+
+    TEST_ESP_ERR(nvs_transaction_abort(handle), ESP_ERR_INVALID_STATE);
+    TEST_ESP_OK(nvs_transaction_begin(handle));
+    TEST_ESP_ERR(nvs_transaction_begin(handle), ESP_ERR_INVALID_STATE);
+    TEST_ESP_OK(nvs_set_i32(handle, "a", 5));
+    TEST_ESP_OK(nvs_transaction_abort(handle));
+    int32_t val;
+    TEST_ESP_OK(nvs_get_i32(handle, "a", &val));
+    CHECK(val == -1);
+
+    emu.clearStats();
+    TEST_ESP_OK(nvs_transaction_begin(handle));
+    TEST_ESP_OK(nvs_set_i32(handle, "a", 5));
+    TEST_ESP_OK(nvs_erase_all(handle));
+    TEST_ESP_ERR(nvs_get_i32(handle, "a", &val), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_ERR(nvs_get_i32(handle, "b", &val), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(nvs_set_i32(handle, "c", 3));
+    TEST_ESP_OK(nvs_get_i32(handle, "c", &val));
+    CHECK(val == 3);
+    CHECK(emu.getWriteOps() == 0);
+    TEST_ESP_OK(nvs_commit(handle));
+
+    TEST_ESP_ERR(nvs_get_i32(handle, "a", &val), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_ERR(nvs_get_i32(handle, "b", &val), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(nvs_get_i32(handle, "c", &val));
+    CHECK(val == 3);
+
+    // committing without a transaction is still allowed
+    TEST_ESP_OK(nvs_commit(handle));
+    nvs_close(handle);
+
+    TEST_ESP_OK(nvs_open("ns", NVS_READONLY, &handle));
+    TEST_ESP_ERR(nvs_transaction_begin(handle), ESP_ERR_NVS_READ_ONLY);
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+TEST_CASE("nvs transaction through the C++ API", "[nvs][transaction]")
+{
+    SpiFlashEmulator emu(5);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+    esp_err_t err;
+    unique_ptr<NVSHandle> handle = open_nvs_handle("ns", NVS_READWRITE, &err);
+    TEST_ESP_OK(err);
+
+    TEST_ESP_OK(handle->begin_transaction());
+    TEST_ESP_OK(handle->set_item("a", static_cast<uint16_t>(1)));
+    TEST_ESP_OK(handle->set_item("b", static_cast<int8_t>(-2)));
+    TEST_ESP_OK(handle->commit());
+    TEST_ESP_ERR(handle->abort_transaction(), ESP_ERR_INVALID_STATE);
+
+    uint16_t a;
+    int8_t b;
+    TEST_ESP_OK(handle->get_item("a", a));
+    TEST_ESP_OK(handle->get_item("b", b));
+    CHECK(a == 1);
+    CHECK(b == -2);
+    handle.reset();
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+TEST_CASE("Page::writeItems writes items with a single data write", "[nvs][transaction]")
+{
+    SpiFlashEmulator emu(1);
+    Page page;
+    TEST_ESP_OK(page.load(0));
+    TEST_ESP_OK(page.setSeqNumber(0));
+
+    const char* str = "a string which is longer than one entry";
+    uint32_t values[20];
+    char keys[20][16];
+    Page::ItemData items[21];
+    for (size_t i = 0; i < 20; ++i) {
+        values[i] = i * 3;
+        snprintf(keys[i], sizeof(keys[i]), "key%d", static_cast<int>(i));
+        items[i] = { ItemType::U32, keys[i], &values[i], sizeof(values[i]) };
+    }
+    items[20] = { ItemType::SZ, "str", str, strlen(str) + 1 };
+
+    // initialize the page
+    TEST_ESP_OK(page.writeItem(1, "first", 0));
+
+    emu.clearStats();
+    size_t written;
+    TEST_ESP_OK(page.writeItems(1, items, 21, written));
+    CHECK(written == 21);
+    // one write for the entries, plus one per word of the entry state table
+    CHECK(emu.getWriteOps() <= 3);
+    CHECK(page.getUsedEntryCount() == 1 + 20 + 3);
+
+    for (size_t i = 0; i < 20; ++i) {
+        uint32_t val;
+        TEST_ESP_OK(page.readItem(1, keys[i], val));
+        CHECK(val == values[i]);
+    }
+    char buf[64];
+    TEST_ESP_OK(page.readItem(1, ItemType::SZ, "str", buf, sizeof(buf)));
+    CHECK(strcmp(buf, str) == 0);
+
+    // the page is loaded from flash the same way
+    Page loaded;
+    TEST_ESP_OK(loaded.load(0));
+    CHECK(loaded.getUsedEntryCount() == 1 + 20 + 3);
+    uint32_t val;
+    TEST_ESP_OK(loaded.readItem(1, keys[19], val));
+    CHECK(val == values[19]);
+
+    // only the items which fit are written
+    uint8_t large[Page::CHUNK_MAX_SIZE / 2];
+    std::fill_n(large, sizeof(large), 0xaa);
+    items[0] = { ItemType::SZ, "large1", large, sizeof(large) };
+    items[1] = { ItemType::SZ, "large2", large, sizeof(large) };
+    TEST_ESP_OK(page.writeItems(1, items, 2, written));
+    CHECK(written == 1);
+    TEST_ESP_ERR(page.writeItems(1, items + 1, 1, written), ESP_ERR_NVS_PAGE_FULL);
+    CHECK(written == 0);
+}
+
+static const int TXN_KEY_COUNT = 20;
+
+/* Write the values checked by the power failure tests, based on "base" */
+static void writeTransactionTestData(nvs_handle_t handle, uint32_t base, bool inTransaction)
+{
+    char key[16];
+    if (inTransaction) {
+        TEST_ESP_OK(nvs_transaction_begin(handle));
+    }
+    for (int i = 0; i < TXN_KEY_COUNT; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        TEST_ESP_OK(nvs_set_u32(handle, key, base + i));
+    }
+    char str[32];
+    snprintf(str, sizeof(str), "string %u", static_cast<unsigned>(base));
+    TEST_ESP_OK(nvs_set_str(handle, "str", str));
+    uint8_t blob[Page::CHUNK_MAX_SIZE / 3];
+    std::fill_n(blob, sizeof(blob), static_cast<uint8_t>(base));
+    TEST_ESP_OK(nvs_set_blob(handle, "blob", blob, sizeof(blob)));
+    if (base == 0) {
+        TEST_ESP_OK(nvs_set_u8(handle, "erased", 1));
+    } else {
+        TEST_ESP_OK(nvs_erase_key(handle, "erased"));
+    }
+}
+
+/* Returns the base of the values in storage, or -1 if they are a mix of two transactions */
+static int64_t readTransactionTestData(nvs_handle_t handle)
+{
+    char key[16];
+    uint32_t val;
+    REQUIRE(nvs_get_u32(handle, "key0", &val) == ESP_OK);
+    const uint32_t base = val;
+    for (int i = 0; i < TXN_KEY_COUNT; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        if (nvs_get_u32(handle, key, &val) != ESP_OK || val != base + i) {
+            return -1;
+        }
+    }
+    char str[32];
+    char expected[32];
+    size_t len = sizeof(str);
+    snprintf(expected, sizeof(expected), "string %u", static_cast<unsigned>(base));
+    if (nvs_get_str(handle, "str", str, &len) != ESP_OK || strcmp(str, expected) != 0) {
+        return -1;
+    }
+    uint8_t blob[Page::CHUNK_MAX_SIZE / 3];
+    len = sizeof(blob);
+    if (nvs_get_blob(handle, "blob", blob, &len) != ESP_OK || len != sizeof(blob)
+            || std::count(blob, blob + sizeof(blob), static_cast<uint8_t>(base)) != static_cast<ptrdiff_t>(sizeof(blob))) {
+        return -1;
+    }
+    uint8_t erased;
+    if ((nvs_get_u8(handle, "erased", &erased) == ESP_OK) != (base == 0)) {
+        return -1;
+    }
+    return base;
+}
+
+TEST_CASE("nvs transaction is applied completely or not at all if power is lost", "[nvs][transaction]")
+{
+    const uint32_t SECTORS = 5;
+    const uint32_t NEW_BASE = 100;
+    size_t oldCount = 0;
+    size_t newCount = 0;
+
+    for (uint32_t errDelay = 0; ; ++errDelay) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(SECTORS);
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, SECTORS));
+        nvs_handle_t handle;
+        TEST_ESP_OK(nvs_open("ns", NVS_READWRITE, &handle));
+        writeTransactionTestData(handle, 0, false);
+        writeTransactionTestData(handle, NEW_BASE, true);
+
+        emu.failAfter(errDelay, true);
+        esp_err_t err = nvs_commit(handle);
+        emu.failAfter(UINT32_MAX);
+        nvs_close(handle);
+
+        // power is lost, initialize again
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, SECTORS));
+        TEST_ESP_OK(nvs_open("ns", NVS_READWRITE, &handle));
+        int64_t base = readTransactionTestData(handle);
+        nvs_close(handle);
+        REQUIRE(base != -1);
+        if (base == NEW_BASE) {
+            ++newCount;
+        } else {
+            CHECK(err != ESP_OK);
+            ++oldCount;
+        }
+        TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+        if (err == ESP_OK) {
+            CHECK(base == NEW_BASE);
+            break;
+        }
+    }
+    CHECK(oldCount > 0);
+    CHECK(newCount > 0);
+}
+
+TEST_CASE("nvs transaction is completed if power is lost while it is recovered", "[nvs][transaction]")
+{
+    const uint32_t SECTORS = 5;
+    const uint32_t NEW_BASE = 100;
+
+    // find out how many flash operations the commit takes
+    size_t commitOps;
+    {
+        SpiFlashEmulator emu(SECTORS);
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, SECTORS));
+        nvs_handle_t handle;
+        TEST_ESP_OK(nvs_open("ns", NVS_READWRITE, &handle));
+        writeTransactionTestData(handle, 0, false);
+        writeTransactionTestData(handle, NEW_BASE, true);
+        emu.clearStats();
+        TEST_ESP_OK(nvs_commit(handle));
+        commitOps = emu.getWriteBytes() / 4 + emu.getEraseOps();
+        nvs_close(handle);
+        TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+    }
+
+    // lose power in the second half of the commit, when the log is complete, and again during recovery
+    for (size_t commitDelay = commitOps / 2; commitDelay < commitOps; commitDelay += 7) {
+        for (uint32_t recoverDelay = 0; ; recoverDelay += 3) {
+            INFO(commitDelay << " " << recoverDelay);
+            SpiFlashEmulator emu(SECTORS);
+            TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, SECTORS));
+            nvs_handle_t handle;
+            TEST_ESP_OK(nvs_open("ns", NVS_READWRITE, &handle));
+            writeTransactionTestData(handle, 0, false);
+            writeTransactionTestData(handle, NEW_BASE, true);
+            emu.failAfter(commitDelay, true);
+            nvs_commit(handle);
+            nvs_close(handle);
+
+            emu.clearStats();
+            emu.failAfter(recoverDelay, true);
+            nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, SECTORS);
+            const bool recoveryDone = emu.getWriteBytes() / 4 + emu.getEraseOps() < recoverDelay;
+            emu.failAfter(UINT32_MAX);
+
+            TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, SECTORS));
+            TEST_ESP_OK(nvs_open("ns", NVS_READWRITE, &handle));
+            int64_t base = readTransactionTestData(handle);
+            nvs_close(handle);
+            TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+            REQUIRE(base != -1);
+            if (recoveryDone) {
+                break;
+            }
+        }
+    }
+}
+
+TEST_CASE("nvs transaction log is not listed with the entries of all namespaces", "[nvs][transaction]")
+{
+    SpiFlashEmulator emu(5);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 5));
+    nvs_handle_t handle, log;
+    TEST_ESP_OK(nvs_open("ns", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_set_u32(handle, "a", 1));
+    // a log left by an interrupted commit
+    TEST_ESP_OK(nvs_open("nvs.txn", NVS_READWRITE, &log));
+    const uint8_t blob[] = { 1, 2, 3, 4, 5 };
+    TEST_ESP_OK(nvs_set_blob(log, "log", blob, sizeof(blob)));
+
+    size_t count = 0;
+    nvs_iterator_t it = nvs_entry_find(NVS_DEFAULT_PART_NAME, NULL, NVS_TYPE_ANY);
+    for (; it != NULL; it = nvs_entry_next(it)) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        CHECK(strcmp(info.namespace_name, "ns") == 0);
+        ++count;
+    }
+    CHECK(count == 1);
+
+    // unless asked for
+    it = nvs_entry_find(NVS_DEFAULT_PART_NAME, "nvs.txn", NVS_TYPE_ANY);
+    CHECK(it != NULL);
+    nvs_release_iterator(it);
+
+    nvs_close(log);
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+TEST_CASE("nvs transaction log with a corrupt data size is rejected", "[nvs][transaction]")
+{
+    class TestTransaction : public Transaction
+    {
+    public:
+        using Transaction::addOp;
+    };
+
+    TestTransaction txn;
+    const uint32_t value = 1;
+    TEST_ESP_OK(txn.addOp(ItemType::U32, "a", &value, sizeof(value)));
+    TEST_ESP_OK(txn.addOp(ItemType::U32, "b", &value, sizeof(value)));
+    size_t logSize = txn.getLogSize();
+    vector<uint8_t> log(logSize);
+    txn.writeLog(1, log.data());
+
+    Transaction read;
+    uint8_t nsIndex;
+    TEST_ESP_OK(read.readLog(log.data(), logSize, nsIndex));
+    CHECK(nsIndex == 1);
+    CHECK(read.size() == 2);
+
+    // data size of the first record, which must not wrap around when aligned
+    const size_t DATA_SIZE_OFFSET = 8 + 4;
+    for (uint32_t dataSize : { 0xffffffffu, 0xfffffffdu, static_cast<uint32_t>(logSize) }) {
+        INFO(dataSize);
+        memcpy(&log[DATA_SIZE_OFFSET], &dataSize, sizeof(dataSize));
+        TEST_ESP_ERR(read.readLog(log.data(), logSize, nsIndex), ESP_ERR_NVS_INVALID_LENGTH);
+        CHECK(read.empty());
+    }
+}
+
+/* Hidden benchmark, compares committing a batch of keys in a transaction with writing them one by one */
+TEST_CASE("nvs transaction write speed", "[nvs][transaction][benchmark][.]")
+{
+    const uint32_t SECTORS = 16;
+    const int batchSizes[] = { 2, 4, 6, 8, 10, 16, 64 };
+    const int ROUNDS = 20;
+    char key[16];
+
+    for (int batchSize : batchSizes) {
+        for (bool useTransaction : { false, true }) {
+            SpiFlashEmulator emu(SECTORS);
+            TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, SECTORS));
+            nvs_handle_t handle;
+            TEST_ESP_OK(nvs_open("ns", NVS_READWRITE, &handle));
+            emu.clearStats();
+
+            auto start = chrono::steady_clock::now();
+            for (int round = 0; round < ROUNDS; ++round) {
+                if (useTransaction) {
+                    REQUIRE(nvs_transaction_begin(handle) == ESP_OK);
+                }
+                for (int i = 0; i < batchSize; ++i) {
+                    snprintf(key, sizeof(key), "key%d", i);
+                    REQUIRE(nvs_set_u32(handle, key, round * batchSize + i) == ESP_OK);
+                }
+                REQUIRE(nvs_commit(handle) == ESP_OK);
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            const int keys = ROUNDS * batchSize;
+
+            printf("%2d keys per commit, %-12s %7.0f keys/s, %6.1f flash writes/key, %8.1f us flash time/key\n",
+                   batchSize, useTransaction ? "transaction:" : "one by one:",
+                   keys / seconds, static_cast<double>(emu.getWriteOps()) / keys,
+                   static_cast<double>(emu.getTotalTime()) / keys);
+            nvs_close(handle);
+            TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+        }
+    }
+}
@@ -9,7 +9,7 @@
 extern "C" {
 #endif
 
-#define strlcpy(a, b, c)
+#define strlcpy(a, b, c)       snprintf((a), (c), "%s", (b))
 #define strlcat(a, b, c)
 
 #define heap_caps_malloc(a, b)  NULL
@@ -1,12 +1,13 @@
 #pragma once
 
+#include <stdint.h>
 #include <time.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-typedef int _lock_t;
+typedef intptr_t _lock_t;
 
 void _lock_acquire(_lock_t *lock);
 void _lock_close(_lock_t *lock);
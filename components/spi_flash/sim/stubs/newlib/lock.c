@@ -1,21 +1,51 @@
+#include <stdlib.h>
+#include <pthread.h>
 #include "sys/lock.h"
 
+/* Locks are pthread mutexes, so that host tests can use several threads.
+ * Like on the target, a zero-initialized static lock is created on first use.
+ */
+static pthread_mutex_t s_lock_init_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t* lock_get(_lock_t *lock)
+{
+    pthread_mutex_lock(&s_lock_init_mutex);
+    if (*lock == 0) {
+        pthread_mutex_t* mutex = malloc(sizeof(pthread_mutex_t));
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+        *lock = (_lock_t) mutex;
+    }
+    pthread_mutex_unlock(&s_lock_init_mutex);
+    return (pthread_mutex_t*) *lock;
+}
+
 void _lock_acquire(_lock_t *lock)
 {
-    return;
+    pthread_mutex_lock(lock_get(lock));
 }
 
 void _lock_close(_lock_t *lock)
 {
-    return;
+    pthread_mutex_lock(&s_lock_init_mutex);
+    if (*lock != 0) {
+        pthread_mutex_destroy((pthread_mutex_t*) *lock);
+        free((pthread_mutex_t*) *lock);
+        *lock = 0;
+    }
+    pthread_mutex_unlock(&s_lock_init_mutex);
 }
 
 void _lock_init(_lock_t *lock)
 {
-    return;
+    *lock = 0;
+    lock_get(lock);
 }
 
 void _lock_release(_lock_t *lock)
 {
-    return;
+    pthread_mutex_unlock((pthread_mutex_t*) *lock);
 }
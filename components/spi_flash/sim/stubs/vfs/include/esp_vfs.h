@@ -1,6 +1,37 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "esp_err.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define ESP_VFS_FLAG_CONTEXT_PTR    1
 #define ESP_VFS_PATH_MAX            15
+
+/* Only the functions with context pointer which file system drivers of the host tests provide */
+typedef struct
+{
+    int flags;
+    ssize_t (*write_p)(void* p, int fd, const void * data, size_t size);
+    off_t (*lseek_p)(void* p, int fd, off_t size, int mode);
+    ssize_t (*read_p)(void* ctx, int fd, void * dst, size_t size);
+    ssize_t (*pread_p)(void *ctx, int fd, void * dst, size_t size, off_t offset);
+    ssize_t (*pwrite_p)(void *ctx, int fd, const void *src, size_t size, off_t offset);
+    int (*open_p)(void* ctx, const char * path, int flags, int mode);
+    int (*close_p)(void* ctx, int fd);
+    int (*fstat_p)(void* ctx, int fd, struct stat * st);
+    int (*fsync_p)(void* ctx, int fd);
+} esp_vfs_t;
+
+/* Provided by the test */
+esp_err_t esp_vfs_register(const char* base_path, const esp_vfs_t* vfs, void* ctx);
+esp_err_t esp_vfs_unregister(const char* base_path);
+
+#ifdef __cplusplus
+}
+#endif
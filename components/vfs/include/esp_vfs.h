@@ -76,6 +76,50 @@ typedef struct
     void *sem;              /*!< semaphore instance */
 } esp_vfs_select_sem_t;
 
+/**
+ * Events of a file descriptor watched by esp_vfs_epoll_wait()
+ */
+#define ESP_VFS_EPOLLIN     (1U << 0)   /*!< Data can be read */
+#define ESP_VFS_EPOLLOUT    (1U << 2)   /*!< Data can be written */
+#define ESP_VFS_EPOLLERR    (1U << 3)   /*!< Error condition; it is reported even if not requested */
+#define ESP_VFS_EPOLLET     (1U << 31)  /*!< Report the events once when they occur instead of while they last */
+
+/**
+ * @brief Operations of esp_vfs_epoll_ctl()
+ */
+typedef enum {
+    ESP_VFS_EPOLL_CTL_ADD,  /*!< Add a file descriptor to the interest set */
+    ESP_VFS_EPOLL_CTL_MOD,  /*!< Change the events and data of a file descriptor in the interest set */
+    ESP_VFS_EPOLL_CTL_DEL,  /*!< Remove a file descriptor from the interest set */
+} esp_vfs_epoll_op_t;
+
+/**
+ * @brief User data which is reported with the events of a file descriptor
+ */
+typedef union {
+    void *ptr;              /*!< pointer */
+    int fd;                 /*!< file descriptor */
+    uint32_t u32;           /*!< number */
+} esp_vfs_epoll_data_t;
+
+/**
+ * @brief Events and user data of a file descriptor in an interest set
+ */
+typedef struct {
+    uint32_t events;            /*!< ESP_VFS_EPOLLIN, ESP_VFS_EPOLLOUT, ESP_VFS_EPOLLERR or ESP_VFS_EPOLLET */
+    esp_vfs_epoll_data_t data;  /*!< user data */
+} esp_vfs_epoll_event_t;
+
+/**
+ * @brief Handle of an interest set created by esp_vfs_epoll_create()
+ */
+typedef struct esp_vfs_epoll_ *esp_vfs_epoll_handle_t;
+
+/**
+ * @brief Watch of a file descriptor, passed to the VFS driver by epoll_add
+ */
+typedef struct esp_vfs_epoll_watch_ esp_vfs_epoll_watch_t;
+
 /**
  * @brief VFS definition structure
  *
@@ -251,6 +295,12 @@ typedef struct
     void* (*get_socket_select_semaphore)(void);
     /** get_socket_select_semaphore returns semaphore allocated in the socket driver; set only for the socket driver */
     esp_err_t (*end_select)(void *end_select_args);
+    /** epoll_add is called when a FD of this VFS is added to the first interest set; the driver reports the events of the FD by esp_vfs_epoll_notify() until epoll_del is called */
+    esp_err_t (*epoll_add)(int fd, esp_vfs_epoll_watch_t *watch);
+    /** epoll_del is called when the FD is removed from the last interest set; the driver must not use the watch after it returns */
+    esp_err_t (*epoll_del)(int fd, esp_vfs_epoll_watch_t *watch);
+    /** epoll_poll returns the events which are ready on the FD at the moment; if it is not set, the events are reported only as they are notified */
+    uint32_t (*epoll_poll)(int fd);
 #endif // CONFIG_VFS_SUPPORT_SELECT
 } esp_vfs_t;
 
@@ -411,6 +461,97 @@ void esp_vfs_select_triggered(esp_vfs_select_sem_t sem);
  */
 void esp_vfs_select_triggered_isr(esp_vfs_select_sem_t sem, BaseType_t *woken);
 
+/**
+ * @brief Create an interest set for esp_vfs_epoll_wait()
+ *
+ * Unlike esp_vfs_select(), which hands all file descriptors over to the VFS
+ * drivers again on every call, the file descriptors are registered in the
+ * interest set once. The drivers which implement epoll_add notify the set
+ * about the events of the registered file descriptors as they occur, so
+ * esp_vfs_epoll_wait() only looks at the file descriptors which are ready.
+ * Socket file descriptors are watched by one socket_select call per
+ * esp_vfs_epoll_wait() call.
+ *
+ * @param ep  Here will be written the handle of the new interest set.
+ *
+ * @return  ESP_OK if successful, ESP_ERR_INVALID_ARG if ep is NULL,
+ *          ESP_ERR_NO_MEM if out of memory.
+ */
+esp_err_t esp_vfs_epoll_create(esp_vfs_epoll_handle_t *ep);
+
+/**
+ * @brief Delete an interest set
+ *
+ * All file descriptors are removed from the set. No task may wait on the set.
+ *
+ * @param ep  Handle of the interest set.
+ *
+ * @return  ESP_OK if successful, ESP_ERR_INVALID_ARG if ep is NULL.
+ */
+esp_err_t esp_vfs_epoll_delete(esp_vfs_epoll_handle_t ep);
+
+/**
+ * @brief Add, change or remove a file descriptor in an interest set
+ *
+ * A file descriptor must be removed from all interest sets before it is closed.
+ *
+ * @param ep     Handle of the interest set.
+ * @param op     Operation to be done.
+ * @param fd     File descriptor.
+ * @param event  Events which should be reported for fd, and the user data to
+ *               report them with. Not used by ESP_VFS_EPOLL_CTL_DEL.
+ *               ESP_VFS_EPOLLET has no effect on socket file descriptors.
+ *
+ * @return  ESP_OK if successful,
+ *          ESP_ERR_INVALID_ARG if the arguments are incorrect,
+ *          ESP_ERR_INVALID_STATE if fd is already in the set (ESP_VFS_EPOLL_CTL_ADD)
+ *          or is not in the set (ESP_VFS_EPOLL_CTL_MOD, ESP_VFS_EPOLL_CTL_DEL),
+ *          ESP_ERR_NOT_SUPPORTED if the VFS driver of fd supports neither
+ *          epoll_add nor socket_select,
+ *          ESP_ERR_NO_MEM if out of memory,
+ *          or the error returned by epoll_add of the VFS driver.
+ */
+esp_err_t esp_vfs_epoll_ctl(esp_vfs_epoll_handle_t ep, esp_vfs_epoll_op_t op, int fd, const esp_vfs_epoll_event_t *event);
+
+/**
+ * @brief Wait for events of the file descriptors in an interest set
+ *
+ * Only one task may wait on an interest set at a time.
+ *
+ * @param ep          Handle of the interest set.
+ * @param events      Array where the events are written, together with the
+ *                    user data of their file descriptors.
+ * @param maxevents   Number of items of the events array. If more file
+ *                    descriptors are ready, the rest is reported by the next
+ *                    call.
+ * @param timeout_ms  Time to wait for an event in milliseconds, 0 to return
+ *                    immediately, or -1 to wait without a time-out.
+ *
+ * @return      The number of items written to events, 0 on time-out, or -1
+ *              when an error (specified by errno) has occurred.
+ */
+int esp_vfs_epoll_wait(esp_vfs_epoll_handle_t ep, esp_vfs_epoll_event_t *events, int maxevents, int timeout_ms);
+
+/**
+ * @brief Notification from a VFS driver about events of a watched file descriptor
+ *
+ * This function is called by a VFS driver when the events occur on a file
+ * descriptor which it was asked to watch by epoll_add.
+ *
+ * @param watch   watch which was passed to the driver by the epoll_add call
+ * @param events  ESP_VFS_EPOLLIN, ESP_VFS_EPOLLOUT or ESP_VFS_EPOLLERR
+ */
+void esp_vfs_epoll_notify(esp_vfs_epoll_watch_t *watch, uint32_t events);
+
+/**
+ * @brief Notification from a VFS driver about events of a watched file descriptor (ISR version)
+ *
+ * @param watch   watch which was passed to the driver by the epoll_add call
+ * @param events  ESP_VFS_EPOLLIN, ESP_VFS_EPOLLOUT or ESP_VFS_EPOLLERR
+ * @param woken   is set to pdTRUE if the function wakes up a task with higher priority
+ */
+void esp_vfs_epoll_notify_isr(esp_vfs_epoll_watch_t *watch, uint32_t events, BaseType_t *woken);
+
 /**
  *
  * @brief Implements the VFS layer of POSIX pread()
@@ -266,3 +266,54 @@ TEST_CASE("Open & write & close through VFS passes performance test", "[vfs]")
 #endif
 
 }
+
+TEST_CASE("Open & close through VFS with many registered paths", "[vfs]")
+{
+    esp_vfs_t desc = {
+        .flags = ESP_VFS_FLAG_DEFAULT,
+        .open = time_test_vfs_open,
+        .close = time_test_vfs_close,
+    };
+
+    // Up to 32 entries, as far as CONFIG_VFS_MAX_COUNT allows besides the VFS registered already
+    char prefixes[32][8];
+    int registered = 0;
+    int ns_per_iter_min_count = 0;
+    int ns_per_iter = 0;
+    const int iter_count = 5000;
+
+    for (int count = 2; count <= 32; count *= 2) {
+        for (; registered < count; ++registered) {
+            snprintf(prefixes[registered], sizeof(prefixes[0]), "/vfs%d", registered);
+            if (esp_vfs_register(prefixes[registered], &desc, NULL) != ESP_OK) {
+                break;
+            }
+        }
+        if (registered < count) {
+            printf("No more than %d VFS paths can be registered, see CONFIG_VFS_MAX_COUNT\n", registered);
+            break;
+        }
+
+        ccomp_timer_start();
+        for (int i = 0; i < iter_count; ++i) {
+            const int fd = open("/vfs1" FILE1, 0, 0);
+            TEST_ASSERT_NOT_EQUAL(fd, -1);
+            TEST_ASSERT_NOT_EQUAL(close(fd), -1);
+        }
+        ns_per_iter = (int) (ccomp_timer_stop() * 1000 / iter_count);
+        if (count == 2) {
+            ns_per_iter_min_count = ns_per_iter;
+        }
+
+        char item[32];
+        snprintf(item, sizeof(item), "vfs_open_close_%d_paths", count);
+        IDF_LOG_PERFORMANCE(item, "%dns", ns_per_iter);
+    }
+
+    for (int i = 0; i < registered; ++i) {
+        TEST_ESP_OK( esp_vfs_unregister(prefixes[i]) );
+    }
+
+    // Finding the VFS for the path doesn't take time in proportion to the number of paths
+    TEST_ASSERT_LESS_THAN(ns_per_iter_min_count * 2, ns_per_iter);
+}
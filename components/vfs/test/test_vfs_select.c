@@ -13,16 +13,19 @@
 // limitations under the License.
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/fcntl.h>
 #include <sys/param.h>
 #include "unity.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "soc/uart_struct.h"
 #include "driver/uart.h"
 #include "esp_vfs.h"
 #include "esp_vfs_dev.h"
 #include "esp_vfs_fat.h"
+#include "esp_timer.h"
 #include "lwip/sockets.h"
 #include "lwip/netdb.h"
 #include "test_utils.h"
@@ -613,3 +616,358 @@ TEST_CASE("select() works with concurrent mount", "[vfs][fatfs]")
     deinit(uart_fd, socket_fd);
     close(dummy_socket_fd);
 }
+
+TEST_CASE("UART and socket can do esp_vfs_epoll_wait()", "[vfs]")
+{
+    int uart_fd;
+    int socket_fd;
+    char recv_message[sizeof(message)];
+    esp_vfs_epoll_event_t ready[2];
+
+    init(&uart_fd, &socket_fd);
+
+    esp_vfs_epoll_handle_t ep;
+    TEST_ESP_OK(esp_vfs_epoll_create(&ep));
+
+    esp_vfs_epoll_event_t event = {
+        .events = ESP_VFS_EPOLLIN,
+        .data.fd = uart_fd,
+    };
+    TEST_ESP_OK(esp_vfs_epoll_ctl(ep, ESP_VFS_EPOLL_CTL_ADD, uart_fd, &event));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_vfs_epoll_ctl(ep, ESP_VFS_EPOLL_CTL_ADD, uart_fd, &event));
+    event.data.fd = socket_fd;
+    TEST_ESP_OK(esp_vfs_epoll_ctl(ep, ESP_VFS_EPOLL_CTL_ADD, socket_fd, &event));
+
+    TEST_ASSERT_EQUAL(0, esp_vfs_epoll_wait(ep, ready, 2, 0));
+
+    const test_task_param_t test_task_param = {
+        .fd = uart_fd,
+        .delay_ms = 50,
+        .sem = xSemaphoreCreateBinary(),
+    };
+    TEST_ASSERT_NOT_NULL(test_task_param.sem);
+    start_task(&test_task_param);
+
+    int s = esp_vfs_epoll_wait(ep, ready, 2, 100);
+    TEST_ASSERT_EQUAL(1, s);
+    TEST_ASSERT_EQUAL(uart_fd, ready[0].data.fd);
+    TEST_ASSERT_EQUAL(ESP_VFS_EPOLLIN, ready[0].events);
+    TEST_ASSERT_EQUAL(xSemaphoreTake(test_task_param.sem, 1000 / portTICK_PERIOD_MS), pdTRUE);
+
+    // reported again while the data is not read
+    TEST_ASSERT_EQUAL(1, esp_vfs_epoll_wait(ep, ready, 2, 0));
+    TEST_ASSERT_EQUAL(uart_fd, ready[0].data.fd);
+
+    int read_bytes = read(uart_fd, recv_message, sizeof(message));
+    TEST_ASSERT_EQUAL(read_bytes, sizeof(message));
+    TEST_ASSERT_EQUAL_MEMORY(message, recv_message, sizeof(message));
+    TEST_ASSERT_EQUAL(0, esp_vfs_epoll_wait(ep, ready, 2, 0));
+
+    const test_task_param_t socket_task_param = {
+        .fd = socket_fd,
+        .delay_ms = 50,
+        .sem = test_task_param.sem,
+    };
+    start_task(&socket_task_param);
+
+    s = esp_vfs_epoll_wait(ep, ready, 2, 100);
+    TEST_ASSERT_EQUAL(1, s);
+    TEST_ASSERT_EQUAL(socket_fd, ready[0].data.fd);
+    TEST_ASSERT_EQUAL(ESP_VFS_EPOLLIN, ready[0].events);
+
+    read_bytes = read(socket_fd, recv_message, sizeof(message));
+    TEST_ASSERT_EQUAL(read_bytes, sizeof(message));
+    TEST_ASSERT_EQUAL_MEMORY(message, recv_message, sizeof(message));
+    TEST_ASSERT_EQUAL(xSemaphoreTake(test_task_param.sem, 1000 / portTICK_PERIOD_MS), pdTRUE);
+
+    // edge-triggered events are reported once
+    event.events = ESP_VFS_EPOLLIN | ESP_VFS_EPOLLET;
+    event.data.fd = uart_fd;
+    TEST_ESP_OK(esp_vfs_epoll_ctl(ep, ESP_VFS_EPOLL_CTL_MOD, uart_fd, &event));
+    start_task(&test_task_param);
+
+    s = esp_vfs_epoll_wait(ep, ready, 2, 100);
+    TEST_ASSERT_EQUAL(1, s);
+    TEST_ASSERT_EQUAL(uart_fd, ready[0].data.fd);
+    TEST_ASSERT_EQUAL(xSemaphoreTake(test_task_param.sem, 1000 / portTICK_PERIOD_MS), pdTRUE);
+    TEST_ASSERT_EQUAL(0, esp_vfs_epoll_wait(ep, ready, 2, 0));
+
+    read_bytes = read(uart_fd, recv_message, sizeof(message));
+    TEST_ASSERT_EQUAL(read_bytes, sizeof(message));
+    TEST_ASSERT_EQUAL_MEMORY(message, recv_message, sizeof(message));
+
+    TEST_ESP_OK(esp_vfs_epoll_ctl(ep, ESP_VFS_EPOLL_CTL_DEL, uart_fd, NULL));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_vfs_epoll_ctl(ep, ESP_VFS_EPOLL_CTL_DEL, uart_fd, NULL));
+    TEST_ESP_OK(esp_vfs_epoll_ctl(ep, ESP_VFS_EPOLL_CTL_DEL, socket_fd, NULL));
+    TEST_ESP_OK(esp_vfs_epoll_delete(ep));
+    vSemaphoreDelete(test_task_param.sem);
+
+    deinit(uart_fd, socket_fd);
+}
+
+TEST_CASE("UART can wait for EPOLLOUT with esp_vfs_epoll_wait()", "[vfs]")
+{
+    int uart_fd;
+    int socket_fd;
+    char recv_message[sizeof(message)];
+    esp_vfs_epoll_event_t ready[2];
+
+    init(&uart_fd, &socket_fd);
+
+    esp_vfs_epoll_handle_t ep;
+    TEST_ESP_OK(esp_vfs_epoll_create(&ep));
+
+    // the TX buffer is empty, so the UART is writable, and stays so
+    esp_vfs_epoll_event_t event = {
+        .events = ESP_VFS_EPOLLOUT,
+        .data.fd = uart_fd,
+    };
+    TEST_ESP_OK(esp_vfs_epoll_ctl(ep, ESP_VFS_EPOLL_CTL_ADD, uart_fd, &event));
+    event.events = ESP_VFS_EPOLLIN;
+    event.data.fd = socket_fd;
+    TEST_ESP_OK(esp_vfs_epoll_ctl(ep, ESP_VFS_EPOLL_CTL_ADD, socket_fd, &event));
+
+    TEST_ASSERT_EQUAL(1, esp_vfs_epoll_wait(ep, ready, 2, 0));
+    TEST_ASSERT_EQUAL(uart_fd, ready[0].data.fd);
+    TEST_ASSERT_EQUAL(ESP_VFS_EPOLLOUT, ready[0].events);
+    TEST_ASSERT_EQUAL(1, esp_vfs_epoll_wait(ep, ready, 2, 0));
+
+    // edge-triggered: reported once, then again when the driver has sent data
+    event.events = ESP_VFS_EPOLLOUT | ESP_VFS_EPOLLET;
+    event.data.fd = uart_fd;
+    TEST_ESP_OK(esp_vfs_epoll_ctl(ep, ESP_VFS_EPOLL_CTL_MOD, uart_fd, &event));
+    TEST_ASSERT_EQUAL(1, esp_vfs_epoll_wait(ep, ready, 2, 0));
+    TEST_ASSERT_EQUAL(0, esp_vfs_epoll_wait(ep, ready, 2, 0));
+
+    const test_task_param_t test_task_param = {
+        .fd = uart_fd,
+        .delay_ms = 50,
+        .sem = xSemaphoreCreateBinary(),
+    };
+    TEST_ASSERT_NOT_NULL(test_task_param.sem);
+    start_task(&test_task_param);
+
+    int s = esp_vfs_epoll_wait(ep, ready, 2, 100);
+    TEST_ASSERT_EQUAL(1, s);
+    TEST_ASSERT_EQUAL(uart_fd, ready[0].data.fd);
+    TEST_ASSERT_EQUAL(ESP_VFS_EPOLLOUT, ready[0].events);
+    TEST_ASSERT_EQUAL(xSemaphoreTake(test_task_param.sem, 1000 / portTICK_PERIOD_MS), pdTRUE);
+
+    // the message comes back through the loop-back
+    int read_bytes = read(uart_fd, recv_message, sizeof(message));
+    TEST_ASSERT_EQUAL(read_bytes, sizeof(message));
+    TEST_ASSERT_EQUAL_MEMORY(message, recv_message, sizeof(message));
+
+    TEST_ESP_OK(esp_vfs_epoll_ctl(ep, ESP_VFS_EPOLL_CTL_DEL, uart_fd, NULL));
+    TEST_ESP_OK(esp_vfs_epoll_ctl(ep, ESP_VFS_EPOLL_CTL_DEL, socket_fd, NULL));
+    TEST_ESP_OK(esp_vfs_epoll_delete(ep));
+    vSemaphoreDelete(test_task_param.sem);
+
+    deinit(uart_fd, socket_fd);
+}
+
+/* Driver of FDs which become readable by notify_latency_test_fd(), for measuring how long select() and
+ * esp_vfs_epoll_wait() take from the notification until the FD is read */
+
+#define LATENCY_TEST_MAX_FDS    48
+
+static struct {
+    int fd_count;
+    bool readable[LATENCY_TEST_MAX_FDS];
+    esp_vfs_epoll_watch_t *watches[LATENCY_TEST_MAX_FDS];
+    esp_vfs_select_sem_t select_sem;
+    fd_set *readfds;
+    fd_set readfds_orig;
+    volatile int64_t notified_at;
+} s_latency_test;
+static portMUX_TYPE s_latency_test_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static int latency_test_open(const char *path, int flags, int mode)
+{
+    return s_latency_test.fd_count < LATENCY_TEST_MAX_FDS ? s_latency_test.fd_count++ : -1;
+}
+
+static int latency_test_close(int fd)
+{
+    return 0;
+}
+
+static ssize_t latency_test_read(int fd, void *dst, size_t size)
+{
+    portENTER_CRITICAL(&s_latency_test_lock);
+    s_latency_test.readable[fd] = false;
+    portEXIT_CRITICAL(&s_latency_test_lock);
+    return 0;
+}
+
+static esp_err_t latency_test_start_select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+        esp_vfs_select_sem_t select_sem, void **end_select_args)
+{
+    portENTER_CRITICAL(&s_latency_test_lock);
+    s_latency_test.select_sem = select_sem;
+    s_latency_test.readfds = readfds;
+    s_latency_test.readfds_orig = *readfds;
+    FD_ZERO(readfds);
+    FD_ZERO(writefds);
+    FD_ZERO(exceptfds);
+    portEXIT_CRITICAL(&s_latency_test_lock);
+    return ESP_OK;
+}
+
+static esp_err_t latency_test_end_select(void *end_select_args)
+{
+    portENTER_CRITICAL(&s_latency_test_lock);
+    s_latency_test.readfds = NULL;
+    portEXIT_CRITICAL(&s_latency_test_lock);
+    return ESP_OK;
+}
+
+static esp_err_t latency_test_epoll_add(int fd, esp_vfs_epoll_watch_t *watch)
+{
+    s_latency_test.watches[fd] = watch;
+    return ESP_OK;
+}
+
+static esp_err_t latency_test_epoll_del(int fd, esp_vfs_epoll_watch_t *watch)
+{
+    s_latency_test.watches[fd] = NULL;
+    return ESP_OK;
+}
+
+static uint32_t latency_test_epoll_poll(int fd)
+{
+    return s_latency_test.readable[fd] ? ESP_VFS_EPOLLIN : 0;
+}
+
+static void notify_latency_test_fd(int fd)
+{
+    s_latency_test.notified_at = esp_timer_get_time();
+    portENTER_CRITICAL(&s_latency_test_lock);
+    s_latency_test.readable[fd] = true;
+    if (s_latency_test.readfds && FD_ISSET(fd, &s_latency_test.readfds_orig)) {
+        FD_SET(fd, s_latency_test.readfds);
+        esp_vfs_select_triggered(s_latency_test.select_sem);
+    }
+    portEXIT_CRITICAL(&s_latency_test_lock);
+    if (s_latency_test.watches[fd]) {
+        esp_vfs_epoll_notify(s_latency_test.watches[fd], ESP_VFS_EPOLLIN);
+    }
+}
+
+// Runs when the waiting task has dispatched the previous notification and waits again
+static void latency_test_notify_task(void *param)
+{
+    const int fd_count = *(const int *) param;
+    for (int i = 0; ; ++i) {
+        notify_latency_test_fd(i % fd_count);
+    }
+}
+
+TEST_CASE("esp_vfs_epoll_wait() and select() latency with many FDs", "[vfs]")
+{
+    const esp_vfs_t desc = {
+        .flags = ESP_VFS_FLAG_DEFAULT,
+        .open = latency_test_open,
+        .close = latency_test_close,
+        .read = latency_test_read,
+        .start_select = latency_test_start_select,
+        .end_select = latency_test_end_select,
+        .epoll_add = latency_test_epoll_add,
+        .epoll_del = latency_test_epoll_del,
+        .epoll_poll = latency_test_epoll_poll,
+    };
+    memset(&s_latency_test, 0, sizeof(s_latency_test));
+    TEST_ESP_OK(esp_vfs_register("/latency", &desc, NULL));
+
+    const int iter_count = 1000;
+    const int fd_counts[] = { 8, 32, LATENCY_TEST_MAX_FDS };
+    int fds[LATENCY_TEST_MAX_FDS];
+    int opened = 0;
+    int epoll_us_min_count = 0;
+    int epoll_us = 0;
+
+    for (int c = 0; c < sizeof(fd_counts) / sizeof(fd_counts[0]); ++c) {
+        const int fd_count = fd_counts[c];
+        for (; opened < fd_count; ++opened) {
+            if ((fds[opened] = open("/latency/fd", O_RDONLY)) < 0) {
+                break;
+            }
+        }
+        if (opened < fd_count) {
+            printf("No more than %d FDs can be opened besides the FDs open already\n", opened);
+            break;
+        }
+        int nfds = 0;
+        for (int i = 0; i < fd_count; ++i) {
+            nfds = MAX(nfds, fds[i] + 1);
+        }
+
+        esp_vfs_epoll_handle_t ep;
+        TEST_ESP_OK(esp_vfs_epoll_create(&ep));
+        for (int i = 0; i < fd_count; ++i) {
+            const esp_vfs_epoll_event_t event = {
+                .events = ESP_VFS_EPOLLIN,
+                .data.fd = fds[i],
+            };
+            TEST_ESP_OK(esp_vfs_epoll_ctl(ep, ESP_VFS_EPOLL_CTL_ADD, fds[i], &event));
+        }
+
+        // The notifying task runs on the same core with lower priority, i.e. only when this task waits
+        TaskHandle_t notify_task;
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreatePinnedToCore(latency_test_notify_task, "notify_task", 2048,
+                    (void *) &fd_count, uxTaskPriorityGet(NULL) - 1, &notify_task, xPortGetCoreID()));
+
+        int64_t select_total_us = 0;
+        struct timeval tv = {
+            .tv_sec = 1,
+            .tv_usec = 0,
+        };
+        for (int i = 0; i < iter_count; ++i) {
+            fd_set rfds;
+            FD_ZERO(&rfds);
+            for (int j = 0; j < fd_count; ++j) {
+                FD_SET(fds[j], &rfds);
+            }
+            TEST_ASSERT_EQUAL(1, select(nfds, &rfds, NULL, NULL, &tv));
+            for (int fd = 0; fd < nfds; ++fd) {
+                if (FD_ISSET(fd, &rfds)) {
+                    read(fd, NULL, 0);
+                }
+            }
+            select_total_us += esp_timer_get_time() - s_latency_test.notified_at;
+        }
+
+        int64_t epoll_total_us = 0;
+        for (int i = 0; i < iter_count; ++i) {
+            esp_vfs_epoll_event_t ready[8];
+            const int n = esp_vfs_epoll_wait(ep, ready, 8, 1000);
+            TEST_ASSERT_EQUAL(1, n);
+            read(ready[0].data.fd, NULL, 0);
+            epoll_total_us += esp_timer_get_time() - s_latency_test.notified_at;
+        }
+
+        vTaskDelete(notify_task);
+        TEST_ESP_OK(esp_vfs_epoll_delete(ep));
+        for (int i = 0; i < fd_count; ++i) {
+            read(fds[i], NULL, 0);
+        }
+
+        epoll_us = (int) (epoll_total_us / iter_count);
+        if (c == 0) {
+            epoll_us_min_count = epoll_us;
+        }
+        char item[40];
+        snprintf(item, sizeof(item), "vfs_select_latency_%d_fds", fd_count);
+        IDF_LOG_PERFORMANCE(item, "%dus", (int) (select_total_us / iter_count));
+        snprintf(item, sizeof(item), "vfs_epoll_latency_%d_fds", fd_count);
+        IDF_LOG_PERFORMANCE(item, "%dus", epoll_us);
+    }
+
+    for (int i = 0; i < opened; ++i) {
+        close(fds[i]);
+    }
+    TEST_ESP_OK(esp_vfs_unregister("/latency"));
+
+    // Only the ready FD is looked at, regardless of how many FDs are watched
+    TEST_ASSERT_LESS_THAN(epoll_us_min_count * 2 + 1, epoll_us);
+}
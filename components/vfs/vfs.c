@@ -23,6 +23,7 @@
 #include <sys/param.h>
 #include <dirent.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "esp_vfs.h"
 #include "sdkconfig.h"
@@ -34,7 +35,7 @@
 
 static const char *TAG = "vfs";
 
-#define VFS_MAX_COUNT   8   /* max number of VFS entries (registered filesystems) */
+#define VFS_MAX_COUNT   CONFIG_VFS_MAX_COUNT    /* max number of VFS entries (registered filesystems) */
 #define LEN_PATH_PREFIX_IGNORED SIZE_MAX /* special length value for VFS which is never recognised by open() */
 #define FD_TABLE_ENTRY_UNUSED   (fd_table_t) { .permanent = false, .vfs_index = -1, .local_fd = -1 }
 
@@ -69,9 +70,74 @@ typedef struct {
 static vfs_entry_t* s_vfs[VFS_MAX_COUNT] = { 0 };
 static size_t s_vfs_count = 0;
 
+// Entries with a path prefix, sorted by the prefix, and by offset if the prefixes are equal.
+// Used to find the VFS for a path without comparing it to every registered prefix.
+static vfs_entry_t* s_vfs_by_path[VFS_MAX_COUNT] = { 0 };
+static size_t s_vfs_by_path_count = 0;
+static size_t s_vfs_prefix_len_max = 0;
+
 static fd_table_t s_fd_table[MAX_FDS] = { [0 ... MAX_FDS-1] = FD_TABLE_ENTRY_UNUSED };
 static _lock_t s_fd_table_lock;
 
+// Compares the path prefix of the entry with the first len characters of path
+static int vfs_prefix_cmp(const vfs_entry_t* vfs, const char* path, size_t len)
+{
+    int cmp = memcmp(vfs->path_prefix, path, MIN(vfs->path_prefix_len, len));
+    if (cmp == 0) {
+        cmp = (vfs->path_prefix_len > len) - (vfs->path_prefix_len < len);
+    }
+    return cmp;
+}
+
+// Returns the position of the first entry in s_vfs_by_path with a prefix
+// not less than the first len characters of path
+static size_t vfs_path_index_find(const char* path, size_t len)
+{
+    size_t low = 0;
+    size_t high = s_vfs_by_path_count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (vfs_prefix_cmp(s_vfs_by_path[mid], path, len) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static void vfs_path_index_add(vfs_entry_t* entry)
+{
+    size_t pos = vfs_path_index_find(entry->path_prefix, entry->path_prefix_len);
+    // Of several entries with the same prefix, the one registered at the lowest offset is used
+    while (pos < s_vfs_by_path_count &&
+            vfs_prefix_cmp(s_vfs_by_path[pos], entry->path_prefix, entry->path_prefix_len) == 0 &&
+            s_vfs_by_path[pos]->offset < entry->offset) {
+        ++pos;
+    }
+    memmove(&s_vfs_by_path[pos + 1], &s_vfs_by_path[pos],
+            (s_vfs_by_path_count - pos) * sizeof(s_vfs_by_path[0]));
+    s_vfs_by_path[pos] = entry;
+    ++s_vfs_by_path_count;
+    s_vfs_prefix_len_max = MAX(s_vfs_prefix_len_max, entry->path_prefix_len);
+}
+
+static void vfs_path_index_remove(const vfs_entry_t* entry)
+{
+    for (size_t i = 0; i < s_vfs_by_path_count; ++i) {
+        if (s_vfs_by_path[i] == entry) {
+            --s_vfs_by_path_count;
+            memmove(&s_vfs_by_path[i], &s_vfs_by_path[i + 1],
+                    (s_vfs_by_path_count - i) * sizeof(s_vfs_by_path[0]));
+            break;
+        }
+    }
+    s_vfs_prefix_len_max = 0;
+    for (size_t i = 0; i < s_vfs_by_path_count; ++i) {
+        s_vfs_prefix_len_max = MAX(s_vfs_prefix_len_max, s_vfs_by_path[i]->path_prefix_len);
+    }
+}
+
 static esp_err_t esp_vfs_register_common(const char* base_path, size_t len, const esp_vfs_t* vfs, void* ctx, int *vfs_index)
 {
     if (len != LEN_PATH_PREFIX_IGNORED) {
@@ -109,6 +175,9 @@ static esp_err_t esp_vfs_register_common(const char* base_path, size_t len, cons
     entry->path_prefix_len = len;
     entry->ctx = ctx;
     entry->offset = index;
+    if (len != LEN_PATH_PREFIX_IGNORED) {
+        vfs_path_index_add(entry);
+    }
 
     if (vfs_index) {
         *vfs_index = index;
@@ -136,8 +205,8 @@ esp_err_t esp_vfs_register_fd_range(const esp_vfs_t *vfs, void *ctx, int min_fd,
         _lock_acquire(&s_fd_table_lock);
         for (int i = min_fd; i < max_fd; ++i) {
             if (s_fd_table[i].vfs_index != -1) {
-                free(s_vfs[i]);
-                s_vfs[i] = NULL;
+                free(s_vfs[index]);
+                s_vfs[index] = NULL;
                 for (int j = min_fd; j < i; ++j) {
                     if (s_fd_table[j].vfs_index == index) {
                         s_fd_table[j] = FD_TABLE_ENTRY_UNUSED;
@@ -172,27 +241,25 @@ esp_err_t esp_vfs_register_with_id(const esp_vfs_t *vfs, void *ctx, esp_vfs_id_t
 esp_err_t esp_vfs_unregister(const char* base_path)
 {
     const size_t base_path_len = strlen(base_path);
-    for (size_t i = 0; i < s_vfs_count; ++i) {
-        vfs_entry_t* vfs = s_vfs[i];
-        if (vfs == NULL) {
-            continue;
-        }
-        if (base_path_len == vfs->path_prefix_len &&
-                memcmp(base_path, vfs->path_prefix, vfs->path_prefix_len) == 0) {
-            free(vfs);
-            s_vfs[i] = NULL;
-
-            _lock_acquire(&s_fd_table_lock);
-            // Delete all references from the FD lookup-table
-            for (int j = 0; j < MAX_FDS; ++j) {
-                if (s_fd_table[j].vfs_index == i) {
-                    s_fd_table[j] = FD_TABLE_ENTRY_UNUSED;
-                }
-            }
-            _lock_release(&s_fd_table_lock);
+    const size_t pos = vfs_path_index_find(base_path, base_path_len);
+    if (pos < s_vfs_by_path_count &&
+            vfs_prefix_cmp(s_vfs_by_path[pos], base_path, base_path_len) == 0) {
+        vfs_entry_t* vfs = s_vfs_by_path[pos];
+        const int i = vfs->offset;
+        vfs_path_index_remove(vfs);
+        free(vfs);
+        s_vfs[i] = NULL;
 
-            return ESP_OK;
+        _lock_acquire(&s_fd_table_lock);
+        // Delete all references from the FD lookup-table
+        for (int j = 0; j < MAX_FDS; ++j) {
+            if (s_fd_table[j].vfs_index == i) {
+                s_fd_table[j] = FD_TABLE_ENTRY_UNUSED;
+            }
         }
+        _lock_release(&s_fd_table_lock);
+
+        return ESP_OK;
     }
     return ESP_ERR_INVALID_STATE;
 }
@@ -292,42 +359,23 @@ static const char* translate_path(const vfs_entry_t* vfs, const char* src_path)
 
 static const vfs_entry_t* get_vfs_for_path(const char* path)
 {
-    const vfs_entry_t* best_match = NULL;
-    ssize_t best_match_prefix_len = -1;
-    size_t len = strlen(path);
-    for (size_t i = 0; i < s_vfs_count; ++i) {
-        const vfs_entry_t* vfs = s_vfs[i];
-        if (!vfs || vfs->path_prefix_len == LEN_PATH_PREFIX_IGNORED) {
-            continue;
-        }
-        // match path prefix
-        if (len < vfs->path_prefix_len ||
-            memcmp(path, vfs->path_prefix, vfs->path_prefix_len) != 0) {
-            continue;
-        }
-        // this is the default VFS and we don't have a better match yet.
-        if (vfs->path_prefix_len == 0 && !best_match) {
-            best_match = vfs;
-            continue;
-        }
-        // if path is not equal to the prefix, expect to see a path separator
-        // i.e. don't match "/data" prefix for "/data1/foo.txt" path
-        if (len > vfs->path_prefix_len &&
-                path[vfs->path_prefix_len] != '/') {
-            continue;
+    // A prefix matches if the path is equal to it, or continues with a path separator,
+    // i.e. "/data" prefix does not match "/data1/foo.txt" path. Out of all matching
+    // prefixes the longest one is selected, i.e. if "/dev" and "/dev/uart" both match
+    // "/dev/uart/1" path, "/dev/uart" is chosen. So the beginnings of the path which
+    // could be a prefix are looked up in the sorted index, starting from the longest.
+    // The empty prefix of the default VFS matches any path.
+    for (size_t len = strnlen(path, s_vfs_prefix_len_max); ; --len) {
+        if (len == 0 || path[len] == '/' || path[len] == '\0') {
+            const size_t pos = vfs_path_index_find(path, len);
+            if (pos < s_vfs_by_path_count && vfs_prefix_cmp(s_vfs_by_path[pos], path, len) == 0) {
+                return s_vfs_by_path[pos];
+            }
         }
-        // Out of all matching path prefixes, select the longest one;
-        // i.e. if "/dev" and "/dev/uart" both match, for "/dev/uart/1" path,
-        // choose "/dev/uart",
-        // This causes all s_vfs_count VFS entries to be scanned when opening
-        // a file by name. This can be optimized by introducing a table for
-        // FS search order, sorted so that longer prefixes are checked first.
-        if (best_match_prefix_len < (ssize_t) vfs->path_prefix_len) {
-            best_match_prefix_len = (ssize_t) vfs->path_prefix_len;
-            best_match = vfs;
+        if (len == 0) {
+            return NULL;
         }
     }
-    return best_match;
 }
 
 /*
@@ -1066,6 +1114,603 @@ void esp_vfs_select_triggered_isr(esp_vfs_select_sem_t sem, BaseType_t *woken)
     }
 }
 
+
+typedef struct epoll_item_ {
+    struct esp_vfs_epoll_ *ep;          // interest set which the item belongs to
+    esp_vfs_epoll_watch_t *watch;       // watch of the FD, NULL for socket FDs
+    int fd;                             // global FD
+    uint32_t events;                    // requested events
+    uint32_t pending;                   // events notified by the driver and not reported yet
+    esp_vfs_epoll_data_t data;          // user data reported with the events
+    bool ready;                         // the item is in the ready list of the set
+    bool wake;                          // the set is to be signaled by a notification in progress
+    struct epoll_item_ *next_ready;     // next item in the ready list of the set
+    struct epoll_item_ *next_watched;   // next item of another set watching the same FD
+} epoll_item_t;
+
+struct esp_vfs_epoll_watch_ {
+    const vfs_entry_t *vfs;             // VFS of the watched FD
+    int local_fd;                       // FD within the VFS
+    epoll_item_t *items;                // items of all sets watching the FD
+};
+
+struct esp_vfs_epoll_ {
+    _lock_t lock;                       // serializes esp_vfs_epoll_ctl() and collecting the events
+    SemaphoreHandle_t sem;              // signalization used when no socket FD is in the set
+    esp_vfs_select_sem_t wake;          // signalization of the waiting task, sem is NULL if no task waits
+    int notifying;                      // notifications signaling the set, which keep it from being deleted
+    epoll_item_t *items[MAX_FDS];       // items indexed by the global FD
+    epoll_item_t *ready_head;           // items notified by the drivers, in the order of notification
+    epoll_item_t *ready_tail;
+    const vfs_entry_t *socket_vfs;      // VFS of the socket FDs in the set
+    int socket_count;                   // number of socket FDs in the set
+    int socket_nfds;                    // highest socket FD in the set plus one
+    fd_set socket_readfds;              // socket FDs in the set, as passed to socket_select
+    fd_set socket_writefds;
+    fd_set socket_errorfds;
+};
+
+// Watches of the FDs in any set, indexed by the global FD
+static esp_vfs_epoll_watch_t *s_epoll_watches[MAX_FDS] = { 0 };
+static _lock_t s_epoll_watch_lock;
+// Protects the ready lists, the items of the watches and the wake signalization of the sets.
+// These are accessed by the drivers, from ISRs as well.
+static portMUX_TYPE s_epoll_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+// s_epoll_spinlock must be held
+static void epoll_queue_ready(epoll_item_t *item)
+{
+    if (!item->ready) {
+        struct esp_vfs_epoll_ *ep = item->ep;
+        item->ready = true;
+        item->next_ready = NULL;
+        if (ep->ready_tail) {
+            ep->ready_tail->next_ready = item;
+        } else {
+            ep->ready_head = item;
+        }
+        ep->ready_tail = item;
+    }
+}
+
+// s_epoll_spinlock must be held
+static void epoll_unqueue_ready(epoll_item_t *item)
+{
+    if (item->ready) {
+        struct esp_vfs_epoll_ *ep = item->ep;
+        epoll_item_t *prev = NULL;
+        for (epoll_item_t *it = ep->ready_head; it; prev = it, it = it->next_ready) {
+            if (it == item) {
+                if (prev) {
+                    prev->next_ready = it->next_ready;
+                } else {
+                    ep->ready_head = it->next_ready;
+                }
+                if (ep->ready_tail == it) {
+                    ep->ready_tail = prev;
+                }
+                break;
+            }
+        }
+        item->ready = false;
+    }
+}
+
+static uint32_t epoll_poll_item(const epoll_item_t *item)
+{
+    const vfs_entry_t *vfs = item->watch->vfs;
+    return vfs->vfs.epoll_poll ? vfs->vfs.epoll_poll(item->watch->local_fd) : 0;
+}
+
+static esp_err_t epoll_watch_item(epoll_item_t *item, const vfs_entry_t *vfs, int local_fd)
+{
+    esp_err_t ret = ESP_OK;
+
+    _lock_acquire(&s_epoll_watch_lock);
+    esp_vfs_epoll_watch_t *watch = s_epoll_watches[item->fd];
+    if (watch == NULL) {
+        if ((watch = calloc(1, sizeof(esp_vfs_epoll_watch_t))) == NULL) {
+            ret = ESP_ERR_NO_MEM;
+        } else {
+            watch->vfs = vfs;
+            watch->local_fd = local_fd;
+            ret = vfs->vfs.epoll_add(local_fd, watch);
+            if (ret == ESP_OK) {
+                s_epoll_watches[item->fd] = watch;
+            } else {
+                free(watch);
+            }
+        }
+    }
+    if (ret == ESP_OK) {
+        item->watch = watch;
+        portENTER_CRITICAL(&s_epoll_spinlock);
+        item->next_watched = watch->items;
+        watch->items = item;
+        portEXIT_CRITICAL(&s_epoll_spinlock);
+    }
+    _lock_release(&s_epoll_watch_lock);
+
+    return ret;
+}
+
+static void epoll_unwatch_item(epoll_item_t *item)
+{
+    esp_vfs_epoll_watch_t *watch = item->watch;
+
+    _lock_acquire(&s_epoll_watch_lock);
+    portENTER_CRITICAL(&s_epoll_spinlock);
+    for (epoll_item_t **it = &watch->items; *it; it = &(*it)->next_watched) {
+        if (*it == item) {
+            *it = item->next_watched;
+            break;
+        }
+    }
+    epoll_unqueue_ready(item);
+    portEXIT_CRITICAL(&s_epoll_spinlock);
+
+    if (watch->items == NULL) {
+        esp_err_t err = watch->vfs->vfs.epoll_del(watch->local_fd, watch);
+        if (err != ESP_OK) {
+            ESP_LOGD(TAG, "epoll_del failed: %s", esp_err_to_name(err));
+        }
+        s_epoll_watches[item->fd] = NULL;
+        free(watch);
+    }
+    _lock_release(&s_epoll_watch_lock);
+}
+
+static void epoll_set_socket_fd(struct esp_vfs_epoll_ *ep, int fd, uint32_t events)
+{
+    FD_CLR(fd, &ep->socket_readfds);
+    FD_CLR(fd, &ep->socket_writefds);
+    FD_CLR(fd, &ep->socket_errorfds);
+    if (events & ESP_VFS_EPOLLIN) {
+        FD_SET(fd, &ep->socket_readfds);
+    }
+    if (events & ESP_VFS_EPOLLOUT) {
+        FD_SET(fd, &ep->socket_writefds);
+    }
+    FD_SET(fd, &ep->socket_errorfds);
+}
+
+static esp_err_t epoll_add_item(struct esp_vfs_epoll_ *ep, const vfs_entry_t *vfs, int fd, int local_fd,
+        const esp_vfs_epoll_event_t *event)
+{
+    if (ep->items[fd]) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (vfs->vfs.epoll_add == NULL) {
+        if (vfs->vfs.socket_select == NULL || (ep->socket_vfs && ep->socket_vfs != vfs)) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+    }
+
+    epoll_item_t *item = calloc(1, sizeof(epoll_item_t));
+    if (item == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    item->ep = ep;
+    item->fd = fd;
+    item->events = event->events | ESP_VFS_EPOLLERR;
+    item->data = event->data;
+
+    if (vfs->vfs.epoll_add) {
+        esp_err_t err = epoll_watch_item(item, vfs, local_fd);
+        if (err != ESP_OK) {
+            free(item);
+            return err;
+        }
+        const uint32_t ready = epoll_poll_item(item);
+        if (ready & item->events) {
+            portENTER_CRITICAL(&s_epoll_spinlock);
+            item->pending |= ready;
+            epoll_queue_ready(item);
+            portEXIT_CRITICAL(&s_epoll_spinlock);
+        }
+    } else {
+        ep->socket_vfs = vfs;
+        ++ep->socket_count;
+        ep->socket_nfds = MAX(ep->socket_nfds, fd + 1);
+        epoll_set_socket_fd(ep, fd, item->events);
+    }
+    ep->items[fd] = item;
+
+    return ESP_OK;
+}
+
+static esp_err_t epoll_mod_item(struct esp_vfs_epoll_ *ep, int fd, const esp_vfs_epoll_event_t *event)
+{
+    epoll_item_t *item = ep->items[fd];
+    if (item == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (item->watch) {
+        const uint32_t ready = epoll_poll_item(item);
+        portENTER_CRITICAL(&s_epoll_spinlock);
+        item->events = event->events | ESP_VFS_EPOLLERR;
+        item->data = event->data;
+        item->pending = ready & item->events;
+        if (item->pending) {
+            epoll_queue_ready(item);
+        } else {
+            epoll_unqueue_ready(item);
+        }
+        portEXIT_CRITICAL(&s_epoll_spinlock);
+    } else {
+        item->events = event->events | ESP_VFS_EPOLLERR;
+        item->data = event->data;
+        epoll_set_socket_fd(ep, fd, item->events);
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t epoll_del_item(struct esp_vfs_epoll_ *ep, int fd)
+{
+    epoll_item_t *item = ep->items[fd];
+    if (item == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (item->watch) {
+        epoll_unwatch_item(item);
+    } else {
+        FD_CLR(fd, &ep->socket_readfds);
+        FD_CLR(fd, &ep->socket_writefds);
+        FD_CLR(fd, &ep->socket_errorfds);
+        if (--ep->socket_count == 0) {
+            ep->socket_vfs = NULL;
+            ep->socket_nfds = 0;
+        }
+    }
+    ep->items[fd] = NULL;
+    free(item);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_epoll_create(esp_vfs_epoll_handle_t *ep)
+{
+    if (ep == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_vfs_epoll_ *new_ep = calloc(1, sizeof(struct esp_vfs_epoll_));
+    if (new_ep == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if ((new_ep->sem = xSemaphoreCreateBinary()) == NULL) {
+        free(new_ep);
+        return ESP_ERR_NO_MEM;
+    }
+    *ep = new_ep;
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_epoll_delete(esp_vfs_epoll_handle_t ep)
+{
+    if (ep == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int fd = 0; fd < MAX_FDS; ++fd) {
+        if (ep->items[fd]) {
+            (void) epoll_del_item(ep, fd);
+        }
+    }
+    // Notifications which took the set before its items were removed may still be signaling it
+    portENTER_CRITICAL(&s_epoll_spinlock);
+    while (ep->notifying > 0) {
+        portEXIT_CRITICAL(&s_epoll_spinlock);
+        vTaskDelay(1);
+        portENTER_CRITICAL(&s_epoll_spinlock);
+    }
+    portEXIT_CRITICAL(&s_epoll_spinlock);
+    vSemaphoreDelete(ep->sem);
+    _lock_close(&ep->lock);
+    free(ep);
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_epoll_ctl(esp_vfs_epoll_handle_t ep, esp_vfs_epoll_op_t op, int fd, const esp_vfs_epoll_event_t *event)
+{
+    if (ep == NULL || !fd_valid(fd) || (op != ESP_VFS_EPOLL_CTL_DEL && event == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    _lock_acquire(&s_fd_table_lock);
+    const int vfs_index = s_fd_table[fd].vfs_index;
+    const int local_fd = s_fd_table[fd].local_fd;
+    _lock_release(&s_fd_table_lock);
+
+    const vfs_entry_t *vfs = get_vfs_for_index(vfs_index);
+    if (vfs == NULL && op != ESP_VFS_EPOLL_CTL_DEL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret;
+    _lock_acquire(&ep->lock);
+    switch (op) {
+        case ESP_VFS_EPOLL_CTL_ADD:
+            ret = epoll_add_item(ep, vfs, fd, local_fd, event);
+            break;
+        case ESP_VFS_EPOLL_CTL_MOD:
+            ret = epoll_mod_item(ep, fd, event);
+            break;
+        case ESP_VFS_EPOLL_CTL_DEL:
+            ret = epoll_del_item(ep, fd);
+            break;
+        default:
+            ret = ESP_ERR_INVALID_ARG;
+            break;
+    }
+    _lock_release(&ep->lock);
+
+    ESP_LOGD(TAG, "esp_vfs_epoll_ctl(%d, %d) finished with %s", op, fd, esp_err_to_name(ret));
+    return ret;
+}
+
+// ep->lock must be held
+static int epoll_collect_ready(struct esp_vfs_epoll_ *ep, esp_vfs_epoll_event_t *events, int maxevents)
+{
+    int count = 0;
+
+    // The ready list is taken over so that the FDs can be polled outside of the critical section. Drivers don't touch
+    // the taken items because they are still marked as ready, they only add to the pending events.
+    portENTER_CRITICAL(&s_epoll_spinlock);
+    epoll_item_t *item = ep->ready_head;
+    ep->ready_head = NULL;
+    ep->ready_tail = NULL;
+    portEXIT_CRITICAL(&s_epoll_spinlock);
+
+    while (item) {
+        epoll_item_t *next = item->next_ready;
+        if (count == maxevents) {
+            // the rest stays ready for the next call
+            portENTER_CRITICAL(&s_epoll_spinlock);
+            item->ready = false;
+            epoll_queue_ready(item);
+            portEXIT_CRITICAL(&s_epoll_spinlock);
+            item = next;
+            continue;
+        }
+
+        const bool level_triggered = !(item->events & ESP_VFS_EPOLLET) && item->watch->vfs->vfs.epoll_poll;
+        const uint32_t level = level_triggered ? epoll_poll_item(item) : 0;
+
+        portENTER_CRITICAL(&s_epoll_spinlock);
+        // Level-triggered events are reported as polled, except for errors which are only notified
+        const uint32_t notified = level_triggered ? (item->pending & ESP_VFS_EPOLLERR) : item->pending;
+        const uint32_t revents = (level | notified) & item->events & ~ESP_VFS_EPOLLET;
+        item->pending = 0;
+        item->ready = false;
+        if (level & item->events) {
+            // level-triggered events are reported again by the next call while they last
+            epoll_queue_ready(item);
+        }
+        portEXIT_CRITICAL(&s_epoll_spinlock);
+
+        if (revents) {
+            events[count].events = revents;
+            events[count].data = item->data;
+            ++count;
+        }
+        item = next;
+    }
+
+    return count;
+}
+
+// ep->lock must be held
+static int epoll_collect_sockets(struct esp_vfs_epoll_ *ep, int nfds, const fd_set *readfds, const fd_set *writefds,
+        const fd_set *errorfds, esp_vfs_epoll_event_t *events, int maxevents)
+{
+    int count = 0;
+
+    for (int fd = 0; fd < nfds && count < maxevents; ++fd) {
+        const epoll_item_t *item = ep->items[fd];
+        if (item == NULL || item->watch) {
+            continue;
+        }
+        uint32_t revents = 0;
+        if (FD_ISSET(fd, readfds)) {
+            revents |= ESP_VFS_EPOLLIN;
+        }
+        if (FD_ISSET(fd, writefds)) {
+            revents |= ESP_VFS_EPOLLOUT;
+        }
+        if (FD_ISSET(fd, errorfds)) {
+            revents |= ESP_VFS_EPOLLERR;
+        }
+        revents &= item->events;
+        if (revents) {
+            events[count].events = revents;
+            events[count].data = item->data;
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+int esp_vfs_epoll_wait(esp_vfs_epoll_handle_t ep, esp_vfs_epoll_event_t *events, int maxevents, int timeout_ms)
+{
+    struct _reent* r = __getreent();
+
+    if (ep == NULL || events == NULL || maxevents <= 0) {
+        __errno_r(r) = EINVAL;
+        return -1;
+    }
+
+    const TickType_t start = xTaskGetTickCount();
+    const TickType_t timeout_ticks = (timeout_ms < 0) ? portMAX_DELAY : timeout_ms / portTICK_PERIOD_MS;
+    int ret;
+
+    // Each round collects the ready FDs, and waits if there are none. Driver notifications of the events which are not
+    // reported, e.g. because the data was read in the meantime, lead to another round.
+    while (true) {
+        const TickType_t elapsed = xTaskGetTickCount() - start;
+        TickType_t ticks_to_wait = portMAX_DELAY;
+        if (timeout_ticks != portMAX_DELAY) {
+            ticks_to_wait = (elapsed < timeout_ticks) ? timeout_ticks - elapsed : 0;
+        }
+
+        _lock_acquire(&ep->lock);
+
+        // The signalization is set before collecting so that no notification is missed after that
+        esp_vfs_select_sem_t wake = {
+            .is_sem_local = true,
+            .sem = ep->sem,
+        };
+        if (ep->socket_count > 0) {
+            wake.is_sem_local = false;
+            wake.sem = ep->socket_vfs->vfs.get_socket_select_semaphore();
+        }
+        portENTER_CRITICAL(&s_epoll_spinlock);
+        ep->wake = wake;
+        portEXIT_CRITICAL(&s_epoll_spinlock);
+
+        ret = epoll_collect_ready(ep, events, maxevents);
+        if (ret > 0) {
+            ticks_to_wait = 0;
+        }
+
+        if (ep->socket_count > 0 && ret < maxevents) {
+            int (*socket_select)(int, fd_set *, fd_set *, fd_set *, struct timeval *) = ep->socket_vfs->vfs.socket_select;
+            const int nfds = ep->socket_nfds;
+            fd_set readfds = ep->socket_readfds;
+            fd_set writefds = ep->socket_writefds;
+            fd_set errorfds = ep->socket_errorfds;
+            struct timeval tv = {
+                .tv_sec = (ticks_to_wait * portTICK_PERIOD_MS) / 1000,
+                .tv_usec = ((ticks_to_wait * portTICK_PERIOD_MS) % 1000) * 1000,
+            };
+            _lock_release(&ep->lock);
+
+            const int s = socket_select(nfds, &readfds, &writefds, &errorfds,
+                    (ticks_to_wait == portMAX_DELAY) ? NULL : &tv);
+
+            _lock_acquire(&ep->lock);
+            if (s > 0) {
+                ret += epoll_collect_sockets(ep, nfds, &readfds, &writefds, &errorfds, events + ret, maxevents - ret);
+            } else if (s < 0 && ret == 0) {
+                ret = -1;
+            }
+            if (ret == 0) {
+                // socket_select could have been stopped by a driver notification
+                ret = epoll_collect_ready(ep, events, maxevents);
+            }
+        } else if (ret == 0 && ticks_to_wait > 0) {
+            _lock_release(&ep->lock);
+            xSemaphoreTake(ep->sem, ticks_to_wait);
+            _lock_acquire(&ep->lock);
+            ret = epoll_collect_ready(ep, events, maxevents);
+        }
+
+        portENTER_CRITICAL(&s_epoll_spinlock);
+        ep->wake.sem = NULL;
+        portEXIT_CRITICAL(&s_epoll_spinlock);
+
+        _lock_release(&ep->lock);
+
+        if (ret != 0 || ticks_to_wait == 0) {
+            break;
+        }
+    }
+
+    ESP_LOGD(TAG, "esp_vfs_epoll_wait returns %d", ret);
+    return ret;
+}
+
+// Number of sets which a notification takes at once to signal them outside of the critical section. An FD is rarely
+// in more sets, the others are taken in further rounds.
+#define EPOLL_WAKE_BATCH 4
+
+typedef struct {
+    struct esp_vfs_epoll_ *ep;
+    esp_vfs_select_sem_t wake;
+} epoll_wake_t;
+
+// s_epoll_spinlock must be held
+static void epoll_notify_items(esp_vfs_epoll_watch_t *watch, uint32_t events)
+{
+    for (epoll_item_t *item = watch->items; item; item = item->next_watched) {
+        if (events & item->events) {
+            item->pending |= events;
+            epoll_queue_ready(item);
+            item->wake = true;
+        }
+    }
+}
+
+// s_epoll_spinlock must be held. Takes up to EPOLL_WAKE_BATCH sets with a waiting task, which can't be deleted until
+// epoll_release_wake() is called.
+static int epoll_take_wake(esp_vfs_epoll_watch_t *watch, epoll_wake_t *wake)
+{
+    int count = 0;
+    for (epoll_item_t *item = watch->items; item && count < EPOLL_WAKE_BATCH; item = item->next_watched) {
+        if (item->wake) {
+            item->wake = false;
+            if (item->ep->wake.sem) {
+                ++item->ep->notifying;
+                wake[count].ep = item->ep;
+                wake[count].wake = item->ep->wake;
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+// s_epoll_spinlock must be held
+static void epoll_release_wake(epoll_wake_t *wake, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        --wake[i].ep->notifying;
+    }
+}
+
+// Stopping socket_select can take long, and giving a semaphore can switch tasks, so the sets are only collected in
+// the critical section and signaled after it. A set which is notified again meanwhile is signaled by the notification
+// which takes it last, after its ready list was updated.
+void esp_vfs_epoll_notify(esp_vfs_epoll_watch_t *watch, uint32_t events)
+{
+    epoll_wake_t wake[EPOLL_WAKE_BATCH];
+    int count;
+
+    portENTER_CRITICAL(&s_epoll_spinlock);
+    epoll_notify_items(watch, events);
+    do {
+        count = epoll_take_wake(watch, wake);
+        portEXIT_CRITICAL(&s_epoll_spinlock);
+        for (int i = 0; i < count; ++i) {
+            esp_vfs_select_triggered(wake[i].wake);
+        }
+        portENTER_CRITICAL(&s_epoll_spinlock);
+        epoll_release_wake(wake, count);
+    } while (count == EPOLL_WAKE_BATCH);
+    portEXIT_CRITICAL(&s_epoll_spinlock);
+}
+
+void esp_vfs_epoll_notify_isr(esp_vfs_epoll_watch_t *watch, uint32_t events, BaseType_t *woken)
+{
+    epoll_wake_t wake[EPOLL_WAKE_BATCH];
+    int count;
+
+    portENTER_CRITICAL_ISR(&s_epoll_spinlock);
+    epoll_notify_items(watch, events);
+    do {
+        count = epoll_take_wake(watch, wake);
+        portEXIT_CRITICAL_ISR(&s_epoll_spinlock);
+        for (int i = 0; i < count; ++i) {
+            esp_vfs_select_triggered_isr(wake[i].wake, woken);
+        }
+        portENTER_CRITICAL_ISR(&s_epoll_spinlock);
+        epoll_release_wake(wake, count);
+    } while (count == EPOLL_WAKE_BATCH);
+    portEXIT_CRITICAL_ISR(&s_epoll_spinlock);
+}
+
 #endif // CONFIG_VFS_SUPPORT_SELECT
 
 #ifdef CONFIG_VFS_SUPPORT_TERMIOS
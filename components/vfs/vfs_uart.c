@@ -131,6 +131,8 @@ typedef struct {
 static uart_select_args_t **s_registered_selects = NULL;
 static int s_registered_select_num = 0;
 static portMUX_TYPE s_registered_select_lock = portMUX_INITIALIZER_UNLOCKED;
+// Watches of the UARTs added to esp_vfs_epoll interest sets, protected by s_registered_select_lock
+static esp_vfs_epoll_watch_t *s_epoll_watches[UART_NUM] = { 0 };
 
 static esp_err_t uart_end_select(void *end_select_args);
 
@@ -434,6 +436,20 @@ static void select_notif_callback_isr(uart_port_t uart_num, uart_select_notif_t
             }
         }
     }
+    esp_vfs_epoll_watch_t *watch = s_epoll_watches[uart_num];
+    if (watch) {
+        switch (uart_select_notif) {
+            case UART_SELECT_READ_NOTIF:
+                esp_vfs_epoll_notify_isr(watch, ESP_VFS_EPOLLIN, task_woken);
+                break;
+            case UART_SELECT_WRITE_NOTIF:
+                esp_vfs_epoll_notify_isr(watch, ESP_VFS_EPOLLOUT, task_woken);
+                break;
+            case UART_SELECT_ERROR_NOTIF:
+                esp_vfs_epoll_notify_isr(watch, ESP_VFS_EPOLLERR, task_woken);
+                break;
+        }
+    }
     portEXIT_CRITICAL_ISR(&s_registered_select_lock);
 }
 
@@ -486,6 +502,14 @@ static esp_err_t uart_start_select(int nfds, fd_set *readfds, fd_set *writefds,
                 esp_vfs_select_triggered(args->select_sem);
             }
         }
+        if (FD_ISSET(i, &args->writefds_orig)) {
+            size_t tx_free_size;
+            if (uart_get_tx_buffer_free_size(i, &tx_free_size) == ESP_OK && tx_free_size > 0) {
+                // signalize immediately when data can be queued for sending
+                FD_SET(i, writefds);
+                esp_vfs_select_triggered(args->select_sem);
+            }
+        }
     }
 
     esp_err_t ret = register_select(args);
@@ -508,7 +532,9 @@ static esp_err_t uart_end_select(void *end_select_args)
     portENTER_CRITICAL(uart_get_selectlock());
     esp_err_t ret = unregister_select(args);
     for (int i = 0; i < UART_NUM; ++i) {
-        uart_set_select_notif_callback(i, NULL);
+        if (s_epoll_watches[i] == NULL) { // the notifications are still needed by the interest sets watching the UART
+            uart_set_select_notif_callback(i, NULL);
+        }
     }
     portEXIT_CRITICAL(uart_get_selectlock());
 
@@ -519,6 +545,55 @@ static esp_err_t uart_end_select(void *end_select_args)
     return ret;
 }
 
+static esp_err_t uart_epoll_add(int fd, esp_vfs_epoll_watch_t *watch)
+{
+    if (fd < 0 || fd >= UART_NUM || !uart_is_driver_installed(fd)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(uart_get_selectlock());
+    portENTER_CRITICAL(&s_registered_select_lock);
+    s_epoll_watches[fd] = watch;
+    portEXIT_CRITICAL(&s_registered_select_lock);
+    uart_set_select_notif_callback(fd, select_notif_callback_isr);
+    portEXIT_CRITICAL(uart_get_selectlock());
+
+    return ESP_OK;
+}
+
+static esp_err_t uart_epoll_del(int fd, esp_vfs_epoll_watch_t *watch)
+{
+    if (fd < 0 || fd >= UART_NUM || s_epoll_watches[fd] != watch) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(uart_get_selectlock());
+    portENTER_CRITICAL(&s_registered_select_lock);
+    s_epoll_watches[fd] = NULL;
+    const bool selected = s_registered_select_num > 0;
+    portEXIT_CRITICAL(&s_registered_select_lock);
+    if (!selected) {
+        uart_set_select_notif_callback(fd, NULL);
+    }
+    portEXIT_CRITICAL(uart_get_selectlock());
+
+    return ESP_OK;
+}
+
+static uint32_t uart_epoll_poll(int fd)
+{
+    uint32_t events = 0;
+    size_t buffered_size;
+    if (uart_get_buffered_data_len(fd, &buffered_size) == ESP_OK && buffered_size > 0) {
+        events |= ESP_VFS_EPOLLIN;
+    }
+    size_t tx_free_size;
+    if (uart_get_tx_buffer_free_size(fd, &tx_free_size) == ESP_OK && tx_free_size > 0) {
+        events |= ESP_VFS_EPOLLOUT;
+    }
+    return events;
+}
+
 #endif // CONFIG_VFS_SUPPORT_SELECT
 
 #ifdef CONFIG_VFS_SUPPORT_TERMIOS
@@ -990,6 +1065,9 @@ void esp_vfs_dev_uart_register(void)
 #ifdef CONFIG_VFS_SUPPORT_SELECT
         .start_select = &uart_start_select,
         .end_select = &uart_end_select,
+        .epoll_add = &uart_epoll_add,
+        .epoll_del = &uart_epoll_del,
+        .epoll_poll = &uart_epoll_poll,
 #endif // CONFIG_VFS_SUPPORT_SELECT
 #ifdef CONFIG_VFS_SUPPORT_TERMIOS
         .tcsetattr = &uart_tcsetattr,
@@ -0,0 +1,274 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "WL_Cache.h"
+
+static const char *TAG = "wl_cache";
+
+#define WL_CACHE_RESULT_CHECK(result) \
+    if (result != ESP_OK) { \
+        ESP_LOGE(TAG,"%s(%d): result = 0x%08x", __FUNCTION__, __LINE__, result); \
+        return (result); \
+    }
+
+WL_Cache::WL_Cache()
+{
+}
+
+WL_Cache::~WL_Cache()
+{
+    free(this->lines);
+    free(this->buffer);
+}
+
+esp_err_t WL_Cache::config(Flash_Access *flash_drv, size_t line_size, size_t lines_count, size_t flush_size)
+{
+    if ((flash_drv == NULL) || (lines_count == 0) || (line_size == 0) || (flush_size == 0)
+            || (flush_size % flash_drv->sector_size() != 0) || (line_size % flush_size != 0)
+            || (line_size / flush_size > 32)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    this->lines = (cache_line_t *)calloc(lines_count, sizeof(cache_line_t));
+    this->buffer = (uint8_t *)malloc(lines_count * line_size);
+    if ((this->lines == NULL) || (this->buffer == NULL)) {
+        free(this->lines);
+        free(this->buffer);
+        this->lines = NULL;
+        this->buffer = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < lines_count; i++) {
+        this->lines[i].data = &this->buffer[i * line_size];
+    }
+    this->flash_drv = flash_drv;
+    this->line_size = line_size;
+    this->lines_count = lines_count;
+    this->flush_size = flush_size;
+    this->use_counter = 0;
+    ESP_LOGD(TAG, "%s - line_size= 0x%08x, lines_count= %i, flush_size= 0x%08x", __func__, (uint32_t) line_size, (int) lines_count, (uint32_t) flush_size);
+    return ESP_OK;
+}
+
+size_t WL_Cache::chip_size()
+{
+    return this->flash_drv->chip_size();
+}
+
+size_t WL_Cache::sector_size()
+{
+    return this->flash_drv->sector_size();
+}
+
+WL_Cache::cache_line_t *WL_Cache::findLine(size_t addr)
+{
+    for (size_t i = 0; i < this->lines_count; i++) {
+        if (this->lines[i].valid && this->lines[i].addr == addr) {
+            this->lines[i].last_use = ++this->use_counter;
+            return &this->lines[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t WL_Cache::getLine(size_t addr, bool fill, cache_line_t **out_line)
+{
+    cache_line_t *line = this->findLine(addr);
+    if (line != NULL) {
+        *out_line = line;
+        return ESP_OK;
+    }
+    // Take a free line, or the least recently used one
+    line = &this->lines[0];
+    for (size_t i = 0; i < this->lines_count; i++) {
+        if (!this->lines[i].valid) {
+            line = &this->lines[i];
+            break;
+        }
+        if ((this->use_counter - this->lines[i].last_use) > (this->use_counter - line->last_use)) {
+            line = &this->lines[i];
+        }
+    }
+    esp_err_t result = this->flushLine(line);
+    WL_CACHE_RESULT_CHECK(result);
+    line->valid = false;
+    if (fill) {
+        result = this->flash_drv->read(addr, line->data, this->line_size);
+        WL_CACHE_RESULT_CHECK(result);
+    } else {
+        memset(line->data, 0xFF, this->line_size);
+    }
+    line->addr = addr;
+    line->valid = true;
+    line->dirty = 0;
+    line->last_use = ++this->use_counter;
+    *out_line = line;
+    return ESP_OK;
+}
+
+void WL_Cache::markDirty(cache_line_t *line, size_t offset, size_t size)
+{
+    for (size_t block = offset / this->flush_size; block <= (offset + size - 1) / this->flush_size; block++) {
+        line->dirty |= 1UL << block;
+    }
+}
+
+esp_err_t WL_Cache::flushLine(cache_line_t *line)
+{
+    if (!line->valid || (line->dirty == 0)) {
+        return ESP_OK;
+    }
+    ESP_LOGD(TAG, "%s - addr= 0x%08x, dirty= 0x%08x", __func__, (uint32_t) line->addr, line->dirty);
+    // Each modified block is erased and written on its own, so a power failure during the flush
+    // doesn't affect blocks which were not modified
+    for (size_t offset = 0; offset < this->line_size; offset += this->flush_size) {
+        uint32_t mask = 1UL << (offset / this->flush_size);
+        if ((line->dirty & mask) == 0) {
+            continue;
+        }
+        esp_err_t result = this->flash_drv->erase_range(line->addr + offset, this->flush_size);
+        WL_CACHE_RESULT_CHECK(result);
+        // A block which was only erased doesn't have to be written
+        bool erased = true;
+        for (size_t i = 0; i < this->flush_size; i++) {
+            if (line->data[offset + i] != 0xFF) {
+                erased = false;
+                break;
+            }
+        }
+        if (!erased) {
+            result = this->flash_drv->write(line->addr + offset, &line->data[offset], this->flush_size);
+            WL_CACHE_RESULT_CHECK(result);
+        }
+        line->dirty &= ~mask;
+    }
+    return ESP_OK;
+}
+
+esp_err_t WL_Cache::erase_sector(size_t sector)
+{
+    return this->erase_range(sector * this->sector_size(), this->sector_size());
+}
+
+esp_err_t WL_Cache::erase_range(size_t start_address, size_t size)
+{
+    esp_err_t result = ESP_OK;
+    ESP_LOGD(TAG, "%s - start_address= 0x%08x, size= 0x%08x", __func__, (uint32_t) start_address, (uint32_t) size);
+    if ((start_address % this->sector_size() != 0) || (size % this->sector_size() != 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Ranges larger than the cache (e.g. formatting the whole partition) would only cycle
+    // all lines, so complete lines of such ranges are erased directly
+    bool bypass = size > this->lines_count * this->line_size;
+    while (size > 0) {
+        size_t line_addr = start_address - start_address % this->line_size;
+        size_t offset = start_address - line_addr;
+        size_t count = this->line_size - offset;
+        if (count > size) {
+            count = size;
+        }
+        bool full_line = (count == this->line_size);
+        cache_line_t *line;
+        if (bypass && full_line) {
+            line = this->findLine(line_addr);
+            if (line != NULL) {
+                line->valid = false;
+            }
+            result = this->flash_drv->erase_range(line_addr, this->line_size);
+            WL_CACHE_RESULT_CHECK(result);
+        } else {
+            result = this->getLine(line_addr, !full_line, &line);
+            WL_CACHE_RESULT_CHECK(result);
+            memset(&line->data[offset], 0xFF, count);
+            this->markDirty(line, offset, count);
+        }
+        start_address += count;
+        size -= count;
+    }
+    return ESP_OK;
+}
+
+esp_err_t WL_Cache::write(size_t dest_addr, const void *src, size_t size)
+{
+    esp_err_t result = ESP_OK;
+    ESP_LOGD(TAG, "%s - dest_addr= 0x%08x, size= 0x%08x", __func__, (uint32_t) dest_addr, (uint32_t) size);
+    const uint8_t *src_data = (const uint8_t *)src;
+    while (size > 0) {
+        size_t line_addr = dest_addr - dest_addr % this->line_size;
+        size_t offset = dest_addr - line_addr;
+        size_t count = this->line_size - offset;
+        if (count > size) {
+            count = size;
+        }
+        cache_line_t *line;
+        result = this->getLine(line_addr, true, &line);
+        WL_CACHE_RESULT_CHECK(result);
+        // Same as flash memory, write can only clear bits
+        for (size_t i = 0; i < count; i++) {
+            line->data[offset + i] &= src_data[i];
+        }
+        this->markDirty(line, offset, count);
+        src_data += count;
+        dest_addr += count;
+        size -= count;
+    }
+    return ESP_OK;
+}
+
+esp_err_t WL_Cache::read(size_t src_addr, void *dest, size_t size)
+{
+    esp_err_t result = ESP_OK;
+    ESP_LOGV(TAG, "%s - src_addr= 0x%08x, size= 0x%08x", __func__, (uint32_t) src_addr, (uint32_t) size);
+    uint8_t *dest_data = (uint8_t *)dest;
+    while (size > 0) {
+        size_t line_addr = src_addr - src_addr % this->line_size;
+        size_t offset = src_addr - line_addr;
+        size_t count = this->line_size - offset;
+        if (count > size) {
+            count = size;
+        }
+        // Reads don't allocate lines, sectors which are not cached are read from flash
+        cache_line_t *line = this->findLine(line_addr);
+        if (line != NULL) {
+            memcpy(dest_data, &line->data[offset], count);
+        } else {
+            // Following lines which are not cached either are read with the same call
+            while (count < size && this->findLine(src_addr + count) == NULL) {
+                count += (size - count > this->line_size) ? this->line_size : size - count;
+            }
+            result = this->flash_drv->read(src_addr, dest_data, count);
+            WL_CACHE_RESULT_CHECK(result);
+        }
+        dest_data += count;
+        src_addr += count;
+        size -= count;
+    }
+    return ESP_OK;
+}
+
+esp_err_t WL_Cache::flush()
+{
+    esp_err_t result = ESP_OK;
+    for (size_t i = 0; i < this->lines_count; i++) {
+        result = this->flushLine(&this->lines[i]);
+        WL_CACHE_RESULT_CHECK(result);
+    }
+    return ESP_OK;
+}
+
+Flash_Access *WL_Cache::get_drv()
+{
+    return this->flash_drv;
+}
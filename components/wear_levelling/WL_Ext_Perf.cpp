@@ -72,6 +72,39 @@ esp_err_t WL_Ext_Perf::erase_sector(size_t sector)
     return this->erase_sector_fit(sector, 1);
 }
 
+esp_err_t WL_Ext_Perf::read_kept_sectors(uint32_t flash_sector, uint32_t start, uint32_t count)
+{
+    // Sectors before and after the erased ones are two contiguous ranges at most
+    esp_err_t result = ESP_OK;
+    size_t base_addr = flash_sector * this->flash_sector_size;
+    if (start > 0) {
+        result = this->read(base_addr, this->sector_buffer, start * this->fat_sector_size);
+        WL_EXT_RESULT_CHECK(result);
+    }
+    uint32_t end = start + count;
+    if (end < this->size_factor) {
+        result = this->read(base_addr + end * this->fat_sector_size, &this->sector_buffer[end * this->fat_sector_size / sizeof(uint32_t)], (this->size_factor - end) * this->fat_sector_size);
+        WL_EXT_RESULT_CHECK(result);
+    }
+    return result;
+}
+
+esp_err_t WL_Ext_Perf::write_kept_sectors(uint32_t flash_sector, uint32_t start, uint32_t count)
+{
+    esp_err_t result = ESP_OK;
+    size_t base_addr = flash_sector * this->flash_sector_size;
+    if (start > 0) {
+        result = this->write(base_addr, this->sector_buffer, start * this->fat_sector_size);
+        WL_EXT_RESULT_CHECK(result);
+    }
+    uint32_t end = start + count;
+    if (end < this->size_factor) {
+        result = this->write(base_addr + end * this->fat_sector_size, &this->sector_buffer[end * this->fat_sector_size / sizeof(uint32_t)], (this->size_factor - end) * this->fat_sector_size);
+        WL_EXT_RESULT_CHECK(result);
+    }
+    return result;
+}
+
 esp_err_t WL_Ext_Perf::erase_sector_fit(uint32_t start_sector, uint32_t count)
 {
     ESP_LOGV(TAG, "%s begin, start_sector = 0x%08x, count = %i", __func__, start_sector, count);
@@ -80,23 +113,14 @@ esp_err_t WL_Ext_Perf::erase_sector_fit(uint32_t start_sector, uint32_t count)
 
     uint32_t pre_check_start = start_sector % this->size_factor;
 
-
-    for (int i = 0; i < this->size_factor; i++) {
-        if ((i < pre_check_start) || (i >= count + pre_check_start)) {
-            result = this->read(start_sector / this->size_factor * this->flash_sector_size + i * this->fat_sector_size, &this->sector_buffer[i * this->fat_sector_size / sizeof(uint32_t)], this->fat_sector_size);
-            WL_EXT_RESULT_CHECK(result);
-        }
-    }
+    result = this->read_kept_sectors(start_sector / this->size_factor, pre_check_start, count);
+    WL_EXT_RESULT_CHECK(result);
 
     result = WL_Flash::erase_sector(start_sector / this->size_factor); // erase comlete flash sector
     WL_EXT_RESULT_CHECK(result);
     // And write back only data that should not be erased...
-    for (int i = 0; i < this->size_factor; i++) {
-        if ((i < pre_check_start) || (i >= count + pre_check_start)) {
-            result = this->write(start_sector / this->size_factor * this->flash_sector_size + i * this->fat_sector_size, &this->sector_buffer[i * this->fat_sector_size / sizeof(uint32_t)], this->fat_sector_size);
-            WL_EXT_RESULT_CHECK(result);
-        }
-    }
+    result = this->write_kept_sectors(start_sector / this->size_factor, pre_check_start, count);
+    WL_EXT_RESULT_CHECK(result);
     return ESP_OK;
 }
 
@@ -154,11 +178,9 @@ esp_err_t WL_Ext_Perf::erase_range(size_t start_address, size_t size)
     ESP_LOGV(TAG, "%s rest_check_start = %i, pre_check_count=%i, rest_check_count=%i, post_check_count=%i\n", __func__, rest_check_start, pre_check_count, rest_check_count, post_check_count);
     if (rest_check_count > 0) {
         rest_check_count = rest_check_count / this->size_factor;
-        size_t start_sector = rest_check_start / this->flash_sector_size;
-        for (size_t i = 0; i < rest_check_count; i++) {
-            result = WL_Flash::erase_sector(start_sector + i);
-            WL_EXT_RESULT_CHECK(result);
-        }
+        // Complete flash sectors, erased as one range
+        result = WL_Flash::erase_range(rest_check_start, rest_check_count * this->flash_sector_size);
+        WL_EXT_RESULT_CHECK(result);
     }
     if (post_check_count != 0) {
         result = this->erase_sector_fit(post_check_start, post_check_count);
@@ -101,12 +101,8 @@ esp_err_t WL_Ext_Safe::recover()
         WL_EXT_RESULT_CHECK(result);
 
         // And write back...
-        for (int i = 0; i < this->size_factor; i++) {
-            if ((i < state.local_addr_shift) || (i >= state.count + state.local_addr_shift)) {
-                result = this->write(state.local_addr_base * this->flash_sector_size + i * this->fat_sector_size, &this->sector_buffer[i * this->fat_sector_size / sizeof(uint32_t)], this->fat_sector_size);
-                WL_EXT_RESULT_CHECK(result);
-            }
-        }
+        result = this->write_kept_sectors(state.local_addr_base, state.local_addr_shift, state.count);
+        WL_EXT_RESULT_CHECK(result);
         // clear transaction
         result = WL_Flash::erase_range(this->state_addr, this->flash_sector_size);
     }
@@ -120,12 +116,8 @@ esp_err_t WL_Ext_Safe::erase_sector_fit(uint32_t start_sector, uint32_t count)
     uint32_t local_addr_base = start_sector / this->size_factor;
     uint32_t pre_check_start = start_sector % this->size_factor;
     ESP_LOGV(TAG, "%s start_sector=0x%08x, count = %i", __func__, start_sector, count);
-    for (int i = 0; i < this->size_factor; i++) {
-        if ((i < pre_check_start) || (i >= count + pre_check_start)) {
-            result = this->read(start_sector / this->size_factor * this->flash_sector_size + i * this->fat_sector_size, &this->sector_buffer[i * this->fat_sector_size / sizeof(uint32_t)], this->fat_sector_size);
-            WL_EXT_RESULT_CHECK(result);
-        }
-    }
+    result = this->read_kept_sectors(local_addr_base, pre_check_start, count);
+    WL_EXT_RESULT_CHECK(result);
 
     result = WL_Flash::erase_sector(this->dump_addr / this->flash_sector_size);
     WL_EXT_RESULT_CHECK(result);
@@ -147,12 +139,8 @@ esp_err_t WL_Ext_Safe::erase_sector_fit(uint32_t start_sector, uint32_t count)
     result = WL_Flash::erase_sector(local_addr_base); // erase comlete flash sector
     WL_EXT_RESULT_CHECK(result);
     // And write back...
-    for (int i = 0; i < this->size_factor; i++) {
-        if ((i < pre_check_start) || (i >= count + pre_check_start)) {
-            result = this->write(local_addr_base * this->flash_sector_size + i * this->fat_sector_size, &this->sector_buffer[i * this->fat_sector_size / sizeof(uint32_t)], this->fat_sector_size);
-            WL_EXT_RESULT_CHECK(result);
-        }
-    }
+    result = this->write_kept_sectors(local_addr_base, pre_check_start, count);
+    WL_EXT_RESULT_CHECK(result);
 
     result = WL_Flash::erase_sector(this->state_addr / this->flash_sector_size);
     WL_EXT_RESULT_CHECK(result);
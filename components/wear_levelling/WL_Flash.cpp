@@ -514,14 +514,43 @@ esp_err_t WL_Flash::updateWL()
     return result;
 }
 
-size_t WL_Flash::calcAddr(size_t addr)
+// Accounts for count accesses at once. The dummy block is moved as many times as
+// it would be if updateWL() was called for each access.
+esp_err_t WL_Flash::updateWL(size_t count)
+{
+    esp_err_t result = ESP_OK;
+    while (count > 0) {
+        // Accesses which don't reach max_count only need to be counted
+        size_t skip = this->state.max_count - 1 - this->state.access_count;
+        if (count <= skip) {
+            this->state.access_count += count;
+            break;
+        }
+        this->state.access_count += skip;
+        count -= skip + 1;
+        result = this->updateWL();
+        WL_RESULT_CHECK(result);
+    }
+    return result;
+}
+
+// Returns physical address of addr. If contiguous is not NULL, it receives the number of
+// bytes from addr which are mapped to consecutive physical addresses: the mapping only
+// breaks at the dummy block and where the shifted address wraps around.
+size_t WL_Flash::calcAddr(size_t addr, size_t *contiguous)
 {
     size_t result = (this->flash_size - this->state.move_count * this->cfg.page_size + addr) % this->flash_size;
     size_t dummy_addr = this->state.pos * this->cfg.page_size;
+    size_t run;
     if (result < dummy_addr) {
+        run = dummy_addr - result;
     } else {
+        run = this->flash_size - result;
         result += this->cfg.page_size;
     }
+    if (contiguous != NULL) {
+        *contiguous = run;
+    }
     ESP_LOGV(TAG, "%s - addr= 0x%08x -> result= 0x%08x, dummy_addr= 0x%08x", __func__, (uint32_t) addr, (uint32_t) result, (uint32_t)dummy_addr);
     return result;
 }
@@ -566,9 +595,22 @@ esp_err_t WL_Flash::erase_range(size_t start_address, size_t size)
     ESP_LOGD(TAG, "%s - start_address= 0x%08x, size= 0x%08x", __func__, (uint32_t) start_address, (uint32_t) size);
     size_t erase_count = (size + this->cfg.sector_size - 1) / this->cfg.sector_size;
     size_t start_sector = start_address / this->cfg.sector_size;
-    for (size_t i = 0; i < erase_count; i++) {
-        result = this->erase_sector(start_sector + i);
+    // All the state updates for the range are done first, so that the mapping
+    // doesn't change while the range is erased
+    result = this->updateWL(erase_count);
+    WL_RESULT_CHECK(result);
+    size_t addr = start_sector * this->cfg.sector_size;
+    size = erase_count * this->cfg.sector_size;
+    while (size > 0) {
+        size_t count;
+        size_t virt_addr = this->calcAddr(addr, &count);
+        if (count > size) {
+            count = size;
+        }
+        result = this->flash_drv->erase_range(this->cfg.start_addr + virt_addr, count);
         WL_RESULT_CHECK(result);
+        addr += count;
+        size -= count;
     }
     ESP_LOGV(TAG, "%s - result= 0x%08x", __func__, result);
     return result;
@@ -581,15 +623,19 @@ esp_err_t WL_Flash::write(size_t dest_addr, const void *src, size_t size)
         return ESP_ERR_INVALID_STATE;
     }
     ESP_LOGD(TAG, "%s - dest_addr= 0x%08x, size= 0x%08x", __func__, (uint32_t) dest_addr, (uint32_t) size);
-    uint32_t count = (size - 1) / this->cfg.page_size;
-    for (size_t i = 0; i < count; i++) {
-        size_t virt_addr = this->calcAddr(dest_addr + i * this->cfg.page_size);
-        result = this->flash_drv->write(this->cfg.start_addr + virt_addr, &((uint8_t *)src)[i * this->cfg.page_size], this->cfg.page_size);
+    const uint8_t *src_data = (const uint8_t *)src;
+    while (size > 0) {
+        size_t count;
+        size_t virt_addr = this->calcAddr(dest_addr, &count);
+        if (count > size) {
+            count = size;
+        }
+        result = this->flash_drv->write(this->cfg.start_addr + virt_addr, src_data, count);
         WL_RESULT_CHECK(result);
+        src_data += count;
+        dest_addr += count;
+        size -= count;
     }
-    size_t virt_addr_last = this->calcAddr(dest_addr + count * this->cfg.page_size);
-    result = this->flash_drv->write(this->cfg.start_addr + virt_addr_last, &((uint8_t *)src)[count * this->cfg.page_size], size - count * this->cfg.page_size);
-    WL_RESULT_CHECK(result);
     return result;
 }
 
@@ -600,16 +646,20 @@ esp_err_t WL_Flash::read(size_t src_addr, void *dest, size_t size)
         return ESP_ERR_INVALID_STATE;
     }
     ESP_LOGD(TAG, "%s - src_addr= 0x%08x, size= 0x%08x", __func__, (uint32_t) src_addr, (uint32_t) size);
-    uint32_t count = (size - 1) / this->cfg.page_size;
-    for (size_t i = 0; i < count; i++) {
-        size_t virt_addr = this->calcAddr(src_addr + i * this->cfg.page_size);
-        ESP_LOGV(TAG, "%s - real_addr= 0x%08x, size= 0x%08x", __func__, (uint32_t) (this->cfg.start_addr + virt_addr), (uint32_t) size);
-        result = this->flash_drv->read(this->cfg.start_addr + virt_addr, &((uint8_t *)dest)[i * this->cfg.page_size], this->cfg.page_size);
+    uint8_t *dest_data = (uint8_t *)dest;
+    while (size > 0) {
+        size_t count;
+        size_t virt_addr = this->calcAddr(src_addr, &count);
+        if (count > size) {
+            count = size;
+        }
+        ESP_LOGV(TAG, "%s - real_addr= 0x%08x, size= 0x%08x", __func__, (uint32_t) (this->cfg.start_addr + virt_addr), (uint32_t) count);
+        result = this->flash_drv->read(this->cfg.start_addr + virt_addr, dest_data, count);
         WL_RESULT_CHECK(result);
+        dest_data += count;
+        src_addr += count;
+        size -= count;
     }
-    size_t virt_addr_last = this->calcAddr(src_addr + count * this->cfg.page_size);
-    result = this->flash_drv->read(this->cfg.start_addr + virt_addr_last, &((uint8_t *)dest)[count * this->cfg.page_size], size - count * this->cfg.page_size);
-    WL_RESULT_CHECK(result);
     return result;
 }
 
@@ -45,6 +45,9 @@ esp_err_t wl_mount(const esp_partition_t *partition, wl_handle_t *out_handle);
 /**
 * @brief Unmount WL for defined partition
 *
+* Sectors held in the write-back cache (see CONFIG_WL_CACHE_SECTORS) are written to flash
+* before the partition is unmounted.
+*
 * @param handle WL partition handle
 *
 * @return
@@ -112,6 +115,22 @@ esp_err_t wl_write(wl_handle_t handle, size_t dest_addr, const void *src, size_t
 */
 esp_err_t wl_read(wl_handle_t handle, size_t src_addr, void *dest, size_t size);
 
+/**
+* @brief Write the sectors held in the write-back cache to flash
+*
+* If CONFIG_WL_CACHE_SECTORS is not zero, erase and write operations modify a copy of the
+* flash sector in RAM, and the sector is stored to flash only when the cache needs room for
+* another sector, or when this function or wl_unmount is called. Data which was not flushed
+* is lost on power failure. If the cache is disabled, this function does nothing.
+*
+* @param handle WL module handle that was initialized before
+*
+* @return
+*       - ESP_OK, if all cached sectors were written successfully;
+*       - or one of error codes from lower-level flash driver.
+*/
+esp_err_t wl_flush(wl_handle_t handle);
+
 /**
 * @brief Get size of the WL storage
 *
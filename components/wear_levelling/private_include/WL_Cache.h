@@ -0,0 +1,74 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _WL_Cache_H_
+#define _WL_Cache_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "Flash_Access.h"
+
+/**
+* @brief Write-back cache of flash sectors, placed on top of a WL_Flash instance. Class implements Flash_Access interface
+*
+* Erase and write operations modify a copy of the flash sector in RAM. The modified blocks of a
+* sector are written to the underlying driver (one erase and one write per block of flush_size
+* bytes) when it is evicted to make room for another sector, or when flush() is called.
+* Data which was not flushed is lost on power failure. If flush_size is smaller than the sector,
+* power failure during a flush only affects the block being written, same as without the cache.
+*/
+class WL_Cache : public Flash_Access
+{
+public:
+    WL_Cache();
+    ~WL_Cache() override;
+
+    esp_err_t config(Flash_Access *flash_drv, size_t line_size, size_t lines_count, size_t flush_size);
+
+    size_t chip_size() override;
+    size_t sector_size() override;
+
+    esp_err_t erase_sector(size_t sector) override;
+    esp_err_t erase_range(size_t start_address, size_t size) override;
+
+    esp_err_t write(size_t dest_addr, const void *src, size_t size) override;
+    esp_err_t read(size_t src_addr, void *dest, size_t size) override;
+
+    esp_err_t flush() override;
+
+    Flash_Access *get_drv();
+
+protected:
+    typedef struct {
+        size_t addr;        /*!< address of the cached sector */
+        uint32_t last_use;  /*!< value of use_counter at the last access, for LRU eviction */
+        bool valid;         /*!< line holds a sector */
+        uint32_t dirty;     /*!< bit mask of the blocks of flush_size bytes which differ from flash */
+        uint8_t *data;      /*!< line_size bytes of sector data */
+    } cache_line_t;
+
+    Flash_Access *flash_drv = NULL;
+    size_t line_size = 0;
+    size_t lines_count = 0;
+    size_t flush_size = 0;
+    cache_line_t *lines = NULL;
+    uint8_t *buffer = NULL;
+    uint32_t use_counter = 0;
+
+    cache_line_t *findLine(size_t addr);
+    esp_err_t getLine(size_t addr, bool fill, cache_line_t **out_line);
+    void markDirty(cache_line_t *line, size_t offset, size_t size);
+    esp_err_t flushLine(cache_line_t *line);
+};
+
+#endif // _WL_Cache_H_
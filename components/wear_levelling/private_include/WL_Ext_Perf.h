@@ -40,6 +40,9 @@ protected:
     uint32_t *sector_buffer;
 
     virtual esp_err_t erase_sector_fit(uint32_t start_sector, uint32_t count);
+    // Read to / write from sector_buffer the fatfs sectors of flash_sector outside of [start, start + count)
+    esp_err_t read_kept_sectors(uint32_t flash_sector, uint32_t start, uint32_t count);
+    esp_err_t write_kept_sectors(uint32_t flash_sector, uint32_t start, uint32_t count);
 
 };
 
@@ -69,8 +69,9 @@ protected:
 
     esp_err_t initSections();
     esp_err_t updateWL();
+    esp_err_t updateWL(size_t count);
     esp_err_t recoverPos();
-    size_t calcAddr(size_t addr);
+    size_t calcAddr(size_t addr, size_t *contiguous = NULL);
 
     esp_err_t updateVersion();
     esp_err_t updateV1_V2();
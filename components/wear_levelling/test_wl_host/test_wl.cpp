@@ -1,11 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "esp_spi_flash.h"
 #include "esp_partition.h"
 #include "wear_levelling.h"
 #include "WL_Flash.h"
+#include "WL_Ext_Perf.h"
+#include "WL_Ext_Safe.h"
+#include "WL_Cache.h"
+#include "Partition.h"
 #include "SpiFlash.h"
 
 #include "catch.hpp"
@@ -207,4 +212,545 @@ TEST_CASE("power down test", "[wear_levelling]")
     // Unmount
     result = wl_unmount(wl_handle);
     REQUIRE(result == ESP_OK);
-}
\ No newline at end of file
+}
+
+/* Flash_Access wrapper which counts the operations done on the partition */
+class Counting_Flash : public Flash_Access
+{
+public:
+    Counting_Flash(Flash_Access *drv) : drv(drv) {}
+
+    size_t chip_size() override
+    {
+        return drv->chip_size();
+    }
+    size_t sector_size() override
+    {
+        return drv->sector_size();
+    }
+    esp_err_t erase_sector(size_t sector) override
+    {
+        erases++;
+        erase_calls++;
+        return drv->erase_sector(sector);
+    }
+    esp_err_t erase_range(size_t start_address, size_t size) override
+    {
+        erases += (size + drv->sector_size() - 1) / drv->sector_size();
+        erase_calls++;
+        return drv->erase_range(start_address, size);
+    }
+    esp_err_t write(size_t dest_addr, const void *src, size_t size) override
+    {
+        bytes_written += size;
+        write_calls++;
+        return drv->write(dest_addr, src, size);
+    }
+    esp_err_t read(size_t src_addr, void *dest, size_t size) override
+    {
+        bytes_read += size;
+        read_calls++;
+        return drv->read(src_addr, dest, size);
+    }
+
+    void reset()
+    {
+        erases = bytes_written = bytes_read = 0;
+        erase_calls = write_calls = read_calls = 0;
+    }
+
+    Flash_Access *drv;
+    size_t erases = 0;
+    size_t bytes_written = 0;
+    size_t bytes_read = 0;
+    size_t erase_calls = 0;
+    size_t write_calls = 0;
+    size_t read_calls = 0;
+};
+
+static void wl_test_config(wl_config_t *cfg, const esp_partition_t *partition)
+{
+    // Same configuration as used by wl_mount
+    memset(cfg, 0, sizeof(wl_config_t));
+    cfg->full_mem_size = partition->size;
+    cfg->start_addr = 0;
+    cfg->version = 2;
+    cfg->sector_size = SPI_FLASH_SEC_SIZE;
+    cfg->page_size = SPI_FLASH_SEC_SIZE;
+    cfg->updaterate = 16;
+    cfg->temp_buff_size = 32;
+    cfg->wr_size = 16;
+}
+
+static void wl_test_mount(WL_Flash *wl, Flash_Access *drv, const esp_partition_t *partition)
+{
+    wl_config_t cfg;
+    wl_test_config(&cfg, partition);
+    REQUIRE(wl->config(&cfg, drv) == ESP_OK);
+    REQUIRE(wl->init() == ESP_OK);
+}
+
+static void wl_test_mount_ext(WL_Ext_Perf *wl, Flash_Access *drv, const esp_partition_t *partition, uint32_t fat_sector_size)
+{
+    wl_ext_cfg_t cfg;
+    wl_test_config(&cfg, partition);
+    cfg.fat_sector_size = fat_sector_size;
+    REQUIRE(wl->config(&cfg, drv) == ESP_OK);
+    REQUIRE(wl->init() == ESP_OK);
+}
+
+static void fill_sector(uint8_t *buf, size_t size, uint32_t seed)
+{
+    for (size_t i = 0; i < size; i++) {
+        buf[i] = (uint8_t)(seed * 31 + i * 7 + (i >> 8));
+    }
+}
+
+TEST_CASE("write-back cache keeps data coherent", "[wear_levelling][cache]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+
+    Partition part(partition);
+    WL_Flash wl;
+    wl_test_mount(&wl, &part, partition);
+    WL_Cache cache;
+    REQUIRE(cache.config(&wl, SPI_FLASH_SEC_SIZE, 4, SPI_FLASH_SEC_SIZE) == ESP_OK);
+    REQUIRE(cache.chip_size() == wl.chip_size());
+    REQUIRE(cache.sector_size() == wl.sector_size());
+
+    const size_t sector_size = cache.sector_size();
+    const size_t region_size = 16 * sector_size;
+    uint8_t *expected = (uint8_t *)malloc(region_size);
+    uint8_t *read = (uint8_t *)malloc(region_size);
+    REQUIRE(wl.read(0, expected, region_size) == ESP_OK);
+
+    // Small writes to one sector are only erased and written to flash on flush
+    uint32_t erases = spiflash.get_total_erase_cycles();
+    REQUIRE(cache.erase_range(0, sector_size) == ESP_OK);
+    memset(expected, 0xFF, sector_size);
+    for (size_t offset = 0; offset < sector_size; offset += 256) {
+        fill_sector(&expected[offset], 256, offset);
+        REQUIRE(cache.write(offset, &expected[offset], 256) == ESP_OK);
+    }
+    CHECK(spiflash.get_total_erase_cycles() == erases);
+    REQUIRE(cache.read(0, read, sector_size) == ESP_OK);
+    CHECK(memcmp(expected, read, sector_size) == 0);
+    REQUIRE(cache.flush() == ESP_OK);
+    CHECK(spiflash.get_total_erase_cycles() - erases <= 2);
+    REQUIRE(wl.read(0, read, sector_size) == ESP_OK);
+    CHECK(memcmp(expected, read, sector_size) == 0);
+
+    // Random operations on more sectors than the cache holds
+    srand(42);
+    for (int i = 0; i < 2000; i++) {
+        size_t addr = rand() % region_size;
+        size_t size = 1 + rand() % 600;
+        if (addr + size > region_size) {
+            size = region_size - addr;
+        }
+        switch (rand() % 8) {
+        case 0: {
+            size_t sector = addr / sector_size;
+            size_t count = 1 + rand() % 2;
+            if ((sector + count) * sector_size > region_size) {
+                count = 1;
+            }
+            REQUIRE(cache.erase_range(sector * sector_size, count * sector_size) == ESP_OK);
+            memset(&expected[sector * sector_size], 0xFF, count * sector_size);
+            break;
+        }
+        case 1:
+        case 2:
+        case 3: {
+            uint8_t data[600];
+            fill_sector(data, size, i);
+            REQUIRE(cache.write(addr, data, size) == ESP_OK);
+            for (size_t k = 0; k < size; k++) {
+                expected[addr + k] &= data[k];
+            }
+            break;
+        }
+        case 4:
+            if (rand() % 8 == 0) {
+                REQUIRE(cache.flush() == ESP_OK);
+            }
+            break;
+        default:
+            REQUIRE(cache.read(addr, read, size) == ESP_OK);
+            REQUIRE(memcmp(&expected[addr], read, size) == 0);
+            break;
+        }
+    }
+    REQUIRE(cache.read(0, read, region_size) == ESP_OK);
+    CHECK(memcmp(expected, read, region_size) == 0);
+
+    // Ranges larger than the cache are erased directly and drop the cached sectors
+    REQUIRE(cache.erase_range(0, 8 * sector_size) == ESP_OK);
+    memset(expected, 0xFF, 8 * sector_size);
+    REQUIRE(cache.read(0, read, region_size) == ESP_OK);
+    CHECK(memcmp(expected, read, region_size) == 0);
+
+    // After flush, the data is in flash and survives remount
+    REQUIRE(cache.flush() == ESP_OK);
+    REQUIRE(wl.flush() == ESP_OK);
+    Partition part2(partition);
+    WL_Flash wl2;
+    wl_test_mount(&wl2, &part2, partition);
+    REQUIRE(wl2.read(0, read, region_size) == ESP_OK);
+    CHECK(memcmp(expected, read, region_size) == 0);
+
+    free(expected);
+    free(read);
+}
+
+TEST_CASE("write-back cache keeps flushed data on power loss", "[wear_levelling][cache]")
+{
+    const size_t sectors_count = 8;
+    const size_t sector_size = SPI_FLASH_SEC_SIZE;
+    uint8_t *committed = (uint8_t *)malloc(sectors_count * sector_size);
+    uint8_t *pending = (uint8_t *)malloc(sectors_count * sector_size);
+    uint8_t *read = (uint8_t *)malloc(sector_size);
+    uint8_t erased[SPI_FLASH_SEC_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+
+    for (uint32_t limit = 1; limit < 80; limit += 3) {
+        INFO("erase limit " << limit);
+        _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+        bool dirty[sectors_count] = {};
+
+        {
+            Partition part(partition);
+            WL_Flash wl;
+            wl_test_mount(&wl, &part, partition);
+            REQUIRE(wl.read(0, committed, sectors_count * sector_size) == ESP_OK);
+            memcpy(pending, committed, sectors_count * sector_size);
+            WL_Cache cache;
+            REQUIRE(cache.config(&wl, sector_size, 3, sector_size) == ESP_OK);
+
+            spiflash.reset_total_erase_cycles();
+            spiflash.set_total_erase_cycles_limit(limit);
+            esp_err_t result = ESP_OK;
+            for (uint32_t i = 0; result == ESP_OK; i++) {
+                size_t sector = (i * 5) % sectors_count;
+                uint8_t *data = &pending[sector * sector_size];
+                dirty[sector] = true;
+                memset(data, 0xFF, sector_size);
+                fill_sector(data, sector_size, i);
+                result = cache.erase_range(sector * sector_size, sector_size);
+                // Write the sector in small pieces
+                for (size_t offset = 0; offset < sector_size && result == ESP_OK; offset += 512) {
+                    result = cache.write(sector * sector_size + offset, &data[offset], 512);
+                }
+                if (result == ESP_OK && i % 4 == 3) {
+                    result = cache.flush();
+                    if (result == ESP_OK) {
+                        memcpy(committed, pending, sectors_count * sector_size);
+                        memset(dirty, 0, sizeof(dirty));
+                    }
+                }
+            }
+            // Power is lost here: neither the cache nor WL state are flushed
+            spiflash.set_total_erase_cycles_limit(0);
+        }
+
+        Partition part(partition);
+        WL_Flash wl;
+        wl_test_mount(&wl, &part, partition);
+        for (size_t sector = 0; sector < sectors_count; sector++) {
+            INFO("sector " << sector);
+            REQUIRE(wl.read(sector * sector_size, read, sector_size) == ESP_OK);
+            if (!dirty[sector]) {
+                // Sectors flushed before the power loss must be intact
+                CHECK(memcmp(read, &committed[sector * sector_size], sector_size) == 0);
+            } else {
+                // Sectors modified after the last flush may be old, new, or erased
+                CHECK((memcmp(read, &committed[sector * sector_size], sector_size) == 0 ||
+                       memcmp(read, &pending[sector * sector_size], sector_size) == 0 ||
+                       memcmp(read, erased, sector_size) == 0));
+            }
+        }
+        spiflash.reset_total_erase_cycles();
+    }
+
+    free(committed);
+    free(pending);
+    free(read);
+}
+
+TEST_CASE("write-back cache in safety mode only loses modified sectors on power loss", "[wear_levelling][cache]")
+{
+    const size_t fat_sector_size = 512;
+    const size_t sectors_count = 4 * SPI_FLASH_SEC_SIZE / fat_sector_size;
+    const size_t size = sectors_count * fat_sector_size;
+    uint8_t *committed = (uint8_t *)malloc(size);
+    uint8_t *pending = (uint8_t *)malloc(size);
+    uint8_t read[fat_sector_size];
+    uint8_t erased[fat_sector_size];
+    memset(erased, 0xFF, sizeof(erased));
+
+    for (uint32_t limit = 1; limit < 200; limit += 7) {
+        INFO("erase limit " << limit);
+        _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+        bool dirty[sectors_count] = {};
+
+        {
+            Partition part(partition);
+            WL_Ext_Safe wl;
+            wl_test_mount_ext(&wl, &part, partition, fat_sector_size);
+            REQUIRE(wl.read(0, committed, size) == ESP_OK);
+            memcpy(pending, committed, size);
+            WL_Cache cache;
+            REQUIRE(cache.config(&wl, SPI_FLASH_SEC_SIZE, 2, fat_sector_size) == ESP_OK);
+
+            spiflash.reset_total_erase_cycles();
+            spiflash.set_total_erase_cycles_limit(limit);
+            esp_err_t result = ESP_OK;
+            for (uint32_t i = 0; result == ESP_OK; i++) {
+                // Modify two of the sectors which share a flash sector, the others must be kept
+                size_t base = ((i * 3) % (sectors_count / 8)) * 8;
+                for (size_t sector : { base + i % 8, base + (i * 5 + 1) % 8 }) {
+                    uint8_t *data = &pending[sector * fat_sector_size];
+                    dirty[sector] = true;
+                    fill_sector(data, fat_sector_size, i + sector);
+                    result = cache.erase_range(sector * fat_sector_size, fat_sector_size);
+                    if (result == ESP_OK) {
+                        result = cache.write(sector * fat_sector_size, data, fat_sector_size);
+                    }
+                    if (result != ESP_OK) {
+                        break;
+                    }
+                }
+                if (result == ESP_OK && i % 3 == 2) {
+                    result = cache.flush();
+                    if (result == ESP_OK) {
+                        memcpy(committed, pending, size);
+                        memset(dirty, 0, sizeof(dirty));
+                    }
+                }
+            }
+            // Power is lost here, possibly in the middle of a flush
+            spiflash.set_total_erase_cycles_limit(0);
+        }
+
+        Partition part(partition);
+        WL_Ext_Safe wl;
+        wl_test_mount_ext(&wl, &part, partition, fat_sector_size);
+        for (size_t sector = 0; sector < sectors_count; sector++) {
+            INFO("sector " << sector);
+            REQUIRE(wl.read(sector * fat_sector_size, read, fat_sector_size) == ESP_OK);
+            if (!dirty[sector]) {
+                // Sectors which were not modified since the last flush must be intact, even if
+                // they share the flash sector with modified ones
+                CHECK(memcmp(read, &committed[sector * fat_sector_size], fat_sector_size) == 0);
+            } else {
+                CHECK((memcmp(read, &committed[sector * fat_sector_size], fat_sector_size) == 0 ||
+                       memcmp(read, &pending[sector * fat_sector_size], fat_sector_size) == 0 ||
+                       memcmp(read, erased, fat_sector_size) == 0));
+            }
+        }
+        spiflash.reset_total_erase_cycles();
+    }
+
+    free(committed);
+    free(pending);
+}
+
+/* Hidden benchmark, appending small records to a file like FAT does it: each record rewrites
+ * the data sector and the directory sector, and the file is synced every 16 records */
+TEST_CASE("write-back cache benchmark", "[wear_levelling][cache][benchmark][.]")
+{
+    const size_t record_size = 64;
+    const size_t records_count = 4096;
+    const size_t sync_interval = 16;
+    // Typical timings of SPI flash chips: sector erase, and page program per byte
+    const double erase_time_ms = 45.0;
+    const double program_time_us_per_byte = 0.7 * 1000 / 256;
+    const size_t sector_size = SPI_FLASH_SEC_SIZE;
+
+    for (size_t cache_sectors : { 0, 2, 4 }) {
+        _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+        Partition part(partition);
+        Counting_Flash counter(&part);
+        WL_Flash wl;
+        wl_test_mount(&wl, &counter, partition);
+        WL_Cache cache;
+        Flash_Access *access = &wl;
+        if (cache_sectors > 0) {
+            REQUIRE(cache.config(&wl, sector_size, cache_sectors, sector_size) == ESP_OK);
+            access = &cache;
+        }
+        counter.erases = 0;
+        counter.bytes_written = 0;
+        counter.bytes_read = 0;
+
+        uint8_t sector[SPI_FLASH_SEC_SIZE];
+        uint8_t dir_sector[SPI_FLASH_SEC_SIZE];
+        memset(dir_sector, 0, sizeof(dir_sector));
+        const size_t dir_addr = 0;
+        const size_t data_addr = sector_size;
+        clock_t start = clock();
+        for (size_t i = 0; i < records_count; i++) {
+            size_t offset = i * record_size;
+            size_t addr = data_addr + offset - offset % sector_size;
+            REQUIRE(access->read(addr, sector, sector_size) == ESP_OK);
+            fill_sector(&sector[offset % sector_size], record_size, i);
+            REQUIRE(access->erase_range(addr, sector_size) == ESP_OK);
+            REQUIRE(access->write(addr, sector, sector_size) == ESP_OK);
+            // file size in the directory entry
+            *(uint32_t *)dir_sector = offset + record_size;
+            REQUIRE(access->erase_range(dir_addr, sector_size) == ESP_OK);
+            REQUIRE(access->write(dir_addr, dir_sector, sector_size) == ESP_OK);
+            // WL_Flash::flush moves the dummy block, so only the cache is flushed on sync
+            if (cache_sectors > 0 && (i + 1) % sync_interval == 0) {
+                REQUIRE(cache.flush() == ESP_OK);
+            }
+        }
+        if (cache_sectors > 0) {
+            REQUIRE(cache.flush() == ESP_OK);
+        }
+        double cpu_time_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        double mb = (double)(records_count * record_size) / (1024 * 1024);
+        double flash_time_s = counter.erases * erase_time_ms / 1000 + counter.bytes_written * program_time_us_per_byte / 1000000;
+        printf("cache sectors %zu: %8.0f erases/MB, %8.0f KB written to flash/MB, estimated flash time %6.2f s (%6.1f KB/s), host time %5.3f s\n",
+               cache_sectors, counter.erases / mb, counter.bytes_written / 1024 / mb,
+               flash_time_s, records_count * record_size / 1024 / flash_time_s, cpu_time_s);
+    }
+}
+
+enum wl_test_mode_t {
+    WL_TEST_FLASH,
+    WL_TEST_EXT_PERF,
+    WL_TEST_EXT_SAFE,
+};
+
+static const char *wl_test_mode_name(wl_test_mode_t mode)
+{
+    return (mode == WL_TEST_FLASH) ? "WL_Flash" : (mode == WL_TEST_EXT_PERF) ? "WL_Ext_Perf" : "WL_Ext_Safe";
+}
+
+static WL_Flash *wl_test_create(wl_test_mode_t mode, Flash_Access *drv, const esp_partition_t *partition)
+{
+    if (mode == WL_TEST_FLASH) {
+        WL_Flash *wl = new WL_Flash();
+        wl_test_mount(wl, drv, partition);
+        return wl;
+    }
+    WL_Ext_Perf *wl = (mode == WL_TEST_EXT_PERF) ? new WL_Ext_Perf() : new WL_Ext_Safe();
+    wl_test_mount_ext(wl, drv, partition, 512);
+    return wl;
+}
+
+TEST_CASE("multi-sector transfers are coherent across dummy block moves", "[wear_levelling]")
+{
+    for (wl_test_mode_t mode : { WL_TEST_FLASH, WL_TEST_EXT_PERF, WL_TEST_EXT_SAFE }) {
+        _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+        Partition part(partition);
+        WL_Flash *wl = wl_test_create(mode, &part, partition);
+
+        const size_t sector_size = wl->sector_size();
+        const size_t sectors = wl->chip_size() / sector_size;
+        const size_t max_sectors = 64;
+        uint8_t *expected = (uint8_t *)malloc(sectors * sector_size);
+        uint8_t *buf = (uint8_t *)malloc(max_sectors * sector_size);
+        memset(expected, 0xFF, sectors * sector_size);
+        REQUIRE(wl->erase_range(0, sectors * sector_size) == ESP_OK);
+
+        srand(42);
+        // Enough erased sectors to move the dummy block through the whole partition
+        for (int round = 0; round < 1500; round++) {
+            size_t count = 1 + rand() % max_sectors;
+            size_t start = rand() % (sectors - count + 1);
+            fill_sector(buf, count * sector_size, round);
+            REQUIRE(wl->erase_range(start * sector_size, count * sector_size) == ESP_OK);
+            REQUIRE(wl->write(start * sector_size, buf, count * sector_size) == ESP_OK);
+            memcpy(&expected[start * sector_size], buf, count * sector_size);
+
+            count = 1 + rand() % max_sectors;
+            start = rand() % (sectors - count + 1);
+            REQUIRE(wl->read(start * sector_size, buf, count * sector_size) == ESP_OK);
+            REQUIRE(memcmp(buf, &expected[start * sector_size], count * sector_size) == 0);
+        }
+        delete wl;
+
+        // The state written by batched updates must describe the same mapping after a remount
+        Partition part2(partition);
+        wl = wl_test_create(mode, &part2, partition);
+        for (size_t sector = 0; sector < sectors; sector += max_sectors) {
+            size_t count = (sectors - sector < max_sectors) ? sectors - sector : max_sectors;
+            REQUIRE(wl->read(sector * sector_size, buf, count * sector_size) == ESP_OK);
+            REQUIRE(memcmp(buf, &expected[sector * sector_size], count * sector_size) == 0);
+        }
+        delete wl;
+
+        free(buf);
+        free(expected);
+    }
+}
+
+/* Hidden benchmark of large transfers, done at once and sector by sector (which is how WL_Flash
+ * used to access the flash). The estimated flash time assumes typical SPI flash timings and
+ * a fixed cost of each flash call. */
+TEST_CASE("multi-sector transfer benchmark", "[wear_levelling][benchmark][.]")
+{
+    const double call_time_us = 30.0;
+    const double erase_time_ms = 45.0;
+    const double program_time_us_per_byte = 0.7 * 1000 / 256;
+    const double read_time_us_per_byte = 1.0 / 20;
+
+    for (wl_test_mode_t mode : { WL_TEST_FLASH, WL_TEST_EXT_PERF }) {
+        _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+        Partition part(partition);
+        Counting_Flash counter(&part);
+        WL_Flash *wl = wl_test_create(mode, &counter, partition);
+        const size_t sector_size = wl->sector_size();
+        // 1 MB doesn't fit into the partition next to the wear levelling data
+        const size_t max_size = wl->chip_size() - wl->chip_size() % (256 * 1024);
+        uint8_t *buf = (uint8_t *)malloc(max_size);
+
+        for (size_t size = 4096; size <= 1024 * 1024; size *= 4) {
+            const size_t transfer_size = (size < max_size) ? size : max_size;
+            for (int per_sector = 1; per_sector >= 0; per_sector--) {
+                const size_t chunk = per_sector ? sector_size : transfer_size;
+                const size_t repeat = 1024 * 1024 / transfer_size;
+                fill_sector(buf, transfer_size, transfer_size);
+                counter.reset();
+                clock_t start = clock();
+                for (size_t r = 0; r < repeat; r++) {
+                    for (size_t ofs = 0; ofs < transfer_size; ofs += chunk) {
+                        REQUIRE(wl->erase_range(ofs, chunk) == ESP_OK);
+                        REQUIRE(wl->write(ofs, &buf[ofs], chunk) == ESP_OK);
+                    }
+                }
+                double write_cpu_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+                size_t write_calls = counter.erase_calls + counter.write_calls + counter.read_calls;
+                double write_flash_s = (write_calls * call_time_us + counter.bytes_written * program_time_us_per_byte + counter.bytes_read * read_time_us_per_byte) / 1000000 + counter.erases * erase_time_ms / 1000;
+
+                counter.reset();
+                start = clock();
+                for (size_t r = 0; r < repeat; r++) {
+                    for (size_t ofs = 0; ofs < transfer_size; ofs += chunk) {
+                        REQUIRE(wl->read(ofs, &buf[ofs], chunk) == ESP_OK);
+                    }
+                }
+                double read_cpu_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+                size_t read_calls = counter.read_calls;
+                double read_flash_s = (read_calls * call_time_us + counter.bytes_read * read_time_us_per_byte) / 1000000;
+
+                const double mb = (double)(repeat * transfer_size) / (1024 * 1024);
+                printf("%-11s %4zu KB %-10s: write %6.1f flash calls/transfer, est. %6.1f KB/s, host %5.3f s; read %6.1f flash calls/transfer, est. %6.2f MB/s, host %5.3f s\n",
+                       wl_test_mode_name(mode), transfer_size / 1024, per_sector ? "per sector" : "at once",
+                       (double)write_calls / repeat, mb * 1024 / write_flash_s, write_cpu_s,
+                       (double)read_calls / repeat, mb / read_flash_s, read_cpu_s);
+            }
+        }
+        delete wl;
+        free(buf);
+    }
+}
@@ -21,6 +21,7 @@
 #include "WL_Flash.h"
 #include "WL_Ext_Perf.h"
 #include "WL_Ext_Safe.h"
+#include "WL_Cache.h"
 #include "SPI_Flash.h"
 #include "Partition.h"
 
@@ -48,8 +49,17 @@
 #define WL_CURRENT_VERSION  2
 #endif //WL_CURRENT_VERSION
 
+#ifndef WL_CACHE_SECTORS
+#ifdef CONFIG_WL_CACHE_SECTORS
+#define WL_CACHE_SECTORS    CONFIG_WL_CACHE_SECTORS
+#else
+#define WL_CACHE_SECTORS    0
+#endif // CONFIG_WL_CACHE_SECTORS
+#endif // WL_CACHE_SECTORS
+
 typedef struct {
     WL_Flash *instance;
+    WL_Cache *cache;    /*!< write-back cache on top of instance, NULL if disabled */
     _lock_t lock;
 } wl_instance_t;
 
@@ -59,11 +69,24 @@ static const char *TAG = "wear_levelling";
 
 static esp_err_t check_handle(wl_handle_t handle, const char *func);
 
+// Operations go through the cache if there is one
+static inline Flash_Access *get_access(wl_handle_t handle)
+{
+    if (s_instances[handle].cache != NULL) {
+        return s_instances[handle].cache;
+    }
+    return s_instances[handle].instance;
+}
+
 esp_err_t wl_mount(const esp_partition_t *partition, wl_handle_t *out_handle)
 {
     // Initialize variables before the first jump to cleanup label
     void *wl_flash_ptr = NULL;
     WL_Flash *wl_flash = NULL;
+#if WL_CACHE_SECTORS > 0
+    void *wl_cache_ptr = NULL;
+#endif // WL_CACHE_SECTORS
+    WL_Cache *wl_cache = NULL;
     void *part_ptr = NULL;
     Partition *part = NULL;
 
@@ -149,7 +172,28 @@ esp_err_t wl_mount(const esp_partition_t *partition, wl_handle_t *out_handle)
         ESP_LOGE(TAG, "%s: init instance=0x%08x, result=0x%x", __func__, *out_handle, result);
         goto out;
     }
+#if WL_CACHE_SECTORS > 0
+    wl_cache_ptr = malloc(sizeof(WL_Cache));
+    if (wl_cache_ptr == NULL) {
+        result = ESP_ERR_NO_MEM;
+        ESP_LOGE(TAG, "%s: can't allocate WL_Cache", __func__);
+        goto out;
+    }
+    wl_cache = new (wl_cache_ptr) WL_Cache();
+#if CONFIG_WL_SECTOR_SIZE == 512 && CONFIG_WL_SECTOR_MODE == 1
+    // Safety mode only loses the sector being written on power failure, so the cache
+    // writes back each modified sector on its own instead of the whole flash sector
+    result = wl_cache->config(wl_flash, cfg.sector_size, WL_CACHE_SECTORS, cfg.fat_sector_size);
+#else
+    result = wl_cache->config(wl_flash, cfg.sector_size, WL_CACHE_SECTORS, cfg.sector_size);
+#endif // CONFIG_WL_SECTOR_MODE
+    if (ESP_OK != result) {
+        ESP_LOGE(TAG, "%s: cache config instance=0x%08x, result=0x%x", __func__, *out_handle, result);
+        goto out;
+    }
+#endif // WL_CACHE_SECTORS
     s_instances[*out_handle].instance = wl_flash;
+    s_instances[*out_handle].cache = wl_cache;
     _lock_init(&s_instances[*out_handle].lock);
     _lock_release(&s_instances_lock);
     return ESP_OK;
@@ -157,6 +201,10 @@ esp_err_t wl_mount(const esp_partition_t *partition, wl_handle_t *out_handle)
 out:
     _lock_release(&s_instances_lock);
     *out_handle = WL_INVALID_HANDLE;
+    if (wl_cache) {
+        wl_cache->~WL_Cache();
+        free(wl_cache);
+    }
     if (wl_flash) {
         wl_flash->~WL_Flash();
         free(wl_flash);
@@ -174,8 +222,18 @@ esp_err_t wl_unmount(wl_handle_t handle)
     _lock_acquire(&s_instances_lock);
     result = check_handle(handle, __func__);
     if (result == ESP_OK) {
+        // Write back the cached sectors before the state of the component is flushed
+        if (s_instances[handle].cache != NULL) {
+            result = s_instances[handle].cache->flush();
+            s_instances[handle].cache->~WL_Cache();
+            free(s_instances[handle].cache);
+            s_instances[handle].cache = NULL;
+        }
         // We have to flush state of the component
-        result = s_instances[handle].instance->flush();
+        esp_err_t flush_result = s_instances[handle].instance->flush();
+        if (result == ESP_OK) {
+            result = flush_result;
+        }
         // We use placement new in wl_mount, so call destructor directly
         Flash_Access *drv = s_instances[handle].instance->get_drv();
         drv->~Flash_Access();
@@ -196,7 +254,7 @@ esp_err_t wl_erase_range(wl_handle_t handle, size_t start_addr, size_t size)
         return result;
     }
     _lock_acquire(&s_instances[handle].lock);
-    result = s_instances[handle].instance->erase_range(start_addr, size);
+    result = get_access(handle)->erase_range(start_addr, size);
     _lock_release(&s_instances[handle].lock);
     return result;
 }
@@ -208,7 +266,7 @@ esp_err_t wl_write(wl_handle_t handle, size_t dest_addr, const void *src, size_t
         return result;
     }
     _lock_acquire(&s_instances[handle].lock);
-    result = s_instances[handle].instance->write(dest_addr, src, size);
+    result = get_access(handle)->write(dest_addr, src, size);
     _lock_release(&s_instances[handle].lock);
     return result;
 }
@@ -220,7 +278,21 @@ esp_err_t wl_read(wl_handle_t handle, size_t src_addr, void *dest, size_t size)
         return result;
     }
     _lock_acquire(&s_instances[handle].lock);
-    result = s_instances[handle].instance->read(src_addr, dest, size);
+    result = get_access(handle)->read(src_addr, dest, size);
+    _lock_release(&s_instances[handle].lock);
+    return result;
+}
+
+esp_err_t wl_flush(wl_handle_t handle)
+{
+    esp_err_t result = check_handle(handle, __func__);
+    if (result != ESP_OK) {
+        return result;
+    }
+    _lock_acquire(&s_instances[handle].lock);
+    if (s_instances[handle].cache != NULL) {
+        result = s_instances[handle].cache->flush();
+    }
     _lock_release(&s_instances[handle].lock);
     return result;
 }
@@ -232,7 +304,7 @@ size_t wl_size(wl_handle_t handle)
         return 0;
     }
     _lock_acquire(&s_instances[handle].lock);
-    size_t result = s_instances[handle].instance->chip_size();
+    size_t result = get_access(handle)->chip_size();
     _lock_release(&s_instances[handle].lock);
     return result;
 }
@@ -244,7 +316,7 @@ size_t wl_sector_size(wl_handle_t handle)
         return 0;
     }
     _lock_acquire(&s_instances[handle].lock);
-    size_t result = s_instances[handle].instance->sector_size();
+    size_t result = get_access(handle)->sector_size();
     _lock_release(&s_instances[handle].lock);
     return result;
 }
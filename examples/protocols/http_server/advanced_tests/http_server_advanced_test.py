@@ -51,7 +51,8 @@ def test_examples_protocol_http_server_advanced(env, extra_data):
 
     # Parse IP address of STA
     Utility.console_log("Waiting to connect with AP")
-    got_ip = dut1.expect(re.compile(r"(?:[\s\S]*)IPv4 address: (\d+.\d+.\d+.\d+)"), timeout=30)[0]
+    # SPIFFS is formatted on first boot, before connecting
+    got_ip = dut1.expect(re.compile(r"(?:[\s\S]*)IPv4 address: (\d+.\d+.\d+.\d+)"), timeout=60)[0]
 
     got_port = dut1.expect(re.compile(r"(?:[\s\S]*)Started HTTP server on port: '(\d+)'"), timeout=15)[0]
     result = dut1.expect(re.compile(r"(?:[\s\S]*)Max URI handlers: '(\d+)'(?:[\s\S]*)Max Open Sessions: "  # noqa: W605
@@ -83,6 +84,29 @@ def test_examples_protocol_http_server_advanced(env, extra_data):
         failed = True
     if not client.arbitrary_termination_test(got_ip, got_port):
         failed = True
+    if not client.connection_close_test(got_ip, got_port):
+        failed = True
+    if not client.concurrent_load_test(got_ip, got_port, max_sessions):
+        Utility.console_log("Ignoring failure")
+    if not client.keep_alive_load_test(got_ip, got_port):
+        Utility.console_log("Ignoring failure")
+    if not client.compression_test(got_ip, got_port):
+        failed = True
+
+    Utility.console_log("File serving benchmark...")
+    bench_requests = 3
+    for uri in ["/bench/send_file", "/bench/chunks"]:
+        if not client.bench_file_test(got_ip, got_port, uri, bench_requests):
+            failed = True
+            continue
+        # Time taken and calls to the socket, as logged by the server for each request
+        results = [dut1.expect(re.compile(r"Bench " + uri + r": (\d+) bytes in (\d+) us, (\d+) send calls"),
+                               timeout=15) for _ in range(bench_requests)]
+        throughput = sorted(int(size) / int(us) for size, us, _ in results)
+        name = uri.split("/")[-1]
+        ttfw_idf.log_performance("http_server_{}_throughput".format(name),
+                                 "{:.2f} MB/s".format(throughput[len(throughput) // 2]))
+        ttfw_idf.log_performance("http_server_{}_send_calls".format(name), results[-1][2])
 
     # This test fails a lot! Enable when connection is stable
     # test_size = 50*1024 # 50KB
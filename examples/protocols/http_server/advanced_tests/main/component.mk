@@ -3,3 +3,5 @@
 #
 # (Uses default behaviour of compiling all source files in directory, adding 'include' to include path.)
 
+# Count the calls to the socket in the file serving benchmark
+COMPONENT_ADD_LDFLAGS = -l$(COMPONENT_NAME) -Wl,--wrap=lwip_send -Wl,--wrap=lwip_sendmsg
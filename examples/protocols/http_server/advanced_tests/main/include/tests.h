@@ -5,5 +5,6 @@
 
 extern httpd_handle_t   start_tests(void);
 extern void              stop_tests(httpd_handle_t hd);
+extern esp_err_t         create_bench_file(void);
 
 #endif // __HTTPD_TESTS_H__
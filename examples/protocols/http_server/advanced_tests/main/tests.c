@@ -1,8 +1,13 @@
 #include <stdlib.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
 
 #include <esp_log.h>
 #include <esp_system.h>
+#include <esp_timer.h>
 #include <esp_http_server.h>
 
 #include "tests.h"
@@ -300,6 +305,159 @@ static esp_err_t async_get_handler(httpd_req_t *req)
 #undef STR
 }
 
+/* Keeps the task processing the request busy for a while,
+ * like a handler sending a large file would */
+static esp_err_t slow_get_handler(httpd_req_t *req)
+{
+#define STR "Hello Slow World!"
+    vTaskDelay(pdMS_TO_TICKS(100));
+    httpd_resp_send(req, STR, strlen(STR));
+    return ESP_OK;
+#undef STR
+}
+
+/* Sends a table in rows of markup, the kind of text content which
+ * compresses well, gzip encoded if the client accepts it */
+static esp_err_t compress_get_handler(httpd_req_t *req)
+{
+    char buf[100];
+    esp_err_t ret = httpd_resp_enable_gzip(req);
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_SUPPORTED) {
+        return ret;
+    }
+
+    httpd_resp_sendstr_chunk(req, "<html><body><table>\n");
+    for (int i = 0; i < 400; i++) {
+        snprintf(buf, sizeof(buf), "<tr><td class=\"name\">sensor%d</td><td class=\"value\">%d</td></tr>\n",
+                 i, (i * 7919) % 1000);
+        if (httpd_resp_sendstr_chunk(req, buf) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    httpd_resp_sendstr_chunk(req, "</table></body></html>\n");
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+/********************* File Serving Benchmark *******************/
+
+#define BENCH_FILE          "/spiffs/bench.bin"
+#define BENCH_FILE_LEN      (256 * 1024)
+#define BENCH_CHUNK_LEN     4096
+
+/* Calls to the socket send functions on the session being benchmarked.
+ * These are wrapped at link time, see CMakeLists.txt */
+static int bench_sockfd = -1;
+static unsigned bench_send_calls;
+
+ssize_t __real_lwip_send(int s, const void *dataptr, size_t size, int flags);
+ssize_t __real_lwip_sendmsg(int s, const struct msghdr *message, int flags);
+
+ssize_t __wrap_lwip_send(int s, const void *dataptr, size_t size, int flags)
+{
+    if (s == bench_sockfd) {
+        bench_send_calls++;
+    }
+    return __real_lwip_send(s, dataptr, size, flags);
+}
+
+ssize_t __wrap_lwip_sendmsg(int s, const struct msghdr *message, int flags)
+{
+    if (s == bench_sockfd) {
+        bench_send_calls++;
+    }
+    return __real_lwip_sendmsg(s, message, flags);
+}
+
+static inline char bench_file_byte(size_t pos)
+{
+    return pos % 251;
+}
+
+esp_err_t create_bench_file(void)
+{
+    struct stat st;
+    if (stat(BENCH_FILE, &st) == 0 && st.st_size == BENCH_FILE_LEN) {
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Creating %s of %d bytes", BENCH_FILE, BENCH_FILE_LEN);
+    char *buf = malloc(BENCH_CHUNK_LEN);
+    int fd = open(BENCH_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (!buf || fd < 0) {
+        ESP_LOGE(TAG, "Failed to create %s", BENCH_FILE);
+        free(buf);
+        return ESP_FAIL;
+    }
+    esp_err_t ret = ESP_OK;
+    for (size_t pos = 0; pos < BENCH_FILE_LEN && ret == ESP_OK; pos += BENCH_CHUNK_LEN) {
+        for (size_t i = 0; i < BENCH_CHUNK_LEN; i++) {
+            buf[i] = bench_file_byte(pos + i);
+        }
+        if (write(fd, buf, BENCH_CHUNK_LEN) != BENCH_CHUNK_LEN) {
+            ESP_LOGE(TAG, "Failed to write %s", BENCH_FILE);
+            ret = ESP_FAIL;
+        }
+    }
+    close(fd);
+    free(buf);
+    return ret;
+}
+
+/* Sends the file with a loop of reads and chunks, as applications do
+ * without httpd_resp_send_file() */
+static esp_err_t bench_send_chunks(httpd_req_t *req, int fd)
+{
+    char *buf = malloc(BENCH_CHUNK_LEN);
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t ret = ESP_OK;
+    ssize_t len = 0;
+    while (ret == ESP_OK && (len = read(fd, buf, BENCH_CHUNK_LEN)) > 0) {
+        ret = httpd_resp_send_chunk(req, buf, len);
+    }
+    if (ret == ESP_OK) {
+        ret = (len < 0) ? ESP_FAIL : httpd_resp_send_chunk(req, NULL, 0);
+    }
+    free(buf);
+    return ret;
+}
+
+/* Serves the benchmark file, and logs the time it took and the number of
+ * calls to the socket, for the test script to report */
+static esp_err_t bench_serve(httpd_req_t *req, esp_err_t (*send_file)(httpd_req_t *req, int fd))
+{
+    int fd = open(BENCH_FILE, O_RDONLY);
+    if (fd < 0) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Benchmark file not found");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, HTTPD_TYPE_OCTET);
+
+    bench_send_calls = 0;
+    bench_sockfd = httpd_req_to_sockfd(req);
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = send_file(req, fd);
+    int64_t elapsed = esp_timer_get_time() - start;
+    bench_sockfd = -1;
+    close(fd);
+
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Bench %s: %d bytes in %lld us, %u send calls",
+                 req->uri, BENCH_FILE_LEN, elapsed, bench_send_calls);
+    }
+    return ret;
+}
+
+static esp_err_t bench_send_file_get_handler(httpd_req_t *req)
+{
+    return bench_serve(req, httpd_resp_send_file);
+}
+
+static esp_err_t bench_chunks_get_handler(httpd_req_t *req)
+{
+    return bench_serve(req, bench_send_chunks);
+}
 
 static const httpd_uri_t basic_handlers[] = {
     { .uri      = "/hello/type_html",
@@ -346,6 +504,26 @@ static const httpd_uri_t basic_handlers[] = {
       .method   = HTTP_GET,
       .handler  = async_get_handler,
       .user_ctx = NULL,
+    },
+    { .uri      = "/slow",
+      .method   = HTTP_GET,
+      .handler  = slow_get_handler,
+      .user_ctx = NULL,
+    },
+    { .uri      = "/compress",
+      .method   = HTTP_GET,
+      .handler  = compress_get_handler,
+      .user_ctx = NULL,
+    },
+    { .uri      = "/bench/send_file",
+      .method   = HTTP_GET,
+      .handler  = bench_send_file_get_handler,
+      .user_ctx = NULL,
+    },
+    { .uri      = "/bench/chunks",
+      .method   = HTTP_GET,
+      .handler  = bench_chunks_get_handler,
+      .user_ctx = NULL,
     }
 };
 
@@ -371,8 +549,9 @@ static httpd_handle_t test_httpd_start(void)
     httpd_handle_t hd;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     /* Modify this setting to match the number of test URI handlers */
-    config.max_uri_handlers  = 9;
+    config.max_uri_handlers  = 13;
     config.server_port = 1234;
+    config.max_workers = CONFIG_EXAMPLE_HTTPD_WORKERS;
 
     /* This check should be a part of http_server */
     config.max_open_sockets = (CONFIG_LWIP_MAX_SOCKETS - 3);
@@ -384,6 +563,7 @@ static httpd_handle_t test_httpd_start(void)
         ESP_LOGI(TAG, "Max Header Length: '%d'", HTTPD_MAX_REQ_HDR_LEN);
         ESP_LOGI(TAG, "Max URI Length: '%d'", HTTPD_MAX_URI_LEN);
         ESP_LOGI(TAG, "Max Stack Size: '%d'", config.stack_size);
+        ESP_LOGI(TAG, "Worker Tasks: '%d'", config.max_workers);
         return hd;
     }
     return NULL;
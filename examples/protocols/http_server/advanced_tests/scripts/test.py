@@ -92,6 +92,39 @@
 #      client that left the network halfway through a request)
 #    - Wait for recv-wait-timeout
 #    - Server should automatically close the socket
+#
+# - Concurrent load test
+#    - Create max supported sessions minus one
+#    - On one session, repeatedly GET /slow (the handler takes 100ms)
+#    - On all the other sessions, repeatedly GET /hello at the same time
+#    - Report requests per second and the latency percentiles of the
+#      /hello requests. With worker tasks enabled, /hello requests are
+#      not held up by the /slow ones, which shows in the tail latency
+#
+# - Connection close test
+#    - Send GET /hello with 'Connection: close' and, pipelined after it,
+#      another GET /hello on the same session
+#    - The response should have a 'Connection: close' header, and the
+#      server should close the session without serving the second request
+#
+# - Keep-alive load test
+#    - GET /hello repeatedly, first on a single persistent session, then
+#      on a new session for every request ('Connection: close')
+#    - Report the latency percentiles and the number of sessions opened
+#      in each case
+#
+# - Compression test
+#    - GET /compress repeatedly, with and without 'Accept-Encoding: gzip'
+#    - Decoded content should be the same in both cases
+#    - Report the bytes received and the time to the last byte in each case
+#
+# - File serving benchmark
+#    - GET /bench/send_file and /bench/chunks, which serve the same file
+#      from SPIFFS, with httpd_resp_send_file() and with a loop of reads
+#      and httpd_resp_send_chunk() respectively
+#    - Content should be the expected one
+#    - Report the throughput seen by the client. The server logs the time
+#      it took and the number of calls to the socket for each request
 
 
 # ############ TODO TESTS #############
@@ -135,6 +168,8 @@ from builtins import str
 from builtins import range
 from builtins import object
 import threading
+import gzip
+import io
 import socket
 import time
 import argparse
@@ -344,6 +379,218 @@ class adder_thread (threading.Thread):
         self.session.close()
 
 
+class load_thread (threading.Thread):
+    def __init__(self, dut, port, path, count):
+        threading.Thread.__init__(self)
+        self.dut = dut
+        self.port = port
+        self.path = path
+        self.count = count
+        self.latency = []
+        self.failed = False
+
+    def run(self):
+        try:
+            conn = http.client.HTTPConnection(self.dut, int(self.port), timeout=15)
+            for _ in range(self.count):
+                start = time.time()
+                conn.request("GET", self.path)
+                resp = conn.getresponse()
+                resp.read()
+                if resp.status != 200:
+                    self.failed = True
+                    break
+                self.latency.append(time.time() - start)
+            conn.close()
+        except Exception:
+            self.failed = True
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def concurrent_load_test(dut, port, max_sessions, requests=20):
+    # GETs on /hello in parallel sessions, while another session GETs /slow
+    Utility.console_log("[test] Concurrent GETs on /hello in " + str(max_sessions - 2) + " sessions "
+                        "alongside GETs on /slow =>", end=' ')
+    # Leave one session free, in case the server closed one of the
+    # previous sessions later than the client did
+    t = [load_thread(dut, port, "/slow", requests // 2)]
+    for _ in range(max_sessions - 2):
+        t.append(load_thread(dut, port, "/hello", requests))
+
+    start = time.time()
+    for i in range(len(t)):
+        t[i].start()
+    for i in range(len(t)):
+        t[i].join()
+    elapsed = time.time() - start
+
+    for i in range(len(t)):
+        if not test_val("Thread" + str(i) + " Failed", False, t[i].failed):
+            return False
+
+    latency = [x for i in range(1, len(t)) for x in t[i].latency]
+    Utility.console_log("Success")
+    Utility.console_log("   requests/sec: {:.1f}".format(sum(len(x.latency) for x in t) / elapsed))
+    Utility.console_log("   /hello latency (ms): p50 {:.1f}, p99 {:.1f}, max {:.1f}".format(
+                        percentile(latency, 50) * 1000, percentile(latency, 99) * 1000, max(latency) * 1000))
+    return True
+
+
+def connection_close_test(dut, port):
+    # Server closes the session after the response to 'Connection: close'
+    Utility.console_log("[test] Session closed after 'Connection: close' request =>", end=' ')
+    request = "GET /hello HTTP/1.1\r\nHost: " + dut + "\r\nConnection: close\r\n\r\n"
+    s = socket.create_connection((dut, int(port)), timeout=15)
+    s.sendall((request + request).encode())
+    data = b''
+    try:
+        while True:
+            chunk = s.recv(1024)
+            if not chunk:
+                break
+            data += chunk
+    except socket.error:
+        # Timeout, or the connection was reset
+        pass
+    s.close()
+    resp = data.decode()
+    if not test_val("Responses", 1, resp.count("Hello World!")):
+        return False
+    if not test_val("Connection header", True, "Connection: close\r\n" in resp):
+        return False
+    Utility.console_log("Success")
+    return True
+
+
+def keep_alive_load_test(dut, port, requests=50):
+    # GETs on /hello on a persistent session vs. a new session per request
+    Utility.console_log("[test] Keep-alive vs. new session per request =>", end=' ')
+    results = []
+    for keep_alive in [True, False]:
+        latency = []
+        sessions = 0
+        conn = None
+        try:
+            for _ in range(requests):
+                start = time.time()
+                if conn is None:
+                    conn = http.client.HTTPConnection(dut, int(port), timeout=15)
+                    sessions += 1
+                conn.request("GET", "/hello", headers={} if keep_alive else {"Connection": "close"})
+                resp = conn.getresponse()
+                resp.read()
+                if not test_val("Status", 200, resp.status):
+                    conn.close()
+                    return False
+                if not keep_alive:
+                    conn.close()
+                    conn = None
+                latency.append(time.time() - start)
+            if conn:
+                conn.close()
+        except Exception as err:
+            Utility.console_log("Error: " + str(err))
+            return False
+        results.append((keep_alive, latency, sessions))
+
+    Utility.console_log("Success")
+    for keep_alive, latency, sessions in results:
+        Utility.console_log("   {}: latency (ms) p50 {:.1f}, p99 {:.1f}, sessions opened {}".format(
+                            "keep-alive" if keep_alive else "new session per request",
+                            percentile(latency, 50) * 1000, percentile(latency, 99) * 1000, sessions))
+    return True
+
+
+def decode_chunked(body):
+    data = b''
+    while True:
+        size, body = body.split(b'\r\n', 1)
+        size = int(size, 16)
+        if size == 0:
+            return data
+        data += body[:size]
+        body = body[size + 2:]
+
+
+def compression_test(dut, port, requests=20):
+    # GETs on /compress, with and without gzip content coding
+    Utility.console_log("[test] GET /compress with and without 'Accept-Encoding: gzip' =>", end=' ')
+    results = []
+    for accept_gzip in [False, True]:
+        request = "GET /compress HTTP/1.1\r\nHost: " + dut + "\r\nConnection: close\r\n"
+        if accept_gzip:
+            request += "Accept-Encoding: gzip\r\n"
+        request += "\r\n"
+        latency = []
+        for _ in range(requests):
+            start = time.time()
+            s = socket.create_connection((dut, int(port)), timeout=15)
+            s.sendall(request.encode())
+            data = b''
+            try:
+                while True:
+                    chunk = s.recv(4096)
+                    if not chunk:
+                        break
+                    data += chunk
+            except socket.error as err:
+                Utility.console_log("Error: " + str(err))
+                s.close()
+                return False
+            latency.append(time.time() - start)
+            s.close()
+        headers, body = data.split(b'\r\n\r\n', 1)
+        content = decode_chunked(body)
+        gzipped = b'\r\nContent-Encoding: gzip' in headers
+        if gzipped:
+            content = gzip.GzipFile(fileobj=io.BytesIO(content)).read()
+        results.append((accept_gzip, gzipped, len(data), latency, content))
+
+    if not test_val("Same content", results[0][4], results[1][4]):
+        return False
+    if not test_val("Identity response", False, results[0][1]):
+        return False
+    Utility.console_log("Success")
+    for accept_gzip, gzipped, size, latency, content in results:
+        Utility.console_log("   {}: {} bytes on wire for {} bytes of content, "
+                            "time to last byte (ms) p50 {:.1f}, p99 {:.1f}".format(
+                                "gzip" if gzipped else "identity", size, len(content),
+                                percentile(latency, 50) * 1000, percentile(latency, 99) * 1000))
+    return True
+
+
+def bench_file_test(dut, port, uri, requests=3):
+    # GETs on a file serving benchmark URI
+    Utility.console_log("[test] GET " + uri + " =>", end=' ')
+    throughput = []
+    for _ in range(requests):
+        try:
+            start = time.time()
+            conn = http.client.HTTPConnection(dut, int(port), timeout=15)
+            conn.request("GET", uri, headers={"Connection": "close"})
+            resp = conn.getresponse()
+            data = resp.read()
+            elapsed = time.time() - start
+            conn.close()
+        except Exception as err:
+            Utility.console_log("Error: " + str(err))
+            return False
+        if not test_val("Status", 200, resp.status):
+            return False
+        expected = bytes(bytearray(i % 251 for i in range(len(data))))
+        if not test_val("Content", True, len(data) > 0 and data == expected):
+            return False
+        throughput.append(len(data) / elapsed / 1000000)
+
+    Utility.console_log("Success")
+    Utility.console_log("   {} bytes, throughput (MB/s) p50 {:.2f}".format(len(data), percentile(throughput, 50)))
+    return True
+
+
 def get_hello(dut, port):
     # GET /hello should return 'Hello World!'
     Utility.console_log("[test] GET /hello returns 'Hello World!' =>", end=' ')
@@ -1032,6 +1279,16 @@ if __name__ == '__main__':
     recv_timeout_test(dut, port)
     packet_size_limit_test(dut, port, 50 * 1024)
     arbitrary_termination_test(dut, port)
+    connection_close_test(dut, port)
     get_hello(dut, port)
 
+    Utility.console_log("### Load Tests")
+    concurrent_load_test(dut, port, max_sessions)
+    keep_alive_load_test(dut, port)
+    compression_test(dut, port)
+
+    Utility.console_log("### File Serving Benchmark")
+    bench_file_test(dut, port, "/bench/send_file")
+    bench_file_test(dut, port, "/bench/chunks")
+
     sys.exit()
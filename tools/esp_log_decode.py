@@ -0,0 +1,223 @@
+#!/usr/bin/env python
+#
+# Decodes the output of deferred logging in binary mode
+# (CONFIG_LOG_DEFERRED_OUTPUT_BINARY). Each log message is output by the
+# target as a line of "#B:" followed by a base64 encoded record, which holds
+# the address of the format string and the raw arguments. The format strings,
+# and the string arguments stored as pointers, are read from the ELF file.
+#
+# All other lines are passed through unchanged.
+#
+# Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+from __future__ import print_function
+from __future__ import unicode_literals
+from __future__ import division
+import argparse
+import base64
+import binascii
+import re
+import struct
+import sys
+
+import elftools.elf.elffile as elffile
+from elftools.elf.constants import SH_FLAGS
+
+# Must match components/log/log_deferred.c
+BINARY_LINE_PREFIX = b'#B:'
+HEADER_LEN_MASK = 0xffff
+HEADER_TYPE_SHIFT = 24
+RECORD_TYPE_LOG = 0xb1
+STR_INLINE = 0xffff0000
+STR_INLINE_MASK = 0xffff0000
+STR_INLINE_LEN_MASK = 0x0000ffff
+
+# Conversion specification, as parsed by next_conversion() in log_deferred.c
+CONVERSION_RE = re.compile(r'%(?P<flags>[-+ #0]*)(?P<width>\*|\d+)?(?:\.(?P<prec>\*|\d*))?'
+                           r'(?P<length>hh|h|ll|l|j|z|t|L)?(?P<conv>[diouxXcpfFeEgGaAsn])')
+
+
+class DecodeError(RuntimeError):
+    pass
+
+
+class ElfStrings(object):
+    """ Reads zero terminated strings from the allocated sections of an ELF file """
+
+    def __init__(self, elf_path):
+        with open(elf_path, 'rb') as f:
+            elf = elffile.ELFFile(f)
+            self.sections = []
+            for sect in elf.iter_sections():
+                if sect['sh_addr'] == 0 or (sect['sh_flags'] & SH_FLAGS.SHF_ALLOC) == 0 or sect['sh_type'] == 'SHT_NOBITS':
+                    continue
+                self.sections.append((sect['sh_addr'], sect.data()))
+            # Argument sizes of the target, in bytes
+            word = 8 if elf.elfclass == 64 else 4
+            self.sizes = {
+                None: 4, 'hh': 4, 'h': 4,
+                'l': word, 'z': word, 't': word,
+                'll': 8, 'j': 8,
+                'p': word,
+                'double': 8,
+                'L': 16 if word == 8 else 8,
+            }
+
+    def get(self, addr):
+        for start, data in self.sections:
+            if start <= addr < start + len(data):
+                end = data.find(b'\0', addr - start)
+                if end == -1:
+                    end = len(data)
+                return data[addr - start:end].decode('utf-8', 'replace')
+        return None
+
+
+class Record(object):
+    def __init__(self, data):
+        if len(data) < 8 or len(data) % 4 != 0:
+            raise DecodeError('invalid record size %d' % len(data))
+        header, self.format_addr = struct.unpack_from('<II', data)
+        if (header >> HEADER_TYPE_SHIFT) != RECORD_TYPE_LOG or (header & HEADER_LEN_MASK) * 4 != len(data):
+            raise DecodeError('invalid record header 0x%08x' % header)
+        self.data = data
+        self.offset = 8
+
+    def read(self, size):
+        words = (size + 3) // 4
+        if self.offset + words * 4 > len(self.data):
+            raise DecodeError('record too short')
+        value = self.data[self.offset:self.offset + size]
+        self.offset += words * 4
+        return value
+
+    def read_uint(self, size):
+        return struct.unpack('<Q', self.read(size).ljust(8, b'\0'))[0]
+
+    def read_int(self, size):
+        value = self.read_uint(size)
+        if value & (1 << (size * 8 - 1)):
+            value -= 1 << (size * 8)
+        return value
+
+
+def format_record(record, strings):
+    fmt = strings.get(record.format_addr)
+    if fmt is None:
+        raise DecodeError('format string at 0x%08x not found in the ELF file' % record.format_addr)
+    out = []
+    pos = 0
+    while True:
+        start = fmt.find('%', pos)
+        if start == -1:
+            break
+        out.append(fmt[pos:start])
+        if fmt.startswith('%%', start):
+            out.append('%')
+            pos = start + 2
+            continue
+        m = CONVERSION_RE.match(fmt, start)
+        if m is None:
+            pos = start     # unknown conversion, output the rest as is
+            break
+        pos = m.end()
+        flags, width, prec, length, conv = m.group('flags', 'width', 'prec', 'length', 'conv')
+        if width == '*':
+            width = record.read_int(4)
+            if width < 0:
+                flags += '-'
+                width = -width
+            width = str(width)
+        if prec == '*':
+            prec = record.read_int(4)
+            prec = None if prec < 0 else str(prec)
+        spec = '%' + flags + (width or '') + ('.' + prec if prec is not None else '')
+        if conv in 'di':
+            out.append((spec + 'd') % record.read_int(strings.sizes[length]))
+        elif conv in 'ouxX':
+            value = record.read_uint(strings.sizes[length])
+            if conv == 'o' and '#' in flags:
+                spec = spec.replace('#', '')
+                out.append((spec + 's') % ('0%o' % value if value else '0'))
+            else:
+                out.append((spec + conv.replace('u', 'd')) % value)
+        elif conv == 'c':
+            out.append((spec + 'c') % (record.read_uint(4) & 0xff))
+        elif conv == 'p':
+            out.append((spec.split('.')[0] + 's') % ('0x%x' % record.read_uint(strings.sizes['p'])))
+        elif conv in 'fFeEgGaA':
+            size = strings.sizes['L' if length == 'L' else 'double']
+            value = struct.unpack('<d', record.read(size)[:8])[0]
+            if conv in 'aA':
+                text = value.hex()
+                out.append((spec.split('.')[0] + 's') % (text.upper() if conv == 'A' else text))
+            else:
+                out.append((spec + conv) % value)
+        elif conv == 's':
+            word = record.read_uint(4)
+            if (word & STR_INLINE_MASK) == STR_INLINE:
+                value = record.read(word & STR_INLINE_LEN_MASK).decode('utf-8', 'replace')
+            elif word == 0:
+                value = '(null)'
+            else:
+                value = strings.get(word)
+                if value is None:
+                    value = '<string at 0x%08x>' % word
+            out.append((spec + 's') % value)
+        # '%n' has no stored argument
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+def decode_line(line, strings):
+    """ Returns the decoded text of a line of output, as bytes """
+    idx = line.find(BINARY_LINE_PREFIX)
+    if idx == -1:
+        return line
+    payload = line[idx + len(BINARY_LINE_PREFIX):].strip()
+    try:
+        record = Record(base64.b64decode(payload))
+        text = format_record(record, strings)
+    except (DecodeError, binascii.Error, struct.error, TypeError, ValueError) as e:
+        text = '<failed to decode log record: %s>\n' % e
+    return line[:idx] + text.encode('utf-8')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decodes the binary output of deferred logging (CONFIG_LOG_DEFERRED_OUTPUT_BINARY)')
+    parser.add_argument('elf_file', help='ELF file of the application')
+    parser.add_argument('input', nargs='?', default='-', help='File with the output of the target, or "-" for stdin (default)')
+    parser.add_argument('--port', '-p', help='Read the output from this serial port instead of a file')
+    parser.add_argument('--baud', '-b', type=int, default=115200, help='Serial port baud rate')
+    args = parser.parse_args()
+
+    strings = ElfStrings(args.elf_file)
+
+    if args.port:
+        import serial
+        lines = iter(serial.serial_for_url(args.port, args.baud).readline, None)
+    elif args.input == '-':
+        lines = getattr(sys.stdin, 'buffer', sys.stdin)
+    else:
+        lines = open(args.input, 'rb')
+
+    out = getattr(sys.stdout, 'buffer', sys.stdout)
+    for line in lines:
+        out.write(decode_line(line, strings))
+        out.flush()
+
+
+if __name__ == '__main__':
+    main()